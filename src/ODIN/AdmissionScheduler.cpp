@@ -0,0 +1,153 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "AdmissionScheduler.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+CAdmissionScheduler::CAdmissionScheduler(unsigned maxConcurrent, unsigned settleTime, double minGain)
+{
+  fMaxConcurrent = maxConcurrent;
+  fSettleTime = settleTime;
+  fMinGain = minGain;
+}
+
+CAdmissionScheduler::TGroup& CAdmissionScheduler::GetGroup(const wstring& group)
+{
+  map<wstring, TGroup>::iterator it = fGroups.find(group);
+  if (it == fGroups.end()) {
+    TGroup newGroup;
+    newGroup.limit = 1;
+    newGroup.saturated = false;
+    newGroup.running = 0;
+    newGroup.changeTime = 0;
+    it = fGroups.insert(make_pair(group, newGroup)).first;
+  }
+  return it->second;
+}
+
+bool CAdmissionScheduler::MayStart(const wstring& group) const
+{
+  if (fClones.size() >= fMaxConcurrent)
+    return false;
+  map<wstring, TGroup>::const_iterator it = fGroups.find(group);
+  return it == fGroups.end() || it->second.running < it->second.limit;
+}
+
+void CAdmissionScheduler::OnStarted(int slot, const wstring& group, unsigned __int64 now)
+{
+  if (fClones.find(slot) != fClones.end())
+    OnFinished(slot, now);
+  TClone clone;
+  clone.group = group;
+  clone.rate = 0;
+  clone.rateTime = 0;
+  fClones[slot] = clone;
+  TGroup& g = GetGroup(group);
+  ++g.running;
+  g.changeTime = now;
+}
+
+void CAdmissionScheduler::OnFinished(int slot, unsigned __int64 now)
+{
+  map<int, TClone>::iterator it = fClones.find(slot);
+  if (it == fClones.end())
+    return;
+  TGroup& g = GetGroup(it->second.group);
+  --g.running;
+  g.changeTime = now;
+  fClones.erase(it);
+}
+
+void CAdmissionScheduler::OnRate(int slot, unsigned __int64 bytesPerSecond, unsigned __int64 now)
+{
+  map<int, TClone>::iterator it = fClones.find(slot);
+  if (it == fClones.end())
+    return;
+  it->second.rate = bytesPerSecond;
+  it->second.rateTime = now;
+  Measure(GetGroup(it->second.group), it->second.group, now);
+}
+
+// sum the rates of the clones of group once all of them reported after the settle time
+void CAdmissionScheduler::Measure(TGroup& group, const wstring& name, unsigned __int64 now)
+{
+  if (group.running == 0 || now < group.changeTime + fSettleTime)
+    return;
+  unsigned __int64 sum = 0;
+  for (map<int, TClone>::const_iterator it = fClones.begin(); it != fClones.end(); ++it) {
+    if (it->second.group != name)
+      continue;
+    if (it->second.rateTime < group.changeTime + fSettleTime)
+      return;
+    sum += it->second.rate;
+  }
+  unsigned n = group.running;
+  if (group.rates.size() <= n)
+    group.rates.resize(n + 1, 0);
+  // smooth the rates of the progress reports
+  group.rates[n] = group.rates[n] ? (group.rates[n] * 3 + sum) / 4 : sum;
+
+  // decide once for each count, when the group runs at its limit
+  if (n != group.limit || group.saturated)
+    return;
+  if (n == 1 || group.rates[n] >= (unsigned __int64) (group.rates[n-1] * (1.0 + fMinGain))) {
+    group.limit = n + 1;
+  } else {
+    group.limit = n - 1;
+    group.saturated = true;
+  }
+}
+
+unsigned CAdmissionScheduler::GetLimit(const wstring& group) const
+{
+  map<wstring, TGroup>::const_iterator it = fGroups.find(group);
+  return it == fGroups.end() ? 1 : it->second.limit;
+}
+
+bool CAdmissionScheduler::IsSaturated(const wstring& group) const
+{
+  map<wstring, TGroup>::const_iterator it = fGroups.find(group);
+  return it != fGroups.end() && it->second.saturated;
+}
+
+unsigned CAdmissionScheduler::GetRunning(const wstring& group) const
+{
+  map<wstring, TGroup>::const_iterator it = fGroups.find(group);
+  return it == fGroups.end() ? 0 : it->second.running;
+}
+
+unsigned __int64 CAdmissionScheduler::GetMeasuredRate(const wstring& group, unsigned count) const
+{
+  map<wstring, TGroup>::const_iterator it = fGroups.find(group);
+  if (it == fGroups.end() || count >= it->second.rates.size())
+    return 0;
+  return it->second.rates[count];
+}
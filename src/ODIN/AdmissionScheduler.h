@@ -0,0 +1,101 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __ADMISSIONSCHEDULER_H__
+#define __ADMISSIONSCHEDULER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CAdmissionScheduler decides how many clones may run at the same time on drives
+// that share a bus (a hub, a card reader or a port of a controller). Drives are put in
+// groups by the caller. A group starts with one clone. When its clones have run at the
+// same count for the settle time, their summed write rate is compared with the rate
+// measured with one clone less: if it rose by at least minGain one more clone may start,
+// otherwise the group has reached its plateau and stays at one clone less. At most
+// maxConcurrent clones run over all groups. Times are in milliseconds.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CAdmissionScheduler
+{
+public:
+  CAdmissionScheduler(unsigned maxConcurrent, unsigned settleTime = 8000, double minGain = 0.1);
+
+  void SetMaxConcurrent(unsigned maxConcurrent) {
+    fMaxConcurrent = maxConcurrent;
+  }
+
+  // may a clone to a drive of group start now
+  bool MayStart(const std::wstring& group) const;
+
+  // a clone to drive slot of group was started or has ended
+  void OnStarted(int slot, const std::wstring& group, unsigned __int64 now);
+  void OnFinished(int slot, unsigned __int64 now);
+
+  // write rate of the running clone to drive slot in bytes per second
+  void OnRate(int slot, unsigned __int64 bytesPerSecond, unsigned __int64 now);
+
+  // clones that may run at the same time in group
+  unsigned GetLimit(const std::wstring& group) const;
+
+  // true if more clones in group did not write faster
+  bool IsSaturated(const std::wstring& group) const;
+
+  unsigned GetRunning(const std::wstring& group) const;
+  unsigned GetRunning() const {
+    return (unsigned) fClones.size();
+  }
+
+  // summed rate of group measured with count clones running or 0
+  unsigned __int64 GetMeasuredRate(const std::wstring& group, unsigned count) const;
+
+private:
+  typedef struct {
+    unsigned limit;
+    bool saturated;
+    unsigned running;
+    unsigned __int64 changeTime;        // when running last changed
+    std::vector<unsigned __int64> rates; // rates[n]: summed rate with n clones, 0 if not measured
+  } TGroup;
+
+  typedef struct {
+    std::wstring group;
+    unsigned __int64 rate;
+    unsigned __int64 rateTime;          // when rate was reported
+  } TClone;
+
+  TGroup& GetGroup(const std::wstring& group);
+  void Measure(TGroup& group, const std::wstring& name, unsigned __int64 now);
+
+  unsigned fMaxConcurrent;
+  unsigned fSettleTime;
+  double fMinGain;
+  std::map<std::wstring, TGroup> fGroups;
+  std::map<int, TClone> fClones;        // running clones by slot
+};
+
+#endif
@@ -0,0 +1,82 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <string.h>
+#include "BlockCompare.h"
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define HAVE_SSE2_COMPARE
+  #include <emmintrin.h>
+#endif
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CBlockCompare
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static const unsigned kStepSize = 64;
+
+#ifdef HAVE_SSE2_COMPARE
+// 64 bytes of data1 and data2 are equal
+static inline bool IsSameStep(const BYTE* data1, const BYTE* data2)
+{
+  const __m128i* p1 = (const __m128i*) data1;
+  const __m128i* p2 = (const __m128i*) data2;
+  __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(p1), _mm_loadu_si128(p2));
+  __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(p1 + 1), _mm_loadu_si128(p2 + 1));
+  __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(p1 + 2), _mm_loadu_si128(p2 + 2));
+  __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128(p1 + 3), _mm_loadu_si128(p2 + 3));
+  __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+  return _mm_movemask_epi8(eq) == 0xFFFF;
+}
+#endif
+
+bool CBlockCompare::IsSame(const BYTE* data1, const BYTE* data2, unsigned length)
+{
+#ifdef HAVE_SSE2_COMPARE
+  unsigned offset = 0;
+  for (; offset + kStepSize <= length; offset += kStepSize) {
+    if (!IsSameStep(data1 + offset, data2 + offset))
+      return false;
+  }
+  return memcmp(data1 + offset, data2 + offset, length - offset) == 0;
+#else
+  return memcmp(data1, data2, length) == 0;
+#endif
+}
+
+unsigned CBlockCompare::FindDifference(const BYTE* data1, const BYTE* data2, unsigned length)
+{
+  unsigned offset = 0;
+#ifdef HAVE_SSE2_COMPARE
+  while (offset + kStepSize <= length && IsSameStep(data1 + offset, data2 + offset))
+    offset += kStepSize;
+#endif
+  while (offset < length && data1[offset] == data2[offset])
+    ++offset;
+  return offset;
+}
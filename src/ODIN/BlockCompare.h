@@ -0,0 +1,44 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#pragma once
+#ifndef __BLOCKCOMPARE_H__
+#define __BLOCKCOMPARE_H__
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Comparison of memory blocks 64 bytes per step with SSE2, which every x64 processor
+// has. Other platforms use memcmp.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CBlockCompare
+{
+public:
+  // true if the length bytes of data1 and data2 are identical
+  static bool IsSame(const BYTE* data1, const BYTE* data2, unsigned length);
+
+  // offset of the first byte that differs or length if none
+  static unsigned FindDifference(const BYTE* data1, const BYTE* data2, unsigned length);
+};
+
+#endif
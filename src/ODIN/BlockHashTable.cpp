@@ -0,0 +1,184 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "BlockHashTable.h"
+#include "FileHeader.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CBlockHashTable
+
+const DWORD CBlockHashTable::sMagic = 0x5448424F; // "OBHT"
+
+CBlockHashTable::CBlockHashTable()
+{
+  Init(0, 0, 0);
+}
+
+CBlockHashTable::CBlockHashTable(DWORD blockSize, DWORD clusterSize, unsigned __int64 volumeSize)
+{
+  Init(blockSize, clusterSize, volumeSize);
+}
+
+void CBlockHashTable::Init(DWORD blockSize, DWORD clusterSize, unsigned __int64 volumeSize)
+{
+  fBlockSize = blockSize;
+  fClusterSize = clusterSize;
+  fVolumeSize = volumeSize;
+  fBaseFileName.clear();
+  memset(fBaseDigest, 0, sizeof(fBaseDigest));
+  fBlocks.clear();
+  if (blockSize > 0)
+    fBlocks.resize((size_t)((volumeSize + blockSize - 1) / blockSize));
+  if (!fBlocks.empty())
+    memset(&fBlocks[0], 0, fBlocks.size() * sizeof(TBlockHash));
+}
+
+void CBlockHashTable::SetBlockHash(unsigned __int64 blockNo, const BYTE* digest, DWORD flags)
+{
+  TBlockHash& block = fBlocks[(size_t)blockNo];
+  memcpy(block.digest, digest, sizeof(block.digest));
+  block.flags = flags;
+}
+
+bool CBlockHashTable::IsSameBlock(unsigned __int64 blockNo, const BYTE* digest, DWORD flags) const
+{
+  const TBlockHash& block = fBlocks[(size_t)blockNo];
+  return (block.flags & blockUsed) == (flags & blockUsed)
+    && memcmp(block.digest, digest, sizeof(block.digest)) == 0;
+}
+
+bool CBlockHashTable::IsCompatible(const CBlockHashTable& other) const
+{
+  return fBlockSize == other.fBlockSize && fClusterSize == other.fClusterSize
+    && fVolumeSize == other.fVolumeSize;
+}
+
+unsigned __int64 CBlockHashTable::GetStoredBlockCount() const
+{
+  unsigned __int64 count = 0;
+  for (size_t i=0; i<fBlocks.size(); i++)
+    if (fBlocks[i].flags & blockStored)
+      ++count;
+  return count;
+}
+
+void CBlockHashTable::SetBaseReference(LPCWSTR baseFileName, const BYTE* baseDigest)
+{
+  fBaseFileName = baseFileName ? baseFileName : L"";
+  if (baseDigest)
+    memcpy(fBaseDigest, baseDigest, sizeof(fBaseDigest));
+  else
+    memset(fBaseDigest, 0, sizeof(fBaseDigest));
+}
+
+void CBlockHashTable::GetTableDigest(BYTE* digest) const
+{
+  vector<BYTE> buffer;
+  Serialize(buffer);
+  CSha256 sha;
+  // hash in pieces to avoid truncating the length of big tables
+  const unsigned cPieceSize = 16 * 1024 * 1024;
+  for (size_t pos = 0; pos < buffer.size(); pos += cPieceSize) {
+    size_t count = buffer.size() - pos < cPieceSize ? buffer.size() - pos : cPieceSize;
+    sha.AddDataBlock(&buffer[pos], (unsigned)count);
+  }
+  sha.GetResult(digest);
+}
+
+void CBlockHashTable::AddRunToDigest(CSha256& sha, DWORD offsetInBlock, const BYTE* data, unsigned length)
+{
+  // the position is part of the digest, so moving data inside a block or
+  // changing the allocation of a block changes its digest
+  DWORD runHeader[2] = { offsetInBlock, length };
+  sha.AddDataBlock((const BYTE*)runHeader, sizeof(runHeader));
+  sha.AddDataBlock(data, length);
+}
+
+unsigned __int64 CBlockHashTable::GetSerializedLength() const
+{
+  vector<BYTE> baseName;
+  CImageFileHeader::EncodeString(fBaseFileName, baseName);
+  return sizeof(TBlockHashTableHeader) + baseName.size() + fBlocks.size() * sizeof(TBlockHash);
+}
+
+void CBlockHashTable::Serialize(vector<BYTE>& buffer) const
+{
+  TBlockHashTableHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = sMagic;
+  header.format = CImageFileHeader::blockHashSHA256;
+  header.blockSize = fBlockSize;
+  header.clusterSize = fClusterSize;
+  header.volumeSize = fVolumeSize;
+  header.blockCount = fBlocks.size();
+  memcpy(header.baseDigest, fBaseDigest, sizeof(header.baseDigest));
+  // the name of the base image is UTF-16LE like the comment
+  vector<BYTE> baseName;
+  CImageFileHeader::EncodeString(fBaseFileName, baseName);
+  header.baseNameLength = (DWORD) baseName.size();
+
+  buffer.resize((size_t)GetSerializedLength());
+  BYTE* pos = &buffer[0];
+  memcpy(pos, &header, sizeof(header));
+  pos += sizeof(header);
+  if (header.baseNameLength > 0) {
+    memcpy(pos, &baseName[0], header.baseNameLength);
+    pos += header.baseNameLength;
+  }
+  if (!fBlocks.empty())
+    memcpy(pos, &fBlocks[0], fBlocks.size() * sizeof(TBlockHash));
+}
+
+void CBlockHashTable::Deserialize(const BYTE* buffer, unsigned __int64 length)
+{
+  TBlockHashTableHeader header;
+
+  if (length < sizeof(header))
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  memcpy(&header, buffer, sizeof(header));
+  if (header.magic != sMagic || header.format != CImageFileHeader::blockHashSHA256 || header.blockSize == 0
+      || header.clusterSize == 0 || header.baseNameLength % 2 != 0)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  if (header.blockCount != (header.volumeSize + header.blockSize - 1) / header.blockSize)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  if (length != sizeof(header) + header.baseNameLength + header.blockCount * sizeof(TBlockHash))
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+
+  Init(header.blockSize, header.clusterSize, header.volumeSize);
+  const BYTE* pos = buffer + sizeof(header);
+  fBaseFileName = CImageFileHeader::DecodeString(pos, header.baseNameLength);
+  memcpy(fBaseDigest, header.baseDigest, sizeof(fBaseDigest));
+  pos += header.baseNameLength;
+  if (!fBlocks.empty())
+    memcpy(&fBlocks[0], pos, fBlocks.size() * sizeof(TBlockHash));
+}
@@ -0,0 +1,145 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __BLOCKHASHTABLE_H__
+#define __BLOCKHASHTABLE_H__
+
+#include <string>
+#include <vector>
+#include "Sha256.h"
+
+//---------------------------------------------------------------------------
+// class CBlockHashTable
+// One SHA-256 digest per fixed size block of the original volume. Unlike the
+// block manifest the digests are taken from the raw volume data (only the used
+// clusters of a block and their position in the block), so the tables of two
+// backups of the same volume can be compared block by block. An image that
+// references a base image is an incremental image: its data area holds only the
+// used clusters of the blocks marked as stored, all other blocks are unchanged
+// since the base image was taken. The table is stored behind the data area
+// (see CFileImageStream).
+
+class CBlockHashTable {
+public:
+  typedef struct {
+    DWORD magic;                 // sMagic, to detect a damaged table
+    DWORD format;                // CImageFileHeader::BlockHashFormat
+    DWORD blockSize;             // size of volume area covered by one digest
+    DWORD clusterSize;           // cluster size of volume
+    unsigned __int64 volumeSize; // size of volume in bytes
+    unsigned __int64 blockCount; // number of block entries following the base reference
+    BYTE baseDigest[CSha256::sDigestLength]; // digest of the table of the base image
+    DWORD baseNameLength;        // length in bytes of base file name (0 for full images)
+    DWORD reserved;
+  } TBlockHashTableHeader;
+
+  typedef struct {
+    BYTE digest[CSha256::sDigestLength];
+    DWORD flags;                 // combination of TBlockFlags
+  } TBlockHash;
+
+  typedef enum { blockUsed = 1, blockStored = 2 } TBlockFlags;
+
+  CBlockHashTable();
+  CBlockHashTable(DWORD blockSize, DWORD clusterSize, unsigned __int64 volumeSize);
+
+  void Init(DWORD blockSize, DWORD clusterSize, unsigned __int64 volumeSize);
+
+  DWORD GetBlockSize() const {
+    return fBlockSize;
+  }
+
+  DWORD GetClusterSize() const {
+    return fClusterSize;
+  }
+
+  unsigned __int64 GetVolumeSize() const {
+    return fVolumeSize;
+  }
+
+  unsigned __int64 GetBlockCount() const {
+    return fBlocks.size();
+  }
+
+  void SetBlockHash(unsigned __int64 blockNo, const BYTE* digest, DWORD flags);
+
+  const BYTE* GetBlockDigest(unsigned __int64 blockNo) const {
+    return fBlocks[(size_t)blockNo].digest;
+  }
+
+  bool IsUsed(unsigned __int64 blockNo) const {
+    return (fBlocks[(size_t)blockNo].flags & blockUsed) != 0;
+  }
+
+  // true if the used clusters of the block are contained in the image data
+  bool IsStored(unsigned __int64 blockNo) const {
+    return (fBlocks[(size_t)blockNo].flags & blockStored) != 0;
+  }
+
+  // true if block blockNo has the same contents as given by digest and flags
+  bool IsSameBlock(unsigned __int64 blockNo, const BYTE* digest, DWORD flags) const;
+
+  // true if both tables describe the same volume geometry
+  bool IsCompatible(const CBlockHashTable& other) const;
+
+  // number of blocks whose clusters are contained in the image data
+  unsigned __int64 GetStoredBlockCount() const;
+
+  // an incremental image refers to its base image by name and by the digest of its table
+  void SetBaseReference(LPCWSTR baseFileName, const BYTE* baseDigest);
+
+  bool IsIncremental() const {
+    return !fBaseFileName.empty();
+  }
+
+  LPCWSTR GetBaseFileName() const {
+    return fBaseFileName.c_str();
+  }
+
+  const BYTE* GetBaseDigest() const {
+    return fBaseDigest;
+  }
+
+  // digest identifying this table, referenced by images using this one as base
+  void GetTableDigest(BYTE* digest) const;
+
+  // add a range of used clusters at offset offsetInBlock of the current block to digest
+  static void AddRunToDigest(CSha256& sha, DWORD offsetInBlock, const BYTE* data, unsigned length);
+
+  unsigned __int64 GetSerializedLength() const;
+  void Serialize(std::vector<BYTE>& buffer) const;
+  void Deserialize(const BYTE* buffer, unsigned __int64 length);
+
+private:
+  static const DWORD sMagic;
+
+  DWORD fBlockSize;
+  DWORD fClusterSize;
+  unsigned __int64 fVolumeSize;
+  std::vector<TBlockHash> fBlocks;
+  std::wstring fBaseFileName;
+  BYTE fBaseDigest[CSha256::sDigestLength];
+};
+
+#endif
@@ -0,0 +1,151 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+#include "stdafx.h"
+#include "BlockManifest.h"
+#include "FileHeader.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CBlockManifest
+
+const DWORD CBlockManifest::sMagic = 0x464D424F; // "OBMF"
+
+CBlockManifest::CBlockManifest(DWORD blockSize)
+{
+  fBlockSize = blockSize;
+  Reset();
+}
+
+void CBlockManifest::Reset()
+{
+  fDataSize = 0;
+  fBytesInBlock = 0;
+  fCurrentCrc.Reset();
+  fChecksums.clear();
+}
+
+void CBlockManifest::AddData(const BYTE* data, unsigned length)
+{
+  fDataSize += length;
+  while (length > 0) {
+    unsigned count = fBlockSize - fBytesInBlock;
+    if (count > length)
+      count = length;
+    fCurrentCrc.AddDataBlock(data, count);
+    fBytesInBlock += count;
+    data += count;
+    length -= count;
+    if (fBytesInBlock == fBlockSize) {
+      fChecksums.push_back(fCurrentCrc.GetResult());
+      fCurrentCrc.Reset();
+      fBytesInBlock = 0;
+    }
+  }
+}
+
+void CBlockManifest::Finish()
+{
+  if (fBytesInBlock > 0) {
+    fChecksums.push_back(fCurrentCrc.GetResult());
+    fCurrentCrc.Reset();
+    fBytesInBlock = 0;
+  }
+}
+
+void CBlockManifest::Resume(const vector<DWORD>& checksums, unsigned __int64 dataSize, DWORD partialChecksum)
+{
+  if (checksums.size() != dataSize / fBlockSize)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  fChecksums = checksums;
+  fDataSize = dataSize;
+  fBytesInBlock = (unsigned) (dataSize % fBlockSize);
+  fCurrentCrc.Resume(partialChecksum);
+}
+
+unsigned CBlockManifest::GetBlockLength(unsigned __int64 blockNo) const
+{
+  unsigned __int64 begin = blockNo * fBlockSize;
+  if (begin >= fDataSize)
+    return 0;
+  unsigned __int64 remaining = fDataSize - begin;
+  return remaining < fBlockSize ? (unsigned) remaining : fBlockSize;
+}
+
+bool CBlockManifest::VerifyBlock(unsigned __int64 blockNo, const BYTE* data, unsigned length) const
+{
+  if (blockNo >= fChecksums.size() || length != GetBlockLength(blockNo))
+    return false;
+  return CCRC32C::Calculate(data, length) == fChecksums[(size_t)blockNo];
+}
+
+unsigned __int64 CBlockManifest::GetSerializedLength() const
+{
+  return sizeof(TBlockManifestHeader) + fChecksums.size() * sizeof(DWORD);
+}
+
+void CBlockManifest::Serialize(vector<BYTE>& buffer) const
+{
+  TBlockManifestHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = sMagic;
+  header.format = CImageFileHeader::blockManifestCRC32C;
+  header.blockSize = fBlockSize;
+  header.dataSize = fDataSize;
+  header.blockCount = fChecksums.size();
+
+  buffer.resize((size_t)GetSerializedLength());
+  memcpy(&buffer[0], &header, sizeof(header));
+  if (!fChecksums.empty())
+    memcpy(&buffer[sizeof(header)], &fChecksums[0], fChecksums.size() * sizeof(DWORD));
+}
+
+void CBlockManifest::Deserialize(const BYTE* buffer, unsigned __int64 length)
+{
+  TBlockManifestHeader header;
+
+  if (length < sizeof(header))
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  memcpy(&header, buffer, sizeof(header));
+  if (header.magic != sMagic || header.format != CImageFileHeader::blockManifestCRC32C || header.blockSize == 0)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  if (length != sizeof(header) + header.blockCount * sizeof(DWORD))
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  if (header.blockCount != (header.dataSize + header.blockSize - 1) / header.blockSize)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+
+  Reset();
+  fBlockSize = header.blockSize;
+  fDataSize = header.dataSize;
+  fChecksums.resize((size_t)header.blockCount);
+  if (!fChecksums.empty())
+    memcpy(&fChecksums[0], buffer + sizeof(header), fChecksums.size() * sizeof(DWORD));
+}
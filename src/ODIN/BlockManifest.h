@@ -0,0 +1,111 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+#pragma once
+#ifndef __BLOCKMANIFEST_H__
+#define __BLOCKMANIFEST_H__
+
+#include <vector>
+#include "crc32.h"
+
+// a range of bytes in an image file (offsets are file offsets, for split
+// images offsets in the concatenation of all files)
+typedef struct {
+  unsigned __int64 offset;
+  unsigned __int64 length;
+} TImageRange;
+
+//---------------------------------------------------------------------------
+// class CBlockManifest
+// One crc32c checksum per fixed size block of the data area of an image file.
+// The checksums are taken from the bytes as they are stored in the file (i.e.
+// after compression), so blocks can be checked independently of each other
+// without decompressing the image. The manifest is computed while the image
+// is written and stored behind the data area (see CFileImageStream).
+
+class CBlockManifest {
+public:
+  typedef struct {
+    DWORD magic;                 // sMagic, to detect a damaged manifest
+    DWORD format;                // CImageFileHeader::BlockManifestFormat
+    DWORD blockSize;             // size of data area covered by one checksum
+    DWORD reserved;
+    unsigned __int64 dataSize;   // total size of data area in bytes
+    unsigned __int64 blockCount; // number of checksums following this header
+  } TBlockManifestHeader;
+
+  CBlockManifest(DWORD blockSize);
+
+  void Reset();
+
+  // add next bytes of the data area, may span several blocks
+  void AddData(const BYTE* data, unsigned length);
+
+  // flush the checksum of a partially filled last block
+  void Finish();
+
+  // continue a manifest of which the checksums of the complete blocks and the checksum
+  // of the partially filled last block (GetPartialChecksum()) were saved, e.g. to
+  // resume an interrupted backup
+  void Resume(const std::vector<DWORD>& checksums, unsigned __int64 dataSize, DWORD partialChecksum);
+
+  DWORD GetPartialChecksum() const {
+    return fCurrentCrc.GetResult();
+  }
+
+  DWORD GetBlockSize() const {
+    return fBlockSize;
+  }
+
+  unsigned __int64 GetDataSize() const {
+    return fDataSize;
+  }
+
+  unsigned __int64 GetBlockCount() const {
+    return fChecksums.size();
+  }
+
+  DWORD GetChecksum(unsigned __int64 blockNo) const {
+    return fChecksums[(size_t)blockNo];
+  }
+
+  // number of data bytes covered by block blockNo (last block may be shorter)
+  unsigned GetBlockLength(unsigned __int64 blockNo) const;
+
+  bool VerifyBlock(unsigned __int64 blockNo, const BYTE* data, unsigned length) const;
+
+  unsigned __int64 GetSerializedLength() const;
+  void Serialize(std::vector<BYTE>& buffer) const;
+  void Deserialize(const BYTE* buffer, unsigned __int64 length);
+
+private:
+  static const DWORD sMagic;
+
+  DWORD fBlockSize;
+  unsigned __int64 fDataSize;
+  unsigned fBytesInBlock;       // bytes added to the current (not yet complete) block
+  CCRC32C fCurrentCrc;          // running checksum of the current block
+  std::vector<DWORD> fChecksums;
+};
+
+#endif
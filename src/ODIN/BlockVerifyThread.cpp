@@ -0,0 +1,134 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+#include "stdafx.h"
+#include <string>
+#include <memory>
+#include "BlockVerifyThread.h"
+#include "BlockManifest.h"
+#include "ImageStream.h"
+#include "SplitManager.h"
+#include "Exception.h"
+
+using namespace std;
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+//---------------------------------------------------------------------------
+// Constructor
+//
+CBlockVerifyThread::CBlockVerifyThread(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize,
+                                       ISplitManagerCallback* cb, const CBlockManifest* manifest,
+                                       unsigned __int64 dataOffset, unsigned __int64 firstBlock,
+                                       unsigned __int64 blockCount)
+  : COdinThread(CREATE_SUSPENDED)
+{
+  fFileName = fileName;
+  fNoFiles = noFiles;
+  fTotalSize = totalSize;
+  fSplitCallback = cb;
+  fManifest = manifest;
+  fDataOffset = dataOffset;
+  fFirstBlock = firstBlock;
+  fBlockCount = blockCount;
+}
+
+//---------------------------------------------------------------------------
+// Main execute method for the thread.
+//
+DWORD CBlockVerifyThread::Execute()
+{
+  SetName("BlockVerifyThread");
+  try {
+    VerifyLoop();
+    fFinished = true;
+    return S_OK;
+  } catch (Exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Block verify thread encountered exception: \"";
+    fErrorMessage += e.GetMessage();
+    fErrorMessage += L"\"";
+    fFinished = true;
+    return E_FAIL;
+  } catch (std::exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Block verify thread encountered standard exception: ";
+    fErrorMessage += CA2W(e.what());
+    fFinished = true;
+    return E_FAIL;
+  } catch (...) {
+    fErrorFlag = true;
+    fErrorMessage = L"Block verify thread encountered unknown exception";
+    fFinished = true;
+    return E_FAIL;
+  }
+}
+
+//---------------------------------------------------------------------------
+
+void CBlockVerifyThread::VerifyLoop()
+{
+  CFileImageStream imageStream;
+  unique_ptr<CSplitManager> splitManager;
+  DWORD blockSize = fManifest->GetBlockSize();
+  vector<BYTE> buffer(blockSize);
+
+  if (fNoFiles > 0) {
+    imageStream.Open(NULL, IImageStream::forReading);
+    splitManager = make_unique<CSplitManager>(fFileName.c_str(), &imageStream, fTotalSize, fSplitCallback);
+    imageStream.RegisterCallback(splitManager.get());
+  } else {
+    imageStream.Open(fFileName.c_str(), IImageStream::forReading);
+  }
+
+  // blocks are read sequentially, each thread only seeks once
+  imageStream.Seek(fDataOffset + fFirstBlock * blockSize, FILE_BEGIN);
+  for (unsigned __int64 block = fFirstBlock; block < fFirstBlock + fBlockCount && !fCancel; block++) {
+    unsigned length = fManifest->GetBlockLength(block);
+    unsigned bytesRead = 0;
+    imageStream.Read(&buffer[0], length, &bytesRead);
+    if (!fManifest->VerifyBlock(block, &buffer[0], bytesRead)) {
+      ATLTRACE("Block verify: checksum mismatch in block %u\n", (unsigned) block);
+      AddCorruptRange(fDataOffset + block * blockSize, length);
+    }
+    fBytesProcessed += length;
+  }
+  imageStream.UnegisterCallback();
+  imageStream.Close();
+}
+
+void CBlockVerifyThread::AddCorruptRange(unsigned __int64 offset, unsigned __int64 length)
+{
+  if (!fCorruptRanges.empty()) {
+    TImageRange& last = fCorruptRanges.back();
+    if (last.offset + last.length == offset) {
+      last.length += length;
+      return;
+    }
+  }
+  TImageRange range = { offset, length };
+  fCorruptRanges.push_back(range);
+}
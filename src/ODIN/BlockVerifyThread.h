@@ -0,0 +1,67 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+#pragma once
+
+#ifndef BlockVerifyThread_H
+#define BlockVerifyThread_H
+//---------------------------------------------------------------------------
+#include <vector>
+#include "OdinThread.h"
+#include "BlockManifest.h"
+
+class ISplitManagerCallback;
+
+//---------------------------------------------------------------------------
+// Thread checking a contiguous range of blocks of an image file against its
+// block manifest. Each thread opens its own stream so that several threads
+// can check different parts of the same image in parallel.
+class CBlockVerifyThread : public COdinThread
+{
+  public:
+    CBlockVerifyThread(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb,
+                       const CBlockManifest* manifest, unsigned __int64 dataOffset,
+                       unsigned __int64 firstBlock, unsigned __int64 blockCount);
+    virtual DWORD Execute();
+
+    // ranges of corrupted blocks found, adjacent blocks are merged, sorted by offset
+    const std::vector<TImageRange>& GetCorruptRanges() const {
+      return fCorruptRanges;
+    }
+
+  private:
+    void VerifyLoop();
+    void AddCorruptRange(unsigned __int64 offset, unsigned __int64 length);
+
+    std::wstring fFileName;
+    unsigned fNoFiles;                  // number of files for split images, 0 otherwise
+    unsigned __int64 fTotalSize;        // total size of all files of split image
+    ISplitManagerCallback* fSplitCallback;
+    const CBlockManifest* fManifest;
+    unsigned __int64 fDataOffset;       // file offset of data area
+    unsigned __int64 fFirstBlock;       // first block to check
+    unsigned __int64 fBlockCount;       // number of blocks to check
+    std::vector<TImageRange> fCorruptRanges;
+};
+//---------------------------------------------------------------------------
+#endif
@@ -49,11 +49,17 @@ static const DWORD kBufferWaitTimeoutMs = 300000;  // 5 minutes
 //
 CBufferChunk::CBufferChunk(int nSize, int nIndex) {
 
-  fData = new BYTE[nSize];
+  fOwnsData = nSize > 0;
+  fData = fOwnsData ? new BYTE[nSize] : NULL;
   fMaxSize = nSize;
   fUsedSize = SIZE_NOT_SET;
   fEOF = false;
   fSeekPos = (unsigned __int64) -1;
+  fCheckpointPos = (unsigned __int64) -1;
+  fCheckpointSourcePos = 0;
+  fShareCount = 0;
+  fSharedChunk = NULL;
+  fSharedChunkQueue = NULL;
 
 }  
 //---------------------------------------------------------------------------
@@ -63,7 +69,45 @@ CBufferChunk::CBufferChunk(int nSize, int nIndex) {
 // CBufferChunk destructor
 //
 CBufferChunk::~CBufferChunk() {
-  delete [] fData;
+  if (fOwnsData)
+    delete [] fData;
+}
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// Use data and state of another chunk
+//
+void CBufferChunk::ShareData(CBufferChunk* source, CImageBuffer* sourceQueue) {
+  if (fOwnsData || fSharedChunk)
+    THROW_INT_EXC(EInternalException::threadSyncError);
+  fSharedChunk = source;
+  fSharedChunkQueue = sourceQueue;
+  fData = source->fData;
+  fMaxSize = source->fMaxSize;
+  fUsedSize = source->fUsedSize;
+  fEOF = source->fEOF;
+  fSeekPos = source->fSeekPos;
+  fCheckpointPos = source->fCheckpointPos;
+  fCheckpointSourcePos = source->fCheckpointSourcePos;
+}
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// Stop using the data of another chunk, the last one releases the other chunk
+//
+void CBufferChunk::ReleaseSharedData() {
+  CBufferChunk* source = fSharedChunk;
+  if (!source)
+    return;
+  fSharedChunk = NULL;
+  fData = NULL;
+  fMaxSize = 0;
+  if (InterlockedDecrement(&source->fShareCount) == 0) {
+    source->Reset();
+    fSharedChunkQueue->ReleaseChunk(source);
+  }
 }
 //---------------------------------------------------------------------------
 
@@ -80,6 +124,7 @@ CImageBuffer::CImageBuffer(LPCWSTR name) {
   if (name)
     fName = name;
   fChunkCount = 0;
+  fCancelled = false;
   fSemaListHasElems.Create(NULL, 0, 9999, NULL);
 }
 
@@ -88,7 +133,8 @@ CImageBuffer::CImageBuffer(int size, int count, LPCWSTR name) {
   if (name)
     fName = name;
   fChunkCount = count;
-  // Create all the buffer chunks
+  fCancelled = false;
+  // Create all the buffer chunks, chunks of size 0 get their data from other chunks
   for (unsigned n = 0; n < fChunkCount; n++) {
     fChunks.push_back( new CBufferChunk(size, n));
   }  // for (unsigned n = 0; n < nChunkCount; n++)
@@ -122,13 +168,21 @@ CBufferChunk *  CImageBuffer::GetChunk()
   CBufferChunk *chunk = NULL;
   //ATLTRACE("CImageBuffer::GetChunk() begin, thread: %d, name: %S, size is: %d\n", GetCurrentThreadId(), fName.c_str(), fChunks.size());
   
+  if (fCancelled)
+    THROW_INT_EXC(EInternalException::operationStopped);
+
   // Wait for chunk with proper timeout (5 minutes for large operations)
   DWORD res = WaitForSingleObject(fSemaListHasElems.m_h, kBufferWaitTimeoutMs);
   
   // Handle all possible wait states
   switch(res) {
     case WAIT_OBJECT_0:
-      // Success - chunk is available
+      // Success - chunk is available, unless the wake up came from Cancel(), which is
+      // passed on to the next waiting thread
+      if (fCancelled) {
+        fSemaListHasElems.Release();
+        THROW_INT_EXC(EInternalException::operationStopped);
+      }
       break;
     case WAIT_TIMEOUT:
       THROW_INT_EXC(EInternalException::threadSyncTimeout);
@@ -157,12 +211,51 @@ CBufferChunk *  CImageBuffer::GetChunk()
 //---------------------------------------------------------------------------
 
 
+//---------------------------------------------------------------------------
+// Request a chunk, return NULL if no chunk gets available within timeout ms
+//
+CBufferChunk *  CImageBuffer::TryGetChunk(DWORD timeout) 
+{
+  CBufferChunk *chunk = NULL;
+  if (fCancelled)
+    THROW_INT_EXC(EInternalException::operationStopped);
+  DWORD res = WaitForSingleObject(fSemaListHasElems.m_h, timeout);
+  
+  switch(res) {
+    case WAIT_OBJECT_0:
+      if (fCancelled) {
+        fSemaListHasElems.Release();
+        THROW_INT_EXC(EInternalException::operationStopped);
+      }
+      break;
+    case WAIT_TIMEOUT:
+      return NULL;
+    default:
+      THROW_INT_EXC(EInternalException::threadSyncError);
+  }
+  
+  fCritSec.Enter();
+  if (fChunks.empty()) {
+    fCritSec.Leave();
+    THROW_INT_EXC(EInternalException::threadSyncError);
+  }
+  chunk = fChunks.front();
+  fChunks.pop_front();
+  fCritSec.Leave();
+  return chunk;
+}
+//---------------------------------------------------------------------------
+
+
 //---------------------------------------------------------------------------
 // Release a chunk
 //
 void  CImageBuffer::ReleaseChunk(CBufferChunk *chunk) 
 {
   //ATLTRACE("CImageBuffer::ReleaseChunk() begin,  thread: %d, name: %S, size is: %d\n", GetCurrentThreadId(), fName.c_str(), fChunks.size());
+  // a chunk returning to the queue that owns it is free and does not need shared data any longer
+  if (fChunkCount > 0)
+    chunk->ReleaseSharedData();
   fCritSec.Enter();
   fChunks.push_back(chunk);
   fCritSec.Leave();
@@ -171,3 +264,27 @@ void  CImageBuffer::ReleaseChunk(CBufferChunk *chunk)
 }
 //---------------------------------------------------------------------------
 
+
+//---------------------------------------------------------------------------
+// Number of chunks in queue
+//
+unsigned CImageBuffer::GetChunkCount() 
+{
+  fCritSec.Enter();
+  unsigned count = (unsigned) fChunks.size();
+  fCritSec.Leave();
+  return count;
+}
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// Stop the threads using the queue, a waiting thread passes the wake up on
+// to the next one
+//
+void CImageBuffer::Cancel()
+{
+  fCancelled = true;
+  fSemaListHasElems.Release();
+}
+//---------------------------------------------------------------------------
@@ -41,18 +41,39 @@
 // Memory used in these chunks is guaranteed to be alligned on a page
 // boundary - thus on x86 it will be a multiple of any known disk sector
 // size (as required when unbuffered file I/O is performed).
+// A chunk created without memory (size 0) can share the data of another chunk,
+// so that several threads can consume the same data. The shared chunk is given
+// back to its queue when the last chunk sharing it is released.
+// A chunk can mark a checkpoint of a backup: the data stream up to the end of
+// the chunk can be continued after an interruption (see CCheckpointJournal).
+// Threads passing on chunks they did not get reset must set or clear the mark.
 //
 enum TBufferChunkState {csFree, csInUse};
 
+class CImageBuffer;
+
 class CBufferChunk {
   public:
     CBufferChunk(int nSize, int nIndex);
     ~CBufferChunk();
+
+    // let this chunk (created with size 0) use the data of chunk source, source is
+    // released to queue sourceQueue after all chunks sharing it are released.
+    // The number of chunks sharing source must be set before with SetShareCount()
+    void ShareData(CBufferChunk* source, CImageBuffer* sourceQueue);
+
+    // stop sharing data of another chunk, called when chunk is released
+    void ReleaseSharedData();
+
+    void SetShareCount(LONG count) {
+      fShareCount = count;
+    }
     
 	void inline  Reset(void) { 
 		fEOF = false; 
 		fUsedSize = SIZE_NOT_SET; 
     fSeekPos = (unsigned __int64) -1;
+    fCheckpointPos = (unsigned __int64) -1;
 	}
 
     unsigned GetMaxSize() {
@@ -94,12 +115,41 @@ class CBufferChunk {
   bool IsEmpty() const {
     return fUsedSize == SIZE_NOT_SET;
   }
+
+  // the chunk ends at a checkpoint, dataPos is the position in the volume data
+  // and sourcePos the offset on the volume the data end at
+  void SetCheckpoint(unsigned __int64 dataPos, unsigned __int64 sourcePos) {
+    fCheckpointPos = dataPos;
+    fCheckpointSourcePos = sourcePos;
+  }
+
+  void ClearCheckpoint() {
+    fCheckpointPos = (unsigned __int64) -1;
+  }
+
+  bool HasCheckpoint() const {
+    return fCheckpointPos != (unsigned __int64) -1;
+  }
+
+  unsigned __int64 GetCheckpointPos() const {
+    return fCheckpointPos;
+  }
+
+  unsigned __int64 GetCheckpointSourcePos() const {
+    return fCheckpointSourcePos;
+  }
 private:
     unsigned fMaxSize;
     unsigned fUsedSize;
     bool fEOF;
     BYTE *fData;
+    bool fOwnsData;
     unsigned __int64 fSeekPos;
+    unsigned __int64 fCheckpointPos;       // data position of checkpoint or -1
+    unsigned __int64 fCheckpointSourcePos; // volume offset of checkpoint
+    volatile LONG fShareCount;        // number of chunks still using the data of this chunk
+    CBufferChunk* fSharedChunk;       // chunk whose data is used by this chunk or NULL
+    CImageBuffer* fSharedChunkQueue;  // queue fSharedChunk is released to
 
 };  // class CBufferChunk
 //---------------------------------------------------------------------------
@@ -119,18 +169,30 @@ using namespace ATL;
 class CImageBuffer {
   public:
      CImageBuffer(LPCWSTR name=NULL);
+     // ChunkSize 0 creates chunks that share the data of other chunks
      CImageBuffer(int ChunkSize, int ChunkCount, LPCWSTR name=NULL);
      ~CImageBuffer();
 
     CBufferChunk* GetChunk();
 
+    // like GetChunk() but returns NULL if no chunk is available within timeout ms
+    CBufferChunk* TryGetChunk(DWORD timeout);
+
     void ReleaseChunk(CBufferChunk *Chunk);
 
+    // number of chunks currently in the queue
+    unsigned GetChunkCount();
+
+    // wake up the threads waiting for a chunk, they and all threads asking for one
+    // later get an exception. Stops the threads of an operation after one has failed
+    void Cancel();
+
   private:
     std::list<CBufferChunk*> fChunks;
     unsigned fChunkCount;         // Must be power of two
     CCriticalSection fCritSec;
     CSemaphore fSemaListHasElems;
+    volatile bool fCancelled;     // Cancel() was called
     std::wstring fName;
 };  // class CImageBuffer
 //---------------------------------------------------------------------------
@@ -0,0 +1,224 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <wctype.h>
+#include "CheckpointJournal.h"
+#include "FileNameUtil.h"
+#include "InternalException.h"
+#include "OSException.h"
+#include "crc32.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CCheckpointJournal
+
+const DWORD CCheckpointJournal::sMagic = 0x4A50434F; // "OCPJ"
+const DWORD CCheckpointJournal::sVersion = 1;
+// more checksums than a record can have (4TB of image data with blocks of 4KB) are a torn record
+const DWORD CCheckpointJournal::sMaxChecksumCount = 0x40000000;
+
+CCheckpointJournal::CCheckpointJournal()
+{
+  fIsOpen = false;
+  fCheckpointCount = 0;
+  memset(&fLastCheckpoint, 0, sizeof(fLastCheckpoint));
+}
+
+CCheckpointJournal::~CCheckpointJournal()
+{
+  try {
+    Close();
+  } catch (Exception&) {
+    // the journal is left as it is, it is checked when it is opened
+  }
+}
+
+void CCheckpointJournal::Create(LPCWSTR fileName, const TJournalInfo& info)
+{
+  TJournalHeader header;
+  unsigned bytesWritten = 0;
+
+  Close();
+  fFileName = fileName;
+  fCheckpointCount = 0;
+  fChecksums.clear();
+  memset(&fLastCheckpoint, 0, sizeof(fLastCheckpoint));
+  fFile.Open(fileName, IImageStream::forWriting);
+  fIsOpen = true;
+  fFile.Seek(0, FILE_BEGIN);
+  BOOL ok = SetEndOfFile(fFile.GetFileHandle());
+  CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fileName);
+
+  memset(&header, 0, sizeof(header));
+  header.magic = sMagic;
+  header.version = sVersion;
+  header.info = info;
+  fFile.Write(&header, sizeof(header), &bytesWritten);
+  if (bytesWritten != sizeof(header))
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  ok = FlushFileBuffers(fFile.GetFileHandle());
+  CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fileName);
+}
+
+bool CCheckpointJournal::Open(LPCWSTR fileName, const TJournalInfo& info)
+{
+  TJournalHeader header;
+  TCheckpoint checkpoint;
+  vector<DWORD> checksums;
+  unsigned bytesRead = 0;
+
+  Close();
+  fFileName = fileName;
+  fCheckpointCount = 0;
+  fChecksums.clear();
+  memset(&fLastCheckpoint, 0, sizeof(fLastCheckpoint));
+  if (!CFileNameUtil::IsFileReadable(fileName))
+    return false;
+
+  fFile.Open(fileName, IImageStream::forWriting);
+  fIsOpen = true;
+  fFile.Seek(0, FILE_BEGIN);
+  fFile.Read(&header, sizeof(header), &bytesRead);
+  if (bytesRead != sizeof(header) || header.magic != sMagic || header.version != sVersion ||
+      memcmp(&header.info, &info, sizeof(info)) != 0)
+    THROW_INT_EXC_PARAM1(EInternalException::journalMismatch, fileName);
+
+  // the records up to the first incomplete or damaged one are valid
+  unsigned __int64 validEnd = sizeof(header);
+  for (;;) {
+    fFile.Read(&checkpoint, sizeof(checkpoint), &bytesRead);
+    if (bytesRead != sizeof(checkpoint) || checkpoint.checksumCount > sMaxChecksumCount)
+      break;
+    checksums.resize(checkpoint.checksumCount);
+    if (checkpoint.checksumCount > 0) {
+      unsigned length = checkpoint.checksumCount * sizeof(DWORD);
+      fFile.Read(&checksums[0], length, &bytesRead);
+      if (bytesRead != length)
+        break;
+    }
+    if (GetRecordChecksum(checkpoint, checksums.empty() ? NULL : &checksums[0], checkpoint.checksumCount) !=
+        checkpoint.recordChecksum)
+      break;
+    fChecksums.insert(fChecksums.end(), checksums.begin(), checksums.end());
+    fLastCheckpoint = checkpoint;
+    ++fCheckpointCount;
+    validEnd = fFile.GetPosition();
+  }
+
+  // new checkpoints replace a torn record
+  fFile.Seek(validEnd, FILE_BEGIN);
+  BOOL ok = SetEndOfFile(fFile.GetFileHandle());
+  CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fileName);
+  return fCheckpointCount > 0;
+}
+
+void CCheckpointJournal::AddCheckpoint(TCheckpoint& checkpoint, const DWORD* checksums, unsigned count)
+{
+  unsigned bytesWritten = 0;
+
+  ATLASSERT(fIsOpen);
+  checkpoint.checksumCount = count;
+  checkpoint.recordChecksum = GetRecordChecksum(checkpoint, checksums, count);
+  fFile.Write(&checkpoint, sizeof(checkpoint), &bytesWritten);
+  if (bytesWritten != sizeof(checkpoint))
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  if (count > 0) {
+    fFile.Write((void*) checksums, count * sizeof(DWORD), &bytesWritten);
+    if (bytesWritten != count * sizeof(DWORD))
+      THROW_INT_EXC(EInternalException::wrongWriteSize);
+  }
+  BOOL ok = FlushFileBuffers(fFile.GetFileHandle());
+  CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fFileName.c_str());
+  fLastCheckpoint = checkpoint;
+  ++fCheckpointCount;
+}
+
+void CCheckpointJournal::Close()
+{
+  if (fIsOpen) {
+    fIsOpen = false;
+    fFile.Close();
+  }
+}
+
+void CCheckpointJournal::Remove()
+{
+  Close();
+  if (!fFileName.empty())
+    DeleteFile(fFileName.c_str());
+}
+
+DWORD CCheckpointJournal::GetRecordChecksum(const TCheckpoint& checkpoint, const DWORD* checksums, unsigned count)
+{
+  TCheckpoint record = checkpoint;
+  CCRC32C crc;
+
+  record.recordChecksum = 0;
+  crc.AddDataBlock((const BYTE*) &record, sizeof(record));
+  if (count > 0)
+    crc.AddDataBlock((const BYTE*) checksums, count * sizeof(DWORD));
+  return crc.GetResult();
+}
+
+wstring CCheckpointJournal::GetBackupJournalName(LPCWSTR imageFileName)
+{
+  return wstring(imageFileName) + L".journal";
+}
+
+wstring CCheckpointJournal::GetRestoreJournalName(LPCWSTR imageFileName, LPCWSTR volumeName)
+{
+  // the last part of the volume name, e.g. sdb1 of /dev/sdb1 or HarddiskVolume3 of
+  // \\?\GLOBALROOT\Device\HarddiskVolume3, volumes with the same last part are told
+  // apart by the name checksum in the journal
+  wstring name = volumeName;
+  size_t pos = name.find_last_not_of(L"\\/:");
+  name.erase(pos == wstring::npos ? 0 : pos + 1); // F: is F
+  pos = name.find_last_of(L"\\/:");
+  if (pos != wstring::npos)
+    name = name.substr(pos + 1);
+  for (size_t i=0; i<name.length(); i++) {
+    if (!iswalnum(name[i]) && name[i] != L'-' && name[i] != L'_')
+      name[i] = L'_';
+  }
+  return wstring(imageFileName) + L"." + name + L".journal";
+}
+
+DWORD CCheckpointJournal::GetNameChecksum(LPCWSTR name)
+{
+  // the checksum must not depend on the size of wchar_t
+  CCRC32C crc;
+  for (; *name; name++) {
+    DWORD c = (DWORD) *name;
+    crc.AddDataBlock((const BYTE*) &c, sizeof(c));
+  }
+  return crc.GetResult();
+}
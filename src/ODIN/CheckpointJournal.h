@@ -0,0 +1,139 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __CHECKPOINTJOURNAL_H__
+#define __CHECKPOINTJOURNAL_H__
+
+#include <string>
+#include <vector>
+#include "ImageStream.h"
+
+//---------------------------------------------------------------------------
+// class CCheckpointJournal
+// A small append only file next to the image that records the progress of a
+// backup or restore, so that an interrupted operation continues at its last
+// checkpoint instead of at the beginning. The journal starts with the identity
+// of the operation, followed by one TCheckpoint record for each checkpoint with
+// the block manifest checksums of the image blocks completed since the one
+// before. A record is appended after the data it covers were flushed to the
+// target. A record torn by the interruption fails its checksum and is ignored.
+// At a checkpoint of a backup the compression starts a new stream (frame), so
+// that the image can be continued from there with a new compressor.
+
+class CCheckpointJournal {
+public:
+  typedef enum { opBackup = 1, opRestore = 2 } TOperation;
+
+  // identity of an operation, a journal is only continued by the same operation
+  typedef struct {
+    DWORD operation;                // TOperation
+    DWORD compressionFormat;        // TCompressionFormat of the image
+    DWORD manifestBlockSize;        // block size of the manifest of a backup or 0
+    DWORD volumeNameChecksum;       // GetNameChecksum() of the volume saved or restored
+    unsigned __int64 volumeSize;    // size of the volume
+    unsigned __int64 dataOffset;    // offset of the volume data in the image file
+    unsigned __int64 imageDataSize; // size of the data of the restored image, 0 for a backup
+    DWORD imageCrc32;               // checksum of the restored image, 0 for a backup
+    DWORD reserved;
+  } TJournalInfo;
+
+  typedef struct {
+    unsigned __int64 dataPos;       // position in the volume data up to which the target is complete
+    unsigned __int64 sourcePos;     // offset on the volume the data end at (position in the allocation map)
+    unsigned __int64 targetPos;     // bytes of image data written (backup, the compressed output offset where
+                                    // the compression was restarted) or offset written on the volume (restore)
+    DWORD crc32;                    // checksum of the image data up to targetPos (backup)
+    DWORD manifestChecksum;         // checksum of the incomplete last block of the manifest (backup)
+    DWORD checksumCount;            // number of manifest checksums following the record
+    DWORD recordChecksum;           // crc32c of the record (with this field 0) and the checksums
+  } TCheckpoint;
+
+  CCheckpointJournal();
+  ~CCheckpointJournal();
+
+  // start the journal of a new operation, replacing an existing one
+  void Create(LPCWSTR fileName, const TJournalInfo& info);
+
+  // open the journal of an interrupted operation to continue it, returns false if there is
+  // no journal or it has no checkpoint. Throws EInternalException::journalMismatch if the
+  // journal is damaged or belongs to another operation
+  bool Open(LPCWSTR fileName, const TJournalInfo& info);
+
+  // append a checkpoint, checksums are the manifest checksums completed since the last one
+  void AddCheckpoint(TCheckpoint& checkpoint, const DWORD* checksums, unsigned count);
+
+  // the last checkpoint, after Open() the one the operation continues at
+  const TCheckpoint& GetLastCheckpoint() const {
+    return fLastCheckpoint;
+  }
+
+  unsigned GetCheckpointCount() const {
+    return fCheckpointCount;
+  }
+
+  // manifest checksums of all checkpoints read by Open()
+  const std::vector<DWORD>& GetChecksums() const {
+    return fChecksums;
+  }
+
+  LPCWSTR GetFileName() const {
+    return fFileName.c_str();
+  }
+
+  void Close();
+
+  // close and delete the journal of an operation that has completed
+  void Remove();
+
+  // journal of a backup to image file imageFileName
+  static std::wstring GetBackupJournalName(LPCWSTR imageFileName);
+
+  // journal of a restore of image file imageFileName to volume volumeName
+  static std::wstring GetRestoreJournalName(LPCWSTR imageFileName, LPCWSTR volumeName);
+
+  static DWORD GetNameChecksum(LPCWSTR name);
+
+private:
+  typedef struct {
+    DWORD magic;                    // sMagic
+    DWORD version;                  // sVersion
+    TJournalInfo info;
+  } TJournalHeader;
+
+  static const DWORD sMagic;
+  static const DWORD sVersion;
+  static const DWORD sMaxChecksumCount;
+
+  static DWORD GetRecordChecksum(const TCheckpoint& checkpoint, const DWORD* checksums, unsigned count);
+
+  std::wstring fFileName;
+  CFileImageStream fFile;
+  bool fIsOpen;
+  TCheckpoint fLastCheckpoint;
+  unsigned fCheckpointCount;
+  std::vector<DWORD> fChecksums;
+};
+
+#endif
@@ -0,0 +1,334 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "ChunkStore.h"
+#include "FileNameUtil.h"
+#include "FileFormatException.h"
+#include "OSException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CContentDefinedChunker
+
+// Random values for the gear hash. Chunk boundaries depend on this table, so
+// it must never change: otherwise new backups would not share chunks with
+// existing ones. The values are generated with splitmix64 from a fixed seed.
+class CGearTable {
+public:
+  CGearTable() {
+    unsigned __int64 seed = 0x4F44494E43444331ULL; // "ODINCDC1"
+    for (int i=0; i<256; i++) {
+      unsigned __int64 z = (seed += 0x9E3779B97F4A7C15ULL);
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+      fValues[i] = z ^ (z >> 31);
+    }
+  }
+
+  unsigned __int64 operator[](BYTE b) const {
+    return fValues[b];
+  }
+
+private:
+  unsigned __int64 fValues[256];
+};
+
+static const CGearTable sGear;
+
+// mask with the given number of bits set in the upper part of the hash value,
+// the upper bits of the gear hash depend on the most recent 64 input bytes
+static unsigned __int64 MakeMask(unsigned bits)
+{
+  return ~0ULL << (64 - bits);
+}
+
+CContentDefinedChunker::CContentDefinedChunker()
+{
+  unsigned bits = 0;
+  for (unsigned size = sAvgChunkSize; size > 1; size >>= 1)
+    ++bits;
+  // normalized chunking: harder to match before the average size is reached,
+  // easier after, this narrows the distribution of chunk sizes
+  fMaskSmall = MakeMask(bits + 2);
+  fMaskLarge = MakeMask(bits - 2);
+}
+
+unsigned CContentDefinedChunker::FindChunkBoundary(const BYTE* data, unsigned length) const
+{
+  if (length <= sMinChunkSize)
+    return length;
+  if (length > sMaxChunkSize)
+    length = sMaxChunkSize;
+  unsigned normalSize = length < sAvgChunkSize ? length : sAvgChunkSize;
+
+  // bytes before the minimum chunk size cannot be a boundary and are skipped
+  unsigned __int64 hash = 0;
+  unsigned i = sMinChunkSize;
+  for (; i < normalSize; i++) {
+    hash = (hash << 1) + sGear[data[i]];
+    if ((hash & fMaskSmall) == 0)
+      return i + 1;
+  }
+  for (; i < length; i++) {
+    hash = (hash << 1) + sGear[data[i]];
+    if ((hash & fMaskLarge) == 0)
+      return i + 1;
+  }
+  return length;
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CChunkStore
+
+const DWORD CChunkStore::sIndexMagic = 0x4953434F; // "OCSI"
+const DWORD CChunkStore::sIndexVersion = 1;
+const unsigned __int64 CChunkStore::sMaxPackFileSize = 1024 * 1024 * 1024; // 1GB
+static const size_t kMaxPendingIndexEntries = 256;
+
+CChunkStore::CChunkStore()
+{
+  fForWriting = false;
+  fPackNo = 0;
+  fNewChunks = fNewBytes = fDuplicateBytes = 0;
+}
+
+CChunkStore::~CChunkStore()
+{
+  try {
+    Close();
+  } catch (Exception& e) {
+    ATLTRACE("Error when closing chunk store: %S\n", e.GetMessage());
+  }
+}
+
+wstring CChunkStore::GetStoreDirectory(LPCWSTR imageFileName)
+{
+  wstring dir;
+  CFileNameUtil::GetDirFromFileName(imageFileName, dir);
+  if (!dir.empty())
+    dir += L'\\';
+  dir += L"chunks";
+  return dir;
+}
+
+wstring CChunkStore::GetIndexFileName() const
+{
+  return fDirectory + L"\\index.dat";
+}
+
+wstring CChunkStore::GetPackFileName(DWORD packNo) const
+{
+  wchar_t buf[20];
+  wsprintf(buf, L"\\pack-%05u.dat", packNo);
+  return fDirectory + buf;
+}
+
+void CChunkStore::Open(LPCWSTR dir, bool forWriting)
+{
+  fDirectory = dir;
+  fForWriting = forWriting;
+  fIndex.clear();
+  fPendingEntries.clear();
+  fNewChunks = fNewBytes = fDuplicateBytes = 0;
+  fPackNo = 0;
+
+  if (forWriting) {
+    BOOL ok = CreateDirectory(dir, NULL);
+    if (!ok && GetLastError() != ERROR_ALREADY_EXISTS)
+      CHECK_OS_EX_PARAM1(ok, EWinException::fileOpenError, dir);
+  }
+  ReadIndex();
+
+  if (forWriting) {
+    // continue with the last pack file until it is full
+    OpenPackFile(fPackNo);
+    if (fPackFile.GetPosition() >= sMaxPackFileSize) {
+      fPackFile.Close();
+      OpenPackFile(fPackNo + 1);
+    }
+  }
+}
+
+void CChunkStore::ReadIndex()
+{
+  wstring indexFileName = GetIndexFileName();
+  TIndexFileHeader header;
+  unsigned bytesRead = 0, bytesWritten = 0;
+
+  if (!CFileNameUtil::IsFileReadable(indexFileName.c_str())) {
+    if (!fForWriting)
+      THROW_FILEFORMAT_EXC(EFileFormatException::wrongChunkStoreIndex);
+    // new chunk store
+    fIndexFile.Open(indexFileName.c_str(), IImageStream::forWriting);
+    header.magic = sIndexMagic;
+    header.version = sIndexVersion;
+    fIndexFile.Write(&header, sizeof(header), &bytesWritten);
+    return;
+  }
+
+  fIndexFile.Open(indexFileName.c_str(), fForWriting ? IImageStream::forWriting : IImageStream::forReading);
+  fIndexFile.Read(&header, sizeof(header), &bytesRead);
+  if (bytesRead != sizeof(header) || header.magic != sIndexMagic || header.version != sIndexVersion)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongChunkStoreIndex);
+
+  const unsigned kEntriesPerRead = 4096;
+  vector<TChunkIndexEntry> entries(kEntriesPerRead);
+  unsigned __int64 entryCount = 0;
+  do {
+    fIndexFile.Read(&entries[0], kEntriesPerRead * sizeof(TChunkIndexEntry), &bytesRead);
+    // a partial entry at the end is the result of an interrupted backup and ignored,
+    // the pack data it refers to is not used
+    unsigned count = bytesRead / sizeof(TChunkIndexEntry);
+    entryCount += count;
+    for (unsigned i=0; i<count; i++) {
+      fIndex[entries[i].hash] = entries[i];
+      if (entries[i].packNo > fPackNo)
+        fPackNo = entries[i].packNo;
+    }
+  } while (bytesRead == kEntriesPerRead * sizeof(TChunkIndexEntry));
+
+  if (fForWriting) {
+    // position behind last complete entry, new entries overwrite a partial one
+    unsigned __int64 entriesEnd = sizeof(header) + entryCount * sizeof(TChunkIndexEntry);
+    fIndexFile.Seek(entriesEnd, FILE_BEGIN);
+  } else {
+    fIndexFile.Close();
+  }
+}
+
+void CChunkStore::OpenPackFile(DWORD packNo)
+{
+  fPackNo = packNo;
+  fPackFile.Open(GetPackFileName(packNo).c_str(), IImageStream::forWriting);
+  fPackFile.Seek(0, FILE_END);
+}
+
+void CChunkStore::Close()
+{
+  if (fForWriting) {
+    Flush();
+    fPackFile.Close();
+  }
+  fIndexFile.Close();
+  fForWriting = false;
+}
+
+bool CChunkStore::HasChunk(const TChunkHash& hash) const
+{
+  return fIndex.find(hash) != fIndex.end();
+}
+
+const CChunkStore::TChunkIndexEntry* CChunkStore::FindChunk(const TChunkHash& hash) const
+{
+  auto it = fIndex.find(hash);
+  return it == fIndex.end() ? NULL : &it->second;
+}
+
+bool CChunkStore::AddChunk(const TChunkHash& hash, const BYTE* data, unsigned length)
+{
+  ATLASSERT(fForWriting);
+  if (HasChunk(hash)) {
+    fDuplicateBytes += length;
+    return false;
+  }
+
+  if (fPackFile.GetPosition() + length > sMaxPackFileSize && fPackFile.GetPosition() > 0) {
+    fPackFile.Close();
+    OpenPackFile(fPackNo + 1);
+  }
+
+  TChunkIndexEntry entry;
+  unsigned bytesWritten = 0;
+  entry.hash = hash;
+  entry.packNo = fPackNo;
+  entry.length = length;
+  entry.offset = fPackFile.GetPosition();
+  fPackFile.Write((void*)data, length, &bytesWritten);
+  fIndex[hash] = entry;
+  fPendingEntries.push_back(entry);
+  ++fNewChunks;
+  fNewBytes += length;
+
+  if (fPendingEntries.size() >= kMaxPendingIndexEntries)
+    Flush();
+  return true;
+}
+
+void CChunkStore::Flush()
+{
+  // index entries are written after the pack data they refer to, so an
+  // interrupted backup never leaves index entries to missing data
+  if (!fForWriting || fPendingEntries.empty())
+    return;
+  unsigned bytesWritten = 0;
+  fIndexFile.Write(&fPendingEntries[0], (unsigned)(fPendingEntries.size() * sizeof(TChunkIndexEntry)), &bytesWritten);
+  fPendingEntries.clear();
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CChunkStoreReader
+
+CChunkStoreReader::CChunkStoreReader(const CChunkStore& store)
+  : fStore(store)
+{
+}
+
+CChunkStoreReader::~CChunkStoreReader()
+{
+  for (auto it = fPackFiles.begin(); it != fPackFiles.end(); ++it)
+    delete it->second;
+}
+
+void CChunkStoreReader::ReadChunk(const TChunkHash& hash, vector<BYTE>& data)
+{
+  const CChunkStore::TChunkIndexEntry* entry = fStore.FindChunk(hash);
+  if (entry == NULL)
+    THROW_FILEFORMAT_EXC(EFileFormatException::chunkNotFound);
+
+  CFileImageStream*& packFile = fPackFiles[entry->packNo];
+  if (packFile == NULL) {
+    packFile = new CFileImageStream();
+    packFile->Open(fStore.GetPackFileName(entry->packNo).c_str(), IImageStream::forReading);
+  }
+
+  unsigned bytesRead = 0;
+  TChunkHash digest;
+  data.resize(entry->length);
+  packFile->Seek(entry->offset, FILE_BEGIN);
+  packFile->Read(data.data(), entry->length, &bytesRead);
+  if (bytesRead != entry->length)
+    THROW_FILEFORMAT_EXC(EFileFormatException::chunkChecksumError);
+  CSha256::Calculate(data.data(), entry->length, digest.digest);
+  if (!(digest == hash))
+    THROW_FILEFORMAT_EXC(EFileFormatException::chunkChecksumError);
+}
@@ -0,0 +1,195 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __CHUNKSTORE_H__
+#define __CHUNKSTORE_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "Sha256.h"
+#include "ImageStream.h"
+
+//---------------------------------------------------------------------------
+// Content addressed storage for deduplicated images. An image written with
+// compression mode compressionChunkStore does not contain the volume data
+// itself but a recipe: a sequence of TRecipeEntry records naming the chunks
+// (by their SHA-256 digest) that make up the volume data. The chunks are kept
+// in a chunk store shared by all images in the same directory, so chunks
+// already stored by an earlier backup are not written again.
+
+// digest of a chunk, the key of the chunk store
+typedef struct {
+  BYTE digest[CSha256::sDigestLength];
+} TChunkHash;
+
+inline bool operator==(const TChunkHash& a, const TChunkHash& b)
+{
+  return memcmp(a.digest, b.digest, sizeof(a.digest)) == 0;
+}
+
+struct TChunkHashHasher {
+  size_t operator()(const TChunkHash& hash) const {
+    // the digest is uniformly distributed, any part of it is a good hash value
+    size_t value;
+    memcpy(&value, hash.digest, sizeof(value));
+    return value;
+  }
+};
+
+// one entry of an image recipe as stored in the data area of the image file
+#pragma pack(push, 1)
+typedef struct {
+  TChunkHash hash;
+  DWORD length;
+} TRecipeEntry;
+#pragma pack(pop)
+
+//---------------------------------------------------------------------------
+// class CContentDefinedChunker
+// Splits a data stream into chunks with boundaries depending only on the
+// content (FastCDC: gear rolling hash with normalized chunking). Inserting or
+// removing data therefore only changes the chunks around the modification and
+// identical data in different images results in identical chunks.
+
+class CContentDefinedChunker {
+public:
+  static const unsigned sMinChunkSize = 16 * 1024;
+  static const unsigned sAvgChunkSize = 64 * 1024;
+  static const unsigned sMaxChunkSize = 256 * 1024;
+
+  CContentDefinedChunker();
+
+  // length of the chunk starting at data, length is the number of bytes
+  // available. If less than sMaxChunkSize bytes are available and this is not
+  // the end of the stream the result may be limited by the available data, so
+  // callers should pass at least sMaxChunkSize bytes whenever possible.
+  unsigned FindChunkBoundary(const BYTE* data, unsigned length) const;
+
+private:
+  unsigned __int64 fMaskSmall;  // stricter mask used before reaching average size
+  unsigned __int64 fMaskLarge;  // looser mask used after reaching average size
+};
+
+//---------------------------------------------------------------------------
+// class CChunkStore
+// The chunk store is a directory containing append only pack files with the
+// chunk data and an append only index file with one TChunkIndexEntry for each
+// chunk. The index is read into memory when the store is opened. Only one
+// process may write to a chunk store at a time.
+
+class CChunkStore {
+public:
+  typedef struct {
+    TChunkHash hash;
+    DWORD packNo;                // number of pack file containing the chunk
+    DWORD length;                // length of chunk in bytes
+    unsigned __int64 offset;     // offset of chunk in pack file
+  } TChunkIndexEntry;
+
+  CChunkStore();
+  ~CChunkStore();
+
+  // open the chunk store in directory dir, when opened for writing the
+  // directory is created if it does not exist
+  void Open(LPCWSTR dir, bool forWriting);
+  void Close();
+
+  // add a chunk if not already in the store, returns true if the chunk was new
+  bool AddChunk(const TChunkHash& hash, const BYTE* data, unsigned length);
+  bool HasChunk(const TChunkHash& hash) const;
+  const TChunkIndexEntry* FindChunk(const TChunkHash& hash) const;
+  // write all pending index entries and pack data to disk
+  void Flush();
+
+  std::wstring GetPackFileName(DWORD packNo) const;
+
+  LPCWSTR GetDirectory() const {
+    return fDirectory.c_str();
+  }
+
+  size_t GetChunkCount() const {
+    return fIndex.size();
+  }
+
+  // statistics of chunks added since the store was opened
+  unsigned __int64 GetNewChunkCount() const {
+    return fNewChunks;
+  }
+  unsigned __int64 GetNewBytes() const {
+    return fNewBytes;
+  }
+  unsigned __int64 GetDuplicateBytes() const {
+    return fDuplicateBytes;
+  }
+
+  // directory of the chunk store belonging to an image file
+  static std::wstring GetStoreDirectory(LPCWSTR imageFileName);
+
+  static const unsigned __int64 sMaxPackFileSize;
+
+private:
+  typedef struct {
+    DWORD magic;
+    DWORD version;
+  } TIndexFileHeader;
+
+  void ReadIndex();
+  void OpenPackFile(DWORD packNo);
+  std::wstring GetIndexFileName() const;
+
+  std::wstring fDirectory;
+  bool fForWriting;
+  std::unordered_map<TChunkHash, TChunkIndexEntry, TChunkHashHasher> fIndex;
+  std::vector<TChunkIndexEntry> fPendingEntries; // index entries not yet written to disk
+  CFileImageStream fIndexFile;
+  CFileImageStream fPackFile;  // current pack file new chunks are appended to
+  DWORD fPackNo;               // number of current pack file
+  unsigned __int64 fNewChunks, fNewBytes, fDuplicateBytes;
+
+  static const DWORD sIndexMagic;
+  static const DWORD sIndexVersion;
+};
+
+//---------------------------------------------------------------------------
+// class CChunkStoreReader
+// Reads chunks from a chunk store opened for reading. Each reader keeps its own
+// pack file handles, so several threads can read from the same store with one
+// reader each.
+
+class CChunkStoreReader {
+public:
+  CChunkStoreReader(const CChunkStore& store);
+  ~CChunkStoreReader();
+
+  // read chunk with digest hash into data and check its digest, throws an
+  // EFileFormatException if the chunk is missing or damaged
+  void ReadChunk(const TChunkHash& hash, std::vector<BYTE>& data);
+
+private:
+  const CChunkStore& fStore;
+  std::unordered_map<DWORD, CFileImageStream*> fPackFiles;
+};
+
+#endif
@@ -0,0 +1,194 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <string>
+#include "BufferQueue.h"
+#include "ChunkingThread.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// Constructor
+//
+CChunkingThread::CChunkingThread(CChunkStore* chunkStore,
+  CImageBuffer *sourceQueueDecompressed,
+  CImageBuffer *targetQueueDecompressed,
+  CImageBuffer *sourceQueueCompressed,
+  CImageBuffer *targetQueueCompressed
+  ) : COdinThread(CREATE_SUSPENDED)
+{
+  fChunkStore = chunkStore;
+  fSourceQueueDecompressed = sourceQueueDecompressed;
+  fTargetQueueDecompressed = targetQueueDecompressed;
+  fSourceQueueCompressed = sourceQueueCompressed;
+  fTargetQueueCompressed = targetQueueCompressed;
+  fRecipeChunk = NULL;
+  fRecipeChunkUsed = 0;
+}
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// The thread's main execution loop - keep this as simple as possible
+//
+DWORD CChunkingThread::Execute()
+{
+  SetName("ChunkingThread");
+
+  try {
+    ChunkLoop();
+    fFinished = true;
+  } catch (Exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Chunking thread encountered exception: \"";
+    fErrorMessage += e.GetMessage();
+    fErrorMessage += L"\"";
+    fFinished = true;
+    return E_FAIL;
+  } catch (std::exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Chunking thread encountered standard exception: \"";
+    fErrorMessage += CA2W(e.what());
+    fErrorMessage += L"\"";
+    fFinished = true;
+    return E_FAIL;
+  } catch (...) {
+    fErrorFlag = true;
+    fErrorMessage = L"Chunking thread encountered unknown exception";
+    fFinished = true;
+    return E_FAIL;
+  }
+  return 0;
+}
+
+//---------------------------------------------------------------------------
+// Chunk boundaries may be anywhere in the input chunks from the read thread,
+// so the data is collected in a buffer holding at least one maximum size
+// chunk (unless at the end of the input) before looking for the next boundary.
+//
+void CChunkingThread::ChunkLoop()
+{
+  const unsigned maxChunkSize = CContentDefinedChunker::sMaxChunkSize;
+  vector<BYTE> buffer(2 * maxChunkSize);
+  unsigned start = 0, end = 0;  // unprocessed data in buffer
+  CBufferChunk *readChunk = NULL;
+  unsigned readPos = 0;         // bytes of readChunk already copied to buffer
+  bool bEOF = false;
+
+  fRecipeChunk = fSourceQueueCompressed->GetChunk();
+  if (!fRecipeChunk)
+    THROW_INT_EXC(EInternalException::getChunkError);
+  fRecipeChunkUsed = 0;
+
+  for (;;) {
+    while (end - start < maxChunkSize) {
+      if (readChunk != NULL && readPos < readChunk->GetSize()) {
+        if (end == buffer.size()) {
+          memmove(&buffer[0], &buffer[start], end - start);
+          end -= start;
+          start = 0;
+        }
+        unsigned count = readChunk->GetSize() - readPos;
+        if (count > buffer.size() - end)
+          count = (unsigned) buffer.size() - end;
+        memcpy(&buffer[end], (BYTE*)readChunk->GetData() + readPos, count);
+        end += count;
+        readPos += count;
+      } else if (bEOF) {
+        break;
+      } else {
+        if (readChunk)
+          fTargetQueueDecompressed->ReleaseChunk(readChunk);
+        readChunk = fSourceQueueDecompressed->GetChunk(); // may block
+        if (!readChunk)
+          THROW_INT_EXC(EInternalException::getChunkError);
+        bEOF = readChunk->IsEOF();
+        readPos = 0;
+      }
+    }
+
+    if (end == start)
+      break;
+    unsigned length = fChunker.FindChunkBoundary(&buffer[start], end - start);
+    AddChunk(&buffer[start], length);
+    start += length;
+
+    if (fCancel) {
+      if (fRecipeChunk)
+        fTargetQueueCompressed->ReleaseChunk(fRecipeChunk);
+      if (readChunk)
+        fTargetQueueDecompressed->ReleaseChunk(readChunk);
+      Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
+    }
+  }
+
+  // make sure the chunks are in the index before the image is completed
+  fChunkStore->Flush();
+  ATLTRACE("Chunking finished, new chunks: %u, new bytes: %I64u, duplicate bytes: %I64u\n",
+    (unsigned) fChunkStore->GetNewChunkCount(), fChunkStore->GetNewBytes(), fChunkStore->GetDuplicateBytes());
+
+  if (readChunk != NULL)
+    fTargetQueueDecompressed->ReleaseChunk(readChunk);
+  fRecipeChunk->SetSize(fRecipeChunkUsed);
+  fRecipeChunk->SetEOF(true);
+  fTargetQueueCompressed->ReleaseChunk(fRecipeChunk);
+  fRecipeChunk = NULL;
+}
+
+void CChunkingThread::AddChunk(const BYTE* data, unsigned length)
+{
+  TRecipeEntry entry;
+  CSha256::Calculate(data, length, entry.hash.digest);
+  entry.length = length;
+  fChunkStore->AddChunk(entry.hash, data, length);
+  WriteRecipe((const BYTE*)&entry, sizeof(entry));
+  fBytesProcessed += length;
+}
+
+// append to the recipe, entries may span output chunks
+void CChunkingThread::WriteRecipe(const BYTE* data, unsigned length)
+{
+  while (length > 0) {
+    if (fRecipeChunkUsed == fRecipeChunk->GetMaxSize()) {
+      fRecipeChunk->SetSize(fRecipeChunkUsed);
+      fTargetQueueCompressed->ReleaseChunk(fRecipeChunk);
+      fRecipeChunk = fSourceQueueCompressed->GetChunk();
+      if (!fRecipeChunk)
+        THROW_INT_EXC(EInternalException::getChunkError);
+      fRecipeChunkUsed = 0;
+    }
+    unsigned count = fRecipeChunk->GetMaxSize() - fRecipeChunkUsed;
+    if (count > length)
+      count = length;
+    memcpy((BYTE*)fRecipeChunk->GetData() + fRecipeChunkUsed, data, count);
+    fRecipeChunkUsed += count;
+    data += count;
+    length -= count;
+  }
+}
@@ -0,0 +1,68 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef ChunkingThread_H
+#define ChunkingThread_H
+//---------------------------------------------------------------------------
+
+#include <vector>
+#include "OdinThread.h"
+#include "ChunkStore.h"
+//---------------------------------------------------------------------------
+
+class CImageBuffer;
+class CBufferChunk;
+
+//---------------------------------------------------------------------------
+// Thread taking the place of the compression thread when writing a
+// deduplicated image: splits the volume data into content defined chunks,
+// adds new chunks to the chunk store and passes the recipe (the list of
+// chunk references) to the write thread.
+class CChunkingThread : public COdinThread
+{
+  public:
+    CChunkingThread(CChunkStore* chunkStore,
+      CImageBuffer *sourceQueueDecompressed,
+      CImageBuffer *targetQueueDecompressed,
+      CImageBuffer *sourceQueueCompressed,
+      CImageBuffer *targetQueueCompressed);
+
+  protected:
+    CChunkStore* fChunkStore;
+    CContentDefinedChunker fChunker;
+    CImageBuffer *fSourceQueueDecompressed, *fTargetQueueDecompressed;
+    CImageBuffer *fSourceQueueCompressed, *fTargetQueueCompressed;
+
+    virtual DWORD Execute();
+
+  private:
+    void ChunkLoop();
+    void AddChunk(const BYTE* data, unsigned length);
+    void WriteRecipe(const BYTE* data, unsigned length);
+
+    CBufferChunk *fRecipeChunk; // output chunk currently filled with recipe entries
+    unsigned fRecipeChunkUsed;
+};
+//---------------------------------------------------------------------------
+#endif
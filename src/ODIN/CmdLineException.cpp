@@ -75,6 +75,30 @@ void ECmdLineException::Init(enum ExceptionCode errCode)
     case verifyParamError:
       msg.LoadString(IDS_ERRCMDLINE_VERIFY_PARAM_ERROR);
       break;
+    case transcodeParamError:
+      msg.LoadString(IDS_ERRCMDLINE_TRANSCODE_PARAM_ERROR);
+      break;
+    case wrongHash:
+      msg.LoadString(IDS_ERRCMDLINE_WRONG_HASH);
+      break;
+    case wrongHashScope:
+      msg.LoadString(IDS_ERRCMDLINE_WRONG_HASH_SCOPE);
+      break;
+    case compareParamError:
+      msg.LoadString(IDS_ERRCMDLINE_COMPARE_PARAM_ERROR);
+      break;
+    case engineJobError:
+      msg.LoadString(IDS_ERRCMDLINE_ENGINE_JOB_ERROR);
+      break;
+    case stdStreamParamError:
+      msg.LoadString(IDS_ERRCMDLINE_STD_STREAM_PARAM_ERROR);
+      break;
+    case wrongIoLimit:
+      msg.LoadString(IDS_ERRCMDLINE_WRONG_IO_LIMIT);
+      break;
+    case wrongCheckpoint:
+      msg.LoadString(IDS_ERRCMDLINE_WRONG_CHECKPOINT);
+      break;
     default:
       msg = L"unknown error";
       break;
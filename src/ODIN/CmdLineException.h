@@ -35,7 +35,9 @@ class ECmdLineException : public Exception
   public:
   
   typedef enum ExceptionCode {noCode, noSource, noTarget, noOperation, wrongCompression, unknownOption,
-    wrongSource, wrongTarget, wrongIndex, backupParamError, restoreParamError, verifyParamError};
+    wrongSource, wrongTarget, wrongIndex, backupParamError, restoreParamError, verifyParamError,
+    transcodeParamError, wrongHash, wrongHashScope, compareParamError,
+    engineJobError, stdStreamParamError, wrongIoLimit, wrongCheckpoint};
 
   ECmdLineException(enum ExceptionCode errCode)
     : Exception(CmdLineException) { 
@@ -40,12 +40,18 @@
 #include <codecvt>
 #include <crtdbg.h>
 #include "CmdLineException.h"
+#include "InternalException.h"
+#include "OSException.h"
 #include "DriveList.h"
 #include "UserFeedbackConsole.h"
 #include "util.h"
 #include "SplitManager.h"
 #include "MultiPartitionHandler.h"
 #include "ParamChecker.h"
+#include "MediaHash.h"
+#include "EventStream.h"
+#include "EngineServer.h"
+#include "StdImageStream.h"
 
 using namespace std;
 
@@ -54,16 +60,8 @@ using namespace std;
   #define malloc DEBUG_MALLOC
 #endif // _DEBUG
 
-DWORD WINAPI ODINTimerThread ( LPVOID pData) 
-{ 
-  Sleep(2000);
-  for (;;) {
-    CCommandLineProcessor *pCmd = (CCommandLineProcessor *)pData;
-    pCmd->ReportFeedback();
-    Sleep(1000);
-  }
-  return 0;
-}
+// differing ranges of a compare printed on the console
+static const size_t kMaxPrintedRanges = 100;
 
 
 // Here the description of what the command line parser can do:
@@ -222,6 +220,7 @@ class CConsoleSplitManagerCallback : public ISplitManagerCallback
 public:
   CConsoleSplitManagerCallback()
   {
+    fInteractive = true;
   }
   virtual void GetFileName(unsigned fileNo, std::wstring& fileName);
   virtual size_t AskUserForMissingFile(LPCWSTR missingFileName, unsigned fileNo, std::wstring& newName);
@@ -231,8 +230,15 @@ public:
     fBaseName = baseName;
   }
 
+  // without a user a missing file is an error
+  void SetInteractive(bool interactive)
+  {
+    fInteractive = interactive;
+  }
+
 private:
   wstring fBaseName; // file name patttern where number string is appended to
+  bool fInteractive;
 };
 
 
@@ -256,6 +262,10 @@ void CConsoleSplitManagerCallback::GetFileName(unsigned fileNo, std::wstring& fi
 
 size_t CConsoleSplitManagerCallback::AskUserForMissingFile(LPCWSTR missingFileName, unsigned fileNo, wstring& newName)
 {
+  if (!fInteractive) {
+    newName.clear();
+    return 0;
+  }
   wcout  << L"Please provide path to file number " << fileNo;
   wcin >> newName;
   return newName.length();
@@ -272,27 +282,145 @@ CCommandLineProcessor::CCommandLineProcessor() {
   fVerifyRun = false;
   fCrc32 = 0;
   fExitCode = 0;
+  fEvents = NULL;
+  fCancelRequested = fCancelSent = false;
+  fTimerStop = CreateEvent(NULL, FALSE, FALSE, NULL);
   fpIn = fpOut = fpErr = NULL;
 }
 
 CCommandLineProcessor::~CCommandLineProcessor() {
+  StopTimer();
+  CloseHandle(fTimerStop);
   TerminateConsole();
 }
 
 int CCommandLineProcessor::ParseAndProcess() {
   try {
     Parse();
+    OpenEventStream();
     ProcessCommandLine();
-    return fExitCode;
   } catch (Exception& e) {
     OnAbort();
-    wcout << e.GetMessage() << endl; 
-    return -1;
+    fErrorMessage = e.GetMessage();
+    wcout << fErrorMessage << endl; 
+    fExitCode = -1;
   } catch (...) {
     OnAbort();
-    wcout << L"Internal runtime error occured." << endl; 
-    return -1;
+    fErrorMessage = L"Internal runtime error occured.";
+    wcout << fErrorMessage << endl; 
+    fExitCode = -1;
+  }
+  if (fJobEvents) {
+    fEvents = NULL;
+    fJobEvents->OnFinished(fExitCode, fErrorMessage.c_str());
   }
+  return fExitCode;
+}
+
+// -events=<name>: progress and end of the operation are written to the named pipe
+// or file or to a handle inherited from the parent process given as number
+void CCommandLineProcessor::OpenEventStream() {
+  if (fOperation.eventsTarget.empty() || fOperation.cmd == CmdServe)
+    return;
+  HANDLE out;
+  LPCWSTR name = fOperation.eventsTarget.c_str();
+  if (wcsspn(name, L"0123456789") == fOperation.eventsTarget.length()) {
+    out = (HANDLE) (ULONG_PTR) _wcstoui64(name, NULL, 10);
+  } else {
+    bool isPipe = _wcsnicmp(name, L"\\\\.\\pipe\\", 9) == 0;
+    out = CreateFile(name, GENERIC_WRITE, FILE_SHARE_READ, NULL, isPipe ? OPEN_EXISTING : CREATE_ALWAYS,
+      FILE_FLAG_OVERLAPPED, NULL);
+    CHECK_OS_EX_HANDLE_PARAM1(out, EWinException::fileOpenError, name);
+  }
+  fEventStream = std::make_unique<CEventStream>(out, true);
+  // odinc runs only one job, the engine numbers its jobs from 1
+  fJobEvents = std::make_unique<CJobEvents>(fEventStream.get(), 0);
+  fEvents = fJobEvents.get();
+  fJobEvents->OnStarted();
+}
+
+int CCommandLineProcessor::RunJob(LPCWSTR commandLine, IOperationEvents* events, bool refreshDrives) {
+  Reset();
+  fExitCode = 0;
+  fErrorMessage.clear();
+  fCancelSent = false;
+  fEvents = events;
+  fSplitCB->SetInteractive(false);
+  try {
+    Init();
+    if (refreshDrives)
+      fOdinManager->RefreshDriveList();
+    // the parser skips the program name
+    wstring jobCommandLine = L"odin ";
+    jobCommandLine += commandLine;
+    Parse(jobCommandLine.c_str());
+    if (fOperation.cmd == CmdList || fOperation.cmd == CmdServe || fOperation.cmd == CmdUsage)
+      THROW_CMD_EXC(ECmdLineException::engineJobError);
+    // there is no user to confirm
+    fOperation.force = true;
+    ProcessCommandLine();
+  } catch (Exception& e) {
+    OnAbort();
+    fErrorMessage = e.GetMessage();
+    fExitCode = -1;
+  } catch (...) {
+    OnAbort();
+    fErrorMessage = L"Internal runtime error occured.";
+    fExitCode = -1;
+  }
+  if (fCancelSent) {
+    fErrorMessage = L"Job was cancelled";
+    fExitCode = -1;
+  }
+  if (!fErrorMessage.empty())
+    wcout << L"Job failed: " << fErrorMessage << endl;
+  fEvents = NULL;
+  events->OnFinished(fExitCode, fErrorMessage.c_str());
+  return fExitCode;
+}
+
+void CCommandLineProcessor::CancelJob() {
+  fCancelRequested = true;
+}
+
+void CCommandLineProcessor::SetIoLimits(LPCWSTR options) {
+  CStlCmdLineArgsWin<wchar_t> cmdLineParser(options, '-', '=');
+  unsigned readLimit = fOdinManager->GetReadLimit(), readIops = fOdinManager->GetReadOpsLimit();
+  unsigned writeLimit = fOdinManager->GetWriteLimit(), writeIops = fOdinManager->GetWriteOpsLimit();
+  bool readChanged = ParseIoLimit(cmdLineParser, L"readlimit", readLimit);
+  readChanged = ParseIoLimit(cmdLineParser, L"readiops", readIops) || readChanged;
+  bool writeChanged = ParseIoLimit(cmdLineParser, L"writelimit", writeLimit);
+  writeChanged = ParseIoLimit(cmdLineParser, L"writeiops", writeIops) || writeChanged;
+  if (cmdLineParser.unusednamed.size() > 0 || (!readChanged && !writeChanged))
+    THROW_CMD_EXC(ECmdLineException::unknownOption);
+  if (readChanged)
+    fOdinManager->SetReadLimit(readLimit, readIops);
+  if (writeChanged)
+    fOdinManager->SetWriteLimit(writeLimit, writeIops);
+}
+
+// take option name as limit if it is given, a limit is a number without sign
+bool CCommandLineProcessor::ParseIoLimit(CStlCmdLineArgsWin<wchar_t>& cmdLineParser, LPCWSTR name, unsigned& limit) {
+  LPCWSTR value = cmdLineParser[name];
+  if (value == NULL)
+    return false;
+  wchar_t* end;
+  unsigned long number = wcstoul(value, &end, 10);
+  if (!iswdigit(*value) || *end != L'\0' || number > UINT_MAX)
+    THROW_CMD_EXC(ECmdLineException::wrongIoLimit);
+  limit = (unsigned) number;
+  return true;
+}
+
+// limit of a job, stays -1 if the option is not given
+bool CCommandLineProcessor::ParseIoLimit(CStlCmdLineArgsWin<wchar_t>& cmdLineParser, LPCWSTR name, int& limit) {
+  unsigned number;
+  if (!ParseIoLimit(cmdLineParser, name, number))
+    return false;
+  if (number > INT_MAX)
+    THROW_CMD_EXC(ECmdLineException::wrongIoLimit);
+  limit = (int) number;
+  return true;
 }
 
 void CCommandLineProcessor::Init() {
@@ -329,8 +457,14 @@ void CCommandLineProcessor::Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser) {
     fOperation.cmd = CCommandLineProcessor::CmdRestore;
   else if (cmdLineParser[L"verify"] != NULL)
     fOperation.cmd = CCommandLineProcessor::CmdVerify;
+  else if (cmdLineParser[L"transcode"] != NULL)
+    fOperation.cmd = CCommandLineProcessor::CmdTranscode;
+  else if (cmdLineParser[L"compare"] != NULL)
+    fOperation.cmd = CCommandLineProcessor::CmdCompare;
   else if (cmdLineParser[L"list"] != NULL)
     fOperation.cmd = CCommandLineProcessor::CmdList;
+  else if (cmdLineParser[L"serve"] != NULL)
+    fOperation.cmd = CCommandLineProcessor::CmdServe;
   else {
     THROW_CMD_EXC(ECmdLineException::noOperation);
   }
@@ -361,10 +495,14 @@ void CCommandLineProcessor::Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser) {
     fOperation.compression = compressionLZ4HC;
   else if (comp.compare(L"zstd") == 0)
     fOperation.compression = compressionZSTD;
+  else if (comp.compare(L"dedup") == 0)
+    fOperation.compression = compressionChunkStore;
   else if (comp.compare(L"none") == 0)
     fOperation.compression = noCompression;
   else if (!comp.empty())
     THROW_CMD_EXC(ECmdLineException::wrongCompression);
+  if (!IsCompressionAvailable(fOperation.compression))
+    THROW_INT_EXC(EInternalException::codecNotAvailable);
 
   // split and force options
   fOperation.force = false;
@@ -373,6 +511,50 @@ void CCommandLineProcessor::Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser) {
     fOperation.splitSizeMB = _wtoi(cmdLineParser[L"split"]);
   if (cmdLineParser[L"force"] != NULL)
     fOperation.force = true;
+  fOperation.deltaRestore = cmdLineParser[L"delta"] != NULL;
+  fOperation.readBackVerify = cmdLineParser[L"readback"] != NULL;
+
+  // hashes of restored volumes
+  fOperation.mediaHash = 0;
+  wstring hash;
+  if (cmdLineParser[L"hash"])
+    hash = cmdLineParser[L"hash"];
+  if (hash.compare(L"sha1") == 0)
+    fOperation.mediaHash = CMediaHash::hashSha1;
+  else if (hash.compare(L"sha256") == 0)
+    fOperation.mediaHash = CMediaHash::hashSha256;
+  else if (hash.compare(L"both") == 0)
+    fOperation.mediaHash = CMediaHash::hashSha1 | CMediaHash::hashSha256;
+  else if (!hash.empty())
+    THROW_CMD_EXC(ECmdLineException::wrongHash);
+  fOperation.mediaHashUsedOnly = false;
+  wstring hashScope;
+  if (cmdLineParser[L"hashscope"])
+    hashScope = cmdLineParser[L"hashscope"];
+  if (hashScope.compare(L"used") == 0)
+    fOperation.mediaHashUsedOnly = true;
+  else if (!hashScope.empty() && hashScope.compare(L"volume") != 0)
+    THROW_CMD_EXC(ECmdLineException::wrongHashScope);
+
+  // budget of I/O, e.g. for backups of volumes in production use, the configured budget
+  // is taken for limits not given
+  fOperation.readLimit = fOperation.readIops = fOperation.writeLimit = fOperation.writeIops = -1;
+  ParseIoLimit(cmdLineParser, L"readlimit", fOperation.readLimit);
+  ParseIoLimit(cmdLineParser, L"readiops", fOperation.readIops);
+  ParseIoLimit(cmdLineParser, L"writelimit", fOperation.writeLimit);
+  ParseIoLimit(cmdLineParser, L"writeiops", fOperation.writeIops);
+  fOperation.lowIoPriority = cmdLineParser[L"lowpriority"] != NULL;
+  fOperation.resume = cmdLineParser[L"resume"] != NULL;
+  // checkpoints of a backup or restore, the configured interval is taken if not given
+  fOperation.checkpointMB = -1;
+  if (cmdLineParser[L"checkpoint"]) {
+    LPCWSTR value = cmdLineParser[L"checkpoint"];
+    wchar_t* end;
+    unsigned long number = wcstoul(value, &end, 10);
+    if (!iswdigit(*value) || *end != L'\0' || number > INT_MAX)
+      THROW_CMD_EXC(ECmdLineException::wrongCheckpoint);
+    fOperation.checkpointMB = (int) number;
+  }
 
   // source and target options
   if (cmdLineParser[L"source"])
@@ -381,16 +563,23 @@ void CCommandLineProcessor::Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser) {
     fOperation.target = cmdLineParser[L"target"];
   if (cmdLineParser[L"output"])
     fOperation.outputFile = cmdLineParser[L"output"];
+  if (cmdLineParser[L"pipe"])
+    fOperation.pipeName = cmdLineParser[L"pipe"];
+  if (cmdLineParser[L"events"])
+    fOperation.eventsTarget = cmdLineParser[L"events"];
 
-  if (fOperation.source.empty() && fOperation.cmd != CCommandLineProcessor::CmdList) {
+  if (fOperation.source.empty() && fOperation.cmd != CCommandLineProcessor::CmdList
+    && fOperation.cmd != CCommandLineProcessor::CmdServe) {
     THROW_CMD_EXC(ECmdLineException::noSource);
   }
   if (fOperation.target.empty() && fOperation.cmd != CCommandLineProcessor::CmdList
-    && fOperation.cmd != CCommandLineProcessor::CmdVerify) {
+    && fOperation.cmd != CCommandLineProcessor::CmdVerify && fOperation.cmd != CCommandLineProcessor::CmdServe) {
     THROW_CMD_EXC(ECmdLineException::noTarget);
   }
   if (cmdLineParser[L"comment"])
     fOperation.comment = cmdLineParser[L"comment"];
+  if (cmdLineParser[L"incremental"])
+    fOperation.baseImage = cmdLineParser[L"incremental"];
 
   // check for unknown options
   if (cmdLineParser.unusednamed.size() > 0) {
@@ -400,6 +589,12 @@ void CCommandLineProcessor::Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser) {
 
 void CCommandLineProcessor::ProcessCommandLine() {
 
+  if (fOperation.cmd == CmdServe) {
+    // the workers of the engine have managers of their own
+    CEngineServer server(fOperation.pipeName.c_str());
+    server.Run();
+    return;
+  }
   Init();
   if (fOperation.cmd == CmdUsage) {
     PrintUsage();
@@ -411,16 +606,43 @@ void CCommandLineProcessor::ProcessCommandLine() {
 
   // first preprocess source and or target information given
   PreprocessSourceAndTarget(fOperation.source, true);
-  if (!fOperation.target.empty())
+  if (fOperation.cmd == CmdRestore && fOperation.target.find(L',') != wstring::npos) {
+    // restore to several drives at once, each name is a device name or an index
+    size_t start = 0, pos;
+    do {
+      pos = fOperation.target.find(L',', start);
+      wstring name = fOperation.target.substr(start, pos == wstring::npos ? wstring::npos : pos-start);
+      if (name.empty())
+        THROW_CMD_EXC(ECmdLineException::restoreParamError);
+      PreprocessSourceAndTarget(name, false);
+      fOperation.targetIndexes.push_back(fOperation.targetIndex);
+      start = pos + 1;
+    } while (pos != wstring::npos);
+  } else if (!fOperation.target.empty())
     PreprocessSourceAndTarget(fOperation.target, false);
 
   // check for parameter errors
   CheckValidParameters();
+  // messages must not end up in an image written to standard output
+  if (CStdImageStream::IsStdName(fOperation.target.c_str()))
+    wcout.rdbuf(wcerr.rdbuf());
   
   fLastPercent = 0;
   fCrc32 = 0;
   fFeedback = std::make_unique<CUserFeedbackConsole>(fOperation.force);
   CParamChecker checker(*fFeedback, *fOdinManager);
+  fOdinManager->UseConfiguredLimits();
+  if (fOperation.readLimit >= 0 || fOperation.readIops >= 0)
+    fOdinManager->SetReadLimit(fOperation.readLimit >= 0 ? fOperation.readLimit : fOdinManager->GetReadLimit(),
+                               fOperation.readIops >= 0 ? fOperation.readIops : fOdinManager->GetReadOpsLimit());
+  if (fOperation.writeLimit >= 0 || fOperation.writeIops >= 0)
+    fOdinManager->SetWriteLimit(fOperation.writeLimit >= 0 ? fOperation.writeLimit : fOdinManager->GetWriteLimit(),
+                                fOperation.writeIops >= 0 ? fOperation.writeIops : fOdinManager->GetWriteOpsLimit());
+  if (fOperation.lowIoPriority)
+    fOdinManager->SetLowIoPriority(true);
+  fOdinManager->SetResume(fOperation.resume);
+  if (fOperation.checkpointMB >= 0)
+    fOdinManager->SetCheckpointInterval(fOperation.checkpointMB);
 
   // perform operation
   if (fOperation.cmd == CmdBackup) {
@@ -428,12 +650,38 @@ void CCommandLineProcessor::ProcessCommandLine() {
       wcout << L"Backing up " << deviceName << L" to file: " << fOperation.target.c_str() << endl;
       IUserFeedback::TFeedbackResult res = checker.CheckConditionsForSavePartition(fOperation.target.c_str(), fOperation.sourceIndex);
       if (res == IUserFeedback::TOk || res == IUserFeedback::TYes) {
-        fTimer = CreateThread(NULL, 0, ODINTimerThread, this, 0, NULL);
+        ReportStage(L"backup");
+        StartTimer();
+        if (fOperation.splitSizeMB > 0)
+          fOdinManager->SetSplitSize((unsigned __int64) fOperation.splitSizeMB * 1024 * 1024);
         if (fOperation.comment.length() > 0)
            fOdinManager->SetComment(fOperation.comment.c_str());
+        fOdinManager->SetCompressionMode(fOperation.compression);
+        fOdinManager->SetBaseImage(fOperation.baseImage.c_str());
+        fOdinManager->SetMediaHashAlgorithms(fOperation.mediaHash);
+        fOdinManager->SetMediaHashUsedClustersOnly(fOperation.mediaHashUsedOnly);
         CMultiPartitionHandler::BackupPartitionOrDisk(fOperation.sourceIndex, fOperation.target.c_str(), *fOdinManager, fSplitCB.get(), this, *fFeedback);
       } 
   }
+  else if (fOperation.cmd == CmdRestore && fOperation.targetIndexes.size() > 0) {
+    unsigned noFiles=0; unsigned __int64 totalSize = 0;
+    IUserFeedback::TFeedbackResult res = IUserFeedback::TOk;
+    for (size_t i=0; i<fOperation.targetIndexes.size() && (res == IUserFeedback::TOk || res == IUserFeedback::TYes); i++) {
+      LPCWSTR deviceName = fOdinManager->GetDriveList()->GetItem(fOperation.targetIndexes[i])->GetDeviceName().c_str();
+      wcout << L"Restoring " << deviceName << L" from file: " << fOperation.source.c_str() << endl;
+      res = checker.CheckConditionsForRestorePartition(fOperation.source.c_str(), *fSplitCB, fOperation.targetIndexes[i], noFiles, totalSize);
+    }
+    if (res == IUserFeedback::TOk || res == IUserFeedback::TYes) {
+      // do restore, image is read once and written to all drives
+      ReportStage(L"restore");
+      StartTimer();
+      fOdinManager->SetDeltaRestore(fOperation.deltaRestore);
+      fOdinManager->SetReadBackVerify(fOperation.readBackVerify);
+      fOdinManager->SetMediaHashAlgorithms(fOperation.mediaHash);
+      fOdinManager->SetMediaHashUsedClustersOnly(fOperation.mediaHashUsedOnly);
+      CMultiPartitionHandler::RestorePartitionToDrives(fOperation.targetIndexes, fOperation.source.c_str(), *fOdinManager, fSplitCB.get(), this);
+    }
+  }
   else if (fOperation.cmd == CmdRestore) {
     unsigned noFiles=0; unsigned __int64 totalSize = 0;
     LPCWSTR deviceName = fOdinManager->GetDriveList()->GetItem(fOperation.targetIndex)->GetDeviceName().c_str();
@@ -441,7 +689,12 @@ void CCommandLineProcessor::ProcessCommandLine() {
     IUserFeedback::TFeedbackResult res = checker.CheckConditionsForRestorePartition(fOperation.source.c_str(), *fSplitCB, fOperation.targetIndex, noFiles, totalSize);
     if (res == IUserFeedback::TOk || res == IUserFeedback::TYes) {
       // do restore
-      fTimer = CreateThread(NULL, 0, ODINTimerThread, this, 0, NULL);
+      ReportStage(L"restore");
+      StartTimer();
+      fOdinManager->SetDeltaRestore(fOperation.deltaRestore);
+      fOdinManager->SetReadBackVerify(fOperation.readBackVerify);
+      fOdinManager->SetMediaHashAlgorithms(fOperation.mediaHash);
+      fOdinManager->SetMediaHashUsedClustersOnly(fOperation.mediaHashUsedOnly);
       CMultiPartitionHandler::RestorePartitionOrDisk(fOperation.targetIndex, fOperation.source.c_str(), *fOdinManager, fSplitCB.get(), this);
     }
   }
@@ -450,9 +703,27 @@ void CCommandLineProcessor::ProcessCommandLine() {
     // do verify
     fVerifyRun = true;
     fCrc32 = 0; //TODO: get from header
-    fTimer = CreateThread(NULL, 0, ODINTimerThread, this, 0, NULL);
+    ReportStage(L"verify");
+    StartTimer();
     CMultiPartitionHandler::VerifyPartitionOrDisk(fOperation.source.c_str(), *fOdinManager, fCrc32, fSplitCB.get(), this, *fFeedback);
   }
+  else if (fOperation.cmd == CmdTranscode) {
+    wcout << L"Transcoding image file " << fOperation.source.c_str() << L" to file: " << fOperation.target.c_str() << endl;
+    ReportStage(L"transcode");
+    StartTimer();
+    fOdinManager->SetCompressionMode(fOperation.compression);
+    if (fOperation.splitSizeMB > 0)
+      fOdinManager->SetSplitSize((unsigned __int64) fOperation.splitSizeMB * 1024 * 1024);
+    CMultiPartitionHandler::TranscodePartitionOrDisk(fOperation.source.c_str(), fOperation.target.c_str(), *fOdinManager, fSplitCB.get(), this, *fFeedback);
+  }
+  else if (fOperation.cmd == CmdCompare) {
+    LPCWSTR targetName = fOperation.targetIndex >= 0 ?
+      fOdinManager->GetDriveList()->GetItem(fOperation.targetIndex)->GetDeviceName().c_str() : fOperation.target.c_str();
+    wcout << L"Comparing image file " << fOperation.source.c_str() << L" with " << targetName << endl;
+    ReportStage(L"compare");
+    StartTimer();
+    CMultiPartitionHandler::ComparePartition(fOperation.source.c_str(), fOperation.targetIndex, fOperation.target.c_str(), *fOdinManager, fSplitCB.get(), this);
+  }
   else
     wcerr << L"Internal error illegal program state:  " << __WFILE__ << L" " << __LINE__; // should not happen
 }
@@ -535,6 +806,14 @@ void CCommandLineProcessor::PreprocessSourceAndTarget(const wstring& name, bool
     else
       sourceOrTarget ? fOperation.sourceIndex = index : fOperation.targetIndex = index;
   }
+  else if (name.length() == 2 && iswalpha(name[0]) && name[1] == L':') {
+    // a drive letter like F: refers to the volume mounted there
+    index = fOdinManager->GetDriveList()->GetIndexOfDrive(name.c_str());
+    if (index<0)
+      THROW_CMD_EXC(sourceOrTarget ? ECmdLineException::wrongSource : ECmdLineException::wrongTarget );
+    else
+      sourceOrTarget ? fOperation.sourceIndex = index : fOperation.targetIndex = index;
+  }
   else if (hasOnlyDigits) {
     wchar_t* stopChar = (wchar_t*) name.c_str()+name.length();
     index = wcstol(name.c_str(), &stopChar, 10);
@@ -559,36 +838,127 @@ void CCommandLineProcessor::CheckValidParameters() {
     if (fOperation.sourceIndex >= 0 || fOperation.targetIndex < 0) {
       THROW_CMD_EXC(ECmdLineException::restoreParamError);
     }
+    // with several targets each must be a device and given only once, the exit code
+    // reports failed targets in 16 bits
+    if (fOperation.targetIndexes.size() > 16)
+      THROW_CMD_EXC(ECmdLineException::restoreParamError);
+    // read back compares with the written data, a delta restore does not write all data
+    if (fOperation.readBackVerify && fOperation.deltaRestore)
+      THROW_CMD_EXC(ECmdLineException::restoreParamError);
+    // checkpoints are recorded for restores to a single drive
+    if (fOperation.resume && fOperation.targetIndexes.size() > 0)
+      THROW_CMD_EXC(ECmdLineException::restoreParamError);
+    for (size_t i=0; i<fOperation.targetIndexes.size(); i++) {
+      if (fOperation.targetIndexes[i] < 0)
+        THROW_CMD_EXC(ECmdLineException::restoreParamError);
+      for (size_t j=0; j<i; j++)
+        if (fOperation.targetIndexes[i] == fOperation.targetIndexes[j])
+          THROW_CMD_EXC(ECmdLineException::restoreParamError);
+    }
   } else if (fOperation.cmd == CmdVerify) {
     // Source must be a file name, target must be empty
     if (fOperation.sourceIndex >= 0 || fOperation.targetIndex >=0
       || fOperation.target.length() > 0) {
       THROW_CMD_EXC(ECmdLineException::verifyParamError);
     }
+  } else if (fOperation.cmd == CmdTranscode) {
+    // Source and target must be different file names
+    if (fOperation.sourceIndex >= 0 || fOperation.targetIndex >= 0
+      || _wcsicmp(fOperation.source.c_str(), fOperation.target.c_str()) == 0) {
+      THROW_CMD_EXC(ECmdLineException::transcodeParamError);
+    }
+  } else if (fOperation.cmd == CmdCompare) {
+    // Source must be a file name, target a device or a different file name
+    if (fOperation.sourceIndex >= 0 || fOperation.target.empty()
+      || (fOperation.targetIndex < 0 && _wcsicmp(fOperation.source.c_str(), fOperation.target.c_str()) == 0)) {
+      THROW_CMD_EXC(ECmdLineException::compareParamError);
+    }
+  }
+
+  // an image on standard input or output is read or written once in order: only a
+  // single image file without a base image or chunk store, a restore can not ask
+  bool stdSource = CStdImageStream::IsStdName(fOperation.source.c_str());
+  bool stdTarget = CStdImageStream::IsStdName(fOperation.target.c_str());
+  if (stdSource || stdTarget) {
+    bool ok;
+    if (fOperation.cmd == CmdBackup) {
+      bool diskInParts = fOperation.mode != modeAllBlocks
+        && fOdinManager->GetDriveList()->GetItem(fOperation.sourceIndex)->IsCompleteHardDisk();
+      ok = stdTarget && fOperation.splitSizeMB == 0 && fOperation.baseImage.empty()
+        && fOperation.compression != compressionChunkStore && !diskInParts;
+    } else {
+      ok = fOperation.cmd == CmdRestore && stdSource && fOperation.force;
+    }
+    if (!ok)
+      THROW_CMD_EXC(ECmdLineException::stdStreamParamError);
   }
 }
 
 void CCommandLineProcessor::PrintUsage() {
   wcout << L"Usage:" << endl;
   wcout << L"ODIN [operation] [options] -source=[name] -target=[name]" << endl;
-  wcout << L"  [operation] is one of -backup, -restore, -verify or -list" << endl;
+  wcout << L"  [operation] is one of -backup, -restore, -verify, -transcode, -compare -list or -serve" << endl;
   wcout << L"  [options] are:" << endl;
-  wcout << L"  -compression=[gzip|lz4|lz4hc|zstd|bzip|none]  use specified compression" << endl;
+  wcout << L"  -compression=[gzip|lz4|lz4hc|zstd|dedup|bzip|none]  use specified compression" << endl;
   wcout << L"                gzip=deflate, lz4=fast LZ4, lz4hc=high-compression LZ4," << endl;
   wcout << L"                zstd=Zstandard, bzip=bzip2 (read-only legacy), none=no compression" << endl;
+  wcout << L"                dedup=store data in chunk store \"chunks\" next to the image file" << endl;
+  wcout << L"                shared by all images in the same directory" << endl;
   wcout << L"  -makeSnapshot    make snapshot (VSS) before backup (implies -usedBlocks)" << endl;
   wcout << L"  -usedBlocks      copy only used blocks of volume" << endl;
   wcout << L"  -allBlocks       copy all blocks of volume" << endl;
   wcout << L"  -split=[nnn]     split image file every [nnn] MB" << endl;
   wcout << L"  -comment=[string] add comment to image file for backup" << endl;
+  wcout << L"  -incremental=[file] store only blocks changed since image [file] (needs" << endl;
+  wcout << L"                -usedBlocks), restoring the new image restores all images it" << endl;
+  wcout << L"                is based on" << endl;
+  wcout << L"  -delta           restore writes only blocks that differ from the content of" << endl;
+  wcout << L"                the target, fast if the target holds a similar image already" << endl;
+  wcout << L"  -readback        restore reads all written data back from the target while" << endl;
+  wcout << L"                restoring and fails at the first difference (not with -delta)" << endl;
+  wcout << L"  -hash=[sha1|sha256|both] calculate the hash of the restored volume while" << endl;
+  wcout << L"                restoring (free clusters count as zeros), no extra read needed," << endl;
+  wcout << L"                for -backup the hash of the volume is stored in the image" << endl;
+  wcout << L"  -hashscope=[volume|used] what -hash covers: the volume up to its size" << endl;
+  wcout << L"                (default) or only the used clusters, so that a verify needs" << endl;
+  wcout << L"                to read only the used clusters from the drive" << endl;
+  wcout << L"  -readlimit=[MB] -readiops=[n] read the source with at most [MB] MB and [n]" << endl;
+  wcout << L"                read operations per second, e.g. for a backup of a volume in use" << endl;
+  wcout << L"  -writelimit=[MB] -writeiops=[n] write the target with at most [MB] MB and [n]" << endl;
+  wcout << L"                write operations per second (all drives of a restore together)" << endl;
+  wcout << L"                (default ReadLimitMBPerSecond, ReadLimitIOPS, WriteLimitMBPerSecond," << endl;
+  wcout << L"                WriteLimitIOPS, 0 for none)" << endl;
+  wcout << L"  -lowpriority     read and write with low I/O priority (background mode)" << endl;
+  wcout << L"                (default LowIoPriority)" << endl;
+  wcout << L"  -checkpoint=[MB] record a checkpoint of a -backup or -restore every [MB] MB" << endl;
+  wcout << L"                in a journal next to the image (default CheckpointIntervalMB," << endl;
+  wcout << L"                0 for none)" << endl;
+  wcout << L"  -resume          continue an interrupted -backup or -restore at the last" << endl;
+  wcout << L"                checkpoint of its journal next to the image (single image file" << endl;
+  wcout << L"                without -split, -incremental, -delta, -hash or dedup), records" << endl;
+  wcout << L"                checkpoints every 1024 MB if no interval is set" << endl;
   wcout << L"  [name]    name can be a device name like \\Device\\Harddisk0\\Partition0 or" << endl;
   wcout << L"            a file name like c:\\DiskCImage.dat or a number that refers to " << endl;
-  wcout << L"            an index from the -list command" << endl;
+  wcout << L"            an index from the -list command or a drive letter like F:" << endl;
+  wcout << L"            for -restore the target can be a list of devices separated by ','" << endl;
+  wcout << L"            the image is then read once and written to all of them" << endl;
+  wcout << L"            - as file name reads the image from standard input or writes it" << endl;
+  wcout << L"            to standard output (single volume -backup or -restore with -force)" << endl;
   wcout << L"  -backup   creates an image from a disk or volume to a file" << endl;
   wcout << L"  -restore  restores a disk image from a file to a volume or disk" << endl;
   wcout << L"  -verify   checks an image for damage" << endl;
+  wcout << L"  -transcode converts an image file to a new image file with the compression" << endl;
+  wcout << L"            given by -compression without restoring it" << endl;
+  wcout << L"  -compare  compares an image file with a volume or a file holding a copy of" << endl;
+  wcout << L"            a volume, only used clusters, and lists the differing ranges" << endl;
   wcout << L"  -list     prints a list of available volumes on this machine" << endl;
-  wcout << L"  -output=[filename]  write -list output to file instead of console" << endl;
+  wcout << L"  -serve    runs as imaging engine taking jobs from other programs through" << endl;
+  wcout << L"            the named pipe \\\\.\\pipe\\ODINEngine until it gets a shutdown" << endl;
+  wcout << L"  -pipe=[name] name of the pipe for -serve" << endl;
+  wcout << L"  -events=[name] write progress and result as events to a named pipe, a file or" << endl;
+  wcout << L"            an inherited handle given as number instead of the console" << endl;
+  wcout << L"  -output=[filename]  write -list output to file instead of console, for" << endl;
+  wcout << L"            -restore write the result and hashes of each target to the file" << endl;
   wcout << L"  -force    suppress all warning messages and continue immediately (very" << endl;
   wcout << L"            dangerous!)" << endl;
   wcout << endl;
@@ -600,8 +970,37 @@ void CCommandLineProcessor::PrintUsage() {
   wcout << L"ODIN -backup -usedBlocks -compression=lz4 -source=1 -target=myimage.dat" << endl;
   wcout << L"  backups volume number 1 with LZ4 compression (fastest option)" << endl;
   wcout << L"  and only used blocks (1 refers to index 1 of devices from output of -list) " << endl;
+  wcout << L"ODIN -backup -usedBlocks -compression=dedup -source=1 -target=d:\\images\\pc1.dat" << endl;
+  wcout << L"  backups volume number 1 storing only data not already in d:\\images\\chunks" << endl;
+  wcout << L"ODIN -backup -incremental=d:\\images\\sun.dat -source=1 -target=d:\\images\\mon.dat" << endl;
+  wcout << L"  backups volume number 1 storing only blocks that changed since sun.dat" << endl;
+  wcout << L"ODIN -backup -allBlocks -hash=both -source=1 -target=myimage.dat" << endl;
+  wcout << L"  backups volume number 1 and stores SHA-1 and SHA-256 of it in the image" << endl;
   wcout << L"ODIN -restore -source=myimage.dat -target=\\Device\\Harddisk0\\Partition0" << endl;
   wcout << L"  restores image from file myimage.dat to first partition of first disk " << endl;
+  wcout << L"ODIN -restore -delta -source=myimage.dat -target=\\Device\\Harddisk1\\Partition0" << endl;
+  wcout << L"  restores image to second disk writing only blocks that have changed" << endl;
+  wcout << L"ODIN -restore -readback -source=myimage.dat -target=F:" << endl;
+  wcout << L"  restores image to drive F: and checks the written data by reading them back" << endl;
+  wcout << L"ODIN -restore -source=myimage.dat -target=3,4,5" << endl;
+  wcout << L"  restores image from file myimage.dat to the drives 3, 4 and 5 at once" << endl;
+  wcout << L"ODIN -restore -hash=sha1 -source=myimage.dat -target=F: -output=result.ini" << endl;
+  wcout << L"  restores image to drive F: and writes the SHA-1 of the volume to result.ini" << endl;
+  wcout << L"ODIN -backup -makeSnapshot -readlimit=50 -readiops=200 -lowpriority -source=1 -target=myimage.dat" << endl;
+  wcout << L"  backups volume number 1 of a running server reading at most 50MB/s" << endl;
+  wcout << L"ODIN -backup -checkpoint=1024 -source=1 -target=myimage.dat" << endl;
+  wcout << L"  backups volume number 1 with a checkpoint every GB, so that it can be resumed" << endl;
+  wcout << L"ODIN -backup -resume -source=1 -target=myimage.dat" << endl;
+  wcout << L"  continues the interrupted backup of volume number 1 to myimage.dat" << endl;
+  wcout << L"ODIN -restore -force -source=- -target=F: < myimage.dat" << endl;
+  wcout << L"  restores the image read from standard input to drive F:" << endl;
+  wcout << L"ODIN -transcode -compression=zstd -source=old.dat -target=new.dat" << endl;
+  wcout << L"  converts image file old.dat to image file new.dat with Zstandard compression" << endl;
+  wcout << L"ODIN -compare -source=myimage.dat -target=F:" << endl;
+  wcout << L"  checks if drive F: still holds the data of image file myimage.dat" << endl;
+  wcout << L"ODIN -serve" << endl;
+  wcout << L"  waits for jobs like \"job -restore -source=myimage.dat -target=F:\" on the" << endl;
+  wcout << L"  pipe \\\\.\\pipe\\ODINEngine and reports their progress to the client" << endl;
   wcout << L"ODIN -list" << endl;
   wcout << L"  prints all availaible volumes and disks with their name and number" << endl;
   wcout << L"ODIN -list -output=drives.txt" << endl;
@@ -620,13 +1019,27 @@ void CCommandLineProcessor::Reset() {
   fOperation.source.clear();
   fOperation.target.clear();
   fOperation.comment.clear();
+  fOperation.baseImage.clear();
   fOperation.outputFile.clear();
+  fOperation.pipeName.clear();
+  fOperation.eventsTarget.clear();
   fOperation.sourceIndex  = -1;
   fOperation.targetIndex  = -1;
+  fOperation.targetIndexes.clear();
   fOperation.splitSizeMB  = 0;
   fOperation.mode         = modeOnlyUsedBlocks;
   fOperation.compression  = compressionGZip;
   fOperation.force        = false;
+  fOperation.deltaRestore = false;
+  fOperation.readBackVerify = false;
+  fOperation.mediaHash    = 0;
+  fOperation.readLimit    = 0;
+  fOperation.readIops     = 0;
+  fOperation.writeLimit   = 0;
+  fOperation.writeIops    = 0;
+  fOperation.lowIoPriority = false;
+  fOperation.resume       = false;
+  fOperation.checkpointMB = -1;
   fTimer      = NULL;
   fLastPercent = 0;
   fFeedback.reset();
@@ -640,12 +1053,20 @@ void CCommandLineProcessor::OnFinished()
 {
   DWORD crc32;
   if (fTimer) {
-    TerminateThread(fTimer, 0);
-    CloseHandle(fTimer);
-    fTimer = NULL;
+    StopTimer();
     wcout << endl;
     fFeedback.reset();
-    if (fVerifyRun) {
+    if (fVerifyRun && fOdinManager->WasBlockVerify()) {
+      const vector<TImageRange>& ranges = fOdinManager->GetCorruptRanges();
+      if (ranges.empty()) {
+        wcout << L"Verify result is ok (all blocks match the block manifest)." << endl;
+      } else {
+        wcout << L"Verify found " << ranges.size() << L" corrupted range(s) in image file:" << endl;
+        for (size_t i=0; i<ranges.size(); i++)
+          wcout << L"  offset " << ranges[i].offset << L", length " << ranges[i].length << L" bytes" << endl;
+      }
+      fExitCode = !ranges.empty();
+    } else if (fVerifyRun) {
       crc32 = fOdinManager->GetVerifiedChecksum();
       if (crc32 == fCrc32)
         wcout << L"Verify result is ok." << endl;
@@ -653,20 +1074,136 @@ void CCommandLineProcessor::OnFinished()
         wcout << L"Verify result " << crc32 << L" differs from original value " << fCrc32 << endl;
       fExitCode = crc32 != fCrc32;
     }
-    else
+    else if (fOperation.cmd == CmdCompare) {
+      ReportCompareResults();
+    }
+    else if (fOperation.cmd == CmdTranscode && !fOdinManager->WasSourceIntact()) {
+      wcout << L"Warning: the data read from the source image does not match its checksum." << endl;
+      fExitCode = 1;
+    }
+    else if (fOperation.cmd == CmdRestore && fOperation.targetIndexes.size() > 0) {
+      // exit code 0 if all drives are ok, otherwise 0x10000 with bit n set for each failed
+      // target n in the order given by -target
       fExitCode = 0;
+      if (fOdinManager->WasError()) {
+        fErrorMessage = fOdinManager->GetErrorMessage();
+        wcout << L"Error: " << fErrorMessage << endl;
+        fExitCode = 1;
+      }
+      for (unsigned i=0; i<fOdinManager->GetFanOutTargetCount(); i++) {
+        LPCWSTR deviceName = fOdinManager->GetDriveList()->GetItem(fOperation.targetIndexes[i])->GetDeviceName().c_str();
+        if (fOdinManager->WasFanOutTargetFailed(i)) {
+          wcout << L"Target " << deviceName << L" failed: " << fOdinManager->GetFanOutTargetError(i) << endl;
+          if (fExitCode != 1)
+            fExitCode |= 0x10000 | (1 << i);
+        } else {
+          wcout << L"Target " << deviceName << L" ok." << endl;
+        }
+      }
+      if (fOperation.deltaRestore)
+        wcout << L"Delta restore: " << fOdinManager->GetDeltaSkippedBytes()
+              << L" bytes were unchanged on the targets and not written." << endl;
+      if (fOperation.readBackVerify)
+        wcout << L"Read back: " << fOdinManager->GetReadBackVerifiedBytes()
+              << L" bytes were read back from the targets and are identical." << endl;
+      ReportRestoreResults();
+    }
+    else {
+      if (fOperation.cmd == CmdRestore && fOperation.deltaRestore)
+        wcout << L"Delta restore: " << fOdinManager->GetDeltaSkippedBytes()
+              << L" bytes were unchanged on the target and not written." << endl;
+      if (fOperation.cmd == CmdRestore && fOperation.readBackVerify)
+        wcout << L"Read back: " << fOdinManager->GetReadBackVerifiedBytes()
+              << L" bytes were read back from the target and are identical." << endl;
+      if (fOdinManager->GetResumedBytes() > 0)
+        wcout << L"Resumed: " << fOdinManager->GetResumedBytes()
+              << L" bytes were taken from the interrupted operation." << endl;
+      if (fOperation.cmd == CmdRestore)
+        ReportRestoreResults();
+      const CMediaHash* hash = fOperation.cmd == CmdBackup ? fOdinManager->GetMediaHash() : NULL;
+      if (hash && !hash->GetSha1().empty())
+        wcout << L"SHA-1 of volume stored in image: " << hash->GetSha1() << endl;
+      if (hash && !hash->GetSha256().empty())
+        wcout << L"SHA-256 of volume stored in image: " << hash->GetSha256() << endl;
+      fExitCode = 0;
+      if (fOdinManager->WasError()) {
+        fErrorMessage = fOdinManager->GetErrorMessage();
+        wcout << L"Error: " << fErrorMessage << endl;
+        fExitCode = 1;
+      }
+    }
     fLastPercent = 0;
     fCrc32 = 0;
     fVerifyRun = false;
   }
 }
 
+// print the ranges of the volume where the last compare found differences, exit code 0
+// if the target holds the data of the image, 1 for an error and 2 for differences
+void CCommandLineProcessor::ReportCompareResults()
+{
+  if (fOdinManager->WasError()) {
+    fErrorMessage = fOdinManager->GetErrorMessage();
+    wcout << L"Error: " << fErrorMessage << endl;
+    fExitCode = 1;
+    return;
+  }
+  const vector<TImageRange>& ranges = fOdinManager->GetCompareDifferences();
+  if (ranges.empty()) {
+    wcout << L"Compare result is ok, " << fOdinManager->GetComparedBytes() << L" bytes are identical." << endl;
+    fExitCode = 0;
+    return;
+  }
+  wcout << L"Compare found " << fOdinManager->GetCompareDifferingBytes() << L" of "
+        << fOdinManager->GetComparedBytes() << L" bytes differing in " << ranges.size() << L" range(s):" << endl;
+  size_t count = ranges.size() < kMaxPrintedRanges ? ranges.size() : kMaxPrintedRanges;
+  for (size_t i=0; i<count; i++)
+    wcout << L"  " << ranges[i].offset << L"-" << ranges[i].offset + ranges[i].length - 1
+          << L" (" << ranges[i].length << L" bytes)" << endl;
+  if (count < ranges.size())
+    wcout << L"  ... " << ranges.size() - count << L" more range(s)" << endl;
+  fExitCode = 2;
+}
+
+// print the hashes of the restored volumes and write the result of each target to the
+// -output file, one ini section TargetN for the n-th target given by -target
+void CCommandLineProcessor::ReportRestoreResults()
+{
+  wstring outputFile;
+  if (!fOperation.outputFile.empty()) {
+    // WritePrivateProfileString() needs a full path
+    wchar_t fullPath[MAX_PATH];
+    if (GetFullPathNameW(fOperation.outputFile.c_str(), MAX_PATH, fullPath, NULL) > 0)
+      outputFile = fullPath;
+  }
+
+  bool fanOut = fOperation.targetIndexes.size() > 0;
+  unsigned targetCount = fanOut ? fOdinManager->GetFanOutTargetCount() : 1;
+  for (unsigned i=0; i<targetCount; i++) {
+    int driveIndex = fanOut ? fOperation.targetIndexes[i] : fOperation.targetIndex;
+    LPCWSTR deviceName = fOdinManager->GetDriveList()->GetItem(driveIndex)->GetDeviceName().c_str();
+    bool failed = fanOut ? fOdinManager->WasFanOutTargetFailed(i) : fOdinManager->WasError();
+    const CMediaHash* hash = failed ? NULL : fOdinManager->GetMediaHash(i);
+    if (hash && !hash->GetSha1().empty())
+      wcout << L"SHA-1 of " << deviceName << L": " << hash->GetSha1() << endl;
+    if (hash && !hash->GetSha256().empty())
+      wcout << L"SHA-256 of " << deviceName << L": " << hash->GetSha256() << endl;
+    if (!outputFile.empty()) {
+      wchar_t section[16];
+      swprintf_s(section, L"Target%u", i);
+      WritePrivateProfileStringW(section, L"Device", deviceName, outputFile.c_str());
+      WritePrivateProfileStringW(section, L"Result", failed ? L"failed" : L"ok", outputFile.c_str());
+      WritePrivateProfileStringW(section, L"SHA1", hash ? hash->GetSha1().c_str() : L"", outputFile.c_str());
+      WritePrivateProfileStringW(section, L"SHA256", hash ? hash->GetSha256().c_str() : L"", outputFile.c_str());
+      WritePrivateProfileStringW(section, L"HashScope", fOperation.mediaHashUsedOnly ? L"used" : L"volume", outputFile.c_str());
+    }
+  }
+}
+
 void CCommandLineProcessor::OnAbort()
 {
   if (fTimer) {
-    TerminateThread(fTimer, 0);
-    CloseHandle(fTimer);
-    fTimer = NULL;
+    StopTimer();
     fFeedback.reset();
     wcout << endl;
     fLastPercent = 0;
@@ -679,6 +1216,7 @@ void CCommandLineProcessor::OnAbort()
 void CCommandLineProcessor::OnPartitionChange(int i, int n)
 {
   wcout << endl << L"Processing now partition " << i+1 << L" of " << n << endl;
+  ReportStage(L"partition");
 }
 
 void CCommandLineProcessor::OnPrepareSnapshotBegin()
@@ -699,9 +1237,17 @@ void CCommandLineProcessor::OnPrepareSnapshotReady()
 
 void CCommandLineProcessor::ReportFeedback()
 {
-  wcout << L'.';
+  if (fCancelRequested && !fCancelSent) {
+    fCancelSent = true;
+    fOdinManager->CancelOperation();
+  }
   unsigned __int64 bytesTotal = fOdinManager->GetTotalBytesToProcess();
   unsigned __int64 bytesProcessed = fOdinManager->GetBytesProcessed();
+  if (fEvents) {
+    fEvents->OnProgress(bytesProcessed, bytesTotal);
+    return;
+  }
+  wcout << L'.';
   if (bytesTotal) {
     int percent = (int) ((bytesProcessed * 100 + (bytesTotal/2)) / bytesTotal);
     if (percent > fLastPercent+5) {
@@ -712,8 +1258,52 @@ void CCommandLineProcessor::ReportFeedback()
   wcout.flush();
 }
 
+void CCommandLineProcessor::ReportStage(LPCWSTR stage)
+{
+  if (fEvents)
+    fEvents->OnStage(stage);
+}
+
+// progress is reported once a second while an operation runs, starting after two
+// seconds, and twice a second from the start to a client reading events
+void CCommandLineProcessor::StartTimer()
+{
+  ResetEvent(fTimerStop);
+  fTimer = CreateThread(NULL, 0, TimerThread, this, 0, NULL);
+}
+
+// the timer thread is ended at a defined point so that it never holds a lock
+void CCommandLineProcessor::StopTimer()
+{
+  if (fTimer) {
+    SetEvent(fTimerStop);
+    WaitForSingleObject(fTimer, INFINITE);
+    CloseHandle(fTimer);
+    fTimer = NULL;
+  }
+}
+
+DWORD WINAPI CCommandLineProcessor::TimerThread(LPVOID param)
+{
+  CCommandLineProcessor* processor = (CCommandLineProcessor*) param;
+  DWORD interval = processor->fEvents ? 500 : 2000;
+  while (WaitForSingleObject(processor->fTimerStop, interval) == WAIT_TIMEOUT) {
+    processor->ReportFeedback();
+    interval = processor->fEvents ? 500 : 1000;
+  }
+  return 0;
+}
+
 // Code taken from: http://dslweb.nwnexus.com/~ast/dload/guicon.htm
 static const WORD MAX_CONSOLE_LINES = 500;
+static bool IsRedirectedToFile(DWORD stdHandle) {
+  HANDLE h = GetStdHandle(stdHandle);
+  if (h == NULL || h == INVALID_HANDLE_VALUE)
+    return false;
+  DWORD type = GetFileType(h);
+  return type == FILE_TYPE_DISK || type == FILE_TYPE_PIPE;
+}
+
 bool  CCommandLineProcessor::InitConsole(bool createConsole) {
   CONSOLE_SCREEN_BUFFER_INFO coninfo;
 
@@ -755,9 +1345,13 @@ bool  CCommandLineProcessor::InitConsole(bool createConsole) {
   // STARTF_USESTDHANDLES: the _open_osfhandle path silently fails because
   // the CRT fd table already owns the inherited handle.  CONOUT$/CONIN$
   // always resolve to the console we just attached or allocated.
-  freopen("CONOUT$", "w", stdout);
+  // An image read from or written to a redirected stdin or stdout (-source=- or
+  // -target=-) uses the inherited handle, it must not be replaced by the console.
+  if (!IsRedirectedToFile(STD_OUTPUT_HANDLE))
+    freopen("CONOUT$", "w", stdout);
   freopen("CONOUT$", "w", stderr);
-  freopen("CONIN$",  "r", stdin);
+  if (!IsRedirectedToFile(STD_INPUT_HANDLE))
+    freopen("CONIN$",  "r", stdin);
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
 
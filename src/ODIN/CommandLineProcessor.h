@@ -28,19 +28,23 @@
 ///////////////////////////////////////////////////////////////////////////// 
 
 #pragma once
-#include "compression.h"
+#include "Compression.h"
 #include <memory>
 #include <string>
+#include <vector>
 
 class COdinManager;
 class CConsoleSplitManagerCallback;
 class CUserFeedbackConsole;
+class IOperationEvents;
+class CEventStream;
+class CJobEvents;
 template <class T> class CStlCmdLineArgsWin;
 
 class CCommandLineProcessor: public IWaitCallback {
 
 public:
-  typedef enum { CmdBackup, CmdRestore, CmdVerify, CmdList, CmdUsage } TOdinCommand; 
+  typedef enum { CmdBackup, CmdRestore, CmdVerify, CmdTranscode, CmdCompare, CmdList, CmdServe, CmdUsage } TOdinCommand; 
   typedef enum { modeOnlyUsedBlocks, modeUsedBlocksAndSnapshot, modeAllBlocks } TBackupMode;
 
   typedef struct {
@@ -48,13 +52,28 @@ public:
       std::wstring source;
       std::wstring target;
       std::wstring comment;
-      std::wstring outputFile;  // for -output flag with -list
+      std::wstring baseImage;   // for -incremental flag with -backup
+      std::wstring outputFile;  // for -output flag with -list and -restore
+      std::wstring pipeName;    // for -pipe flag with -serve
+      std::wstring eventsTarget; // for -events flag, pipe, file or inherited handle
       int sourceIndex;
       int targetIndex;
+      std::vector<int> targetIndexes; // for -restore to several drives, -target=[name],[name],...
 	  int splitSizeMB;
       TBackupMode mode; 
 	  TCompressionFormat compression;
 	  bool force;
+      bool deltaRestore;        // for -delta flag with -restore
+      bool readBackVerify;      // for -readback flag with -restore
+      unsigned mediaHash;       // for -hash flag with -restore, combination of CMediaHash::hashSha1/hashSha256
+      bool mediaHashUsedOnly;   // for -hashscope=used, hash only the used clusters
+      int readLimit;            // for -readlimit flag, MB per second, 0 for none or -1 if not given
+      int readIops;             // for -readiops flag, read operations per second, 0 for none or -1 if not given
+      int writeLimit;           // for -writelimit flag, MB per second, 0 for none or -1 if not given
+      int writeIops;            // for -writeiops flag, write operations per second, 0 for none or -1 if not given
+      bool lowIoPriority;       // for -lowpriority flag, the configured priority is taken if not given
+      bool resume;              // for -resume flag with -backup or -restore
+      int checkpointMB;         // for -checkpoint flag, MB between two checkpoints or -1 if not given
   } TOdinOperation;
 
   CCommandLineProcessor();
@@ -65,20 +84,47 @@ public:
   bool InitConsole(bool createConsole);
   void ReportFeedback();
 
+  // create the manager and read the list of drives
+  void Init();
+
+  // run one job of the engine: commandLine holds the options of odinc, progress and
+  // end are reported to events. Runs without asking the user. Returns the exit code
+  int RunJob(LPCWSTR commandLine, IOperationEvents* events, bool refreshDrives);
+
+  // cancel the running job, may be called from another thread
+  void CancelJob();
+
+  // change the I/O limits of the running job, options are -readlimit, -readiops,
+  // -writelimit and -writeiops like on the command line, may be called from another thread
+  void SetIoLimits(LPCWSTR options);
+
+  // forget a cancel request, called before the next job is assigned
+  void ClearCancel() {
+    fCancelRequested = false;
+  }
+
 private:
   // Parse the command line fill fOperation member
   // return true to continue with program operation or false to stop
-  void Init();
   void Parse();
   void Parse(const wchar_t* commandLine); // for unit tests
   void Parse(CStlCmdLineArgsWin<wchar_t>& cmdLineParser);
 
   void PrintUsage();
+  static bool ParseIoLimit(CStlCmdLineArgsWin<wchar_t>& cmdLineParser, LPCWSTR name, unsigned& limit);
+  static bool ParseIoLimit(CStlCmdLineArgsWin<wchar_t>& cmdLineParser, LPCWSTR name, int& limit);
   void ProcessCommandLine();
   void TerminateConsole();
   void ListDrives(); 
   void PreprocessSourceAndTarget(const std::wstring& name, bool sourceOrTarget);
   void CheckValidParameters();
+  void ReportRestoreResults();
+  void ReportCompareResults();
+  void OpenEventStream();
+  void ReportStage(LPCWSTR stage);
+  void StartTimer();
+  void StopTimer();
+  static DWORD WINAPI TimerThread(LPVOID param);
   void Reset();
   virtual void OnThreadTerminated();
   virtual void OnFinished();
@@ -94,9 +140,16 @@ private:
   TOdinOperation fOperation; // structure that contains the command and parameters
   std::unique_ptr<COdinManager> fOdinManager;
   HANDLE fTimer;
+  HANDLE fTimerStop;          // ends timer thread
   int fLastPercent;
   DWORD fCrc32;
   int fExitCode;
+  std::wstring fErrorMessage; // error of last operation
+  IOperationEvents* fEvents;  // receives progress and end of a job or NULL
+  std::unique_ptr<CEventStream> fEventStream;  // -events of odinc
+  std::unique_ptr<CJobEvents> fJobEvents;
+  volatile bool fCancelRequested;
+  bool fCancelSent;
   std::unique_ptr<CConsoleSplitManagerCallback> fSplitCB;
   std::unique_ptr<CUserFeedbackConsole> fFeedback;
   friend class CCmdLineTest;
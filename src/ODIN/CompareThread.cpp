@@ -0,0 +1,207 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <string>
+#include "BufferQueue.h"
+#include "CompareThread.h"
+#include "IRunLengthStreamReader.h"
+#include "BlockCompare.h"
+#include "Exception.h"
+#include "InternalException.h"
+
+using namespace std;
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+//---------------------------------------------------------------------------
+CCompareThread::CCompareThread(CImageBuffer *imageQueue, CImageBuffer *imageReturnQueue,
+                               CImageBuffer *deviceQueue, CImageBuffer *deviceReturnQueue)
+  : COdinThread(CREATE_SUSPENDED)
+{
+  fImageQueue = imageQueue;
+  fImageReturnQueue = imageReturnQueue;
+  fDeviceQueue = deviceQueue;
+  fDeviceReturnQueue = deviceReturnQueue;
+  fRunLengthReader = NULL;
+  fCompareUnit = sDefaultCompareUnit;
+  fMaxRanges = (unsigned) -1;
+  fDifferingBytes = 0;
+  fRunStreamPos = fRunVolumePos = fRunUsedBytes = fRunFreeBytes = 0;
+}
+
+void CCompareThread::SetAllocationMapReaderInfo(IRunLengthStreamReader* runLengthReader, DWORD clusterSize)
+{
+  fRunLengthReader = runLengthReader;
+  fCompareUnit = clusterSize;
+}
+
+//---------------------------------------------------------------------------
+DWORD CCompareThread::Execute()
+{
+  SetName("CompareThread");
+  ATLTRACE("CCompareThread created,  thread: %d, name: Compare-Thread\n", GetCurrentThreadId());
+  try {
+    if (fCompareUnit == 0 || fMaxRanges == 0)
+      THROW_INT_EXC(EInternalException::inputError);
+    CompareLoop();
+    fFinished = true;
+    ATLTRACE("CCompareThread has finished,  thread: %d, name: Compare-Thread\n", GetCurrentThreadId());
+    return S_OK;
+  } catch (Exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = e.GetMessage();
+    fFinished = true;
+    return E_FAIL;
+  } catch (std::exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Compare thread encountered standard exception: ";
+    fErrorMessage += CA2W(e.what());
+    fFinished = true;
+    return E_FAIL;
+  } catch (...) {
+    fErrorFlag = true;
+    fErrorMessage = L"Compare thread encountered unknown exception";
+    fFinished = true;
+    return E_FAIL;
+  }
+}
+
+//---------------------------------------------------------------------------
+// Compare both streams piecewise, a piece ends at the end of a chunk of either
+// stream or at the end of a compare unit.
+void CCompareThread::CompareLoop()
+{
+  CBufferChunk *imageChunk = NULL, *deviceChunk = NULL;
+  unsigned imagePos = 0, devicePos = 0;
+  unsigned __int64 streamPos = 0;
+
+  bool imageData = TakeChunk(fImageQueue, fImageReturnQueue, imageChunk, imagePos);
+  bool deviceData = TakeChunk(fDeviceQueue, fDeviceReturnQueue, deviceChunk, devicePos);
+  while (imageData || deviceData) {
+    unsigned length = fCompareUnit - (unsigned) (streamPos % fCompareUnit);
+    if (imageData && imageChunk->GetSize() - imagePos < length)
+      length = imageChunk->GetSize() - imagePos;
+    if (deviceData && deviceChunk->GetSize() - devicePos < length)
+      length = deviceChunk->GetSize() - devicePos;
+
+    if (!imageData || !deviceData || !CBlockCompare::IsSame((BYTE*)imageChunk->GetData() + imagePos,
+          (BYTE*)deviceChunk->GetData() + devicePos, length))
+      AddDifference(streamPos, length);
+    streamPos += length;
+    fBytesProcessed += length;
+
+    if (imageData) {
+      imagePos += length;
+      if (imagePos == imageChunk->GetSize())
+        imageData = TakeChunk(fImageQueue, fImageReturnQueue, imageChunk, imagePos);
+    }
+    if (deviceData) {
+      devicePos += length;
+      if (devicePos == deviceChunk->GetSize())
+        deviceData = TakeChunk(fDeviceQueue, fDeviceReturnQueue, deviceChunk, devicePos);
+    }
+  }
+
+  // without allocation map the last unit may be shorter
+  if (!fRunLengthReader && !fDifferences.empty()) {
+    TImageRange& last = fDifferences.back();
+    if (last.offset + last.length > streamPos) {
+      fDifferingBytes -= last.offset + last.length - streamPos;
+      last.length = streamPos - last.offset;
+    }
+  }
+  ATLTRACE("Compare thread: Number of compared bytes: %u, differing: %u\n", fBytesProcessed, fDifferingBytes);
+}
+
+//---------------------------------------------------------------------------
+// Release chunk if there is one and take the next chunk with data from queue,
+// returns false at the end of the stream
+bool CCompareThread::TakeChunk(CImageBuffer* queue, CImageBuffer* returnQueue, CBufferChunk*& chunk, unsigned& chunkPos)
+{
+  while (true) {
+    if (chunk) {
+      bool eof = chunk->IsEOF();
+      chunk->Reset();
+      returnQueue->ReleaseChunk(chunk);
+      chunk = NULL;
+      if (fCancel)
+        Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
+      if (eof)
+        return false;
+    }
+    chunk = queue->GetChunk(); // may block
+    if (!chunk)
+      THROW_INT_EXC(EInternalException::getChunkError);
+    chunkPos = 0;
+    if (chunk->GetSize() > 0)
+      return true;
+  }
+}
+
+//---------------------------------------------------------------------------
+// Record the compare unit containing the piece at streamPos as different,
+// adjacent units are merged into one range
+void CCompareThread::AddDifference(unsigned __int64 streamPos, unsigned length)
+{
+  unsigned __int64 unitStart = streamPos - streamPos % fCompareUnit;
+  unsigned __int64 volumePos = MapToVolume(unitStart);
+
+  if (!fDifferences.empty()) {
+    TImageRange& last = fDifferences.back();
+    unsigned __int64 lastEnd = last.offset + last.length;
+    if (volumePos < lastEnd)
+      return; // another piece of a unit already recorded
+    if (volumePos == lastEnd || fDifferences.size() >= fMaxRanges) {
+      last.length = volumePos + fCompareUnit - last.offset;
+      fDifferingBytes += fCompareUnit;
+      return;
+    }
+  }
+  TImageRange range;
+  range.offset = volumePos;
+  range.length = fCompareUnit;
+  fDifferences.push_back(range);
+  fDifferingBytes += fCompareUnit;
+}
+
+//---------------------------------------------------------------------------
+// Volume offset of stream offset streamPos, the used clusters of the volume are
+// stored one after the other in the stream. Offsets must be given in ascending order.
+unsigned __int64 CCompareThread::MapToVolume(unsigned __int64 streamPos)
+{
+  if (!fRunLengthReader)
+    return streamPos;
+  while (streamPos >= fRunStreamPos + fRunUsedBytes) {
+    if (fRunLengthReader->LastValueRead())
+      THROW_INT_EXC(EInternalException::inputError); // stream longer than allocation map
+    fRunStreamPos += fRunUsedBytes;
+    fRunVolumePos += fRunUsedBytes + fRunFreeBytes;
+    fRunUsedBytes = fRunLengthReader->GetNextRunLength() * fCompareUnit;
+    fRunFreeBytes = fRunLengthReader->LastValueRead() ? 0 : fRunLengthReader->GetNextRunLength() * fCompareUnit;
+  }
+  return fRunVolumePos + streamPos - fRunStreamPos;
+}
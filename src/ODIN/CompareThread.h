@@ -0,0 +1,94 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef CompareThread_H
+#define CompareThread_H
+//---------------------------------------------------------------------------
+
+#include <vector>
+#include "OdinThread.h"
+#include "BlockManifest.h"
+//---------------------------------------------------------------------------
+
+class CImageBuffer;
+class CBufferChunk;
+class IRunLengthStreamReader;
+
+//---------------------------------------------------------------------------
+// Thread comparing the data of two queues, the decoded data of an image and the
+// data read from a device (used clusters only if the image has an allocation map).
+// Both streams are compared in units of a cluster, differing units are collected
+// as ranges of volume offsets, adjacent ones merged. If one stream ends before
+// the other the rest of the longer one counts as different.
+//
+class CCompareThread : public COdinThread
+{
+  public:
+    CCompareThread(CImageBuffer *imageQueue, CImageBuffer *imageReturnQueue,
+                   CImageBuffer *deviceQueue, CImageBuffer *deviceReturnQueue);
+    virtual DWORD Execute();
+
+    // map offsets in the streams to the volume with the allocation map of the image,
+    // the compare unit is clusterSize. Without a map the streams are the volume.
+    void SetAllocationMapReaderInfo(IRunLengthStreamReader* runLengthReader, DWORD clusterSize);
+
+    // keep at most maxRanges ranges, further differences extend the last range
+    void SetMaxRanges(unsigned maxRanges) {
+      fMaxRanges = maxRanges;
+    }
+
+    // differing ranges in ascending order, offsets are volume offsets
+    const std::vector<TImageRange>& GetDifferences() const {
+      return fDifferences;
+    }
+
+    // bytes in differing units, exact even if ranges were merged by SetMaxRanges()
+    unsigned __int64 GetDifferingBytes() const {
+      return fDifferingBytes;
+    }
+
+    static const unsigned sDefaultCompareUnit = 4096;  // compare unit without allocation map
+
+  private:
+    void CompareLoop();
+    bool TakeChunk(CImageBuffer* queue, CImageBuffer* returnQueue, CBufferChunk*& chunk, unsigned& chunkPos);
+    void AddDifference(unsigned __int64 streamPos, unsigned length);
+    unsigned __int64 MapToVolume(unsigned __int64 streamPos);
+
+    CImageBuffer *fImageQueue;
+    CImageBuffer *fImageReturnQueue;
+    CImageBuffer *fDeviceQueue;
+    CImageBuffer *fDeviceReturnQueue;
+    IRunLengthStreamReader* fRunLengthReader; // allocation map of image or NULL
+    DWORD fCompareUnit;                 // size of compared units, cluster size with allocation map
+    unsigned fMaxRanges;
+    std::vector<TImageRange> fDifferences;
+    unsigned __int64 fDifferingBytes;
+    unsigned __int64 fRunStreamPos;     // stream offset of current run of used clusters
+    unsigned __int64 fRunVolumePos;     // volume offset of current run of used clusters
+    unsigned __int64 fRunUsedBytes;     // length of current run of used clusters
+    unsigned __int64 fRunFreeBytes;     // length of free clusters following current run
+}; 
+//---------------------------------------------------------------------------
+#endif
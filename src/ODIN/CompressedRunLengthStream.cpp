@@ -46,6 +46,13 @@ CBitArray::CBitArray(void)
 } 
 //---------------------------------------------------------------------------
 
+CBitArray::CBitArray(void *bits, unsigned bitCount)
+{
+  fArray = NULL;
+  fArraySize = 0;
+  LoadBuffer(bits, bitCount);
+}
+
 //---------------------------------------------------------------------------
 
 CBitArray::~CBitArray()
@@ -31,7 +31,26 @@ typedef enum {
   compressionBZIP2 = 2,  // read-only: legacy files only — write support retired in v0.4
   compressionLZ4   = 3,
   compressionLZ4HC = 4,
-  compressionZSTD  = 5
+  compressionZSTD  = 5,
+  compressionChunkStore = 6  // deduplicated: data area holds a recipe, chunks are in a chunk store
 } TCompressionFormat;
 
+// lz4 and zstd are not available if ODIN is built without their libraries
+inline bool IsCompressionAvailable(TCompressionFormat format)
+{
+  switch (format) {
+#ifdef ODIN_NO_LZ4
+    case compressionLZ4:
+    case compressionLZ4HC:
+      return false;
+#endif
+#ifdef ODIN_NO_ZSTD
+    case compressionZSTD:
+      return false;
+#endif
+    default:
+      return true;
+  }
+}
+
 #endif
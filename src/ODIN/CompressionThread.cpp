@@ -24,8 +24,12 @@
 #include "stdafx.h"
 #include "../zlib-1.3.2/zlib.h"
 #include "../bzip2-1.0.5/bzlib.h"
+#ifndef ODIN_NO_LZ4
 #include "lz4frame.h"
+#endif
+#ifndef ODIN_NO_ZSTD
 #include "zstd.h"
+#endif
 #include "Compression.h"
 #include <string>
 #include "BufferQueue.h"
@@ -115,11 +119,24 @@ DWORD CCompressionThread::Execute()
   return 0;
 }  
 
+//---------------------------------------------------------------------------
+// Get a chunk for compressed data. It is marked as checkpoint only if a stream
+// (frame) of the compression ends with it, see CBufferChunk::SetCheckpoint().
+//
+CBufferChunk* CCompressionThread::GetCompressedChunk()
+{
+  CBufferChunk* chunk = fSourceQueueCompressed->GetChunk(); // may block
+  if (chunk)
+    chunk->ClearCheckpoint();
+  return chunk;
+}
+
 //---------------------------------------------------------------------------
 
 void  CCompressionThread::CompressLoopZlib()
 {
   bool bEOF = false;
+  bool bCheckpoint = false;
   z_stream  zStream;
   int flush, ret = Z_OK;
   CBufferChunk *readChunk = NULL;
@@ -132,13 +149,14 @@ void  CCompressionThread::CompressLoopZlib()
   }
 
   while (ret != Z_STREAM_END) {
-    if (zStream.avail_in == 0 && !bEOF) {
+    if (zStream.avail_in == 0 && !bEOF && !bCheckpoint) {
       if (readChunk)
         fTargetQueueDecompressed->ReleaseChunk(readChunk);
       readChunk = fSourceQueueDecompressed->GetChunk(); // may block
       if (!readChunk)
         THROW_INT_EXC(EInternalException::getChunkError);
       bEOF = readChunk->IsEOF();
+      bCheckpoint = readChunk->HasCheckpoint();
       zStream.next_in = (BYTE*)readChunk->GetData();
       zStream.avail_in = readChunk->GetSize();
     }
@@ -148,21 +166,33 @@ void  CCompressionThread::CompressLoopZlib()
         compressChunk->SetSize(compressChunk->GetMaxSize());
         fTargetQueueCompressed->ReleaseChunk(compressChunk);
       }
-      compressChunk = fSourceQueueCompressed->GetChunk();
+      compressChunk = GetCompressedChunk();
       if (!compressChunk)
         THROW_INT_EXC(EInternalException::getChunkError);
       zStream.next_out = (BYTE*)compressChunk->GetData();
       zStream.avail_out = compressChunk->GetMaxSize();
     }
 
-    flush = bEOF ? Z_FINISH : Z_NO_FLUSH;
-    if (zStream.next_in > 0) {
+    flush = (bEOF || bCheckpoint) ? Z_FINISH : Z_NO_FLUSH;
+    if (zStream.next_in != NULL) {
       ret = deflate(&zStream, flush); 
       if (ret < 0 ) {
         ATLTRACE("Error in gzip compressing data, error code: %d\n", ret);
         THROWEX(EZLibCompressionException, ret);
       }
     }
+    if (ret == Z_STREAM_END && bCheckpoint) {
+      // the stream ends with the data of the checkpoint, the following data start a new one
+      compressChunk->SetSize(compressChunk->GetMaxSize() - zStream.avail_out);
+      compressChunk->SetCheckpoint(readChunk->GetCheckpointPos(), readChunk->GetCheckpointSourcePos());
+      fTargetQueueCompressed->ReleaseChunk(compressChunk);
+      compressChunk = NULL;
+      zStream.avail_out = 0;
+      bCheckpoint = false;
+      ret = deflateReset(&zStream);
+      if (ret != Z_OK)
+        THROWEX(EZLibCompressionException, ret);
+    }
     if (fCancel) {
       if (compressChunk)
         fTargetQueueCompressed->ReleaseChunk(compressChunk);
@@ -191,6 +221,7 @@ void  CCompressionThread::CompressLoopZlib()
 void CCompressionThread::CommpressLoopLibz2()
 {
   bool bEOF = false;
+  bool bCheckpoint = false;
   bz_stream  bzsStream;
   int action, ret = Z_OK;
   CBufferChunk *readChunk = NULL;
@@ -202,13 +233,14 @@ void CCompressionThread::CommpressLoopLibz2()
      THROWEX(EBZip2CompressionException, ret);
 
   while (ret != BZ_STREAM_END ) {
-    if (bzsStream.avail_in == 0 && !bEOF) {
+    if (bzsStream.avail_in == 0 && !bEOF && !bCheckpoint) {
       if (readChunk)
         fTargetQueueDecompressed->ReleaseChunk(readChunk);
       readChunk = fSourceQueueDecompressed->GetChunk(); // may block
       if (!readChunk)
         THROW_INT_EXC(EInternalException::getChunkError);
       bEOF = readChunk->IsEOF();
+      bCheckpoint = readChunk->HasCheckpoint();
       bzsStream.next_in = (char*)readChunk->GetData();
       bzsStream.avail_in = readChunk->GetSize();
     }
@@ -218,21 +250,34 @@ void CCompressionThread::CommpressLoopLibz2()
         compressChunk->SetSize(compressChunk->GetMaxSize());// (zsStream.total_out);
         fTargetQueueCompressed->ReleaseChunk(compressChunk);
       }
-      compressChunk = fSourceQueueCompressed->GetChunk();
+      compressChunk = GetCompressedChunk();
       if (!compressChunk)
         THROW_INT_EXC(EInternalException::getChunkError);
       bzsStream.next_out = (char*)compressChunk->GetData();
       bzsStream.avail_out = compressChunk->GetMaxSize();
     }
 
-    action = bEOF ? BZ_FINISH : BZ_RUN;
-    if (bzsStream.next_in > 0) {
+    action = (bEOF || bCheckpoint) ? BZ_FINISH : BZ_RUN;
+    if (bzsStream.next_in != NULL) {
       ret = BZ2_bzCompress(&bzsStream, action);
       if (ret < 0) {
         ATLTRACE("Error in bzip2 compressing data, error code: %d\n", ret);
         THROWEX(EBZip2CompressionException, ret);
       }
     }
+    if (ret == BZ_STREAM_END && bCheckpoint) {
+      // the stream ends with the data of the checkpoint, the following data start a new one
+      compressChunk->SetSize(compressChunk->GetMaxSize() - bzsStream.avail_out);
+      compressChunk->SetCheckpoint(readChunk->GetCheckpointPos(), readChunk->GetCheckpointSourcePos());
+      fTargetQueueCompressed->ReleaseChunk(compressChunk);
+      compressChunk = NULL;
+      bCheckpoint = false;
+      BZ2_bzCompressEnd(&bzsStream);
+      memset(&bzsStream, 0, sizeof(bzsStream));
+      ret = BZ2_bzCompressInit(&bzsStream, 9, 0, 0);
+      if (ret != BZ_OK)
+        THROWEX(EBZip2CompressionException, ret);
+    }
 
     if (fCancel) {
       BZ2_bzCompressEnd(&bzsStream);
@@ -267,6 +312,9 @@ void CCompressionThread::CommpressLoopLibz2()
 //
 void CCompressionThread::CompressLoopLZ4(bool useHC)
 {
+#ifdef ODIN_NO_LZ4
+  THROW_INT_EXC(EInternalException::codecNotAvailable);
+#else
   static const size_t BLOCK_SIZE = 65536; // LZ4F_max64KB
 
   LZ4F_cctx* ctx = NULL;
@@ -289,9 +337,11 @@ void CCompressionThread::CompressLoopLZ4(bool useHC)
   // Pre-compute worst-case compressed size for one BLOCK_SIZE input block.
   // With autoFlush=1 this is what a single compressUpdate call may produce.
   const size_t maxCompressedBlock = LZ4F_compressBound(BLOCK_SIZE, &prefs);
+  // LZ4F_compressBound(0, ...) gives the exact space needed for flush+end.
+  const size_t endBound = LZ4F_compressBound(0, &prefs);
 
   // Acquire first output chunk and write the LZ4 frame header.
-  compressChunk = fSourceQueueCompressed->GetChunk();
+  compressChunk = GetCompressedChunk();
   if (!compressChunk) {
     LZ4F_freeCompressionContext(ctx);
     THROW_INT_EXC(EInternalException::getChunkError);
@@ -331,7 +381,7 @@ void CCompressionThread::CompressLoopLZ4(bool useHC)
       if (dstCapacity - dstUsed < maxCompressedBlock) {
         compressChunk->SetSize(dstUsed);
         fTargetQueueCompressed->ReleaseChunk(compressChunk);
-        compressChunk = fSourceQueueCompressed->GetChunk();
+        compressChunk = GetCompressedChunk();
         if (!compressChunk) {
           LZ4F_freeCompressionContext(ctx);
           THROW_INT_EXC(EInternalException::getChunkError);
@@ -359,15 +409,50 @@ void CCompressionThread::CompressLoopLZ4(bool useHC)
         Terminate(-1);
       }
     }
+
+    // The frame ends with the data of a checkpoint, the following data start a new one.
+    if (readChunk->HasCheckpoint()) {
+      if (dstCapacity - dstUsed < endBound) {
+        compressChunk->SetSize(dstUsed);
+        fTargetQueueCompressed->ReleaseChunk(compressChunk);
+        compressChunk = GetCompressedChunk();
+        if (!compressChunk) {
+          LZ4F_freeCompressionContext(ctx);
+          THROW_INT_EXC(EInternalException::getChunkError);
+        }
+        dst         = (BYTE*)compressChunk->GetData();
+        dstCapacity = compressChunk->GetMaxSize();
+        dstUsed     = 0;
+      }
+      size_t endSize = LZ4F_compressEnd(ctx, dst + dstUsed, dstCapacity - dstUsed, NULL);
+      if (LZ4F_isError(endSize)) {
+        LZ4F_freeCompressionContext(ctx);
+        THROW_INT_EXC(EInternalException::lz4CompressError);
+      }
+      compressChunk->SetSize(dstUsed + endSize);
+      compressChunk->SetCheckpoint(readChunk->GetCheckpointPos(), readChunk->GetCheckpointSourcePos());
+      fTargetQueueCompressed->ReleaseChunk(compressChunk);
+      compressChunk = GetCompressedChunk();
+      if (!compressChunk) {
+        LZ4F_freeCompressionContext(ctx);
+        THROW_INT_EXC(EInternalException::getChunkError);
+      }
+      dst         = (BYTE*)compressChunk->GetData();
+      dstCapacity = compressChunk->GetMaxSize();
+      headerSize = LZ4F_compressBegin(ctx, dst, dstCapacity, &prefs);
+      if (LZ4F_isError(headerSize)) {
+        LZ4F_freeCompressionContext(ctx);
+        THROW_INT_EXC(EInternalException::lz4CompressError);
+      }
+      dstUsed = headerSize;
+    }
   }
 
   // Finalize: write the LZ4 frame end-mark + content checksum.
-  // LZ4F_compressBound(0, ...) gives the exact space needed for flush+end.
-  const size_t endBound = LZ4F_compressBound(0, &prefs);
   if (dstCapacity - dstUsed < endBound) {
     compressChunk->SetSize(dstUsed);
     fTargetQueueCompressed->ReleaseChunk(compressChunk);
-    compressChunk = fSourceQueueCompressed->GetChunk();
+    compressChunk = GetCompressedChunk();
     if (!compressChunk) {
       LZ4F_freeCompressionContext(ctx);
       THROW_INT_EXC(EInternalException::getChunkError);
@@ -393,6 +478,7 @@ void CCompressionThread::CompressLoopLZ4(bool useHC)
     compressChunk->SetEOF(true);
     fTargetQueueCompressed->ReleaseChunk(compressChunk);
   }
+#endif
 }
 
 //---------------------------------------------------------------------------
@@ -401,6 +487,9 @@ void CCompressionThread::CompressLoopLZ4(bool useHC)
 //
 void CCompressionThread::CompressLoopZSTD()
 {
+#ifdef ODIN_NO_ZSTD
+  THROW_INT_EXC(EInternalException::codecNotAvailable);
+#else
   ZSTD_CStream* stream = ZSTD_createCStream();
   if (!stream)
     THROW_INT_EXC(EInternalException::zstdCompressError);
@@ -416,7 +505,7 @@ void CCompressionThread::CompressLoopZSTD()
   CBufferChunk *compressChunk = NULL;
   bool bEOF = false;
 
-  compressChunk = fSourceQueueCompressed->GetChunk();
+  compressChunk = GetCompressedChunk();
   if (!compressChunk) {
     ZSTD_freeCStream(stream);
     THROW_INT_EXC(EInternalException::getChunkError);
@@ -452,7 +541,7 @@ void CCompressionThread::CompressLoopZSTD()
       if (outBuf.pos == outBuf.size) {
         compressChunk->SetSize(outBuf.pos);
         fTargetQueueCompressed->ReleaseChunk(compressChunk);
-        compressChunk = fSourceQueueCompressed->GetChunk();
+        compressChunk = GetCompressedChunk();
         if (!compressChunk) {
           ZSTD_freeCStream(stream);
           THROW_INT_EXC(EInternalException::getChunkError);
@@ -469,6 +558,36 @@ void CCompressionThread::CompressLoopZSTD()
         Terminate(-1);
       }
     }
+
+    // The frame ends with the data of a checkpoint, the following data start a new one.
+    if (readChunk->HasCheckpoint()) {
+      size_t remaining;
+      do {
+        remaining = ZSTD_endStream(stream, &outBuf);
+        if (ZSTD_isError(remaining)) {
+          ZSTD_freeCStream(stream);
+          THROW_INT_EXC(EInternalException::zstdCompressError);
+        }
+        // the output buffer is full or the frame is complete
+        if (remaining == 0)
+          compressChunk->SetCheckpoint(readChunk->GetCheckpointPos(), readChunk->GetCheckpointSourcePos());
+        compressChunk->SetSize(outBuf.pos);
+        fTargetQueueCompressed->ReleaseChunk(compressChunk);
+        compressChunk = GetCompressedChunk();
+        if (!compressChunk) {
+          ZSTD_freeCStream(stream);
+          THROW_INT_EXC(EInternalException::getChunkError);
+        }
+        outBuf.dst  = compressChunk->GetData();
+        outBuf.size = compressChunk->GetMaxSize();
+        outBuf.pos  = 0;
+      } while (remaining > 0);
+      initRet = ZSTD_initCStream(stream, level);
+      if (ZSTD_isError(initRet)) {
+        ZSTD_freeCStream(stream);
+        THROW_INT_EXC(EInternalException::zstdCompressError);
+      }
+    }
   }
 
   // Finalize: flush any remaining internal data and write the frame epilogue.
@@ -484,7 +603,7 @@ void CCompressionThread::CompressLoopZSTD()
       // More data to flush — output buffer is full; get a new chunk.
       compressChunk->SetSize(outBuf.pos);
       fTargetQueueCompressed->ReleaseChunk(compressChunk);
-      compressChunk = fSourceQueueCompressed->GetChunk();
+      compressChunk = GetCompressedChunk();
       if (!compressChunk) {
         ZSTD_freeCStream(stream);
         THROW_INT_EXC(EInternalException::getChunkError);
@@ -504,4 +623,5 @@ void CCompressionThread::CompressLoopZSTD()
     compressChunk->SetEOF(true);
     fTargetQueueCompressed->ReleaseChunk(compressChunk);
   }
+#endif
 }
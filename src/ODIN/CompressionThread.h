@@ -52,6 +52,7 @@ class CCompressionThread : public COdinThread
     virtual DWORD Execute();
 
   private:
+    CBufferChunk* GetCompressedChunk();
     void CompressLoopZlib();
     void CommpressLoopLibz2();
     void CompressLoopLZ4(bool useHC);
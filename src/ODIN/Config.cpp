@@ -22,7 +22,9 @@
 ******************************************************************************/
  
 #include "stdafx.h"
-#include <ShlObj.h>
+#ifdef _WIN32
+  #include <ShlObj.h>
+#endif
 #include "Config.h"
 #include "InternalException.h"
 
@@ -34,6 +36,7 @@ CIniWrapper CConfigEntryStatics::sIni;
 extern const wchar_t defaultSectionName[] = L"Standard";
 CStringTable CConfigEntryStatics::sStringTable(4096);
 
+#ifdef _WIN32
   // return TRUE if the executable was run from a USB-Stick, Floppy etc
 bool ProcessLoadedFromRemovableDrive() {
   const int bufferSize = MAX_PATH;
@@ -80,23 +83,30 @@ bool CfgFileInitialize(const wchar_t* iniFileName, bool forceModuleDir) {
   CConfigEntryStatics::sIni.SetPathName(buffer);
   return true;
 }
+#endif
 
 //////////////////////////////////////////////////////////////////////////////
 // class CStringTable
 //////////////////////////////////////////////////////////////////////////////
 
 CStringTable::CStringTable(int capacity) {
+  fSize = 0;
   fCapacity = capacity;
   fStringTable = new wchar_t[fCapacity];
 }
 
 CStringTable::~CStringTable() {
-  delete fStringTable;
+  delete [] fStringTable;
 }
 
 // Add a string to a table and return a reference to the location in the store
-// return NULL if no mor space is available
+// throws if no more space is available
 const wchar_t* CStringTable::AddString(const wchar_t* str) {
+  std::lock_guard<std::mutex> lock(fLock);
+  for (size_t pos=0; pos<fSize; pos+=wcslen(fStringTable+pos)+1) {
+    if (wcscmp(fStringTable+pos, str) == 0)
+      return fStringTable+pos;
+  }
   size_t len = wcslen(str)+1;
   if (len>fCapacity-fSize)
     THROW_INT_EXC(EInternalException::internalStringTableOverflow);
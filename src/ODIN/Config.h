@@ -22,7 +22,12 @@
 ******************************************************************************/
  
 #pragma once
-#include "IniWrapper.h"
+#include <mutex>
+#ifdef _WIN32
+  #include "IniWrapper.h"
+#else
+  #include "posix/PosixIniWrapper.h"
+#endif
 
 // A simple class to store constant strings in a table
 class CStringTable {
@@ -30,8 +35,9 @@ public:
   CStringTable(int capacity=1024);
   ~CStringTable();
 
-  // Add a string to a table and return a reference to the location in the store
-  // return NULL if no mor space is available
+  // Add a string to a table and return a reference to the location in the store,
+  // a string that is already in the table is stored only once so that a class with
+  // entries can be instantiated any number of times, also by several threads
   const wchar_t* AddString(const wchar_t* str);
   size_t GetCapacity() const {
     return fCapacity;
@@ -41,6 +47,7 @@ private:
   size_t fSize;
   size_t fCapacity;
   wchar_t* fStringTable;
+  std::mutex fLock;
 };
 
 //////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,92 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "CpuFeatures.h"
+#if defined(_MSC_VER)
+  #include <intrin.h>
+#elif defined(HAVE_X86_SHA_EXTENSIONS)
+  #include <cpuid.h>
+#endif
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CCpuFeatures
+///////////////////////////////////////////////////////////////////////////////////////////
+
+bool CCpuFeatures::sShaExtensionsEnabled = true;
+
+#ifdef HAVE_X86_SHA_EXTENSIONS
+// registers eax, ebx, ecx, edx of cpuid for leaf and sub leaf 0, false if leaf
+// is not supported
+static bool CpuId(unsigned leaf, unsigned regs[4])
+{
+#if defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  if ((unsigned) info[0] < leaf)
+    return false;
+  __cpuidex(info, leaf, 0);
+  for (int i=0; i<4; i++)
+    regs[i] = (unsigned) info[i];
+  return true;
+#else
+  if ((unsigned) __get_cpuid_max(0, NULL) < leaf)
+    return false;
+  __cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+  return true;
+#endif
+}
+
+static bool DetectShaExtensions()
+{
+  unsigned regs[4];
+  if (!CpuId(1, regs))
+    return false;
+  bool ssse3 = (regs[2] & (1U << 9)) != 0;
+  bool sse41 = (regs[2] & (1U << 19)) != 0;
+  if (!CpuId(7, regs))
+    return false;
+  bool sha = (regs[1] & (1U << 29)) != 0;
+  return ssse3 && sse41 && sha;
+}
+#endif
+
+bool CCpuFeatures::HasShaExtensions()
+{
+#ifdef HAVE_X86_SHA_EXTENSIONS
+  static const bool hasShaExtensions = DetectShaExtensions();
+  return hasShaExtensions;
+#else
+  return false;
+#endif
+}
+
+bool CCpuFeatures::UseShaExtensions()
+{
+  return sShaExtensionsEnabled && HasShaExtensions();
+}
+
+void CCpuFeatures::EnableShaExtensions(bool enable)
+{
+  sShaExtensionsEnabled = enable;
+}
@@ -0,0 +1,60 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __CPUFEATURES_H__
+#define __CPUFEATURES_H__
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// Runtime detection of processor instruction set extensions used by optimized code paths.
+// Code using the extensions is compiled for them with TARGET_SHA_EXTENSIONS independent
+// of the compiler settings and may only be called if the detection succeeded.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+  #define HAVE_X86_SHA_EXTENSIONS
+  #if defined(__GNUC__) || defined(__clang__)
+    #define TARGET_SHA_EXTENSIONS __attribute__((target("sha,sse4.1,ssse3")))
+  #else
+    #define TARGET_SHA_EXTENSIONS
+  #endif
+#endif
+
+class CCpuFeatures
+{
+public:
+  // processor supports the SHA extensions (SHA-NI) together with SSSE3 and SSE4.1
+  static bool HasShaExtensions();
+
+  // SHA extensions are detected and not disabled, used by CSha1 and CSha256 objects
+  // created afterwards
+  static bool UseShaExtensions();
+
+  // disable the SHA extensions, e.g. to compare with the portable implementation
+  static void EnableShaExtensions(bool enable);
+
+private:
+  static bool sShaExtensionsEnabled;
+};
+
+#endif
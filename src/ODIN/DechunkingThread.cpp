@@ -0,0 +1,392 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <string>
+#include <deque>
+#include "sync.h"
+#include "BufferQueue.h"
+#include "DechunkingThread.h"
+#include "FileFormatException.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+static const size_t kChunkBatchSize = 32; // recipe entries read ahead together
+
+//---------------------------------------------------------------------------
+// a group of chunks read by the prefetch threads
+struct TChunkBatch {
+  TChunkBatch() {
+    fDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+    fPending = 0;
+  }
+  ~TChunkBatch() {
+    CloseHandle(fDone);
+  }
+
+  vector<TRecipeEntry> fEntries;
+  vector<vector<BYTE>> fData;
+  volatile LONG fPending;       // chunks not yet read
+  HANDLE fDone;                 // signaled when all chunks are read
+  wstring fErrorMessage;        // first error reading a chunk of the batch
+};
+
+//---------------------------------------------------------------------------
+// error reading a chunk in a prefetch thread, passed on to the dechunking thread
+class EChunkPrefetchException : public Exception
+{
+public:
+  EChunkPrefetchException(LPCWSTR message)
+    : Exception(FileFormatException)
+  {
+    fMessage = message;
+  }
+};
+
+class CChunkPrefetchThread;
+
+//---------------------------------------------------------------------------
+// Distributes the chunks of posted batches to a set of threads reading them
+// from the chunk store.
+class CChunkPrefetcher {
+public:
+  CChunkPrefetcher(const CChunkStore& store, unsigned threadCount);
+  ~CChunkPrefetcher();
+
+  // start reading all chunks of batch
+  void Post(TChunkBatch* batch);
+  // wait until all chunks of batch are read, throws if one could not be read
+  void Wait(TChunkBatch* batch);
+
+  // used by prefetch threads, returns false if the thread should terminate
+  bool GetJob(TChunkBatch*& batch, size_t& index);
+  void JobDone(TChunkBatch* batch, LPCWSTR errorMessage);
+
+  const CChunkStore& GetChunkStore() const {
+    return fStore;
+  }
+
+private:
+  typedef struct {
+    TChunkBatch* batch;
+    size_t index;
+  } TChunkJob;
+
+  void PostJob(TChunkBatch* batch, size_t index);
+
+  const CChunkStore& fStore;
+  deque<TChunkJob> fJobs;
+  CCriticalSection fCritSec;
+  CSemaphore fSemaJobs;
+  vector<unique_ptr<CChunkPrefetchThread>> fThreads;
+};
+
+//---------------------------------------------------------------------------
+class CChunkPrefetchThread : public COdinThread
+{
+public:
+  CChunkPrefetchThread(CChunkPrefetcher* prefetcher)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fPrefetcher = prefetcher;
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("ChunkPrefetchThread");
+    CChunkStoreReader reader(fPrefetcher->GetChunkStore());
+    TChunkBatch* batch;
+    size_t index;
+
+    while (fPrefetcher->GetJob(batch, index)) {
+      try {
+        reader.ReadChunk(batch->fEntries[index].hash, batch->fData[index]);
+        fPrefetcher->JobDone(batch, NULL);
+      } catch (Exception &e) {
+        fPrefetcher->JobDone(batch, e.GetMessage());
+      } catch (std::exception &e) {
+        wstring msg(CA2W(e.what()));
+        fPrefetcher->JobDone(batch, msg.c_str());
+      } catch (...) {
+        fPrefetcher->JobDone(batch, L"Chunk prefetch thread encountered unknown exception");
+      }
+    }
+    fFinished = true;
+    return 0;
+  }
+
+private:
+  CChunkPrefetcher* fPrefetcher;
+};
+
+//---------------------------------------------------------------------------
+CChunkPrefetcher::CChunkPrefetcher(const CChunkStore& store, unsigned threadCount)
+  : fStore(store)
+{
+  fSemaJobs.Create(NULL, 0, MAXLONG, NULL);
+  if (threadCount == 0)
+    threadCount = 1;
+  for (unsigned i=0; i<threadCount; i++) {
+    fThreads.push_back(make_unique<CChunkPrefetchThread>(this));
+    fThreads.back()->Resume();
+  }
+}
+
+CChunkPrefetcher::~CChunkPrefetcher()
+{
+  // a job without batch terminates a thread
+  for (size_t i=0; i<fThreads.size(); i++)
+    PostJob(NULL, 0);
+  for (size_t i=0; i<fThreads.size(); i++)
+    fThreads[i]->WaitForThread();
+}
+
+void CChunkPrefetcher::PostJob(TChunkBatch* batch, size_t index)
+{
+  TChunkJob job = { batch, index };
+  fCritSec.Enter();
+  fJobs.push_back(job);
+  fCritSec.Leave();
+  fSemaJobs.Release();
+}
+
+void CChunkPrefetcher::Post(TChunkBatch* batch)
+{
+  ResetEvent(batch->fDone);
+  batch->fErrorMessage.clear();
+  batch->fData.resize(batch->fEntries.size());
+  batch->fPending = (LONG) batch->fEntries.size();
+  if (batch->fEntries.empty()) {
+    SetEvent(batch->fDone);
+    return;
+  }
+  for (size_t i=0; i<batch->fEntries.size(); i++)
+    PostJob(batch, i);
+}
+
+void CChunkPrefetcher::Wait(TChunkBatch* batch)
+{
+  DWORD res = WaitForSingleObject(batch->fDone, INFINITE);
+  if (res != WAIT_OBJECT_0)
+    THROW_INT_EXC(EInternalException::threadSyncError);
+  if (!batch->fErrorMessage.empty())
+    throw EChunkPrefetchException(batch->fErrorMessage.c_str());
+}
+
+bool CChunkPrefetcher::GetJob(TChunkBatch*& batch, size_t& index)
+{
+  WaitForSingleObject(fSemaJobs.m_h, INFINITE);
+  fCritSec.Enter();
+  TChunkJob job = fJobs.front();
+  fJobs.pop_front();
+  fCritSec.Leave();
+  batch = job.batch;
+  index = job.index;
+  return batch != NULL;
+}
+
+void CChunkPrefetcher::JobDone(TChunkBatch* batch, LPCWSTR errorMessage)
+{
+  if (errorMessage) {
+    fCritSec.Enter();
+    if (batch->fErrorMessage.empty())
+      batch->fErrorMessage = errorMessage;
+    fCritSec.Leave();
+  }
+  if (InterlockedDecrement(&batch->fPending) == 0)
+    SetEvent(batch->fDone);
+}
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CDechunkingThread
+
+//---------------------------------------------------------------------------
+// Constructor
+//
+CDechunkingThread::CDechunkingThread(const CChunkStore* chunkStore, unsigned prefetchThreadCount,
+  CImageBuffer *sourceQueueCompressed,
+  CImageBuffer *targetQueueCompressed,
+  CImageBuffer *sourceQueueDecompressed,
+  CImageBuffer *targetQueueDecompressed
+  ) : COdinThread(CREATE_SUSPENDED)
+{
+  fChunkStore = chunkStore;
+  fPrefetchThreadCount = prefetchThreadCount;
+  fSourceQueueCompressed = sourceQueueCompressed;
+  fTargetQueueCompressed = targetQueueCompressed;
+  fSourceQueueDecompressed = sourceQueueDecompressed;
+  fTargetQueueDecompressed = targetQueueDecompressed;
+  fDataChunk = NULL;
+  fDataChunkUsed = 0;
+}
+
+//---------------------------------------------------------------------------
+
+//---------------------------------------------------------------------------
+// The thread's main execution loop - keep this as simple as possible
+//
+DWORD CDechunkingThread::Execute()
+{
+  SetName("DechunkingThread");
+
+  try {
+    DechunkLoop();
+    fFinished = true;
+  } catch (Exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Dechunking thread encountered exception: \"";
+    fErrorMessage += e.GetMessage();
+    fErrorMessage += L"\"";
+    fFinished = true;
+    return E_FAIL;
+  } catch (std::exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Dechunking thread encountered standard exception: \"";
+    fErrorMessage += CA2W(e.what());
+    fErrorMessage += L"\"";
+    fFinished = true;
+    return E_FAIL;
+  } catch (...) {
+    fErrorFlag = true;
+    fErrorMessage = L"Dechunking thread encountered unknown exception";
+    fFinished = true;
+    return E_FAIL;
+  }
+  return 0;
+}
+
+//---------------------------------------------------------------------------
+// Two batches are used alternately: while the chunks of one batch are written
+// to the output queue the prefetch threads already read the chunks of the next.
+//
+void CDechunkingThread::DechunkLoop()
+{
+  TChunkBatch batches[2];
+  TChunkBatch* filling = &batches[0];  // batch collecting recipe entries
+  TChunkBatch* pending = NULL;         // batch posted to the prefetch threads
+  TRecipeEntry entry;
+  unsigned entryUsed = 0;              // bytes of entry already read, entries may span input chunks
+  CBufferChunk *readChunk = NULL;
+  bool bEOF = false;
+  // declared after the batches so that the prefetch threads are stopped before
+  // the batches are destroyed, also if an exception is thrown
+  CChunkPrefetcher prefetcher(*fChunkStore, fPrefetchThreadCount);
+
+  fDataChunk = fSourceQueueDecompressed->GetChunk();
+  if (!fDataChunk)
+    THROW_INT_EXC(EInternalException::getChunkError);
+  fDataChunkUsed = 0;
+
+  while (!bEOF) {
+    if (readChunk)
+      fTargetQueueCompressed->ReleaseChunk(readChunk);
+    readChunk = fSourceQueueCompressed->GetChunk(); // may block
+    if (!readChunk)
+      THROW_INT_EXC(EInternalException::getChunkError);
+    bEOF = readChunk->IsEOF();
+
+    const BYTE* src = (const BYTE*)readChunk->GetData();
+    unsigned srcSize = readChunk->GetSize();
+    while (srcSize > 0) {
+      unsigned count = sizeof(entry) - entryUsed;
+      if (count > srcSize)
+        count = srcSize;
+      memcpy((BYTE*)&entry + entryUsed, src, count);
+      entryUsed += count;
+      src += count;
+      srcSize -= count;
+      if (entryUsed < sizeof(entry))
+        break;
+      if (entry.length == 0 || entry.length > CContentDefinedChunker::sMaxChunkSize)
+        THROW_FILEFORMAT_EXC(EFileFormatException::wrongRecipe);
+      filling->fEntries.push_back(entry);
+      entryUsed = 0;
+
+      if (filling->fEntries.size() == kChunkBatchSize) {
+        prefetcher.Post(filling);
+        if (pending)
+          WriteBatch(prefetcher, pending);
+        pending = filling;
+        filling = (filling == &batches[0]) ? &batches[1] : &batches[0];
+      }
+    }
+
+    if (fCancel)
+      break;
+  }
+
+  if (!fCancel) {
+    if (entryUsed != 0)
+      THROW_FILEFORMAT_EXC(EFileFormatException::wrongRecipe);
+    prefetcher.Post(filling);
+    if (pending)
+      WriteBatch(prefetcher, pending);
+    WriteBatch(prefetcher, filling);
+  }
+  if (readChunk != NULL)
+    fTargetQueueCompressed->ReleaseChunk(readChunk);
+  fDataChunk->SetSize(fDataChunkUsed);
+  fDataChunk->SetEOF(true);
+  fTargetQueueDecompressed->ReleaseChunk(fDataChunk);
+  fDataChunk = NULL;
+}
+
+void CDechunkingThread::WriteBatch(CChunkPrefetcher& prefetcher, TChunkBatch* batch)
+{
+  prefetcher.Wait(batch);
+  for (size_t i=0; i<batch->fEntries.size(); i++) {
+    if (batch->fData[i].size() != batch->fEntries[i].length)
+      THROW_FILEFORMAT_EXC(EFileFormatException::wrongRecipe);
+    WriteData(batch->fData[i].data(), batch->fEntries[i].length);
+  }
+  batch->fEntries.clear();
+}
+
+// append chunk data to the output, chunks may span output chunks
+void CDechunkingThread::WriteData(const BYTE* data, unsigned length)
+{
+  while (length > 0) {
+    if (fDataChunkUsed == fDataChunk->GetMaxSize()) {
+      fDataChunk->SetSize(fDataChunkUsed);
+      fTargetQueueDecompressed->ReleaseChunk(fDataChunk);
+      fDataChunk = fSourceQueueDecompressed->GetChunk();
+      if (!fDataChunk)
+        THROW_INT_EXC(EInternalException::getChunkError);
+      fDataChunkUsed = 0;
+    }
+    unsigned count = fDataChunk->GetMaxSize() - fDataChunkUsed;
+    if (count > length)
+      count = length;
+    memcpy((BYTE*)fDataChunk->GetData() + fDataChunkUsed, data, count);
+    fDataChunkUsed += count;
+    data += count;
+    length -= count;
+  }
+}
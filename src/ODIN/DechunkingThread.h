@@ -0,0 +1,70 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef DechunkingThread_H
+#define DechunkingThread_H
+//---------------------------------------------------------------------------
+
+#include "OdinThread.h"
+#include "ChunkStore.h"
+//---------------------------------------------------------------------------
+
+class CImageBuffer;
+class CBufferChunk;
+class CChunkPrefetcher;
+struct TChunkBatch;
+
+//---------------------------------------------------------------------------
+// Thread taking the place of the decompression thread when reading a
+// deduplicated image: reads the recipe from the image file and replaces each
+// entry by the chunk data from the chunk store. Chunks are read ahead in
+// batches by several prefetch threads, so reading from the chunk store
+// overlaps with writing the data already available.
+class CDechunkingThread : public COdinThread
+{
+  public:
+    CDechunkingThread(const CChunkStore* chunkStore, unsigned prefetchThreadCount,
+      CImageBuffer *sourceQueueCompressed,
+      CImageBuffer *targetQueueCompressed,
+      CImageBuffer *sourceQueueDecompressed,
+      CImageBuffer *targetQueueDecompressed);
+
+  protected:
+    const CChunkStore* fChunkStore;
+    unsigned fPrefetchThreadCount;
+    CImageBuffer *fSourceQueueCompressed, *fTargetQueueCompressed;
+    CImageBuffer *fSourceQueueDecompressed, *fTargetQueueDecompressed;
+
+    virtual DWORD Execute();
+
+  private:
+    void DechunkLoop();
+    void WriteBatch(CChunkPrefetcher& prefetcher, TChunkBatch* batch);
+    void WriteData(const BYTE* data, unsigned length);
+
+    CBufferChunk *fDataChunk;   // output chunk currently filled with chunk data
+    unsigned fDataChunkUsed;
+};
+//---------------------------------------------------------------------------
+#endif
@@ -27,8 +27,12 @@
 #include "DecompressionThread.h"
 #include "../zlib-1.3.2/zlib.h"
 #include "../bzip2-1.0.5/bzlib.h"
+#ifndef ODIN_NO_LZ4
 #include "lz4frame.h"
+#endif
+#ifndef ODIN_NO_ZSTD
 #include "zstd.h"
+#endif
 #include "CompressionException.h"
 #include "InternalException.h"
 
@@ -122,8 +126,9 @@ void CDecompressionThread::DecompressLoopZlib()
   if (ret != Z_OK)
      THROWEX(EZLibCompressionException, ret);
 
-  while (ret != Z_STREAM_END) {
-    if (zsStream.avail_in == 0) {
+  // the data can consist of several streams, one for each checkpoint of the backup
+  while (ret != Z_STREAM_END || zsStream.avail_in > 0 || !bEOF) {
+    if (zsStream.avail_in == 0 && !bEOF) {
       if (readChunk)
         fTargetQueueCompressed->ReleaseChunk(readChunk);
       readChunk = fSourceQueueCompressed->GetChunk(); // may block
@@ -132,6 +137,13 @@ void CDecompressionThread::DecompressLoopZlib()
       bEOF = readChunk->IsEOF();
       zsStream.next_in = (BYTE*)readChunk->GetData();
       zsStream.avail_in = readChunk->GetSize();
+      continue;
+    }
+
+    if (ret == Z_STREAM_END) {
+      ret = inflateReset(&zsStream);
+      if (ret != Z_OK)
+        THROWEX(EZLibCompressionException, ret);
     }
 
     if (zsStream.avail_out == 0) {
@@ -190,8 +202,9 @@ void CDecompressionThread::DecompressLoopLibz2()
   if (ret != BZ_OK)
     THROWEX(EBZip2CompressionException, ret);
 
-  while (ret != BZ_STREAM_END ) {
-    if (bzStream.avail_in == 0) {
+  // the data can consist of several streams, one for each checkpoint of the backup
+  while (ret != BZ_STREAM_END || bzStream.avail_in > 0 || !bEOF) {
+    if (bzStream.avail_in == 0 && !bEOF) {
       if (readChunk)
         fTargetQueueCompressed->ReleaseChunk(readChunk);
       readChunk = fSourceQueueCompressed->GetChunk(); // may block
@@ -200,6 +213,23 @@ void CDecompressionThread::DecompressLoopLibz2()
       bEOF = readChunk->IsEOF();
       bzStream.next_in = (char*)readChunk->GetData();
       bzStream.avail_in = readChunk->GetSize();
+      continue;
+    }
+
+    if (ret == BZ_STREAM_END) {
+      char* nextIn = bzStream.next_in;
+      unsigned availIn = bzStream.avail_in;
+      char* nextOut = bzStream.next_out;
+      unsigned availOut = bzStream.avail_out;
+      BZ2_bzDecompressEnd(&bzStream);
+      memset(&bzStream, 0, sizeof(bzStream));
+      ret = BZ2_bzDecompressInit(&bzStream, 0, 0);
+      if (ret != BZ_OK)
+        THROWEX(EBZip2CompressionException, ret);
+      bzStream.next_in = nextIn;
+      bzStream.avail_in = availIn;
+      bzStream.next_out = nextOut;
+      bzStream.avail_out = availOut;
     }
 
     if (bzStream.avail_out == 0) {
@@ -217,6 +247,8 @@ void CDecompressionThread::DecompressLoopLibz2()
    ret = BZ2_bzDecompress(&bzStream); 
    if (ret < 0)
      THROWEX(EBZip2CompressionException, ret);
+   if (ret == BZ_OK && bzStream.avail_in == 0 && bEOF && bzStream.avail_out > 0)
+     THROWEX(EBZip2CompressionException, BZ_UNEXPECTED_EOF); // stream is truncated
 
     if (fCancel) {
       BZ2_bzDecompressEnd(&bzStream);
@@ -251,6 +283,9 @@ void CDecompressionThread::DecompressLoopLibz2()
 //
 void CDecompressionThread::DecompressLoopLZ4()
 {
+#ifdef ODIN_NO_LZ4
+  THROW_INT_EXC(EInternalException::codecNotAvailable);
+#else
   LZ4F_dctx* ctx = NULL;
   CBufferChunk *readChunk      = NULL;
   CBufferChunk *decompressChunk = NULL;
@@ -270,11 +305,13 @@ void CDecompressionThread::DecompressLoopLZ4()
   size_t      srcRemaining = 0;
   size_t      dstUsed     = 0;
   size_t      ret         = 1; // non-zero: frame not yet complete
+  bool        bEOF        = false;
 
-  // LZ4F_decompress returns 0 when the entire frame has been decoded.
-  while (ret != 0) {
+  // LZ4F_decompress returns 0 when the entire frame has been decoded, the data
+  // can consist of several frames, one for each checkpoint of the backup.
+  while (ret != 0 || srcRemaining > 0 || !bEOF) {
     // Refill compressed input when the current chunk is exhausted.
-    if (srcRemaining == 0) {
+    if (srcRemaining == 0 && !bEOF) {
       if (readChunk)
         fTargetQueueCompressed->ReleaseChunk(readChunk);
       readChunk = fSourceQueueCompressed->GetChunk(); // may block
@@ -282,8 +319,10 @@ void CDecompressionThread::DecompressLoopLZ4()
         LZ4F_freeDecompressionContext(ctx);
         THROW_INT_EXC(EInternalException::getChunkError);
       }
+      bEOF        = readChunk->IsEOF();
       srcPtr      = (const BYTE*)readChunk->GetData();
       srcRemaining = readChunk->GetSize();
+      continue;
     }
 
     // Get a fresh output chunk if the current one is full.
@@ -313,6 +352,11 @@ void CDecompressionThread::DecompressLoopLZ4()
     srcPtr       += srcConsumed;
     srcRemaining -= srcConsumed;
     dstUsed      += dstWritten;
+    // the frame is truncated if there is no more input and nothing was decoded
+    if (ret != 0 && bEOF && srcRemaining == 0 && srcConsumed == 0 && dstWritten == 0) {
+      LZ4F_freeDecompressionContext(ctx);
+      THROW_INT_EXC(EInternalException::lz4CompressError);
+    }
 
     if (fCancel) {
       LZ4F_freeDecompressionContext(ctx);
@@ -331,6 +375,7 @@ void CDecompressionThread::DecompressLoopLZ4()
     decompressChunk->SetEOF(true);
     fTargetQueueDecompressed->ReleaseChunk(decompressChunk);
   }
+#endif
 }
 
 //---------------------------------------------------------------------------
@@ -338,6 +383,9 @@ void CDecompressionThread::DecompressLoopLZ4()
 //
 void CDecompressionThread::DecompressLoopZSTD()
 {
+#ifdef ODIN_NO_ZSTD
+  THROW_INT_EXC(EInternalException::codecNotAvailable);
+#else
   ZSTD_DStream* stream = ZSTD_createDStream();
   if (!stream)
     THROW_INT_EXC(EInternalException::zstdCompressError);
@@ -350,8 +398,8 @@ void CDecompressionThread::DecompressLoopZSTD()
 
   CBufferChunk *readChunk      = NULL;
   CBufferChunk *decompressChunk = NULL;
-  bool bEOF          = false;
-  bool frameComplete = false;
+  bool bEOF  = false;
+  size_t ret = 0;
 
   decompressChunk = fSourceQueueDecompressed->GetChunk();
   if (!decompressChunk) {
@@ -363,8 +411,9 @@ void CDecompressionThread::DecompressLoopZSTD()
   outBuf.size = decompressChunk->GetMaxSize();
   outBuf.pos  = 0;
 
-  // Outer loop: consume one compressed chunk per iteration.
-  while (!frameComplete) {
+  // Outer loop: consume one compressed chunk per iteration. The data can consist
+  // of several frames, one for each checkpoint of the backup.
+  while (!bEOF) {
     if (readChunk)
       fTargetQueueCompressed->ReleaseChunk(readChunk);
     readChunk = fSourceQueueCompressed->GetChunk(); // may block
@@ -379,18 +428,9 @@ void CDecompressionThread::DecompressLoopZSTD()
     inBuf.size = readChunk->GetSize();
     inBuf.pos  = 0;
 
-    // Inner loop: decompress all of inBuf or until frame ends.
-    while (inBuf.pos < inBuf.size) {
-      size_t ret = ZSTD_decompressStream(stream, &outBuf, &inBuf);
-      if (ZSTD_isError(ret)) {
-        ZSTD_freeDStream(stream);
-        THROW_INT_EXC(EInternalException::zstdCompressError);
-      }
-      if (ret == 0) {
-        // Frame is fully decoded.
-        frameComplete = true;
-        break;
-      }
+    // Inner loop: decompress all of inBuf and flush the data the stream holds
+    // back while the output buffer is full.
+    while (inBuf.pos < inBuf.size || outBuf.pos == outBuf.size) {
       // If the output buffer is full, flush it and get a new chunk.
       if (outBuf.pos == outBuf.size) {
         decompressChunk->SetSize(decompressChunk->GetMaxSize());
@@ -405,6 +445,12 @@ void CDecompressionThread::DecompressLoopZSTD()
         outBuf.pos  = 0;
       }
 
+      ret = ZSTD_decompressStream(stream, &outBuf, &inBuf);
+      if (ZSTD_isError(ret)) {
+        ZSTD_freeDStream(stream);
+        THROW_INT_EXC(EInternalException::zstdCompressError);
+      }
+
       if (fCancel) {
         ZSTD_freeDStream(stream);
         if (decompressChunk) fTargetQueueDecompressed->ReleaseChunk(decompressChunk);
@@ -412,11 +458,12 @@ void CDecompressionThread::DecompressLoopZSTD()
         Terminate(-1);
       }
     }
+  }
 
-    // If we processed the EOF-marked chunk and the frame is still not
-    // signalled complete, stop anyway to avoid blocking on an empty queue.
-    if (bEOF && !frameComplete)
-      break;
+  // the last frame must be complete
+  if (ret != 0) {
+    ZSTD_freeDStream(stream);
+    THROW_INT_EXC(EInternalException::zstdCompressError);
   }
 
   ZSTD_freeDStream(stream);
@@ -428,6 +475,7 @@ void CDecompressionThread::DecompressLoopZSTD()
     decompressChunk->SetEOF(true);
     fTargetQueueDecompressed->ReleaseChunk(decompressChunk);
   }
+#endif
 }
 
 
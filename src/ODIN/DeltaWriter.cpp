@@ -0,0 +1,254 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+ 
+#include "stdafx.h"
+#include <string>
+#include "DeltaWriter.h"
+#include "BlockCompare.h"
+#include "IImageStream.h"
+#include "OdinThread.h"
+#include "Exception.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// Thread reading the range of the target that will be written next
+class CTargetPrefetchThread : public COdinThread
+{
+public:
+  CTargetPrefetchThread(CDeltaWriter* writer)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fWriter = writer;
+    fRequest = CreateEvent(NULL, FALSE, FALSE, NULL);
+    fDone = CreateEvent(NULL, TRUE, TRUE, NULL);
+    fQuit = fPending = false;
+    fPos = 0;
+    fLength = fBytesRead = 0;
+  }
+
+  ~CTargetPrefetchThread()
+  {
+    CloseHandle(fRequest);
+    CloseHandle(fDone);
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("TargetPrefetchThread");
+    while (true) {
+      WaitForSingleObject(fRequest, INFINITE);
+      if (fQuit)
+        break;
+      try {
+        fWriter->ReadTarget(fPos, &fData[0], fLength, &fBytesRead);
+      } catch (Exception &e) {
+        fErrorFlag = true;
+        fErrorMessage = e.GetMessage();
+      } catch (...) {
+        fErrorFlag = true;
+        fErrorMessage = L"Target prefetch thread encountered unknown exception";
+      }
+      SetEvent(fDone);
+    }
+    fFinished = true;
+    return 0;
+  }
+
+  // start reading length bytes at pos
+  void Post(unsigned __int64 pos, unsigned length)
+  {
+    fPos = pos;
+    fLength = length;
+    fBytesRead = 0;
+    fData.resize(length);
+    fErrorFlag = false;
+    fPending = true;
+    ResetEvent(fDone);
+    SetEvent(fRequest);
+  }
+
+  // wait until a posted read is complete
+  void Wait()
+  {
+    if (!fPending)
+      return;
+    DWORD res = WaitForSingleObject(fDone, INFINITE);
+    if (res != WAIT_OBJECT_0)
+      THROW_INT_EXC(EInternalException::threadSyncError);
+    fPending = false;
+  }
+
+  // wait for a posted read and let the thread terminate
+  void Quit()
+  {
+    Wait();
+    fQuit = true;
+    SetEvent(fRequest);
+    WaitForThread();
+  }
+
+  bool IsPending() const {
+    return fPending;
+  }
+
+  // true if the last read was successful and covers length bytes at pos
+  bool Covers(unsigned __int64 pos, unsigned length) const {
+    return !fErrorFlag && fPos == pos && fLength >= length;
+  }
+
+  unsigned GetBytesRead() const {
+    return fBytesRead;
+  }
+
+  // exchange the read data with buffer
+  void SwapData(vector<BYTE>& buffer) {
+    fData.swap(buffer);
+  }
+
+private:
+  CDeltaWriter* fWriter;
+  HANDLE fRequest;              // signaled when a read is posted
+  HANDLE fDone;                 // signaled when a posted read is complete
+  volatile bool fQuit;
+  bool fPending;
+  unsigned __int64 fPos;
+  unsigned fLength;
+  unsigned fBytesRead;
+  vector<BYTE> fData;
+};
+
+//---------------------------------------------------------------------------
+CDeltaWriter::CDeltaWriter(IImageStream* target, unsigned compareSize)
+{
+  if (compareSize == 0)
+    THROW_INT_EXC(EInternalException::inputError);
+  fTarget = target;
+  fCompareSize = compareSize;
+  fPosition = fTarget->GetPosition();
+  fSkippedBytes = fWrittenBytes = 0;
+  fPrefetchThread = make_unique<CTargetPrefetchThread>(this);
+  fPrefetchThread->Resume();
+}
+
+CDeltaWriter::~CDeltaWriter()
+{
+  fPrefetchThread->Quit();
+}
+
+void CDeltaWriter::Seek(unsigned __int64 pos)
+{
+  fPosition = pos;
+}
+
+void CDeltaWriter::Write(const BYTE* data, unsigned length, unsigned* bytesWritten)
+{
+  unsigned bytesRead = 0;
+  bool prefetched = false;
+
+  *bytesWritten = 0;
+  if (length == 0)
+    return;
+
+  // get content of target, from the prefetch thread if it has read the range
+  if (fPrefetchThread->IsPending()) {
+    fPrefetchThread->Wait();
+    if (fPrefetchThread->Covers(fPosition, length)) {
+      fPrefetchThread->SwapData(fCompareData);
+      bytesRead = min(fPrefetchThread->GetBytesRead(), length);
+      prefetched = true;
+    }
+  }
+  if (!prefetched) {
+    fCompareData.resize(length);
+    ReadTarget(fPosition, &fCompareData[0], length, &bytesRead);
+  }
+
+  // read the range behind while this one is compared and written
+  unsigned __int64 next = fPosition + length;
+  unsigned __int64 size = fTarget->GetSize();
+  if (next < size)
+    fPrefetchThread->Post(next, (unsigned) min((unsigned __int64) length, size - next));
+
+  // write differing units, adjacent ones in one write
+  unsigned offset = 0, diffStart = 0;
+  bool inDiff = false;
+  while (offset < length) {
+    unsigned count = min(fCompareSize, length - offset);
+    bool same = offset + count <= bytesRead && CBlockCompare::IsSame(data + offset, &fCompareData[offset], count);
+    if (same) {
+      if (inDiff) {
+        WriteTarget(fPosition + diffStart, data + diffStart, offset - diffStart);
+        inDiff = false;
+      }
+      fSkippedBytes += count;
+    } else if (!inDiff) {
+      diffStart = offset;
+      inDiff = true;
+    }
+    offset += count;
+  }
+  if (inDiff)
+    WriteTarget(fPosition + diffStart, data + diffStart, length - diffStart);
+
+  fPosition += length;
+  *bytesWritten = length;
+}
+
+void CDeltaWriter::ReadTarget(unsigned __int64 pos, BYTE* buffer, unsigned length, unsigned* bytesRead)
+{
+  fTargetLock.Enter();
+  try {
+    fTarget->Seek(pos, FILE_BEGIN);
+    fTarget->Read(buffer, length, bytesRead);
+  } catch (...) {
+    fTargetLock.Leave();
+    throw;
+  }
+  fTargetLock.Leave();
+}
+
+void CDeltaWriter::WriteTarget(unsigned __int64 pos, const BYTE* data, unsigned length)
+{
+  unsigned bytesWritten;
+
+  fTargetLock.Enter();
+  try {
+    fTarget->Seek(pos, FILE_BEGIN);
+    fTarget->Write((void*) data, length, &bytesWritten);
+  } catch (...) {
+    fTargetLock.Leave();
+    throw;
+  }
+  fTargetLock.Leave();
+  if (bytesWritten != length)
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  fWrittenBytes += length;
+}
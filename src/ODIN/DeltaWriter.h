@@ -0,0 +1,89 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+ 
+#pragma once
+#ifndef __DELTAWRITER_H__
+#define __DELTAWRITER_H__
+
+#include <vector>
+#include <memory>
+#include "sync.h"
+
+class IImageStream;
+class CTargetPrefetchThread;
+
+//---------------------------------------------------------------------------
+// class CDeltaWriter
+// Writes restored data to a target only where the target differs. Before data
+// is written the same range is read from the target and compared in units of
+// compareSize bytes, only units that differ are written. For targets that
+// already hold a similar image (e.g. an older version) this replaces most
+// writes by reads which is faster and saves flash write cycles.
+// The target is read ahead by a separate thread: when data is written at
+// position pos with length len the range behind it is read while the data is
+// compared and written and while the next data is decompressed. As long as
+// data is written sequentially the compare then does not wait for the device.
+
+class CDeltaWriter {
+public:
+  CDeltaWriter(IImageStream* target, unsigned compareSize);
+  ~CDeltaWriter();
+
+  // write length bytes at the current position, advances the position by length
+  void Write(const BYTE* data, unsigned length, unsigned* bytesWritten);
+
+  // set current position from the beginning of the target
+  void Seek(unsigned __int64 pos);
+
+  unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+
+  // bytes that were identical on the target and not written
+  unsigned __int64 GetSkippedBytes() const {
+    return fSkippedBytes;
+  }
+
+  // bytes that differed on the target and were written
+  unsigned __int64 GetWrittenBytes() const {
+    return fWrittenBytes;
+  }
+
+  // used by prefetch thread
+  void ReadTarget(unsigned __int64 pos, BYTE* buffer, unsigned length, unsigned* bytesRead);
+
+private:
+  void WriteTarget(unsigned __int64 pos, const BYTE* data, unsigned length);
+
+  IImageStream* fTarget;
+  unsigned fCompareSize;
+  unsigned __int64 fPosition;
+  unsigned __int64 fSkippedBytes;
+  unsigned __int64 fWrittenBytes;
+  std::vector<BYTE> fCompareData;    // content of target for current write
+  CCriticalSection fTargetLock;      // serializes target access of writer and prefetch thread
+  std::unique_ptr<CTargetPrefetchThread> fPrefetchThread;
+};
+
+#endif
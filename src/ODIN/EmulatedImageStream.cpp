@@ -0,0 +1,166 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <math.h>
+#include "EmulatedImageStream.h"
+#include "OSException.h"
+
+// time an I/O may start in the past to make up for the caller sleeping too long
+static const double sCatchUpTime = 0.05;
+
+CEmulatedImageStream::CEmulatedImageStream(IImageStream* stream, const TDeviceModel& model)
+{
+  fStream = stream;
+  fModel = model;
+  fRandomState = model.seed * 2654435761ULL + 1;
+  fBusyUntil = 0.0;
+  fBusyTime = 0.0;
+  fIoCount = fStallCount = fMisalignedCount = 0;
+}
+
+TDeviceModel CEmulatedImageStream::GetUnlimitedModel()
+{
+  TDeviceModel model;
+  memset(&model, 0, sizeof(model));
+  model.readLatency.distribution = model.writeLatency.distribution = latencyFixed;
+  model.errorOffset = (unsigned __int64) -1;
+  model.seed = 1;
+  return model;
+}
+
+bool CEmulatedImageStream::GetModel(LPCWSTR name, TDeviceModel& model)
+{
+  model = GetUnlimitedModel();
+  if (wcscmp(name, L"unlimited") == 0)
+    return true;
+  if (wcscmp(name, L"cf") == 0) {
+    model.readBandwidth = 30.0 * 1024 * 1024;
+    model.writeBandwidth = 20.0 * 1024 * 1024;
+    model.readLatency.mean = 0.0005;
+    model.writeLatency.distribution = latencyExponential;
+    model.writeLatency.mean = 0.001;
+    model.stallInterval = 4 * 1024 * 1024;
+    model.stallTime = 0.05;
+    model.alignment = 4096;
+    model.alignmentPenalty = 0.002;
+    return true;
+  }
+  if (wcscmp(name, L"usbhub") == 0) {
+    model.readBandwidth = 35.0 * 1024 * 1024;
+    model.writeBandwidth = 30.0 * 1024 * 1024;
+    model.readLatency.distribution = model.writeLatency.distribution = latencyUniform;
+    model.readLatency.mean = model.writeLatency.mean = 0.0005;
+    model.readLatency.spread = model.writeLatency.spread = 0.00025;
+    model.alignment = 512;
+    model.alignmentPenalty = 0.0001;
+    return true;
+  }
+  if (wcscmp(name, L"nvme") == 0) {
+    model.readBandwidth = 3000.0 * 1024 * 1024;
+    model.writeBandwidth = 2000.0 * 1024 * 1024;
+    model.readLatency.distribution = model.writeLatency.distribution = latencyExponential;
+    model.readLatency.mean = 0.00002;
+    model.writeLatency.mean = 0.00003;
+    model.alignment = 4096;
+    model.alignmentPenalty = 0.00001;
+    return true;
+  }
+  return false;
+}
+
+void CEmulatedImageStream::Read(void * buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  Transfer(fStream->GetPosition(), nLength, false);
+  fStream->Read(buffer, nLength, nBytesRead);
+}
+
+void CEmulatedImageStream::Write(void *buffer, unsigned nLength, unsigned *nBytesWritten)
+{
+  Transfer(fStream->GetPosition(), nLength, true);
+  fStream->Write(buffer, nLength, nBytesWritten);
+}
+
+void CEmulatedImageStream::Transfer(unsigned __int64 pos, unsigned length, bool write)
+{
+  double bandwidth = write ? fModel.writeBandwidth : fModel.readBandwidth;
+  double duration = SampleLatency(write ? fModel.writeLatency : fModel.readLatency);
+  if (bandwidth > 0.0)
+    duration += length / bandwidth;
+  if (fModel.alignment > 0 && (pos % fModel.alignment != 0 || length % fModel.alignment != 0)) {
+    duration += fModel.alignmentPenalty;
+    ++fMisalignedCount;
+  }
+  if (write && fModel.stallInterval > 0) {
+    unsigned stalls = (unsigned) ((pos + length) / fModel.stallInterval - pos / fModel.stallInterval);
+    duration += stalls * fModel.stallTime;
+    fStallCount += stalls;
+  }
+  bool failed = (fModel.errorOffset >= pos && fModel.errorOffset < pos + length) ||
+    (fModel.errorRate > 0.0 && NextRandom() < fModel.errorRate);
+
+  double now = Now();
+  double start = fBusyUntil >= now - sCatchUpTime ? fBusyUntil : now;
+  fBusyUntil = start + duration;
+  fBusyTime += duration;
+  ++fIoCount;
+  for (double remaining = fBusyUntil - now; remaining > 0.0; remaining = fBusyUntil - Now())
+    Sleep(remaining > 0.003 ? (DWORD) ((remaining - 0.002) * 1000) : 0);
+
+  if (failed) {
+    if (write)
+      THROW_OS_EXC_INFO(ERROR_WRITE_FAULT, EWinException::writeVolumeError);
+    else
+      THROW_OS_EXC_INFO(ERROR_CRC, EWinException::readVolumeError);
+  }
+}
+
+double CEmulatedImageStream::SampleLatency(const TLatency& latency)
+{
+  switch (latency.distribution) {
+    case latencyUniform:
+      return max(0.0, latency.mean + (2.0 * NextRandom() - 1.0) * latency.spread);
+    case latencyExponential:
+      return -latency.mean * log(1.0 - NextRandom());
+    default:
+      return latency.mean;
+  }
+}
+
+// uniform random number in [0, 1)
+double CEmulatedImageStream::NextRandom()
+{
+  fRandomState ^= fRandomState << 13;
+  fRandomState ^= fRandomState >> 7;
+  fRandomState ^= fRandomState << 17;
+  return (fRandomState >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double CEmulatedImageStream::Now()
+{
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / frequency.QuadPart;
+}
@@ -0,0 +1,126 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __EMULATEDIMAGESTREAM_H__
+#define __EMULATEDIMAGESTREAM_H__
+
+#include "IImageStream.h"
+
+// distribution of the latency of a single read or write
+typedef enum { latencyFixed, latencyUniform, latencyExponential } TLatencyDistribution;
+
+typedef struct {
+  TLatencyDistribution distribution;
+  double mean;                      // seconds
+  double spread;                    // latencyUniform: latency is mean +- spread
+} TLatency;
+
+// timing and failure behaviour of an emulated device
+typedef struct {
+  double readBandwidth;             // bytes per second, 0 for unlimited
+  double writeBandwidth;
+  TLatency readLatency;             // per I/O, in addition to the transfer time
+  TLatency writeLatency;
+  unsigned __int64 stallInterval;   // a write crossing a multiple of this offset stalls (erase block), 0 for none
+  double stallTime;                 // seconds of each stall
+  unsigned alignment;               // I/O with offset or length not a multiple of this is penalized, 0 for none
+  double alignmentPenalty;          // seconds added to a misaligned I/O
+  double errorRate;                 // probability that an I/O fails
+  unsigned __int64 errorOffset;     // an I/O covering this offset fails, (unsigned __int64) -1 for none
+  unsigned seed;                    // of the random numbers for latencies and errors
+} TDeviceModel;
+
+//---------------------------------------------------------------------------
+// class CEmulatedImageStream
+// Passes all calls to another image stream but lets each read and write take
+// the time a device of the given model would need: latency, transfer time at the
+// bandwidth, stalls at erase block boundaries and a penalty for misaligned I/O.
+// The device is busy until the I/O is complete and the caller waits on the wall
+// clock until then. Time lost because the caller slept too long is made up by
+// the next I/O, so the bandwidth holds on average. Injected errors throw the
+// EWinException a failing drive would throw, without passing the I/O on.
+
+class CEmulatedImageStream : public IImageStream
+{
+public:
+  // stream is not owned
+  CEmulatedImageStream(IImageStream* stream, const TDeviceModel& model);
+
+  // a model without any limits and the models "cf" (slow compact flash card with
+  // 50 ms stalls every 4 MB), "usbhub" (shared USB 2.0 hub) and "nvme", returns
+  // false if name is unknown
+  static bool GetModel(LPCWSTR name, TDeviceModel& model);
+  static TDeviceModel GetUnlimitedModel();
+
+  virtual LPCWSTR GetName() const { return fStream->GetName(); }
+  virtual void Open(LPCWSTR name, TOpenMode mode) { fStream->Open(name, mode); }
+  virtual void Close() { fStream->Close(); }
+  virtual unsigned __int64 GetPosition() const { return fStream->GetPosition(); }
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
+  virtual void Seek(__int64 offset, DWORD moveMethod) { fStream->Seek(offset, moveMethod); }
+  virtual unsigned __int64 GetSize() const { return fStream->GetSize(); }
+  virtual unsigned __int64 GetAllocatedBytes() const { return fStream->GetAllocatedBytes(); }
+  virtual bool IsDrive() const { return fStream->IsDrive(); }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const { return fStream->GetRunLengthStreamReader(); }
+  virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes) {
+    fStream->SetCompletedInformation(crc32, processedBytes);
+  }
+
+  // seconds the device was busy with reads and writes
+  double GetBusyTime() const {
+    return fBusyTime;
+  }
+
+  unsigned GetIoCount() const {
+    return fIoCount;
+  }
+
+  unsigned GetStallCount() const {
+    return fStallCount;
+  }
+
+  unsigned GetMisalignedCount() const {
+    return fMisalignedCount;
+  }
+
+private:
+  // checks for an injected error and waits until the device completed the I/O
+  void Transfer(unsigned __int64 pos, unsigned length, bool write);
+  double SampleLatency(const TLatency& latency);
+  double NextRandom();
+  static double Now();
+
+  IImageStream* fStream;
+  TDeviceModel fModel;
+  unsigned __int64 fRandomState;
+  double fBusyUntil;                // wall clock time the device completes the last I/O
+  double fBusyTime;
+  unsigned fIoCount;
+  unsigned fStallCount;
+  unsigned fMisalignedCount;
+};
+
+#endif
@@ -0,0 +1,458 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <string>
+#include <iostream>
+#include "EngineServer.h"
+#include "EventStream.h"
+#include "OdinManager.h"
+#include "CommandLineProcessor.h"
+#include "OdinThread.h"
+#include "Exception.h"
+#include "OSException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+static const DWORD kPipeBufferSize = 65536;
+static const size_t kMaxRequestLength = 32768;
+
+// section name in .ini file for configuration values
+IMPL_SECTION(CEngineServer, L"Engine")
+
+//---------------------------------------------------------------------------
+// Thread running the jobs of the engine one after the other. The command line
+// processor and its COdinManager are kept from job to job
+class CEngineWorker : public COdinThread
+{
+public:
+  CEngineWorker(CEngineServer* server)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fServer = server;
+    fRunningJobId = 0;
+    fRefreshGeneration = 0;
+    // create the manager and read the drives here, not in parallel in all workers
+    fProcessor.Init();
+    fDriveMask = GetLogicalDrives();
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("EngineWorker");
+    shared_ptr<CEngineServer::TJob> job;
+    while ((job = fServer->NextJob(this)) != NULL) {
+      // drives were inserted or removed
+      DWORD driveMask = GetLogicalDrives();
+      bool refreshDrives = fServer->DrivesChanged(fRefreshGeneration) || driveMask != fDriveMask;
+      fDriveMask = driveMask;
+      job->events->OnStarted();
+      fProcessor.RunJob(job->commandLine.c_str(), job->events.get(), refreshDrives);
+    }
+    fFinished = true;
+    return 0;
+  }
+
+  // the following are called by the server with its lock held
+  unsigned GetRunningJobId() const {
+    return fRunningJobId;
+  }
+
+  void SetRunningJobId(unsigned id) {
+    fRunningJobId = id;
+    // a cancel of the previous job must not hit this one
+    fProcessor.ClearCancel();
+  }
+
+  void CancelJob() {
+    fProcessor.CancelJob();
+  }
+
+  void SetIoLimits(LPCWSTR options) {
+    fProcessor.SetIoLimits(options);
+  }
+
+private:
+  CEngineServer* fServer;
+  CCommandLineProcessor fProcessor;
+  unsigned fRunningJobId;        // 0 if worker waits for a job
+  unsigned fRefreshGeneration;   // refresh requests seen
+  DWORD fDriveMask;              // drive letters at last job
+};
+
+//---------------------------------------------------------------------------
+// Thread reading the requests of a client connected to the pipe
+class CEngineSession : public COdinThread
+{
+public:
+  CEngineSession(CEngineServer* server, HANDLE pipe)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fServer = server;
+    fPipe = pipe;
+    // the stream closes the pipe when neither the session nor a job needs it
+    fStream = make_shared<CEventStream>(pipe, true);
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("EngineSession");
+    try {
+      ReadRequests();
+    } catch (Exception& e) {
+      wcout << L"Engine: " << e.GetMessage() << endl;
+    } catch (...) {
+    }
+    fFinished = true;
+    return 0;
+  }
+
+private:
+  void ReadRequests();
+
+  CEngineServer* fServer;
+  HANDLE fPipe;
+  shared_ptr<CEventStream> fStream;
+};
+
+void CEngineSession::ReadRequests()
+{
+  HANDLE readEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  HANDLE handles[2] = { fServer->GetStopEvent(), readEvent };
+  string pending;
+  char buffer[4096];
+
+  while (true) {
+    OVERLAPPED overlapped;
+    DWORD bytesRead = 0;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = readEvent;
+    ResetEvent(readEvent);
+    BOOL ok = ReadFile(fPipe, buffer, sizeof(buffer), &bytesRead, &overlapped);
+    if (!ok && GetLastError() == ERROR_IO_PENDING) {
+      DWORD res = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+      if (res != WAIT_OBJECT_0 + 1) {
+        // engine stops
+        CancelIo(fPipe);
+        GetOverlappedResult(fPipe, &overlapped, &bytesRead, TRUE);
+        break;
+      }
+      ok = GetOverlappedResult(fPipe, &overlapped, &bytesRead, FALSE);
+    }
+    if (!ok || bytesRead == 0)
+      break; // client disconnected
+
+    pending.append(buffer, bytesRead);
+    size_t pos;
+    while ((pos = pending.find('\n')) != string::npos) {
+      string line = pending.substr(0, pos);
+      pending.erase(0, pos + 1);
+      if (!line.empty() && line[line.length()-1] == '\r')
+        line.erase(line.length()-1);
+      if (line.empty())
+        continue;
+      int len = MultiByteToWideChar(CP_UTF8, 0, line.c_str(), (int) line.length(), NULL, 0);
+      wstring request(len, L' ');
+      if (len > 0)
+        MultiByteToWideChar(CP_UTF8, 0, line.c_str(), (int) line.length(), &request[0], len);
+      fServer->HandleRequest(request, fStream);
+    }
+    if (pending.length() > kMaxRequestLength)
+      break; // not a client of the engine
+  }
+  CloseHandle(readEvent);
+}
+
+//---------------------------------------------------------------------------
+CEngineServer::CEngineServer(LPCWSTR pipeName)
+  : fPipeName(L"PipeName", L"ODINEngine"),
+    fWorkerCount(L"Workers", 4)
+{
+  fName = L"\\\\.\\pipe\\";
+  fName += (pipeName && *pipeName) ? pipeName : fPipeName().c_str();
+  fNextJobId = 0;
+  fRefreshGeneration = 0;
+  fJobSemaphore = CreateSemaphore(NULL, 0, LONG_MAX, NULL);
+  fStopEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  int workerCount = fWorkerCount > 0 ? fWorkerCount : 1;
+  for (int i=0; i<workerCount; i++)
+    fWorkers.push_back(make_unique<CEngineWorker>(this));
+}
+
+CEngineServer::~CEngineServer()
+{
+  Stop();
+  for (size_t i=0; i<fWorkers.size(); i++)
+    fWorkers[i]->Resume();
+  for (size_t i=0; i<fWorkers.size(); i++)
+    fWorkers[i]->WaitForThread();
+  for (size_t i=0; i<fSessions.size(); i++)
+    fSessions[i]->WaitForThread();
+  fWorkers.clear();
+  fSessions.clear();
+  CloseHandle(fJobSemaphore);
+  CloseHandle(fStopEvent);
+}
+
+void CEngineServer::Run()
+{
+  HANDLE connectEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+  HANDLE handles[2] = { fStopEvent, connectEvent };
+
+  for (size_t i=0; i<fWorkers.size(); i++)
+    fWorkers[i]->Resume();
+  wcout << L"Engine with " << fWorkers.size() << L" workers is waiting for jobs on " << fName << endl;
+
+  try {
+    while (true) {
+      // one instance of the pipe for each client
+      HANDLE pipe = CreateNamedPipe(fName.c_str(), PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED,
+        PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        PIPE_UNLIMITED_INSTANCES, kPipeBufferSize, kPipeBufferSize, 0, NULL);
+      CHECK_OS_EX_HANDLE_PARAM1(pipe, EWinException::fileOpenError, fName.c_str());
+
+      OVERLAPPED overlapped;
+      DWORD bytes;
+      ZeroMemory(&overlapped, sizeof(overlapped));
+      overlapped.hEvent = connectEvent;
+      ResetEvent(connectEvent);
+      DWORD err = ConnectNamedPipe(pipe, &overlapped) ? ERROR_PIPE_CONNECTED : GetLastError();
+      if (err == ERROR_IO_PENDING) {
+        DWORD res = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+        if (res != WAIT_OBJECT_0 + 1) {
+          CancelIo(pipe);
+          GetOverlappedResult(pipe, &overlapped, &bytes, TRUE);
+          CloseHandle(pipe);
+          break;
+        }
+        err = GetOverlappedResult(pipe, &overlapped, &bytes, FALSE) ? ERROR_PIPE_CONNECTED : GetLastError();
+      }
+      if (err != ERROR_PIPE_CONNECTED) {
+        // client has gone already
+        CloseHandle(pipe);
+        continue;
+      }
+      RemoveClosedSessions();
+      fSessions.push_back(make_unique<CEngineSession>(this, pipe));
+      fSessions.back()->Resume();
+    }
+  } catch (...) {
+    Stop();
+    CloseHandle(connectEvent);
+    throw;
+  }
+  CloseHandle(connectEvent);
+
+  // running jobs are finished
+  for (size_t i=0; i<fWorkers.size(); i++)
+    fWorkers[i]->WaitForThread();
+  for (size_t i=0; i<fSessions.size(); i++)
+    fSessions[i]->WaitForThread();
+  wcout << L"Engine stopped." << endl;
+}
+
+void CEngineServer::HandleRequest(const wstring& request, shared_ptr<CEventStream> stream)
+{
+  size_t pos = request.find(L' ');
+  wstring verb = request.substr(0, pos);
+  wstring arg;
+  if (pos != wstring::npos) {
+    pos = request.find_first_not_of(L' ', pos);
+    if (pos != wstring::npos)
+      arg = request.substr(pos);
+  }
+
+  if (verb.compare(L"job") == 0) {
+    if (arg.empty())
+      stream->Write(ErrorEvent(L"job without options"));
+    else
+      QueueJob(arg, stream);
+  } else if (verb.compare(L"cancel") == 0) {
+    unsigned id = (unsigned) wcstoul(arg.c_str(), NULL, 10);
+    CancelJob(id, stream);
+  } else if (verb.compare(L"limit") == 0) {
+    LimitJob(arg, stream);
+  } else if (verb.compare(L"refresh") == 0) {
+    fLock.Enter();
+    ++fRefreshGeneration;
+    fLock.Leave();
+  } else if (verb.compare(L"status") == 0) {
+    unsigned running = 0;
+    fLock.Enter();
+    size_t queued = fJobs.size();
+    for (size_t i=0; i<fWorkers.size(); i++)
+      if (fWorkers[i]->GetRunningJobId() != 0)
+        ++running;
+    fLock.Leave();
+    stream->Write(L"status queued=" + to_wstring(queued) + L" running=" + to_wstring(running)
+      + L" workers=" + to_wstring(fWorkers.size()));
+  } else if (verb.compare(L"shutdown") == 0) {
+    Stop();
+  } else {
+    stream->Write(ErrorEvent((L"unknown request " + verb).c_str()));
+  }
+}
+
+void CEngineServer::QueueJob(const wstring& commandLine, shared_ptr<CEventStream> stream)
+{
+  shared_ptr<TJob> job = make_shared<TJob>();
+  fLock.Enter();
+  job->id = ++fNextJobId;
+  fLock.Leave();
+  job->commandLine = commandLine;
+  job->stream = stream;
+  job->events = make_unique<CJobEvents>(stream.get(), job->id);
+  if (WaitForSingleObject(fStopEvent, 0) == WAIT_OBJECT_0) {
+    stream->Write(ErrorEvent(L"engine is stopping"));
+    return;
+  }
+  // before a worker can send the start of the job
+  job->events->OnQueued();
+  fLock.Enter();
+  fJobs.push_back(job);
+  fLock.Leave();
+  ReleaseSemaphore(fJobSemaphore, 1, NULL);
+}
+
+void CEngineServer::CancelJob(unsigned id, shared_ptr<CEventStream> stream)
+{
+  shared_ptr<TJob> job;
+  bool running = false;
+
+  fLock.Enter();
+  for (deque<shared_ptr<TJob>>::iterator it = fJobs.begin(); it != fJobs.end(); ++it) {
+    if ((*it)->id == id) {
+      job = *it;
+      fJobs.erase(it);
+      break;
+    }
+  }
+  for (size_t i=0; !job && i<fWorkers.size(); i++) {
+    if (id != 0 && fWorkers[i]->GetRunningJobId() == id) {
+      // the worker sends the end of the job
+      fWorkers[i]->CancelJob();
+      running = true;
+    }
+  }
+  fLock.Leave();
+
+  if (job)
+    job->events->OnFinished(-1, L"Job was cancelled");
+  else if (!running)
+    stream->Write(ErrorEvent((L"unknown job " + to_wstring(id)).c_str()));
+}
+
+// the limits take effect at once, the threads of the job share them
+void CEngineServer::LimitJob(const wstring& arg, shared_ptr<CEventStream> stream)
+{
+  wchar_t* end;
+  unsigned id = (unsigned) wcstoul(arg.c_str(), &end, 10);
+  bool running = false;
+  wstring error;
+
+  fLock.Enter();
+  for (size_t i=0; i<fWorkers.size(); i++) {
+    if (id != 0 && fWorkers[i]->GetRunningJobId() == id) {
+      running = true;
+      try {
+        fWorkers[i]->SetIoLimits(end);
+      } catch (Exception& e) {
+        error = e.GetMessage();
+      }
+    }
+  }
+  fLock.Leave();
+
+  if (!running)
+    stream->Write(ErrorEvent((L"job not running " + to_wstring(id)).c_str()));
+  else if (!error.empty())
+    stream->Write(ErrorEvent(error.c_str()));
+}
+
+shared_ptr<CEngineServer::TJob> CEngineServer::NextJob(CEngineWorker* worker)
+{
+  HANDLE handles[2] = { fStopEvent, fJobSemaphore };
+
+  fLock.Enter();
+  worker->SetRunningJobId(0);
+  fLock.Leave();
+  while (true) {
+    DWORD res = WaitForMultipleObjects(2, handles, FALSE, INFINITE);
+    if (res != WAIT_OBJECT_0 + 1)
+      return NULL;
+    fLock.Enter();
+    // the job may have been cancelled already
+    if (!fJobs.empty()) {
+      shared_ptr<TJob> job = fJobs.front();
+      fJobs.pop_front();
+      worker->SetRunningJobId(job->id);
+      fLock.Leave();
+      return job;
+    }
+    fLock.Leave();
+  }
+}
+
+bool CEngineServer::DrivesChanged(unsigned& generation)
+{
+  fLock.Enter();
+  bool changed = generation != fRefreshGeneration;
+  generation = fRefreshGeneration;
+  fLock.Leave();
+  return changed;
+}
+
+// stop accepting jobs, queued jobs are not started
+void CEngineServer::Stop()
+{
+  deque<shared_ptr<TJob>> jobs;
+  fLock.Enter();
+  SetEvent(fStopEvent);
+  jobs.swap(fJobs);
+  fLock.Leave();
+  for (size_t i=0; i<jobs.size(); i++)
+    jobs[i]->events->OnFinished(-1, L"Engine was stopped");
+}
+
+void CEngineServer::RemoveClosedSessions()
+{
+  for (size_t i=0; i<fSessions.size(); ) {
+    if (fSessions[i]->HasFinished()) {
+      fSessions[i]->WaitForThread();
+      fSessions.erase(fSessions.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+}
+
+wstring CEngineServer::ErrorEvent(LPCWSTR message)
+{
+  return L"error message=" + CEventStream::Quote(message);
+}
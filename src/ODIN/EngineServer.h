@@ -0,0 +1,116 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __ENGINESERVER_H__
+#define __ENGINESERVER_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include "Config.h"
+#include "sync.h"
+
+class CEventStream;
+class CJobEvents;
+class CEngineSession;
+class CEngineWorker;
+
+//---------------------------------------------------------------------------
+// class CEngineServer
+// Long running imaging engine (odinc -serve). Clients connect to the named pipe
+// \\.\pipe\<name> and send requests as lines of UTF-8 text:
+//   job <odinc options>    queue a backup, restore, verify, transcode or compare,
+//                          e.g. job -restore -source="c:\img\card.img" -target=F:,G:
+//   cancel <id>            cancel a queued or running job
+//   limit <id> <options>   change the I/O limits of a running job, options are
+//                          -readlimit, -readiops, -writelimit and -writeiops of odinc
+//   refresh                enumerate the drives again before the next jobs
+//   status                 answered with: status queued=<n> running=<n> workers=<n>
+//   shutdown               finish the running jobs and stop the engine
+// The events of a job (see CJobEvents) are sent to the connection that queued it,
+// an invalid request is answered with: error message=<text>
+// A fixed number of workers takes the jobs in the order they were queued. Each
+// worker keeps its COdinManager and the list of drives from job to job, the drives
+// are enumerated again only if the drive letters changed or after refresh.
+
+class CEngineServer {
+public:
+  // pipeName NULL or empty takes the name from the configuration
+  CEngineServer(LPCWSTR pipeName);
+  ~CEngineServer();
+
+  // accept clients until a shutdown request
+  void Run();
+
+  LPCWSTR GetPipeName() const {
+    return fName.c_str();
+  }
+
+  // used by sessions: process one request of a client
+  void HandleRequest(const std::wstring& request, std::shared_ptr<CEventStream> stream);
+
+  typedef struct {
+    unsigned id;
+    std::wstring commandLine;               // odinc options of job
+    std::shared_ptr<CEventStream> stream;   // connection of client that queued the job
+    std::unique_ptr<CJobEvents> events;
+  } TJob;
+
+  // used by workers: wait for the next job for worker, NULL if the engine stops
+  std::shared_ptr<TJob> NextJob(CEngineWorker* worker);
+
+  // used by workers: true if the drives must be enumerated again, generation is
+  // the refresh count the worker has seen
+  bool DrivesChanged(unsigned& generation);
+
+  HANDLE GetStopEvent() const {
+    return fStopEvent;
+  }
+
+private:
+  void QueueJob(const std::wstring& commandLine, std::shared_ptr<CEventStream> stream);
+  void CancelJob(unsigned id, std::shared_ptr<CEventStream> stream);
+  void LimitJob(const std::wstring& arg, std::shared_ptr<CEventStream> stream);
+  void Stop();
+  void RemoveClosedSessions();
+  static std::wstring ErrorEvent(LPCWSTR message);
+
+  std::wstring fName;                          // full name of the pipe
+  std::deque<std::shared_ptr<TJob>> fJobs;     // queued jobs, front is started next
+  std::vector<std::unique_ptr<CEngineWorker>> fWorkers;
+  std::vector<std::unique_ptr<CEngineSession>> fSessions;
+  unsigned fNextJobId;
+  unsigned fRefreshGeneration;                 // incremented by each refresh request
+  HANDLE fJobSemaphore;                        // count of queued jobs
+  HANDLE fStopEvent;                           // set on shutdown, manual reset
+  CCriticalSection fLock;                      // protects jobs and counters
+
+  DECLARE_SECTION()
+  DECLARE_ENTRY(std::wstring, fPipeName)  // name of the pipe the engine accepts clients on
+  DECLARE_ENTRY(int, fWorkerCount)        // jobs that run at the same time
+};
+
+#endif
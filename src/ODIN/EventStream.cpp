@@ -0,0 +1,185 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <string>
+#include <vector>
+#include "EventStream.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+CEventStream::CEventStream(HANDLE out, bool ownsHandle)
+{
+  fOut = out;
+  fOwnsHandle = ownsHandle;
+  fClosed = out == NULL || out == INVALID_HANDLE_VALUE;
+  fWriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+}
+
+CEventStream::~CEventStream()
+{
+  if (fOwnsHandle && fOut != NULL && fOut != INVALID_HANDLE_VALUE)
+    CloseHandle(fOut);
+  CloseHandle(fWriteEvent);
+}
+
+void CEventStream::Write(const wstring& line)
+{
+  wstring text = line + L"\n";
+  int len = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int) text.length(), NULL, 0, NULL, NULL);
+  vector<char> utf8(len > 0 ? len : 1);
+  len = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int) text.length(), &utf8[0], len, NULL, NULL);
+
+  fLock.Enter();
+  if (!fClosed && len > 0) {
+    OVERLAPPED overlapped;
+    DWORD bytesWritten = 0;
+    ZeroMemory(&overlapped, sizeof(overlapped));
+    overlapped.hEvent = fWriteEvent;
+    ResetEvent(fWriteEvent);
+    BOOL ok = WriteFile(fOut, &utf8[0], len, &bytesWritten, &overlapped);
+    if (!ok && GetLastError() == ERROR_IO_PENDING)
+      ok = GetOverlappedResult(fOut, &overlapped, &bytesWritten, TRUE);
+    if (!ok || bytesWritten != (DWORD) len)
+      fClosed = true;
+  }
+  fLock.Leave();
+}
+
+wstring CEventStream::Quote(LPCWSTR value)
+{
+  wstring s(value ? value : L"");
+  if (!s.empty() && s.find_first_of(L" \t\r\n\"=") == wstring::npos)
+    return s;
+  wstring quoted = L"\"";
+  for (size_t i=0; i<s.length(); i++) {
+    if (s[i] == L'\r' || s[i] == L'\n')
+      quoted += L' ';
+    else if (s[i] == L'"')
+      quoted += L"\"\"";
+    else
+      quoted += s[i];
+  }
+  return quoted + L"\"";
+}
+
+bool CEventStream::Parse(const wstring& line, wstring& event, map<wstring, wstring>& values)
+{
+  size_t len = line.length();
+  size_t pos = line.find(L' ');
+  event = line.substr(0, pos);
+  values.clear();
+  if (event.empty() || event.find(L'=') != wstring::npos)
+    return false;
+  while (pos < len) {
+    pos = line.find_first_not_of(L' ', pos);
+    if (pos == wstring::npos)
+      break;
+    size_t eq = line.find(L'=', pos);
+    if (eq == wstring::npos || line.find(L' ', pos) < eq)
+      return false;
+    wstring key = line.substr(pos, eq - pos);
+    wstring value;
+    pos = eq + 1;
+    if (pos < len && line[pos] == L'"') {
+      // quoted value, "" is a quote in it
+      for (++pos; pos < len; ++pos) {
+        if (line[pos] == L'"') {
+          if (pos + 1 < len && line[pos + 1] == L'"')
+            ++pos;
+          else
+            break;
+        }
+        value += line[pos];
+      }
+      if (pos >= len)
+        return false;
+      ++pos;
+    } else {
+      size_t end = line.find(L' ', pos);
+      value = line.substr(pos, end == wstring::npos ? wstring::npos : end - pos);
+      pos = end;
+    }
+    values[key] = value;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------
+CJobEvents::CJobEvents(CEventStream* stream, unsigned jobId)
+{
+  fStream = stream;
+  fJobId = jobId;
+  fLastBytes = 0;
+  fLastTicks = 0;
+}
+
+wstring CJobEvents::Event(LPCWSTR name)
+{
+  return wstring(name) + L" job=" + to_wstring(fJobId);
+}
+
+void CJobEvents::OnQueued()
+{
+  fStream->Write(Event(L"queued"));
+}
+
+void CJobEvents::OnStarted()
+{
+  fLastBytes = 0;
+  fLastTicks = GetTickCount64();
+  fStream->Write(Event(L"started"));
+}
+
+void CJobEvents::OnStage(LPCWSTR stage)
+{
+  fStream->Write(Event(L"stage") + L" name=" + CEventStream::Quote(stage));
+}
+
+void CJobEvents::OnProgress(unsigned __int64 bytesProcessed, unsigned __int64 bytesTotal)
+{
+  // throughput since the last event
+  ULONGLONG ticks = GetTickCount64();
+  unsigned __int64 rate = 0;
+  if (ticks > fLastTicks && bytesProcessed >= fLastBytes)
+    rate = (bytesProcessed - fLastBytes) * 1000 / (ticks - fLastTicks);
+  fLastBytes = bytesProcessed;
+  fLastTicks = ticks;
+  fStream->Write(Event(L"progress") + L" bytes=" + to_wstring(bytesProcessed) + L" total=" + to_wstring(bytesTotal)
+    + L" rate=" + to_wstring(rate));
+}
+
+void CJobEvents::OnFinished(int exitCode, LPCWSTR message)
+{
+  wstring line = Event(L"finished") + L" exit=" + to_wstring(exitCode);
+  if (message && *message)
+    line += L" error=" + CEventStream::Quote(message);
+  fStream->Write(line);
+}
@@ -0,0 +1,122 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __EVENTSTREAM_H__
+#define __EVENTSTREAM_H__
+
+#include <string>
+#include <map>
+#include "sync.h"
+
+//---------------------------------------------------------------------------
+// interface IOperationEvents
+// Notifications about a running backup, restore, verify, transcode or compare
+// for a process controlling ODIN (the engine or OdinM)
+
+class IOperationEvents {
+public:
+  virtual ~IOperationEvents() {}
+
+  // a step of the operation begins: backup, restore, verify, transcode, compare
+  // or partition when the next volume of a disk image is processed
+  virtual void OnStage(LPCWSTR stage) = 0;
+
+  // called about once a second while the operation runs
+  virtual void OnProgress(unsigned __int64 bytesProcessed, unsigned __int64 bytesTotal) = 0;
+
+  // the operation ended with the exit code odinc returns for it, message is the
+  // error message or empty
+  virtual void OnFinished(int exitCode, LPCWSTR message) = 0;
+};
+
+//---------------------------------------------------------------------------
+// class CEventStream
+// Writes events as lines of UTF-8 text to a pipe or file, one event per line:
+//   <event> job=<id> <key>=<value> ...
+// A value containing blanks or quotes is enclosed in quotes, quotes in it are
+// doubled and line breaks replaced by blanks. Several threads may write to the same stream. Once a write failed
+// (the reader has gone) all further events are dropped. The handle may be
+// opened for overlapped I/O.
+
+class CEventStream {
+public:
+  CEventStream(HANDLE out, bool ownsHandle);
+  ~CEventStream();
+
+  // write line and a line feed
+  void Write(const std::wstring& line);
+
+  bool IsClosed() {
+    return fClosed;
+  }
+
+  // value in the form it is written to the stream
+  static std::wstring Quote(LPCWSTR value);
+
+  // split a line read from a stream into event name and values, returns false
+  // if the line is not an event
+  static bool Parse(const std::wstring& line, std::wstring& event, std::map<std::wstring, std::wstring>& values);
+
+private:
+  HANDLE fOut;
+  bool fOwnsHandle;
+  volatile bool fClosed;
+  HANDLE fWriteEvent;         // completion of overlapped writes
+  CCriticalSection fLock;     // serializes writes of different threads
+};
+
+//---------------------------------------------------------------------------
+// class CJobEvents
+// The events of one job on an event stream:
+//   queued job=<id>
+//   started job=<id>
+//   stage job=<id> name=<stage>
+//   progress job=<id> bytes=<processed> total=<total> rate=<bytes per second>
+//   finished job=<id> exit=<exit code> [error=<message>]
+
+class CJobEvents : public IOperationEvents {
+public:
+  CJobEvents(CEventStream* stream, unsigned jobId);
+
+  void OnQueued();
+  void OnStarted();
+  virtual void OnStage(LPCWSTR stage);
+  virtual void OnProgress(unsigned __int64 bytesProcessed, unsigned __int64 bytesTotal);
+  virtual void OnFinished(int exitCode, LPCWSTR message);
+
+  unsigned GetJobId() const {
+    return fJobId;
+  }
+
+private:
+  std::wstring Event(LPCWSTR name);
+
+  CEventStream* fStream;
+  unsigned fJobId;
+  unsigned __int64 fLastBytes;    // bytes processed at last progress event
+  ULONGLONG fLastTicks;           // time of last progress event
+};
+
+#endif
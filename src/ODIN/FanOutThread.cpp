@@ -0,0 +1,223 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+ 
+#include "stdafx.h"
+#include "BufferQueue.h"
+#include "FanOutThread.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+// interval in ms to check for ended or cancelled targets while waiting for one
+static const DWORD kPollInterval = 100;
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// Constructor
+//
+CFanOutThread::CFanOutThread(CImageBuffer *sourceQueue, CImageBuffer *sourceReturnQueue, unsigned maxLag, DWORD detachTimeout)
+  : COdinThread(CREATE_SUSPENDED)
+{
+  fSourceQueue = sourceQueue;
+  fSourceReturnQueue = sourceReturnQueue;
+  // a detached target needs one chunk to wake it up
+  fMaxLag = maxLag < 2 ? 2 : maxLag;
+  fDetachTimeout = detachTimeout;
+}
+
+CFanOutThread::~CFanOutThread()
+{
+}
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// Add a target, its chunks do not have memory of their own
+//
+unsigned CFanOutThread::AddTarget()
+{
+  TTarget target;
+  target.fQueue = std::make_unique<CImageBuffer>(L"fFanOutTargetQueue");
+  target.fReturnQueue = std::make_unique<CImageBuffer>(0, fMaxLag, L"fFanOutTargetReturnQueue");
+  target.fConsumer = NULL;
+  target.fDetached = false;
+  fTargets.push_back(std::move(target));
+  return (unsigned) fTargets.size() - 1;
+}
+
+void CFanOutThread::SetTargetThread(unsigned index, COdinThread* consumer)
+{
+  fTargets[index].fConsumer = consumer;
+}
+
+void CFanOutThread::CancelTargetQueues()
+{
+  for (size_t i=0; i<fTargets.size(); i++) {
+    fTargets[i].fQueue->Cancel();
+    fTargets[i].fReturnQueue->Cancel();
+  }
+}
+//---------------------------------------------------------------------------
+
+
+//---------------------------------------------------------------------------
+// The thread's main execution loop
+//
+DWORD CFanOutThread::Execute()
+{
+  SetName("FanOutThread");
+
+  try {
+    FanOutLoop();
+    fFinished = true;
+  } catch (Exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = e.GetMessage();
+    fFinished = true;
+    return E_FAIL;
+  } catch (std::exception &e) {
+    fErrorFlag = true;
+    fErrorMessage = L"Fan out thread encountered standard exception: ";
+    fErrorMessage += CA2W(e.what());
+    fFinished = true;
+    return E_FAIL;
+  } catch (...) {
+    fErrorFlag = true;
+    fErrorMessage = L"Fan out thread encountered unknown exception";
+    fFinished = true;
+    return E_FAIL;
+  }
+  return 0;
+}
+
+void CFanOutThread::FanOutLoop()
+{
+  bool eof = false;
+  vector<CBufferChunk*> targetChunks(fTargets.size());
+
+  while (!eof) {
+    CBufferChunk *chunk = fSourceQueue->GetChunk(); // may block
+    if (!chunk)
+      THROW_INT_EXC(EInternalException::getChunkError);
+    eof = chunk->IsEOF();
+
+    // get a chunk of each target first, this waits for targets lagging behind
+    LONG shareCount = 0;
+    for (unsigned i=0; i<fTargets.size(); i++) {
+      targetChunks[i] = fTargets[i].fDetached ? NULL : TakeTargetChunk(i);
+      if (targetChunks[i])
+        ++shareCount;
+    }
+
+    fBytesProcessed += chunk->IsEmpty() ? 0 : chunk->GetSize();
+    if (shareCount == 0) {
+      // no target left, continue reading so that the threads before us can finish
+      chunk->Reset();
+      fSourceReturnQueue->ReleaseChunk(chunk);
+    } else {
+      chunk->SetShareCount(shareCount);
+      for (unsigned i=0; i<fTargets.size(); i++) {
+        if (targetChunks[i]) {
+          targetChunks[i]->ShareData(chunk, fSourceReturnQueue);
+          fTargets[i].fQueue->ReleaseChunk(targetChunks[i]);
+        }
+      }
+    }
+    if (fCancel)
+      Terminate(-1);  // terminate thread after passing buffer and before acquiring next one
+  }
+
+  for (unsigned i=0; i<fTargets.size(); i++)
+    if (!fTargets[i].fDetached)
+      return;
+  THROW_INT_EXC(EInternalException::fanOutNoTarget);
+}
+
+//---------------------------------------------------------------------------
+// Wait until target has released a chunk or detach it, returns NULL if detached
+//
+CBufferChunk* CFanOutThread::TakeTargetChunk(unsigned index)
+{
+  TTarget& target = fTargets[index];
+  DWORD waited = 0;
+
+  while (true) {
+    CBufferChunk *chunk = target.fReturnQueue->TryGetChunk(kPollInterval);
+    if (chunk)
+      return chunk;
+    if (fCancel)
+      Terminate(-1);
+    if (HasTargetEnded(index)) {
+      DetachTarget(index, target.fConsumer->GetErrorFlag() ? target.fConsumer->GetErrorMessage() : NULL);
+      return NULL;
+    }
+    waited += kPollInterval;
+    if (fDetachTimeout > 0 && waited >= fDetachTimeout) {
+      DetachTarget(index, EInternalException(EInternalException::fanOutTargetTooSlow).GetMessage());
+      return NULL;
+    }
+  }
+}
+
+bool CFanOutThread::HasTargetEnded(unsigned index)
+{
+  COdinThread* consumer = fTargets[index].fConsumer;
+  return consumer && WaitForSingleObject(consumer->GetHandle(), 0) == WAIT_OBJECT_0;
+}
+
+//---------------------------------------------------------------------------
+// Stop passing data to a target. Chunks it has not taken yet are released so that
+// they do not hold back the other targets. If the target still runs it is cancelled
+// and gets an empty chunk so that it does not wait for data forever.
+//
+void CFanOutThread::DetachTarget(unsigned index, LPCWSTR reason)
+{
+  TTarget& target = fTargets[index];
+  CBufferChunk *chunk;
+
+  ATLTRACE(L"Fan out thread detaches target %u: %s\n", index, reason ? reason : L"thread ended");
+  target.fDetached = true;
+  target.fError = reason ? reason : L"";
+  if (target.fConsumer)
+    target.fConsumer->CancelThread();
+  while ((chunk = target.fQueue->TryGetChunk(0)) != NULL) {
+    chunk->Reset();
+    target.fReturnQueue->ReleaseChunk(chunk);
+  }
+  if (!HasTargetEnded(index)) {
+    chunk = target.fReturnQueue->TryGetChunk(0);
+    if (chunk) {
+      chunk->SetSize(0);
+      chunk->SetEOF(true);
+      target.fQueue->ReleaseChunk(chunk);
+    }
+  }
+}
+//---------------------------------------------------------------------------
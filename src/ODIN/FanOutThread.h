@@ -0,0 +1,109 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+ 
+#pragma once
+#ifndef FanOutThread_H
+#define FanOutThread_H
+//---------------------------------------------------------------------------
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "OdinThread.h"
+//---------------------------------------------------------------------------
+
+class CImageBuffer;
+class CBufferChunk;
+
+//---------------------------------------------------------------------------
+// Thread passing each chunk of a source queue to several targets (e.g. one write
+// thread per drive) without copying the data. Each target gets its own chunk
+// sharing the data of the source chunk, the source chunk is given back when all
+// targets have released their chunk. A target can fall behind the fastest one by
+// maxLag chunks, then the others wait. A target that does not take data for
+// detachTimeout ms or whose thread has ended is detached and the others continue.
+//
+class CFanOutThread : public COdinThread
+{
+  public:
+    CFanOutThread(CImageBuffer *sourceQueue, CImageBuffer *sourceReturnQueue, unsigned maxLag, DWORD detachTimeout);
+    virtual ~CFanOutThread();
+
+    // add a target, returns its index. The target thread takes chunks from
+    // GetTargetQueue() and releases them to GetTargetReturnQueue()
+    unsigned AddTarget();
+
+    // thread consuming the chunks of a target, must be set before the thread is resumed
+    void SetTargetThread(unsigned index, COdinThread* consumer);
+
+    CImageBuffer* GetTargetQueue(unsigned index) {
+      return fTargets[index].fQueue.get();
+    }
+
+    CImageBuffer* GetTargetReturnQueue(unsigned index) {
+      return fTargets[index].fReturnQueue.get();
+    }
+
+    unsigned GetTargetCount() const {
+      return (unsigned) fTargets.size();
+    }
+
+    // stop the target threads waiting for chunks, see CImageBuffer::Cancel()
+    void CancelTargetQueues();
+
+    // true if target was detached before all data were passed to it
+    bool IsTargetDetached(unsigned index) const {
+      return fTargets[index].fDetached;
+    }
+
+    // reason why a target was detached or empty string
+    const std::wstring& GetTargetError(unsigned index) const {
+      return fTargets[index].fError;
+    }
+
+  protected:
+    virtual DWORD Execute();
+
+  private:
+    struct TTarget {
+      std::unique_ptr<CImageBuffer> fQueue;       // chunks passed to target
+      std::unique_ptr<CImageBuffer> fReturnQueue; // chunks released by target
+      COdinThread* fConsumer;                     // thread of target
+      bool fDetached;
+      std::wstring fError;
+    };
+
+    void FanOutLoop();
+    CBufferChunk* TakeTargetChunk(unsigned index);
+    void DetachTarget(unsigned index, LPCWSTR reason);
+    bool HasTargetEnded(unsigned index);
+
+    CImageBuffer *fSourceQueue;
+    CImageBuffer *fSourceReturnQueue;
+    unsigned fMaxLag;
+    DWORD fDetachTimeout;
+    std::vector<TTarget> fTargets;
+};
+//---------------------------------------------------------------------------
+#endif
@@ -40,6 +40,15 @@ LPCWSTR EFileFormatException::sMessages[] = {
   L"The compression method is unknown", // wrongCompressionMethod,
   L"The method to store information about cluster usage is unknown", // wrongVolumeEncodingMethod,
   L"The file has an unexpected file size.", // wrongFileSizeError
+  L"The block manifest of the image is damaged or has an unknown format.", // wrongBlockManifest
+  L"The index of the chunk store is damaged or has an unknown format.", // wrongChunkStoreIndex
+  L"A chunk referenced by the image is missing in the chunk store.", // chunkNotFound
+  L"A chunk in the chunk store is damaged.", // chunkChecksumError
+  L"The chunk list of the deduplicated image is damaged.", // wrongRecipe
+  L"The block hash table of the image is damaged or has an unknown format.", // wrongBlockHashTable
+  L"The base image has no block hashes and can not be used for an incremental image.", // noBlockHashTable
+  L"The base image does not match the image that was used to create the incremental image.", // baseImageMismatch
+  L"The checksum of the image data is wrong, the image is damaged.", // checksumError
 };
 
 
@@ -36,7 +36,9 @@ class EFileFormatException : public Exception
   public:
   typedef enum ExceptionCode {magicByteError, wrongFileOffsetError, wrongCommentLength,
     wrongChecksumLength, majorVersionError, wrongChecksumMethod, wrongCompressionMethod,
-    wrongVolumeEncodingMethod, wrongFileSizeError,
+    wrongVolumeEncodingMethod, wrongFileSizeError, wrongBlockManifest,
+    wrongChunkStoreIndex, chunkNotFound, chunkChecksumError, wrongRecipe,
+    wrongBlockHashTable, noBlockHashTable, baseImageMismatch, checksumError,
   };
   
   EFileFormatException(int errCode) : 
@@ -24,6 +24,8 @@
 #include "stdafx.h"
 #include "FileHeader.h"
 #include "OSException.h"
+#include "InternalException.h"
+#include "IImageStream.h"
 
 #ifdef DEBUG
   #define new DEBUG_NEW
@@ -41,7 +43,8 @@ using namespace std;
 const GUID CImageFileHeader::sMagicFileHeaderGUID = 
   { 0x1d4d7b73, 0xfa01, 0x40e1, { 0xb0, 0x94, 0x52, 0x67, 0xd8, 0xfa, 0xb, 0xe7 } };
 const WORD CImageFileHeader::sVerMajor = 1;
-const WORD CImageFileHeader::sVerMinor = 0;
+const WORD CImageFileHeader::sVerMinor = 4; // 1.1: block manifest, 1.2: block hash table, 1.3: media hash, 1.4: trailer
+const WORD CImageFileHeader::sVerMinorMultiStream = 5; // 1.5: data of several codec streams (checkpoints)
 
 CImageFileHeader::CImageFileHeader()
 {
@@ -77,10 +80,67 @@ void CImageFileHeader::ReadHeaderFromFile(HANDLE hFileIn)
   CHECK_OS_EX_PARAM1(ok, EWinException::seekError, L"");
   ok = ReadFile(hFileIn, &fHeader, sizeof(fHeader), &sizeRead, NULL);
   CHECK_OS_EX_PARAM1(ok, EWinException::readFileError, L"");
+  ClearFieldsOfOlderVersions();
   ok = SetFilePointerEx(hFileIn, curPos, NULL, FILE_BEGIN);
   CHECK_OS_EX_PARAM1(ok, EWinException::seekError, L"");
 }
 
+void CImageFileHeader::WriteHeaderToStream(IImageStream* stream)
+{
+  unsigned sizeWritten;
+  unsigned __int64 curPos = stream->GetPosition();
+  stream->Seek(0, FILE_BEGIN);
+  stream->Write(&fHeader, sizeof(fHeader), &sizeWritten);
+  if (sizeWritten != sizeof(fHeader))
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  stream->Seek(curPos, FILE_BEGIN);
+}
+
+void CImageFileHeader::ReadHeaderFromStream(IImageStream* stream)
+{
+  unsigned sizeRead;
+  unsigned __int64 curPos = stream->GetPosition();
+  stream->Seek(0, FILE_BEGIN);
+  stream->Read(&fHeader, sizeof(fHeader), &sizeRead);
+  ClearFieldsOfOlderVersions();
+  stream->Seek(curPos, FILE_BEGIN);
+}
+
+void CImageFileHeader::WriteHeaderToBuffer(void* buffer) const
+{
+  memcpy(buffer, &fHeader, sizeof(fHeader));
+}
+
+void CImageFileHeader::ReadHeaderFromBuffer(const void* buffer)
+{
+  memcpy(&fHeader, buffer, sizeof(fHeader));
+  ClearFieldsOfOlderVersions();
+}
+
+void CImageFileHeader::ClearFieldsOfOlderVersions()
+{
+  if (fHeader.versionMinor < 1) {
+    // version 1.0 headers are shorter, what we read behind them is not part of the header
+    fHeader.blockManifestScheme = noBlockManifest;
+    fHeader.blockManifestBlockSize = 0;
+    fHeader.blockManifestOffset = 0;
+    fHeader.blockManifestLength = 0;
+  }
+  if (fHeader.versionMinor < 2) {
+    fHeader.imageType = imageFull;
+    fHeader.blockHashScheme = noBlockHashes;
+    fHeader.blockHashOffset = 0;
+    fHeader.blockHashLength = 0;
+  }
+  if (fHeader.versionMinor < 3) {
+    fHeader.mediaHashScheme = noMediaHash;
+    memset(fHeader.mediaHashSha1, 0, sizeof(fHeader.mediaHashSha1));
+    memset(fHeader.mediaHashSha256, 0, sizeof(fHeader.mediaHashSha256));
+  }
+  if (fHeader.versionMinor < 4)
+    fHeader.trailerLength = 0;
+}
+
 bool CImageFileHeader::IsValidFileHeader() const {
   return fHeader.guid == sMagicFileHeaderGUID ? true : false;
 }
@@ -94,13 +154,62 @@ bool CImageFileHeader::IsSupportedChecksumMethod() const {
 }
 
 bool CImageFileHeader::IsSupportedCompressionFormat() const {
-  return fHeader.compressionScheme >= noCompression && fHeader.compressionScheme <= compressionZSTD;
+  DWORD format = fHeader.compressionScheme & ~compressionMultiStream;
+  return format >= noCompression && format <= compressionChunkStore;
 }
 
 bool CImageFileHeader::IsSupportedVolumeEncodingFormat() const {
   return fHeader.volumeBitmapEncodingScheme >= noVolumeBitmap && fHeader.volumeBitmapEncodingScheme <= simpleCompressedRunLength;
 }
 
+bool CImageFileHeader::IsSupportedBlockManifestFormat() const {
+  return fHeader.blockManifestScheme >= noBlockManifest && fHeader.blockManifestScheme <= blockManifestCRC32C;
+}
+
+bool CImageFileHeader::IsSupportedBlockHashFormat() const {
+  return fHeader.blockHashScheme >= noBlockHashes && fHeader.blockHashScheme <= blockHashSHA256;
+}
+
+void CImageFileHeader::EncodeString(const wstring& s, vector<BYTE>& bytes)
+{
+  bytes.clear();
+  bytes.reserve(s.length() * 2);
+  for (size_t i=0; i<s.length(); i++) {
+    unsigned long c = (unsigned long) s[i];
+    WORD units[2] = { (WORD) c, 0 };
+    int count = 1;
+    if (c > 0xFFFF && c <= 0x10FFFF) {
+      // character outside the BMP, only where wchar_t has 32 bits
+      units[0] = (WORD) (0xD800 + ((c - 0x10000) >> 10));
+      units[1] = (WORD) (0xDC00 + ((c - 0x10000) & 0x3FF));
+      count = 2;
+    }
+    for (int j=0; j<count; j++) {
+      bytes.push_back((BYTE) (units[j] & 0xFF));
+      bytes.push_back((BYTE) (units[j] >> 8));
+    }
+  }
+}
+
+wstring CImageFileHeader::DecodeString(const void* bytes, DWORD length)
+{
+  const BYTE* pos = (const BYTE*) bytes;
+  wstring s;
+  s.reserve(length / 2);
+  for (DWORD i=0; i+1<length; i+=2) {
+    unsigned long c = pos[i] | (pos[i+1] << 8);
+    if (sizeof(wchar_t) > 2 && c >= 0xD800 && c < 0xDC00 && i+3 < length) {
+      unsigned long low = pos[i+2] | (pos[i+3] << 8);
+      if (low >= 0xDC00 && low < 0xE000) {
+        c = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+        i += 2;
+      }
+    }
+    s += (wchar_t) c;
+  }
+  return s;
+}
+
 void CImageFileHeader::SetVolumeBitmapInfo(VolumeEncodingFormat format, unsigned __int64 offset, unsigned __int64 length)
 {
   fHeader.volumeBitmapEncodingScheme = format;
@@ -118,7 +227,19 @@ void CImageFileHeader::SetImageFileVerificationInfo(VerifyFormat format, DWORD l
 
 void CImageFileHeader::SetCompressionFormat(TCompressionFormat compFormat)
 {
-  fHeader.compressionScheme = compFormat;
+  fHeader.compressionScheme = compFormat | (fHeader.compressionScheme & compressionMultiStream);
+}
+
+// only images that need it get the new version, so that older versions can read all others
+void CImageFileHeader::SetMultiStream(bool multiStream)
+{
+  if (multiStream) {
+    fHeader.compressionScheme |= compressionMultiStream;
+    fHeader.versionMinor = sVerMinorMultiStream;
+  } else {
+    fHeader.compressionScheme &= ~compressionMultiStream;
+    fHeader.versionMinor = sVerMinor;
+  }
 }
 
 void CImageFileHeader::SetVolumeSize(unsigned __int64 volSize)
@@ -126,3 +247,13 @@ void CImageFileHeader::SetVolumeSize(unsigned __int64 volSize)
   fHeader.volumeSize = volSize;
 }
 
+void CImageFileHeader::SetMediaHash(DWORD scheme, const BYTE* sha1, const BYTE* sha256)
+{
+  fHeader.mediaHashScheme = scheme;
+  memset(fHeader.mediaHashSha1, 0, sizeof(fHeader.mediaHashSha1));
+  memset(fHeader.mediaHashSha256, 0, sizeof(fHeader.mediaHashSha256));
+  if ((scheme & mediaHashSHA1) && sha1)
+    memcpy(fHeader.mediaHashSha1, sha1, sizeof(fHeader.mediaHashSha1));
+  if ((scheme & mediaHashSHA256) && sha256)
+    memcpy(fHeader.mediaHashSha256, sha256, sizeof(fHeader.mediaHashSha256));
+}
@@ -26,8 +26,11 @@
 // class CImageFileHeader
 // class for definition and manipulation of a common image file header
 #include <string>
+#include <vector>
 #include "Compression.h"
 
+class IImageStream;
+
 class CImageFileHeader {
 friend class FileHeaderTest;
 
@@ -54,19 +57,46 @@ public:
     unsigned __int64 usedSize;            // length of used disk clusters in bytes (always uncompressed size)
     unsigned __int64 volumeSize;          // size in bytes of original volume
     unsigned __int64 fileSize;            // total length of file (useful if files are split)
+    // since version 1.1:
+    DWORD blockManifestScheme;            // format of block manifest (per block checksums of data area)
+    DWORD blockManifestBlockSize;         // size in bytes of data area covered by one manifest entry
+    unsigned __int64 blockManifestOffset; // file offset where block manifest is stored
+    unsigned __int64 blockManifestLength; // length of block manifest in bytes
+    // since version 1.2:
+    DWORD imageType;                      // full image or incremental image depending on a base image
+    DWORD blockHashScheme;                // format of block hash table (per block digests of volume)
+    unsigned __int64 blockHashOffset;     // file offset where block hash table is stored
+    unsigned __int64 blockHashLength;     // length of block hash table in bytes
+    // since version 1.3:
+    DWORD mediaHashScheme;                // digests of restored volume contained below (combination of MediaHashFormat)
+    BYTE mediaHashSha1[20];               // SHA-1 of volume content up to volumeSize, free clusters as zeros (or skipped)
+    BYTE mediaHashSha256[32];             // SHA-256 of volume content up to volumeSize, free clusters as zeros (or skipped)
+    // since version 1.4:
+    DWORD trailerLength;                  // images written as a stream: length of trailer at end of file with crc32
+                                          // and final header, the header at the start has no data size then (0 otherwise)
   } TDiskImageFileHeader;
   
   // typedef enum { noCompression = 0, compressionGZip = 1,  compressionBZIP = 2} CompressionFormat;
   typedef enum { noVolumeBitmap = 0, simpleCompressedRunLength = 1 } VolumeEncodingFormat;
   typedef enum { verifyNone = 0, verifyCRC32 = 1 } VerifyFormat;
   typedef enum { volumeHardDisk = 0, volumePartition = 1 } VolumeFormat;
+  typedef enum { noBlockManifest = 0, blockManifestCRC32C = 1 } BlockManifestFormat;
+  typedef enum { imageFull = 0, imageIncremental = 1 } ImageType;
+  typedef enum { noBlockHashes = 0, blockHashSHA256 = 1 } BlockHashFormat;
+  typedef enum { noMediaHash = 0, mediaHashSHA1 = 1, mediaHashSHA256 = 2, mediaHashUsedClusters = 4 } MediaHashFormat;
+  // flag in compressionScheme since version 1.5: the data are several compression streams (checkpoints),
+  // older versions reject the value as unknown compression format
+  typedef enum { compressionMultiStream = 0x100 } CompressionSchemeFlag;
 
 private:
   static const GUID sMagicFileHeaderGUID; 
   static const WORD sVerMajor;
   static const WORD sVerMinor ;
+  static const WORD sVerMinorMultiStream;
 
   TDiskImageFileHeader fHeader;
+
+  void ClearFieldsOfOlderVersions();
 public:
   CImageFileHeader();
   ~CImageFileHeader()
@@ -74,6 +104,12 @@ public:
   
   void WriteHeaderToFile(HANDLE hFileOut);
   void ReadHeaderFromFile(HANDLE hFileIn);
+  // the same for images that are not accessed by a file handle, the position of stream is kept
+  void WriteHeaderToStream(IImageStream* stream);
+  void ReadHeaderFromStream(IImageStream* stream);
+  // the header as stored at the start of an image file, GetHeaderFileLength() bytes
+  void WriteHeaderToBuffer(void* buffer) const;
+  void ReadHeaderFromBuffer(const void* buffer);
   
   DWORD GetHeaderFileLength() {
     return sizeof(fHeader);
@@ -84,17 +120,26 @@ public:
   bool IsSupportedChecksumMethod() const;
   bool IsSupportedCompressionFormat() const;
   bool IsSupportedVolumeEncodingFormat() const;
+  bool IsSupportedBlockManifestFormat() const;
+  bool IsSupportedBlockHashFormat() const;
+
+  // Strings stored in an image (comment, name of the base image) are UTF-16LE like
+  // wchar_t on Windows, also where wchar_t has 32 bits. length is in bytes.
+  static void EncodeString(const std::wstring& s, std::vector<BYTE>& bytes);
+  static std::wstring DecodeString(const void* bytes, DWORD length);
   
-  unsigned GetMajorVersion() {
+  unsigned GetMajorVersion() const {
     return (unsigned) fHeader.versionMajor;
   }
   
-  unsigned GetMinorVersion() {
+  unsigned GetMinorVersion() const {
     return (unsigned) fHeader.versionMinor;
   }
 
   void SetVolumeBitmapInfo(VolumeEncodingFormat format, unsigned __int64 offset, unsigned __int64 length);
   void SetCompressionFormat(TCompressionFormat compFormat);
+  // images with checkpoints, see compressionMultiStream, have version 1.5
+  void SetMultiStream(bool multiStream);
   void SetImageFileVerificationInfo(VerifyFormat format, DWORD length);
   void SetVolumeSize(unsigned __int64 volSize);
 
@@ -103,7 +148,11 @@ public:
   }
 
   TCompressionFormat GetCompressionFormat() const {
-    return (TCompressionFormat) fHeader.compressionScheme;
+    return (TCompressionFormat) (fHeader.compressionScheme & ~compressionMultiStream);
+  }
+
+  bool IsMultiStream() const {
+    return (fHeader.compressionScheme & compressionMultiStream) != 0;
   }
 
   VolumeEncodingFormat GetVolumeEncoding() const {
@@ -170,7 +219,8 @@ public:
   void SetDataSize(unsigned __int64 bytesProcessed) {
     fHeader.dataSize = bytesProcessed;
     fHeader.fileSize = bytesProcessed + fHeader.commentLength + fHeader.volumeBitmapLength
-      + fHeader.verifyLength + sizeof(TDiskImageFileHeader);
+      + fHeader.verifyLength + fHeader.blockManifestLength + fHeader.blockHashLength + fHeader.trailerLength
+      + sizeof(TDiskImageFileHeader);
     //ATLTRACE("Write file size of %u after %u bytes processed\n", (unsigned)fHeader.fileSize, (unsigned) bytesProcessed);
   }
 
@@ -197,5 +247,75 @@ public:
   void SetVolumeType(VolumeFormat volType) {
     fHeader.volumeType = volType;
   }
+
+  BlockManifestFormat GetBlockManifestFormat() const {
+    return (BlockManifestFormat) fHeader.blockManifestScheme;
+  }
+
+  bool HasBlockManifest() const {
+    return fHeader.blockManifestScheme != noBlockManifest && fHeader.blockManifestLength > 0;
+  }
+
+  void GetBlockManifestInfo(unsigned __int64& offset, unsigned __int64& length, DWORD& blockSize) const {
+    offset = fHeader.blockManifestOffset;
+    length = fHeader.blockManifestLength;
+    blockSize = fHeader.blockManifestBlockSize;
+  }
+
+  void SetBlockManifestInfo(BlockManifestFormat format, unsigned __int64 offset, unsigned __int64 length, DWORD blockSize) {
+    fHeader.blockManifestScheme = format;
+    fHeader.blockManifestOffset = offset;
+    fHeader.blockManifestLength = length;
+    fHeader.blockManifestBlockSize = blockSize;
+  }
+
+  ImageType GetImageType() const {
+    return (ImageType) fHeader.imageType;
+  }
+
+  bool HasBlockHashTable() const {
+    return fHeader.blockHashScheme != noBlockHashes && fHeader.blockHashLength > 0;
+  }
+
+  void GetBlockHashInfo(unsigned __int64& offset, unsigned __int64& length) const {
+    offset = fHeader.blockHashOffset;
+    length = fHeader.blockHashLength;
+  }
+
+  void SetBlockHashInfo(ImageType imageType, BlockHashFormat format, unsigned __int64 offset, unsigned __int64 length) {
+    fHeader.imageType = imageType;
+    fHeader.blockHashScheme = format;
+    fHeader.blockHashOffset = offset;
+    fHeader.blockHashLength = length;
+  }
+
+  DWORD GetMediaHashScheme() const {
+    return fHeader.mediaHashScheme;
+  }
+
+  bool HasMediaHash() const {
+    return (fHeader.mediaHashScheme & (mediaHashSHA1 | mediaHashSHA256)) != 0;
+  }
+
+  // digests are only valid if the corresponding bit is set in GetMediaHashScheme()
+  const BYTE* GetMediaHashSha1() const {
+    return fHeader.mediaHashSha1;
+  }
+
+  const BYTE* GetMediaHashSha256() const {
+    return fHeader.mediaHashSha256;
+  }
+
+  // sha1 and sha256 may be NULL if not contained in scheme
+  void SetMediaHash(DWORD scheme, const BYTE* sha1, const BYTE* sha256);
+
+  // the trailer of an image written as a stream holds the crc32 and this header with data size
+  DWORD GetTrailerLength() const {
+    return fHeader.trailerLength;
+  }
+
+  void SetTrailerLength(DWORD trailerLength) {
+    fHeader.trailerLength = trailerLength;
+  }
 };
 //---------------------------------------------------------------------------
@@ -84,7 +84,7 @@ void CFileNameUtil::GetDirFromFileName(const wstring& fileName, wstring& dir)
     dir.clear();
   }
   wstring absPath(buffer, len);
-  size_t pos = absPath.rfind(L'\\');
+  size_t pos = absPath.find_last_of(L"\\/");
   if (pos == string::npos) {
       ATLTRACE("Error in getting current directory for abs path %S", absPath);
       dir.clear();
@@ -146,7 +146,7 @@ void CFileNameUtil::GenerateFileNameForMBRBackupFile(wstring &volumeFileName)
 {
     // generate file name for MBR
     wstring mbrFileName = volumeFileName;
-    transform(mbrFileName.begin(), mbrFileName.end(), mbrFileName.begin(), tolower);
+    transform(mbrFileName.begin(), mbrFileName.end(), mbrFileName.begin(), (int (*)(int))tolower);
     const wstring mbrExt(L".mbr");
     if (mbrFileName.length()-4  == mbrFileName.rfind(mbrExt))
       return;
@@ -196,7 +196,7 @@ void CFileNameUtil::GetSplitFilePattern(ISplitManagerCallback& splitCB, LPCWSTR
 
   filePattern = path;
   splitCB.GetFileName(0, filePattern);
-  off = filePattern.rfind(L'\\');
+  off = filePattern.find_last_of(L"\\/");
   if (off != string::npos)
     dir = filePattern.substr(0, off+1);
   // count number of '0'
@@ -213,7 +213,7 @@ void CFileNameUtil::GetEntireDiskFilePattern(LPCWSTR path, wstring& filePattern)
   size_t count = 0;
 
   filePattern = path;
-  off = filePattern.rfind(L'\\');
+  off = filePattern.find_last_of(L"\\/");
   if (off == string::npos)
     off = 0;
   
@@ -0,0 +1,634 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "HttpImageStream.h"
+#include "NetProtocol.h"
+#include "OSException.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+static const wchar_t cHttpPrefix[] = L"http://";
+static const wchar_t cHttpsPrefix[] = L"https://";
+static const unsigned short cHttpDefaultPort = 80;
+// a request failing temporarily is sent up to cMaxAttempts times, the delay doubles each time
+static const unsigned cMaxAttempts = 5;
+static const DWORD cRetryDelay = 250;
+// S3 allows 10000 parts, parts are sized for fewer to leave room for data growing in compression
+static const unsigned cPartsExpected = 9000;
+static const unsigned __int64 cMaxPartSize = 2ULL * 1024 * 1024 * 1024;
+// longest line of a response header and largest response body other than image data
+static const size_t cMaxLineLength = 16 * 1024;
+static const size_t cMaxBodyLength = 1024 * 1024;
+
+namespace {
+
+std::string ToLower(std::string text)
+{
+  for (size_t i=0; i<text.length(); i++)
+    text[i] = (char) tolower((unsigned char) text[i]);
+  return text;
+}
+
+// percent encoding of all characters but the unreserved ones and those in keep
+std::string Escape(const std::string& text, const char* keep)
+{
+  static const char hex[] = "0123456789ABCDEF";
+  std::string result;
+
+  for (size_t i=0; i<text.length(); i++) {
+    unsigned char c = (unsigned char) text[i];
+    if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~' || strchr(keep, c) != NULL) {
+      result += (char) c;
+    } else {
+      result += '%';
+      result += hex[c >> 4];
+      result += hex[c & 15];
+    }
+  }
+  return result;
+}
+
+// text of the first element tag in xml, empty if there is none
+std::string XmlValue(const std::string& xml, const std::string& tag)
+{
+  size_t start = xml.find("<" + tag + ">");
+  if (start == std::string::npos)
+    return std::string();
+  start += tag.length() + 2;
+  size_t end = xml.find("</" + tag + ">", start);
+  return end == std::string::npos ? std::string() : xml.substr(start, end - start);
+}
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implementation of class CHttpImageStream
+/////////////////////////////////////////////////////////////////////////////////////
+
+CHttpImageStream::CHttpImageStream(unsigned connectionCount, unsigned blockSize, unsigned partSize)
+{
+  WSADATA wsaData;
+  WSAStartup(MAKEWORD(2, 2), &wsaData);
+  fOpenMode = forReading;
+  fConnectionCount = max(connectionCount, 1U);
+  fBlockSize = max(blockSize, 4096U);
+  fPartSize = max(partSize, 4096U);
+  fNextConnection = 0;
+  fPosition = fSize = fWritten = 0;
+  fCommitted = fCompleted = false;
+  fReadOffset = fReadAheadEnd = 0;
+  fReadLength = 0;
+  fReadAhead = 1;
+}
+
+CHttpImageStream::~CHttpImageStream()
+{
+  Close();
+  WSACleanup();
+}
+
+bool CHttpImageStream::IsHttpName(LPCWSTR name)
+{
+  return name != NULL && (_wcsnicmp(name, cHttpPrefix, wcslen(cHttpPrefix)) == 0 ||
+                          _wcsnicmp(name, cHttpsPrefix, wcslen(cHttpsPrefix)) == 0);
+}
+
+void CHttpImageStream::ParseName()
+{
+  std::string path;
+
+  // there is no TLS, https:// is refused instead of sending the data unencrypted
+  if (_wcsnicmp(fName.c_str(), cHttpPrefix, wcslen(cHttpPrefix)) != 0 ||
+      !NetParseName(fName, wcslen(cHttpPrefix), fHost, fPort, path, cHttpDefaultPort))
+    THROW_INT_EXC_PARAM1(EInternalException::httpAddressError, fName.c_str());
+  fPath = "/" + Escape(path, "/");
+}
+
+void CHttpImageStream::Open(LPCWSTR name, TOpenMode mode)
+{
+  TConnection conn = { INVALID_SOCKET, 0, false, 0, std::vector<BYTE>() };
+  TResponse response;
+
+  fName = name;
+  fOpenMode = mode;
+  fPosition = fSize = fWritten = 0;
+  fCommitted = fCompleted = false;
+  fBuffer.clear();
+  fETags.clear();
+  fReadLength = 0;
+  fReadAhead = 1;
+  fNextConnection = 0;
+  ParseName();
+  fConnections.assign(fConnectionCount, conn);
+
+  if (mode == forWriting) {
+    Exchange(fConnections[0], "POST", "uploads", std::string(), response);
+    fUploadId = XmlValue(response.body, "UploadId");
+    if (fUploadId.empty())
+      THROW_INT_EXC(EInternalException::httpProtocolError);
+    fBuffer.reserve(fPartSize);
+  } else {
+    Exchange(fConnections[0], "HEAD", std::string(), std::string(), response);
+    std::map<std::string, std::string>::const_iterator length = response.headers.find("content-length");
+    if (length == response.headers.end())
+      THROW_INT_EXC(EInternalException::httpProtocolError);
+    fSize = strtoull(length->second.c_str(), NULL, 10);
+    fReadBlock.resize(fBlockSize);
+  }
+}
+
+void CHttpImageStream::Close()
+{
+  // an image that is not complete is not stored
+  if (fOpenMode == forWriting && !fUploadId.empty() && !fCompleted)
+    AbortUpload();
+  CloseConnections();
+  fUploadId.clear();
+  fBuffer.clear();
+}
+
+void CHttpImageStream::CloseConnections()
+{
+  for (size_t i=0; i<fConnections.size(); i++)
+    CloseConnection(fConnections[i]);
+  fReadRequests.clear();
+  fReadLength = 0;
+}
+
+void CHttpImageStream::CloseConnection(TConnection& conn)
+{
+  // answers not yet received are dropped by closing the connection
+  if (conn.socket != INVALID_SOCKET)
+    closesocket(conn.socket);
+  conn.socket = INVALID_SOCKET;
+  conn.pending = false;
+}
+
+unsigned __int64 CHttpImageStream::GetSize() const
+{
+  return fOpenMode == forWriting ? fWritten + fBuffer.size() : fSize;
+}
+
+void CHttpImageStream::Seek(__int64 offset, DWORD moveMethod)
+{
+  __int64 base = moveMethod == FILE_BEGIN ? 0 : moveMethod == FILE_CURRENT ? (__int64) fPosition : (__int64) GetSize();
+  if (base + offset < 0)
+    THROW_OS_EXC_PARAM1(ERROR_NEGATIVE_SEEK, EWinException::seekError, fName.c_str());
+  if (fOpenMode == forWriting && fCommitted && (unsigned __int64) (base + offset) != GetSize())
+    THROW_INT_EXC(EInternalException::httpSeekError);
+  // blocks are requested when the stream is read at the new position
+  fPosition = base + offset;
+}
+
+//---------------------------------------------------------------------------
+// requests and responses
+
+std::string CHttpImageStream::NewRequest(const char* method, const std::string& query, const std::string& headers,
+                                         unsigned __int64 contentLength) const
+{
+  std::string request = std::string(method) + " " + fPath + (query.empty() ? "" : "?" + query) + " HTTP/1.1\r\n";
+  std::string host = fHost.find(':') == std::string::npos ? fHost : "[" + fHost + "]";
+
+  request += "Host: " + host + (fPort == std::to_string(cHttpDefaultPort) ? "" : ":" + fPort) + "\r\n";
+  request += "User-Agent: ODIN\r\n";
+  if (strcmp(method, "PUT") == 0 || strcmp(method, "POST") == 0)
+    request += "Content-Length: " + std::to_string(contentLength) + "\r\n";
+  return request + headers + "\r\n";
+}
+
+bool CHttpImageStream::Send(TConnection& conn, const std::string& request, const void* body, size_t length)
+{
+  // a failed request is answered by the failed connection when the answer is received
+  conn.pending = true;
+  if (conn.socket == INVALID_SOCKET)
+    conn.socket = NetConnect(fHost, fPort, fName.c_str());
+  if (NetSendAll(conn.socket, request.c_str(), request.length()) && (length == 0 || NetSendAll(conn.socket, body, length)))
+    return true;
+  conn.error = WSAGetLastError();
+  closesocket(conn.socket);
+  conn.socket = INVALID_SOCKET;
+  return false;
+}
+
+bool CHttpImageStream::Receive(TConnection& conn, void* buffer, size_t length)
+{
+  if (conn.socket != INVALID_SOCKET && NetReceiveAll(conn.socket, buffer, length))
+    return true;
+  if (conn.socket != INVALID_SOCKET)
+    conn.error = WSAGetLastError();
+  CloseConnection(conn);
+  return false;
+}
+
+bool CHttpImageStream::ReceiveLine(TConnection& conn, std::string& line)
+{
+  char c = 0;
+
+  // lines are short, reading them byte by byte keeps the data of the answer in the socket
+  line.clear();
+  while (line.length() < 2 || line.compare(line.length() - 2, 2, "\r\n") != 0) {
+    if (line.length() >= cMaxLineLength)
+      THROW_INT_EXC(EInternalException::httpProtocolError);
+    if (!Receive(conn, &c, 1))
+      return false;
+    line += c;
+  }
+  line.resize(line.length() - 2);
+  return true;
+}
+
+bool CHttpImageStream::ReceiveResponseHeader(TConnection& conn, TResponse& response)
+{
+  std::string line;
+
+  // interim answers (1xx) are skipped
+  do {
+    response.headers.clear();
+    if (!ReceiveLine(conn, line))
+      return false;
+    size_t statusStart = line.find(' ');
+    if (line.compare(0, 5, "HTTP/") != 0 || statusStart == std::string::npos)
+      THROW_INT_EXC(EInternalException::httpProtocolError);
+    response.status = atoi(line.c_str() + statusStart + 1);
+    size_t reasonStart = line.find(' ', statusStart + 1);
+    response.reason = reasonStart == std::string::npos ? std::string() : line.substr(reasonStart + 1);
+    response.keepAlive = line.compare(0, 8, "HTTP/1.1") == 0;
+    for (;;) {
+      if (!ReceiveLine(conn, line))
+        return false;
+      if (line.empty())
+        break;
+      size_t colon = line.find(':');
+      if (colon == std::string::npos)
+        THROW_INT_EXC(EInternalException::httpProtocolError);
+      size_t valueStart = line.find_first_not_of(" \t", colon + 1);
+      std::string name = ToLower(line.substr(0, colon));
+      response.headers[name] = valueStart == std::string::npos ? std::string() : line.substr(valueStart);
+    }
+  } while (response.status >= 100 && response.status < 200);
+  if (response.status < 200 || response.status > 599)
+    THROW_INT_EXC(EInternalException::httpProtocolError);
+
+  std::map<std::string, std::string>::const_iterator connection = response.headers.find("connection");
+  if (connection != response.headers.end())
+    response.keepAlive = ToLower(connection->second) == "keep-alive" ||
+                         (response.keepAlive && ToLower(connection->second) != "close");
+  return true;
+}
+
+bool CHttpImageStream::ReceiveResponseBody(TConnection& conn, TResponse& response)
+{
+  std::map<std::string, std::string>::const_iterator encoding = response.headers.find("transfer-encoding");
+  std::map<std::string, std::string>::const_iterator length = response.headers.find("content-length");
+  std::string line;
+
+  response.body.clear();
+  if (encoding != response.headers.end() && ToLower(encoding->second) != "identity") {
+    // chunked: chunks of a hexadecimal length up to one of length 0 and the trailer
+    for (;;) {
+      if (!ReceiveLine(conn, line))
+        return false;
+      size_t chunkLength = strtoul(line.c_str(), NULL, 16);
+      if (chunkLength == 0)
+        break;
+      if (response.body.length() + chunkLength > cMaxBodyLength)
+        THROW_INT_EXC(EInternalException::httpProtocolError);
+      size_t oldLength = response.body.length();
+      response.body.resize(oldLength + chunkLength);
+      if (!Receive(conn, &response.body[oldLength], chunkLength) || !ReceiveLine(conn, line))
+        return false;
+    }
+    do {
+      if (!ReceiveLine(conn, line))
+        return false;
+    } while (!line.empty());
+  } else if (length != response.headers.end()) {
+    unsigned __int64 bodyLength = strtoull(length->second.c_str(), NULL, 10);
+    if (bodyLength > cMaxBodyLength)
+      THROW_INT_EXC(EInternalException::httpProtocolError);
+    response.body.resize((size_t) bodyLength);
+    if (bodyLength > 0 && !Receive(conn, &response.body[0], (size_t) bodyLength))
+      return false;
+  } else {
+    // the body ends with the connection
+    char buffer[4096];
+    int count;
+    response.keepAlive = false;
+    while ((count = recv(conn.socket, buffer, sizeof(buffer), 0)) > 0) {
+      if (response.body.length() + count > cMaxBodyLength)
+        THROW_INT_EXC(EInternalException::httpProtocolError);
+      response.body.append(buffer, count);
+    }
+    if (count == SOCKET_ERROR) {
+      conn.error = WSAGetLastError();
+      CloseConnection(conn);
+      return false;
+    }
+  }
+  conn.pending = false;
+  if (!response.keepAlive)
+    CloseConnection(conn);
+  return true;
+}
+
+bool CHttpImageStream::ReceiveResponse(TConnection& conn, TResponse& response, bool hasBody)
+{
+  if (!ReceiveResponseHeader(conn, response))
+    return false;
+  if (hasBody && response.status != 204 && response.status != 304)
+    return ReceiveResponseBody(conn, response);
+  conn.pending = false;
+  if (!response.keepAlive)
+    CloseConnection(conn);
+  return true;
+}
+
+void CHttpImageStream::Retry(TConnection& conn, const TResponse& response, unsigned& attempt, const char* method)
+{
+  // status 0: the connection failed
+  bool temporary = response.status == 0 || response.status == 408 || response.status == 429 || response.status >= 500;
+  if (!temporary || ++attempt >= cMaxAttempts) {
+    if (response.status == 0)
+      THROW_OS_EXC_PARAM1(conn.error, EWinException::netReceiveError, fName.c_str());
+    ThrowStatusError(response, method);
+  }
+  CloseConnection(conn);
+  Sleep(cRetryDelay << (attempt - 1));
+}
+
+void CHttpImageStream::ThrowStatusError(const TResponse& response, const char* method)
+{
+  // S3 names the error in the body of the answer
+  std::string code = XmlValue(response.body, "Code");
+  std::string status = std::to_string(response.status) + " " + response.reason + (code.empty() ? "" : " (" + code + ")");
+  std::wstring message = (LPCWSTR) CA2W(status.c_str(), CP_UTF8);
+  message += L" to ";
+  message += (LPCWSTR) CA2W(method);
+  message += L" " + fName;
+  THROW_INT_EXC_PARAM1(EInternalException::httpStatusError, message.c_str());
+}
+
+void CHttpImageStream::Exchange(TConnection& conn, const char* method, const std::string& query,
+                                const std::string& body, TResponse& response)
+{
+  std::string request = NewRequest(method, query, std::string(), body.length());
+  unsigned attempt = 0;
+
+  for (;;) {
+    response = TResponse();
+    if (Send(conn, request, body.c_str(), body.length()) && ReceiveResponse(conn, response, strcmp(method, "HEAD") != 0)
+        && response.status / 100 == 2)
+      return;
+    Retry(conn, response, attempt, method);
+  }
+}
+
+//---------------------------------------------------------------------------
+// writing
+
+void CHttpImageStream::Write(void *buffer, unsigned nLength, unsigned *nBytesWritten)
+{
+  *nBytesWritten = 0;
+  if (fOpenMode == forReading || fPosition < fWritten)
+    THROW_INT_EXC(EInternalException::httpSeekError);
+  size_t offset = (size_t) (fPosition - fWritten);
+  if (offset + nLength > fBuffer.size())
+    fBuffer.resize(offset + nLength);
+  memcpy(&fBuffer[offset], buffer, nLength);
+  fPosition += nLength;
+  *nBytesWritten = nLength;
+  if (fCommitted && fBuffer.size() >= fPartSize)
+    SendPart();
+}
+
+void CHttpImageStream::Commit(unsigned __int64 expectedSize)
+{
+  unsigned __int64 partSize = expectedSize / cPartsExpected + 1;
+
+  fCommitted = true;
+  if (partSize > fPartSize)
+    fPartSize = (unsigned) min(partSize, cMaxPartSize);
+  fPosition = GetSize();
+  if (fBuffer.size() >= fPartSize)
+    SendPart();
+}
+
+void CHttpImageStream::SendPart()
+{
+  // parts go to the connections in turn, a connection has one part on the way
+  TConnection& conn = fConnections[fNextConnection++ % fConnections.size()];
+  if (conn.pending)
+    FinishPart(conn);
+  conn.data.swap(fBuffer);
+  fBuffer.clear();
+  fETags.push_back(std::string());
+  conn.part = (unsigned) fETags.size();
+  fWritten += conn.data.size();
+  SendPartRequest(conn);
+}
+
+void CHttpImageStream::SendPartRequest(TConnection& conn)
+{
+  std::string query = "partNumber=" + std::to_string(conn.part) + "&uploadId=" + Escape(fUploadId, "");
+  Send(conn, NewRequest("PUT", query, std::string(), conn.data.size()), conn.data.empty() ? NULL : &conn.data[0],
+       conn.data.size());
+}
+
+void CHttpImageStream::FinishPart(TConnection& conn)
+{
+  TResponse response;
+  unsigned attempt = 0;
+
+  for (;;) {
+    response = TResponse();
+    if (ReceiveResponse(conn, response, true) && response.status == 200)
+      break;
+    Retry(conn, response, attempt, "PUT");
+    SendPartRequest(conn);
+  }
+  std::map<std::string, std::string>::const_iterator etag = response.headers.find("etag");
+  if (etag == response.headers.end())
+    THROW_INT_EXC(EInternalException::httpProtocolError);
+  fETags[conn.part - 1] = etag->second;
+  conn.data.clear();
+}
+
+void CHttpImageStream::SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */)
+{
+  if (fOpenMode == forWriting && !fCompleted)
+    CompleteUpload();
+}
+
+void CHttpImageStream::CompleteUpload()
+{
+  TResponse response;
+  std::string parts = "<CompleteMultipartUpload>";
+
+  if (!fBuffer.empty() || fETags.empty())
+    SendPart();
+  for (size_t i=0; i<fConnections.size(); i++) {
+    if (fConnections[i].pending)
+      FinishPart(fConnections[i]);
+  }
+  for (size_t i=0; i<fETags.size(); i++)
+    parts += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + fETags[i] + "</ETag></Part>";
+  parts += "</CompleteMultipartUpload>";
+  Exchange(fConnections[0], "POST", "uploadId=" + Escape(fUploadId, ""), parts, response);
+  // S3 reports an upload that failed to complete in the body of an answer with status 200
+  if (!XmlValue(response.body, "Code").empty())
+    ThrowStatusError(response, "POST");
+  fCompleted = true;
+}
+
+void CHttpImageStream::AbortUpload()
+{
+  TResponse response;
+
+  // the parts uploaded so far are deleted, errors are not reported because the image
+  // already failed
+  CloseConnections();
+  try {
+    Exchange(fConnections[0], "DELETE", "uploadId=" + Escape(fUploadId, ""), std::string(), response);
+  } catch (Exception&) {
+  }
+  CloseConnections();
+}
+
+//---------------------------------------------------------------------------
+// reading
+
+void CHttpImageStream::Read(void * buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  BYTE* data = (BYTE*) buffer;
+  unsigned total = 0;
+
+  if (fOpenMode == forWriting)
+    THROW_INT_EXC(EInternalException::httpSeekError);
+  while (total < nLength && fPosition < fSize) {
+    if (fPosition >= fReadOffset && fPosition < fReadOffset + fReadLength) {
+      unsigned count = (unsigned) min((unsigned __int64) (nLength - total), fReadOffset + fReadLength - fPosition);
+      memcpy(data + total, &fReadBlock[(size_t) (fPosition - fReadOffset)], count);
+      fPosition += count;
+      total += count;
+    } else {
+      FillReadBlock();
+    }
+  }
+  *nBytesRead = total;
+}
+
+void CHttpImageStream::FillReadBlock()
+{
+  // blocks before the position are skipped, a position outside of the blocks
+  // requested starts a new read ahead at the block of the position
+  while (!fReadRequests.empty() && fReadRequests.front().offset + fReadRequests.front().length <= fPosition)
+    ReceiveReadBlock();
+  if (fReadRequests.empty() || fReadRequests.front().offset > fPosition) {
+    DiscardReadAhead();
+    fReadAheadEnd = fPosition - fPosition % fBlockSize;
+    fReadAhead = 1;
+  }
+  RequestReadAhead();
+  ReceiveReadBlock();
+
+  // the read ahead grows with every block read in sequence up to one block per connection
+  fReadAhead = min(fReadAhead * 2, (unsigned) fConnections.size());
+  RequestReadAhead();
+}
+
+void CHttpImageStream::RequestReadAhead()
+{
+  // the requests on the way use consecutive connections, the next one is free
+  while (fReadRequests.size() < fReadAhead && fReadAheadEnd < fSize) {
+    unsigned index = fNextConnection++ % fConnections.size();
+    TReadRequest request = { index, fReadAheadEnd, (unsigned) min((unsigned __int64) fBlockSize, fSize - fReadAheadEnd) };
+    SendReadRequest(request);
+    fReadRequests.push_back(request);
+    fReadAheadEnd += request.length;
+  }
+}
+
+void CHttpImageStream::SendReadRequest(const TReadRequest& request)
+{
+  std::string range = "Range: bytes=" + std::to_string(request.offset) + "-" +
+                      std::to_string(request.offset + request.length - 1) + "\r\n";
+  Send(fConnections[request.connection], NewRequest("GET", std::string(), range, 0), NULL, 0);
+}
+
+void CHttpImageStream::ReceiveReadBlock()
+{
+  TReadRequest request = fReadRequests.front();
+  TConnection& conn = fConnections[request.connection];
+  TResponse response;
+  unsigned attempt = 0;
+
+  // the answer of each connection arrives in the order of the requests
+  fReadRequests.pop_front();
+  for (;;) {
+    response = TResponse();
+    if (ReceiveResponseHeader(conn, response)) {
+      if (response.status == 206) {
+        std::map<std::string, std::string>::const_iterator length = response.headers.find("content-length");
+        std::map<std::string, std::string>::const_iterator range = response.headers.find("content-range");
+        if (length == response.headers.end() || range == response.headers.end() ||
+            range->second.compare(0, 6, "bytes ") != 0 || strtoull(range->second.c_str() + 6, NULL, 10) != request.offset)
+          THROW_INT_EXC(EInternalException::httpProtocolError);
+        unsigned __int64 dataLength = strtoull(length->second.c_str(), NULL, 10);
+        if (dataLength > request.length)
+          THROW_INT_EXC(EInternalException::httpProtocolError);
+        if (Receive(conn, &fReadBlock[0], (size_t) dataLength)) {
+          conn.pending = false;
+          if (!response.keepAlive)
+            CloseConnection(conn);
+          fReadOffset = request.offset;
+          fReadLength = (unsigned) dataLength;
+          // an object that got shorter while it is read ends here
+          if (dataLength < request.length)
+            fSize = min(fSize, request.offset + dataLength);
+          return;
+        }
+        response.status = 0;
+      } else if (!ReceiveResponseBody(conn, response)) {
+        response.status = 0;
+      }
+    }
+    Retry(conn, response, attempt, "GET");
+    SendReadRequest(request);
+  }
+}
+
+void CHttpImageStream::DiscardReadAhead()
+{
+  // the blocks on the way are dropped with their connections
+  while (!fReadRequests.empty()) {
+    CloseConnection(fConnections[fReadRequests.front().connection]);
+    fReadRequests.pop_front();
+  }
+  fReadLength = 0;
+}
@@ -0,0 +1,173 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __HTTPIMAGESTREAM_H__
+#define __HTTPIMAGESTREAM_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include "IImageStream.h"
+#include "NetSocket.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Subclass reading and writing an image stored as object of an HTTP server, e.g. an S3
+// compatible object storage. The name of the image is http://host[:port]/path. Requests are
+// not signed, the object storage must grant access to the client by other means.
+// Reading requests blocks of the object with ranged GETs on several connections, each
+// connection has one request on the way, the number of blocks requested ahead of the read
+// position grows while the image is read sequentially. Writing uploads the object with a
+// multipart upload: like an image written to standard output (see CStdImageStream) it is only
+// appended once Commit() was called, the data is sent in parts of a fixed size on several
+// connections, each part is kept until its upload succeeded. A request that fails because of
+// the connection or a temporary error of the server (408, 429, 5xx) is sent again on a new
+// connection. SetCompletedInformation() completes the upload, an upload that was not completed
+// is aborted by Close() and no object is created.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+class CHttpImageStream: public IImageStream
+{
+public:
+  CHttpImageStream(unsigned connectionCount = 8, unsigned blockSize = 4 * 1024 * 1024,
+                   unsigned partSize = 8 * 1024 * 1024);
+  virtual ~CHttpImageStream();
+
+  // true if name is the name of an HTTP image (starts with http:// or https://, the
+  // latter is refused by Open())
+  static bool IsHttpName(LPCWSTR name);
+
+  virtual LPCWSTR GetName() const {
+    return fName.c_str();
+  }
+  virtual void Open(LPCWSTR name, TOpenMode mode);
+  virtual void Close();
+  virtual unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
+  virtual void Seek(__int64 offset, DWORD moveMethod);
+  virtual unsigned __int64 GetSize() const;
+  virtual unsigned __int64 GetAllocatedBytes() const {
+    return GetSize();
+  }
+  virtual bool IsDrive() const {
+    return false;
+  }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const {
+    return NULL;
+  }
+  // writing: upload the rest and complete the upload
+  virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes);
+
+  // writing: data before the end can not change any more, from now on data is only appended.
+  // expectedSize is the largest size the image can get, parts are made large enough that it
+  // fits into the number of parts S3 allows
+  void Commit(unsigned __int64 expectedSize);
+
+  unsigned GetConnectionCount() const {
+    return fConnectionCount;
+  }
+
+private:
+  typedef struct {
+    SOCKET socket;
+    int error;                // error of the last failed socket call
+    bool pending;             // a request was sent whose answer is not yet received
+    unsigned part;            // writing: number of the part on the way (from 1)
+    std::vector<BYTE> data;   // writing: data of the part on the way
+  } TConnection;
+
+  typedef struct {
+    unsigned connection;
+    unsigned __int64 offset;
+    unsigned length;
+  } TReadRequest;
+
+  typedef struct {
+    int status;
+    std::string reason;
+    std::map<std::string, std::string> headers;  // names in lower case
+    std::string body;
+    bool keepAlive;
+  } TResponse;
+
+  void ParseName();
+  void CloseConnections();
+  void CloseConnection(TConnection& conn);
+  std::string NewRequest(const char* method, const std::string& query, const std::string& headers,
+                         unsigned __int64 contentLength) const;
+  bool Send(TConnection& conn, const std::string& request, const void* body, size_t length);
+  bool Receive(TConnection& conn, void* buffer, size_t length);
+  bool ReceiveLine(TConnection& conn, std::string& line);
+  bool ReceiveResponseHeader(TConnection& conn, TResponse& response);
+  bool ReceiveResponseBody(TConnection& conn, TResponse& response);
+  bool ReceiveResponse(TConnection& conn, TResponse& response, bool hasBody);
+  void Retry(TConnection& conn, const TResponse& response, unsigned& attempt, const char* method);
+  void ThrowStatusError(const TResponse& response, const char* method);
+  void Exchange(TConnection& conn, const char* method, const std::string& query, const std::string& body,
+                TResponse& response);
+  // writing
+  void SendPartRequest(TConnection& conn);
+  void SendPart();
+  void FinishPart(TConnection& conn);
+  void CompleteUpload();
+  void AbortUpload();
+  // reading
+  void FillReadBlock();
+  void RequestReadAhead();
+  void SendReadRequest(const TReadRequest& request);
+  void ReceiveReadBlock();
+  void DiscardReadAhead();
+
+  std::wstring       fName;
+  std::string        fHost;
+  std::string        fPort;
+  std::string        fPath;     // path of the object with query characters escaped (UTF-8)
+  TOpenMode          fOpenMode;
+  unsigned           fConnectionCount;
+  unsigned           fBlockSize;
+  unsigned           fPartSize;
+  std::vector<TConnection> fConnections;
+  unsigned           fNextConnection;
+  unsigned __int64   fPosition;
+  unsigned __int64   fSize;     // reading: size of the object
+  // writing
+  std::string        fUploadId;
+  std::vector<BYTE>  fBuffer;   // data not sent yet, starts at fWritten
+  bool               fCommitted;
+  bool               fCompleted;
+  unsigned __int64   fWritten;  // bytes sent in parts
+  std::vector<std::string> fETags;  // ETag of each part uploaded
+  // reading
+  std::deque<TReadRequest> fReadRequests;  // requests sent, in order of offset
+  std::vector<BYTE>  fReadBlock;
+  unsigned __int64   fReadOffset;
+  unsigned           fReadLength;
+  unsigned __int64   fReadAheadEnd;  // end of the data requested so far
+  unsigned           fReadAhead;     // number of blocks to request ahead
+};
+
+#endif
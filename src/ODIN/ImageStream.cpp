@@ -27,6 +27,13 @@
 #include "InternalException.h"
 #include "FileFormatException.h"
 #include "CompressedRunLengthStream.h"
+#include "BlockManifest.h"
+#include "BlockHashTable.h"
+#include "MediaHash.h"
+#include "NetImageStream.h"
+#include "NetCastStream.h"
+#include "StdImageStream.h"
+#include "HttpImageStream.h"
 #include <vector>
 
 #ifdef DEBUG
@@ -45,12 +52,24 @@ CFileImageStream::CFileImageStream()
   fSize = fPosition = fCrc32 = fFileCount = 0;
   fAllocMapReader = NULL;
   fCallback = NULL;
+  fBlockManifest = NULL;
+  fBlockHashes = NULL;
+  fMediaHash = NULL;
+  fNetStream = NULL;
+  fStdStream = NULL;
+  fHttpStream = NULL;
 }
 
 CFileImageStream::~CFileImageStream()
 {
-  Close();
+  try {
+    Close();
+  } catch (Exception&) {
+    // errors of a network image are reported by SetCompletedInformation()
+  }
   delete fAllocMapReader;
+  delete fNetStream;
+  DeleteAllocationMapSpool();
 }
 
 void CFileImageStream::Open(LPCWSTR name, TOpenMode mode)
@@ -60,7 +79,35 @@ void CFileImageStream::Open(LPCWSTR name, TOpenMode mode)
   DWORD createMode = (mode==forWriting?OPEN_ALWAYS:OPEN_EXISTING); 
   // note: use OPEN_ALWAYS and not CREATE_ALWAYS because file header is written later in an existing file!
   fOpenMode = mode;
-  if (name) {
+  if (name && CStdImageStream::IsStdName(name)) {
+    fFileName = name;
+    fStdStream = new CStdImageStream();
+    fNetStream = fStdStream;
+    fNetStream->Open(name, mode);
+    // the header at the start can not be rewritten, the final one follows the data
+    if (mode == forWriting)
+      fImageHeader.SetTrailerLength(sizeof(DWORD) + fImageHeader.GetHeaderFileLength());
+  } else if (name && (CNetImageStream::IsNetName(name) || CNetCastStream::IsCastName(name) ||
+                      CHttpImageStream::IsHttpName(name))) {
+    fFileName = name;
+    if (CNetCastStream::IsCastName(name))
+      fNetStream = new CNetCastStream();
+    else if (CHttpImageStream::IsHttpName(name))
+      fNetStream = fHttpStream = new CHttpImageStream();
+    else
+      fNetStream = new CNetImageStream();
+    try {
+      fNetStream->Open(name, mode);
+    } catch (Exception&) {
+      delete fNetStream;
+      fNetStream = NULL;
+      fHttpStream = NULL;
+      throw;
+    }
+    // an object on an HTTP server is uploaded in order like standard output
+    if (fHttpStream && mode == forWriting)
+      fImageHeader.SetTrailerLength(sizeof(DWORD) + fImageHeader.GetHeaderFileLength());
+  } else if (name) {
     fFileName = name;
     fHandle = CreateFile(name, access, shareMode, NULL, createMode, FILE_ATTRIBUTE_NORMAL, NULL);
     CHECK_OS_EX_HANDLE_PARAM1(fHandle, EWinException::fileOpenError, fFileName.c_str());
@@ -69,6 +116,8 @@ void CFileImageStream::Open(LPCWSTR name, TOpenMode mode)
 
 void CFileImageStream::Close()
 {
+  if (fNetStream)
+    fNetStream->Close();
   if (fHandle != NULL && fHandle != INVALID_HANDLE_VALUE) {
     int res = CloseHandle(fHandle);  
     CHECK_OS_EX_INFO(res, EWinException::closeHandleError);
@@ -109,6 +158,11 @@ void CFileImageStream::Seek(__int64 offset, DWORD moveMethod)
 
 void CFileImageStream::ReadIntern(void * buffer, unsigned nLength, unsigned *nBytesRead)
 {
+  if (fNetStream) {
+    fNetStream->Read(buffer, nLength, nBytesRead);
+    fPosition = fNetStream->GetPosition();
+    return;
+  }
   BOOL bSuccess = ReadFile(fHandle, buffer, nLength, (DWORD *)nBytesRead, NULL) != FALSE;
   CHECK_OS_EX_PARAM1(bSuccess, EWinException::readFileError, fFileName.c_str());
   fPosition += *nBytesRead;
@@ -120,7 +174,12 @@ void CFileImageStream::WriteIntern(void *buffer, unsigned nLength, unsigned *nBy
   BOOL bSuccess;
   unsigned nWrote;
 
-  bSuccess = WriteFile(fHandle, buffer, nLength, (unsigned long *)&nWrote, NULL) != FALSE;
+  if (fNetStream) {
+    fNetStream->Write(buffer, nLength, nBytesWritten);
+    fPosition = fNetStream->GetPosition();
+    return;
+  }
+  bSuccess = WriteFile(fHandle, buffer, nLength, (DWORD *)&nWrote, NULL) != FALSE;
   CHECK_OS_EX_PARAM1(bSuccess, EWinException::writeFileError, fFileName.c_str());
   fPosition += nWrote;
   *nBytesWritten = nWrote;
@@ -131,17 +190,34 @@ void CFileImageStream::SeekIntern(__int64 offset, DWORD moveMethod)
   BOOL bSuccess;   
   LARGE_INTEGER pos, newOffset;
   
+  if (fNetStream) {
+    fNetStream->Seek(offset, moveMethod);
+    fPosition = fNetStream->GetPosition();
+    return;
+  }
   pos.QuadPart = offset;
   bSuccess = SetFilePointerEx(fHandle, pos, &newOffset, moveMethod);
   CHECK_OS_EX_PARAM1(bSuccess, EWinException::seekError, fFileName.c_str());
   fPosition = newOffset.QuadPart;
 }
 
+void CFileImageStream::Truncate(unsigned __int64 length)
+{
+  ATLASSERT(fNetStream == NULL);
+  SeekIntern(length, FILE_BEGIN);
+  BOOL bSuccess = SetEndOfFile(fHandle);
+  CHECK_OS_EX_PARAM1(bSuccess, EWinException::writeFileError, fFileName.c_str());
+}
 
 void CFileImageStream::ReadImageFileHeader(bool readAllocMap)
 {
-  fImageHeader.ReadHeaderFromFile(fHandle);
+  ReadHeader();
   CheckIfInfoFromFileHeaderIsSupported();
+  // the final header of an image written as a stream is at its end
+  if (fImageHeader.GetTrailerLength() > 0 && !fStdStream) {
+    ReadTrailerHeader();
+    CheckIfInfoFromFileHeaderIsSupported();
+  }
 
   unsigned __int64 clusterBitmapOffset, clusterBitmapLength;
   fUsedSize = fImageHeader.GetVolumeUsedSize();
@@ -150,11 +226,17 @@ void CFileImageStream::ReadImageFileHeader(bool readAllocMap)
   if (readAllocMap) {
     fImageHeader.GetClusterBitmapOffsetAndLength(clusterBitmapOffset, clusterBitmapLength);
     if (clusterBitmapOffset != 0 && clusterBitmapLength != 0) {
-      fAllocMapReader = new CompressedRunLengthStreamReader(fFileName.c_str(), clusterBitmapOffset, (DWORD)clusterBitmapLength);
+      if (fNetStream)
+        SpoolNetAllocationMap(clusterBitmapOffset, clusterBitmapLength);
+      fAllocMapReader = NewRunLengthStreamReader();
     }
   }
-  ReadCrc32Checksum();
+  // the checksum of an image read from standard input may follow the volume data
+  if (!IsChecksumPending())
+    ReadCrc32Checksum();
   ReadComment();
+  if (fStdStream)
+    fStdStream->SetDataArea(fImageHeader.GetVolumeDataOffset(), fImageHeader.GetTrailerLength());
 }
 
 void CFileImageStream::CheckIfInfoFromFileHeaderIsSupported()
@@ -179,7 +261,7 @@ void CFileImageStream::WriteImageFileHeaderAndAllocationMap(CDiskImageStream* vo
   unsigned __int64 volumeBitmapOffset = 0;
 
   // first write a default file header
-  fImageHeader.WriteHeaderToFile(fHandle);
+  WriteHeader();
   Seek(0, FILE_END);
   fImageHeader.SetVerifyFormat(CImageFileHeader::verifyCRC32);
   fImageHeader.SetCompressionFormat(fCompressionFormat);
@@ -189,7 +271,10 @@ void CFileImageStream::WriteImageFileHeaderAndAllocationMap(CDiskImageStream* vo
   WriteComment();
   volumeBitmapOffset = fPosition; 
   if (volumeImageStore) {
-    allocMapLength = volumeImageStore->StoreVolumeBitmap(cReadChunkSize, fHandle, fFileName.c_str());
+    if (fNetStream)
+      allocMapLength = StoreNetVolumeBitmap(volumeImageStore, cReadChunkSize);
+    else
+      allocMapLength = volumeImageStore->StoreVolumeBitmap(cReadChunkSize, fHandle, fFileName.c_str());
     fImageHeader.SetVolumeBitmapInfo(CImageFileHeader::simpleCompressedRunLength, volumeBitmapOffset, allocMapLength);
     usedSize  = volumeImageStore->GetAllocatedBytes();
   }
@@ -198,13 +283,10 @@ void CFileImageStream::WriteImageFileHeaderAndAllocationMap(CDiskImageStream* vo
   fImageHeader.SetVolumeUsedSize(usedSize);
   fImageHeader.SetClusterSize(volumeImageStore->GetBytesPerCluster());
   // now write file header again after all information is complete
-  fImageHeader.WriteHeaderToFile(fHandle);
+  WriteHeader();
+  CommitWrittenInOrder();
 
-  // update fPosition to file position
-  LARGE_INTEGER pos, curPos;
-  pos.QuadPart = 0LL;
-  BOOL ok = SetFilePointerEx(fHandle, pos, &curPos, FILE_CURRENT);
-  fPosition = curPos.QuadPart;
+  UpdatePosition();
 }
 
 void CFileImageStream::WriteImageFileHeaderForSaveAllBlocks(unsigned __int64 volumeSize, unsigned bytesPerCluster)
@@ -213,7 +295,7 @@ void CFileImageStream::WriteImageFileHeaderForSaveAllBlocks(unsigned __int64 vol
   unsigned __int64 dataOffset;
 
   // first write a default file header
-  fImageHeader.WriteHeaderToFile(fHandle);
+  WriteHeader();
   Seek(0, FILE_END);
   fImageHeader.SetVerifyFormat(CImageFileHeader::verifyCRC32);
   fImageHeader.SetCompressionFormat(fCompressionFormat);
@@ -228,13 +310,63 @@ void CFileImageStream::WriteImageFileHeaderForSaveAllBlocks(unsigned __int64 vol
   fImageHeader.SetVolumeUsedSize(volumeSize);
   fImageHeader.SetClusterSize(bytesPerCluster);
   // now write file header again after all information is complete
-  fImageHeader.WriteHeaderToFile(fHandle);
+  WriteHeader();
+  CommitWrittenInOrder();
 
-  // update fPosition to file position
-  LARGE_INTEGER pos, curPos;
-  pos.QuadPart = 0LL;
-  BOOL ok = SetFilePointerEx(fHandle, pos, &curPos, FILE_CURRENT);
-  fPosition = curPos.QuadPart;
+  UpdatePosition();
+}
+
+void CFileImageStream::WriteImageFileHeaderFromImage(CFileImageStream& sourceImage)
+{
+  const unsigned cCopyChunkSize = 2 * 1024 * 1024;
+  const CImageFileHeader& sourceHeader = sourceImage.GetImageFileHeader();
+  unsigned __int64 sourceBitmapOffset, allocMapLength, volumeBitmapOffset;
+  unsigned bytesRead, bytesWritten;
+
+  // first write a default file header
+  WriteHeader();
+  Seek(0, FILE_END);
+  fImageHeader.SetVerifyFormat(CImageFileHeader::verifyCRC32);
+  fImageHeader.SetCompressionFormat(fCompressionFormat);
+  fImageHeader.SetVerifyOffsetAndLength(fPosition, sizeof(DWORD));
+  fImageHeader.SetVolumeType(sourceHeader.GetVolumeType());
+  WriteCrc32Checksum(0); // dummy value just to reserve space at position in file
+  fComment = sourceImage.GetComment();
+  WriteComment();
+
+  // copy allocation map, it does not depend on the compression of the data
+  volumeBitmapOffset = fPosition;
+  sourceHeader.GetClusterBitmapOffsetAndLength(sourceBitmapOffset, allocMapLength);
+  if (sourceHeader.GetVolumeEncoding() != CImageFileHeader::noVolumeBitmap && allocMapLength > 0) {
+    std::vector<BYTE> buffer((size_t) min((unsigned __int64) cCopyChunkSize, allocMapLength));
+    unsigned __int64 remaining = allocMapLength;
+    sourceImage.Seek(sourceBitmapOffset, FILE_BEGIN);
+    while (remaining > 0) {
+      unsigned count = (unsigned) min((unsigned __int64) buffer.size(), remaining);
+      sourceImage.Read(&buffer[0], count, &bytesRead);
+      if (bytesRead != count)
+        THROW_FILEFORMAT_EXC(EFileFormatException::wrongFileSizeError);
+      Write(&buffer[0], count, &bytesWritten);
+      if (bytesWritten != count)
+        THROW_INT_EXC(EInternalException::wrongWriteSize);
+      remaining -= count;
+    }
+    fImageHeader.SetVolumeBitmapInfo(sourceHeader.GetVolumeEncoding(), volumeBitmapOffset, allocMapLength);
+  } else {
+    allocMapLength = 0;
+    fImageHeader.SetVolumeBitmapInfo(CImageFileHeader::noVolumeBitmap, 0, 0);
+  }
+  fImageHeader.SetVolumeSize(sourceHeader.GetVolumeSize());
+  fImageHeader.SetVolumeDataOffset(volumeBitmapOffset + allocMapLength);
+  fImageHeader.SetVolumeUsedSize(sourceHeader.GetVolumeUsedSize());
+  fImageHeader.SetClusterSize(sourceHeader.GetClusterSize());
+  // the volume content is the same, so are its digests
+  fImageHeader.SetMediaHash(sourceHeader.GetMediaHashScheme(), sourceHeader.GetMediaHashSha1(), sourceHeader.GetMediaHashSha256());
+  // now write file header again after all information is complete
+  WriteHeader();
+  CommitWrittenInOrder();
+
+  UpdatePosition();
 }
 
 void CFileImageStream::WriteCrc32Checksum(DWORD crc32) {
@@ -253,13 +385,14 @@ void CFileImageStream::WriteCrc32Checksum(DWORD crc32) {
 void CFileImageStream::WriteComment() {
   unsigned byteCount = 0;
   unsigned __int64 pos;
-  LPCWSTR buffer = fComment.c_str();
-  unsigned commentLenBytes = (unsigned) (fComment.length() * sizeof(fComment[0]));
+  std::vector<BYTE> buffer;
 
   if (!fComment.empty()) {
+    CImageFileHeader::EncodeString(fComment, buffer);
+    unsigned commentLenBytes = (unsigned) buffer.size();
     Seek(0, FILE_END);
     pos = fPosition;
-    Write((void*)buffer, commentLenBytes, &byteCount);
+    Write(&buffer[0], commentLenBytes, &byteCount);
     Seek(0, FILE_END);
     fImageHeader.SetComment(pos, commentLenBytes);  
   }
@@ -284,7 +417,7 @@ void CFileImageStream::ReadComment() {
 
   if (count != length)
     THROW_FILEFORMAT_EXC(EFileFormatException::wrongCommentLength);
-  fComment = std::wstring((LPCWSTR)buffer, length/sizeof(wchar_t));
+  fComment = CImageFileHeader::DecodeString(buffer, length);
   delete [] buffer;
 }
 
@@ -314,20 +447,335 @@ void CFileImageStream:: ReadCrc32Checksum() {
   delete [] buffer;
 }
 
+void CFileImageStream::ReadTrailerHeader() {
+  unsigned __int64 oldOffset;
+  unsigned headerLength = fImageHeader.GetHeaderFileLength();
+  std::vector<BYTE> buffer(headerLength);
+  unsigned count;
+
+  // save old file position
+  Seek(0, FILE_CURRENT);
+  oldOffset = fPosition;
+
+  Seek(-(__int64) headerLength, FILE_END);
+  Read(&buffer[0], headerLength, &count);
+  // restore old file position
+  Seek(oldOffset, FILE_BEGIN);
+
+  if (count != headerLength)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongFileSizeError);
+  fImageHeader.ReadHeaderFromBuffer(&buffer[0]);
+}
+
+DWORD CFileImageStream::GetCrc32Checksum() const {
+  std::vector<BYTE> trailer;
+
+  if (IsChecksumPending() && fStdStream->GetTrailer(trailer))
+    return *(DWORD*) &trailer[0];
+  return fCrc32;
+}
+
+bool CFileImageStream::IsChecksumPending() const {
+  return fStdStream != NULL && fOpenMode == forReading && fImageHeader.GetTrailerLength() > 0;
+}
+
+void CFileImageStream::WriteBlockManifest(unsigned __int64 offset) {
+  std::vector<BYTE> buffer;
+  unsigned byteCount = 0;
+
+  fBlockManifest->Finish();
+  fBlockManifest->Serialize(buffer);
+  Seek(offset, FILE_BEGIN);
+  Write(&buffer[0], (unsigned)buffer.size(), &byteCount);
+  if (byteCount != buffer.size())
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  fImageHeader.SetBlockManifestInfo(CImageFileHeader::blockManifestCRC32C, offset, buffer.size(),
+    fBlockManifest->GetBlockSize());
+}
+
+bool CFileImageStream::ReadBlockManifest(CBlockManifest& manifest) {
+  unsigned __int64 oldOffset, offset, length;
+  DWORD blockSize;
+  unsigned count;
+
+  // standard input can not be read behind the volume data
+  if (!fImageHeader.HasBlockManifest() || !fImageHeader.IsSupportedBlockManifestFormat() || fStdStream)
+    return false;
+  fImageHeader.GetBlockManifestInfo(offset, length, blockSize);
+  if (length > 0xFFFFFFFFULL)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  std::vector<BYTE> buffer((size_t)length);
+
+  // save old file position
+  Seek(0, FILE_CURRENT);
+  oldOffset = fPosition;
+
+  Seek(offset, FILE_BEGIN);
+  Read(&buffer[0], (unsigned)length, &count);
+  // restore old file position
+  Seek(oldOffset, FILE_BEGIN);
+
+  if (count != length)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  manifest.Deserialize(&buffer[0], length);
+  if (manifest.GetBlockSize() != blockSize)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockManifest);
+  return true;
+}
+
+void CFileImageStream::WriteBlockHashTable(unsigned __int64 offset) {
+  std::vector<BYTE> buffer;
+  unsigned byteCount = 0;
+
+  fBlockHashes->Serialize(buffer);
+  Seek(offset, FILE_BEGIN);
+  Write(&buffer[0], (unsigned)buffer.size(), &byteCount);
+  if (byteCount != buffer.size())
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+  fImageHeader.SetBlockHashInfo(fBlockHashes->IsIncremental() ? CImageFileHeader::imageIncremental : CImageFileHeader::imageFull,
+    CImageFileHeader::blockHashSHA256, offset, buffer.size());
+}
+
+bool CFileImageStream::ReadBlockHashTable(CBlockHashTable& hashes) {
+  unsigned __int64 oldOffset, offset, length;
+  unsigned count;
+
+  if (!fImageHeader.HasBlockHashTable() || !fImageHeader.IsSupportedBlockHashFormat() || fStdStream)
+    return false;
+  fImageHeader.GetBlockHashInfo(offset, length);
+  if (length > 0xFFFFFFFFULL)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  std::vector<BYTE> buffer((size_t)length);
+
+  // save old file position
+  Seek(0, FILE_CURRENT);
+  oldOffset = fPosition;
+
+  Seek(offset, FILE_BEGIN);
+  Read(&buffer[0], (unsigned)length, &count);
+  // restore old file position
+  Seek(oldOffset, FILE_BEGIN);
+
+  if (count != length)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  hashes.Deserialize(&buffer[0], length);
+  if ((fImageHeader.GetImageType() == CImageFileHeader::imageIncremental) != hashes.IsIncremental())
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongBlockHashTable);
+  return true;
+}
+
 IRunLengthStreamReader* CFileImageStream::GetRunLengthStreamReader() const {
   return fAllocMapReader;
 }
 
+CompressedRunLengthStreamReader* CFileImageStream::NewRunLengthStreamReader() const {
+  unsigned __int64 offset, length;
+
+  fImageHeader.GetClusterBitmapOffsetAndLength(offset, length);
+  if (!fAllocMapSpool.empty())
+    return new CompressedRunLengthStreamReader(fAllocMapSpool.c_str(), 0, (DWORD) length);
+  return new CompressedRunLengthStreamReader(fFileName.c_str(), offset, (DWORD) length);
+}
+
 void CFileImageStream::SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes)
 {
+  if (IsWrittenInOrder()) {
+    WriteTrailer(crc32, processedBytes);
+    // the upload to an HTTP server is completed here and not when the image is closed
+    if (fHttpStream)
+      fHttpStream->SetCompletedInformation(crc32, processedBytes);
+    return;
+  }
+  unsigned __int64 trailerOffset = fImageHeader.GetVolumeDataOffset() + processedBytes;
+
   WriteCrc32Checksum(crc32);
+  if (fBlockManifest) {
+    WriteBlockManifest(trailerOffset);
+    trailerOffset += fBlockManifest->GetSerializedLength();
+  }
+  if (fBlockHashes)
+    WriteBlockHashTable(trailerOffset);
+  if (fMediaHash)
+    fImageHeader.SetMediaHash(fMediaHash->GetAlgorithms() | fMediaHash->GetScope(), fMediaHash->GetSha1Digest(), fMediaHash->GetSha256Digest());
   fImageHeader.SetDataSize(processedBytes);
   fImageHeader.SetFileCount(fFileCount);
   Seek(0, FILE_BEGIN);
-  fImageHeader.WriteHeaderToFile(fHandle);
+  WriteHeader();
   Seek(0, FILE_END);
+  // errors of the image server are reported here and not when the image is closed
+  if (fNetStream)
+    fNetStream->SetCompletedInformation(crc32, processedBytes);
+}
+
+void CFileImageStream::WriteTrailer(DWORD crc32, unsigned __int64 processedBytes)
+{
+  std::vector<BYTE> buffer(fImageHeader.GetTrailerLength());
+  unsigned byteCount = 0;
+
+  // standard output and uploads can not be rewritten, checksum and final header follow the
+  // volume data, there is no block manifest (the hash table is needed by incremental images only)
+  if (fBlockHashes && fBlockHashes->IsIncremental())
+    THROW_INT_EXC(fHttpStream ? EInternalException::httpImageNotSupported : EInternalException::stdImageNotSupported);
+  if (fMediaHash)
+    fImageHeader.SetMediaHash(fMediaHash->GetAlgorithms() | fMediaHash->GetScope(), fMediaHash->GetSha1Digest(), fMediaHash->GetSha256Digest());
+  fImageHeader.SetVerifyOffsetAndLength(fImageHeader.GetVolumeDataOffset() + processedBytes, sizeof(DWORD));
+  fImageHeader.SetDataSize(processedBytes);
+  fImageHeader.SetFileCount(fFileCount);
+  memcpy(&buffer[0], &crc32, sizeof(crc32));
+  fImageHeader.WriteHeaderToBuffer(&buffer[sizeof(crc32)]);
+  Seek(0, FILE_END);
+  Write(&buffer[0], (unsigned) buffer.size(), &byteCount);
+  if (byteCount != buffer.size())
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+}
+
+bool CFileImageStream::IsWrittenInOrder() const
+{
+  return fStdStream != NULL || (fHttpStream != NULL && fOpenMode == forWriting);
+}
+
+void CFileImageStream::CommitWrittenInOrder()
+{
+  // what follows the header, checksum, comment and allocation map is written in order
+  if (fStdStream)
+    fStdStream->Commit();
+  if (fHttpStream)
+    fHttpStream->Commit(fImageHeader.GetVolumeDataOffset() + fImageHeader.GetVolumeSize() +
+                        fImageHeader.GetTrailerLength());
 }
 
+void CFileImageStream::WriteHeader()
+{
+  CheckNetImageSupported();
+  if (fNetStream)
+    fImageHeader.WriteHeaderToStream(fNetStream);
+  else
+    fImageHeader.WriteHeaderToFile(fHandle);
+}
+
+void CFileImageStream::ReadHeader()
+{
+  if (fNetStream)
+    fImageHeader.ReadHeaderFromStream(fNetStream);
+  else
+    fImageHeader.ReadHeaderFromFile(fHandle);
+  CheckNetImageSupported();
+}
+
+void CFileImageStream::UpdatePosition()
+{
+  // update fPosition to file position
+  if (fNetStream) {
+    fPosition = fNetStream->GetPosition();
+  } else {
+    LARGE_INTEGER pos, curPos;
+    pos.QuadPart = 0LL;
+    BOOL ok = SetFilePointerEx(fHandle, pos, &curPos, FILE_CURRENT);
+    fPosition = curPos.QuadPart;
+  }
+}
+
+void CFileImageStream::CheckNetImageSupported()
+{
+  // the chunk store of a deduplicated image and the files of a split image are local files
+  bool isChunkStore = fOpenMode == forWriting ? fCompressionFormat == compressionChunkStore
+                                              : fImageHeader.GetCompressionFormat() == compressionChunkStore;
+  bool isIncremental = fOpenMode == forReading && fImageHeader.GetImageType() == CImageFileHeader::imageIncremental;
+  if (fStdStream && (isChunkStore || isIncremental || fCallback != NULL))
+    THROW_INT_EXC(EInternalException::stdImageNotSupported);
+  if (fHttpStream && (isChunkStore || fCallback != NULL))
+    THROW_INT_EXC(EInternalException::httpImageNotSupported);
+  if (fNetStream && (isChunkStore || fCallback != NULL))
+    THROW_INT_EXC(EInternalException::netImageNotSupported);
+}
+
+void CFileImageStream::CreateAllocationMapSpool()
+{
+  wchar_t tempDir[MAX_PATH], tempName[MAX_PATH];
+
+  DWORD len = GetTempPath(MAX_PATH, tempDir);
+  CHECK_OS_EX_PARAM1((len > 0 && len < MAX_PATH), EWinException::generalFileError, L"TEMP");
+  UINT ok = GetTempFileName(tempDir, L"odn", 0, tempName);
+  CHECK_OS_EX_PARAM1(ok, EWinException::generalFileError, tempDir);
+  fAllocMapSpool = tempName;
+}
+
+void CFileImageStream::DeleteAllocationMapSpool()
+{
+  // readers of the allocation map may still have it open, then it stays in the temp directory
+  if (!fAllocMapSpool.empty()) {
+    DeleteFile(fAllocMapSpool.c_str());
+    fAllocMapSpool.clear();
+  }
+}
+
+unsigned __int64 CFileImageStream::StoreNetVolumeBitmap(CDiskImageStream* volumeImageStore, unsigned int chunkSize)
+{
+  const unsigned cCopyChunkSize = 2 * 1024 * 1024;
+  unsigned __int64 allocMapLength;
+  unsigned bytesWritten;
+  DWORD bytesRead;
+
+  // the volume writes the allocation map to a file and reads it from there again later
+  CreateAllocationMapSpool();
+  HANDLE spool = CreateFile(fAllocMapSpool.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                            NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK_OS_EX_HANDLE_PARAM1(spool, EWinException::fileOpenError, fAllocMapSpool.c_str());
+  try {
+    allocMapLength = volumeImageStore->StoreVolumeBitmap(chunkSize, spool, fAllocMapSpool.c_str());
+    std::vector<BYTE> buffer(cCopyChunkSize);
+    LARGE_INTEGER pos;
+    pos.QuadPart = 0LL;
+    BOOL ok = SetFilePointerEx(spool, pos, NULL, FILE_BEGIN);
+    CHECK_OS_EX_PARAM1(ok, EWinException::seekError, fAllocMapSpool.c_str());
+    for (unsigned __int64 remaining = allocMapLength; remaining > 0; remaining -= bytesRead) {
+      ok = ReadFile(spool, &buffer[0], (DWORD) min((unsigned __int64) cCopyChunkSize, remaining), &bytesRead, NULL);
+      CHECK_OS_EX_PARAM1(ok, EWinException::readFileError, fAllocMapSpool.c_str());
+      if (bytesRead == 0)
+        THROW_INT_EXC(EInternalException::wrongReadSize);
+      Write(&buffer[0], bytesRead, &bytesWritten);
+    }
+  } catch (...) {
+    CloseHandle(spool);
+    throw;
+  }
+  CloseHandle(spool);
+  return allocMapLength;
+}
+
+void CFileImageStream::SpoolNetAllocationMap(unsigned __int64 offset, unsigned __int64 length)
+{
+  const unsigned cCopyChunkSize = 2 * 1024 * 1024;
+  unsigned __int64 oldOffset = fPosition;
+  unsigned bytesRead;
+  DWORD bytesWritten;
+
+  // the allocation map is read by file name (see NewRunLengthStreamReader())
+  CreateAllocationMapSpool();
+  HANDLE spool = CreateFile(fAllocMapSpool.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK_OS_EX_HANDLE_PARAM1(spool, EWinException::fileOpenError, fAllocMapSpool.c_str());
+  try {
+    std::vector<BYTE> buffer(cCopyChunkSize);
+    Seek(offset, FILE_BEGIN);
+    for (unsigned __int64 remaining = length; remaining > 0; remaining -= bytesRead) {
+      Read(&buffer[0], (unsigned) min((unsigned __int64) cCopyChunkSize, remaining), &bytesRead);
+      if (bytesRead == 0)
+        THROW_FILEFORMAT_EXC(EFileFormatException::wrongFileSizeError);
+      BOOL ok = WriteFile(spool, &buffer[0], bytesRead, &bytesWritten, NULL);
+      CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fAllocMapSpool.c_str());
+    }
+  } catch (...) {
+    CloseHandle(spool);
+    throw;
+  }
+  CloseHandle(spool);
+  Seek(oldOffset, FILE_BEGIN);
+}
+
+// drives and volumes of Windows, see posix/PosixDiskImageStream.cpp for POSIX systems
+#ifdef _WIN32
+
 #include <winioctl.h>
 #include "DriveUtil.h"
 /////////////////////////////////////////////////////////////////////////////////////
@@ -610,7 +1058,9 @@ void CDiskImageStream::Read(void * buffer, unsigned nLength, unsigned *nbytesRea
   BOOL bSuccess;
   DWORD nbytesReadTemp;
 
-  if ((unsigned __int64)nLength > fSize - fPosition) // we will read beyond end of partition--> results in error see above
+  // we will read beyond end of partition--> results in error see above
+  // (size is not known for devices opened for writing, e.g. read back of restored data)
+  if (fSize > 0 && (unsigned __int64)nLength > fSize - fPosition)
     nLength = (DWORD)(fSize - fPosition);
 
   bSuccess = ReadFile(fHandle, buffer, nLength, &nbytesReadTemp, NULL) != FALSE;
@@ -920,3 +1370,4 @@ void CSubVolumeLocker::CloseAndUnlockVolume(int index) {
   }
 }
 
+#endif
@@ -25,10 +25,15 @@
 #include <string>
 #include "IImageStream.h"
 #include "FileHeader.h"
-#include "compression.h"
+#include "Compression.h"
 
 class CDiskImageStream;
 class CompressedRunLengthStreamReader;
+class CBlockManifest;
+class CBlockHashTable;
+class CMediaHash;
+class CStdImageStream;
+class CHttpImageStream;
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Interface for implementing callbacks to file operations
@@ -49,6 +54,15 @@ public:
 
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // Subclass encapsulating reading/writing files containing ODIN images
+// A name odin://host[:port]/path is an image stored by an image server, it is read and
+// written with a CNetImageStream, odincast://host[:port]/path is an image cast by an
+// image server and read with a CNetCastStream. The name "-" is standard input or output, read
+// and written in order with a CStdImageStream: an image written to standard output has its
+// checksum and final header in a trailer behind the volume data. A name http://host[:port]/path
+// is an object on an HTTP server read and written with a CHttpImageStream, it is written in order
+// with a trailer as well. The allocation map of these
+// images is kept in a temporary file as well, because it is read by file name (see
+// NewRunLengthStreamReader()).
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
 class CFileImageStream : public IImageStream
@@ -79,6 +93,29 @@ class CFileImageStream : public IImageStream
   virtual IRunLengthStreamReader* GetRunLengthStreamReader() const;
   virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes);
 
+  // a new reader of the allocation map of an opened image, for threads that read it on their own
+  CompressedRunLengthStreamReader* NewRunLengthStreamReader() const;
+
+  bool IsNetImage() const {
+    return fNetStream != NULL && fStdStream == NULL && fHttpStream == NULL;
+  }
+
+  bool IsStdImage() const {
+    return fStdStream != NULL;
+  }
+
+  bool IsHttpImage() const {
+    return fHttpStream != NULL;
+  }
+
+  // true for an image in a file system, that can be truncated and continued
+  bool IsLocalFile() const {
+    return fNetStream == NULL;
+  }
+
+  // cut off the image file at length and continue writing there (not for network images)
+  void Truncate(unsigned __int64 length);
+
   bool inline  IsCompressed(void) const { 
 	  return (fCompressionFormat != noCompression); 
 	};
@@ -87,6 +124,11 @@ class CFileImageStream : public IImageStream
     fCompressionFormat = format;
   }
 
+  // the compression ends its stream at each checkpoint, the image is written with version 1.5
+  void SetMultiStream(bool multiStream) {
+    fImageHeader.SetMultiStream(multiStream);
+  }
+
 
   unsigned __int64 GetSize() const {
       return fSize;
@@ -118,9 +160,10 @@ class CFileImageStream : public IImageStream
 
   void WriteCrc32Checksum(DWORD crc32);
   
-  DWORD GetCrc32Checksum() const {
-    return fCrc32;
-  }
+  // the checksum of an image read from standard input is known after its volume data was read
+  DWORD GetCrc32Checksum() const;
+
+  bool IsChecksumPending() const;
 
   CImageFileHeader::VolumeFormat GetVolumeFormat() const {
     return fVolumeFormat;
@@ -138,6 +181,30 @@ class CFileImageStream : public IImageStream
     fCallback = NULL;
   }
 
+  // manifest that is filled while writing and stored behind the data area
+  // in SetCompletedInformation() (not owned by stream)
+  void SetBlockManifest(CBlockManifest* manifest) {
+    fBlockManifest = manifest;
+  }
+
+  // read the block manifest of an opened image, returns false if image has none
+  bool ReadBlockManifest(CBlockManifest& manifest);
+
+  // volume block digests that are filled while writing and stored behind the
+  // block manifest in SetCompletedInformation() (not owned by stream)
+  void SetBlockHashTable(CBlockHashTable* hashes) {
+    fBlockHashes = hashes;
+  }
+
+  // read the block hash table of an opened image, returns false if image has none
+  bool ReadBlockHashTable(CBlockHashTable& hashes);
+
+  // digests of the volume that are calculated while reading the volume and stored
+  // in the file header in SetCompletedInformation() (not owned by stream)
+  void SetMediaHash(const CMediaHash* hash) {
+    fMediaHash = hash;
+  }
+
   void SetFileCount(unsigned newFileCount) {
     fFileCount = newFileCount;
   }
@@ -150,6 +217,9 @@ class CFileImageStream : public IImageStream
   void ReadImageFileHeader(bool readAllocMap);
   void WriteImageFileHeaderAndAllocationMap(CDiskImageStream* volumeImageStore);
   void WriteImageFileHeaderForSaveAllBlocks(unsigned __int64 volumeSize, unsigned bytesPerCluster);
+  // write header, comment and allocation map of an image that gets the volume data of
+  // sourceImage in a different compression format
+  void WriteImageFileHeaderFromImage(CFileImageStream& sourceImage);
   void CheckIfInfoFromFileHeaderIsSupported();
   void ReadIntern(void * buffer, unsigned nLength, unsigned *nBytesRead);
   void WriteIntern(void *buffer, unsigned nLength, unsigned *nBytesWritten);
@@ -158,9 +228,23 @@ class CFileImageStream : public IImageStream
 
 private:
   unsigned __int64 StoreVolumeBitmap(unsigned int chunkSize, HANDLE hOutHandle);
+  void WriteHeader();
+  void ReadHeader();
+  void UpdatePosition();
+  unsigned __int64 StoreNetVolumeBitmap(CDiskImageStream* volumeImageStore, unsigned int chunkSize);
+  void SpoolNetAllocationMap(unsigned __int64 offset, unsigned __int64 length);
+  void CreateAllocationMapSpool();
+  void DeleteAllocationMapSpool();
+  void CheckNetImageSupported();
   void WriteComment();
   void ReadComment();
   void ReadCrc32Checksum();
+  void ReadTrailerHeader();
+  bool IsWrittenInOrder() const;
+  void CommitWrittenInOrder();
+  void WriteTrailer(DWORD crc32, unsigned __int64 processedBytes);
+  void WriteBlockManifest(unsigned __int64 offset);
+  void WriteBlockHashTable(unsigned __int64 offset);
 
 private:
   std::wstring       fFileName;
@@ -178,6 +262,13 @@ private:
   unsigned           fFileCount; // number of files the image file is split across
                                  // (information only used to store in header)
   CImageFileHeader::VolumeFormat fVolumeFormat; // type of image to be stored
+  CBlockManifest*    fBlockManifest; // per block checksums to store with image or NULL
+  CBlockHashTable*   fBlockHashes;   // per block volume digests to store with image or NULL
+  const CMediaHash*  fMediaHash;     // volume digests to store in header or NULL
+  IImageStream*      fNetStream;     // stream of an image on an image server, standard streams or HTTP or NULL
+  CStdImageStream*   fStdStream;     // fNetStream of an image on standard streams or NULL
+  CHttpImageStream*  fHttpStream;    // fNetStream of an image on an HTTP server or NULL
+  std::wstring       fAllocMapSpool; // temporary file with allocation map of a network image
   friend class CSplitManager;
 };
 
@@ -286,35 +377,6 @@ private:
   CSubVolumeLocker*  fSubVolumeLocker;     // object maintaining locks of volumes contained in a physical disk
 };
 
-//////////////////////////////////////////////////////////////////////////////////////////////////
-// Subclass encapsulating reading/writing files containing disk devices across a network
-// connection: not yet implemented
-//////////////////////////////////////////////////////////////////////////////////////////////////
-class CNetImageStream: public IImageStream
-{
-public:
-  
-  CNetImageStream()
-  {
-  }
-
-  virtual ~CNetImageStream()
-  {
-  }
-  
-  virtual LPCWSTR GetName() const;
-  virtual void Open(LPCWSTR name, TOpenMode mode);
-  virtual void Close();
-  virtual unsigned __int64 GetPosition() const;
-  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
-  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
-  virtual void Seek(__int64 Offset, DWORD MoveMethod);
-  virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes);
-  virtual bool IsDrive() { // true if volume or harddisk, false if file
-    return false;
-  }
-};
-
 //////////////////////////////////////////////////////////////////////////////////////////////////
 // A helper class used to lock/unlock all contained volumes of a physical disk
 // (used by CDiskImageStream)
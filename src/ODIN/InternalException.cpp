@@ -52,6 +52,34 @@ LPCWSTR EInternalException::sMessages[] = {
   L"Input/output error during read or write operation", // inputError
   L"LZ4 frame compression/decompression error", // lz4CompressError
   L"Zstandard (ZSTD) compression/decompression error", // zstdCompressError
+  L"Incremental images can only be created from mounted volumes when saving only used blocks", // incrementalNeedsUsedBlocks
+  L"A deduplicated image can not be transcoded to a deduplicated image", // transcodeDedupToDedup
+  L"Target was detached because it could not keep up with the other targets", // fanOutTargetTooSlow
+  L"Restoring to multiple drives failed for all drives", // fanOutNoTarget
+  L"An incremental image can not be restored to multiple drives at once", // fanOutIncremental
+  L"An image of an entire disk with several volumes can not be restored to multiple drives at once", // fanOutMultiVolume
+  L"Data read back from the target differ from the written data at offset {0}", // readBackMismatch
+  L"Read back verification can not be combined with a delta restore", // readBackWithDelta
+  L"An incremental image can not be compared with a drive", // compareIncremental
+  L"An image of an entire disk with several volumes can not be compared with a drive", // compareMultiVolume
+  L"The compression format is not available in this build of ODIN", // codecNotAvailable
+  L"The image server reported an error: {0}", // netServerError
+  L"Invalid message received from the image server", // netProtocolError
+  L"Invalid name of a network image: {0}, expected odin://host[:port]/path or odincast://host[:port]/path", // netAddressError
+  L"Deduplicated and split images can not be stored on an image server", // netImageNotSupported
+  L"An image cast by an image server can only be read", // netCastReadOnly
+  L"Incremental images can not be cast by an image server", // netCastIncremental
+  L"The volume data of an image cast by an image server can only be read in order", // netCastSeekError
+  L"Deduplicated, split and incremental images can not be read from or written to standard streams", // stdImageNotSupported
+  L"An image on standard input or output can only be read or written in order", // stdImageSeekError
+  L"The HTTP server answered {0}", // httpStatusError
+  L"Invalid answer received from the HTTP server", // httpProtocolError
+  L"Invalid name of an HTTP image: {0}, expected http://host[:port]/path (HTTPS is not supported)", // httpAddressError
+  L"Deduplicated, split and incremental images can not be stored on an HTTP server", // httpImageNotSupported
+  L"An image on an HTTP server can only be written in order and not be read while it is written", // httpSeekError
+  L"The checkpoint journal {0} is damaged or belongs to a different operation", // journalMismatch
+  L"Only backups and restores with checkpoints of local image files can be resumed, not of deduplicated, split or incremental images, delta restores or volume hashes", // resumeNotSupported
+  L"The operation was stopped because another part of it failed", // operationStopped
 };
 
 
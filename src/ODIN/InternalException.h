@@ -30,6 +30,7 @@
 
 // special exception classes for handling compression and decompression errors in libz and bzio2 lib.
 #define THROW_INT_EXC(error) throw EInternalException((error), __WFILE__, __LINE__)
+#define THROW_INT_EXC_PARAM1(error, param1) throw EInternalException((error), __WFILE__, __LINE__, (param1))
 
 class EInternalException : public Exception 
 {
@@ -38,7 +39,12 @@ class EInternalException : public Exception
     threadSyncTimeout, inputTypeNotSet, outputTypeNotSet, getChunkError, writeChunkError, wrongReadSize,
     wrongWriteSize, internalStringTableOverflow, chunkSizeTooSmall, maxPartitionNumberExceeded,
     unsupportedPartitionFormat, invalidBootSector, integerOverflow, threadSyncError, emptyBufferQueue, inputError,
-    lz4CompressError, zstdCompressError,
+    lz4CompressError, zstdCompressError, incrementalNeedsUsedBlocks, transcodeDedupToDedup,
+    fanOutTargetTooSlow, fanOutNoTarget, fanOutIncremental, fanOutMultiVolume, readBackMismatch,
+    readBackWithDelta, compareIncremental, compareMultiVolume, codecNotAvailable, netServerError,
+    netProtocolError, netAddressError, netImageNotSupported, netCastReadOnly, netCastIncremental, netCastSeekError,
+    stdImageNotSupported, stdImageSeekError, httpStatusError, httpProtocolError, httpAddressError,
+    httpImageNotSupported, httpSeekError, journalMismatch, resumeNotSupported, operationStopped,
   };
   
   EInternalException(int errCode) : 
@@ -55,6 +61,15 @@ class EInternalException : public Exception
       BuildMessageString();
     }
 
+  EInternalException(int errCode, LPCWSTR file, int line, LPCWSTR param1) : 
+    Exception(InternalException, file, line)
+    { 
+      const wchar_t* params[1] = { param1 };
+      fErrorCode = errCode;
+      BuildMessageString();
+      ExpandParameters(params, 1);
+    }
+
   int GetErrorCode() const
   {
     return fErrorCode;
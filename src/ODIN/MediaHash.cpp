@@ -0,0 +1,96 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "MediaHash.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CMediaHash
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static const unsigned sZeroBufferSize = 65536;
+
+CMediaHash::CMediaHash(unsigned algorithms, TScope scope)
+{
+  fAlgorithms = algorithms;
+  fScope = scope;
+  fPosition = 0;
+  memset(fSha1Digest, 0, sizeof(fSha1Digest));
+  memset(fSha256Digest, 0, sizeof(fSha256Digest));
+}
+
+void CMediaHash::AddData(const BYTE* pData, unsigned length)
+{
+  if (fAlgorithms & hashSha1)
+    fSha1.AddDataBlock(pData, length);
+  if (fAlgorithms & hashSha256)
+    fSha256.AddDataBlock(pData, length);
+  fPosition += length;
+}
+
+void CMediaHash::AddZeros(unsigned __int64 length)
+{
+  static const BYTE zeros[sZeroBufferSize] = { 0 };
+  if (fScope == scopeUsedClusters) {
+    fPosition += length;
+    return;
+  }
+  while (length > 0) {
+    unsigned count = length > sZeroBufferSize ? sZeroBufferSize : (unsigned) length;
+    AddData(zeros, count);
+    length -= count;
+  }
+}
+
+void CMediaHash::Finish(unsigned __int64 mediaSize)
+{
+  if (mediaSize > fPosition && fScope == scopeVolume)
+    AddZeros(mediaSize - fPosition);
+  if (fAlgorithms & hashSha1) {
+    fSha1.GetResult(fSha1Digest);
+    fSha1Result = ToHex(fSha1Digest, CSha1::sDigestLength);
+  }
+  if (fAlgorithms & hashSha256) {
+    fSha256.GetResult(fSha256Digest);
+    fSha256Result = ToHex(fSha256Digest, CSha256::sDigestLength);
+  }
+}
+
+wstring CMediaHash::ToHex(const BYTE* digest, unsigned length)
+{
+  static const wchar_t hexDigits[] = L"0123456789ABCDEF";
+  wstring result;
+  result.reserve(length * 2);
+  for (unsigned i=0; i<length; i++) {
+    result += hexDigits[digest[i] >> 4];
+    result += hexDigits[digest[i] & 0x0F];
+  }
+  return result;
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __MEDIAHASH_H__
+#define __MEDIAHASH_H__
+
+#include <string>
+#include "Sha1.h"
+#include "Sha256.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CMediaHash calculates SHA-1 and/or SHA-256 of the content a volume has after a
+// restore: the data of the image at their position on the volume up to the volume size.
+// Free clusters not stored in the image count as zeros. For images with all blocks this
+// is the content of the volume, so it can be compared to a hash calculated from the media.
+// With scopeUsedClusters only the data of the image are hashed, free clusters are skipped,
+// so a verify has to read only the used clusters from the media (see CPartitionHasher).
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CMediaHash
+{
+public:
+  // same values as CImageFileHeader::MediaHashFormat
+  enum { hashSha1 = 1, hashSha256 = 2 };
+  // what the digest covers, the used clusters flag of CImageFileHeader::MediaHashFormat
+  typedef enum { scopeVolume = 0, scopeUsedClusters = 4 } TScope;
+
+  // algorithms is a combination of hashSha1 and hashSha256
+  CMediaHash(unsigned algorithms, TScope scope = scopeVolume);
+
+  void AddData(const BYTE* pData, unsigned length);
+  // add length zero bytes for free clusters, with scopeUsedClusters they are only skipped
+  void AddZeros(unsigned __int64 length);
+  // finish the calculation, with scopeVolume the data are padded with zeros up to mediaSize
+  void Finish(unsigned __int64 mediaSize);
+
+  unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+
+  unsigned GetAlgorithms() const {
+    return fAlgorithms;
+  }
+
+  TScope GetScope() const {
+    return fScope;
+  }
+
+  // digest as upper case hex string, empty if not calculated or not finished
+  const std::wstring& GetSha1() const {
+    return fSha1Result;
+  }
+
+  const std::wstring& GetSha256() const {
+    return fSha256Result;
+  }
+
+  // raw digests, only valid after Finish() if the algorithm was calculated
+  const BYTE* GetSha1Digest() const {
+    return fSha1Digest;
+  }
+
+  const BYTE* GetSha256Digest() const {
+    return fSha256Digest;
+  }
+
+  static std::wstring ToHex(const BYTE* digest, unsigned length);
+
+private:
+  unsigned fAlgorithms;
+  TScope fScope;
+  unsigned __int64 fPosition;  // number of bytes added or skipped
+  BYTE fSha1Digest[CSha1::sDigestLength];
+  BYTE fSha256Digest[CSha256::sDigestLength];
+  CSha1 fSha1;
+  CSha256 fSha256;
+  std::wstring fSha1Result;
+  std::wstring fSha256Result;
+};
+
+#endif
@@ -41,6 +41,7 @@
 #include "PartitionInfoMgr.h"
 #include "ParamChecker.h"
 #include "UserFeedback.h"
+#include "InternalException.h"
 
 using namespace std;
 
@@ -182,6 +183,53 @@ void CMultiPartitionHandler::RestorePartitionOrDisk(int index, LPCWSTR fileName,
   odinMgr.Uncancel();
 }
 
+// restore one image to several drives at once, the image is read and decompressed only once
+void CMultiPartitionHandler::RestorePartitionToDrives(const std::vector<int>& indexes, LPCWSTR fileName, COdinManager &odinMgr,
+                                                      ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  unsigned fileCount = 0;
+  unsigned __int64 fileSize = 0;
+  wstring baseName = fileName;
+  bool isEntireDriveImagefile;
+
+  if (CFileNameUtil::TestIsHardDiskImage(fileName))
+    THROW_INT_EXC(EInternalException::fanOutMultiVolume);
+
+  CFileNameUtil::RemoveTrailingNumberFromFileName(baseName);
+  GetNoFilesAndFileSize(baseName.c_str(), cb, fileCount, fileSize, isEntireDriveImagefile);
+  if (fileCount == 0 && baseName != fileName)
+    baseName = fileName;
+
+  wcb->OnPartitionChange(0, 1);
+  odinMgr.RestorePartitionToDrives(baseName.c_str(), indexes, fileCount, fileSize, cb, wcb);
+  odinMgr.WaitToCompleteOperation(wcb);
+  odinMgr.Uncancel();
+}
+
+// compare the image of one volume with a drive or a file, the image is decoded and the target
+// read at the same time
+void CMultiPartitionHandler::ComparePartition(LPCWSTR fileName, int index, LPCWSTR targetFileName, COdinManager &odinMgr,
+                                              ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  unsigned fileCount = 0;
+  unsigned __int64 fileSize = 0;
+  wstring baseName = fileName;
+  bool isEntireDriveImagefile;
+
+  if (CFileNameUtil::TestIsHardDiskImage(fileName))
+    THROW_INT_EXC(EInternalException::compareMultiVolume);
+
+  CFileNameUtil::RemoveTrailingNumberFromFileName(baseName);
+  GetNoFilesAndFileSize(baseName.c_str(), cb, fileCount, fileSize, isEntireDriveImagefile);
+  if (fileCount == 0 && baseName != fileName)
+    baseName = fileName;
+
+  wcb->OnPartitionChange(0, 1);
+  odinMgr.CompareImage(baseName.c_str(), fileCount, fileSize, index, targetFileName, cb);
+  odinMgr.WaitToCompleteOperation(wcb);
+  odinMgr.Uncancel();
+}
+
 void CMultiPartitionHandler::WaitForDriveReady(COdinManager &odinMgr, int index, unsigned partitionCount, const wstring& targetDiskDeviceName) {
     int retries = 0;
     DWORD waitTime = 50;
@@ -264,6 +312,61 @@ bool CMultiPartitionHandler::VerifyPartitionOrDisk(LPCWSTR fileName, COdinManage
     return true;
 }
 
+bool CMultiPartitionHandler::TranscodePartitionOrDisk(LPCWSTR fileName, LPCWSTR targetFileName, COdinManager &odinMgr,
+                                                      ISplitManagerCallback* cb, IWaitCallback* wcb, IUserFeedback& feedback)
+{
+    unsigned noFiles = 0;
+    unsigned __int64 totalSize = 0;
+    int volType;
+    DWORD crc32FromFileHeader;
+    wstring volumeFileName, targetVolumeFileName;
+    unsigned subPartitions;
+    CParamChecker checker(feedback, odinMgr);
+    IUserFeedback::TFeedbackResult res;
+    bool isEntireDriveImage;
+
+    bool isHardDisk = CFileNameUtil::TestIsHardDiskImage(fileName);
+
+    // the MBR file containing boot loader and partition table information is copied
+    if (isHardDisk) {
+      wstring mbrFileName(fileName), targetMbrFileName(targetFileName);
+      res = checker.CheckConditionsForVerifyMBRFile(fileName);
+      if (res != IUserFeedback::TOk && res != IUserFeedback::TYes)
+        return false;
+      CFileNameUtil::GenerateFileNameForMBRBackupFile(mbrFileName);
+      CFileNameUtil::GenerateFileNameForMBRBackupFile(targetMbrFileName);
+      CPartitionInfoMgr partInfoMgr;
+      partInfoMgr.ReadPartitionInfoFromFile(mbrFileName.c_str());
+      partInfoMgr.WritePartitionInfoToFile(targetMbrFileName.c_str());
+      subPartitions = partInfoMgr.GetPartitionCount();
+    } else {
+      subPartitions = 1;
+    }
+
+    odinMgr.Uncancel();
+    for (unsigned i=0; i<subPartitions && !odinMgr.WasCancelled(); i++) {
+      if (isHardDisk) {
+        wstring volumeDeviceName;
+        CFileNameUtil::GenerateDeviceNameForVolume(volumeDeviceName, 99 /* dummy value */, i+1);
+        CFileNameUtil::GenerateFileNameForEntireDiskBackup(volumeFileName, fileName, volumeDeviceName);
+        CFileNameUtil::GenerateFileNameForEntireDiskBackup(targetVolumeFileName, targetFileName, volumeDeviceName);
+      } else {
+        volumeFileName = fileName;
+        targetVolumeFileName = targetFileName;
+      }
+      res = checker.CheckConditionsForVerifyPartition(volumeFileName, *cb, volType, NULL, crc32FromFileHeader);
+      if (res == IUserFeedback::TOk) {
+        CFileNameUtil::RemoveTrailingNumberFromFileName(volumeFileName);
+        GetNoFilesAndFileSize(volumeFileName.c_str(), cb, noFiles, totalSize, isEntireDriveImage);
+        wcb->OnPartitionChange(i, subPartitions);
+        odinMgr.TranscodeImage(volumeFileName.c_str(), noFiles, totalSize, targetVolumeFileName.c_str(), cb);
+        odinMgr.WaitToCompleteOperation(wcb);
+      }
+    }
+    odinMgr.Uncancel();
+    return true;
+}
+
 void CMultiPartitionHandler::GetNoFilesAndFileSize(LPCWSTR fileName, ISplitManagerCallback* cb, unsigned& fileCount, 
                                          unsigned __int64& fileSize, bool& isEntireDriveImageFile)
 {
@@ -22,6 +22,7 @@
 ******************************************************************************/
  
 #pragma once
+#include <vector>
 /////////////////////////////////////////////////////////////////////////////
 //
 // This class is a small convenience class on top of ODIN Manager that 
@@ -48,7 +49,11 @@ public:
     IWaitCallback* wcb, IUserFeedback& feedback);
 
   static void RestorePartitionOrDisk(int index, LPCWSTR fileName, COdinManager &mgr, ISplitManagerCallback* cb, IWaitCallback* wcb);
+  static void RestorePartitionToDrives(const std::vector<int>& indexes, LPCWSTR fileName, COdinManager &mgr, ISplitManagerCallback* cb, IWaitCallback* wcb);
   static bool VerifyPartitionOrDisk( LPCWSTR fileName, COdinManager &odinMgr, DWORD& crc32FromFileHeader, ISplitManagerCallback* cb, IWaitCallback* wcb, IUserFeedback& feedback);
+  static bool TranscodePartitionOrDisk(LPCWSTR fileName, LPCWSTR targetFileName, COdinManager &odinMgr, ISplitManagerCallback* cb, IWaitCallback* wcb, IUserFeedback& feedback);
+  // compare an image of one volume with drive index or, if index is -1, with file targetFileName
+  static void ComparePartition(LPCWSTR fileName, int index, LPCWSTR targetFileName, COdinManager &odinMgr, ISplitManagerCallback* cb, IWaitCallback* wcb);
 
 private:
   static void WaitForDriveReady(COdinManager &odinMgr, int index, unsigned partitionCount, const std::wstring& targetDiskDeviceName);
@@ -0,0 +1,478 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "NetCastRound.h"
+#include "OdinManager.h"
+#include "ImageStream.h"
+#include "IImageStream.h"
+#include "InternalException.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+// interval in ms to check for stop and timeouts while waiting
+static const DWORD cPollInterval = 100;
+
+//---------------------------------------------------------------------------
+// class CNetCastWriter
+// Target of the decoding engine, passes the decoded data to the round
+
+class CNetCastWriter : public IImageStream
+{
+public:
+  CNetCastWriter(CNetCastRound* round)
+  {
+    fRound = round;
+    fPosition = 0;
+  }
+
+  virtual LPCWSTR GetName() const {
+    return fRound->GetImageName();
+  }
+  virtual void Open(LPCWSTR /* name */, TOpenMode /* mode */) {
+  }
+  virtual void Close() {
+  }
+  virtual unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+  virtual void Read(void * /* buffer */, unsigned /* nLength */, unsigned *nBytesRead) {
+    *nBytesRead = 0;
+  }
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten) {
+    fRound->AddData((const BYTE*) buffer, nLength);
+    fPosition += nLength;
+    *nBytesWritten = nLength;
+  }
+  virtual void Seek(__int64 /* offset */, DWORD /* moveMethod */) {
+  }
+  virtual unsigned __int64 GetSize() const {
+    return fPosition;
+  }
+  virtual unsigned __int64 GetAllocatedBytes() const {
+    return fPosition;
+  }
+  virtual bool IsDrive() const {
+    return false;
+  }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const {
+    return NULL;
+  }
+  virtual void SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */) {
+  }
+
+private:
+  CNetCastRound* fRound;
+  unsigned __int64 fPosition;
+};
+
+//---------------------------------------------------------------------------
+// class CNetCastDecodeResult
+// Takes the result of decoding the image when the threads of the engine have
+// finished, the engine releases them afterwards
+
+class CNetCastDecodeResult : public IWaitCallback
+{
+public:
+  CNetCastDecodeResult(COdinManager& manager)
+    : fManager(manager)
+  {
+    fWasError = false;
+  }
+
+  virtual void OnThreadTerminated() {
+  }
+  virtual void OnFinished() {
+    fWasError = fManager.WasError();
+    if (fWasError)
+      fErrorMessage = fManager.GetErrorMessage();
+  }
+  virtual void OnAbort() {
+    fWasError = true;
+    fErrorMessage = L"Waiting for the decoding threads failed";
+  }
+  virtual void OnPartitionChange(int /* i */, int /* n */) {
+  }
+  virtual void OnPrepareSnapshotBegin() {
+  }
+  virtual void OnPrepareSnapshotReady() {
+  }
+
+  bool WasError() const {
+    return fWasError;
+  }
+  LPCWSTR GetErrorMessage() const {
+    return fErrorMessage.c_str();
+  }
+
+private:
+  COdinManager& fManager;
+  bool fWasError;
+  wstring fErrorMessage;
+};
+
+//---------------------------------------------------------------------------
+// class CNetCastRound
+
+CNetCastRound::CNetCastRound(LPCWSTR imageName, unsigned window, unsigned startClients, DWORD startDelay,
+                             DWORD detachTimeout, bool isPrivate)
+  : COdinThread(CREATE_SUSPENDED)
+{
+  fImageName = imageName;
+  fWindow = max(window, 2U);
+  fStartClients = startClients;
+  fStartDelay = startDelay;
+  fDetachTimeout = detachTimeout;
+  fPrivate = isPrivate;
+  fDataSize = fDataEnd = 0;
+  fFirstBlock = 0;
+  fEnded = false;
+  fStop = false;
+  fNextClient = 0;
+  fDetachedCount = 0;
+  fProducerWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+}
+
+CNetCastRound::~CNetCastRound()
+{
+  for (map<unsigned, TClient>::iterator it = fClients.begin(); it != fClients.end(); ++it)
+    CloseHandle(it->second.wake);
+  CloseHandle(fProducerWake);
+}
+
+// read a part of the image that is copied to the prefix
+static void ReadImageRange(CFileImageStream& image, unsigned __int64 offset, unsigned length, BYTE* buffer)
+{
+  unsigned bytesRead;
+
+  if (length == 0)
+    return;
+  image.Seek(offset, FILE_BEGIN);
+  image.Read(buffer, length, &bytesRead);
+  if (bytesRead != length)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongFileSizeError);
+}
+
+void CNetCastRound::Open()
+{
+  CFileImageStream image;
+  image.Open(fImageName.c_str(), IImageStream::forReading);
+  image.ReadImageFileHeader(false);
+  CImageFileHeader header = image.GetImageFileHeader();
+  if (header.GetImageType() == CImageFileHeader::imageIncremental)
+    THROW_INT_EXC(EInternalException::netCastIncremental);
+
+  unsigned __int64 verifyOffset, commentOffset, mapOffset, mapLength;
+  DWORD verifyLength, commentLength;
+  header.GetVerifyOffsetAndLength(verifyOffset, verifyLength);
+  header.GetCommentOffsetAndLength(commentOffset, commentLength);
+  header.GetClusterBitmapOffsetAndLength(mapOffset, mapLength);
+  if (mapOffset == 0)
+    mapLength = 0;
+  if (mapLength > UINT_MAX)
+    THROW_INT_EXC(EInternalException::integerOverflow);
+
+  // header, checksum, comment, allocation map and the volume data decoded. The server
+  // checks the checksum of the stored data, so it is not valid for the data sent.
+  unsigned headerLength = header.GetHeaderFileLength();
+  unsigned __int64 prefixLength = headerLength + verifyLength + commentLength + mapLength;
+  fPrefix.resize((size_t) prefixLength);
+  ReadImageRange(image, verifyOffset, verifyLength, &fPrefix[headerLength]);
+  ReadImageRange(image, commentOffset, commentLength, &fPrefix[headerLength + verifyLength]);
+  ReadImageRange(image, mapOffset, (unsigned) mapLength, &fPrefix[headerLength + verifyLength + commentLength]);
+  image.Close();
+
+  header.SetCompressionFormat(noCompression);
+  header.SetVerifyFormat(CImageFileHeader::verifyNone);
+  header.SetVerifyOffsetAndLength(headerLength, verifyLength);
+  header.SetComment(headerLength + verifyLength, commentLength);
+  if (mapLength > 0)
+    header.SetVolumeBitmapInfo(header.GetVolumeEncoding(), headerLength + verifyLength + commentLength, mapLength);
+  header.SetBlockManifestInfo(CImageFileHeader::noBlockManifest, 0, 0, 0);
+  header.SetBlockHashInfo(CImageFileHeader::imageFull, CImageFileHeader::noBlockHashes, 0, 0);
+  header.SetFileCount(1);
+  header.SetTrailerLength(0);
+  header.SetVolumeDataOffset(prefixLength);
+  fDataSize = header.GetVolumeUsedSize();
+  header.SetDataSize(fDataSize);
+  header.WriteHeaderToBuffer(&fPrefix[0]);
+}
+
+//---------------------------------------------------------------------------
+// clients
+
+bool CNetCastRound::Join(unsigned& client)
+{
+  fLock.Enter();
+  bool joinable = !fPrivate && !fStop && fFirstBlock == 0 && fError.empty();
+  fLock.Leave();
+  if (joinable)
+    client = AddClient(0);
+  return joinable;
+}
+
+unsigned CNetCastRound::AddClient(unsigned __int64 firstBlock)
+{
+  TClient c;
+  c.next = firstBlock;
+  c.detached = false;
+  c.wake = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+  fLock.Enter();
+  unsigned client = fNextClient++;
+  // the first block may have left the cache in the meantime
+  c.detached = c.next < fFirstBlock;
+  fClients[client] = c;
+  fLock.Leave();
+  SetEvent(fProducerWake);
+  return client;
+}
+
+void CNetCastRound::RemoveClient(unsigned client)
+{
+  fLock.Enter();
+  map<unsigned, TClient>::iterator it = fClients.find(client);
+  if (it != fClients.end()) {
+    CloseHandle(it->second.wake);
+    fClients.erase(it);
+  }
+  fLock.Leave();
+  SetEvent(fProducerWake);
+}
+
+bool CNetCastRound::HasClients()
+{
+  fLock.Enter();
+  bool hasClients = !fClients.empty();
+  fLock.Leave();
+  return hasClients;
+}
+
+CNetCastRound::TBlockResult CNetCastRound::GetNextBlock(unsigned client, TNetCastBlock& block)
+{
+  TBlockResult result;
+
+  fLock.Enter();
+  TClient& c = fClients[client];
+  while (true) {
+    if (c.next < fFirstBlock)
+      c.detached = true;
+    if (c.detached) {
+      result = castDetached;
+      break;
+    } else if (!fError.empty()) {
+      result = castError;
+      break;
+    } else if (c.next < fFirstBlock + fCache.size()) {
+      block = fCache[(size_t) (c.next - fFirstBlock)];
+      ++c.next;
+      result = castData;
+      break;
+    } else if (fEnded) {
+      result = castEnd;
+      break;
+    }
+    HANDLE wake = c.wake;
+    fLock.Leave();
+    WaitForSingleObject(wake, cPollInterval);
+    fLock.Enter();
+  }
+  fLock.Leave();
+  if (result == castData)
+    SetEvent(fProducerWake);
+  return result;
+}
+
+unsigned __int64 CNetCastRound::GetClientBlock(unsigned client)
+{
+  fLock.Enter();
+  unsigned __int64 next = fClients[client].next;
+  fLock.Leave();
+  return next;
+}
+
+wstring CNetCastRound::GetError()
+{
+  fLock.Enter();
+  wstring error = fError;
+  fLock.Leave();
+  return error;
+}
+
+unsigned CNetCastRound::GetDetachedCount()
+{
+  fLock.Enter();
+  unsigned count = fDetachedCount;
+  fLock.Leave();
+  return count;
+}
+
+void CNetCastRound::Stop()
+{
+  fStop = true;
+  Fail(L"The image server stopped");
+}
+
+void CNetCastRound::WakeClients()
+{
+  for (map<unsigned, TClient>::iterator it = fClients.begin(); it != fClients.end(); ++it)
+    SetEvent(it->second.wake);
+}
+
+//---------------------------------------------------------------------------
+// decoding
+
+DWORD CNetCastRound::Execute()
+{
+  SetName("NetCastRound");
+  try {
+    WaitForClients();
+    COdinManager manager;
+    CNetCastWriter writer(this);
+    CNetCastDecodeResult result(manager);
+    manager.DecodeImage(fImageName.c_str(), &writer);
+    manager.WaitToCompleteOperation(&result);
+    if (result.WasError())
+      Fail(result.GetErrorMessage());
+    else if (!manager.WasSourceIntact())
+      Fail(EFileFormatException(EFileFormatException::checksumError).GetMessage());
+    else
+      Finish();
+  } catch (Exception& e) {
+    Fail(e.GetMessage());
+  }
+  fFinished = true;
+  return 0;
+}
+
+void CNetCastRound::WaitForClients()
+{
+  DWORD start = GetTickCount();
+
+  while (!fStop && GetTickCount() - start < fStartDelay) {
+    fLock.Enter();
+    bool complete = fStartClients > 0 && fClients.size() >= fStartClients;
+    fLock.Leave();
+    if (complete)
+      break;
+    WaitForSingleObject(fProducerWake, cPollInterval);
+  }
+}
+
+void CNetCastRound::AddData(const BYTE* data, unsigned length)
+{
+  if (fStop)
+    return;
+  // a full block is kept until more data follow, so that the last block is only
+  // sent when the checksum of the image is correct
+  while (length > 0) {
+    if (fCurrent && fCurrent->size() == kNetCastBlockSize)
+      PushBlock();
+    if (!fCurrent) {
+      fCurrent = make_shared<vector<BYTE>>();
+      fCurrent->reserve(kNetCastBlockSize);
+    }
+    unsigned count = min(length, kNetCastBlockSize - (unsigned) fCurrent->size());
+    fCurrent->insert(fCurrent->end(), data, data + count);
+    data += count;
+    length -= count;
+    fDataEnd += count;
+  }
+}
+
+// add the current block to the cache, the oldest block is removed when no
+// client needs it anymore or the clients needing it are detached. Clients are
+// only detached if they hold back others
+void CNetCastRound::PushBlock()
+{
+  TNetCastBlock block;
+  DWORD start = GetTickCount();
+
+  block.offset = fDataEnd - fCurrent->size();
+  block.data = fCurrent;
+  fCurrent.reset();
+
+  fLock.Enter();
+  while (fCache.size() >= fWindow) {
+    // clients still needing the oldest block hold back the others
+    unsigned blocking = 0, attached = 0;
+    for (map<unsigned, TClient>::iterator it = fClients.begin(); it != fClients.end(); ++it) {
+      if (!it->second.detached) {
+        ++attached;
+        if (it->second.next <= fFirstBlock)
+          ++blocking;
+      }
+    }
+    if (blocking == 0 || fStop) {
+      fCache.pop_front();
+      ++fFirstBlock;
+    } else if (blocking < attached && fDetachTimeout > 0 && GetTickCount() - start >= fDetachTimeout) {
+      for (map<unsigned, TClient>::iterator it = fClients.begin(); it != fClients.end(); ++it) {
+        if (!it->second.detached && it->second.next <= fFirstBlock) {
+          ATLTRACE(L"Cast of %s detaches client %u at block %u\n", fImageName.c_str(), it->first,
+                   (unsigned) it->second.next);
+          it->second.detached = true;
+          ++fDetachedCount;
+          SetEvent(it->second.wake);
+        }
+      }
+    } else {
+      fLock.Leave();
+      WaitForSingleObject(fProducerWake, cPollInterval);
+      fLock.Enter();
+    }
+  }
+  fCache.push_back(block);
+  WakeClients();
+  fLock.Leave();
+}
+
+void CNetCastRound::Finish()
+{
+  if (fCurrent && !fCurrent->empty())
+    PushBlock();
+  if (fDataEnd != fDataSize) {
+    Fail(EFileFormatException(EFileFormatException::wrongFileSizeError).GetMessage());
+    return;
+  }
+  fLock.Enter();
+  fEnded = true;
+  WakeClients();
+  fLock.Leave();
+}
+
+void CNetCastRound::Fail(LPCWSTR message)
+{
+  fLock.Enter();
+  if (fError.empty())
+    fError = message;
+  WakeClients();
+  fLock.Leave();
+}
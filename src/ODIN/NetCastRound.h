@@ -0,0 +1,146 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETCASTROUND_H__
+#define __NETCASTROUND_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include "OdinThread.h"
+#include "sync.h"
+
+// size of the blocks the volume data is decoded and sent in
+const unsigned kNetCastBlockSize = 1024 * 1024;
+
+// a block of decoded volume data, shared by the clients sending it
+typedef struct {
+  unsigned __int64 offset;                   // offset in the volume data
+  std::shared_ptr<std::vector<BYTE>> data;
+} TNetCastBlock;
+
+//---------------------------------------------------------------------------
+// class CNetCastRound
+// One pass of an image server decoding an image for all clients that restore it
+// at the same time (netCast, see NetProtocol.h). The clients get the image as an
+// uncompressed image: a prefix of header, checksum, comment and allocation map
+// followed by the decoded volume data. The last window blocks are kept in a cache
+// that the clients read from at their own speed, decoding waits while the oldest
+// block is still needed. A client that holds back the others for detachTimeout ms
+// is detached and continues in a round of its own, so is a client that joins after
+// the first block has left the cache. Decoding starts when startClients clients
+// have joined or startDelay ms have passed.
+
+class CNetCastRound : public COdinThread
+{
+public:
+  typedef enum { castData, castEnd, castDetached, castError } TBlockResult;
+
+  // a private round serves only the client it is created for
+  CNetCastRound(LPCWSTR imageName, unsigned window, unsigned startClients, DWORD startDelay, DWORD detachTimeout,
+                bool isPrivate);
+  virtual ~CNetCastRound();
+
+  // build the prefix from the image, throws if the image can not be cast
+  void Open();
+
+  LPCWSTR GetImageName() const {
+    return fImageName.c_str();
+  }
+
+  const std::vector<BYTE>& GetPrefix() const {
+    return fPrefix;
+  }
+
+  // size of the uncompressed image the clients get
+  unsigned __int64 GetImageSize() const {
+    return fPrefix.size() + fDataSize;
+  }
+
+  // add a client that gets the volume data from the start, false if the round
+  // is private or the first block has already left the cache
+  bool Join(unsigned& client);
+  // add a client that gets the volume data from block firstBlock on
+  unsigned AddClient(unsigned __int64 firstBlock);
+  void RemoveClient(unsigned client);
+  bool HasClients();
+
+  // the next block for client, waits until it is decoded. After castDetached the
+  // client continues with block GetClientBlock() elsewhere, after castError
+  // GetError() tells why the round failed
+  TBlockResult GetNextBlock(unsigned client, TNetCastBlock& block);
+  unsigned __int64 GetClientBlock(unsigned client);
+  std::wstring GetError();
+
+  // number of clients detached because they were too slow
+  unsigned GetDetachedCount();
+
+  // stop sending data to clients, the rest of the image is decoded and discarded
+  void Stop();
+
+  // used by the decoding engine: append decoded volume data
+  void AddData(const BYTE* data, unsigned length);
+
+protected:
+  virtual DWORD Execute();
+
+private:
+  typedef struct {
+    unsigned __int64 next;   // index of next block to send
+    bool detached;
+    HANDLE wake;             // set when a block is added or the client is detached
+  } TClient;
+
+  void WaitForClients();
+  void PushBlock();
+  void Finish();
+  void Fail(LPCWSTR message);
+  void WakeClients();
+
+  std::wstring fImageName;
+  unsigned fWindow;
+  unsigned fStartClients;
+  DWORD fStartDelay;
+  DWORD fDetachTimeout;
+  bool fPrivate;
+  std::vector<BYTE> fPrefix;
+  unsigned __int64 fDataSize;       // size of the decoded volume data
+  unsigned __int64 fDataEnd;        // decoded so far
+  std::shared_ptr<std::vector<BYTE>> fCurrent;  // block being filled
+  std::deque<TNetCastBlock> fCache;
+  unsigned __int64 fFirstBlock;     // index of first block in cache
+  bool fEnded;                      // all blocks are decoded
+  volatile bool fStop;
+  std::wstring fError;
+  std::map<unsigned, TClient> fClients;
+  unsigned fNextClient;
+  unsigned fDetachedCount;
+  HANDLE fProducerWake;             // set when a client takes a block or joins
+  CCriticalSection fLock;           // protects cache, clients and state
+};
+
+#endif
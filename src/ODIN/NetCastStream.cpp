@@ -0,0 +1,176 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "NetCastStream.h"
+#include "OSException.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+static const wchar_t cCastPrefix[] = L"odincast://";
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implementation of class CNetCastStream
+/////////////////////////////////////////////////////////////////////////////////////
+
+CNetCastStream::CNetCastStream()
+{
+  WSADATA wsaData;
+  WSAStartup(MAKEWORD(2, 2), &wsaData);
+  fSocket = INVALID_SOCKET;
+  fPosition = fSize = fBlockOffset = 0;
+}
+
+CNetCastStream::~CNetCastStream()
+{
+  Close();
+  WSACleanup();
+}
+
+bool CNetCastStream::IsCastName(LPCWSTR name)
+{
+  return name != NULL && _wcsnicmp(name, cCastPrefix, wcslen(cCastPrefix)) == 0;
+}
+
+void CNetCastStream::Open(LPCWSTR name, TOpenMode mode)
+{
+  std::string host, port, path;
+  TNetMessage msg;
+
+  fName = name;
+  if (mode == forWriting)
+    THROW_INT_EXC(EInternalException::netCastReadOnly);
+  if (!NetParseName(fName, wcslen(cCastPrefix), host, port, path))
+    THROW_INT_EXC_PARAM1(EInternalException::netAddressError, fName.c_str());
+
+  fSocket = NetConnect(host, port, fName.c_str());
+  msg = NewNetMessage(netCast);
+  msg.length = (DWORD) path.length();
+  if (!NetSendMessage(fSocket, msg, path.c_str()))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netSendError, fName.c_str());
+  ReceiveData(msg, fBlock);
+  if (msg.type != netAck || msg.value > msg.offset)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  fSize = msg.offset;
+
+  // the prefix follows in blocks
+  size_t prefixLength = (size_t) msg.value;
+  fPrefix.clear();
+  while (fPrefix.size() < prefixLength) {
+    ReceiveData(msg, fBlock);
+    if (msg.type != netData || msg.offset != fPrefix.size() || fBlock.empty() ||
+        fPrefix.size() + fBlock.size() > prefixLength)
+      THROW_INT_EXC(EInternalException::netProtocolError);
+    fPrefix.insert(fPrefix.end(), fBlock.begin(), fBlock.end());
+  }
+  fBlock.clear();
+  fBlockOffset = fPrefix.size();
+  fPosition = 0;
+}
+
+void CNetCastStream::Close()
+{
+  if (fSocket == INVALID_SOCKET)
+    return;
+  TNetMessage msg = NewNetMessage(netClose);
+  NetSendMessage(fSocket, msg, NULL);
+  closesocket(fSocket);
+  fSocket = INVALID_SOCKET;
+}
+
+// receive a netAck or netData message and its data
+void CNetCastStream::ReceiveData(TNetMessage& msg, std::vector<BYTE>& data)
+{
+  if (!NetReceiveAll(fSocket, &msg, sizeof(msg)))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+  if (msg.magic != kNetMagic || msg.length > kNetMaxPayload)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  if (msg.type == netError) {
+    std::string message(msg.length, '\0');
+    if (msg.length > 0 && !NetReceiveAll(fSocket, &message[0], msg.length))
+      THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+    THROW_INT_EXC_PARAM1(EInternalException::netServerError, (LPCWSTR) CA2W(message.c_str(), CP_UTF8));
+  }
+  if (msg.type != netAck && msg.type != netData)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  data.resize(msg.length);
+  if (msg.length > 0 && !NetReceiveAll(fSocket, &data[0], msg.length))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+}
+
+void CNetCastStream::ReceiveNextBlock()
+{
+  TNetMessage msg;
+  unsigned __int64 offset = fBlockOffset + fBlock.size();
+
+  ReceiveData(msg, fBlock);
+  if (msg.type != netData || msg.offset != offset || fBlock.empty() || offset + fBlock.size() > fSize)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  fBlockOffset = offset;
+}
+
+void CNetCastStream::Seek(__int64 offset, DWORD moveMethod)
+{
+  __int64 base = moveMethod == FILE_BEGIN ? 0 : moveMethod == FILE_CURRENT ? (__int64) fPosition : (__int64) fSize;
+  if (base + offset < 0)
+    THROW_OS_EXC_PARAM1(ERROR_NEGATIVE_SEEK, EWinException::seekError, fName.c_str());
+  // volume data are received when the stream is read at the new position
+  fPosition = base + offset;
+}
+
+void CNetCastStream::Read(void * buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  BYTE* data = (BYTE*) buffer;
+  unsigned remaining = nLength;
+
+  while (remaining > 0 && fPosition < fSize) {
+    unsigned count;
+    if (fPosition < fPrefix.size()) {
+      count = (unsigned) min((unsigned __int64) remaining, fPrefix.size() - fPosition);
+      memcpy(data, &fPrefix[(size_t) fPosition], count);
+    } else if (fPosition < fBlockOffset) {
+      THROW_INT_EXC(EInternalException::netCastSeekError);
+    } else if (fPosition < fBlockOffset + fBlock.size()) {
+      count = (unsigned) min((unsigned __int64) remaining, fBlockOffset + fBlock.size() - fPosition);
+      memcpy(data, &fBlock[(size_t) (fPosition - fBlockOffset)], count);
+    } else {
+      ReceiveNextBlock();
+      continue;
+    }
+    fPosition += count;
+    data += count;
+    remaining -= count;
+  }
+  *nBytesRead = nLength - remaining;
+}
+
+void CNetCastStream::Write(void * /* buffer */, unsigned /* nLength */, unsigned *nBytesWritten)
+{
+  *nBytesWritten = 0;
+  THROW_INT_EXC(EInternalException::netCastReadOnly);
+}
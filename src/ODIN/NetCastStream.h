@@ -0,0 +1,89 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETCASTSTREAM_H__
+#define __NETCASTSTREAM_H__
+
+#include <string>
+#include <vector>
+#include "IImageStream.h"
+#include "NetProtocol.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Subclass reading an image cast by an image server (see CNetCastRound)
+// The name of the image is odincast://host[:port]/path. The server decodes the image once for
+// all clients restoring it at the same time and sends it as an uncompressed image over one
+// connection: header, checksum, comment and allocation map can be read in any order, the
+// volume data following them only in order as they arrive.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+class CNetCastStream: public IImageStream
+{
+public:
+  CNetCastStream();
+  virtual ~CNetCastStream();
+
+  // true if name is the name of a cast image (starts with odincast://)
+  static bool IsCastName(LPCWSTR name);
+
+  virtual LPCWSTR GetName() const {
+    return fName.c_str();
+  }
+  virtual void Open(LPCWSTR name, TOpenMode mode);
+  virtual void Close();
+  virtual unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
+  virtual void Seek(__int64 offset, DWORD moveMethod);
+  virtual unsigned __int64 GetSize() const {
+    return fSize;
+  }
+  virtual unsigned __int64 GetAllocatedBytes() const {
+    return fSize;
+  }
+  virtual bool IsDrive() const {
+    return false;
+  }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const {
+    return NULL;
+  }
+  virtual void SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */) {
+  }
+
+private:
+  void ReceiveData(TNetMessage& msg, std::vector<BYTE>& data);
+  void ReceiveNextBlock();
+
+  std::wstring       fName;
+  SOCKET             fSocket;
+  unsigned __int64   fPosition;
+  unsigned __int64   fSize;        // size of the uncompressed image
+  std::vector<BYTE>  fPrefix;      // header, checksum, comment and allocation map
+  std::vector<BYTE>  fBlock;       // last block of volume data received
+  unsigned __int64   fBlockOffset; // offset of fBlock in the image
+};
+
+#endif
@@ -0,0 +1,611 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "NetImageServer.h"
+#include "NetProtocol.h"
+#include "NetCastRound.h"
+#include "OdinThread.h"
+#include "OSException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+// unbuffered I/O needs offsets, lengths and buffers aligned to the sector size
+static const unsigned cDirectAlignment = 4096;
+
+//---------------------------------------------------------------------------
+// class CNetImageFile
+// An image file opened by a client. It is written and read at the offsets of
+// the requests, so the connections of a client can use it at the same time.
+
+class CNetImageFile
+{
+public:
+  CNetImageFile(const wstring& path, bool forWriting)
+  {
+    DWORD access = GENERIC_READ | (forWriting ? GENERIC_WRITE : 0);
+    DWORD shareMode = FILE_SHARE_READ | FILE_SHARE_WRITE;
+
+    fPath = path;
+    fDirectHandle = NULL;
+    fHandle = CreateFile(path.c_str(), access, shareMode, NULL, forWriting ? CREATE_ALWAYS : OPEN_EXISTING,
+                         forWriting ? FILE_ATTRIBUTE_NORMAL : FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    CHECK_OS_EX_HANDLE_PARAM1(fHandle, EWinException::fileOpenError, fPath.c_str());
+    // not all file systems support unbuffered I/O
+    HANDLE h = CreateFile(path.c_str(), access, shareMode, NULL, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, NULL);
+    if (h != INVALID_HANDLE_VALUE)
+      fDirectHandle = h;
+  }
+
+  ~CNetImageFile()
+  {
+    if (fDirectHandle != NULL)
+      CloseHandle(fDirectHandle);
+    CloseHandle(fHandle);
+  }
+
+  unsigned __int64 GetSize()
+  {
+    LARGE_INTEGER size;
+    BOOL ok = GetFileSizeEx(fHandle, &size);
+    CHECK_OS_EX_PARAM1(ok, EWinException::seekError, fPath.c_str());
+    return size.QuadPart;
+  }
+
+  void Write(unsigned __int64 offset, const BYTE* buffer, DWORD length)
+  {
+    OVERLAPPED ov;
+    DWORD written;
+
+    SetOffset(ov, offset);
+    BOOL ok = WriteFile(GetHandleFor(offset, buffer, length), buffer, length, &written, &ov);
+    CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fPath.c_str());
+  }
+
+  DWORD Read(unsigned __int64 offset, BYTE* buffer, DWORD length)
+  {
+    OVERLAPPED ov;
+    DWORD read = 0;
+
+    SetOffset(ov, offset);
+    BOOL ok = ReadFile(GetHandleFor(offset, buffer, length), buffer, length, &read, &ov);
+    if (!ok && GetLastError() == ERROR_HANDLE_EOF)
+      return 0;
+    CHECK_OS_EX_PARAM1(ok, EWinException::readFileError, fPath.c_str());
+    return read;
+  }
+
+  void Flush()
+  {
+    BOOL ok = FlushFileBuffers(fHandle);
+    CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fPath.c_str());
+    if (fDirectHandle != NULL) {
+      ok = FlushFileBuffers(fDirectHandle);
+      CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, fPath.c_str());
+    }
+  }
+
+private:
+  static void SetOffset(OVERLAPPED& ov, unsigned __int64 offset)
+  {
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD) offset;
+    ov.OffsetHigh = (DWORD) (offset >> 32);
+  }
+
+  HANDLE GetHandleFor(unsigned __int64 offset, const BYTE* buffer, DWORD length)
+  {
+    bool aligned = offset % cDirectAlignment == 0 && length % cDirectAlignment == 0 &&
+                   (ULONG_PTR) buffer % cDirectAlignment == 0;
+    return aligned && fDirectHandle != NULL ? fDirectHandle : fHandle;
+  }
+
+  wstring fPath;
+  HANDLE fHandle;
+  HANDLE fDirectHandle;   // opened with FILE_FLAG_NO_BUFFERING or NULL
+};
+
+//---------------------------------------------------------------------------
+// class CNetServerConnection
+// Thread answering the requests of one connection of a client
+
+class CNetServerConnection : public COdinThread
+{
+public:
+  CNetServerConnection(CNetImageServer* server, SOCKET s)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fServer = server;
+    fSocket = s;
+  }
+
+  ~CNetServerConnection()
+  {
+    closesocket(fSocket);
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("NetConnection");
+    try {
+      ServeRequests();
+    } catch (Exception& e) {
+      fErrorMessage = e.GetMessage();
+      fErrorFlag = true;
+    } catch (...) {
+      fErrorFlag = true;
+    }
+    fFinished = true;
+    return 0;
+  }
+
+  // wake up the thread if it waits for the client
+  void Shutdown()
+  {
+    shutdown(fSocket, SD_BOTH);
+  }
+
+private:
+  void ServeRequests();
+  BYTE* GetBuffer(DWORD length);
+  bool SendAnswer(TNetMessageType type, unsigned __int64 offset, unsigned __int64 value, const void* payload,
+                  DWORD length);
+  bool SendError(LPCWSTR message);
+  bool ServeCast(const string& path);
+
+  CNetImageServer* fServer;
+  SOCKET fSocket;
+  shared_ptr<CNetImageFile> fImage;
+  vector<BYTE> fBuffer;
+};
+
+BYTE* CNetServerConnection::GetBuffer(DWORD length)
+{
+  if (fBuffer.size() < (size_t) length + cDirectAlignment)
+    fBuffer.resize((size_t) length + cDirectAlignment);
+  ULONG_PTR address = (ULONG_PTR) &fBuffer[0];
+  return &fBuffer[0] + (cDirectAlignment - address % cDirectAlignment) % cDirectAlignment;
+}
+
+bool CNetServerConnection::SendAnswer(TNetMessageType type, unsigned __int64 offset, unsigned __int64 value,
+                                      const void* payload, DWORD length)
+{
+  TNetMessage msg = NewNetMessage(type);
+  msg.offset = offset;
+  msg.value = value;
+  msg.length = length;
+  return NetSendMessage(fSocket, msg, payload);
+}
+
+bool CNetServerConnection::SendError(LPCWSTR message)
+{
+  string text = (LPCSTR) CW2A(message, CP_UTF8);
+  TNetMessage msg = NewNetMessage(netError);
+  msg.length = (DWORD) text.length();
+  msg.status = (DWORD) -1;
+  return NetSendMessage(fSocket, msg, text.c_str());
+}
+
+void CNetServerConnection::ServeRequests()
+{
+  TNetMessage msg;
+  bool ok = true;
+
+  // a connection that fails or sends an invalid message is closed
+  while (ok && NetReceiveMessage(fSocket, msg)) {
+    BYTE* payload = GetBuffer(msg.length);
+    if (msg.length > 0 && !NetReceiveAll(fSocket, payload, msg.length))
+      break;
+    try {
+      switch (msg.type) {
+        case netOpenRead:
+        case netOpenWrite: {
+          unsigned __int64 session = 0;
+          wstring error;
+          fImage = fServer->OpenImage(string((const char*) payload, msg.length), msg.type == netOpenWrite, session, error);
+          if (fImage)
+            ok = SendAnswer(netAck, fImage->GetSize(), session, NULL, 0);
+          else
+            ok = SendError(error.c_str());
+          break;
+        }
+        case netJoin:
+          fImage = fServer->JoinSession(msg.value);
+          ok = fImage ? SendAnswer(netAck, 0, 0, NULL, 0) : SendError(L"The image was closed");
+          break;
+        case netWrite:
+          if (!fImage) {
+            ok = SendError(L"No image is opened");
+          } else {
+            fImage->Write(msg.offset, payload, msg.length);
+            ok = SendAnswer(netAck, msg.offset, 0, NULL, 0);
+          }
+          break;
+        case netRead: {
+          if (!fImage) {
+            ok = SendError(L"No image is opened");
+          } else if (msg.value > kNetMaxPayload) {
+            ok = false;
+          } else {
+            BYTE* buffer = GetBuffer((DWORD) msg.value);
+            DWORD count = fImage->Read(msg.offset, buffer, (DWORD) msg.value);
+            ok = SendAnswer(netData, msg.offset, 0, buffer, count);
+          }
+          break;
+        }
+        case netFlush:
+          if (fImage)
+            fImage->Flush();
+          ok = SendAnswer(netAck, 0, 0, NULL, 0);
+          break;
+        case netCast:
+          ok = ServeCast(string((const char*) payload, msg.length));
+          break;
+        default:  // netClose and messages only sent by the server
+          ok = false;
+          break;
+      }
+    } catch (Exception& e) {
+      ok = SendError(e.GetMessage());
+    }
+  }
+}
+
+// send the prefix and the volume data of a cast round, a detached client continues
+// in a round of its own
+bool CNetServerConnection::ServeCast(const string& path)
+{
+  unsigned client;
+  wstring error;
+  shared_ptr<CNetCastRound> round = fServer->JoinCast(path, 0, client, error);
+  if (!round)
+    return SendError(error.c_str());
+
+  const vector<BYTE>& prefix = round->GetPrefix();
+  unsigned __int64 prefixLength = prefix.size();
+  bool ok = SendAnswer(netAck, round->GetImageSize(), prefixLength, NULL, 0);
+  for (size_t pos = 0; ok && pos < prefix.size(); pos += kNetCastBlockSize) {
+    DWORD length = (DWORD) min(prefix.size() - pos, (size_t) kNetCastBlockSize);
+    ok = SendAnswer(netData, pos, 0, &prefix[pos], length);
+  }
+
+  while (ok) {
+    TNetCastBlock block;
+    CNetCastRound::TBlockResult result = round->GetNextBlock(client, block);
+    if (result == CNetCastRound::castData) {
+      ok = SendAnswer(netData, prefixLength + block.offset, 0, &(*block.data)[0], (DWORD) block.data->size());
+    } else if (result == CNetCastRound::castDetached) {
+      unsigned __int64 next = round->GetClientBlock(client);
+      round->RemoveClient(client);
+      round = fServer->JoinCast(path, next, client, error);
+      if (!round)
+        return SendError(error.c_str());
+    } else if (result == CNetCastRound::castError) {
+      ok = SendError(round->GetError().c_str());
+      break;
+    } else {
+      break;
+    }
+  }
+  round->RemoveClient(client);
+  return ok;
+}
+
+//---------------------------------------------------------------------------
+// class CNetListenThread
+
+class CNetListenThread : public COdinThread
+{
+public:
+  CNetListenThread(CNetImageServer* server)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fServer = server;
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("NetListen");
+    try {
+      fServer->AcceptConnections();
+    } catch (Exception& e) {
+      fErrorMessage = e.GetMessage();
+      fErrorFlag = true;
+    }
+    fFinished = true;
+    return 0;
+  }
+
+private:
+  CNetImageServer* fServer;
+};
+
+//---------------------------------------------------------------------------
+// class CNetImageServer
+
+CNetImageServer::CNetImageServer(LPCWSTR directory)
+{
+  WSADATA wsaData;
+  WSAStartup(MAKEWORD(2, 2), &wsaData);
+  fDirectory = directory;
+  fListenSocket = INVALID_SOCKET;
+  fStop = false;
+  fNextSession = 1;
+  fCastWindow = 32;
+  fCastStartClients = 0;
+  fCastStartDelay = 0;
+  fCastDetachTimeout = 5000;
+  fCastRoundCount = 0;
+}
+
+CNetImageServer::~CNetImageServer()
+{
+  Stop();
+  WSACleanup();
+}
+
+unsigned short CNetImageServer::Start(unsigned short port)
+{
+  // IPv6 socket accepting IPv4 clients as well, IPv4 only if IPv6 is not available
+  struct sockaddr_in6 addr6;
+  struct sockaddr_in addr4;
+  struct sockaddr* addr;
+  socklen_t addrLength;
+  int v6Only = 0;
+
+  fListenSocket = socket(AF_INET6, SOCK_STREAM, IPPROTO_TCP);
+  if (fListenSocket != INVALID_SOCKET) {
+    setsockopt(fListenSocket, IPPROTO_IPV6, IPV6_V6ONLY, (const char*) &v6Only, sizeof(v6Only));
+    memset(&addr6, 0, sizeof(addr6));
+    addr6.sin6_family = AF_INET6;
+    addr6.sin6_addr = in6addr_any;
+    addr6.sin6_port = htons(port);
+    addr = (struct sockaddr*) &addr6;
+    addrLength = sizeof(addr6);
+  } else {
+    fListenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fListenSocket == INVALID_SOCKET)
+      THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netConnectError, fDirectory.c_str());
+    memset(&addr4, 0, sizeof(addr4));
+    addr4.sin_family = AF_INET;
+    addr4.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr4.sin_port = htons(port);
+    addr = (struct sockaddr*) &addr4;
+    addrLength = sizeof(addr4);
+  }
+#ifndef _WIN32
+  // a restarted server can use the port at once (on Windows this would allow to share it)
+  int reuse = 1;
+  setsockopt(fListenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*) &reuse, sizeof(reuse));
+#endif
+  // accepted connections inherit the buffer sizes
+  NetSetSocketOptions(fListenSocket);
+  if (bind(fListenSocket, addr, addrLength) == SOCKET_ERROR || listen(fListenSocket, SOMAXCONN) == SOCKET_ERROR ||
+      getsockname(fListenSocket, addr, &addrLength) == SOCKET_ERROR) {
+    int error = WSAGetLastError();
+    closesocket(fListenSocket);
+    fListenSocket = INVALID_SOCKET;
+    THROW_OS_EXC_PARAM1(error, EWinException::netConnectError, fDirectory.c_str());
+  }
+  port = ntohs(addr->sa_family == AF_INET6 ? addr6.sin6_port : addr4.sin_port);
+
+  fStop = false;
+  fListenThread.reset(new CNetListenThread(this));
+  fListenThread->Resume();
+  return port;
+}
+
+void CNetImageServer::Stop()
+{
+  if (!fListenThread)
+    return;
+  fStop = true;
+  fListenThread->WaitForThread();
+  fListenThread.reset();
+  closesocket(fListenSocket);
+  fListenSocket = INVALID_SOCKET;
+
+  fLock.Enter();
+  for (size_t i=0; i<fConnections.size(); i++)
+    fConnections[i]->Shutdown();
+  for (size_t i=0; i<fConnections.size(); i++)
+    fConnections[i]->WaitForThread();
+  fConnections.clear();
+  fLock.Leave();
+
+  fCastLock.Enter();
+  for (size_t i=0; i<fCastRounds.size(); i++)
+    fCastRounds[i]->Stop();
+  for (size_t i=0; i<fCastRounds.size(); i++)
+    fCastRounds[i]->WaitForThread();
+  fCastRounds.clear();
+  fCastLock.Leave();
+}
+
+void CNetImageServer::SetCastOptions(unsigned window, unsigned startClients, DWORD startDelay, DWORD detachTimeout)
+{
+  fCastWindow = window;
+  fCastStartClients = startClients;
+  fCastStartDelay = startDelay;
+  fCastDetachTimeout = detachTimeout;
+}
+
+unsigned CNetImageServer::GetCastRoundCount()
+{
+  fCastLock.Enter();
+  unsigned count = fCastRoundCount;
+  fCastLock.Leave();
+  return count;
+}
+
+void CNetImageServer::Wait()
+{
+  if (fListenThread)
+    fListenThread->WaitForThread();
+}
+
+void CNetImageServer::AcceptConnections()
+{
+  while (!fStop) {
+    // wait a short time only so that Stop() is noticed
+    fd_set readSet;
+    struct timeval timeout = { 0, 200000 };
+    FD_ZERO(&readSet);
+    FD_SET(fListenSocket, &readSet);
+    int count = select((int) fListenSocket + 1, &readSet, NULL, NULL, &timeout);
+    if (count == SOCKET_ERROR)
+      THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fDirectory.c_str());
+    if (count == 0)
+      continue;
+
+    SOCKET s = accept(fListenSocket, NULL, NULL);
+    if (s == INVALID_SOCKET)
+      continue;
+    fLock.Enter();
+    RemoveClosedConnections();
+    fConnections.push_back(unique_ptr<CNetServerConnection>(new CNetServerConnection(this, s)));
+    fConnections.back()->Resume();
+    fLock.Leave();
+  }
+}
+
+void CNetImageServer::RemoveClosedConnections()
+{
+  for (size_t i=0; i<fConnections.size(); ) {
+    if (fConnections[i]->HasFinished()) {
+      fConnections[i]->WaitForThread();
+      fConnections.erase(fConnections.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+}
+
+// the file name of path of a client, clients can not access files outside of the directory
+bool CNetImageServer::GetImagePath(const string& path, wstring& fileName, wstring& error)
+{
+  wstring name = (LPCWSTR) CA2W(path.c_str(), CP_UTF8);
+
+  bool valid = !name.empty() && name[0] != L'/' && name[0] != L'\\' && name.find(L':') == wstring::npos;
+  for (size_t start = 0; valid && start <= name.length(); ) {
+    size_t end = name.find_first_of(L"/\\", start);
+    if (end == wstring::npos)
+      end = name.length();
+    valid = name.compare(start, end - start, L"..") != 0;
+    start = end + 1;
+  }
+  if (!valid) {
+    error = L"Invalid image path: " + name;
+    return false;
+  }
+  fileName = fDirectory + L"/" + name;
+  return true;
+}
+
+shared_ptr<CNetImageFile> CNetImageServer::OpenImage(const string& path, bool forWriting, unsigned __int64& session,
+                                                     wstring& error)
+{
+  wstring fileName;
+  if (!GetImagePath(path, fileName, error))
+    return shared_ptr<CNetImageFile>();
+
+  shared_ptr<CNetImageFile> image;
+  try {
+    image = make_shared<CNetImageFile>(fileName, forWriting);
+  } catch (Exception& e) {
+    error = e.GetMessage();
+    return shared_ptr<CNetImageFile>();
+  }
+
+  fLock.Enter();
+  for (auto it = fSessions.begin(); it != fSessions.end(); ) {
+    if (it->second.expired())
+      it = fSessions.erase(it);
+    else
+      ++it;
+  }
+  session = fNextSession++;
+  fSessions[session] = image;
+  fLock.Leave();
+  return image;
+}
+
+shared_ptr<CNetImageFile> CNetImageServer::JoinSession(unsigned __int64 session)
+{
+  fLock.Enter();
+  map<unsigned __int64, weak_ptr<CNetImageFile>>::iterator it = fSessions.find(session);
+  shared_ptr<CNetImageFile> image = it != fSessions.end() ? it->second.lock() : shared_ptr<CNetImageFile>();
+  fLock.Leave();
+  return image;
+}
+
+shared_ptr<CNetCastRound> CNetImageServer::JoinCast(const string& path, unsigned __int64 firstBlock, unsigned& client,
+                                                   wstring& error)
+{
+  wstring fileName;
+  if (!GetImagePath(path, fileName, error))
+    return shared_ptr<CNetCastRound>();
+
+  fCastLock.Enter();
+  for (size_t i=0; i<fCastRounds.size(); ) {
+    if (fCastRounds[i]->HasFinished() && !fCastRounds[i]->HasClients()) {
+      fCastRounds[i]->WaitForThread();
+      fCastRounds.erase(fCastRounds.begin() + i);
+    } else {
+      ++i;
+    }
+  }
+  shared_ptr<CNetCastRound> round;
+  if (firstBlock == 0) {
+    for (size_t i=0; i<fCastRounds.size() && !round; i++) {
+      if (fCastRounds[i]->GetImageName() == fileName && fCastRounds[i]->Join(client))
+        round = fCastRounds[i];
+    }
+  }
+  if (!round && !fStop) {
+    // a detached client does not wait for others
+    bool isPrivate = firstBlock > 0;
+    shared_ptr<CNetCastRound> newRound = make_shared<CNetCastRound>(fileName.c_str(), fCastWindow,
+      isPrivate ? 1 : fCastStartClients, isPrivate ? 0 : fCastStartDelay, fCastDetachTimeout, isPrivate);
+    try {
+      newRound->Open();
+      client = newRound->AddClient(firstBlock);
+      fCastRounds.push_back(newRound);
+      ++fCastRoundCount;
+      newRound->Resume();
+      round = newRound;
+    } catch (Exception& e) {
+      error = e.GetMessage();
+    }
+  } else if (!round) {
+    error = L"The image server stopped";
+  }
+  fCastLock.Leave();
+  return round;
+}
@@ -0,0 +1,107 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETIMAGESERVER_H__
+#define __NETIMAGESERVER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "NetSocket.h"
+#include "sync.h"
+
+class CNetImageFile;
+class CNetServerConnection;
+class CNetListenThread;
+class CNetCastRound;
+
+//---------------------------------------------------------------------------
+// class CNetImageServer
+// Stores and delivers the image files of CNetImageStream in a directory (see
+// NetProtocol.h for the protocol). Each connection is served by a thread of its
+// own, the connections of a client share the image file it opened. Blocks
+// aligned to 4 KB are written and read with unbuffered I/O (FILE_FLAG_NO_BUFFERING)
+// so the image does not go through the file cache, other data and file systems
+// that do not support it use buffered I/O.
+// Clients restoring the same image at the same time share a cast round
+// (CNetCastRound) that decodes the image once for all of them.
+
+class CNetImageServer {
+public:
+  // directory where the image files are stored, paths of clients are relative to it
+  CNetImageServer(LPCWSTR directory);
+  ~CNetImageServer();
+
+  // listen on port of all interfaces (0 for a free port chosen by the system) and
+  // accept clients in a thread, returns the port
+  unsigned short Start(unsigned short port);
+  // close all connections and stop accepting clients
+  void Stop();
+  // wait until the server stops, it only stops by itself if accepting clients fails
+  void Wait();
+  // cast rounds keep window blocks of 1MB, start decoding when startClients clients
+  // joined or after startDelay ms and detach clients holding back the others for
+  // detachTimeout ms
+  void SetCastOptions(unsigned window, unsigned startClients, DWORD startDelay, DWORD detachTimeout);
+  // number of cast rounds started so far
+  unsigned GetCastRoundCount();
+
+  // used by the listen thread: accept clients until stopped
+  void AcceptConnections();
+  // used by connections: open an image file of path for a client, returns NULL and
+  // the reason in error if it can not be opened
+  std::shared_ptr<CNetImageFile> OpenImage(const std::string& path, bool forWriting, unsigned __int64& session,
+                                           std::wstring& error);
+  // used by connections: the image file of session, NULL if it is closed
+  std::shared_ptr<CNetImageFile> JoinSession(unsigned __int64 session);
+  // used by connections: join a cast round of the image of path for a client that
+  // needs the volume data from block firstBlock on, a new round is started if there
+  // is none to join. Returns NULL and the reason in error if the image can not be cast
+  std::shared_ptr<CNetCastRound> JoinCast(const std::string& path, unsigned __int64 firstBlock, unsigned& client,
+                                          std::wstring& error);
+
+private:
+  void RemoveClosedConnections();
+  bool GetImagePath(const std::string& path, std::wstring& fileName, std::wstring& error);
+
+  std::wstring fDirectory;
+  SOCKET fListenSocket;
+  volatile bool fStop;
+  std::unique_ptr<CNetListenThread> fListenThread;
+  std::vector<std::unique_ptr<CNetServerConnection>> fConnections;
+  std::map<unsigned __int64, std::weak_ptr<CNetImageFile>> fSessions;  // open image files
+  unsigned __int64 fNextSession;
+  CCriticalSection fLock;                    // protects connections and sessions
+  std::vector<std::shared_ptr<CNetCastRound>> fCastRounds;
+  unsigned fCastWindow;
+  unsigned fCastStartClients;
+  DWORD fCastStartDelay;
+  DWORD fCastDetachTimeout;
+  unsigned fCastRoundCount;
+  CCriticalSection fCastLock;                // protects cast rounds
+};
+
+#endif
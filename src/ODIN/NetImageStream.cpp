@@ -0,0 +1,344 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "NetImageStream.h"
+#include "OSException.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+static const wchar_t cNetPrefix[] = L"odin://";
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implementation of class CNetImageStream
+/////////////////////////////////////////////////////////////////////////////////////
+
+CNetImageStream::CNetImageStream(unsigned connectionCount, unsigned blockSize, unsigned window)
+{
+  WSADATA wsaData;
+  WSAStartup(MAKEWORD(2, 2), &wsaData);
+  fOpenMode = forReading;
+  fConnectionCount = max(connectionCount, 1U);
+  fBlockSize = max(blockSize, 4096U);
+  fWindow = max(window, 1U);
+  fNextConnection = 0;
+  fPosition = fSize = fSentEnd = 0;
+  fWriteOffset = fReadOffset = fReadAheadEnd = 0;
+  fWriteLength = fReadLength = 0;
+  fReadAhead = 1;
+}
+
+CNetImageStream::~CNetImageStream()
+{
+  CloseConnections();
+  WSACleanup();
+}
+
+bool CNetImageStream::IsNetName(LPCWSTR name)
+{
+  return name != NULL && _wcsnicmp(name, cNetPrefix, wcslen(cNetPrefix)) == 0;
+}
+
+void CNetImageStream::ParseName()
+{
+  if (!NetParseName(fName, wcslen(cNetPrefix), fHost, fPort, fPath))
+    THROW_INT_EXC_PARAM1(EInternalException::netAddressError, fName.c_str());
+}
+
+void CNetImageStream::Open(LPCWSTR name, TOpenMode mode)
+{
+  TNetMessage msg;
+
+  fName = name;
+  fOpenMode = mode;
+  fPosition = fSize = fSentEnd = 0;
+  fWriteLength = fReadLength = 0;
+  fNextConnection = 0;
+  ParseName();
+
+  // the first connection opens the image, the others join its session
+  TConnection conn = { NetConnect(fHost, fPort, fName.c_str()), 0 };
+  fConnections.push_back(conn);
+  msg = NewNetMessage(mode == forWriting ? netOpenWrite : netOpenRead);
+  msg.length = (DWORD) fPath.length();
+  SendRequest(fConnections[0], msg, fPath.c_str());
+  ReceiveAnswer(fConnections[0], msg);
+  if (msg.type != netAck)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  unsigned __int64 session = msg.value;
+  fSize = msg.offset;
+
+  for (unsigned i=1; i<fConnectionCount; i++) {
+    TConnection conn = { NetConnect(fHost, fPort, fName.c_str()), 0 };
+    fConnections.push_back(conn);
+    msg = NewNetMessage(netJoin);
+    msg.value = session;
+    SendRequest(fConnections.back(), msg, NULL);
+  }
+  for (unsigned i=1; i<fConnectionCount; i++)
+    ReceiveAck(fConnections[i]);
+
+  if (mode == forWriting)
+    fWriteBlock.resize(fBlockSize);
+  else
+    fReadBlock.resize(fBlockSize);
+  fReadAhead = 1;
+}
+
+void CNetImageStream::Close()
+{
+  if (fOpenMode == forWriting && !fConnections.empty()) {
+    try {
+      Flush();
+    } catch (...) {
+      CloseConnections();
+      throw;
+    }
+  }
+  CloseConnections();
+}
+
+void CNetImageStream::CloseConnections()
+{
+  TNetMessage msg = NewNetMessage(netClose);
+
+  for (size_t i=0; i<fConnections.size(); i++) {
+    // answers not yet received are dropped by closing the connection
+    NetSendMessage(fConnections[i].socket, msg, NULL);
+    closesocket(fConnections[i].socket);
+  }
+  fConnections.clear();
+  fReadRequests.clear();
+  fReadLength = fWriteLength = 0;
+}
+
+void CNetImageStream::SendRequest(TConnection& conn, const TNetMessage& msg, const void* payload)
+{
+  if (!NetSendMessage(conn.socket, msg, payload))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netSendError, fName.c_str());
+  if (msg.type != netClose)
+    ++conn.pending;
+}
+
+void CNetImageStream::ReceiveAnswer(TConnection& conn, TNetMessage& msg)
+{
+  if (!NetReceiveAll(conn.socket, &msg, sizeof(msg)))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+  if (msg.magic != kNetMagic || msg.length > kNetMaxPayload)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  --conn.pending;
+  if (msg.type == netError) {
+    std::string message(msg.length, '\0');
+    if (msg.length > 0 && !NetReceiveAll(conn.socket, &message[0], msg.length))
+      THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+    THROW_INT_EXC_PARAM1(EInternalException::netServerError, (LPCWSTR) CA2W(message.c_str(), CP_UTF8));
+  }
+}
+
+void CNetImageStream::ReceiveAck(TConnection& conn)
+{
+  TNetMessage msg;
+  ReceiveAnswer(conn, msg);
+  if (msg.type != netAck || msg.length != 0)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+}
+
+void CNetImageStream::WaitForAcks()
+{
+  for (size_t i=0; i<fConnections.size(); i++) {
+    while (fConnections[i].pending > 0)
+      ReceiveAck(fConnections[i]);
+  }
+}
+
+void CNetImageStream::Flush()
+{
+  SendWriteBlock();
+  WaitForAcks();
+  TNetMessage msg = NewNetMessage(netFlush);
+  SendRequest(fConnections[0], msg, NULL);
+  ReceiveAck(fConnections[0]);
+}
+
+void CNetImageStream::SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */)
+{
+  Flush();
+}
+
+unsigned __int64 CNetImageStream::GetSize() const
+{
+  return max(fSize, fWriteOffset + fWriteLength);
+}
+
+void CNetImageStream::Seek(__int64 offset, DWORD moveMethod)
+{
+  __int64 base = moveMethod == FILE_BEGIN ? 0 : moveMethod == FILE_CURRENT ? (__int64) fPosition : (__int64) GetSize();
+  if (base + offset < 0)
+    THROW_OS_EXC_PARAM1(ERROR_NEGATIVE_SEEK, EWinException::seekError, fName.c_str());
+  // data are sent or requested when the stream is read or written at the new position
+  fPosition = base + offset;
+}
+
+//---------------------------------------------------------------------------
+// writing
+
+void CNetImageStream::Write(void *buffer, unsigned nLength, unsigned *nBytesWritten)
+{
+  const BYTE* data = (const BYTE*) buffer;
+  unsigned remaining = nLength;
+
+  while (remaining > 0) {
+    // the block in fWriteBlock is extended or overwritten, anything else starts a new block
+    if (fWriteLength > 0 && (fPosition < fWriteOffset || fPosition > fWriteOffset + fWriteLength))
+      SendWriteBlock();
+    if (fWriteLength == 0)
+      fWriteOffset = fPosition;
+    unsigned __int64 blockEnd = (fWriteOffset / fBlockSize + 1) * fBlockSize;
+    unsigned count = (unsigned) min((unsigned __int64) remaining, blockEnd - fPosition);
+    memcpy(&fWriteBlock[(size_t) (fPosition - fWriteOffset)], data, count);
+    fPosition += count;
+    fWriteLength = max(fWriteLength, (unsigned) (fPosition - fWriteOffset));
+    data += count;
+    remaining -= count;
+    if (fWriteOffset + fWriteLength == blockEnd)
+      SendWriteBlock();
+  }
+  *nBytesWritten = nLength;
+}
+
+void CNetImageStream::SendWriteBlock()
+{
+  if (fWriteLength == 0)
+    return;
+  // blocks are written by different threads of the server, data already sent must be
+  // written before they are overwritten
+  if (fWriteOffset < fSentEnd)
+    WaitForAcks();
+  TConnection& conn = fConnections[fNextConnection++ % fConnections.size()];
+  if (conn.pending >= fWindow)
+    ReceiveAck(conn);
+  TNetMessage msg = NewNetMessage(netWrite);
+  msg.offset = fWriteOffset;
+  msg.length = fWriteLength;
+  SendRequest(conn, msg, &fWriteBlock[0]);
+  fSentEnd = max(fSentEnd, fWriteOffset + fWriteLength);
+  fSize = max(fSize, fSentEnd);
+  fWriteLength = 0;
+}
+
+//---------------------------------------------------------------------------
+// reading
+
+void CNetImageStream::Read(void * buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  BYTE* data = (BYTE*) buffer;
+  unsigned total = 0;
+
+  if (fOpenMode == forWriting) {
+    // read back data written before
+    SendWriteBlock();
+    WaitForAcks();
+    fReadBlock.resize(fBlockSize);
+  }
+  while (total < nLength && fPosition < fSize) {
+    if (fPosition >= fReadOffset && fPosition < fReadOffset + fReadLength) {
+      unsigned count = (unsigned) min((unsigned __int64) (nLength - total), fReadOffset + fReadLength - fPosition);
+      memcpy(data + total, &fReadBlock[(size_t) (fPosition - fReadOffset)], count);
+      fPosition += count;
+      total += count;
+    } else {
+      FillReadBlock();
+    }
+  }
+  if (fOpenMode == forWriting) {
+    // only acknowledgements may be on the way when writing continues
+    DiscardReadAhead();
+  }
+  *nBytesRead = total;
+}
+
+void CNetImageStream::FillReadBlock()
+{
+  // blocks before the position are skipped, a position outside of the blocks
+  // requested starts a new read ahead at the block of the position
+  while (!fReadRequests.empty() && fReadRequests.front().offset + fReadRequests.front().length <= fPosition)
+    ReceiveReadBlock();
+  if (fReadRequests.empty() || fReadRequests.front().offset > fPosition) {
+    DiscardReadAhead();
+    fReadAheadEnd = fPosition - fPosition % fBlockSize;
+    fReadAhead = 1;
+  }
+  RequestReadAhead();
+  ReceiveReadBlock();
+
+  // like TCP the read ahead grows with every block read in sequence
+  unsigned maxReadAhead = fWindow * (unsigned) fConnections.size();
+  fReadAhead = min(fReadAhead * 2, maxReadAhead);
+  RequestReadAhead();
+}
+
+void CNetImageStream::RequestReadAhead()
+{
+  while (fReadRequests.size() < fReadAhead && fReadAheadEnd < fSize) {
+    unsigned index = fNextConnection++ % fConnections.size();
+    TReadRequest request = { index, fReadAheadEnd, (unsigned) min((unsigned __int64) fBlockSize, fSize - fReadAheadEnd) };
+    TNetMessage msg = NewNetMessage(netRead);
+    msg.offset = request.offset;
+    msg.value = request.length;
+    SendRequest(fConnections[index], msg, NULL);
+    fReadRequests.push_back(request);
+    fReadAheadEnd += request.length;
+  }
+}
+
+void CNetImageStream::ReceiveReadBlock()
+{
+  TNetMessage msg;
+  TReadRequest request = fReadRequests.front();
+  TConnection& conn = fConnections[request.connection];
+
+  // the answers of a connection arrive in the order of its requests
+  fReadRequests.pop_front();
+  ReceiveAnswer(conn, msg);
+  if (msg.type != netData || msg.length > request.length)
+    THROW_INT_EXC(EInternalException::netProtocolError);
+  if (!NetReceiveAll(conn.socket, &fReadBlock[0], msg.length))
+    THROW_OS_EXC_PARAM1(WSAGetLastError(), EWinException::netReceiveError, fName.c_str());
+  fReadOffset = request.offset;
+  fReadLength = msg.length;
+  // an image that got shorter while it is read ends here
+  if (msg.length < request.length)
+    fSize = min(fSize, request.offset + msg.length);
+}
+
+void CNetImageStream::DiscardReadAhead()
+{
+  while (!fReadRequests.empty())
+    ReceiveReadBlock();
+  fReadLength = 0;
+}
@@ -0,0 +1,136 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETIMAGESTREAM_H__
+#define __NETIMAGESTREAM_H__
+
+#include <string>
+#include <vector>
+#include <deque>
+#include "IImageStream.h"
+#include "NetProtocol.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Subclass reading and writing an image file stored by an image server (see CNetImageServer)
+// The name of the image is odin://host[:port]/path, the path is relative to the directory of
+// the server. The stream is striped across several TCP connections: data are sent in blocks
+// that start at multiples of the block size of the image file, consecutive blocks go to the
+// connections in turn and each connection may have several blocks on the way before their
+// acknowledgements are received. Reading requests the blocks ahead of the read position the
+// same way, the number of blocks requested ahead grows while the image is read sequentially.
+// Blocks that overwrite data already sent (e.g. the file header) are sent after all blocks
+// on the way were acknowledged. Errors of the server are reported by the next call that
+// receives an answer, at the latest by Flush() or Close().
+//////////////////////////////////////////////////////////////////////////////////////////////////
+class CNetImageStream: public IImageStream
+{
+public:
+  CNetImageStream(unsigned connectionCount = 4, unsigned blockSize = 1024 * 1024, unsigned window = 8);
+  virtual ~CNetImageStream();
+
+  // true if name is the name of a network image (starts with odin://)
+  static bool IsNetName(LPCWSTR name);
+
+  virtual LPCWSTR GetName() const {
+    return fName.c_str();
+  }
+  virtual void Open(LPCWSTR name, TOpenMode mode);
+  virtual void Close();
+  virtual unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
+  virtual void Seek(__int64 offset, DWORD moveMethod);
+  virtual unsigned __int64 GetSize() const;
+  virtual unsigned __int64 GetAllocatedBytes() const {
+    return GetSize();
+  }
+  virtual bool IsDrive() const {
+    return false;
+  }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const {
+    return NULL;
+  }
+  virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes);
+
+  // send buffered data and return when the server has written all data to disk
+  void Flush();
+
+  unsigned GetConnectionCount() const {
+    return fConnectionCount;
+  }
+
+private:
+  typedef struct {
+    SOCKET socket;
+    unsigned pending;  // requests sent whose answer is not yet received
+  } TConnection;
+
+  typedef struct {
+    unsigned connection;
+    unsigned __int64 offset;
+    unsigned length;
+  } TReadRequest;
+
+  void ParseName();
+  void CloseConnections();
+  void SendRequest(TConnection& conn, const TNetMessage& msg, const void* payload);
+  void ReceiveAnswer(TConnection& conn, TNetMessage& msg);
+  void ReceiveAck(TConnection& conn);
+  void WaitForAcks();
+  void SendWriteBlock();
+  void FillReadBlock();
+  void RequestReadAhead();
+  void ReceiveReadBlock();
+  void DiscardReadAhead();
+
+  std::wstring       fName;
+  std::string        fHost;
+  std::string        fPort;
+  std::string        fPath;     // path of image relative to the directory of the server (UTF-8)
+  TOpenMode          fOpenMode;
+  unsigned           fConnectionCount;
+  unsigned           fBlockSize;
+  unsigned           fWindow;   // requests per connection sent before the first answer is awaited
+  std::vector<TConnection> fConnections;
+  unsigned           fNextConnection;
+  unsigned __int64   fPosition;
+  unsigned __int64   fSize;     // size of image file on server including all data sent
+  // writing
+  std::vector<BYTE>  fWriteBlock;
+  unsigned __int64   fWriteOffset;
+  unsigned           fWriteLength;
+  unsigned __int64   fSentEnd;  // end of the data sent so far
+  // reading
+  std::deque<TReadRequest> fReadRequests;  // requests sent, in order of offset
+  std::vector<BYTE>  fReadBlock;
+  unsigned __int64   fReadOffset;
+  unsigned           fReadLength;
+  unsigned __int64   fReadAheadEnd;  // end of the data requested so far
+  unsigned           fReadAhead;     // number of blocks to request ahead
+};
+
+#endif
@@ -0,0 +1,173 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "NetProtocol.h"
+#include "OSException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+// largest block passed to a single send() or recv()
+static const int cMaxTransferSize = 1024 * 1024 * 1024;
+
+static void SetConnectionClosedError()
+{
+#ifdef _WIN32
+  WSASetLastError(WSAECONNRESET);
+#else
+  errno = ECONNRESET;
+#endif
+}
+
+TNetMessage NewNetMessage(TNetMessageType type)
+{
+  TNetMessage msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.magic = kNetMagic;
+  msg.type = type;
+  return msg;
+}
+
+bool NetSendAll(SOCKET s, const void* buffer, size_t length)
+{
+  const char* pos = (const char*) buffer;
+  while (length > 0) {
+    int n = send(s, pos, (int) min(length, (size_t) cMaxTransferSize), 0);
+    if (n == SOCKET_ERROR) {
+#ifndef _WIN32
+      if (errno == EINTR)
+        continue;
+#endif
+      return false;
+    }
+    pos += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool NetReceiveAll(SOCKET s, void* buffer, size_t length)
+{
+  char* pos = (char*) buffer;
+  while (length > 0) {
+    int n = recv(s, pos, (int) min(length, (size_t) cMaxTransferSize), 0);
+    if (n == SOCKET_ERROR) {
+#ifndef _WIN32
+      if (errno == EINTR)
+        continue;
+#endif
+      return false;
+    }
+    if (n == 0) {
+      SetConnectionClosedError();
+      return false;
+    }
+    pos += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool NetSendMessage(SOCKET s, const TNetMessage& msg, const void* payload)
+{
+  if (!NetSendAll(s, &msg, sizeof(msg)))
+    return false;
+  return msg.length == 0 || NetSendAll(s, payload, msg.length);
+}
+
+bool NetReceiveMessage(SOCKET s, TNetMessage& msg)
+{
+  if (!NetReceiveAll(s, &msg, sizeof(msg)))
+    return false;
+  return msg.magic == kNetMagic && msg.type >= netOpenRead && msg.type <= netCast && msg.length <= kNetMaxPayload;
+}
+
+void NetSetSocketOptions(SOCKET s)
+{
+  // a window of several MB keeps a connection busy on links with some latency,
+  // the send and receive buffers must be set before the connection is established
+  int bufferSize = 4 * 1024 * 1024;
+  int noDelay = 1;
+  setsockopt(s, SOL_SOCKET, SO_SNDBUF, (const char*) &bufferSize, sizeof(bufferSize));
+  setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*) &bufferSize, sizeof(bufferSize));
+  setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*) &noDelay, sizeof(noDelay));
+}
+
+bool NetParseName(const std::wstring& name, size_t prefixLength, std::string& host, std::string& port,
+                  std::string& path, unsigned short defaultPort)
+{
+  // prefix host[:port]/path, an IPv6 address is enclosed in brackets
+  std::string address = (LPCSTR) CW2A(name.c_str() + min(prefixLength, name.length()), CP_UTF8);
+  size_t pathStart = address.find('/');
+  std::string hostPort = address.substr(0, pathStart);
+  size_t portStart = hostPort.rfind(':');
+
+  if (!hostPort.empty() && hostPort[0] == '[') {
+    size_t hostEnd = hostPort.find(']');
+    if (hostEnd == std::string::npos)
+      return false;
+    host = hostPort.substr(1, hostEnd - 1);
+    portStart = hostPort.find(':', hostEnd);
+  } else {
+    host = hostPort.substr(0, portStart);
+  }
+  port = portStart == std::string::npos ? std::to_string(defaultPort) : hostPort.substr(portStart + 1);
+  path = pathStart == std::string::npos ? std::string() : address.substr(pathStart + 1);
+  return !host.empty() && !path.empty() && !port.empty() && port.length() <= 5 &&
+         port.find_first_not_of("0123456789") == std::string::npos && atoi(port.c_str()) <= 65535;
+}
+
+SOCKET NetConnect(const std::string& host, const std::string& port, LPCWSTR name)
+{
+  struct addrinfo hints, *addresses;
+  SOCKET s = INVALID_SOCKET;
+  int error = WSAHOST_NOT_FOUND;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_protocol = IPPROTO_TCP;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0)
+    THROW_OS_EXC_PARAM1(WSAHOST_NOT_FOUND, EWinException::netConnectError, name);
+  for (struct addrinfo* addr = addresses; addr != NULL && s == INVALID_SOCKET; addr = addr->ai_next) {
+    s = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if (s == INVALID_SOCKET) {
+      error = WSAGetLastError();
+      continue;
+    }
+    NetSetSocketOptions(s);
+    if (connect(s, addr->ai_addr, (int) addr->ai_addrlen) == SOCKET_ERROR) {
+      error = WSAGetLastError();
+      closesocket(s);
+      s = INVALID_SOCKET;
+    }
+  }
+  freeaddrinfo(addresses);
+  if (s == INVALID_SOCKET)
+    THROW_OS_EXC_PARAM1(error, EWinException::netConnectError, name);
+  return s;
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETPROTOCOL_H__
+#define __NETPROTOCOL_H__
+
+#include <string>
+#include "NetSocket.h"
+
+//---------------------------------------------------------------------------
+// Protocol between the network image stream and the image server
+// Every message starts with a fixed header of 32 bytes in little endian byte
+// order, followed by length bytes of payload for messages that carry data.
+// A client opens an image on its first connection and gets a session id, its
+// other connections join the session. Each connection is served by its own
+// thread of the server and answers requests in the order they arrive, so a
+// client can send several requests before it waits for their answers.
+//
+//   request        offset      value       length            answer
+//   netOpenRead    -           -           path (UTF-8)      netAck: value = session, offset = size
+//   netOpenWrite   -           -           path (UTF-8)      netAck: value = session, offset = 0
+//   netJoin        -           session     0                 netAck
+//   netWrite       position    -           data              netAck
+//   netRead        position    bytes       0                 netData: data, shorter at end of image
+//   netFlush       -           -           0                 netAck when data are on disk
+//   netClose       -           -           0                 none, connection is closed
+//   netCast        -           -           path (UTF-8)      netAck: value = prefix length, offset = size,
+//                                                            then netData: prefix and data up to size
+//
+// A failed request is answered with netError: status is the error code of the
+// server, the payload is its message (UTF-8).
+//
+// netCast restores an image to many clients at once (see NetCastRound.h): the
+// server decodes the image once and sends each client the same uncompressed
+// image, a prefix of header, checksum, comment and allocation map followed by
+// the volume data. The data is pushed without further requests, a client reads
+// it in order.
+
+const DWORD kNetMagic = 0x4E4E4944; // "DINN"
+const unsigned short kNetDefaultPort = 7931;
+const DWORD kNetMaxPayload = 64 * 1024 * 1024;
+
+typedef enum TNetMessageType {netOpenRead = 1, netOpenWrite, netJoin, netWrite, netRead, netFlush, netClose,
+  netAck, netData, netError, netCast};
+
+#pragma pack(push, 1)
+typedef struct {
+  DWORD magic;
+  DWORD type;
+  unsigned __int64 offset;
+  unsigned __int64 value;
+  DWORD length;
+  DWORD status;
+} TNetMessage;
+#pragma pack(pop)
+
+// a message of type with all other fields 0
+TNetMessage NewNetMessage(TNetMessageType type);
+
+// send and receive exactly length bytes, false if the connection failed, the error
+// is then returned by WSAGetLastError(), a connection closed by the peer is WSAECONNRESET
+bool NetSendAll(SOCKET s, const void* buffer, size_t length);
+bool NetReceiveAll(SOCKET s, void* buffer, size_t length);
+
+// send a message header and its payload (length bytes given in the header)
+bool NetSendMessage(SOCKET s, const TNetMessage& msg, const void* payload);
+// receive a message header, false on errors or an invalid header
+bool NetReceiveMessage(SOCKET s, TNetMessage& msg);
+
+// split a name <prefix>host[:port]/path, the prefix has prefixLength characters,
+// false if host or path are missing or the port is invalid
+bool NetParseName(const std::wstring& name, size_t prefixLength, std::string& host, std::string& port,
+                  std::string& path, unsigned short defaultPort = kNetDefaultPort);
+// connect to host, throws EWinException::netConnectError with name if it fails
+SOCKET NetConnect(const std::string& host, const std::string& port, LPCWSTR name);
+
+// set large socket buffers and disable Nagle's algorithm, before connect() or listen()
+void NetSetSocketOptions(SOCKET s);
+
+#endif
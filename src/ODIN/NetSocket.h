@@ -0,0 +1,40 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __NETSOCKET_H__
+#define __NETSOCKET_H__
+
+//---------------------------------------------------------------------------
+// Sockets of the network image stream and the image server: Winsock 2 on
+// Windows (included by stdafx.h before windows.h), its subset in
+// posix/PosixSocket.h on POSIX systems
+
+#ifdef _WIN32
+  #pragma comment(lib, "ws2_32.lib")
+#else
+  #include "posix/PosixSocket.h"
+#endif
+
+#endif
@@ -585,6 +585,18 @@ void CODINDlg::ReadImageFileInformation()
 
 void CODINDlg::CheckVerifyResult()
 {
+  if (fOdinManager.WasBlockVerify()) {
+    const std::vector<TImageRange>& ranges = fOdinManager.GetCorruptRanges();
+    if (ranges.empty()) {
+      AtlMessageBox(this->m_hWnd,IDS_VERIFY_OK, IDS_VERIFY_TITLE, MB_OK);
+    } else {
+      ATL::CString text;
+      text.FormatMessageW(IDS_VERIFY_BLOCKS_FAILED, (unsigned) ranges.size(), ranges[0].offset, ranges[0].length);
+      AtlMessageBox(this->m_hWnd, (LPCWSTR)text, IDS_VERIFY_TITLE, MB_OK|MB_ICONEXCLAMATION);
+    }
+    return;
+  }
+
   DWORD verifyCrc32 = fOdinManager.GetVerifiedChecksum();
   if (fCrc32FromFileHeader == verifyCrc32)
     AtlMessageBox(this->m_hWnd,IDS_VERIFY_OK, IDS_VERIFY_TITLE, MB_OK);
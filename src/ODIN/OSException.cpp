@@ -45,6 +45,9 @@ LPCWSTR EWinException::sMessages[] = {
   L"Failed to write to volume: {0}", // writeVolumeError
   L"Failed to seek in file or volume {0}", // seekError 
   L"Problem with file or directory \"{0}\"", // generalFileError 
+  L"Failed to connect to image server of {0}", // netConnectError
+  L"Failed to send to image server of {0}", // netSendError
+  L"Failed to receive from image server of {0}", // netReceiveError
 };
 
 
@@ -64,6 +67,7 @@ void EWinException::AppendWindowsMessage()
 
 void EWinException::AppendNtStatusMessage()
 {
+#ifdef _WIN32
   const int STATUS_SHARING_VIOLATION = 0xc0000043; /* (kernel error code STATUS_SHARING_VIOLATION) */
   // documentation see MS KnowledgeBase article id 259693 
   if (fErrorCode != 0) {
@@ -90,5 +94,9 @@ void EWinException::AppendNtStatusMessage()
       FreeLibrary(handle);
     }
   }
+#else
+  // status codes of the NT kernel only occur when opening Windows devices
+  AppendWindowsMessage();
+#endif
 }
 
@@ -80,7 +80,8 @@ class EWinException : public Exception
   public:
   
   typedef enum ExceptionCode {noCode, testError, fileOpenError, volumeOpenError, ioControlError, closeHandleError,
-    readFileError, writeFileError, readVolumeError, writeVolumeError, seekError, generalFileError};
+    readFileError, writeFileError, readVolumeError, writeVolumeError, seekError, generalFileError,
+    netConnectError, netSendError, netReceiveError};
 
   EWinException(int winRetCode)
     : Exception(OSException)
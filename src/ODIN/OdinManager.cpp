@@ -29,15 +29,30 @@
 #include "OdinThread.h"
 #include "WriteThread.h"
 #include "ReadThread.h"
+#include "FanOutThread.h"
+#include "CompareThread.h"
+#include "MediaHash.h"
+#include "BlockVerifyThread.h"
 #include "CompressionThread.h"
 #include "DecompressionThread.h"
+#include "ChunkingThread.h"
+#include "DechunkingThread.h"
+#include "ChunkStore.h"
+#include "BlockHashTable.h"
+#include "RestoreChain.h"
+#include "CheckpointJournal.h"
 #include "BufferQueue.h"
 #include "ImageStream.h"
+#include "CompressedRunLengthStream.h"
 #include "OdinManager.h"
-#include "DriveList.h"
 #include "InternalException.h"
+#include "FileFormatException.h"
 #include "SplitManager.h"
-#include "VSSWrapper.h"
+#include "Throttle.h"
+#ifdef _WIN32
+  #include "DriveList.h"
+  #include "VSSWrapper.h"
+#endif
 
 #ifdef DEBUG
   #define new DEBUG_NEW
@@ -47,6 +62,9 @@
 using namespace std;
 
 static const int kDoCopyBufferCount = 8;
+static const unsigned kMaxBlockVerifyThreads = 16;
+// MB between two checkpoints of a resumed operation if no interval is configured
+static const unsigned kResumeCheckpointInterval = 1024;
 
 // section name in .ini file for configuration values
 IMPL_SECTION(COdinManager, L"Options")
@@ -57,10 +75,44 @@ COdinManager::COdinManager()
    fSplitFiles(L"SplitFiles", false),
    fSplitFileSize(L"SplitFileSize", 0),
    fReadBlockSize(L"ReadWriteBlockSize", 1048576), // 1MB
-   fTakeVSSSnapshot(L"TakeVSSSnaphot", false)
+   fTakeVSSSnapshot(L"TakeVSSSnaphot", false),
+   fBlockManifestSize(L"BlockManifestBlockSize", 1048576), // 1MB
+   fParallelVerify(L"ParallelBlockVerify", true),
+   fChunkPrefetchThreads(L"ChunkPrefetchThreads", 4),
+   fBlockHashSize(L"BlockHashBlockSize", 1048576), // 1MB
+   fDeltaRestore(L"DeltaRestore", false),
+   fDeltaCompareSize(L"DeltaCompareBlockSize", 65536), // 64KB
+   fFanOutMaxLag(L"FanOutMaxLag", 8),
+   fFanOutDetachTimeout(L"FanOutDetachTimeout", 30),
+   fReadBackVerify(L"ReadBackVerify", false),
+   fReadBackDistance(L"ReadBackDistance", 8388608), // 8MB
+   fReadBackQueueDepth(L"ReadBackQueueDepth", 64),
+   fReadBackRetentionSize(L"ReadBackRetentionSize", 33554432), // 32MB
+   fCompareMaxRanges(L"CompareMaxRanges", 10000),
+   fReadLimit(L"ReadLimitMBPerSecond", 0),
+   fReadOpsLimit(L"ReadLimitIOPS", 0),
+   fWriteLimit(L"WriteLimitMBPerSecond", 0),
+   fWriteOpsLimit(L"WriteLimitIOPS", 0),
+   fLowIoPriority(L"LowIoPriority", false),
+   fCheckpointInterval(L"CheckpointIntervalMB", 0)
 {
   fVerifyCrc32 = 0;
+  fIsBlockVerify = false;
   fWasCancelled = false;
+  fRestoreChainIndex = 0;
+  fDeltaSkippedBytes = 0;
+  fReadBackVerifiedBytes = 0;
+  fSourceCrc32 = 0;
+  fSourceHasChecksum = false;
+  fMediaHashAlgorithms = 0;
+  fMediaHashUsedClustersOnly = false;
+  fCompareDifferingBytes = 0;
+  fComparedBytes = 0;
+  fResume = false;
+  fResumedBytes = 0;
+  fReadThrottle = std::make_unique<CThrottle>();
+  fWriteThrottle = std::make_unique<CThrottle>();
+  UseConfiguredLimits();
   Init();
 }
 
@@ -74,27 +126,54 @@ void COdinManager::Init()
   fReadThread.reset();
   fWriteThread.reset();
   fCompDecompThread.reset();
+  fTranscodeThread.reset();
+  fFanOutWriteThreads.clear();
+  fFanOutThread.reset();
+  fBlockVerifyThreads.clear();
+  fBlockManifest.reset();
+  fChunkStore.reset();
+  fBlockHashes.reset();
+  fBaseBlockHashes.reset();
   fSourceImage.reset();
   fTargetImage.reset();
+  fFanOutTargetImages.clear();
+  fFanOutRunLengthReaders.clear();
+  fCompareReadThread.reset();
+  fCompareThread.reset();
+  fCompareRunLengthReader.reset();
   fEmptyReaderQueue.reset();
   fFilledReaderQueue.reset();
   fEmptyCompDecompQueue.reset();
   fFilledCompDecompQueue.reset();
+  fEmptyTranscodeQueue.reset();
+  fFilledTranscodeQueue.reset();
+  fEmptyCompareQueue.reset();
+  fFilledCompareQueue.reset();
   fSplitCallback.reset();
+  fTargetSplitCallback.reset();
+  fJournal.reset();
   fIsSaving = false;
   fIsRestoring = false;
-  fVSS.reset();
+  fIsTranscoding = false;
+  fIsComparing = false;
   fMultiVolumeMode = false;
   fMultiVolumeIndex = 0;
+#ifdef _WIN32
+  fVSS.reset();
   if (!CVssWrapper::VSSIsSupported()) {
     fTakeVSSSnapshot = false;
   }
+#else
+  fTakeVSSSnapshot = false;
+#endif
 }
   
+#ifdef _WIN32
 void COdinManager::RefreshDriveList()
 {
   fDriveList = std::make_unique<CDriveList>(false);
 }
+#endif
 
   // Terminates all worker threads, bCancelled indicates if this is 
   // becuse a running operation was aborted.
@@ -109,34 +188,75 @@ void COdinManager::Terminate()
   if (fCompDecompThread) {
     fCompDecompThread->Terminate();
   }
+  if (fTranscodeThread) {
+    fTranscodeThread->Terminate();
+  }
+  if (fFanOutThread) {
+    fFanOutThread->Terminate();
+  }
+  if (fCompareReadThread) {
+    fCompareReadThread->Terminate();
+  }
+  if (fCompareThread) {
+    fCompareThread->Terminate();
+  }
+  for (size_t i=0; i<fFanOutWriteThreads.size(); i++)
+    fFanOutWriteThreads[i]->Terminate();
+  for (size_t i=0; i<fBlockVerifyThreads.size(); i++)
+    fBlockVerifyThreads[i]->Terminate();
+  fRestoreChain.reset();
+#ifdef _WIN32
   if (fVSS && !fMultiVolumeMode) {
     fVSS->ReleaseSnapshot(fWasCancelled);
     fVSS.reset();
   }
+#endif
   Reset();
 }
 
 void COdinManager::Reset()
 {
+  fErrorMessage.clear();
   fReadThread.reset();
   fWriteThread.reset();
   fCompDecompThread.reset();
+  fTranscodeThread.reset();
+  fFanOutWriteThreads.clear();
+  fFanOutThread.reset();
+  fBlockVerifyThreads.clear();
+  fBlockManifest.reset();
+  fChunkStore.reset();
+  fBlockHashes.reset();
+  fBaseBlockHashes.reset();
   fSourceImage.reset();
   fTargetImage.reset();
+  fFanOutTargetImages.clear();
+  fFanOutRunLengthReaders.clear();
+  fCompareReadThread.reset();
+  fCompareThread.reset();
+  fCompareRunLengthReader.reset();
   fEmptyReaderQueue.reset();
   fFilledReaderQueue.reset();
   fEmptyCompDecompQueue.reset();
   fFilledCompDecompQueue.reset();
+  fEmptyTranscodeQueue.reset();
+  fFilledTranscodeQueue.reset();
+  fEmptyCompareQueue.reset();
+  fFilledCompareQueue.reset();
   fSplitCallback.reset();
+  fTargetSplitCallback.reset();
+  fJournal.reset();
   if (fMultiVolumeMode) {
     fIsSaving = false;
     fIsRestoring = false;
+    fIsTranscoding = false;
+    fIsComparing = false;
   } else {
-    fVSS.reset();
     Init();
   }
 }
 
+#ifdef _WIN32
 CDriveInfo* COdinManager::GetDriveInfo(int index) {
   return fDriveList->GetItem(index);
 }
@@ -145,22 +265,583 @@ unsigned COdinManager::GetDriveCount() {
     return (unsigned) fDriveList->GetCount();
   }
 
+void COdinManager::GetVolumeInfo(int driveIndex, TVolumeInfo& volume)
+{
+  CDriveInfo* pDriveInfo = fDriveList->GetItem(driveIndex);
+  volume.deviceName = pDriveInfo->GetDeviceName();
+  volume.mountPoint = pDriveInfo->GetMountPoint();
+  volume.clusterSize = pDriveInfo->GetClusterSize();
+  volume.containedVolumes = pDriveInfo->GetContainedVolumes();
+  volume.isHardDisk = pDriveInfo->IsCompleteHardDisk();
+}
+
 void COdinManager::SavePartition(int driveIndex, LPCWSTR fileName, ISplitManagerCallback* cb, IWaitCallback* wcb)
 {
-  DoCopy(isBackup, fileName, driveIndex, 0, 0, cb, wcb);
+  TVolumeInfo volume;
+  GetVolumeInfo(driveIndex, volume);
+  fMediaHashes.clear();
+  DoCopy(isBackup, fileName, &volume, 0, 0, cb, wcb);
 }
 
 void COdinManager::RestorePartition(LPCWSTR fileName, int driveIndex, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb)
 {
-  DoCopy(isRestore, fileName, driveIndex, noFiles, totalSize, cb, wcb);
+  TVolumeInfo volume;
+  GetVolumeInfo(driveIndex, volume);
+  DoRestore(fileName, volume, noFiles, totalSize, cb, wcb);
+}
+#endif
+
+void COdinManager::SaveVolume(LPCWSTR volumeName, LPCWSTR fileName, ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  TVolumeInfo volume;
+  volume.deviceName = volumeName;
+  fMediaHashes.clear();
+  DoCopy(isBackup, fileName, &volume, 0, 0, cb, wcb);
+}
+
+void COdinManager::RestoreVolume(LPCWSTR fileName, LPCWSTR volumeName, unsigned noFiles, unsigned __int64 totalSize,
+                                 ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  TVolumeInfo volume;
+  volume.deviceName = volumeName;
+  DoRestore(fileName, volume, noFiles, totalSize, cb, wcb);
+}
+
+void COdinManager::DoRestore(LPCWSTR fileName, const TVolumeInfo& volume, unsigned noFiles, unsigned __int64 totalSize,
+                             ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  // an incremental image is restored by restoring all images of its chain one
+  // after the other starting with the full image (see ContinueRestoreChain())
+  fRestoreChain.reset();
+  fDeltaSkippedBytes = 0;
+  fReadBackVerifiedBytes = 0;
+  fMediaHashes.clear();
+  if (noFiles == 0) {
+    std::unique_ptr<CRestoreChain> chain = std::make_unique<CRestoreChain>();
+    chain->Load(fileName);
+    if (chain->GetImageCount() > 1) {
+      fRestoreChain = std::move(chain);
+      fRestoreChainIndex = 0;
+      fRestoreVolume = volume;
+      fileName = fRestoreChain->GetFileName(0);
+    }
+  }
+  DoCopy(isRestore, fileName, &volume, noFiles, totalSize, cb, wcb);
+}
+
+bool COdinManager::ContinueRestoreChain(IWaitCallback* wcb)
+{
+  if (!fRestoreChain || WasError() || fWasCancelled || fRestoreChainIndex + 1 >= fRestoreChain->GetImageCount())
+    return false;
+
+  // release threads and streams of the image just restored and start with the next one
+  Reset();
+  ++fRestoreChainIndex;
+  ATLTRACE(L"Continue restore chain with image: %s\n", fRestoreChain->GetFileName(fRestoreChainIndex));
+  DoCopy(isRestore, fRestoreChain->GetFileName(fRestoreChainIndex), &fRestoreVolume, 0, 0, NULL, wcb);
+  return true;
+}
+
+#ifdef _WIN32
+void COdinManager::RestorePartitionToDrives(LPCWSTR fileName, const std::vector<int>& driveIndexes, unsigned noFiles,
+                                            unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb)
+{
+  fRestoreChain.reset();
+  fDeltaSkippedBytes = 0;
+  fReadBackVerifiedBytes = 0;
+  fVerifyCrc32 = 0;
+  fIsBlockVerify = false;
+  fFanOutTargetFailed.clear();
+  fFanOutTargetErrors.clear();
+  fMediaHashes.clear();
+  if (noFiles == 0) {
+    CRestoreChain chain;
+    chain.Load(fileName);
+    if (chain.GetImageCount() > 1)
+      THROW_INT_EXC(EInternalException::fanOutIncremental);
+  }
+  if (fDeltaRestore && (fDeltaCompareSize <= 0 || fDeltaCompareSize % 512 != 0))
+    THROW_INT_EXC(EInternalException::inputError);
+
+  // setup source
+  fSourceImage = std::make_unique<CFileImageStream>();
+  CFileImageStream *fileStream = static_cast<CFileImageStream*>(fSourceImage.get());
+  if (noFiles > 0) {
+    fSourceImage->Open(NULL, IImageStream::forReading);
+    fSplitCallback = std::make_unique<CSplitManager>(fileName, fileStream, totalSize, cb);
+    fileStream->RegisterCallback(fSplitCallback.get());
+  } else {
+    fSourceImage->Open(fileName, IImageStream::forReading);
+  }
+  fileStream->ReadImageFileHeader(false);
+  const CImageFileHeader& header = fileStream->GetImageFileHeader();
+  TCompressionFormat decompressionFormat = header.GetCompressionFormat();
+
+  // read -> decompress -> fan out -> one write thread per drive, the chunks passed to
+  // the drives are shared, so the queue feeding the fan out needs room for the lag
+  int fanOutBufferCount = kDoCopyBufferCount + fFanOutMaxLag;
+  fWasCancelled = false;
+  fEmptyReaderQueue = std::make_unique<CImageBuffer>(fReadBlockSize, fanOutBufferCount, L"fEmptyReaderQueue");
+  fFilledReaderQueue = std::make_unique<CImageBuffer>(L"fFilledReaderQueue");
+  CImageBuffer *fanOutInQueue = fFilledReaderQueue.get();
+  CImageBuffer *fanOutOutQueue = fEmptyReaderQueue.get();
+
+  fReadThread = std::make_unique<CReadThread>(fSourceImage.get(), fEmptyReaderQueue.get(), fFilledReaderQueue.get(), false);
+  fReadThread->SetVolumeDataOffset(header.GetVolumeDataOffset());
+  fReadThread->SetVolumeDataSize(header.GetDataSize());
+  SetupIoBudget(fReadThread.get(), true);
+
+  if (decompressionFormat != noCompression) {
+    fEmptyCompDecompQueue = std::make_unique<CImageBuffer>(fReadBlockSize, fanOutBufferCount, L"fEmptyCompDecompQueue");
+    fFilledCompDecompQueue = std::make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+    if (decompressionFormat == compressionChunkStore) {
+      fChunkStore = std::make_unique<CChunkStore>();
+      fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), false);
+      fCompDecompThread = std::make_unique<CDechunkingThread>(fChunkStore.get(), fChunkPrefetchThreads,
+                            fanOutInQueue, fanOutOutQueue, fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    } else {
+      fCompDecompThread = std::make_unique<CDecompressionThread>(decompressionFormat, fanOutInQueue, fanOutOutQueue,
+                            fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    }
+    fanOutInQueue = fFilledCompDecompQueue.get();
+    fanOutOutQueue = fEmptyCompDecompQueue.get();
+  }
+
+  fFanOutThread = std::make_unique<CFanOutThread>(fanOutInQueue, fanOutOutQueue, fFanOutMaxLag, fFanOutDetachTimeout * 1000);
+  unsigned __int64 bitmapOffset, bitmapLength;
+  header.GetClusterBitmapOffsetAndLength(bitmapOffset, bitmapLength);
+  for (size_t i=0; i<driveIndexes.size(); i++) {
+    CDriveInfo* pDriveInfo = fDriveList->GetItem(driveIndexes[i]);
+    std::unique_ptr<CDiskImageStream> targetImage = std::make_unique<CDiskImageStream>();
+    targetImage->SetContainedSubPartitionsCount(pDriveInfo->GetContainedVolumes());
+    targetImage->Open(pDriveInfo->GetDeviceName().c_str(), IImageStream::forWriting);
+    targetImage->SetBytesPerCluster(pDriveInfo->GetClusterSize());
+
+    unsigned index = fFanOutThread->AddTarget();
+    std::unique_ptr<CWriteThread> writeThread = std::make_unique<CWriteThread>(targetImage.get(),
+      fFanOutThread->GetTargetQueue(index), fFanOutThread->GetTargetReturnQueue(index), false);
+    if (bitmapOffset != 0 && bitmapLength != 0) {
+      // the allocation map is read by each write thread on its own
+      fFanOutRunLengthReaders.push_back(std::unique_ptr<CompressedRunLengthStreamReader>(fileStream->NewRunLengthStreamReader()));
+      writeThread->SetAllocationMapReaderInfo(fFanOutRunLengthReaders.back().get(), header.GetClusterSize());
+    }
+    if (fDeltaRestore)
+      writeThread->SetDeltaRestore(fDeltaCompareSize);
+    if (fReadBackVerify)
+      SetupReadBackVerify(writeThread.get(), targetImage.get());
+    if (fMediaHashAlgorithms) {
+      writeThread->SetMediaHash(NewMediaHash(), header.GetVolumeSize());
+    }
+    SetupIoBudget(writeThread.get(), false);
+    fFanOutThread->SetTargetThread(index, writeThread.get());
+    fFanOutTargetImages.push_back(std::move(targetImage));
+    fFanOutWriteThreads.push_back(std::move(writeThread));
+  }
+  fIsRestoring = true;
+
+  fReadThread->Resume();
+  if (fCompDecompThread)
+    fCompDecompThread->Resume();
+  fFanOutThread->Resume();
+  for (size_t i=0; i<fFanOutWriteThreads.size(); i++)
+    fFanOutWriteThreads[i]->Resume();
+}
+#endif
+
+// let a write thread read back the restored data, the device is flushed before so that
+// the data are read from the media
+void COdinManager::SetupReadBackVerify(CWriteThread* writeThread, CDiskImageStream* target)
+{
+  if (fDeltaRestore)
+    THROW_INT_EXC(EInternalException::readBackWithDelta);
+  if (fReadBackDistance < 0 || fReadBackQueueDepth <= 0 || fReadBackRetentionSize <= 0)
+    THROW_INT_EXC(EInternalException::inputError);
+  writeThread->SetReadBackVerify(fReadBackDistance, fReadBackQueueDepth, fReadBackRetentionSize, target->GetFileHandle());
+}
+
+void COdinManager::SetReadLimit(unsigned mbPerSecond, unsigned iops)
+{
+  fJobReadLimit = mbPerSecond;
+  fJobReadOpsLimit = iops;
+  fReadThrottle->SetLimits((unsigned __int64) mbPerSecond * 1048576, iops);
+}
+
+void COdinManager::SetWriteLimit(unsigned mbPerSecond, unsigned iops)
+{
+  fJobWriteLimit = mbPerSecond;
+  fJobWriteOpsLimit = iops;
+  fWriteThrottle->SetLimits((unsigned __int64) mbPerSecond * 1048576, iops);
+}
+
+void COdinManager::UseConfiguredLimits()
+{
+  SetReadLimit(fReadLimit, fReadOpsLimit);
+  SetWriteLimit(fWriteLimit, fWriteOpsLimit);
+  fJobLowIoPriority = fLowIoPriority;
+  fJobCheckpointInterval = fCheckpointInterval;
+}
+
+// the threads always get the throttle, so that limits set while they run take effect
+void COdinManager::SetupIoBudget(COdinThread* thread, bool isReading)
+{
+  thread->SetIoBudget(isReading ? fReadThrottle.get() : fWriteThrottle.get(), fJobLowIoPriority);
+}
+
+// create the hash for the next volume of a backup or restore with the configured options
+// checkpoints are recorded for backups and restores of a single local image file, throws
+// if a resume was requested for other images
+bool COdinManager::IsJournaled(TOdinOperation operation, CFileImageStream* imageStream, TCompressionFormat format,
+                               bool isSplit) const
+{
+  bool journaled = GetCheckpointIntervalInUse() > 0 && imageStream->IsLocalFile() && !isSplit &&
+                   format != compressionChunkStore && fMediaHashAlgorithms == 0;
+  if (operation == isBackup)
+    journaled = journaled && fBaseImage.empty();
+  else
+    journaled = journaled && !fRestoreChain && !fDeltaRestore;
+  if (fResume && !journaled)
+    THROW_INT_EXC(EInternalException::resumeNotSupported);
+  return journaled;
+}
+
+// checkpoints are off unless an interval is configured or an operation is resumed
+unsigned COdinManager::GetCheckpointIntervalInUse() const
+{
+  return fJobCheckpointInterval == 0 && fResume ? kResumeCheckpointInterval : fJobCheckpointInterval;
+}
+
+// the journal of an operation that has completed is deleted, the one of a failed or
+// cancelled operation is kept to resume it
+void COdinManager::CloseJournal()
+{
+  if (fJournal) {
+    if (WasError() || fWasCancelled)
+      fJournal->Close();
+    else
+      fJournal->Remove();
+    fJournal.reset();
+  }
+}
+
+CMediaHash* COdinManager::NewMediaHash()
+{
+  CMediaHash::TScope scope = fMediaHashUsedClustersOnly ? CMediaHash::scopeUsedClusters : CMediaHash::scopeVolume;
+  fMediaHashes.push_back(std::make_unique<CMediaHash>(fMediaHashAlgorithms, scope));
+  return fMediaHashes.back().get();
+}
+
+const CMediaHash* COdinManager::GetMediaHash(unsigned index) const
+{
+  return index < fMediaHashes.size() ? fMediaHashes[index].get() : NULL;
+}
+
+void COdinManager::CollectFanOutResults()
+{
+  fFanOutTargetFailed.resize(fFanOutWriteThreads.size());
+  fFanOutTargetErrors.resize(fFanOutWriteThreads.size());
+  for (size_t i=0; i<fFanOutWriteThreads.size(); i++) {
+    CWriteThread* writeThread = fFanOutWriteThreads[i].get();
+    fFanOutTargetFailed[i] = writeThread->GetErrorFlag() || fFanOutThread->IsTargetDetached((unsigned) i);
+    if (writeThread->GetErrorFlag())
+      fFanOutTargetErrors[i] = writeThread->GetErrorMessage();
+    else
+      fFanOutTargetErrors[i] = fFanOutThread->GetTargetError((unsigned) i);
+    fDeltaSkippedBytes += writeThread->GetDeltaSkippedBytes();
+    fReadBackVerifiedBytes += writeThread->GetReadBackVerifiedBytes();
+  }
 }
 
 void COdinManager::VerifyPartition(LPCWSTR fileName, int driveIndex, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb)
 {
-  DoCopy(isVerify, fileName, -1, noFiles, totalSize, cb, wcb);
+  // images with a block manifest are checked block by block in parallel, others
+  // (and all images if disabled) by decompressing them and comparing the crc32
+  fCorruptRanges.clear();
+  if (fParallelVerify && DoBlockVerify(fileName, noFiles, totalSize, cb))
+    return;
+  DoCopy(isVerify, fileName, NULL, noFiles, totalSize, cb, wcb);
 }
 
+void COdinManager::TranscodeImage(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, LPCWSTR targetFileName,
+                                  ISplitManagerCallback* cb)
+{
+  TCompressionFormat targetFormat = GetCompressionMode();
+  fVerifyCrc32 = 0;
+  fIsBlockVerify = false;
+
+  // setup source file
+  fSourceImage = std::make_unique<CFileImageStream>();
+  CFileImageStream *sourceStream = static_cast<CFileImageStream*>(fSourceImage.get());
+  if (noFiles > 0) {
+    fSourceImage->Open(NULL, IImageStream::forReading);
+    fSplitCallback = std::make_unique<CSplitManager>(fileName, sourceStream, totalSize, cb);
+    sourceStream->RegisterCallback(fSplitCallback.get());
+  } else {
+    fSourceImage->Open(fileName, IImageStream::forReading);
+  }
+  sourceStream->ReadImageFileHeader(false);
+  const CImageFileHeader& header = sourceStream->GetImageFileHeader();
+  TCompressionFormat sourceFormat = header.GetCompressionFormat();
+  if (sourceFormat == compressionChunkStore && targetFormat == compressionChunkStore)
+    THROW_INT_EXC(EInternalException::transcodeDedupToDedup);
+
+  // setup target file, header, comment and allocation map are taken from the source
+  fTargetImage = std::make_unique<CFileImageStream>();
+  CFileImageStream *targetStream = static_cast<CFileImageStream*>(fTargetImage.get());
+  if (fSplitFileSize > 0) {
+    fTargetImage->Open(NULL, IImageStream::forWriting);
+    fTargetSplitCallback = std::make_unique<CSplitManager>(targetFileName, fSplitFileSize, targetStream, cb);
+    targetStream->RegisterCallback(fTargetSplitCallback.get());
+  } else {
+    fTargetImage->Open(targetFileName, IImageStream::forWriting);
+  }
+  targetStream->SetCompressionFormat(targetFormat);
+  targetStream->WriteImageFileHeaderFromImage(*sourceStream);
+  if (fSplitFileSize > 0 && targetStream->GetPosition() > fSplitFileSize)
+    THROW_INT_EXC(EInternalException::chunkSizeTooSmall); 
+
+  // volume block digests do not depend on the compression and are kept, so
+  // incremental images based on the source can use the target as well
+  fBlockHashes = std::make_unique<CBlockHashTable>();
+  if (sourceStream->ReadBlockHashTable(*fBlockHashes))
+    targetStream->SetBlockHashTable(fBlockHashes.get());
+  else
+    fBlockHashes.reset();
+
+  // read -> decompress -> compress -> write, each stage passes its output to the next
+  fWasCancelled = false;
+  fEmptyReaderQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyReaderQueue");
+  fFilledReaderQueue = std::make_unique<CImageBuffer>(L"fFilledReaderQueue");
+  CImageBuffer *stageInQueue = fFilledReaderQueue.get();
+  CImageBuffer *stageOutQueue = fEmptyReaderQueue.get();
+
+  fReadThread = std::make_unique<CReadThread>(fSourceImage.get(), fEmptyReaderQueue.get(), fFilledReaderQueue.get(), false);
+  fReadThread->SetVolumeDataOffset(header.GetVolumeDataOffset());
+  fReadThread->SetVolumeDataSize(header.GetDataSize());
+  SetupIoBudget(fReadThread.get(), true);
+
+  if (sourceFormat != noCompression) {
+    fEmptyCompDecompQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyCompDecompQueue");
+    fFilledCompDecompQueue = std::make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+    if (sourceFormat == compressionChunkStore) {
+      fChunkStore = std::make_unique<CChunkStore>();
+      fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), false);
+      fCompDecompThread = std::make_unique<CDechunkingThread>(fChunkStore.get(), fChunkPrefetchThreads,
+                            stageInQueue, stageOutQueue, fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    } else {
+      fCompDecompThread = std::make_unique<CDecompressionThread>(sourceFormat, stageInQueue, stageOutQueue,
+                            fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    }
+    stageInQueue = fFilledCompDecompQueue.get();
+    stageOutQueue = fEmptyCompDecompQueue.get();
+  }
+
+  if (targetFormat != noCompression) {
+    fEmptyTranscodeQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyTranscodeQueue");
+    fFilledTranscodeQueue = std::make_unique<CImageBuffer>(L"fFilledTranscodeQueue");
+    if (targetFormat == compressionChunkStore) {
+      fChunkStore = std::make_unique<CChunkStore>();
+      fChunkStore->Open(CChunkStore::GetStoreDirectory(targetFileName).c_str(), true);
+      fTranscodeThread = std::make_unique<CChunkingThread>(fChunkStore.get(), stageInQueue, stageOutQueue,
+                            fEmptyTranscodeQueue.get(), fFilledTranscodeQueue.get());
+    } else {
+      fTranscodeThread = std::make_unique<CCompressionThread>(targetFormat, stageInQueue, stageOutQueue,
+                            fEmptyTranscodeQueue.get(), fFilledTranscodeQueue.get());
+    }
+    stageInQueue = fFilledTranscodeQueue.get();
+    stageOutQueue = fEmptyTranscodeQueue.get();
+  }
 
+  fWriteThread = std::make_unique<CWriteThread>(fTargetImage.get(), stageInQueue, stageOutQueue, false);
+  SetupIoBudget(fWriteThread.get(), false);
+  if (fBlockManifestSize > 0) {
+    fBlockManifest = std::make_unique<CBlockManifest>(fBlockManifestSize);
+    targetStream->SetBlockManifest(fBlockManifest.get());
+    fWriteThread->SetBlockManifest(fBlockManifest.get());
+  }
+  fIsSaving = true;
+  fIsTranscoding = true;
+
+  fReadThread->Resume();
+  fWriteThread->Resume();
+  if (fCompDecompThread)
+    fCompDecompThread->Resume();
+  if (fTranscodeThread)
+    fTranscodeThread->Resume();
+}
+
+#ifdef _WIN32
+void COdinManager::CompareImage(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, int driveIndex,
+                                LPCWSTR targetFileName, ISplitManagerCallback* cb)
+{
+  LPCWSTR volumeName = driveIndex >= 0 ? fDriveList->GetItem(driveIndex)->GetDeviceName().c_str() : NULL;
+  DoCompare(fileName, noFiles, totalSize, volumeName, targetFileName, cb);
+}
+#endif
+
+void COdinManager::CompareImageToVolume(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize,
+                                        LPCWSTR volumeName, ISplitManagerCallback* cb)
+{
+  DoCompare(fileName, noFiles, totalSize, volumeName, NULL, cb);
+}
+
+// compare with volume volumeName or, if it is NULL, with the copy of a volume in file targetFileName
+void COdinManager::DoCompare(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, LPCWSTR volumeName,
+                             LPCWSTR targetFileName, ISplitManagerCallback* cb)
+{
+  fVerifyCrc32 = 0;
+  fIsBlockVerify = false;
+  fCompareDifferences.clear();
+  fCompareDifferingBytes = 0;
+  fComparedBytes = 0;
+  if (fCompareMaxRanges <= 0)
+    THROW_INT_EXC(EInternalException::inputError);
+
+  // setup image file
+  fSourceImage = std::make_unique<CFileImageStream>();
+  CFileImageStream *fileStream = static_cast<CFileImageStream*>(fSourceImage.get());
+  if (noFiles > 0) {
+    fSourceImage->Open(NULL, IImageStream::forReading);
+    fSplitCallback = std::make_unique<CSplitManager>(fileName, fileStream, totalSize, cb);
+    fileStream->RegisterCallback(fSplitCallback.get());
+  } else {
+    fSourceImage->Open(fileName, IImageStream::forReading);
+  }
+  fileStream->ReadImageFileHeader(true);
+  const CImageFileHeader& header = fileStream->GetImageFileHeader();
+  TCompressionFormat decompressionFormat = header.GetCompressionFormat();
+  if (header.GetImageType() == CImageFileHeader::imageIncremental)
+    THROW_INT_EXC(EInternalException::compareIncremental);
+
+  // setup target, a drive or a file holding a copy of a volume
+  if (volumeName != NULL) {
+    fTargetImage = std::make_unique<CDiskImageStream>();
+    fTargetImage->Open(volumeName, IImageStream::forReading);
+  } else {
+    fTargetImage = std::make_unique<CFileImageStream>();
+    fTargetImage->Open(targetFileName, IImageStream::forReading);
+  }
+
+  // image: read -> decompress, target: read, the compare thread takes the data of both
+  fWasCancelled = false;
+  fEmptyReaderQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyReaderQueue");
+  fFilledReaderQueue = std::make_unique<CImageBuffer>(L"fFilledReaderQueue");
+  CImageBuffer *imageQueue = fFilledReaderQueue.get();
+  CImageBuffer *imageReturnQueue = fEmptyReaderQueue.get();
+
+  fReadThread = std::make_unique<CReadThread>(fSourceImage.get(), fEmptyReaderQueue.get(), fFilledReaderQueue.get(), false);
+  fReadThread->SetVolumeDataOffset(header.GetVolumeDataOffset());
+  fReadThread->SetVolumeDataSize(header.GetDataSize());
+  SetupIoBudget(fReadThread.get(), true);
+
+  if (decompressionFormat != noCompression) {
+    fEmptyCompDecompQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyCompDecompQueue");
+    fFilledCompDecompQueue = std::make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+    if (decompressionFormat == compressionChunkStore) {
+      fChunkStore = std::make_unique<CChunkStore>();
+      fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), false);
+      fCompDecompThread = std::make_unique<CDechunkingThread>(fChunkStore.get(), fChunkPrefetchThreads,
+                            imageQueue, imageReturnQueue, fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    } else {
+      fCompDecompThread = std::make_unique<CDecompressionThread>(decompressionFormat, imageQueue, imageReturnQueue,
+                            fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    }
+    imageQueue = fFilledCompDecompQueue.get();
+    imageReturnQueue = fEmptyCompDecompQueue.get();
+  }
+
+  fEmptyCompareQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyCompareQueue");
+  fFilledCompareQueue = std::make_unique<CImageBuffer>(L"fFilledCompareQueue");
+  fCompareReadThread = std::make_unique<CReadThread>(fTargetImage.get(), fEmptyCompareQueue.get(), fFilledCompareQueue.get(), false);
+  fCompareReadThread->SetVolumeStore(true);
+  SetupIoBudget(fCompareReadThread.get(), true);
+  fCompareThread = std::make_unique<CCompareThread>(imageQueue, imageReturnQueue, fFilledCompareQueue.get(), fEmptyCompareQueue.get());
+  fCompareThread->SetMaxRanges(fCompareMaxRanges);
+  if (fileStream->GetRunLengthStreamReader()) {
+    // only used clusters are read from the target, the allocation map is read by both threads on their own
+    fCompareRunLengthReader.reset(fileStream->NewRunLengthStreamReader());
+    fCompareReadThread->SetAllocationMapReaderInfo(fCompareRunLengthReader.get(), header.GetClusterSize());
+    fCompareThread->SetAllocationMapReaderInfo(fileStream->GetRunLengthStreamReader(), header.GetClusterSize());
+  } else {
+    // image of all blocks, the target is compared up to the size of the volume
+    fCompareReadThread->SetVolumeDataSize(header.GetVolumeSize());
+  }
+  fIsComparing = true;
+
+  fReadThread->Resume();
+  if (fCompDecompThread)
+    fCompDecompThread->Resume();
+  fCompareReadThread->Resume();
+  fCompareThread->Resume();
+}
+
+void COdinManager::CollectCompareResults()
+{
+  fCompareDifferences = fCompareThread->GetDifferences();
+  fCompareDifferingBytes = fCompareThread->GetDifferingBytes();
+  fComparedBytes = fCompareThread->GetBytesProcessed();
+}
+
+void COdinManager::DecodeImage(LPCWSTR fileName, IImageStream* target)
+{
+  fVerifyCrc32 = 0;
+  fIsBlockVerify = false;
+
+  fSourceImage = std::make_unique<CFileImageStream>();
+  CFileImageStream *fileStream = static_cast<CFileImageStream*>(fSourceImage.get());
+  fSourceImage->Open(fileName, IImageStream::forReading);
+  fileStream->ReadImageFileHeader(false);
+  const CImageFileHeader& header = fileStream->GetImageFileHeader();
+  TCompressionFormat decompressionFormat = header.GetCompressionFormat();
+
+  // read -> decompress -> target, the data of free clusters are not added
+  fWasCancelled = false;
+  fEmptyReaderQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyReaderQueue");
+  fFilledReaderQueue = std::make_unique<CImageBuffer>(L"fFilledReaderQueue");
+  CImageBuffer *writerInQueue = fFilledReaderQueue.get();
+  CImageBuffer *writerOutQueue = fEmptyReaderQueue.get();
+
+  fReadThread = std::make_unique<CReadThread>(fSourceImage.get(), fEmptyReaderQueue.get(), fFilledReaderQueue.get(), false);
+  fReadThread->SetVolumeDataOffset(header.GetVolumeDataOffset());
+  fReadThread->SetVolumeDataSize(header.GetDataSize());
+  SetupIoBudget(fReadThread.get(), true);
+
+  if (decompressionFormat != noCompression) {
+    fEmptyCompDecompQueue = std::make_unique<CImageBuffer>(fReadBlockSize, kDoCopyBufferCount, L"fEmptyCompDecompQueue");
+    fFilledCompDecompQueue = std::make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+    if (decompressionFormat == compressionChunkStore) {
+      fChunkStore = std::make_unique<CChunkStore>();
+      fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), false);
+      fCompDecompThread = std::make_unique<CDechunkingThread>(fChunkStore.get(), fChunkPrefetchThreads,
+                            writerInQueue, writerOutQueue, fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    } else {
+      fCompDecompThread = std::make_unique<CDecompressionThread>(decompressionFormat, writerInQueue, writerOutQueue,
+                            fEmptyCompDecompQueue.get(), fFilledCompDecompQueue.get());
+    }
+    writerInQueue = fFilledCompDecompQueue.get();
+    writerOutQueue = fEmptyCompDecompQueue.get();
+  }
+
+  fWriteThread = std::make_unique<CWriteThread>(target, writerInQueue, writerOutQueue, false);
+  SetupIoBudget(fWriteThread.get(), false);
+  fIsRestoring = true;
+
+  fReadThread->Resume();
+  if (fCompDecompThread)
+    fCompDecompThread->Resume();
+  fWriteThread->Resume();
+}
+
+// the checksum of an image written as a stream is stored behind its data, so it is
+// known only when the image was read completely
+void COdinManager::CollectSourceChecksum()
+{
+  CFileImageStream *fileStream = static_cast<CFileImageStream*>(fSourceImage.get());
+  fSourceCrc32 = fileStream->GetCrc32Checksum();
+  // images sent by an image server were checked by the server
+  fSourceHasChecksum = fileStream->GetImageFileHeader().GetVerifyFormat() != CImageFileHeader::verifyNone;
+}
+
+#ifdef _WIN32
 void COdinManager::MakeSnapshot(int driveIndex, IWaitCallback* wcb) {
   if (!fMultiVolumeMode)
     return; // ignore 
@@ -209,27 +890,29 @@ void COdinManager::GetDriveNameList(std::list<std::wstring>& driveNames)
  	for (int i=0; i<(int)fDriveList->GetCount(); i++)
 		driveNames.push_back(fDriveList->GetItem(i)->GetDisplayName());
 }
+#endif
 
-void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveIndex, unsigned noFiles,
+void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, const TVolumeInfo* volume, unsigned noFiles,
                           unsigned __int64 totalSize, ISplitManagerCallback* cb,  IWaitCallback* wcb)
 {
   int nBufferCount = kDoCopyBufferCount;
   TCompressionFormat decompressionFormat = noCompression;
   bool bSaveAllBlocks = fSaveAllBlocks;
   fVerifyCrc32 = 0;
-  CDriveInfo*	pDriveInfo = driveIndex<0 ? NULL : fDriveList->GetItem(driveIndex);
-  bool isHardDisk = pDriveInfo ? pDriveInfo->IsCompleteHardDisk() : false;
+  fIsBlockVerify = false;
+  bool isHardDisk = volume ? volume->isHardDisk : false;
   LPCWSTR mountPoint = NULL;
-  LPCWSTR deviceName = pDriveInfo ? pDriveInfo->GetDeviceName().c_str() : NULL;
-  unsigned bytesPerCluster = pDriveInfo ? pDriveInfo->GetClusterSize() : 0;
+  LPCWSTR deviceName = volume ? volume->deviceName.c_str() : NULL;
+  unsigned bytesPerCluster = volume ? volume->clusterSize : 0;
 
   if (isHardDisk && !fSaveAllBlocks) {
     ATLASSERT(fMultiVolumeMode);
   } else {
-    mountPoint = pDriveInfo ? pDriveInfo->GetMountPoint().c_str() : NULL;
+    mountPoint = volume ? volume->mountPoint.c_str() : NULL;
   }
 
   bool verifyOnly = operation == isVerify;
+  fResumedBytes = 0;
 
   // Create the output image store
   if (operation == isBackup) {
@@ -243,8 +926,9 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
         fTargetImage->Open(fileName, IImageStream::forWriting);
       }
       // setup source device
+#ifdef _WIN32
       const wchar_t* vssVolume;
-      if (fTakeVSSSnapshot && !verifyOnly && !pDriveInfo->GetMountPoint().empty()) {
+      if (fTakeVSSSnapshot && !verifyOnly && !volume->mountPoint.empty()) {
         if (!fMultiVolumeMode) {
           wcb->OnPrepareSnapshotBegin();
           fVSS = std::make_unique<CVssWrapper>();
@@ -257,13 +941,14 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
           if (vssVolume != NULL && *vssVolume != L'\0') // can be 0 if not mounted
             deviceName  = vssVolume;
       }
+#endif
       fSourceImage = std::make_unique<CDiskImageStream>();
       fSourceImage->Open(deviceName, IImageStream::forReading);
   } else if (operation == isRestore || operation == isVerify) {
       if (operation == isRestore) {
         // setup target
         fTargetImage = std::make_unique<CDiskImageStream>();
-        int subPartitions = pDriveInfo ? pDriveInfo->GetContainedVolumes() : 0;
+        int subPartitions = volume ? volume->containedVolumes : 0;
         static_cast<CDiskImageStream*>(fTargetImage.get())->SetContainedSubPartitionsCount(subPartitions);
         fTargetImage->Open(deviceName, IImageStream::forWriting);
       }
@@ -291,7 +976,8 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
     decompressionFormat = fileStream->GetImageFileHeader().GetCompressionFormat();
   }
 
-  if (fCompressionMode != noCompression || decompressionFormat != noCompression) {
+  // a backup compresses with the configured format, a restore decompresses with the one of the image
+  if ((operation == isBackup ? fCompressionMode : decompressionFormat) != noCompression) {
     fEmptyCompDecompQueue = std::make_unique<CImageBuffer>(fReadBlockSize, nBufferCount, L"fEmptyCompDecompQueue");
     fFilledCompDecompQueue = std::make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
     writerInQueue = fFilledCompDecompQueue.get();
@@ -304,6 +990,8 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
   unsigned __int64 volumeBitmapOffset, volumeBitmapLength;
   fReadThread = std::make_unique<CReadThread>(fSourceImage.get(), fEmptyReaderQueue.get(), fFilledReaderQueue.get(), verifyOnly);
   fWriteThread = std::make_unique<CWriteThread>(fTargetImage.get(), writerInQueue, writerOutQueue, verifyOnly);
+  SetupIoBudget(fReadThread.get(), true);
+  SetupIoBudget(fWriteThread.get(), false);
   if (operation == isRestore || operation == isVerify) {
       CFileImageStream *fileStream = static_cast<CFileImageStream*>(fSourceImage.get());
       unsigned __int64 dataOffset;
@@ -315,10 +1003,59 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
         static_cast<CDiskImageStream*>(fTargetImage.get())->SetBytesPerCluster(bytesPerCluster);
         fileStream->GetImageFileHeader().GetClusterBitmapOffsetAndLength(volumeBitmapOffset, volumeBitmapLength);
         fWriteThread->SetAllocationMapReaderInfo(fSourceImage->GetRunLengthStreamReader(), fileStream->GetImageFileHeader().GetClusterSize());
+        if (fRestoreChain)
+          fWriteThread->SetRestoreChain(fRestoreChain.get(), fRestoreChainIndex);
+        if (fDeltaRestore) {
+          if (fDeltaCompareSize <= 0 || fDeltaCompareSize % 512 != 0)
+            THROW_INT_EXC(EInternalException::inputError);
+          fWriteThread->SetDeltaRestore(fDeltaCompareSize);
+        }
+        if (fReadBackVerify)
+          SetupReadBackVerify(fWriteThread.get(), static_cast<CDiskImageStream*>(fTargetImage.get()));
+        if (fMediaHashAlgorithms && !fRestoreChain) {
+          // the images of a chain are written in several passes, hash is not calculated
+          fWriteThread->SetMediaHash(NewMediaHash(), fileStream->GetImageFileHeader().GetVolumeSize());
+        }
+        if (IsJournaled(operation, fileStream, decompressionFormat, noFiles > 0)) {
+          const CImageFileHeader& header = fileStream->GetImageFileHeader();
+          CCheckpointJournal::TJournalInfo info;
+          memset(&info, 0, sizeof(info));
+          info.operation = CCheckpointJournal::opRestore;
+          info.compressionFormat = decompressionFormat;
+          info.volumeNameChecksum = CCheckpointJournal::GetNameChecksum(deviceName);
+          info.volumeSize = header.GetVolumeSize();
+          info.dataOffset = header.GetVolumeDataOffset();
+          info.imageDataSize = header.GetDataSize();
+          info.imageCrc32 = fileStream->GetCrc32Checksum();
+          std::wstring journalName = CCheckpointJournal::GetRestoreJournalName(fileName, deviceName);
+          fJournal = std::make_unique<CCheckpointJournal>();
+          // an interrupted restore decodes the image from the start and writes the data
+          // behind its last checkpoint
+          if (fResume && fJournal->Open(journalName.c_str(), info)) {
+            fResumedBytes = fJournal->GetLastCheckpoint().dataPos;
+          } else {
+            try {
+              fJournal->Create(journalName.c_str(), info);
+            } catch (Exception&) {
+              fJournal.reset(); // e.g. image on a read only medium, the restore runs without checkpoints
+            }
+          }
+          if (fJournal) {
+            fWriteThread->SetCheckpoints(fJournal.get(), static_cast<CDiskImageStream*>(fTargetImage.get())->GetFileHandle(),
+                                         (unsigned __int64) GetCheckpointIntervalInUse() * 1048576);
+            fWriteThread->SetSkipBytes(fResumedBytes);
+          }
+        }
       }
       dataOffset = fileStream->GetImageFileHeader().GetVolumeDataOffset();
       fReadThread->SetVolumeDataOffset(dataOffset);
-      if (decompressionFormat != noCompression) {
+      fReadThread->SetVolumeDataSize(fileStream->GetImageFileHeader().GetDataSize());
+      if (decompressionFormat == compressionChunkStore) {
+        fChunkStore = std::make_unique<CChunkStore>();
+        fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), false);
+        fCompDecompThread = std::make_unique<CDechunkingThread>(fChunkStore.get(), fChunkPrefetchThreads,
+                              fFilledReaderQueue.get(), fEmptyReaderQueue.get(), fEmptyCompDecompQueue.get(), writerInQueue);
+      } else if (decompressionFormat != noCompression) {
         fCompDecompThread = std::make_unique<CDecompressionThread>(decompressionFormat, fFilledReaderQueue.get(),
                               fEmptyReaderQueue.get(), fEmptyCompDecompQueue.get(), writerInQueue);
       } 
@@ -338,19 +1075,84 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
       
       if (bSaveAllBlocks || isHardDisk || !static_cast<CDiskImageStream*>(fSourceImage.get())->IsMounted() || bytesPerCluster == 0) 
         bSaveAllBlocks = true;
-      if (!bSaveAllBlocks) {
+      if (bSaveAllBlocks && !fBaseImage.empty())
+        THROW_INT_EXC(EInternalException::incrementalNeedsUsedBlocks);
+      CCheckpointJournal::TJournalInfo info;
+      memset(&info, 0, sizeof(info));
+      info.operation = CCheckpointJournal::opBackup;
+      info.compressionFormat = GetCompressionMode();
+      info.manifestBlockSize = fBlockManifestSize;
+      // the snapshot of the volume has another name each time
+      info.volumeNameChecksum = CCheckpointJournal::GetNameChecksum(volume ? volume->deviceName.c_str() : L"");
+      info.volumeSize = fSourceImage->GetSize();
+      bool resumed = false;
+      if (IsJournaled(operation, fileStream, GetCompressionMode(), fSplitFileSize > 0)) {
+        std::wstring journalName = CCheckpointJournal::GetBackupJournalName(fileName);
+        fJournal = std::make_unique<CCheckpointJournal>();
+        // an interrupted backup continues behind the image data of its last checkpoint
+        if (fResume && IsFileReadable(journalName.c_str())) {
+          fileStream->ReadImageFileHeader(true);
+          info.dataOffset = fileStream->GetImageFileHeader().GetVolumeDataOffset();
+          resumed = fJournal->Open(journalName.c_str(), info);
+        }
+        if (!resumed)
+          fileStream->Truncate(0);
+        fileStream->SetMultiStream(GetCompressionMode() != noCompression);
+      }
+      if (resumed) {
+        // the clusters to save are taken from the allocation map stored in the image, the
+        // block hashes of the saved part are not known so the image can not be the base
+        // of an incremental backup
+        if (fileStream->GetRunLengthStreamReader())
+          fReadThread->SetAllocationMapReaderInfo(fileStream->GetRunLengthStreamReader(), fileStream->GetImageFileHeader().GetClusterSize());
+      } else if (!bSaveAllBlocks) {
         fileStream->WriteImageFileHeaderAndAllocationMap(static_cast<CDiskImageStream*>(fSourceImage.get()));
         fReadThread->SetAllocationMapReaderInfo(fSourceImage->GetRunLengthStreamReader(), fileStream->GetImageFileHeader().GetClusterSize());
+        if (fBlockHashSize > 0 || !fBaseImage.empty())
+          PrepareBlockHashes(fileStream);
         if ( fSplitFileSize > 0 && fileStream->GetPosition() > fSplitFileSize)
           THROW_INT_EXC(EInternalException::chunkSizeTooSmall); 
       } else {
         fileStream->WriteImageFileHeaderForSaveAllBlocks(fSourceImage->GetSize(), 
           static_cast<CDiskImageStream*>(fSourceImage.get())->GetBytesPerCluster());
       }
-      if (fCompressionMode != noCompression) {
+      if (fJournal && !resumed) {
+        info.dataOffset = fileStream->GetImageFileHeader().GetVolumeDataOffset();
+        fJournal->Create(CCheckpointJournal::GetBackupJournalName(fileName).c_str(), info);
+      }
+      if (fCompressionMode == compressionChunkStore) {
+        fChunkStore = std::make_unique<CChunkStore>();
+        fChunkStore->Open(CChunkStore::GetStoreDirectory(fileName).c_str(), true);
+        fCompDecompThread = std::make_unique<CChunkingThread>(fChunkStore.get(), fFilledReaderQueue.get(),
+                                  fEmptyReaderQueue.get(), fEmptyCompDecompQueue.get(), writerInQueue);
+      } else if (fCompressionMode != noCompression) {
         fCompDecompThread = std::make_unique<CCompressionThread>(GetCompressionMode(), fFilledReaderQueue.get(),
                                   fEmptyReaderQueue.get(), fEmptyCompDecompQueue.get(), writerInQueue);
       }  
+      if (fBlockManifestSize > 0) {
+        fBlockManifest = std::make_unique<CBlockManifest>(fBlockManifestSize);
+        fileStream->SetBlockManifest(fBlockManifest.get());
+        fWriteThread->SetBlockManifest(fBlockManifest.get());
+      }
+      if (fMediaHashAlgorithms) {
+        // digests of the volume as it will be after a restore, stored in the file header
+        CMediaHash* hash = NewMediaHash();
+        fReadThread->SetMediaHash(hash, fileStream->GetImageFileHeader().GetVolumeSize());
+        fileStream->SetMediaHash(hash);
+      }
+      if (fJournal) {
+        fReadThread->SetCheckpointInterval((unsigned __int64) GetCheckpointIntervalInUse() * 1048576);
+        fWriteThread->SetCheckpoints(fJournal.get(), fileStream->GetFileHandle(), 0);
+      }
+      if (resumed) {
+        const CCheckpointJournal::TCheckpoint& checkpoint = fJournal->GetLastCheckpoint();
+        fileStream->Truncate(info.dataOffset + checkpoint.targetPos);
+        if (fBlockManifest)
+          fBlockManifest->Resume(fJournal->GetChecksums(), checkpoint.targetPos, checkpoint.manifestChecksum);
+        fReadThread->SetResumePosition(checkpoint.dataPos);
+        fWriteThread->ResumeWriting(checkpoint.targetPos, checkpoint.crc32);
+        fResumedBytes = checkpoint.dataPos;
+      }
       fIsSaving = true;
   }
 
@@ -362,9 +1164,120 @@ void COdinManager::DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveI
     fCompDecompThread->Resume();
 }
 
+void COdinManager::PrepareBlockHashes(CFileImageStream* imageStream)
+{
+  DWORD clusterSize = imageStream->GetImageFileHeader().GetClusterSize();
+  DWORD blockSize = fBlockHashSize;
+
+  if (!fBaseImage.empty()) {
+    // blocks are compared with the base image, so its geometry must be used
+    CFileImageStream baseStream;
+    fBaseBlockHashes = std::make_unique<CBlockHashTable>();
+    baseStream.Open(fBaseImage.c_str(), IImageStream::forReading);
+    baseStream.ReadImageFileHeader(false);
+    if (!baseStream.ReadBlockHashTable(*fBaseBlockHashes))
+      THROW_FILEFORMAT_EXC(EFileFormatException::noBlockHashTable);
+    blockSize = fBaseBlockHashes->GetBlockSize();
+  }
+  // a block always consists of complete clusters
+  if (blockSize < clusterSize)
+    blockSize = clusterSize;
+  blockSize -= blockSize % clusterSize;
+
+  fBlockHashes = std::make_unique<CBlockHashTable>(blockSize, clusterSize, fSourceImage->GetSize());
+  if (fBaseBlockHashes) {
+    if (!fBlockHashes->IsCompatible(*fBaseBlockHashes))
+      THROW_FILEFORMAT_EXC(EFileFormatException::baseImageMismatch);
+    BYTE baseDigest[CSha256::sDigestLength];
+    wchar_t fullPath[MAX_PATH];
+    fBaseBlockHashes->GetTableDigest(baseDigest);
+    DWORD len = GetFullPathName(fBaseImage.c_str(), MAX_PATH, fullPath, NULL);
+    fBlockHashes->SetBaseReference(len > 0 && len < MAX_PATH ? fullPath : fBaseImage.c_str(), baseDigest);
+  }
+  imageStream->SetBlockHashTable(fBlockHashes.get());
+  fReadThread->SetBlockHashTable(fBlockHashes.get(), fBaseBlockHashes.get());
+}
+
+bool COdinManager::DoBlockVerify(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb)
+{
+  CFileImageStream imageStream;
+  std::unique_ptr<CSplitManager> splitManager;
+
+  if (noFiles > 0) {
+    imageStream.Open(NULL, IImageStream::forReading);
+    splitManager = std::make_unique<CSplitManager>(fileName, &imageStream, totalSize, cb);
+    imageStream.RegisterCallback(splitManager.get());
+  } else {
+    imageStream.Open(fileName, IImageStream::forReading);
+  }
+  imageStream.ReadImageFileHeader(false);
+  fBlockManifest = std::make_unique<CBlockManifest>(fBlockManifestSize);
+  // the manifest of a deduplicated image covers only the recipe, the chunks
+  // are checked when reading them from the chunk store
+  bool hasManifest = imageStream.GetImageFileHeader().GetCompressionFormat() != compressionChunkStore
+    && imageStream.ReadBlockManifest(*fBlockManifest);
+  unsigned __int64 dataOffset = imageStream.GetImageFileHeader().GetVolumeDataOffset();
+  unsigned __int64 dataSize = imageStream.GetImageFileHeader().GetDataSize();
+  imageStream.UnegisterCallback();
+  imageStream.Close();
+
+  if (!hasManifest || fBlockManifest->GetDataSize() != dataSize) {
+    ATLTRACE("Image has no usable block manifest, using crc32 verification\n");
+    fBlockManifest.reset();
+    return false;
+  }
+
+  // split blocks in contiguous ranges, one per processor
+  SYSTEM_INFO sysInfo;
+  GetSystemInfo(&sysInfo);
+  unsigned __int64 blockCount = fBlockManifest->GetBlockCount();
+  unsigned __int64 threadCount = sysInfo.dwNumberOfProcessors;
+  if (threadCount > kMaxBlockVerifyThreads)
+    threadCount = kMaxBlockVerifyThreads;
+  if (threadCount > blockCount)
+    threadCount = blockCount;
+  if (threadCount == 0)
+    threadCount = 1;
+  unsigned __int64 blocksPerThread = (blockCount + threadCount - 1) / threadCount;
+
+  for (unsigned __int64 first = 0; first < blockCount || fBlockVerifyThreads.empty(); first += blocksPerThread) {
+    unsigned __int64 count = blockCount - first < blocksPerThread ? blockCount - first : blocksPerThread;
+    fBlockVerifyThreads.push_back(std::make_unique<CBlockVerifyThread>(fileName, noFiles, totalSize, cb,
+      fBlockManifest.get(), dataOffset, first, count));
+  }
+  ATLTRACE("Verifying %u blocks of image in %u threads\n", (unsigned) blockCount, (unsigned) fBlockVerifyThreads.size());
+
+  fWasCancelled = false;
+  fIsBlockVerify = true;
+  fIsRestoring = true;
+  for (size_t i=0; i<fBlockVerifyThreads.size(); i++)
+    fBlockVerifyThreads[i]->Resume();
+  return true;
+}
+
+void COdinManager::CollectCorruptRanges()
+{
+  // threads check ascending block ranges, so results are already sorted
+  fCorruptRanges.clear();
+  for (size_t i=0; i<fBlockVerifyThreads.size(); i++) {
+    const std::vector<TImageRange>& ranges = fBlockVerifyThreads[i]->GetCorruptRanges();
+    for (size_t j=0; j<ranges.size(); j++) {
+      if (!fCorruptRanges.empty() && fCorruptRanges.back().offset + fCorruptRanges.back().length == ranges[j].offset)
+        fCorruptRanges.back().length += ranges[j].length;
+      else
+        fCorruptRanges.push_back(ranges[j]);
+    }
+  }
+}
+
 void COdinManager::CancelOperation()
 {
   fWasCancelled = true;
+  CancelThreads();
+}
+
+void COdinManager::CancelThreads()
+{
   if (fReadThread) {
     fReadThread->CancelThread();
   }
@@ -374,6 +1287,38 @@ void COdinManager::CancelOperation()
   if (fCompDecompThread) {
     fCompDecompThread->CancelThread();
   }
+  if (fTranscodeThread) {
+    fTranscodeThread->CancelThread();
+  }
+  if (fFanOutThread) {
+    fFanOutThread->CancelThread();
+  }
+  if (fCompareReadThread) {
+    fCompareReadThread->CancelThread();
+  }
+  if (fCompareThread) {
+    fCompareThread->CancelThread();
+  }
+  for (size_t i=0; i<fFanOutWriteThreads.size(); i++)
+    fFanOutWriteThreads[i]->CancelThread();
+  for (size_t i=0; i<fBlockVerifyThreads.size(); i++)
+    fBlockVerifyThreads[i]->CancelThread();
+}
+
+// after a thread has failed the others would wait for its chunks until the timeout of
+// the queues, they are cancelled and the queues they wait for are stopped
+void COdinManager::StopAfterError()
+{
+  fErrorMessage = GetErrorMessage();
+  CancelThreads();
+  CImageBuffer* queues[] = { fEmptyReaderQueue.get(), fFilledReaderQueue.get(), fEmptyCompDecompQueue.get(),
+                             fFilledCompDecompQueue.get(), fEmptyTranscodeQueue.get(), fFilledTranscodeQueue.get(),
+                             fEmptyCompareQueue.get(), fFilledCompareQueue.get() };
+  for (size_t i=0; i<_countof(queues); i++)
+    if (queues[i])
+      queues[i]->Cancel();
+  if (fFanOutThread)
+    fFanOutThread->CancelTargetQueues();
 }
 
 void COdinManager::WaitToCompleteOperation(IWaitCallback* callback) 
@@ -390,14 +1335,42 @@ void COdinManager::WaitToCompleteOperation(IWaitCallback* callback)
   ATLTRACE("WaitToCompleteOperation() entered.\n");
 
   while (TRUE) {
+#ifdef _WIN32
     DWORD result = MsgWaitForMultipleObjects(threadCount, threadHandleArray.get(), FALSE, INFINITE, QS_ALLEVENTS);
+#else
+    // there are no window messages to process
+    DWORD result = WaitForMultipleObjects(threadCount, threadHandleArray.get(), FALSE, INFINITE);
+#endif
     if (result >= WAIT_OBJECT_0 && result < (DWORD)threadCount) {
       ATLTRACE("event arrived: %d, thread id: %x\n", result, threadHandleArray[result]);
+      if (fErrorMessage.empty() && WasError())
+        StopAfterError();
       callback->OnThreadTerminated();
       if (--threadCount == 0)  {       
         ATLTRACE(" All worker threads are terminated now\n");
         if (fReadThread) 
           fVerifyCrc32 = fReadThread->GetCrc32();
+        if (fSourceImage && (!fIsSaving || fIsTranscoding))
+          CollectSourceChecksum();
+        if (fWriteThread) {
+          fDeltaSkippedBytes += fWriteThread->GetDeltaSkippedBytes();
+          fReadBackVerifiedBytes += fWriteThread->GetReadBackVerifiedBytes();
+        }
+        if (fFanOutThread)
+          CollectFanOutResults();
+        if (fCompareThread)
+          CollectCompareResults();
+        if (fIsBlockVerify)
+          CollectCorruptRanges();
+        if (ContinueRestoreChain(callback)) {
+          // wait for the threads restoring the next image of the chain
+          threadCount = GetThreadCount();
+          threadHandleArray.reset(new HANDLE[threadCount]);
+          if (!GetThreadHandles(threadHandleArray.get(), threadCount))
+            break;
+          continue;
+        }
+        CloseJournal();
         callback->OnFinished();
         Terminate(); // work is finished
         break;
@@ -406,6 +1379,7 @@ void COdinManager::WaitToCompleteOperation(IWaitCallback* callback)
       for (unsigned i=result; i<threadCount; i++)
         threadHandleArray[i] = threadHandleArray[i+1];
     }
+#ifdef _WIN32
     else if (result  == WAIT_OBJECT_0 + threadCount)
     {
       // process windows messages
@@ -413,6 +1387,7 @@ void COdinManager::WaitToCompleteOperation(IWaitCallback* callback)
       while(::PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
         ::DispatchMessage(&msg) ;
     }
+#endif
     else if ( WAIT_FAILED) {
       ATLTRACE("MsgWaitForMultipleObjects failed, last error is: %d\n", GetLastError());
       callback->OnAbort();
@@ -429,12 +1404,19 @@ unsigned COdinManager::GetThreadCount()
 {
   int count;
 
-  if (fReadThread && fWriteThread)
+  if (fReadThread && (fWriteThread || fFanOutThread || fCompareThread))
     count = 2;
   else
     count = 0;
+  if (fCompareReadThread)
+    ++count;
   if (fCompDecompThread)
     ++count;
+  if (fTranscodeThread)
+    ++count;
+  if (fFanOutThread)
+    count += (int) fFanOutWriteThreads.size();
+  count += (int) fBlockVerifyThreads.size();
   return count;
 }
 
@@ -452,8 +1434,26 @@ bool COdinManager::GetThreadHandles(HANDLE* handles, unsigned size)
   if (fWriteThread)
     handles[i++] = fWriteThread->GetHandle();
 
+  if (fFanOutThread)
+    handles[i++] = fFanOutThread->GetHandle();
+
+  for (size_t j=0; j<fFanOutWriteThreads.size(); j++)
+    handles[i++] = fFanOutWriteThreads[j]->GetHandle();
+
+  if (fCompareThread)
+    handles[i++] = fCompareThread->GetHandle();
+
+  if (fCompareReadThread)
+    handles[i++] = fCompareReadThread->GetHandle();
+
   if (fCompDecompThread)
     handles[i++] = fCompDecompThread->GetHandle();
+
+  if (fTranscodeThread)
+    handles[i++] = fTranscodeThread->GetHandle();
+
+  for (size_t j=0; j<fBlockVerifyThreads.size(); j++)
+    handles[i++] = fBlockVerifyThreads[j]->GetHandle();
   
   return true;
 }
@@ -462,6 +1462,9 @@ LPCWSTR COdinManager::GetErrorMessage()
 {
   LPCWSTR msg = NULL;
 
+  if (!fErrorMessage.empty())
+    return fErrorMessage.c_str();
+
   if (fReadThread && fReadThread->GetErrorFlag())
     msg = fReadThread->GetErrorMessage();
 
@@ -470,15 +1473,39 @@ LPCWSTR COdinManager::GetErrorMessage()
 
   if (msg==NULL && fCompDecompThread && fCompDecompThread->GetErrorFlag())
     msg = fCompDecompThread->GetErrorMessage();
+
+  if (msg==NULL && fTranscodeThread && fTranscodeThread->GetErrorFlag())
+    msg = fTranscodeThread->GetErrorMessage();
+
+  if (msg==NULL && fCompareReadThread && fCompareReadThread->GetErrorFlag())
+    msg = fCompareReadThread->GetErrorMessage();
+
+  if (msg==NULL && fCompareThread && fCompareThread->GetErrorFlag())
+    msg = fCompareThread->GetErrorMessage();
+
+  // errors of single drives when restoring to multiple drives are reported per drive
+  if (msg==NULL && fFanOutThread && fFanOutThread->GetErrorFlag())
+    msg = fFanOutThread->GetErrorMessage();
+
+  for (size_t i=0; msg==NULL && i<fBlockVerifyThreads.size(); i++)
+    if (fBlockVerifyThreads[i]->GetErrorFlag())
+      msg = fBlockVerifyThreads[i]->GetErrorMessage();
   
   return msg;
 }
 
 bool COdinManager::WasError()
 {
+  for (size_t i=0; i<fBlockVerifyThreads.size(); i++)
+    if (fBlockVerifyThreads[i]->GetErrorFlag())
+      return true;
   return (fReadThread && fReadThread->GetErrorFlag()) ||
          (fWriteThread && fWriteThread->GetErrorFlag()) ||
-         (fCompDecompThread && fCompDecompThread->GetErrorFlag());
+         (fCompDecompThread && fCompDecompThread->GetErrorFlag()) ||
+         (fTranscodeThread && fTranscodeThread->GetErrorFlag()) ||
+         (fCompareReadThread && fCompareReadThread->GetErrorFlag()) ||
+         (fCompareThread && fCompareThread->GetErrorFlag()) ||
+         (fFanOutThread && fFanOutThread->GetErrorFlag());
 }
 
 unsigned __int64 COdinManager::GetTotalBytesToProcess()
@@ -495,7 +1522,19 @@ unsigned __int64 COdinManager::GetTotalBytesToProcess()
   
   unsigned __int64 res;
 
-  if (fIsSaving || (fIsRestoring && !fTargetImage) ) {
+  if (!fBlockVerifyThreads.empty() && fBlockManifest) {
+    return fBlockManifest->GetDataSize();
+  }
+  if (fIsComparing && fSourceImage) {
+    // used clusters of the image volume or the whole volume if all blocks were saved
+    res = fSourceImage->GetAllocatedBytes();
+    return res > 0 ? res : fSourceImage->GetSize();
+  }
+  if (fIsTranscoding && fSourceImage) {
+    // the read thread reads the data area of the source image
+    return static_cast<CFileImageStream*>(fSourceImage.get())->GetImageFileHeader().GetDataSize();
+  }
+  if (fIsSaving || (fIsRestoring && !fTargetImage && !fFanOutThread) ) {
   //               ^ verify mode! (rhs of or condition)                   
     if (fSourceImage) {
       if (fSaveAllBlocks)
@@ -531,8 +1570,17 @@ unsigned __int64 COdinManager::GetBytesProcessed()
   // from the write thread, because if image is restored and compressed heavily the number of the 
   // image file may be very inaccurate.
 
-  if (fIsRestoring && fWriteThread)
+  if (!fBlockVerifyThreads.empty()) {
+    unsigned __int64 sum = 0;
+    for (size_t i=0; i<fBlockVerifyThreads.size(); i++)
+      sum += fBlockVerifyThreads[i]->GetBytesProcessed();
+    return sum;
+  } else if (fIsComparing && fCompareThread)
+    return fCompareThread->GetBytesProcessed();
+  else if (fIsRestoring && fWriteThread)
     return fWriteThread->GetBytesProcessed();
+  else if (fIsRestoring && fFanOutThread)
+    return fFanOutThread->GetBytesProcessed();
   else if (fIsSaving && fReadThread)
     return fReadThread->GetBytesProcessed();
   else
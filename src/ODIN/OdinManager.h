@@ -25,8 +25,10 @@
 
 #include <list>
 #include <memory>
+#include <vector>
 #include "Compression.h"
 #include "Config.h"
+#include "BlockManifest.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // OdinManager a class managing the overall process for saving and resotring the disk images
@@ -37,8 +39,20 @@ class CDriveList;
 class COdinThread;
 class CReadThread;
 class CWriteThread;
+class CFanOutThread;
+class CCompareThread;
+class CBlockVerifyThread;
+class CChunkStore;
+class CBlockHashTable;
+class CRestoreChain;
+class CMediaHash;
+class CThrottle;
+class CCheckpointJournal;
+class CFileImageStream;
+class CDiskImageStream;
 class CImageBuffer;
 class IImageStream;
+class CompressedRunLengthStreamReader;
 class CSplitManager;
 class ISplitManagerCallback;
 class CVssWrapper;
@@ -59,23 +73,51 @@ public:
 
   COdinManager();
   ~COdinManager();
-  void RefreshDriveList();
   void Terminate();
+#ifdef _WIN32
+  void RefreshDriveList();
   void SavePartition(int driveIndex, LPCWSTR fileName, ISplitManagerCallback* cb, IWaitCallback* wcb);
   void RestorePartition(LPCWSTR fileName, int driveIndex, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb);
+  // restore image fileName to all drives of driveIndexes at once, the image is read and
+  // decompressed once and its data are passed to one write thread per drive
+  void RestorePartitionToDrives(LPCWSTR fileName, const std::vector<int>& driveIndexes, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb);
+#endif
+  // save or restore the volume with device name volumeName that is not taken from the
+  // drive list, on POSIX systems also a file holding a copy of a volume. Nothing is known
+  // about its file system, so all blocks are saved
+  void SaveVolume(LPCWSTR volumeName, LPCWSTR fileName, ISplitManagerCallback* cb, IWaitCallback* wcb);
+  void RestoreVolume(LPCWSTR fileName, LPCWSTR volumeName, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb);
   void VerifyPartition(LPCWSTR fileName, int driveIndex, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb, IWaitCallback* wcb);
+  // convert image fileName to an image targetFileName with the current compression mode
+  // in one pass without restoring it
+  void TranscodeImage(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, LPCWSTR targetFileName, ISplitManagerCallback* cb);
+  // compare image fileName with drive driveIndex or, if driveIndex is -1, with the copy of a volume
+  // in file targetFileName. The image is decoded and the target is read at the same time, only
+  // the used clusters are compared if the image has an allocation map
+#ifdef _WIN32
+  void CompareImage(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, int driveIndex,
+                    LPCWSTR targetFileName, ISplitManagerCallback* cb);
+#endif
+  // compare image fileName with the volume with device name volumeName
+  void CompareImageToVolume(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, LPCWSTR volumeName,
+                            ISplitManagerCallback* cb);
+  // write the volume data of image fileName decompressed and in the order they are stored
+  // to target, which must exist until the operation has completed
+  void DecodeImage(LPCWSTR fileName, IImageStream* target);
   void CancelOperation();
   void WaitToCompleteOperation(IWaitCallback* callback);
-  void GetDriveNameList(std::list<std::wstring>& driveNames);
   LPCWSTR GetErrorMessage();
   bool WasError();
   unsigned __int64 GetTotalBytesToProcess();
   unsigned __int64 GetBytesProcessed();
+#ifdef _WIN32
+  void GetDriveNameList(std::list<std::wstring>& driveNames);
   CDriveInfo* GetDriveInfo(int index);
   unsigned GetDriveCount();
   const CDriveList* GetDriveList() {
     return fDriveList.get();
   }
+#endif
   
   unsigned __int64 GetSplitSize() const {
     return fSplitFileSize;
@@ -90,6 +132,38 @@ public:
     return fVerifyCrc32;
   }
 
+  // true if the data read by the last restore, verify, transcode or decode matched the
+  // checksum stored in the source image, always true for images without one
+  bool WasSourceIntact() const {
+    return !fSourceHasChecksum || fVerifyCrc32 == fSourceCrc32;
+  }
+
+  // true if the last verify checked the image block by block against its block
+  // manifest, GetVerifiedChecksum() is not meaningful in this case
+  bool WasBlockVerify() const {
+    return fIsBlockVerify;
+  }
+
+  // byte ranges of the image file where the last block verify found corrupted data
+  const std::vector<TImageRange>& GetCorruptRanges() const {
+    return fCorruptRanges;
+  }
+
+  // ranges of volume offsets where the last compare found differences
+  const std::vector<TImageRange>& GetCompareDifferences() const {
+    return fCompareDifferences;
+  }
+
+  // bytes of the volume that differed in the last compare
+  unsigned __int64 GetCompareDifferingBytes() const {
+    return fCompareDifferingBytes;
+  }
+
+  // bytes compared by the last compare
+  unsigned __int64 GetComparedBytes() const {
+    return fComparedBytes;
+  }
+
   TCompressionFormat GetCompressionMode() {
     return (TCompressionFormat)fCompressionMode();
   }
@@ -114,12 +188,166 @@ public:
     return fComment.c_str();
   }
 
+  // image the next backup is based on, the backup then stores only the blocks
+  // that have changed since (empty for a full backup)
+  void SetBaseImage(LPCWSTR baseImage) {
+    fBaseImage = baseImage ? baseImage : L"";
+  }
+
+  LPCWSTR GetBaseImage() const {
+    return fBaseImage.c_str();
+  }
+
+  // restore writes only blocks that differ from the current content of the target
+  void SetDeltaRestore(bool deltaRestore) {
+    fDeltaRestore = deltaRestore;
+  }
+
+  bool GetDeltaRestore() const {
+    return fDeltaRestore;
+  }
+
+  // bytes the last delta restore found already on the target and did not write
+  unsigned __int64 GetDeltaSkippedBytes() const {
+    return fDeltaSkippedBytes;
+  }
+
+  // restore reads all written data back from the target while restoring and fails at the
+  // first difference
+  void SetReadBackVerify(bool readBackVerify) {
+    fReadBackVerify = readBackVerify;
+  }
+
+  bool GetReadBackVerify() const {
+    return fReadBackVerify;
+  }
+
+  // bytes the last restore read back from the target and found identical
+  unsigned __int64 GetReadBackVerifiedBytes() const {
+    return fReadBackVerifiedBytes;
+  }
+
+  // keep reading the source (volume or image) of an operation within mbPerSecond MB and
+  // iops read operations per second, 0 for no limit. Takes effect at once if called while
+  // an operation runs, e.g. from another thread
+  void SetReadLimit(unsigned mbPerSecond, unsigned iops);
+
+  // keep writing the target (image or volumes) within mbPerSecond MB and iops write
+  // operations per second, shared by all drives of a restore to multiple drives
+  void SetWriteLimit(unsigned mbPerSecond, unsigned iops);
+
+  unsigned GetReadLimit() const {
+    return fJobReadLimit;
+  }
+
+  unsigned GetReadOpsLimit() const {
+    return fJobReadOpsLimit;
+  }
+
+  unsigned GetWriteLimit() const {
+    return fJobWriteLimit;
+  }
+
+  unsigned GetWriteOpsLimit() const {
+    return fJobWriteOpsLimit;
+  }
+
+  // read and write the volumes and images with low I/O priority of the OS (background
+  // mode), takes effect with the next operation
+  void SetLowIoPriority(bool lowPriority) {
+    fJobLowIoPriority = lowPriority;
+  }
+
+  bool GetLowIoPriority() const {
+    return fJobLowIoPriority;
+  }
+
+  // continue an interrupted backup or restore at the last checkpoint of its journal, or
+  // start it from the beginning if there is none. Checkpoints are recorded each
+  // CheckpointIntervalMB of volume data for single image files (see CCheckpointJournal),
+  // each 1024 MB when resuming without an interval
+  void SetResume(bool resume) {
+    fResume = resume;
+  }
+
+  bool GetResume() const {
+    return fResume;
+  }
+
+  // MB of volume data between two checkpoints of a backup or restore, 0 for none (default)
+  void SetCheckpointInterval(unsigned mb) {
+    fJobCheckpointInterval = mb;
+  }
+
+  unsigned GetCheckpointInterval() const {
+    return fJobCheckpointInterval;
+  }
+
+  // I/O budgets, I/O priority and checkpoint interval back to the configured values, the
+  // setters above change them for the next operations only and are never saved
+  void UseConfiguredLimits();
+
+  // bytes of volume data the last backup or restore took from an interrupted one, 0 if
+  // it was not resumed
+  unsigned __int64 GetResumedBytes() const {
+    return fResumedBytes;
+  }
+
+  // calculate SHA-1 and/or SHA-256 of the restored volume while restoring or of the volume
+  // as it will be restored while saving it (stored in the image file header), a combination
+  // of CMediaHash::hashSha1 and CMediaHash::hashSha256 or 0 for none
+  void SetMediaHashAlgorithms(unsigned algorithms) {
+    fMediaHashAlgorithms = algorithms;
+  }
+
+  unsigned GetMediaHashAlgorithms() const {
+    return fMediaHashAlgorithms;
+  }
+
+  // hash only the used clusters instead of the volume with free clusters as zeros, so that
+  // a verify reads only the used clusters of the media (CMediaHash::scopeUsedClusters)
+  void SetMediaHashUsedClustersOnly(bool usedOnly) {
+    fMediaHashUsedClustersOnly = usedOnly;
+  }
+
+  bool GetMediaHashUsedClustersOnly() const {
+    return fMediaHashUsedClustersOnly;
+  }
+
+  // hash of the volume of the last backup or restore, index is the drive of a restore to
+  // multiple drives. NULL if no hash was calculated (e.g. for restoring an incremental image)
+  const CMediaHash* GetMediaHash(unsigned index = 0) const;
+
+  // number of drives of the last restore to multiple drives
+  unsigned GetFanOutTargetCount() const {
+    return (unsigned) fFanOutTargetFailed.size();
+  }
+
+  // true if restoring drive index of the last restore to multiple drives failed
+  bool WasFanOutTargetFailed(unsigned index) const {
+    return fFanOutTargetFailed[index];
+  }
+
+  // reason why restoring drive index failed (empty if it was cancelled)
+  LPCWSTR GetFanOutTargetError(unsigned index) const {
+    return fFanOutTargetErrors[index].c_str();
+  }
+
   int GetReadBlockSize() const {
     return fReadBlockSize;
   }
 
+  // block size in bytes of the block manifest written with new images, 0 for none
+  void SetBlockManifestSize(int blockSize) {
+    fBlockManifestSize = blockSize;
+  }
+
+  int GetBlockManifestSize() const {
+    return fBlockManifestSize;
+  }
+
   bool IsRunning() const  {
-    return fIsSaving || fIsRestoring;
+    return fIsSaving || fIsRestoring || fIsComparing;
   }
 
   void SetTakeSnapshotOption(bool makeSnapshot) {
@@ -148,24 +376,78 @@ public:
     fWasCancelled = false;
   }
 
+#ifdef _WIN32
   void MakeSnapshot(int driveIndex, IWaitCallback* wcb);
   void ReleaseSnapshot(bool bCancelled);
+#endif
 
 private:
   enum TOdinOperation { isBackup, isRestore, isVerify };
 
+  // volume saved or restored, taken from the drive list or given by its name
+  struct TVolumeInfo {
+    TVolumeInfo() : clusterSize(0), containedVolumes(0), isHardDisk(false) {
+    }
+    std::wstring deviceName;
+    std::wstring mountPoint; // empty if not mounted
+    unsigned clusterSize;    // 0 if not known
+    int containedVolumes;    // volumes of a hard disk
+    bool isHardDisk;
+  };
+
   void Init();
   void Reset();
-  void DoCopy(TOdinOperation operation, LPCWSTR fileName, int driveIndex, unsigned noFiles,
+#ifdef _WIN32
+  void GetVolumeInfo(int driveIndex, TVolumeInfo& volume);
+#endif
+  void DoRestore(LPCWSTR fileName, const TVolumeInfo& volume, unsigned noFiles, unsigned __int64 totalSize,
+                 ISplitManagerCallback* cb, IWaitCallback* wcb);
+  void DoCopy(TOdinOperation operation, LPCWSTR fileName, const TVolumeInfo* volume, unsigned noFiles,
           unsigned __int64 totalSize, ISplitManagerCallback* cb,  IWaitCallback* wcb);
+  void DoCompare(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, LPCWSTR volumeName,
+                 LPCWSTR targetFileName, ISplitManagerCallback* cb);
+  bool DoBlockVerify(LPCWSTR fileName, unsigned noFiles, unsigned __int64 totalSize, ISplitManagerCallback* cb);
+  void CollectCorruptRanges();
+  void PrepareBlockHashes(CFileImageStream* imageStream);
+  bool ContinueRestoreChain(IWaitCallback* wcb);
+  void CollectFanOutResults();
+  void CollectCompareResults();
+  void CollectSourceChecksum();
+  void CancelThreads();
+  void StopAfterError();
+  CMediaHash* NewMediaHash();
+  void SetupIoBudget(COdinThread* thread, bool isReading);
+  void SetupReadBackVerify(CWriteThread* writeThread, CDiskImageStream* target);
+  bool IsJournaled(TOdinOperation operation, CFileImageStream* imageStream, TCompressionFormat format,
+                   bool isSplit) const;
+  unsigned GetCheckpointIntervalInUse() const;
+  void CloseJournal();
   bool IsFileReadable(LPCWSTR fileName);
   unsigned GetThreadCount();
   bool GetThreadHandles(HANDLE* handles, unsigned size);
 
+#ifdef _WIN32
   std::unique_ptr<CDriveList>   fDriveList;
+#endif
   std::unique_ptr<CReadThread>  fReadThread;
   std::unique_ptr<CWriteThread> fWriteThread;
   std::unique_ptr<COdinThread>  fCompDecompThread;
+  std::unique_ptr<COdinThread>  fTranscodeThread;
+    // compression thread when transcoding, fCompDecompThread decompresses then
+  std::unique_ptr<CFanOutThread> fFanOutThread;
+    // passes the restored data to all write threads when restoring to multiple drives
+  std::vector<std::unique_ptr<CWriteThread>> fFanOutWriteThreads;
+    // one write thread per drive when restoring to multiple drives, fWriteThread is not used then
+  std::vector<std::unique_ptr<IImageStream>> fFanOutTargetImages;
+    // drives written by fFanOutWriteThreads
+  std::vector<std::unique_ptr<CompressedRunLengthStreamReader>> fFanOutRunLengthReaders;
+    // allocation map reader of each of fFanOutWriteThreads
+  std::unique_ptr<CReadThread> fCompareReadThread;
+    // reads the target of a compare, fReadThread reads the image
+  std::unique_ptr<CCompareThread> fCompareThread;
+    // compares the decoded image with the data of fCompareReadThread
+  std::unique_ptr<CompressedRunLengthStreamReader> fCompareRunLengthReader;
+    // allocation map reader of fCompareReadThread
   std::unique_ptr<IImageStream> fSourceImage;
   std::unique_ptr<IImageStream> fTargetImage;
   std::unique_ptr<CImageBuffer> fEmptyReaderQueue;
@@ -176,16 +458,34 @@ private:
     // queue with filled blocks filled by reader thread;
   std::unique_ptr<CImageBuffer> fFilledCompDecompQueue;
     // queue with filled blocks filled by compression or decompression thread;
+  std::unique_ptr<CImageBuffer> fEmptyTranscodeQueue;
+    // queue with empty blocks used by compression thread when transcoding;
+  std::unique_ptr<CImageBuffer> fFilledTranscodeQueue;
+    // queue with filled blocks filled by compression thread when transcoding;
+  std::unique_ptr<CImageBuffer> fEmptyCompareQueue;
+    // queue with empty blocks used by the thread reading the target of a compare;
+  std::unique_ptr<CImageBuffer> fFilledCompareQueue;
+    // queue with filled blocks filled by the thread reading the target of a compare;
   bool fIsSaving;
     // currently saving of a partition is in progress
   bool fIsRestoring;
     // currently restoring of a partition is in progress
+  bool fIsTranscoding;
+    // currently transcoding of an image is in progress (fIsSaving is set as well)
+  bool fIsComparing;
+    // currently comparing an image with a drive is in progress
       
   std::unique_ptr<CSplitManager> fSplitCallback;
     // callback object to handle splitting files in chunks
+  std::unique_ptr<CSplitManager> fTargetSplitCallback;
+    // callback object to handle splitting the target file when transcoding
+  DWORD fSourceCrc32; // checksum stored in the image read by the last operation
+  bool fSourceHasChecksum; // the image read by the last operation has a checksum
   DWORD fVerifyCrc32; // checksum after a verify run
   std::wstring fComment; // a comment used when storing a file
+#ifdef _WIN32
   std::unique_ptr<CVssWrapper> fVSS;
+#endif
   bool fMultiVolumeMode; 
     // COdinManager can run in one of two modes. if fMultiVolumeMode is set to false it
     // will create and release a VSS snapshot on its own as part of a DoCopy() operation.
@@ -197,6 +497,61 @@ private:
     // current index to backup in multi volume mode
   bool fWasCancelled;
     // indicates if true that an operation was cancelled by a user
+  std::wstring fErrorMessage;
+    // error of the thread that failed first, the others are stopped then and fail as well
+  std::unique_ptr<CBlockManifest> fBlockManifest;
+    // per block checksums collected during backup or read for a block verify
+  std::vector<std::unique_ptr<CBlockVerifyThread>> fBlockVerifyThreads;
+    // threads checking the image blocks in parallel
+  bool fIsBlockVerify;
+    // last verify was done against the block manifest
+  std::vector<TImageRange> fCorruptRanges;
+    // result of last block verify
+  std::unique_ptr<CChunkStore> fChunkStore;
+    // chunk store used when saving or restoring a deduplicated image
+  std::wstring fBaseImage;
+    // base image for an incremental backup or empty
+  std::unique_ptr<CBlockHashTable> fBlockHashes;
+    // per block digests of the volume calculated during backup
+  std::unique_ptr<CBlockHashTable> fBaseBlockHashes;
+    // per block digests of the base image of an incremental backup
+  std::unique_ptr<CRestoreChain> fRestoreChain;
+    // images restored one after the other when restoring an incremental image
+  unsigned fRestoreChainIndex;
+    // image of fRestoreChain currently restored
+  TVolumeInfo fRestoreVolume;
+    // target volume of restore chain
+  unsigned __int64 fDeltaSkippedBytes;
+    // bytes not written by the last delta restore because the target held them already
+  unsigned __int64 fReadBackVerifiedBytes;
+    // bytes read back and compared by the last restore
+  std::vector<bool> fFanOutTargetFailed;
+    // result per drive of the last restore to multiple drives
+  std::vector<std::wstring> fFanOutTargetErrors;
+    // error message per drive of the last restore to multiple drives
+  unsigned fMediaHashAlgorithms;
+  bool fMediaHashUsedClustersOnly;
+    // hashes to calculate of restored volumes
+  std::vector<std::unique_ptr<CMediaHash>> fMediaHashes;
+    // hash of saved volume or of restored volume per drive of last backup or restore
+  std::vector<TImageRange> fCompareDifferences;
+    // result of last compare
+  unsigned __int64 fCompareDifferingBytes;
+  unsigned __int64 fComparedBytes;
+    // differing and compared bytes of last compare
+  std::unique_ptr<CThrottle> fReadThrottle;
+  std::unique_ptr<CThrottle> fWriteThrottle;
+    // I/O budgets of read and write threads
+  std::unique_ptr<CCheckpointJournal> fJournal;
+    // checkpoints of the running backup or restore
+  bool fResume;
+    // continue the next backup or restore at the last checkpoint of its journal
+  unsigned __int64 fResumedBytes;
+    // volume data the last backup or restore took from an interrupted one
+  unsigned fJobReadLimit, fJobReadOpsLimit, fJobWriteLimit, fJobWriteOpsLimit;
+  bool fJobLowIoPriority;
+  unsigned fJobCheckpointInterval;
+    // I/O budget and checkpoints of the next operations, start with the configured ones
   
   DECLARE_SECTION()
   DECLARE_ENTRY(int /*TCompressionFormat*/, fCompressionMode) // mode how to compress images
@@ -205,6 +560,25 @@ private:
   DECLARE_ENTRY(unsigned __int64, fSplitFileSize) // size in bytes after which to split image files
   DECLARE_ENTRY(int, fReadBlockSize) // size in bytes to read from or write to disk in one chunk
   DECLARE_ENTRY(bool, fTakeVSSSnapshot)  // use VSS service to take a snapshot
+  DECLARE_ENTRY(int, fBlockManifestSize) // block size in bytes of block manifest written with image, 0 for none
+  DECLARE_ENTRY(bool, fParallelVerify) // verify images with block manifest in parallel without decompressing
+  DECLARE_ENTRY(int, fChunkPrefetchThreads) // number of threads reading chunks when restoring a deduplicated image
+  DECLARE_ENTRY(int, fBlockHashSize) // block size in bytes of volume block hashes for incremental backups, 0 for none
+  DECLARE_ENTRY(bool, fDeltaRestore) // restore writes only data that differs from the target
+  DECLARE_ENTRY(int, fDeltaCompareSize) // size in bytes of units compared in a delta restore
+  DECLARE_ENTRY(int, fFanOutMaxLag) // chunks a drive may fall behind the others when restoring to multiple drives
+  DECLARE_ENTRY(int, fFanOutDetachTimeout) // seconds after which a drive not taking data is given up, 0 for never
+  DECLARE_ENTRY(bool, fReadBackVerify) // restore reads written data back and compares them
+  DECLARE_ENTRY(int, fReadBackDistance) // bytes the read back lags behind writing
+  DECLARE_ENTRY(int, fReadBackQueueDepth) // written extents that may wait for being read back
+  DECLARE_ENTRY(int, fReadBackRetentionSize) // bytes of written data kept for read back
+  DECLARE_ENTRY(int, fCompareMaxRanges) // differing ranges a compare reports, further differences extend the last one
+  DECLARE_ENTRY(int, fReadLimit) // MB per second reading the source of an operation, 0 for no limit
+  DECLARE_ENTRY(int, fReadOpsLimit) // read operations per second, 0 for no limit
+  DECLARE_ENTRY(int, fWriteLimit) // MB per second writing the target of an operation, 0 for no limit
+  DECLARE_ENTRY(int, fWriteOpsLimit) // write operations per second, 0 for no limit
+  DECLARE_ENTRY(bool, fLowIoPriority) // read and write with low I/O priority (background mode)
+  DECLARE_ENTRY(int, fCheckpointInterval) // MB of volume data between two checkpoints of a backup or restore, 0 for none
 
   friend class ODINManagerTest;
 };
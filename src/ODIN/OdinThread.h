@@ -28,6 +28,8 @@
 #include <string>
 #include "Thread.h"
 
+class CThrottle;
+
 class COdinThread : public CThread
 {
   public:
@@ -35,6 +37,8 @@ class COdinThread : public CThread
       : CThread(dwCreationFlags) { 
 		fFinished = fErrorFlag = fCancel = false;
     fBytesProcessed = fCrc32 = 0;
+    fThrottle = NULL;
+    fLowIoPriority = false;
 	}
 
 	__int64 GetBytesProcessed() {
@@ -68,6 +72,13 @@ class COdinThread : public CThread
     return fCancel;
   }
 
+  // keep the I/O of the thread within the budget of throttle (NULL for no limit) and
+  // let the OS schedule it with low priority (read and write threads only)
+  void SetIoBudget(CThrottle* throttle, bool lowIoPriority) {
+    fThrottle = throttle;
+    fLowIoPriority = lowIoPriority;
+  }
+
   protected:
 
   __int64 fBytesProcessed;
@@ -76,6 +87,8 @@ class COdinThread : public CThread
   bool    fCancel;
   std::wstring fErrorMessage;
   DWORD   fCrc32;
+  CThrottle* fThrottle;       // budget of I/O or NULL
+  bool    fLowIoPriority;     // I/O in background mode
 }; 
 //---------------------------------------------------------------------------
 #endif
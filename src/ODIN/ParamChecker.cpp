@@ -43,6 +43,7 @@
 #include "FileNameUtil.h"
 #include "Util.h"
 #include "ImageStream.h"
+#include "StdImageStream.h"
 #include "PartitionInfoMgr.h"
 #include "SplitManagerCallback.h"
 #include "resource.h"
@@ -147,6 +148,10 @@ IUserFeedback::TFeedbackResult CParamChecker::CheckConditionsForSavePartition(co
     return IUserFeedback::TCancel;
   }
 
+  // standard output is no file that could exist or run out of space
+  if (CStdImageStream::IsStdName(fileName.c_str()))
+    return IUserFeedback::TOk;
+
   // check if target file already exists and warn that it will be overwritten
   if (CFileNameUtil::IsFileReadable(fileName.c_str())) {
     msgStr.Format(IDS_FILE_EXISTS, fileName.c_str());
@@ -307,10 +312,11 @@ IUserFeedback::TFeedbackResult CParamChecker::CheckConditionsForVerifyPartition(
   unsigned noFiles = 0;
   unsigned __int64 totalSize = 0;
 
-  if (!CFileNameUtil::IsFileReadable(openName.c_str()))
+  bool isStd = CStdImageStream::IsStdName(fileName.c_str());
+  if (!isStd && !CFileNameUtil::IsFileReadable(openName.c_str()))
     openName = splitFileName; // try multiple files mode
 
-  if (!CFileNameUtil::IsFileReadable(openName.c_str()))
+  if (!isStd && !CFileNameUtil::IsFileReadable(openName.c_str()))
   {
     msgStr.Format(IDS_CANTREADFILE, fileName.c_str());
     fFeedback.UserMessage(IUserFeedback::TError, IUserFeedback::TConfirm, (LPCWSTR)msgStr);
@@ -332,7 +338,8 @@ IUserFeedback::TFeedbackResult CParamChecker::CheckConditionsForVerifyPartition(
   crc32FromFileHeader = fileStream.GetCrc32Checksum();
   volType = fileStream.GetImageFileHeader().GetVolumeType();
 
-  if (totalSize == 0 || crc32FromFileHeader == 0) {
+  // an image on standard input has its size and checksum in the trailer at its end
+  if (!fileStream.IsChecksumPending() && (totalSize == 0 || crc32FromFileHeader == 0)) {
     // The image is corrupt and was not written completely (this information is stored as last step)
     msgStr.Format(IDS_INCOMPLETE_IMAGE, openName.c_str());
     fFeedback.UserMessage(IUserFeedback::TError, IUserFeedback::TConfirm, (LPCWSTR)msgStr);
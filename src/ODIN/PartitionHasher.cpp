@@ -0,0 +1,166 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <thread>
+#include "PartitionHasher.h"
+#include "StreamHasher.h"
+#include "FileHeader.h"
+#include "CompressedRunLengthStream.h"
+#include "OSException.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CPartitionHasher
+///////////////////////////////////////////////////////////////////////////////////////////
+
+CPartitionHasher::CPartitionHasher(unsigned algorithms, CMediaHash::TScope scope)
+{
+  fAlgorithms = algorithms;
+  fScope = scope;
+}
+
+bool CPartitionHasher::Calculate(vector<TPartition>& partitions)
+{
+  vector<thread> threads;
+  for (size_t i=0; i<partitions.size(); i++)
+    threads.push_back(thread(&CPartitionHasher::HashPartition, this, std::ref(partitions[i])));
+  bool ok = true;
+  for (size_t i=0; i<threads.size(); i++) {
+    threads[i].join();
+    ok = ok && partitions[i].ok;
+  }
+  return ok;
+}
+
+// the ranges of the volume in the order they are hashed, the same as CWriteThread restores
+// them: runs of used and free clusters up to the volume size
+void CPartitionHasher::GetRanges(const TPartition& partition, vector<TRange>& ranges) const
+{
+  unsigned __int64 pos = 0;
+  ranges.clear();
+  if (partition.runLengths.empty()) {
+    TRange all = { 0, partition.volumeSize, true };
+    ranges.push_back(all);
+    return;
+  }
+  for (size_t i=0; i<partition.runLengths.size(); i++) {
+    bool used = i % 2 == 0;
+    unsigned __int64 length = partition.runLengths[i] * partition.clusterSize;
+    if (length > 0 && (used || fScope == CMediaHash::scopeVolume)) {
+      TRange range = { pos, length, used };
+      ranges.push_back(range);
+    }
+    pos += length;
+  }
+  if (pos < partition.volumeSize && fScope == CMediaHash::scopeVolume) {
+    TRange rest = { pos, partition.volumeSize - pos, false };
+    ranges.push_back(rest);
+  }
+}
+
+void CPartitionHasher::HashPartition(TPartition& partition)
+{
+  vector<TRange> ranges;
+  unsigned __int64 totalLength = 0;
+  GetRanges(partition, ranges);
+  for (size_t i=0; i<ranges.size(); i++)
+    totalLength += ranges[i].length;
+
+  // CStreamHasher reads ahead while the data read before are hashed
+  size_t current = 0;
+  unsigned __int64 rangePos = 0;
+  partition.bytesRead = 0;
+  auto readRanges = [&](BYTE* buffer, unsigned size, unsigned& bytesRead) {
+    bytesRead = 0;
+    while (bytesRead < size && current < ranges.size()) {
+      const TRange& range = ranges[current];
+      unsigned count = range.length - rangePos < size - bytesRead ? (unsigned) (range.length - rangePos) : size - bytesRead;
+      unsigned countRead = count;
+      if (range.used) {
+        if (!partition.readAt(range.offset + rangePos, buffer + bytesRead, count, countRead) || countRead == 0)
+          return false;
+        partition.bytesRead += countRead;
+      } else {
+        memset(buffer + bytesRead, 0, count);
+      }
+      bytesRead += countRead;
+      rangePos += countRead;
+      if (rangePos == range.length) {
+        ++current;
+        rangePos = 0;
+      }
+    }
+    return true;
+  };
+
+  CStreamHasher hasher(fAlgorithms);
+  partition.sha1.clear();
+  partition.sha256.clear();
+  // a volume without data is the empty message
+  auto noData = [](BYTE*, unsigned, unsigned& bytesRead) { bytesRead = 0; return true; };
+  partition.ok = totalLength > 0 ? hasher.Calculate(readRanges, totalLength) : hasher.Calculate(noData, 0);
+  if (!partition.ok)
+    return;
+  if (fAlgorithms & CMediaHash::hashSha1)
+    partition.sha1 = CMediaHash::ToHex(hasher.GetSha1Digest(), CSha1::sDigestLength);
+  if (fAlgorithms & CMediaHash::hashSha256)
+    partition.sha256 = CMediaHash::ToHex(hasher.GetSha256Digest(), CSha256::sDigestLength);
+}
+
+void CPartitionHasher::ReadImageLayout(LPCWSTR imageFile, TPartition& partition)
+{
+  CImageFileHeader header;
+  HANDLE hFile = CreateFile(imageFile, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK_OS_EX_HANDLE_PARAM1(hFile, EWinException::fileOpenError, imageFile);
+  try {
+    header.ReadHeaderFromFile(hFile);
+  } catch (...) {
+    CloseHandle(hFile);
+    throw;
+  }
+  CloseHandle(hFile);
+  if (!header.IsValidFileHeader())
+    THROW_FILEFORMAT_EXC(EFileFormatException::magicByteError);
+
+  partition.volumeSize = header.GetVolumeSize();
+  partition.clusterSize = header.GetClusterSize();
+  partition.runLengths.clear();
+  unsigned __int64 bitmapOffset, bitmapLength;
+  header.GetClusterBitmapOffsetAndLength(bitmapOffset, bitmapLength);
+  if (header.GetVolumeEncoding() != CImageFileHeader::noVolumeBitmap && bitmapLength > 0) {
+    // pairs of used and free run lengths as CWriteThread reads them
+    CompressedRunLengthStreamReader reader(imageFile, bitmapOffset, (DWORD) bitmapLength);
+    while (!reader.LastValueRead()) {
+      partition.runLengths.push_back(reader.GetNextRunLength());
+      partition.runLengths.push_back(reader.GetNextRunLength());
+    }
+  }
+}
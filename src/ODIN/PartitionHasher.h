@@ -0,0 +1,84 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __PARTITIONHASHER_H__
+#define __PARTITIONHASHER_H__
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "MediaHash.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CPartitionHasher calculates the media hashes (see CMediaHash) of restored
+// partitions by reading them back. Only the used clusters given by the allocation map of
+// the image are read, free clusters are hashed as zeros or skipped depending on the
+// scope. So verify time depends on the amount of data in the image and not on the size
+// of the media. Each partition is hashed on its own thread.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CPartitionHasher
+{
+public:
+  // read up to size bytes at offset (relative to the start of the partition) to buffer,
+  // must be callable from a thread of its own
+  typedef std::function<bool(unsigned __int64 offset, BYTE* buffer, unsigned size, unsigned& bytesRead)> TReadAtFunction;
+
+  typedef struct {
+    TReadAtFunction readAt;                  // reads from the restored partition
+    unsigned __int64 volumeSize;             // size of the volume in the image
+    unsigned clusterSize;                    // bytes per cluster of the allocation map
+    std::vector<unsigned __int64> runLengths;  // used, free, used... clusters, empty if all are used
+    // results:
+    bool ok;                                 // false if reading failed
+    std::wstring sha1;                       // upper case hex digests, empty if not calculated
+    std::wstring sha256;
+    unsigned __int64 bytesRead;              // bytes read from the partition
+  } TPartition;
+
+  // algorithms is a combination of CMediaHash::hashSha1 and CMediaHash::hashSha256
+  CPartitionHasher(unsigned algorithms, CMediaHash::TScope scope);
+
+  // hash all partitions in parallel, true if all of them could be read
+  bool Calculate(std::vector<TPartition>& partitions);
+
+  // fill the volume size, cluster size and allocation map of partition from the header
+  // of image file imageFile (first file of a split image)
+  static void ReadImageLayout(LPCWSTR imageFile, TPartition& partition);
+
+private:
+  typedef struct {
+    unsigned __int64 offset;
+    unsigned __int64 length;
+    bool used;                               // false: hashed as zeros without reading
+  } TRange;
+
+  void HashPartition(TPartition& partition);
+  void GetRanges(const TPartition& partition, std::vector<TRange>& ranges) const;
+
+  unsigned fAlgorithms;
+  CMediaHash::TScope fScope;
+};
+
+#endif
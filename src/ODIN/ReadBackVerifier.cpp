@@ -0,0 +1,307 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <string>
+#include "ReadBackVerifier.h"
+#include "BlockCompare.h"
+#include "IImageStream.h"
+#include "OdinThread.h"
+#include "Exception.h"
+#include "OSException.h"
+#include "InternalException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// Thread reading back the extents written to the target
+class CReadBackThread : public COdinThread
+{
+public:
+  CReadBackThread(CReadBackVerifier* verifier)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fVerifier = verifier;
+  }
+
+  virtual DWORD Execute()
+  {
+    SetName("ReadBackThread");
+    while (fVerifier->VerifyNext())
+      ;
+    fFinished = true;
+    return 0;
+  }
+
+private:
+  CReadBackVerifier* fVerifier;
+};
+
+//---------------------------------------------------------------------------
+CReadBackVerifier::CReadBackVerifier(IImageStream* target, unsigned distance, unsigned queueDepth, unsigned retentionSize,
+                                     HANDLE flushHandle)
+{
+  if (queueDepth == 0 || retentionSize == 0)
+    THROW_INT_EXC(EInternalException::inputError);
+  fTarget = target;
+  fFlushHandle = flushHandle;
+  fDistance = distance;
+  fQueueDepth = queueDepth;
+  fPosition = fTarget->GetPosition();
+  fRing.resize(retentionSize);
+  fRingHead = fRingUsed = 0;
+  fBytesWritten = fFlushedBytes = fVerifiedBytes = 0;
+  fMismatchOffset = (unsigned __int64) -1;
+  fWriterWaiting = fFinishing = fQuit = false;
+  fDataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  fSpaceEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+  fReadBackThread = make_unique<CReadBackThread>(this);
+  fReadBackThread->Resume();
+}
+
+CReadBackVerifier::~CReadBackVerifier()
+{
+  fLock.Enter();
+  fQuit = true;
+  fLock.Leave();
+  SetEvent(fDataEvent);
+  fReadBackThread->WaitForThread();
+  CloseHandle(fDataEvent);
+  CloseHandle(fSpaceEvent);
+}
+
+void CReadBackVerifier::Seek(unsigned __int64 pos)
+{
+  fPosition = pos;
+}
+
+void CReadBackVerifier::Write(const BYTE* data, unsigned length, unsigned* bytesWritten)
+{
+  *bytesWritten = 0;
+  CheckError();
+  if (length == 0)
+    return;
+  WriteTarget(fPosition, data, length);
+  Retain(fPosition, data, length);
+  fPosition += length;
+  *bytesWritten = length;
+}
+
+void CReadBackVerifier::Finish()
+{
+  fLock.Enter();
+  fFinishing = true;
+  SetEvent(fDataEvent);
+  while (!fExtents.empty() && !fError) {
+    fLock.Leave();
+    DWORD res = WaitForSingleObject(fSpaceEvent, INFINITE);
+    if (res != WAIT_OBJECT_0)
+      THROW_INT_EXC(EInternalException::threadSyncError);
+    fLock.Enter();
+  }
+  fLock.Leave();
+  CheckError();
+}
+
+//---------------------------------------------------------------------------
+// Keep a copy of data written at pos until it is verified, an extent is split
+// where the ring buffer wraps around
+void CReadBackVerifier::Retain(unsigned __int64 pos, const BYTE* data, unsigned length)
+{
+  fLock.Enter();
+  while (length > 0 && !fError) {
+    unsigned count = fExtents.size() < fQueueDepth ? GetRingSpace() : 0;
+    if (count == 0) {
+      // let the read back thread verify without waiting for the distance
+      fWriterWaiting = true;
+      SetEvent(fDataEvent);
+      fLock.Leave();
+      DWORD res = WaitForSingleObject(fSpaceEvent, INFINITE);
+      if (res != WAIT_OBJECT_0)
+        THROW_INT_EXC(EInternalException::threadSyncError);
+      fLock.Enter();
+      fWriterWaiting = false;
+      continue;
+    }
+    if (count > length)
+      count = length;
+    // the free part of the ring is not accessed by the read back thread
+    unsigned ringPos = fRingHead;
+    fLock.Leave();
+    memcpy(&fRing[ringPos], data, count);
+    fLock.Enter();
+
+    TExtent extent;
+    fBytesWritten += count;
+    extent.pos = pos;
+    extent.length = count;
+    extent.ringPos = ringPos;
+    extent.writtenEnd = fBytesWritten;
+    fExtents.push_back(extent);
+    fRingHead += count;
+    fRingUsed += count;
+    SetEvent(fDataEvent);
+    pos += count;
+    data += count;
+    length -= count;
+  }
+  fLock.Leave();
+  CheckError();
+}
+
+// free bytes in the ring buffer following fRingHead, must be called with fLock held
+unsigned CReadBackVerifier::GetRingSpace()
+{
+  unsigned size = (unsigned) fRing.size();
+  if (fRingUsed == 0) {
+    fRingHead = 0;
+    return size;
+  }
+  unsigned tail = fExtents.front().ringPos;
+  if (fRingHead > tail) {
+    if (fRingHead < size)
+      return size - fRingHead;
+    fRingHead = 0;
+  }
+  return tail - fRingHead;
+}
+
+//---------------------------------------------------------------------------
+// Wait until the front extent may be read back, read and compare it
+bool CReadBackVerifier::VerifyNext()
+{
+  TExtent extent;
+  bool flush;
+
+  fLock.Enter();
+  while (true) {
+    if (fQuit || fError) {
+      fLock.Leave();
+      return false;
+    }
+    if (!fExtents.empty()) {
+      extent = fExtents.front();
+      if (fFinishing || fWriterWaiting || fBytesWritten - extent.writtenEnd >= fDistance)
+        break;
+    } else if (fFinishing) {
+      fLock.Leave();
+      return false;
+    }
+    fLock.Leave();
+    WaitForSingleObject(fDataEvent, INFINITE);
+    fLock.Enter();
+  }
+  // flush once for all extents written up to now
+  flush = fFlushHandle != NULL && extent.writtenEnd > fFlushedBytes;
+  if (flush)
+    fFlushedBytes = fBytesWritten;
+  fLock.Leave();
+
+  unsigned bytesRead = 0;
+  unsigned __int64 mismatchOffset = (unsigned __int64) -1;
+  try {
+    if (flush) {
+      fTargetLock.Enter();
+      BOOL ok = FlushFileBuffers(fFlushHandle);
+      fTargetLock.Leave();
+      CHECK_OS_EX_PARAM1(ok, EWinException::writeVolumeError, fTarget->GetName());
+    }
+    fReadData.resize(extent.length);
+    ReadTarget(extent.pos, &fReadData[0], extent.length, &bytesRead);
+    unsigned diff = CBlockCompare::FindDifference(&fRing[extent.ringPos], &fReadData[0], bytesRead);
+    if (diff < bytesRead || bytesRead < extent.length) {
+      mismatchOffset = extent.pos + (diff < bytesRead ? diff : bytesRead);
+      THROW_INT_EXC_PARAM1(EInternalException::readBackMismatch, to_wstring(mismatchOffset).c_str());
+    }
+  } catch (...) {
+    fLock.Enter();
+    fMismatchOffset = mismatchOffset;
+    fLock.Leave();
+    SetError(current_exception());
+    return false;
+  }
+
+  fLock.Enter();
+  fExtents.pop_front();
+  fRingUsed -= extent.length;
+  fVerifiedBytes += extent.length;
+  fLock.Leave();
+  SetEvent(fSpaceEvent);
+  return true;
+}
+
+//---------------------------------------------------------------------------
+void CReadBackVerifier::SetError(exception_ptr error)
+{
+  fLock.Enter();
+  if (!fError)
+    fError = error;
+  fLock.Leave();
+  SetEvent(fSpaceEvent);
+}
+
+void CReadBackVerifier::CheckError()
+{
+  fLock.Enter();
+  exception_ptr error = fError;
+  fLock.Leave();
+  if (error)
+    rethrow_exception(error);
+}
+
+void CReadBackVerifier::WriteTarget(unsigned __int64 pos, const BYTE* data, unsigned length)
+{
+  unsigned bytesWritten;
+
+  fTargetLock.Enter();
+  try {
+    if (fTarget->GetPosition() != pos)
+      fTarget->Seek(pos, FILE_BEGIN);
+    fTarget->Write((void*) data, length, &bytesWritten);
+  } catch (...) {
+    fTargetLock.Leave();
+    throw;
+  }
+  fTargetLock.Leave();
+  if (bytesWritten != length)
+    THROW_INT_EXC(EInternalException::wrongWriteSize);
+}
+
+void CReadBackVerifier::ReadTarget(unsigned __int64 pos, BYTE* buffer, unsigned length, unsigned* bytesRead)
+{
+  fTargetLock.Enter();
+  try {
+    fTarget->Seek(pos, FILE_BEGIN);
+    fTarget->Read(buffer, length, bytesRead);
+  } catch (...) {
+    fTargetLock.Leave();
+    throw;
+  }
+  fTargetLock.Leave();
+}
@@ -0,0 +1,124 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __READBACKVERIFIER_H__
+#define __READBACKVERIFIER_H__
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <exception>
+#include "sync.h"
+
+class IImageStream;
+class CReadBackThread;
+
+//---------------------------------------------------------------------------
+// class CReadBackVerifier
+// Writes restored data to a target and reads every written extent back while
+// the restore continues. A copy of the written data is kept in a ring buffer of
+// retentionSize bytes. A separate thread reads an extent from the target as soon
+// as the writer is distance bytes past it and compares it with the copy. At most
+// queueDepth extents wait for their read back, the writer waits when the queue
+// or the ring buffer is full. The first difference or read error is thrown by the
+// next Write() or by Finish(), a difference with its exact offset on the target.
+// If flushHandle is given it is flushed before data are read back that have not
+// been flushed yet, so that they come from the media and not from the write
+// cache of the device.
+
+class CReadBackVerifier {
+public:
+  CReadBackVerifier(IImageStream* target, unsigned distance, unsigned queueDepth, unsigned retentionSize,
+    HANDLE flushHandle = NULL);
+  ~CReadBackVerifier();
+
+  // write length bytes at the current position, advances the position by length
+  void Write(const BYTE* data, unsigned length, unsigned* bytesWritten);
+
+  // set current position from the beginning of the target
+  void Seek(unsigned __int64 pos);
+
+  unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+
+  // wait until all written data are read back, throws if they differ
+  void Finish();
+
+  // bytes read back and found identical
+  unsigned __int64 GetVerifiedBytes() const {
+    return fVerifiedBytes;
+  }
+
+  // offset on the target of the first byte that differed or -1 if none
+  unsigned __int64 GetMismatchOffset() const {
+    return fMismatchOffset;
+  }
+
+  // used by read back thread: verify the next extent, returns false if there is
+  // nothing more to verify
+  bool VerifyNext();
+
+private:
+  typedef struct {
+    unsigned __int64 pos;         // position on target
+    unsigned length;
+    unsigned ringPos;             // position of copy in fRing
+    unsigned __int64 writtenEnd;  // fBytesWritten when the extent was written
+  } TExtent;
+
+  void Retain(unsigned __int64 pos, const BYTE* data, unsigned length);
+  unsigned GetRingSpace();
+  void CheckError();
+  void SetError(std::exception_ptr error);
+  void WriteTarget(unsigned __int64 pos, const BYTE* data, unsigned length);
+  void ReadTarget(unsigned __int64 pos, BYTE* buffer, unsigned length, unsigned* bytesRead);
+
+  IImageStream* fTarget;
+  HANDLE fFlushHandle;
+  unsigned fDistance;
+  unsigned fQueueDepth;
+  unsigned __int64 fPosition;
+  std::vector<BYTE> fRing;           // copy of written data not yet verified
+  unsigned fRingHead;                // position in fRing where next data are kept
+  unsigned fRingUsed;
+  std::deque<TExtent> fExtents;      // extents waiting for read back, front is verified next
+  std::vector<BYTE> fReadData;       // data read back from target
+  unsigned __int64 fBytesWritten;
+  unsigned __int64 fFlushedBytes;    // fBytesWritten at last flush
+  unsigned __int64 fVerifiedBytes;
+  unsigned __int64 fMismatchOffset;
+  std::exception_ptr fError;         // first difference or error of read back thread
+  bool fWriterWaiting;               // writer waits for room, read back must not wait for distance
+  bool fFinishing;
+  bool fQuit;
+  HANDLE fDataEvent;                 // signaled when an extent was added or state changed
+  HANDLE fSpaceEvent;                // signaled when an extent was verified or an error occurred
+  CCriticalSection fLock;            // protects extents, ring positions and state
+  CCriticalSection fTargetLock;      // serializes target access of writer and read back thread
+  std::unique_ptr<CReadBackThread> fReadBackThread;
+};
+
+#endif
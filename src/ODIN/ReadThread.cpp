@@ -28,8 +28,11 @@
 #include "ReadThread.h"
 #include "IRunLengthStreamReader.h"
 #include "crc32.h"
+#include "BlockHashTable.h"
+#include "MediaHash.h"
 #include "Exception.h"
 #include "InternalException.h"
+#include "Throttle.h"
 
 using namespace std;
 
@@ -52,8 +55,17 @@ using namespace std;
   //fAllocMapOffset = 0;
   //fAllocMapLen = 0;
   fVolumeDataOffset = 0;
+  fVolumeDataSize = 0;
   fRunLengthReader = NULL;
   fVerifyOnly = verifyOnly;
+  fBlockHashes = NULL;
+  fBaseBlockHashes = NULL;
+  fMediaHash = NULL;
+  fMediaSize = 0;
+  fIsVolumeStore = false;
+  fCheckpointInterval = 0;
+  fNextCheckpoint = 0;
+  fResumePos = 0;
 } 
 
 //---------------------------------------------------------------------------
@@ -67,12 +79,16 @@ DWORD CReadThread::Execute()
 {
   SetName("ReadThread");
   ATLTRACE("CReadThread created,  thread: %d, name: Read-Thread\n", GetCurrentThreadId());
+  if (fLowIoPriority && !EnterBackgroundMode())
+    ATLTRACE("CReadThread could not enter background mode, error: %d\n", GetLastError());
   try {
     if (fVerifyOnly) {
       ReadLoopVerify();
     } else {
       if (NULL == fRunLengthReader)
         ReadLoopSimple();
+      else if (NULL != fBlockHashes)
+        ReadLoopBlockHash();
       else
         ReadLoopCombined(); 
     }
@@ -98,6 +114,37 @@ DWORD CReadThread::Execute()
   }
 }
 
+//---------------------------------------------------------------------------
+// Read from the read store within the I/O budget of the thread
+void CReadThread::ReadSource(void* data, unsigned length, unsigned* bytesRead)
+{
+  fReadStore->Read(data, length, bytesRead);
+  if (fThrottle)
+    fThrottle->Consume(*bytesRead);
+}
+
+//---------------------------------------------------------------------------
+// The read store holds the volume data at their offsets on the volume, otherwise
+// it is an image file with the volume data starting at fVolumeDataOffset
+bool CReadThread::IsVolume() const
+{
+  return fIsVolumeStore || fReadStore->IsDrive();
+}
+
+//---------------------------------------------------------------------------
+// Mark a chunk that ends at position dataPos of the volume data (offset sourcePos
+// on the volume) as checkpoint if the checkpoint interval is over, clear the mark
+// of a reused chunk otherwise
+void CReadThread::MarkCheckpoint(CBufferChunk* chunk, unsigned __int64 dataPos, unsigned __int64 sourcePos)
+{
+  if (fCheckpointInterval > 0 && dataPos >= fNextCheckpoint) {
+    chunk->SetCheckpoint(dataPos, sourcePos);
+    fNextCheckpoint = dataPos + fCheckpointInterval;
+  } else {
+    chunk->ClearCheckpoint();
+  }
+}
+
 //---------------------------------------------------------------------------
 
 // A modified read loop that uses the stored run lengths to only store clusters 
@@ -122,9 +169,11 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
   bufferBytesUsed = 0;
 
   remainingBufferSize = writeChunk->GetMaxSize();
-  if (!fReadStore->IsDrive()) {
-    fReadStore->Seek(fVolumeDataOffset, FILE_BEGIN);
+  if (!IsVolume()) {
+    fReadStore->Seek(fVolumeDataOffset + fResumePos, FILE_BEGIN);
   }
+  unsigned __int64 skipBytes = fResumePos; // data of an interrupted backup that are already saved
+  fBytesProcessed = fResumePos;
 
   while (!fRunLengthReader->LastValueRead()) {
     // read run length of used clusters
@@ -138,6 +187,14 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
     }
     bytesToReadForReadRunLength = fClusterSize * runLength;
     //ATLTRACE("  size in bytes is: %d\n", (DWORD) bytesToReadForReadRunLength);
+    if (skipBytes > 0) {
+      unsigned __int64 skip = skipBytes < bytesToReadForReadRunLength ? skipBytes : bytesToReadForReadRunLength;
+      seekPos += skip;
+      skipBytes -= skip;
+      bytesToReadForReadRunLength -= skip;
+      if (IsVolume())
+        fReadStore->Seek(seekPos, FILE_BEGIN);
+    }
         
     while (bytesToReadForReadRunLength > 0) {
 
@@ -148,13 +205,15 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
          bytesToRead = remainingBufferSize;
          runLength -= remainingBufferSize / fClusterSize;
        }
-       fReadStore->Read(buffer, bytesToRead, &bytesRead);
+       ReadSource(buffer, bytesToRead, &bytesRead);
        if (bytesToRead != bytesRead) {
          THROW_INT_EXC(EInternalException::wrongReadSize); 
        }
        //ATLTRACE("First Bytes of run length are: %d, %d, %d, %d, %d\n",
        //  (unsigned) buffer[0], (unsigned) buffer[1], (unsigned) buffer[2],(unsigned) buffer[3], (unsigned) buffer[4]);
        crc32.AddDataBlock(buffer, bytesRead);
+       if (fMediaHash)
+         fMediaHash->AddData(buffer, bytesRead);
        seekPos += bytesRead;
        buffer += bytesRead;
        bufferBytesUsed += bytesRead;
@@ -168,6 +227,7 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
        if (remainingBufferSize <= 0) {
          // release current block, because it is full and get a new block.
          //ATLTRACE("Buffer is full, releasing buffer, bytes written: %d\n", (DWORD) dbgBytesReadTotal);
+         MarkCheckpoint(writeChunk, fBytesProcessed, seekPos);
          fTargetQueue->ReleaseChunk(writeChunk);
          if (fCancel)
            Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
@@ -189,14 +249,21 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
     ATLTRACE("Skipping run length of free clusters, size: %d\n", (DWORD) runLength);
     //ATLTRACE("  number of total clusters up to now: %u\n", dbgNoUsedClustersTotal);
     seekPos += fClusterSize * runLength; // skip free clusters
+    if (fMediaHash)
+      fMediaHash->AddZeros(fClusterSize * runLength);
     // ATLTRACE("read thread: set seek position: %d\n", (DWORD) seekPos);
 
-    if (fReadStore->IsDrive()) { 
+    if (IsVolume()) { 
       fReadStore->Seek(seekPos, FILE_BEGIN);
     } 
   } // outer while
 
+  // media hash must be complete before the image file is finished by the write thread
+  if (fMediaHash)
+    fMediaHash->Finish(fMediaSize);
+  writeChunk->SetSize(bufferBytesUsed); // last chunk may be taken without data
   writeChunk->SetEOF(true);  
+  writeChunk->ClearCheckpoint();
   ATLTRACE("Number of read bytes in total: %u\n", dbgNoUsedClustersTotal * fClusterSize);
   fTargetQueue->ReleaseChunk(writeChunk);
   ATLTRACE("Read thread: Number of read bytes in total: %u\n", fBytesProcessed);
@@ -204,23 +271,174 @@ void  CReadThread::ReadLoopCombined(void) // ReadLoopFromPartition(void)
   ATLTRACE("Read thread CRC32 is: %u\n", fCrc32);
 }
 
+//---------------------------------------------------------------------------
+// A read loop for used clusters like ReadLoopCombined() that collects the used
+// clusters of each block of the block hash table and calculates its digest. A
+// block is passed on to the target queue only if it is not the same as in the
+// base image (or always, if there is no base image). 
+void CReadThread::ReadLoopBlockHash(void)
+{
+  const DWORD blockSize = fBlockHashes->GetBlockSize();
+  std::vector<BYTE> blockData(blockSize);
+  unsigned blockBytes = 0;          // bytes of used clusters collected for current block
+  unsigned __int64 blockNo = 0;     // current block 
+  unsigned __int64 volumePos = 0;   // position on volume
+  unsigned __int64 runLength, bytesInRun;
+  unsigned bytesRead;
+  CBufferChunk *chunk = NULL;
+  unsigned chunkBytes = 0;
+  CSha256 sha;
+  CCRC32 crc32;
+
+  ATLASSERT(fRunLengthReader != NULL);
+  if (blockSize == 0 || blockSize % fClusterSize != 0)
+    THROW_INT_EXC(EInternalException::inputError);
+  if (!IsVolume()) {
+    fReadStore->Seek(fVolumeDataOffset, FILE_BEGIN);
+  }
+
+  while (!fRunLengthReader->LastValueRead()) {
+    // read run length of used clusters
+    runLength = fRunLengthReader->GetNextRunLength();
+    if (runLength > 0 && fClusterSize > ULLONG_MAX / runLength) {
+      THROW_INT_EXC(EInternalException::inputError);
+    }
+    bytesInRun = fClusterSize * runLength;
+
+    while (bytesInRun > 0) {
+      // finish all blocks before the one the run continues in
+      while (blockNo < volumePos / blockSize) {
+        FinishBlock(blockNo++, sha, &blockData[0], blockBytes, chunk, chunkBytes, crc32);
+        blockBytes = 0;
+      }
+      DWORD offsetInBlock = (DWORD) (volumePos - blockNo * blockSize);
+      unsigned bytesToRead = blockSize - offsetInBlock;
+      if (bytesToRead > bytesInRun)
+        bytesToRead = (unsigned) bytesInRun;
+      ReadSource(&blockData[blockBytes], bytesToRead, &bytesRead);
+      if (bytesToRead != bytesRead) {
+        THROW_INT_EXC(EInternalException::wrongReadSize); 
+      }
+      CBlockHashTable::AddRunToDigest(sha, offsetInBlock, &blockData[blockBytes], bytesRead);
+      if (fMediaHash)
+        fMediaHash->AddData(&blockData[blockBytes], bytesRead);
+      blockBytes += bytesRead;
+      volumePos += bytesRead;
+      bytesInRun -= bytesRead;
+      fBytesProcessed += bytesRead;
+    }
+
+    // skip run length of free clusters
+    runLength = fRunLengthReader->GetNextRunLength();
+    volumePos += fClusterSize * runLength;
+    if (fMediaHash)
+      fMediaHash->AddZeros(fClusterSize * runLength);
+    if (IsVolume()) { 
+      fReadStore->Seek(volumePos, FILE_BEGIN);
+    } 
+  }
+  // finish last block and all unused blocks at end of volume
+  while (blockNo < fBlockHashes->GetBlockCount()) {
+    FinishBlock(blockNo++, sha, &blockData[0], blockBytes, chunk, chunkBytes, crc32);
+    blockBytes = 0;
+  }
+
+  if (fMediaHash)
+    fMediaHash->Finish(fMediaSize);
+  if (!chunk) {
+    chunk = fSourceQueue->GetChunk(); // may block
+    if (!chunk)
+      THROW_INT_EXC(EInternalException::getChunkError);
+    chunk->SetSize(0);
+  }
+  chunk->SetEOF(true);  
+  fTargetQueue->ReleaseChunk(chunk);
+  fCrc32 = crc32.GetResult();
+  ATLTRACE("Read thread: Number of read bytes in total: %u\n", fBytesProcessed);
+  ATLTRACE("Read thread: Number of changed blocks: %u\n", (unsigned) fBlockHashes->GetStoredBlockCount());
+  ATLTRACE("Read thread CRC32 is: %u\n", fCrc32);
+}
+
+//---------------------------------------------------------------------------
+// Store the digest of a complete block in the block hash table and pass its
+// data on if it has changed.
+void CReadThread::FinishBlock(unsigned __int64 blockNo, CSha256& sha, const BYTE* blockData, unsigned blockBytes,
+                              CBufferChunk*& chunk, unsigned& chunkBytes, CCRC32& crc32)
+{
+  BYTE digest[CSha256::sDigestLength];
+  DWORD flags = 0;
+
+  if (blockBytes > 0) {
+    sha.GetResult(digest);
+    sha.Reset();
+    flags = CBlockHashTable::blockUsed;
+  } else {
+    memset(digest, 0, sizeof(digest));
+  }
+  if (blockBytes > 0 && (!fBaseBlockHashes || !fBaseBlockHashes->IsSameBlock(blockNo, digest, flags))) {
+    flags |= CBlockHashTable::blockStored;
+    EmitData(blockData, blockBytes, chunk, chunkBytes, crc32);
+  }
+  fBlockHashes->SetBlockHash(blockNo, digest, flags);
+}
+
+//---------------------------------------------------------------------------
+// Copy data to the chunks of the target queue, releasing each full chunk.
+void CReadThread::EmitData(const BYTE* data, unsigned length, CBufferChunk*& chunk, unsigned& chunkBytes, CCRC32& crc32)
+{
+  while (length > 0) {
+    if (!chunk) {
+      chunk = fSourceQueue->GetChunk(); // may block
+      if (!chunk)
+        THROW_INT_EXC(EInternalException::getChunkError);
+      chunkBytes = 0;
+    }
+    unsigned count = chunk->GetMaxSize() - chunkBytes;
+    if (count > length)
+      count = length;
+    memcpy((BYTE*)chunk->GetData() + chunkBytes, data, count);
+    crc32.AddDataBlock((BYTE*)data, count);
+    chunkBytes += count;
+    data += count;
+    length -= count;
+    chunk->SetSize(chunkBytes);
+    if (chunkBytes == chunk->GetMaxSize()) {
+      fTargetQueue->ReleaseChunk(chunk);
+      chunk = NULL;
+      if (fCancel)
+        Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
+    }
+  }
+}
+
 //---------------------------------------------------------------------------
 // Simple read loop reading the complete input buffer after buffer
 void  CReadThread::ReadLoopSimple(void)
 {
   bool bEOF = false;
   bool bSkipUnallocated = true; 
-  unsigned nBytesRead;
+  unsigned nBytesRead, nBytesToRead;
+  unsigned __int64 remaining = fVolumeDataSize;
   CCRC32 crc32;
-  if (!fReadStore->IsDrive()) {
-    fReadStore->Seek(fVolumeDataOffset, FILE_BEGIN);
+  if (!IsVolume()) {
+    fReadStore->Seek(fVolumeDataOffset + fResumePos, FILE_BEGIN);
+  } else if (fResumePos > 0) {
+    fReadStore->Seek(fResumePos, FILE_BEGIN);
   }
+  // data of an interrupted backup that are already saved
+  if (fVolumeDataSize > 0)
+    remaining = fResumePos < fVolumeDataSize ? fVolumeDataSize - fResumePos : 0;
+  fBytesProcessed = fResumePos;
 
   while (!bEOF ) {
     CBufferChunk *chunk = fSourceQueue->GetChunk(); // may block
     if (!chunk)
       THROW_INT_EXC(EInternalException::getChunkError);
-    fReadStore->Read(chunk->GetData(), chunk->GetSize(), &nBytesRead);
+    nBytesToRead = chunk->GetSize();
+    if (fVolumeDataSize > 0 && remaining < nBytesToRead)
+      nBytesToRead = (unsigned) remaining; // stop at end of data area
+    ReadSource(chunk->GetData(), nBytesToRead, &nBytesRead);
+    remaining -= nBytesRead;
 
     // If we didn't get as much data as we expected, then we're at the end of the file.  Set the EOF marker
     // in the buffer chunk so the write thread knows this is the last.
@@ -230,9 +448,18 @@ void  CReadThread::ReadLoopSimple(void)
     }  
     chunk->SetSize(nBytesRead);
     crc32.AddDataBlock((BYTE*)(chunk->GetData()), nBytesRead);
+    if (fMediaHash) {
+      fMediaHash->AddData((BYTE*)(chunk->GetData()), nBytesRead);
+      if (bEOF)
+        fMediaHash->Finish(fMediaSize);
+    }
     fBytesProcessed += nBytesRead;
     //ATLTRACE("  Read thread: Number of read bytes for current block: %u\n", fBytesProcessed);  
     //ATLTRACE("  Read thread CRC32 for this block is: %u\n", crc32.GetResult());
+    if (bEOF)
+      chunk->ClearCheckpoint();
+    else
+      MarkCheckpoint(chunk, fBytesProcessed, fBytesProcessed);
     fTargetQueue->ReleaseChunk(chunk);
     if (fCancel)
       Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
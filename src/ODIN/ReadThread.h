@@ -32,6 +32,10 @@ class CImageBuffer;
 class IImageStream;
 class CBufferChunk;
 class CompressedRunLengthStreamReader;
+class CBlockHashTable;
+class CMediaHash;
+class CSha256;
+class CCRC32;
 
 //---------------------------------------------------------------------------
 
@@ -47,20 +51,77 @@ class CReadThread : public COdinThread
       fVolumeDataOffset = volumeDataOffset;
     }
 
+    // length of volume data in image file, data behind it (block manifest etc.) is
+    // not read, 0 reads up to the end of the file
+    void SetVolumeDataSize(unsigned __int64 volumeDataSize) {
+      fVolumeDataSize = volumeDataSize;
+    }
+
+    // the read store holds a volume at the offsets of the volume like a drive does,
+    // e.g. a file with a copy of a volume: free clusters are skipped by seeking
+    void SetVolumeStore(bool isVolumeStore) {
+      fIsVolumeStore = isVolumeStore;
+    }
+
+    // calculate the block digests of the volume while reading (backup of used blocks only),
+    // if baseHashes is given only blocks that differ from the base image are passed on
+    void SetBlockHashTable(CBlockHashTable* hashes, const CBlockHashTable* baseHashes) {
+      fBlockHashes = hashes;
+      fBaseBlockHashes = baseHashes;
+    }
+
+    // calculate the digests of the volume while reading it for a backup, free clusters
+    // count as zeros up to mediaSize
+    void SetMediaHash(CMediaHash* hash, unsigned __int64 mediaSize) {
+      fMediaHash = hash;
+      fMediaSize = mediaSize;
+    }
+
+    // mark a chunk as checkpoint of a backup each time another interval bytes of data
+    // were read (see CBufferChunk::SetCheckpoint()), 0 marks none
+    void SetCheckpointInterval(unsigned __int64 interval) {
+      fCheckpointInterval = interval;
+      fNextCheckpoint = interval;
+    }
+
+    // continue an interrupted backup at position dataPos of the volume data, the
+    // position of a checkpoint (not with block hashes or media hash)
+    void SetResumePosition(unsigned __int64 dataPos) {
+      fResumePos = dataPos;
+      fNextCheckpoint = dataPos + fCheckpointInterval;
+    }
+
 protected:
     CImageBuffer *fSourceQueue;
     CImageBuffer *fTargetQueue;
     IImageStream  *fReadStore;
     std::wstring fAllocMapFileName; // name of file where file allocation table map is stored
     unsigned __int64 fVolumeDataOffset;   // offset of volume data in image file
+    unsigned __int64 fVolumeDataSize;     // length of volume data in image file or 0 if unknown
     HANDLE fAllocMapFileHandle;       // handle of file where file allocation table map is stored
     // unsigned __int64 fAllocMapOffset; // offset in file where file allocation table map 
     // unsigned __int64 fAllocMapLen;    // length of file allocation map table
     DWORD fClusterSize;               // size each bit in allocation bitmap represents
     IRunLengthStreamReader* fRunLengthReader; // interface to get run length of (un)allocated clusters
     bool fVerifyOnly;                   // check only checksum of a stored image
+    CBlockHashTable* fBlockHashes;      // block digests calculated while reading or NULL
+    const CBlockHashTable* fBaseBlockHashes; // block digests of base image for incremental backup or NULL
+    CMediaHash* fMediaHash;             // digests of volume calculated while reading or NULL
+    unsigned __int64 fMediaSize;        // size of volume for media hash
+    bool fIsVolumeStore;                // read store is a file holding a volume
+    unsigned __int64 fCheckpointInterval; // bytes of data between checkpoints or 0
+    unsigned __int64 fNextCheckpoint;   // data position of next checkpoint
+    unsigned __int64 fResumePos;        // data position an interrupted backup continues at
+
+    bool IsVolume() const;
+    void MarkCheckpoint(CBufferChunk* chunk, unsigned __int64 dataPos, unsigned __int64 sourcePos);
+    void ReadSource(void* data, unsigned length, unsigned* bytesRead);
 
     void ReadLoopCombined(void);
+    void ReadLoopBlockHash(void);
+    void FinishBlock(unsigned __int64 blockNo, CSha256& sha, const BYTE* blockData, unsigned blockBytes,
+                     CBufferChunk*& chunk, unsigned& chunkBytes, CCRC32& crc32);
+    void EmitData(const BYTE* data, unsigned length, CBufferChunk*& chunk, unsigned& chunkBytes, CCRC32& crc32);
     void ReadLoopSimple(void);
     void ReadLoopVerify();
 }; 
@@ -0,0 +1,119 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "RestoreChain.h"
+#include "ImageStream.h"
+#include "FileNameUtil.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+//---------------------------------------------------------------------------
+// class CRestoreChain
+
+CRestoreChain::CRestoreChain()
+{
+}
+
+void CRestoreChain::Load(LPCWSTR imageFile)
+{
+  wstring fileName = imageFile;
+
+  fFileNames.clear();
+  fHashTables.clear();
+  fOwners.clear();
+
+  // walk from the given image down to the full image
+  while (true) {
+    CFileImageStream imageStream;
+    unique_ptr<CBlockHashTable> hashes = make_unique<CBlockHashTable>();
+
+    imageStream.Open(fileName.c_str(), IImageStream::forReading);
+    imageStream.ReadImageFileHeader(false);
+    bool hasHashes = imageStream.ReadBlockHashTable(*hashes);
+    imageStream.Close();
+
+    if (fHashTables.empty() && !hasHashes) {
+      // a plain image without block hashes, no chain
+      fFileNames.push_back(fileName);
+      return;
+    }
+    if (!hasHashes)
+      THROW_FILEFORMAT_EXC(EFileFormatException::noBlockHashTable);
+    if (!fHashTables.empty()) {
+      // check that this is really the image the newer one was created from
+      const CBlockHashTable& newer = *fHashTables.front();
+      BYTE digest[CSha256::sDigestLength];
+      hashes->GetTableDigest(digest);
+      if (memcmp(digest, newer.GetBaseDigest(), sizeof(digest)) != 0 || !hashes->IsCompatible(newer))
+        THROW_FILEFORMAT_EXC(EFileFormatException::baseImageMismatch);
+    }
+
+    bool isIncremental = hashes->IsIncremental();
+    wstring baseFileName = isIncremental ? FindBaseImage(fileName.c_str(), hashes->GetBaseFileName()) : wstring();
+    fFileNames.insert(fFileNames.begin(), fileName);
+    fHashTables.insert(fHashTables.begin(), move(hashes));
+    if (!isIncremental)
+      break;
+    fileName = baseFileName;
+  }
+
+  BuildOwners();
+  ATLTRACE("Restore chain of %S has %u images\n", imageFile, (unsigned) fFileNames.size());
+}
+
+void CRestoreChain::BuildOwners()
+{
+  // the newest image storing a block wins
+  fOwners.assign((size_t)fHashTables.back()->GetBlockCount(), 0);
+  for (unsigned i=0; i<fHashTables.size(); i++) {
+    const CBlockHashTable& hashes = *fHashTables[i];
+    for (size_t j=0; j<fOwners.size(); j++)
+      if (hashes.IsStored(j))
+        fOwners[j] = i;
+  }
+}
+
+wstring CRestoreChain::FindBaseImage(LPCWSTR imageFile, LPCWSTR baseFileName)
+{
+  if (CFileNameUtil::IsFileReadable(baseFileName))
+    return baseFileName;
+
+  wstring baseName = baseFileName;
+  size_t pos = baseName.find_last_of(L"\\/:");
+  if (pos != wstring::npos)
+    baseName = baseName.substr(pos+1);
+  wstring dir;
+  CFileNameUtil::GetDirFromFileName(imageFile, dir);
+  wstring candidate = dir.empty() ? baseName : dir + L'\\' + baseName;
+  if (CFileNameUtil::IsFileReadable(candidate.c_str()))
+    return candidate;
+  return baseFileName; // let opening the file report the error
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __RESTORECHAIN_H__
+#define __RESTORECHAIN_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "BlockHashTable.h"
+
+//---------------------------------------------------------------------------
+// class CRestoreChain
+// The images needed to restore an incremental image: the full image it is
+// based on and all incremental images up to and including the one to restore,
+// oldest first. The images are restored one after the other, each block of the
+// volume is written only from the newest image containing it, so every block
+// of the target is written exactly once.
+
+class CRestoreChain {
+public:
+  CRestoreChain();
+
+  // load the block hash tables of imageFile and all images it is based on
+  void Load(LPCWSTR imageFile);
+
+  // number of images in chain, 1 if image is not an incremental image
+  unsigned GetImageCount() const {
+    return (unsigned) fFileNames.size();
+  }
+
+  // file name of image index, 0 is the full image
+  LPCWSTR GetFileName(unsigned index) const {
+    return fFileNames[index].c_str();
+  }
+
+  const CBlockHashTable& GetBlockHashTable(unsigned index) const {
+    return *fHashTables[index];
+  }
+
+  // true if block blockNo is restored from image index: the block is in use
+  // in the newest image and no image newer than index has stored it
+  bool IsBlockFromImage(unsigned __int64 blockNo, unsigned index) const {
+    return fHashTables.back()->IsUsed(blockNo) && fOwners[(size_t)blockNo] == index;
+  }
+
+  // locate the base image referenced by an image, if it has moved look in the
+  // directory of the referencing image
+  static std::wstring FindBaseImage(LPCWSTR imageFile, LPCWSTR baseFileName);
+
+private:
+  void BuildOwners();
+
+  std::vector<std::wstring> fFileNames;
+  std::vector<std::unique_ptr<CBlockHashTable>> fHashTables;
+  std::vector<unsigned> fOwners; // per block index of newest image that has stored the block
+
+  friend class IncrementalImageTest;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "Sha1.h"
+#include "CpuFeatures.h"
+#ifdef HAVE_X86_SHA_EXTENSIONS
+  #include <immintrin.h>
+#endif
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CSha1
+///////////////////////////////////////////////////////////////////////////////////////////
+
+static inline DWORD RotateLeft(DWORD x, unsigned n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+CSha1::CSha1()
+{
+#ifdef HAVE_X86_SHA_EXTENSIONS
+  fTransform = CCpuFeatures::UseShaExtensions() ? TransformShaExtensions : TransformPortable;
+#else
+  fTransform = TransformPortable;
+#endif
+  Reset();
+}
+
+void CSha1::Reset()
+{
+  fState[0] = 0x67452301;
+  fState[1] = 0xefcdab89;
+  fState[2] = 0x98badcfe;
+  fState[3] = 0x10325476;
+  fState[4] = 0xc3d2e1f0;
+  fLength = 0;
+  fBufferUsed = 0;
+}
+
+void CSha1::TransformPortable(DWORD* state, const BYTE* blocks, size_t blockCount)
+{
+  for (; blockCount > 0; blockCount--, blocks += 64) {
+    DWORD w[80];
+    for (int i=0; i<16; i++)
+      w[i] = (blocks[i*4] << 24) | (blocks[i*4+1] << 16) | (blocks[i*4+2] << 8) | blocks[i*4+3];
+    for (int i=16; i<80; i++)
+      w[i] = RotateLeft(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+    DWORD a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+    // one loop per round function, keeps the branches out of the rounds
+    for (int i=0; i<20; i++) {
+      DWORD t = RotateLeft(a, 5) + ((b & c) | (~b & d)) + e + 0x5a827999 + w[i];
+      e = d; d = c; c = RotateLeft(b, 30); b = a; a = t;
+    }
+    for (int i=20; i<40; i++) {
+      DWORD t = RotateLeft(a, 5) + (b ^ c ^ d) + e + 0x6ed9eba1 + w[i];
+      e = d; d = c; c = RotateLeft(b, 30); b = a; a = t;
+    }
+    for (int i=40; i<60; i++) {
+      DWORD t = RotateLeft(a, 5) + ((b & c) | (b & d) | (c & d)) + e + 0x8f1bbcdc + w[i];
+      e = d; d = c; c = RotateLeft(b, 30); b = a; a = t;
+    }
+    for (int i=60; i<80; i++) {
+      DWORD t = RotateLeft(a, 5) + (b ^ c ^ d) + e + 0xca62c1d6 + w[i];
+      e = d; d = c; c = RotateLeft(b, 30); b = a; a = t;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+  }
+}
+
+#ifdef HAVE_X86_SHA_EXTENSIONS
+// four rounds of group g (0..19) with message words m[g%4], alternating e registers ein
+// and eout; the message schedule computes the words of group g+1 and prepares later ones
+#define SHA1_ROUNDS(g, ein, eout, f) \
+  ein = _mm_sha1nexte_epu32(ein, m[(g)%4]); \
+  eout = abcd; \
+  if ((g) >= 3 && (g) <= 18) m[((g)+1)%4] = _mm_sha1msg2_epu32(m[((g)+1)%4], m[(g)%4]); \
+  abcd = _mm_sha1rnds4_epu32(abcd, ein, f); \
+  if ((g) >= 1 && (g) <= 16) m[((g)+3)%4] = _mm_sha1msg1_epu32(m[((g)+3)%4], m[(g)%4]); \
+  if ((g) >= 2 && (g) <= 17) m[((g)+2)%4] = _mm_xor_si128(m[((g)+2)%4], m[(g)%4]);
+
+// SHA-1 with the SHA extensions of x86 processors (Intel SHA-NI)
+TARGET_SHA_EXTENSIONS
+void CSha1::TransformShaExtensions(DWORD* state, const BYTE* blocks, size_t blockCount)
+{
+  const __m128i byteSwap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+  __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) state), 0x1B);
+  __m128i e0 = _mm_set_epi32((int) state[4], 0, 0, 0);
+  __m128i e1, m[4];
+
+  for (; blockCount > 0; blockCount--, blocks += 64) {
+    __m128i abcdSave = abcd;
+    __m128i e0Save = e0;
+    for (int i=0; i<4; i++)
+      m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (blocks + i*16)), byteSwap);
+
+    // rounds 0-3 add the message words to e directly
+    e0 = _mm_add_epi32(e0, m[0]);
+    e1 = abcd;
+    abcd = _mm_sha1rnds4_epu32(abcd, e0, 0);
+    SHA1_ROUNDS(1, e1, e0, 0)
+    SHA1_ROUNDS(2, e0, e1, 0)
+    SHA1_ROUNDS(3, e1, e0, 0)
+    SHA1_ROUNDS(4, e0, e1, 0)
+    SHA1_ROUNDS(5, e1, e0, 1)
+    SHA1_ROUNDS(6, e0, e1, 1)
+    SHA1_ROUNDS(7, e1, e0, 1)
+    SHA1_ROUNDS(8, e0, e1, 1)
+    SHA1_ROUNDS(9, e1, e0, 1)
+    SHA1_ROUNDS(10, e0, e1, 2)
+    SHA1_ROUNDS(11, e1, e0, 2)
+    SHA1_ROUNDS(12, e0, e1, 2)
+    SHA1_ROUNDS(13, e1, e0, 2)
+    SHA1_ROUNDS(14, e0, e1, 2)
+    SHA1_ROUNDS(15, e1, e0, 3)
+    SHA1_ROUNDS(16, e0, e1, 3)
+    SHA1_ROUNDS(17, e1, e0, 3)
+    SHA1_ROUNDS(18, e0, e1, 3)
+    SHA1_ROUNDS(19, e1, e0, 3)
+
+    e0 = _mm_sha1nexte_epu32(e0, e0Save);
+    abcd = _mm_add_epi32(abcd, abcdSave);
+  }
+  _mm_storeu_si128((__m128i*) state, _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = (DWORD) _mm_extract_epi32(e0, 3);
+}
+#undef SHA1_ROUNDS
+#endif
+
+void CSha1::AddDataBlock(const BYTE* pData, unsigned length)
+{
+  fLength += length;
+  if (fBufferUsed > 0) {
+    unsigned count = 64 - fBufferUsed;
+    if (count > length)
+      count = length;
+    memcpy(fBuffer + fBufferUsed, pData, count);
+    fBufferUsed += count;
+    pData += count;
+    length -= count;
+    if (fBufferUsed < 64)
+      return;
+    fTransform(fState, fBuffer, 1);
+    fBufferUsed = 0;
+  }
+  if (length >= 64) {
+    size_t blockCount = length / 64;
+    fTransform(fState, pData, blockCount);
+    pData += blockCount * 64;
+    length -= (unsigned) blockCount * 64;
+  }
+  if (length > 0) {
+    memcpy(fBuffer, pData, length);
+    fBufferUsed = length;
+  }
+}
+
+void CSha1::GetResult(BYTE* digest)
+{
+  unsigned __int64 bitLength = fLength * 8;
+  BYTE padding[72];
+  unsigned padLength = (fBufferUsed < 56 ? 56 : 120) - fBufferUsed;
+
+  memset(padding, 0, sizeof(padding));
+  padding[0] = 0x80;
+  for (int i=0; i<8; i++)
+    padding[padLength + i] = (BYTE)(bitLength >> (56 - i*8));
+  AddDataBlock(padding, padLength + 8);
+
+  for (int i=0; i<5; i++) {
+    digest[i*4]   = (BYTE)(fState[i] >> 24);
+    digest[i*4+1] = (BYTE)(fState[i] >> 16);
+    digest[i*4+2] = (BYTE)(fState[i] >> 8);
+    digest[i*4+3] = (BYTE)fState[i];
+  }
+}
+
+void CSha1::Calculate(const BYTE* pData, unsigned length, BYTE* digest)
+{
+  CSha1 sha;
+  sha.AddDataBlock(pData, length);
+  sha.GetResult(digest);
+}
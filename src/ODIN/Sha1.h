@@ -0,0 +1,62 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __SHA1_H__
+#define __SHA1_H__
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CSha1 a c++ class for calculation of SHA-1 message digests (FIPS 180-4)
+// Used for the media hashes of restored data that are compared to known values.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CSha1
+{
+public:
+  static const unsigned sDigestLength = 20;
+
+  CSha1();
+  void AddDataBlock(const BYTE* pData, unsigned length);
+  // finish the calculation and copy the digest to digest (sDigestLength bytes),
+  // call Reset() before adding new data
+  void GetResult(BYTE* digest);
+  void Reset();
+
+  // digest of a single buffer in one call
+  static void Calculate(const BYTE* pData, unsigned length, BYTE* digest);
+
+private:
+  typedef void (*TTransform)(DWORD* state, const BYTE* blocks, size_t blockCount);
+
+  // process blockCount blocks of 64 bytes
+  static void TransformPortable(DWORD* state, const BYTE* blocks, size_t blockCount);
+  static void TransformShaExtensions(DWORD* state, const BYTE* blocks, size_t blockCount);
+
+  TTransform fTransform;     // implementation for this processor
+  DWORD fState[5];
+  unsigned __int64 fLength;  // total number of bytes added
+  BYTE fBuffer[64];          // partial block not yet transformed
+  unsigned fBufferUsed;
+};
+
+#endif
@@ -0,0 +1,224 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include "Sha256.h"
+#include "CpuFeatures.h"
+#ifdef HAVE_X86_SHA_EXTENSIONS
+  #include <immintrin.h>
+#endif
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CSha256
+///////////////////////////////////////////////////////////////////////////////////////////
+
+const DWORD CSha256::sK[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline DWORD RotateRight(DWORD x, unsigned n)
+{
+  return (x >> n) | (x << (32 - n));
+}
+
+CSha256::CSha256()
+{
+#ifdef HAVE_X86_SHA_EXTENSIONS
+  fTransform = CCpuFeatures::UseShaExtensions() ? TransformShaExtensions : TransformPortable;
+#else
+  fTransform = TransformPortable;
+#endif
+  Reset();
+}
+
+void CSha256::Reset()
+{
+  fState[0] = 0x6a09e667;
+  fState[1] = 0xbb67ae85;
+  fState[2] = 0x3c6ef372;
+  fState[3] = 0xa54ff53a;
+  fState[4] = 0x510e527f;
+  fState[5] = 0x9b05688c;
+  fState[6] = 0x1f83d9ab;
+  fState[7] = 0x5be0cd19;
+  fLength = 0;
+  fBufferUsed = 0;
+}
+
+void CSha256::TransformPortable(DWORD* state, const BYTE* blocks, size_t blockCount)
+{
+  for (; blockCount > 0; blockCount--, blocks += 64) {
+    DWORD w[64];
+    for (int i=0; i<16; i++)
+      w[i] = (blocks[i*4] << 24) | (blocks[i*4+1] << 16) | (blocks[i*4+2] << 8) | blocks[i*4+3];
+    for (int i=16; i<64; i++) {
+      DWORD s0 = RotateRight(w[i-15], 7) ^ RotateRight(w[i-15], 18) ^ (w[i-15] >> 3);
+      DWORD s1 = RotateRight(w[i-2], 17) ^ RotateRight(w[i-2], 19) ^ (w[i-2] >> 10);
+      w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    DWORD a = state[0], b = state[1], c = state[2], d = state[3];
+    DWORD e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i=0; i<64; i++) {
+      DWORD s1 = RotateRight(e, 6) ^ RotateRight(e, 11) ^ RotateRight(e, 25);
+      DWORD ch = (e & f) ^ (~e & g);
+      DWORD t1 = h + s1 + ch + sK[i] + w[i];
+      DWORD s0 = RotateRight(a, 2) ^ RotateRight(a, 13) ^ RotateRight(a, 22);
+      DWORD maj = (a & b) ^ (a & c) ^ (b & c);
+      DWORD t2 = s0 + maj;
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+  }
+}
+
+#ifdef HAVE_X86_SHA_EXTENSIONS
+// four rounds of group g (0..15) with message words m[g%4], the message schedule computes
+// the words of group g+1 and prepares later ones
+#define SHA256_ROUNDS(g) \
+  msg = _mm_add_epi32(m[(g)%4], _mm_loadu_si128((const __m128i*) &sK[(g)*4])); \
+  state1 = _mm_sha256rnds2_epu32(state1, state0, msg); \
+  if ((g) >= 3 && (g) <= 14) { \
+    m[((g)+1)%4] = _mm_add_epi32(m[((g)+1)%4], _mm_alignr_epi8(m[(g)%4], m[((g)+3)%4], 4)); \
+    m[((g)+1)%4] = _mm_sha256msg2_epu32(m[((g)+1)%4], m[(g)%4]); \
+  } \
+  state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E)); \
+  if ((g) >= 1 && (g) <= 12) m[((g)+3)%4] = _mm_sha256msg1_epu32(m[((g)+3)%4], m[(g)%4]);
+
+// SHA-256 with the SHA extensions of x86 processors (Intel SHA-NI)
+TARGET_SHA_EXTENSIONS
+void CSha256::TransformShaExtensions(DWORD* state, const BYTE* blocks, size_t blockCount)
+{
+  const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  // the instructions need the state as ABEF and CDGH
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[0]), 0xB1);   // CDAB
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*) &state[4]), 0x1B); // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);       // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xF0);             // CDGH
+  __m128i msg, m[4];
+
+  for (; blockCount > 0; blockCount--, blocks += 64) {
+    __m128i state0Save = state0;
+    __m128i state1Save = state1;
+    for (int i=0; i<4; i++)
+      m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (blocks + i*16)), byteSwap);
+
+    SHA256_ROUNDS(0)
+    SHA256_ROUNDS(1)
+    SHA256_ROUNDS(2)
+    SHA256_ROUNDS(3)
+    SHA256_ROUNDS(4)
+    SHA256_ROUNDS(5)
+    SHA256_ROUNDS(6)
+    SHA256_ROUNDS(7)
+    SHA256_ROUNDS(8)
+    SHA256_ROUNDS(9)
+    SHA256_ROUNDS(10)
+    SHA256_ROUNDS(11)
+    SHA256_ROUNDS(12)
+    SHA256_ROUNDS(13)
+    SHA256_ROUNDS(14)
+    SHA256_ROUNDS(15)
+
+    state0 = _mm_add_epi32(state0, state0Save);
+    state1 = _mm_add_epi32(state1, state1Save);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1B);                   // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xB1);                // DCHG
+  state0 = _mm_blend_epi16(tmp, state1, 0xF0);             // DCBA
+  state1 = _mm_alignr_epi8(state1, tmp, 8);                // HGFE
+  _mm_storeu_si128((__m128i*) &state[0], state0);
+  _mm_storeu_si128((__m128i*) &state[4], state1);
+}
+#undef SHA256_ROUNDS
+#endif
+
+void CSha256::AddDataBlock(const BYTE* pData, unsigned length)
+{
+  fLength += length;
+  if (fBufferUsed > 0) {
+    unsigned count = 64 - fBufferUsed;
+    if (count > length)
+      count = length;
+    memcpy(fBuffer + fBufferUsed, pData, count);
+    fBufferUsed += count;
+    pData += count;
+    length -= count;
+    if (fBufferUsed < 64)
+      return;
+    fTransform(fState, fBuffer, 1);
+    fBufferUsed = 0;
+  }
+  if (length >= 64) {
+    size_t blockCount = length / 64;
+    fTransform(fState, pData, blockCount);
+    pData += blockCount * 64;
+    length -= (unsigned) blockCount * 64;
+  }
+  if (length > 0) {
+    memcpy(fBuffer, pData, length);
+    fBufferUsed = length;
+  }
+}
+
+void CSha256::GetResult(BYTE* digest)
+{
+  unsigned __int64 bitLength = fLength * 8;
+  BYTE padding[72];
+  unsigned padLength = (fBufferUsed < 56 ? 56 : 120) - fBufferUsed;
+
+  memset(padding, 0, sizeof(padding));
+  padding[0] = 0x80;
+  for (int i=0; i<8; i++)
+    padding[padLength + i] = (BYTE)(bitLength >> (56 - i*8));
+  AddDataBlock(padding, padLength + 8);
+
+  for (int i=0; i<8; i++) {
+    digest[i*4]   = (BYTE)(fState[i] >> 24);
+    digest[i*4+1] = (BYTE)(fState[i] >> 16);
+    digest[i*4+2] = (BYTE)(fState[i] >> 8);
+    digest[i*4+3] = (BYTE)fState[i];
+  }
+}
+
+void CSha256::Calculate(const BYTE* pData, unsigned length, BYTE* digest)
+{
+  CSha256 sha;
+  sha.AddDataBlock(pData, length);
+  sha.GetResult(digest);
+}
@@ -0,0 +1,64 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __SHA256_H__
+#define __SHA256_H__
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CSha256 a c++ class for calculation of SHA-256 message digests (FIPS 180-4)
+// Used to address chunks in the chunk store by their content.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CSha256
+{
+public:
+  static const unsigned sDigestLength = 32;
+
+  CSha256();
+  void AddDataBlock(const BYTE* pData, unsigned length);
+  // finish the calculation and copy the digest to digest (sDigestLength bytes),
+  // call Reset() before adding new data
+  void GetResult(BYTE* digest);
+  void Reset();
+
+  // digest of a single buffer in one call
+  static void Calculate(const BYTE* pData, unsigned length, BYTE* digest);
+
+private:
+  typedef void (*TTransform)(DWORD* state, const BYTE* blocks, size_t blockCount);
+
+  // process blockCount blocks of 64 bytes
+  static void TransformPortable(DWORD* state, const BYTE* blocks, size_t blockCount);
+  static void TransformShaExtensions(DWORD* state, const BYTE* blocks, size_t blockCount);
+
+  TTransform fTransform;     // implementation for this processor
+  DWORD fState[8];
+  unsigned __int64 fLength;  // total number of bytes added
+  BYTE fBuffer[64];          // partial block not yet transformed
+  unsigned fBufferUsed;
+
+  static const DWORD sK[64];
+};
+
+#endif
@@ -0,0 +1,254 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "StdImageStream.h"
+#include "OSException.h"
+#include "InternalException.h"
+#include "FileFormatException.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+static const unsigned cReadChunkSize = 1024 * 1024;
+
+//---------------------------------------------------------------------------
+// Standard input can be read only once, but the header of an image is read by each
+// stream opening it. What was read is kept here for all streams of the process,
+// they are used by one thread at a time.
+namespace {
+
+struct TStdInput {
+  TStdInput() : dataOffset(0), trailerLength(0), pendingOffset(0), eof(false) {
+  }
+  std::vector<BYTE> prefix;       // bytes before the volume data (all bytes read while dataOffset is 0)
+  std::vector<BYTE> pending;      // bytes read ahead in the volume data, at least the trailer
+  unsigned __int64 dataOffset;    // start of volume data or 0 if not known yet
+  DWORD trailerLength;            // length of trailer behind the volume data
+  unsigned __int64 pendingOffset; // offset of the first byte of pending in the image
+  bool eof;                       // standard input ended
+};
+
+TStdInput sInput;
+
+// append up to length bytes from standard input to buffer, less only at its end
+void ReadInput(std::vector<BYTE>& buffer, size_t length)
+{
+  HANDLE h = GetStdHandle(STD_INPUT_HANDLE);
+  size_t oldSize = buffer.size();
+  size_t total = 0;
+
+  buffer.resize(oldSize + length);
+  while (total < length && !sInput.eof) {
+    DWORD count = 0;
+    BOOL ok = ReadFile(h, &buffer[oldSize + total], (DWORD) (length - total), &count, NULL);
+    // a pipe reports its end as error when the writing side closed it
+    if (!ok && GetLastError() == ERROR_BROKEN_PIPE)
+      ok = TRUE;
+    if (!ok)
+      buffer.resize(oldSize + total);
+    CHECK_OS_EX_PARAM1(ok, EWinException::readFileError, L"-");
+    if (count == 0)
+      sInput.eof = true;
+    total += count;
+  }
+  buffer.resize(oldSize + total);
+}
+
+// read the prefix up to length bytes, less only at the end of standard input
+void FillPrefix(unsigned __int64 length)
+{
+  if (length > sInput.prefix.size() && !sInput.eof)
+    ReadInput(sInput.prefix, (size_t) (length - sInput.prefix.size()));
+}
+
+}
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implementation of class CStdImageStream
+/////////////////////////////////////////////////////////////////////////////////////
+
+CStdImageStream::CStdImageStream()
+{
+  fOpenMode = forReading;
+  fPosition = fWritten = 0;
+  fCommitted = false;
+}
+
+CStdImageStream::~CStdImageStream()
+{
+  Close();
+}
+
+bool CStdImageStream::IsStdName(LPCWSTR name)
+{
+  return name != NULL && wcscmp(name, L"-") == 0;
+}
+
+void CStdImageStream::Open(LPCWSTR /* name */, TOpenMode mode)
+{
+  fOpenMode = mode;
+  fPosition = fWritten = 0;
+  fCommitted = false;
+  fBuffer.clear();
+}
+
+void CStdImageStream::Close()
+{
+  // standard output is not closed, an image that was never committed is not sent
+  fBuffer.clear();
+}
+
+void CStdImageStream::Read(void * buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  BYTE* dest = (BYTE*) buffer;
+  unsigned count = 0;
+
+  *nBytesRead = 0;
+  if (fOpenMode == forWriting)
+    THROW_INT_EXC(EInternalException::stdImageSeekError);
+  // header, checksum, comment and allocation map
+  if (sInput.dataOffset == 0 || fPosition < sInput.dataOffset) {
+    unsigned __int64 end = fPosition + nLength;
+    if (sInput.dataOffset != 0 && end > sInput.dataOffset)
+      end = sInput.dataOffset;
+    FillPrefix(end);
+    if (fPosition < sInput.prefix.size()) {
+      count = (unsigned) (min(end, (unsigned __int64) sInput.prefix.size()) - fPosition);
+      memcpy(dest, &sInput.prefix[(size_t) fPosition], count);
+    }
+    fPosition += count;
+    *nBytesRead = count;
+    if (count < nLength && sInput.dataOffset != 0 && fPosition == sInput.dataOffset) {
+      ReadData(dest + count, nLength - count, &count);
+      *nBytesRead += count;
+    }
+    return;
+  }
+  ReadData(dest, nLength, nBytesRead);
+}
+
+void CStdImageStream::ReadData(BYTE* buffer, unsigned nLength, unsigned *nBytesRead)
+{
+  // volume data can be read only once
+  if (fPosition != sInput.pendingOffset)
+    THROW_INT_EXC(EInternalException::stdImageSeekError);
+  size_t needed = (size_t) nLength + sInput.trailerLength;
+  while (sInput.pending.size() < needed && !sInput.eof)
+    ReadInput(sInput.pending, min(needed - sInput.pending.size(), (size_t) cReadChunkSize));
+  // input ending within the trailer has no valid trailer, see GetTrailer()
+  unsigned count = 0;
+  if (sInput.pending.size() > sInput.trailerLength)
+    count = (unsigned) min((size_t) nLength, sInput.pending.size() - sInput.trailerLength);
+  if (count > 0)
+    memcpy(buffer, &sInput.pending[0], count);
+  sInput.pending.erase(sInput.pending.begin(), sInput.pending.begin() + count);
+  sInput.pendingOffset += count;
+  fPosition += count;
+  *nBytesRead = count;
+}
+
+void CStdImageStream::Write(void *buffer, unsigned nLength, unsigned *nBytesWritten)
+{
+  *nBytesWritten = 0;
+  if (fOpenMode == forReading)
+    THROW_INT_EXC(EInternalException::stdImageSeekError);
+  if (!fCommitted) {
+    if (fPosition + nLength > fBuffer.size())
+      fBuffer.resize((size_t) (fPosition + nLength));
+    memcpy(&fBuffer[(size_t) fPosition], buffer, nLength);
+  } else {
+    HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD count = 0;
+    if (fPosition != fWritten)
+      THROW_INT_EXC(EInternalException::stdImageSeekError);
+    for (unsigned total = 0; total < nLength; total += count) {
+      BOOL ok = WriteFile(h, (BYTE*) buffer + total, nLength - total, &count, NULL);
+      CHECK_OS_EX_PARAM1(ok, EWinException::writeFileError, L"-");
+    }
+    fWritten += nLength;
+  }
+  fPosition += nLength;
+  *nBytesWritten = nLength;
+}
+
+void CStdImageStream::Seek(__int64 offset, DWORD moveMethod)
+{
+  __int64 newPosition;
+
+  switch (moveMethod) {
+    case FILE_BEGIN:
+      newPosition = offset;
+      break;
+    case FILE_CURRENT:
+      newPosition = (__int64) fPosition + offset;
+      break;
+    default:
+      // only the end of an image that is written is known
+      if (fOpenMode == forReading)
+        THROW_INT_EXC(EInternalException::stdImageSeekError);
+      newPosition = (__int64) (fCommitted ? fWritten : fBuffer.size()) + offset;
+      break;
+  }
+  if (newPosition < 0 || (fCommitted && (unsigned __int64) newPosition != fWritten))
+    THROW_INT_EXC(EInternalException::stdImageSeekError);
+  fPosition = newPosition;
+}
+
+void CStdImageStream::Commit()
+{
+  std::vector<BYTE> buffer;
+  unsigned bytesWritten;
+
+  buffer.swap(fBuffer);
+  fCommitted = true;
+  fPosition = fWritten;
+  if (!buffer.empty())
+    Write(&buffer[0], (unsigned) buffer.size(), &bytesWritten);
+}
+
+void CStdImageStream::SetDataArea(unsigned __int64 offset, DWORD trailerLength)
+{
+  // another stream of the process may already have read the volume data
+  if (sInput.dataOffset != 0)
+    return;
+  FillPrefix(offset);
+  if (sInput.prefix.size() < offset)
+    THROW_FILEFORMAT_EXC(EFileFormatException::wrongFileSizeError);
+  sInput.pending.assign(sInput.prefix.begin() + (size_t) offset, sInput.prefix.end());
+  sInput.prefix.resize((size_t) offset);
+  sInput.dataOffset = offset;
+  sInput.trailerLength = trailerLength;
+  sInput.pendingOffset = offset;
+}
+
+bool CStdImageStream::GetTrailer(std::vector<BYTE>& trailer) const
+{
+  if (!sInput.eof || sInput.dataOffset == 0 || sInput.pending.size() != sInput.trailerLength)
+    return false;
+  trailer = sInput.pending;
+  return true;
+}
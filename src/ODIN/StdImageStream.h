@@ -0,0 +1,97 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __STDIMAGESTREAM_H__
+#define __STDIMAGESTREAM_H__
+
+#include <string>
+#include <vector>
+#include "IImageStream.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////
+// Subclass reading an image from standard input or writing it to standard output
+// The name of the image is "-". An image can only be sent in order: when writing, header,
+// checksum, comment and allocation map are kept in memory until Commit() sends them, the volume
+// data is then only appended. When reading, everything before the volume data is kept in memory
+// and can be read again (also by another stream opened later in the same process), the volume
+// data only in order as it arrives. The trailer of an image written as a stream (see
+// CImageFileHeader::GetTrailerLength()) is held back when reading the volume data and
+// returned by GetTrailer() once the input ended.
+//////////////////////////////////////////////////////////////////////////////////////////////////
+class CStdImageStream: public IImageStream
+{
+public:
+  CStdImageStream();
+  virtual ~CStdImageStream();
+
+  // true if name is the name of standard input or output ("-")
+  static bool IsStdName(LPCWSTR name);
+
+  virtual LPCWSTR GetName() const {
+    return L"-";
+  }
+  virtual void Open(LPCWSTR name, TOpenMode mode);
+  virtual void Close();
+  virtual unsigned __int64 GetPosition() const {
+    return fPosition;
+  }
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead);
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten);
+  virtual void Seek(__int64 offset, DWORD moveMethod);
+  virtual unsigned __int64 GetSize() const {
+    return 0;
+  }
+  virtual unsigned __int64 GetAllocatedBytes() const {
+    return 0;
+  }
+  virtual bool IsDrive() const {
+    return false;
+  }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const {
+    return NULL;
+  }
+  virtual void SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */) {
+  }
+
+  // writing: send what was written so far, from now on data is only appended
+  void Commit();
+
+  // reading: the volume data starts at offset and is followed by a trailer of trailerLength bytes
+  void SetDataArea(unsigned __int64 offset, DWORD trailerLength);
+
+  // reading: the trailer after all volume data was read, false if the input did not end yet
+  bool GetTrailer(std::vector<BYTE>& trailer) const;
+
+private:
+  void ReadData(BYTE* buffer, unsigned nLength, unsigned *nBytesRead);
+
+  TOpenMode          fOpenMode;
+  unsigned __int64   fPosition;
+  std::vector<BYTE>  fBuffer;    // writing: data not committed yet
+  bool               fCommitted;
+  unsigned __int64   fWritten;   // writing: bytes sent to standard output
+};
+
+#endif
@@ -0,0 +1,134 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <thread>
+#include "StreamHasher.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CStreamHasher
+///////////////////////////////////////////////////////////////////////////////////////////
+
+CStreamHasher::CStreamHasher(unsigned algorithms, unsigned bufferSize, unsigned bufferCount)
+{
+  fAlgorithms = algorithms;
+  fBuffers.resize(bufferCount < 2 ? 2 : bufferCount);
+  for (size_t i=0; i<fBuffers.size(); i++)
+    fBuffers[i].data.resize(bufferSize);
+  fHasherCount = ((algorithms & hashSha1) ? 1 : 0) + ((algorithms & hashSha256) ? 1 : 0);
+  fFilledCount = 0;
+  fEndOfData = false;
+  fBytesHashed = 0;
+  memset(fSha1Digest, 0, sizeof(fSha1Digest));
+  memset(fSha256Digest, 0, sizeof(fSha256Digest));
+}
+
+bool CStreamHasher::Calculate(const TReadFunction& read, unsigned __int64 length, const TProgressFunction& progress)
+{
+  vector<thread> hashers;
+  bool ok = true;
+  int lastPercent = -1;
+
+  fFilledCount = 0;
+  fEndOfData = false;
+  fBytesHashed = 0;
+  for (size_t i=0; i<fBuffers.size(); i++)
+    fBuffers[i].pendingHashers = 0;
+  fSha1.Reset();
+  fSha256.Reset();
+  if (fAlgorithms & hashSha1)
+    hashers.push_back(thread([this] { HashLoop([this](const BYTE* data, unsigned size) { fSha1.AddDataBlock(data, size); }); }));
+  if (fAlgorithms & hashSha256)
+    hashers.push_back(thread([this] { HashLoop([this](const BYTE* data, unsigned size) { fSha256.AddDataBlock(data, size); }); }));
+
+  // read into the next buffer as soon as all hashers are done with it
+  while (length == 0 || fBytesHashed < length) {
+    TBuffer& buffer = fBuffers[fFilledCount % fBuffers.size()];
+    {
+      unique_lock<mutex> lock(fMutex);
+      fBufferFree.wait(lock, [&buffer] { return buffer.pendingHashers == 0; });
+    }
+    unsigned size = (unsigned) buffer.data.size();
+    if (length > 0 && length - fBytesHashed < size)
+      size = (unsigned) (length - fBytesHashed);
+    unsigned bytesRead = 0;
+    ok = read(&buffer.data[0], size, bytesRead) && bytesRead <= size;
+    if (!ok || bytesRead == 0)
+      break;
+    {
+      lock_guard<mutex> lock(fMutex);
+      buffer.size = bytesRead;
+      buffer.pendingHashers = fHasherCount;
+      fFilledCount++;
+    }
+    fBufferFilled.notify_all();
+    fBytesHashed += bytesRead;
+    if (progress && length > 0) {
+      int percent = (int) (fBytesHashed * 100 / length);
+      if (percent != lastPercent) {
+        progress(percent);
+        lastPercent = percent;
+      }
+    }
+  }
+
+  {
+    lock_guard<mutex> lock(fMutex);
+    fEndOfData = true;
+  }
+  fBufferFilled.notify_all();
+  for (size_t i=0; i<hashers.size(); i++)
+    hashers[i].join();
+
+  if (fAlgorithms & hashSha1)
+    fSha1.GetResult(fSha1Digest);
+  if (fAlgorithms & hashSha256)
+    fSha256.GetResult(fSha256Digest);
+  return ok && (length == 0 || fBytesHashed == length);
+}
+
+void CStreamHasher::HashLoop(const function<void(const BYTE*, unsigned)>& addData)
+{
+  for (unsigned __int64 next = 0; ; next++) {
+    TBuffer& buffer = fBuffers[next % fBuffers.size()];
+    {
+      unique_lock<mutex> lock(fMutex);
+      fBufferFilled.wait(lock, [this, next] { return fFilledCount > next || fEndOfData; });
+      if (fFilledCount <= next)
+        return; // end of data and all buffers done
+    }
+    addData(&buffer.data[0], buffer.size);
+    {
+      lock_guard<mutex> lock(fMutex);
+      buffer.pendingHashers--;
+    }
+    fBufferFree.notify_one();
+  }
+}
@@ -0,0 +1,105 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __STREAMHASHER_H__
+#define __STREAMHASHER_H__
+
+#include <functional>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include "Sha1.h"
+#include "Sha256.h"
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CStreamHasher calculates SHA-1 and/or SHA-256 of a stream of data. The data are
+// read into a ring of buffers by the calling thread while the buffers read before are
+// hashed, each algorithm on a thread of its own. So reading and hashing overlap and
+// both digests take the time of the slower one. Only standard C++ is used, the source
+// of the data is given by a read function (file handle, device, memory...).
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CStreamHasher
+{
+public:
+  // same values as CMediaHash
+  enum { hashSha1 = 1, hashSha256 = 2 };
+  static const unsigned sDefaultBufferSize = 1048576;
+  static const unsigned sDefaultBufferCount = 3;
+
+  // read up to size bytes to buffer and set bytesRead, return false on a read error;
+  // bytesRead 0 is the end of the data
+  typedef std::function<bool(BYTE* buffer, unsigned size, unsigned& bytesRead)> TReadFunction;
+  // called with the percentage of length done
+  typedef std::function<void(int percent)> TProgressFunction;
+
+  // algorithms is a combination of hashSha1 and hashSha256
+  CStreamHasher(unsigned algorithms, unsigned bufferSize = sDefaultBufferSize,
+                unsigned bufferCount = sDefaultBufferCount);
+
+  // hash length bytes delivered by read, false if read failed or ended before length
+  // bytes; length 0 reads up to the end of the data
+  bool Calculate(const TReadFunction& read, unsigned __int64 length,
+                 const TProgressFunction& progress = nullptr);
+
+  // digests of the last Calculate(), only valid if the algorithm was calculated
+  const BYTE* GetSha1Digest() const {
+    return fSha1Digest;
+  }
+
+  const BYTE* GetSha256Digest() const {
+    return fSha256Digest;
+  }
+
+  // number of bytes hashed by the last Calculate()
+  unsigned __int64 GetBytesHashed() const {
+    return fBytesHashed;
+  }
+
+private:
+  // consume the filled buffers in order until the end of the data
+  void HashLoop(const std::function<void(const BYTE*, unsigned)>& addData);
+
+  struct TBuffer {
+    std::vector<BYTE> data;
+    unsigned size;
+    unsigned pendingHashers;  // hash threads that still have to process the buffer
+  };
+
+  unsigned fAlgorithms;
+  std::vector<TBuffer> fBuffers;
+  unsigned fHasherCount;
+  unsigned __int64 fFilledCount;   // number of buffers filled so far
+  bool fEndOfData;
+  std::mutex fMutex;
+  std::condition_variable fBufferFilled;
+  std::condition_variable fBufferFree;
+  CSha1 fSha1;
+  CSha256 fSha256;
+  BYTE fSha1Digest[CSha1::sDigestLength];
+  BYTE fSha256Digest[CSha256::sDigestLength];
+  unsigned __int64 fBytesHashed;
+};
+
+#endif
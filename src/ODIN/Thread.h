@@ -25,6 +25,10 @@
 #ifndef __THREAD_H__
 #define __THREAD_H__
 
+#ifndef _WIN32
+  #include <pthread.h>
+#endif
+
 class CThread
 {
 
@@ -72,6 +76,14 @@ public:
 		return SetThreadPriority(m_hThread, nPriority);
 	}
 
+  // Let the OS schedule the I/O of the thread with low priority (background mode),
+  // so that it disturbs other programs using the same disks as little as possible.
+  // Note: This method must be called from inside the thread, i.e. from Execute
+  BOOL EnterBackgroundMode()
+  {
+    return SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+  }
+
 	DWORD GetExitCode() const
 	{
 		ATLASSERT( m_hThread != NULL );
@@ -136,10 +148,18 @@ public:
     info.dwThreadID = -1;
     info.dwFlags = 0;
 
+#ifdef _WIN32
     __try {
       RaiseException( 0x406D1388, 0, sizeof(info)/sizeof(DWORD), (const ULONG_PTR*)&info );
     }
     __except (EXCEPTION_CONTINUE_EXECUTION) {}
+#else
+    // names of POSIX threads are limited to 15 characters
+    char name[16];
+    strncpy(name, threadName, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    pthread_setname_np(pthread_self(), name);
+#endif
 }
 
 protected:
@@ -0,0 +1,125 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <chrono>
+#include "Throttle.h"
+
+#ifdef DEBUG
+  #define new DEBUG_NEW
+  #define malloc DEBUG_MALLOC
+#endif // _DEBUG
+
+using namespace std;
+
+// longest sleep before a change of the limits is seen, in microseconds
+static const unsigned __int64 kWaitSlice = 100000;
+
+CThrottle::CThrottle()
+  : fLimited(false)
+{
+  fBytes.rate = 0;
+  fBytes.tokens = 0;
+  fOps.rate = 0;
+  fOps.tokens = 0;
+  fLastTime = 0;
+  fGeneration = 0;
+}
+
+void CThrottle::SetLimits(unsigned __int64 bytesPerSecond, unsigned opsPerSecond)
+{
+  lock_guard<mutex> lock(fMutex);
+  fBytes.rate = bytesPerSecond;
+  fBytes.tokens = 0;
+  fOps.rate = opsPerSecond;
+  fOps.tokens = 0;
+  fLastTime = 0;
+  ++fGeneration;
+  fLimited = bytesPerSecond > 0 || opsPerSecond > 0;
+}
+
+unsigned __int64 CThrottle::GetBytesPerSecond() const
+{
+  lock_guard<mutex> lock(fMutex);
+  return fBytes.rate;
+}
+
+unsigned CThrottle::GetOpsPerSecond() const
+{
+  lock_guard<mutex> lock(fMutex);
+  return (unsigned) fOps.rate;
+}
+
+unsigned __int64 CThrottle::Take(unsigned __int64 bytes, unsigned ops, unsigned __int64 now)
+{
+  lock_guard<mutex> lock(fMutex);
+  // the buckets start empty with the first I/O after the limits were set
+  unsigned __int64 elapsed = fLastTime == 0 || now < fLastTime ? 0 : now - fLastTime;
+  fLastTime = now;
+  unsigned __int64 byteWait = Refill(fBytes, elapsed, bytes);
+  unsigned __int64 opWait = Refill(fOps, elapsed, ops);
+  return byteWait > opWait ? byteWait : opWait;
+}
+
+// add the tokens of elapsed microseconds to bucket and take cost tokens, returns the
+// microseconds until the bucket is out of debt
+unsigned __int64 CThrottle::Refill(TBucket& bucket, unsigned __int64 elapsed, unsigned __int64 cost)
+{
+  if (bucket.rate == 0)
+    return 0;
+  double capacity = (double) bucket.rate * kBurstTime / 1000000.0;
+  bucket.tokens += (double) bucket.rate * elapsed / 1000000.0;
+  if (bucket.tokens > capacity)
+    bucket.tokens = capacity;
+  bucket.tokens -= (double) cost;
+  if (bucket.tokens >= 0)
+    return 0;
+  return (unsigned __int64) (-bucket.tokens * 1000000.0 / bucket.rate);
+}
+
+void CThrottle::Wait(unsigned length)
+{
+  unsigned generation;
+  {
+    lock_guard<mutex> lock(fMutex);
+    generation = fGeneration;
+  }
+  unsigned __int64 wait = Take(length, 1, Now());
+
+  // sleep in slices, so that raised limits take effect at once
+  while (wait > 0) {
+    unsigned __int64 slice = wait < kWaitSlice ? wait : kWaitSlice;
+    Sleep((DWORD) ((slice + 999) / 1000));
+    wait -= slice;
+    lock_guard<mutex> lock(fMutex);
+    if (fGeneration != generation)
+      break;
+  }
+}
+
+unsigned __int64 CThrottle::Now()
+{
+  return (unsigned __int64) chrono::duration_cast<chrono::microseconds>(
+    chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,92 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __THROTTLE_H__
+#define __THROTTLE_H__
+
+#include <mutex>
+#include <atomic>
+
+//---------------------------------------------------------------------------
+// class CThrottle
+// Keeps the I/O of one stage of an operation within a budget of bytes and of
+// I/O operations per second, e.g. the reading of a volume that is in
+// production use. Each budget is a token bucket that is refilled at its rate
+// and holds at most the tokens of kBurstTime. An I/O takes its tokens after
+// it is done, the bucket may then run into debt, which the thread pays off
+// by sleeping. So an I/O of any size is allowed and the rate is kept over
+// all I/Os. Threads of the same stage (e.g. the writers of a restore to
+// several drives) share one throttle. The limits can be changed while
+// threads use the throttle, a throttle without limits costs a test of a flag
+// per I/O.
+
+class CThrottle
+{
+public:
+  CThrottle();
+
+  // bytes and I/O operations per second, 0 is unlimited. Can be called while other threads
+  // consume from the throttle, a debt from the former limits is forgiven
+  void SetLimits(unsigned __int64 bytesPerSecond, unsigned opsPerSecond);
+
+  unsigned __int64 GetBytesPerSecond() const;
+  unsigned GetOpsPerSecond() const;
+
+  bool IsLimited() const {
+    return fLimited.load(std::memory_order_relaxed);
+  }
+
+  // account for one I/O of length bytes that is done, returns when the budget allows
+  // the next one
+  void Consume(unsigned length) {
+    if (IsLimited())
+      Wait(length);
+  }
+
+  // take the tokens for ops I/Os of bytes at time now (in microseconds), returns the
+  // microseconds the caller has to wait to stay within the budget
+  unsigned __int64 Take(unsigned __int64 bytes, unsigned ops, unsigned __int64 now);
+
+  static const unsigned __int64 kBurstTime = 250000; // microseconds
+
+private:
+  typedef struct {
+    unsigned __int64 rate;  // tokens per second, 0 for unlimited
+    double tokens;          // may be negative after an I/O larger than the tokens left
+  } TBucket;
+
+  void Wait(unsigned length);
+  static unsigned __int64 Now();
+  static unsigned __int64 Refill(TBucket& bucket, unsigned __int64 elapsed, unsigned __int64 cost);
+
+  mutable std::mutex fMutex;
+  TBucket fBytes;
+  TBucket fOps;
+  unsigned __int64 fLastTime;        // time of the last refill in microseconds
+  unsigned fGeneration;              // incremented by each change of the limits
+  std::atomic<bool> fLimited;
+};
+
+#endif
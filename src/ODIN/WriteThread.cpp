@@ -29,7 +29,15 @@
 #include "Exception.h"
 #include "IRunLengthStreamReader.h"
 #include "crc32.h"
+#include "BlockManifest.h"
+#include "RestoreChain.h"
+#include "DeltaWriter.h"
+#include "ReadBackVerifier.h"
+#include "MediaHash.h"
+#include "CheckpointJournal.h"
 #include "InternalException.h"
+#include "OSException.h"
+#include "Throttle.h"
 
 using namespace std;
 
@@ -52,7 +60,25 @@ CWriteThread::CWriteThread(IImageStream *writeStore, CImageBuffer *sourceQueue,
   fTargetQueue = targetQueue;
   fRunLengthReader = NULL;
   fVerifyOnly = verifyOnly;
+  fBlockManifest = NULL;
+  fRestoreChain = NULL;
+  fChainIndex = 0;
+  fDeltaCompareSize = 0;
+  fReadBackDistance = fReadBackQueueDepth = fReadBackRetentionSize = 0;
+  fReadBackFlushHandle = NULL;
+  fMediaHash = NULL;
+  fMediaSize = 0;
+  fJournal = NULL;
+  fCheckpointFlushHandle = NULL;
+  fCheckpointInterval = fNextCheckpoint = fJournaledBlocks = 0;
+  fResumeBytes = 0;
+  fResumeCrc32 = 0;
+  fSkipBytes = fDataPos = fTargetPos = 0;
 } 
+
+CWriteThread::~CWriteThread()
+{
+}
 //---------------------------------------------------------------------------
 
 
@@ -63,14 +89,27 @@ DWORD  CWriteThread::Execute()
 {
   SetName("WriteThread");
   ATLTRACE("CWriteThread created,  thread: %d, name: Write-Thread\n", GetCurrentThreadId());
+  if (fLowIoPriority && !EnterBackgroundMode())
+    ATLTRACE("CWriteThread could not enter background mode, error: %d\n", GetLastError());
   try {
     if (fVerifyOnly) {
       WriteLoopVerify();
     } else {
-      if (NULL != fRunLengthReader)
+      if (fDeltaCompareSize > 0 && fReadBackQueueDepth > 0)
+        THROW_INT_EXC(EInternalException::readBackWithDelta);
+      if (fDeltaCompareSize > 0)
+        fDeltaWriter = std::make_unique<CDeltaWriter>(fWriteStore, fDeltaCompareSize);
+      if (fReadBackQueueDepth > 0)
+        fReadBackVerifier = std::make_unique<CReadBackVerifier>(fWriteStore, fReadBackDistance, fReadBackQueueDepth,
+                              fReadBackRetentionSize, fReadBackFlushHandle);
+      if (NULL != fRunLengthReader && NULL != fRestoreChain)
+        WriteLoopChain();
+      else if (NULL != fRunLengthReader)
         WriteLoopRunLength(); 
       else
         WriteLoopSimple();
+      if (fReadBackVerifier)
+        fReadBackVerifier->Finish(); // the restore is complete when all data are read back
     }
     ATLTRACE("CWriteThread has finished,  thread: %d, name: Write-Thread\n", GetCurrentThreadId());
     return S_OK;
@@ -138,7 +177,7 @@ void CWriteThread::WriteLoopRunLength()
          bytesToRead = remainingBufferSize;
          runLength -= remainingBufferSize / fClusterSize;
        }
-       fWriteStore->Write(buffer, bytesToRead, &bytesRead);
+       WriteTarget(buffer, bytesToRead, &bytesRead);
        fBytesProcessed += bytesRead;
        if (bytesToRead != bytesRead) {
           THROW_INT_EXC(EInternalException::wrongWriteSize); 
@@ -146,6 +185,8 @@ void CWriteThread::WriteLoopRunLength()
        //ATLTRACE("First Bytes of run length are: %d, %d, %d, %d, %d\n",
        //  (unsigned) buffer[0], (unsigned) buffer[1], (unsigned) buffer[2],(unsigned) buffer[3], (unsigned) buffer[4]);
        crc32.AddDataBlock(buffer, bytesRead);
+       if (fMediaHash)
+         fMediaHash->AddData(buffer, bytesRead);
        seekPos += bytesRead;
        buffer += bytesRead;
        dbgBytesReadRunLength += bytesRead;
@@ -181,16 +222,135 @@ void CWriteThread::WriteLoopRunLength()
     ATLTRACE("Skipping run length of free clusters, size: %d\n", (DWORD) runLength);
     //ATLTRACE("  number of total clusters up to now: %u\n", dbgNoUsedClustersTotal);
     seekPos += fClusterSize * runLength; // skip free clusters
+    if (fMediaHash)
+      fMediaHash->AddZeros(fClusterSize * runLength);
     //ATLTRACE("write thread: set seek position: %d\n", (DWORD) seekPos);
 
-    fWriteStore->Seek(seekPos, FILE_BEGIN); // set seek position for write thread
+    SeekTarget(seekPos); // set seek position for write thread
   } // outer while
   ATLTRACE("Write thread: Number of written bytes in total: %u\n", dbgNoUsedClustersTotal * fClusterSize);
   fCrc32 = crc32.GetResult();
   ATLTRACE("Write thread CRC32 is: %u\n", crc32.GetResult());
+  if (fMediaHash)
+    fMediaHash->Finish(fMediaSize);
+  fWriteStore->SetCompletedInformation(fCrc32, fBytesProcessed); 
+}
+
+//---------------------------------------------------------------------------
+// Write loop for an image of a restore chain. The data of the image are the
+// used clusters of the blocks the image has stored. Blocks that are stored in
+// a newer image of the chain are skipped, they are written when that image is
+// restored.
+void CWriteThread::WriteLoopChain()
+{
+  const CBlockHashTable& hashes = fRestoreChain->GetBlockHashTable(fChainIndex);
+  const DWORD blockSize = hashes.GetBlockSize();
+  unsigned __int64 runLength, bytesInRun;
+  unsigned __int64 volumePos = 0;   // position on volume
+  unsigned __int64 writePos = 0;    // seek position of target
+  CBufferChunk *chunk = NULL;
+  unsigned chunkPos = 0;
+  bool eof = false;
+  CCRC32 crc32;
+
+  if (blockSize == 0 || blockSize % fClusterSize != 0)
+    THROW_INT_EXC(EInternalException::inputError);
+
+  while (!fRunLengthReader->LastValueRead()) {
+    // read run length of used clusters
+    runLength = fRunLengthReader->GetNextRunLength();
+    if (runLength > 0 && fClusterSize > ULLONG_MAX / runLength) {
+      THROW_INT_EXC(EInternalException::inputError);
+    }
+    bytesInRun = fClusterSize * runLength;
+
+    while (bytesInRun > 0) {
+      unsigned __int64 blockNo = volumePos / blockSize;
+      unsigned count = blockSize - (unsigned) (volumePos - blockNo * blockSize);
+      if (count > bytesInRun)
+        count = (unsigned) bytesInRun;
+      if (hashes.IsStored(blockNo)) {
+        bool write = fRestoreChain->IsBlockFromImage(blockNo, fChainIndex);
+        if (write && writePos != volumePos) {
+          SeekTarget(volumePos);
+          writePos = volumePos;
+        }
+        TakeData(count, write, chunk, chunkPos, eof, crc32);
+        if (write)
+          writePos += count;
+      }
+      volumePos += count;
+      bytesInRun -= count;
+    }
+
+    // skip run length of free clusters
+    runLength = fRunLengthReader->GetNextRunLength();
+    volumePos += fClusterSize * runLength;
+  }
+
+  // hand back remaining chunks up to end of stream
+  while (chunk || !eof) {
+    if (chunk) {
+      chunk->Reset();
+      fTargetQueue->ReleaseChunk(chunk);
+      chunk = NULL;
+    }
+    if (!eof) {
+      chunk = fSourceQueue->GetChunk(); // may block
+      if (!chunk)
+        THROW_INT_EXC(EInternalException::getChunkError);
+      eof = chunk->IsEOF();
+    }
+  }
+  fCrc32 = crc32.GetResult();
+  ATLTRACE("Write thread: Number of written bytes in total: %u\n", (DWORD) fBytesProcessed);
+  ATLTRACE("Write thread CRC32 is: %u\n", fCrc32);
   fWriteStore->SetCompletedInformation(fCrc32, fBytesProcessed); 
 }
 
+//---------------------------------------------------------------------------
+// Consume length bytes from the source queue and write them to the target if
+// write is true.
+void CWriteThread::TakeData(unsigned length, bool write, CBufferChunk*& chunk, unsigned& chunkPos, bool& eof, CCRC32& crc32)
+{
+  unsigned bytesWritten;
+
+  while (length > 0) {
+    unsigned chunkSize = (!chunk || chunk->IsEmpty()) ? 0 : chunk->GetSize();
+    if (chunkPos == chunkSize) {
+      if (chunk) {
+        if (eof)
+          THROW_INT_EXC(EInternalException::wrongReadSize); // image has less data than its allocation map
+        chunk->Reset();
+        fTargetQueue->ReleaseChunk(chunk);
+        chunk = NULL;
+        if (fCancel)
+          Terminate(-1);  // terminate thread after releasing buffer and before acquiring next one
+      }
+      chunk = fSourceQueue->GetChunk(); // may block
+      if (!chunk)
+        THROW_INT_EXC(EInternalException::getChunkError);
+      chunkPos = 0;
+      eof = chunk->IsEOF();
+      continue;
+    }
+    unsigned count = chunkSize - chunkPos;
+    if (count > length)
+      count = length;
+    BYTE* data = (BYTE*)chunk->GetData() + chunkPos;
+    if (write) {
+      WriteTarget(data, count, &bytesWritten);
+      fBytesProcessed += bytesWritten;
+      if (bytesWritten != count) {
+        THROW_INT_EXC(EInternalException::wrongWriteSize); 
+      }
+    }
+    crc32.AddDataBlock(data, count);
+    chunkPos += count;
+    length -= count;
+  }
+}
+
 //---------------------------------------------------------------------------
 
 void CWriteThread::WriteLoopSimple()
@@ -203,6 +363,14 @@ void CWriteThread::WriteLoopSimple()
   bool bTerminated = FALSE;
   CCRC32 crc32;
 
+  if (fResumeBytes > 0) {
+    // the image data of the interrupted backup up to its last checkpoint
+    fBytesProcessed = fResumeBytes;
+    crc32.Resume(fResumeCrc32);
+    if (fBlockManifest)
+      fJournaledBlocks = fBlockManifest->GetBlockCount();
+  }
+
   while (!bEOF) {
       CBufferChunk *ReadChunk = fSourceQueue->GetChunk();
       if (!ReadChunk)
@@ -210,7 +378,7 @@ void CWriteThread::WriteLoopSimple()
       nWriteCount = ReadChunk->IsEmpty() ? 0 : ReadChunk->GetSize();
 	    bEOF = ReadChunk->IsEOF();
 
-      fWriteStore->Write(ReadChunk->GetData(), nWriteCount, &nBytesWritten);
+      WriteTarget(ReadChunk->GetData(), nWriteCount, &nBytesWritten);
       fBytesProcessed += nBytesWritten;
       if (nBytesWritten != nWriteCount) {
         // An error occured while writing - handle this
@@ -218,8 +386,14 @@ void CWriteThread::WriteLoopSimple()
       }  // else if (!nBytesRead)
       dbgRunLength += nBytesWritten;
       crc32.AddDataBlock((BYTE*)(ReadChunk->GetData()), nWriteCount);
+      if (fBlockManifest)
+        fBlockManifest->AddData((BYTE*)(ReadChunk->GetData()), nWriteCount);
+      if (fMediaHash)
+        fMediaHash->AddData((BYTE*)(ReadChunk->GetData()), nWriteCount);
       //ATLTRACE("Write thread number of bytes written so far: %u\n", (DWORD) fBytesProcessed);
       //ATLTRACE("Write thread CRC32 so far is: %u\n", crc32.GetResult());
+      if (fJournal && fCheckpointInterval == 0 && ReadChunk->HasCheckpoint())
+        AddBackupCheckpoint(ReadChunk, crc32.GetResult());
       
       ReadChunk->Reset();
       fTargetQueue->ReleaseChunk(ReadChunk);
@@ -231,6 +405,8 @@ void CWriteThread::WriteLoopSimple()
     unsigned __int64 fileSeekPos = fWriteStore->GetPosition();
     ATLTRACE("Write thread: final seek position in file is: %u\n", (unsigned) fileSeekPos);
     fCrc32 = crc32.GetResult();
+    if (fMediaHash)
+      fMediaHash->Finish(fMediaSize);
     fWriteStore->SetCompletedInformation(fCrc32, fBytesProcessed); 
 }
 
@@ -265,6 +441,110 @@ void CWriteThread::WriteLoopVerify()
       fWriteStore->SetCompletedInformation(fCrc32, fBytesProcessed); 
 }
 
+//---------------------------------------------------------------------------
+// Write to the target within the I/O budget of the thread, in a delta restore only
+// the data that differs, with read back verification keeping the data for comparing
+
+void CWriteThread::WriteTarget(void* data, unsigned length, unsigned* bytesWritten)
+{
+  // the data an interrupted restore has already written are skipped
+  if (fDataPos < fSkipBytes) {
+    unsigned skip = fSkipBytes - fDataPos < length ? (unsigned) (fSkipBytes - fDataPos) : length;
+    fDataPos += skip;
+    fTargetPos += skip;
+    if (fDataPos == fSkipBytes)
+      SeekTarget(fTargetPos); // the target continues behind the skipped data
+    if (skip == length) {
+      *bytesWritten = length;
+      return;
+    }
+    WriteTarget((BYTE*) data + skip, length - skip, bytesWritten);
+    *bytesWritten += skip;
+    return;
+  }
+
+  if (fDeltaWriter)
+    fDeltaWriter->Write((const BYTE*) data, length, bytesWritten);
+  else if (fReadBackVerifier)
+    fReadBackVerifier->Write((const BYTE*) data, length, bytesWritten);
+  else
+    fWriteStore->Write(data, length, bytesWritten);
+  if (fThrottle)
+    fThrottle->Consume(*bytesWritten);
+  fDataPos += *bytesWritten;
+  fTargetPos += *bytesWritten;
+  if (fJournal && fCheckpointInterval > 0 && fDataPos >= fNextCheckpoint) {
+    AddRestoreCheckpoint();
+    fNextCheckpoint = fDataPos + fCheckpointInterval;
+  }
+}
+
+void CWriteThread::SeekTarget(unsigned __int64 pos)
+{
+  fTargetPos = pos;
+  if (fDataPos < fSkipBytes)
+    return; // the target is positioned when the first data are written
+  if (fDeltaWriter)
+    fDeltaWriter->Seek(pos);
+  else if (fReadBackVerifier)
+    fReadBackVerifier->Seek(pos);
+  else
+    fWriteStore->Seek(pos, FILE_BEGIN);
+}
+
+//---------------------------------------------------------------------------
+// Record a checkpoint of a backup behind the image data of chunk, the data and
+// the image checksum crc32 up to here are flushed to the image file
+
+void CWriteThread::AddBackupCheckpoint(const CBufferChunk* chunk, DWORD crc32)
+{
+  CCheckpointJournal::TCheckpoint checkpoint;
+  std::vector<DWORD> checksums;
+
+  BOOL ok = FlushFileBuffers(fCheckpointFlushHandle);
+  CHECK_OS_EX_INFO(ok, EWinException::writeFileError);
+  memset(&checkpoint, 0, sizeof(checkpoint));
+  checkpoint.dataPos = chunk->GetCheckpointPos();
+  checkpoint.sourcePos = chunk->GetCheckpointSourcePos();
+  checkpoint.targetPos = fBytesProcessed;
+  checkpoint.crc32 = crc32;
+  if (fBlockManifest) {
+    for (unsigned __int64 i = fJournaledBlocks; i < fBlockManifest->GetBlockCount(); i++)
+      checksums.push_back(fBlockManifest->GetChecksum(i));
+    fJournaledBlocks = fBlockManifest->GetBlockCount();
+    checkpoint.manifestChecksum = fBlockManifest->GetPartialChecksum();
+  }
+  fJournal->AddCheckpoint(checkpoint, checksums.empty() ? NULL : &checksums[0], (unsigned) checksums.size());
+}
+
+//---------------------------------------------------------------------------
+// Record a checkpoint of a restore: with read back verification at the end of the
+// data read back and found identical, otherwise at the end of the flushed data
+
+void CWriteThread::AddRestoreCheckpoint()
+{
+  CCheckpointJournal::TCheckpoint checkpoint;
+
+  BOOL ok = FlushFileBuffers(fCheckpointFlushHandle);
+  CHECK_OS_EX_INFO(ok, EWinException::writeFileError);
+  memset(&checkpoint, 0, sizeof(checkpoint));
+  checkpoint.dataPos = fReadBackVerifier ? fSkipBytes + fReadBackVerifier->GetVerifiedBytes() : fDataPos;
+  checkpoint.sourcePos = checkpoint.dataPos;
+  checkpoint.targetPos = fTargetPos;
+  if (checkpoint.dataPos > fJournal->GetLastCheckpoint().dataPos)
+    fJournal->AddCheckpoint(checkpoint, NULL, 0);
+}
+
+unsigned __int64 CWriteThread::GetDeltaSkippedBytes() const
+{
+  return fDeltaWriter ? fDeltaWriter->GetSkippedBytes() : 0;
+}
+
+unsigned __int64 CWriteThread::GetReadBackVerifiedBytes() const
+{
+  return fReadBackVerifier ? fReadBackVerifier->GetVerifiedBytes() : 0;
+}
+
 //---------------------------------------------------------------------------
 
 void CWriteThread::SetAllocationMapReaderInfo(IRunLengthStreamReader* runLengthReader, DWORD clusterSize) {
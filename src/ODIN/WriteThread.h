@@ -26,22 +26,96 @@
 #ifndef WriteThread_H
 #define WriteThread_H
 //---------------------------------------------------------------------------
+#include <memory>
 #include "OdinThread.h"
 
 class CImageBuffer;
 class IImageStream;
 class CBufferChunk;
 class IRunLengthStreamReader;
+class CBlockManifest;
+class CRestoreChain;
+class CCRC32;
+class CDeltaWriter;
+class CReadBackVerifier;
+class CMediaHash;
+class CCheckpointJournal;
 
 //---------------------------------------------------------------------------
 class CWriteThread : public COdinThread
 {
   public:
     CWriteThread(IImageStream *writeStore, CImageBuffer *sourceQueue, CImageBuffer* targetQueue, bool verifyOnly);
+    virtual ~CWriteThread();
     virtual DWORD Execute();
     
     // void SetAllocationMapReaderInfo(HANDLE hFile, unsigned __int64 offBegin, unsigned __int64 length, DWORD clusterSize);
     void SetAllocationMapReaderInfo(IRunLengthStreamReader* runLengthReader, DWORD clusterSize);
+
+    // collect per block checksums of all written data in manifest (backup only)
+    void SetBlockManifest(CBlockManifest* manifest) {
+      fBlockManifest = manifest;
+    }
+
+    // restore image index of a chain of incremental images, only blocks that are
+    // not contained in a newer image of the chain are written
+    void SetRestoreChain(const CRestoreChain* chain, unsigned index) {
+      fRestoreChain = chain;
+      fChainIndex = index;
+    }
+
+    // write only data that differs from the content of the target, compared in
+    // units of compareSize bytes (restore only)
+    void SetDeltaRestore(unsigned compareSize) {
+      fDeltaCompareSize = compareSize;
+    }
+
+    // bytes of a delta restore that were already on the target and not written
+    unsigned __int64 GetDeltaSkippedBytes() const;
+
+    // read back all written data while restoring and compare them with the written data,
+    // distance bytes behind the writer with at most queueDepth extents and retentionSize
+    // bytes waiting to be read back. flushHandle is flushed before reading (restore only)
+    void SetReadBackVerify(unsigned distance, unsigned queueDepth, unsigned retentionSize, HANDLE flushHandle) {
+      fReadBackDistance = distance;
+      fReadBackQueueDepth = queueDepth;
+      fReadBackRetentionSize = retentionSize;
+      fReadBackFlushHandle = flushHandle;
+    }
+
+    // bytes of a restore with read back verification that were read back and identical
+    unsigned __int64 GetReadBackVerifiedBytes() const;
+
+    // calculate the hash of the restored volume in hash, free clusters count as zeros
+    // and the data are padded with zeros up to mediaSize (restore only, not for chains)
+    void SetMediaHash(CMediaHash* hash, unsigned __int64 mediaSize) {
+      fMediaHash = hash;
+      fMediaSize = mediaSize;
+    }
+
+    // record checkpoints in journal after flushing flushHandle: of a backup at the
+    // chunks marked as checkpoint (interval 0), of a restore each time another interval
+    // bytes of data were written (not for chains and delta restores)
+    void SetCheckpoints(CCheckpointJournal* journal, HANDLE flushHandle, unsigned __int64 interval) {
+      fJournal = journal;
+      fCheckpointFlushHandle = flushHandle;
+      fCheckpointInterval = interval;
+      fNextCheckpoint = interval;
+    }
+
+    // continue an interrupted backup behind bytesWritten bytes of image data with
+    // checksum crc32 (simple write loop only)
+    void ResumeWriting(unsigned __int64 bytesWritten, DWORD crc32) {
+      fResumeBytes = bytesWritten;
+      fResumeCrc32 = crc32;
+    }
+
+    // continue an interrupted restore: the first bytes of data are already on the
+    // target and are not written again
+    void SetSkipBytes(unsigned __int64 bytes) {
+      fSkipBytes = bytes;
+      fNextCheckpoint = bytes + fCheckpointInterval;
+    }
  
   protected:
     CImageBuffer *fSourceQueue;
@@ -54,10 +128,38 @@ class CWriteThread : public COdinThread
     DWORD fClusterSize;               // size each bit in allocation bitmap represents
     IRunLengthStreamReader* fRunLengthReader;
     bool fVerifyOnly;                   // check only checksum of a stored image
+    CBlockManifest* fBlockManifest;     // per block checksums of written data or NULL
+    const CRestoreChain* fRestoreChain; // chain of incremental images being restored or NULL
+    unsigned fChainIndex;               // index of restored image in fRestoreChain
+    unsigned fDeltaCompareSize;         // compare unit of delta restore or 0 for normal restore
+    std::unique_ptr<CDeltaWriter> fDeltaWriter; // writes to fWriteStore in delta restore
+    unsigned fReadBackDistance;         // bytes read back verification lags behind writing
+    unsigned fReadBackQueueDepth;       // extents waiting for read back or 0 for no read back
+    unsigned fReadBackRetentionSize;    // bytes of written data kept for read back
+    HANDLE fReadBackFlushHandle;        // handle of target flushed before read back or NULL
+    std::unique_ptr<CReadBackVerifier> fReadBackVerifier; // writes to fWriteStore with read back
+    CMediaHash* fMediaHash;             // hash of restored volume or NULL
+    unsigned __int64 fMediaSize;        // size of restored volume covered by fMediaHash
+    CCheckpointJournal* fJournal;       // journal checkpoints are recorded in or NULL
+    HANDLE fCheckpointFlushHandle;      // handle of target flushed before a checkpoint
+    unsigned __int64 fCheckpointInterval; // bytes of data between checkpoints of a restore
+    unsigned __int64 fNextCheckpoint;   // data position of next checkpoint of a restore
+    unsigned __int64 fJournaledBlocks;  // manifest checksums recorded in the journal
+    unsigned __int64 fResumeBytes;      // image data already written by an interrupted backup
+    DWORD fResumeCrc32;                 // checksum of the image data already written
+    unsigned __int64 fSkipBytes;        // data already restored by an interrupted restore
+    unsigned __int64 fDataPos;          // data passed to WriteTarget()
+    unsigned __int64 fTargetPos;        // position on target of next data
 
   private:
     void WriteLoopRunLength();
+    void WriteLoopChain();
+    void TakeData(unsigned length, bool write, CBufferChunk*& chunk, unsigned& chunkPos, bool& eof, CCRC32& crc32);
     void WriteLoopSimple();
+    void WriteTarget(void* data, unsigned length, unsigned* bytesWritten);
+    void SeekTarget(unsigned __int64 pos);
+    void AddBackupCheckpoint(const CBufferChunk* chunk, DWORD crc32);
+    void AddRestoreCheckpoint();
     void WriteLoopVerify();
 }; 
 //---------------------------------------------------------------------------
@@ -27,6 +27,10 @@
 
 #include "stdafx.h"
 #include "crc32.h"
+#if defined(_M_X64)
+#include <intrin.h>
+#include <nmmintrin.h>
+#endif
 
 #ifdef DEBUG
   #define new DEBUG_NEW
@@ -197,7 +201,121 @@ DWORD CCRC32::GetResult() {
   return ~fCrc32;
 }
 
+void CCRC32::Resume(DWORD result) {
+  fCrc32 = ~result;
+}
+
 inline void CCRC32::CalcCRC32(const BYTE byte)
 {
   fCrc32 = ((fCrc32) >> 8) ^ sCrc32Table[(byte) ^ ((fCrc32) & 0x000000FF)];
 }
+
+// ---------------------------------------------------------------------------
+// CRC32C (Castagnoli, reflected polynomial 0x82F63B78)
+//
+// Same slice-by-8 scheme as above, with separate tables for the Castagnoli
+// polynomial. On x64 processors with SSE4.2 the crc32 instruction computes
+// the same checksum in hardware, which is several times faster again.
+// ---------------------------------------------------------------------------
+static DWORD sSliceTableC[8][256];
+#if defined(_M_X64)
+static bool  sHasSSE42 = false;
+#endif
+
+static void InitSliceTablesC()
+{
+  for (int i = 0; i < 256; i++) {
+    DWORD crc = (DWORD)i;
+    for (int j = 0; j < 8; j++)
+      crc = (crc >> 1) ^ (crc & 1 ? 0x82F63B78UL : 0UL);
+    sSliceTableC[0][i] = crc;
+  }
+  for (int t = 1; t < 8; t++)
+    for (int i = 0; i < 256; i++)
+      sSliceTableC[t][i] = (sSliceTableC[t-1][i] >> 8)
+                         ^ sSliceTableC[0][sSliceTableC[t-1][i] & 0xFF];
+#if defined(_M_X64)
+  int cpuInfo[4];
+  __cpuid(cpuInfo, 1);
+  sHasSSE42 = (cpuInfo[2] & (1 << 20)) != 0;
+#endif
+}
+
+static DWORD Crc32cSoftware(DWORD crc, const BYTE* p, unsigned length)
+{
+  while (length > 0 && (reinterpret_cast<uintptr_t>(p) & 3) != 0) {
+    crc = (crc >> 8) ^ sSliceTableC[0][*p++ ^ (crc & 0xFF)];
+    --length;
+  }
+  while (length >= 8) {
+    DWORD v0 = *reinterpret_cast<const DWORD*>(p    ) ^ crc;
+    DWORD v1 = *reinterpret_cast<const DWORD*>(p + 4);
+    crc = sSliceTableC[7][ v0        & 0xFF]
+        ^ sSliceTableC[6][(v0 >>  8) & 0xFF]
+        ^ sSliceTableC[5][(v0 >> 16) & 0xFF]
+        ^ sSliceTableC[4][(v0 >> 24) & 0xFF]
+        ^ sSliceTableC[3][ v1        & 0xFF]
+        ^ sSliceTableC[2][(v1 >>  8) & 0xFF]
+        ^ sSliceTableC[1][(v1 >> 16) & 0xFF]
+        ^ sSliceTableC[0][(v1 >> 24) & 0xFF];
+    p      += 8;
+    length -= 8;
+  }
+  while (length-- > 0)
+    crc = (crc >> 8) ^ sSliceTableC[0][*p++ ^ (crc & 0xFF)];
+  return crc;
+}
+
+#if defined(_M_X64)
+static DWORD Crc32cHardware(DWORD crc, const BYTE* p, unsigned length)
+{
+  while (length > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+    --length;
+  }
+  unsigned __int64 crc64 = crc;
+  while (length >= 8) {
+    crc64 = _mm_crc32_u64(crc64, *reinterpret_cast<const unsigned __int64*>(p));
+    p      += 8;
+    length -= 8;
+  }
+  crc = (DWORD)crc64;
+  while (length-- > 0)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+CCRC32C::CCRC32C() {
+  static int sOnce = (InitSliceTablesC(), 0);
+  (void)sOnce;
+  Reset();
+}
+
+void CCRC32C::Reset() {
+  fCrc32c = 0xFFFFFFFF;
+}
+
+void CCRC32C::AddDataBlock(const BYTE* pData, unsigned length) {
+#if defined(_M_X64)
+  if (sHasSSE42) {
+    fCrc32c = Crc32cHardware(fCrc32c, pData, length);
+    return;
+  }
+#endif
+  fCrc32c = Crc32cSoftware(fCrc32c, pData, length);
+}
+
+DWORD CCRC32C::GetResult() const {
+  return ~fCrc32c;
+}
+
+void CCRC32C::Resume(DWORD result) {
+  fCrc32c = ~result;
+}
+
+DWORD CCRC32C::Calculate(const BYTE* pData, unsigned length) {
+  CCRC32C crc;
+  crc.AddDataBlock(pData, length);
+  return crc.GetResult();
+}
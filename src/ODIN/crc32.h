@@ -21,6 +21,8 @@
 
 ******************************************************************************/
  
+#pragma once
+
 ///////////////////////////////////////////////////////////////////////////////////////////
 // class CRC32 a c++ class for calculation of crc32 checksums
 ///////////////////////////////////////////////////////////////////////////////////////////
@@ -33,6 +35,8 @@ public:
   ~CCRC32();
   void AddDataBlock(BYTE* pData, unsigned length);
   DWORD GetResult();
+  // continue a checksum from the result of an earlier calculation
+  void Resume(DWORD result);
 
 private:
   inline void CalcCRC32(const BYTE byte);
@@ -42,3 +46,26 @@ private:
   DWORD fCrc32;
   static const DWORD sCrc32Table[256];
 };
+
+///////////////////////////////////////////////////////////////////////////////////////////
+// class CCRC32C a c++ class for calculation of crc32c (Castagnoli polynomial) checksums
+// Used for the per block checksums of the block manifest. Uses the SSE4.2 crc32 instruction
+// if the processor supports it, otherwise a slice-by-8 table implementation.
+///////////////////////////////////////////////////////////////////////////////////////////
+
+class CCRC32C
+{
+public:
+  CCRC32C();
+  void AddDataBlock(const BYTE* pData, unsigned length);
+  DWORD GetResult() const;
+  void Reset();
+  // continue a checksum from the result of an earlier calculation
+  void Resume(DWORD result);
+
+  // checksum of a single buffer in one call
+  static DWORD Calculate(const BYTE* pData, unsigned length);
+
+private:
+  DWORD fCrc32c;
+};
@@ -0,0 +1,175 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "../stdafx.h"
+#include <sys/ioctl.h>
+#ifdef __linux__
+  #include <linux/fs.h>
+#endif
+#include "../ImageStream.h"
+#include "../OSException.h"
+#include "../InternalException.h"
+#include "../CompressedRunLengthStream.h"
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Implementation of class CDiskImageStream on POSIX systems
+// The volume is a block device (a partition, a disk or a loop device) or a file
+// given by its path. The allocation maps of file systems are not read, so all
+// blocks are saved and IsMounted() is false. A block device is opened
+// exclusively for writing, which fails while it is mounted.
+/////////////////////////////////////////////////////////////////////////////////////
+
+CDiskImageStream::CDiskImageStream()
+{
+  Init();
+}
+
+CDiskImageStream::CDiskImageStream(int volumeCount)
+{
+  Init();
+  fContainedVolumeCount = volumeCount;
+}
+
+void CDiskImageStream::Init() {
+  fHandle = NULL;
+  fBytesUsed = 0;
+  fSize = 0;
+  fAllocMapReader = NULL;
+  fExtraOffset = 0;
+  fPosition = 0;
+  fContainedVolumeCount = 0;
+  fSubVolumeLocker = NULL;
+  fWasLocked = false;
+  fIsMounted = false;
+  fPartitionType = 0;
+  fBytesPerSector = 512;
+  fBytesPerCluster = 0;
+  fBytesPerClusterFromBootSector = 0;
+}
+
+CDiskImageStream::~CDiskImageStream()
+{
+  Close();
+  delete fAllocMapReader;
+}
+
+void CDiskImageStream::ReadDriveLayout()
+{
+  // partition tables are read by the tools of the system
+}
+
+void CDiskImageStream::UnlockSubVolume(int /* i */)
+{
+}
+
+void CDiskImageStream::Open(LPCWSTR name, TOpenMode mode)
+{
+  DWORD access = (mode == forWriting) ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_READ;
+  DWORD shareMode = (mode == forWriting) ? 0 : FILE_SHARE_READ | FILE_SHARE_WRITE;
+  LARGE_INTEGER size;
+
+  fName = name;
+  fOpenMode = mode;
+  fPosition = 0;
+  fHandle = CreateFile(name, access, shareMode, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CHECK_OS_EX_HANDLE_PARAM1(fHandle, EWinException::volumeOpenError, fName.c_str());
+  fWasLocked = mode == forWriting;
+
+  BOOL ok = GetFileSizeEx(fHandle, &size);
+  CHECK_OS_EX_PARAM1(ok, EWinException::ioControlError, L"BLKGETSIZE64");
+  fSize = size.QuadPart;
+#ifdef BLKSSZGET
+  int sectorSize = 0;
+  if (ioctl(GetFileDescriptor(fHandle), BLKSSZGET, &sectorSize) == 0 && sectorSize > 0)
+    fBytesPerSector = sectorSize;
+#endif
+  // there is no file system to take the cluster size from
+  fBytesPerClusterFromBootSector = fSize % 4096 == 0 ? 4096 : 512;
+  ATLTRACE("Size of volume %S is %llu\n", fName.c_str(), fSize);
+}
+
+void CDiskImageStream::Close()
+{
+  if (fHandle != NULL && fHandle != INVALID_HANDLE_VALUE) {
+    if (fOpenMode == forWriting) {
+      // the data must be on the device when the restore is reported as finished
+      BOOL ok = FlushFileBuffers(fHandle);
+      CHECK_OS_EX_PARAM1(ok, EWinException::writeVolumeError, fName.c_str());
+    }
+    BOOL res = CloseHandle(fHandle);
+    fHandle = NULL;
+    CHECK_OS_EX_INFO(res, EWinException::closeHandleError);
+  }
+}
+
+void CDiskImageStream::Read(void * buffer, unsigned nLength, unsigned *nbytesRead)
+{
+  BOOL bSuccess;
+  DWORD nbytesReadTemp;
+
+  if (fSize > 0 && (unsigned __int64)nLength > fSize - fPosition)
+    nLength = (DWORD)(fSize - fPosition);
+
+  bSuccess = ReadFile(fHandle, buffer, nLength, &nbytesReadTemp, NULL) != FALSE;
+  CHECK_OS_EX_PARAM1(bSuccess, EWinException::readVolumeError, fName.c_str());
+  fPosition += nbytesReadTemp;
+  *nbytesRead = nbytesReadTemp;
+}
+
+void CDiskImageStream::Write(void *buffer, unsigned nLength, unsigned *nBytesWritten)
+{
+  BOOL bSuccess;
+  DWORD nWrote;
+
+  bSuccess = WriteFile(fHandle, buffer, nLength, &nWrote, NULL) != FALSE;
+  CHECK_OS_EX_PARAM1(bSuccess, EWinException::writeVolumeError, fName.c_str());
+  fPosition += nWrote;
+  *nBytesWritten = nWrote;
+}
+
+void CDiskImageStream::Seek(__int64 offset, DWORD moveMethod)
+{
+  BOOL bSuccess;
+  LARGE_INTEGER pos, newOffset;
+  pos.QuadPart = offset;
+  bSuccess = SetFilePointerEx(fHandle, pos, &newOffset, moveMethod);
+  CHECK_OS_EX_PARAM1(bSuccess, EWinException::seekError, fName.c_str());
+  fPosition = newOffset.QuadPart;
+}
+
+IRunLengthStreamReader* CDiskImageStream::GetRunLengthStreamReader() const {
+  return fAllocMapReader;
+}
+
+unsigned __int64 CDiskImageStream::StoreVolumeBitmap(unsigned int /* chunkSize */, HANDLE /* hOutHandle */,
+                                                     LPCWSTR /* fileName */)
+{
+  // only all blocks of a volume can be saved, see class comment
+  THROW_INT_EXC(EInternalException::unsupportedPartitionFormat);
+}
+
+void CDiskImageStream::SetCompletedInformation(DWORD /* crc32 */, unsigned __int64 /* processedBytes */)
+{
+  // ignore nothing to do
+}
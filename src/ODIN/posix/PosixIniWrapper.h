@@ -0,0 +1,104 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __POSIXINIWRAPPER_H__
+#define __POSIXINIWRAPPER_H__
+
+#include <string>
+#include "PosixPlatform.h"
+
+//---------------------------------------------------------------------------
+// class CIniWrapper on POSIX systems
+// The engine has no configuration file there, all entries of Config.h keep the
+// value they are initialized with and the programs set options by the setters of
+// the classes. Only the functions used by Config.h are provided.
+
+class CIniWrapper
+{
+public:
+  void SetPathName(LPCTSTR /* lpPathName */) {
+  }
+  LPCTSTR GetPathName() const {
+    return L"";
+  }
+
+  void GetString(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, LPCTSTR lpDefault, std::wstring& result) const {
+    result = lpDefault ? lpDefault : L"";
+  }
+  BOOL WriteString(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, LPCTSTR /* lpValue */) const {
+    return TRUE;
+  }
+
+  int GetInt(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, int nDefault) const {
+    return nDefault;
+  }
+  BOOL WriteInt(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, int /* nValue */) const {
+    return TRUE;
+  }
+
+  UINT GetUInt(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, UINT nDefault) const {
+    return nDefault;
+  }
+  BOOL WriteUInt(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, UINT /* nValue */) const {
+    return TRUE;
+  }
+
+  __int64 GetInt64(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, __int64 nDefault) const {
+    return nDefault;
+  }
+  BOOL WriteInt64(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, __int64 /* nValue */) const {
+    return TRUE;
+  }
+
+  unsigned __int64 GetUInt64(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, unsigned __int64 nDefault) const {
+    return nDefault;
+  }
+  BOOL WriteUInt64(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, unsigned __int64 /* nValue */) const {
+    return TRUE;
+  }
+
+  BOOL GetBool(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, BOOL bDefault) const {
+    return bDefault;
+  }
+  BOOL WriteBool(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, BOOL /* bValue */) const {
+    return TRUE;
+  }
+
+  double GetDouble(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, double fDefault) const {
+    return fDefault;
+  }
+  BOOL WriteDouble(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, double /* fValue */) const {
+    return TRUE;
+  }
+
+  TCHAR GetChar(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, TCHAR cDefault) const {
+    return cDefault;
+  }
+  BOOL WriteChar(LPCTSTR /* lpSection */, LPCTSTR /* lpKey */, TCHAR /* c */) const {
+    return TRUE;
+  }
+};
+
+#endif
@@ -0,0 +1,1179 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "../stdafx.h"
+#include "PosixSocket.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <signal.h>
+#include <limits.h>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#ifdef __linux__
+  #include <linux/fs.h>
+#endif
+
+using namespace std;
+
+//---------------------------------------------------------------------------
+// errors
+
+static thread_local DWORD sLastError = ERROR_SUCCESS;
+
+typedef struct {
+  int errnoValue;
+  DWORD error;
+} TErrorMapping;
+
+// first entry of an error code is used to find the message of a Windows error
+static const TErrorMapping sErrorMappings[] = {
+  { ENOENT, ERROR_FILE_NOT_FOUND },
+  { ENOTDIR, ERROR_PATH_NOT_FOUND },
+  { EMFILE, ERROR_TOO_MANY_OPEN_FILES },
+  { ENFILE, ERROR_TOO_MANY_OPEN_FILES },
+  { EACCES, ERROR_ACCESS_DENIED },
+  { EPERM, ERROR_ACCESS_DENIED },
+  { EISDIR, ERROR_ACCESS_DENIED },
+  { EBADF, ERROR_INVALID_HANDLE },
+  { ENOMEM, ERROR_NOT_ENOUGH_MEMORY },
+  { EROFS, ERROR_WRITE_PROTECT },
+  { ENOMEDIUM, ERROR_NOT_READY },
+  { EILSEQ, ERROR_CRC },
+  { ESPIPE, ERROR_SEEK },
+  { EIO, ERROR_IO_DEVICE },
+  { EBUSY, ERROR_BUSY },
+  { ENOTSUP, ERROR_NOT_SUPPORTED },
+  { EEXIST, ERROR_ALREADY_EXISTS },
+  { EINVAL, ERROR_INVALID_PARAMETER },
+  { EPIPE, ERROR_BROKEN_PIPE },
+  { ENOSPC, ERROR_DISK_FULL },
+  { EFBIG, ERROR_DISK_FULL },
+  { ENOTEMPTY, ERROR_DIR_NOT_EMPTY },
+  { ENAMETOOLONG, ERROR_FILENAME_EXCED_RANGE },
+  { ECANCELED, ERROR_OPERATION_ABORTED },
+  { ETIMEDOUT, ERROR_TIMEOUT },
+  { EADDRINUSE, WSAEADDRINUSE },
+  { EADDRNOTAVAIL, WSAEADDRNOTAVAIL },
+  { ENETDOWN, WSAENETDOWN },
+  { ENETUNREACH, WSAENETUNREACH },
+  { ECONNABORTED, WSAECONNABORTED },
+  { ECONNRESET, WSAECONNRESET },
+  { ENOBUFS, WSAENOBUFS },
+  { ENOTCONN, WSAENOTCONN },
+  { ECONNREFUSED, WSAECONNREFUSED },
+  { EHOSTUNREACH, WSAEHOSTUNREACH },
+};
+
+// messages of errors without errno equivalent
+static const struct {
+  DWORD error;
+  const char* message;
+} sErrorMessages[] = {
+  { ERROR_INVALID_FUNCTION, "Incorrect function." },
+  { ERROR_CRC, "Data error (cyclic redundancy check)." },
+  { ERROR_WRITE_FAULT, "The system cannot write to the specified device." },
+  { ERROR_READ_FAULT, "The system cannot read from the specified device." },
+  { ERROR_SHARING_VIOLATION, "The process cannot access the file because it is being used by another process." },
+  { ERROR_HANDLE_EOF, "Reached the end of the file." },
+  { ERROR_FILE_EXISTS, "The file exists." },
+  { ERROR_INSUFFICIENT_BUFFER, "The data area passed to a system call is too small." },
+  { ERROR_NEGATIVE_SEEK, "An attempt was made to move the file pointer before the beginning of the file." },
+  { ERROR_MORE_DATA, "More data is available." },
+  { WSAHOST_NOT_FOUND, "No such host is known." },
+};
+
+static void SetErrorFromErrno(int errnoValue)
+{
+  for (size_t i=0; i<_countof(sErrorMappings); i++) {
+    if (sErrorMappings[i].errnoValue == errnoValue) {
+      sLastError = sErrorMappings[i].error;
+      return;
+    }
+  }
+  sLastError = ERROR_INVALID_FUNCTION;
+}
+
+DWORD GetLastError()
+{
+  return sLastError;
+}
+
+void SetLastError(DWORD error)
+{
+  sLastError = error;
+}
+
+DWORD FormatMessage(DWORD flags, LPCVOID /* source */, DWORD messageId, DWORD /* languageId */, LPWSTR buffer,
+                    DWORD /* size */, va_list* /* arguments */)
+{
+  if (!(flags & FORMAT_MESSAGE_ALLOCATE_BUFFER) || !(flags & FORMAT_MESSAGE_FROM_SYSTEM)) {
+    sLastError = ERROR_INVALID_PARAMETER;
+    return 0;
+  }
+  const char* message = NULL;
+  for (size_t i=0; i<_countof(sErrorMessages) && !message; i++) {
+    if (sErrorMessages[i].error == messageId)
+      message = sErrorMessages[i].message;
+  }
+  for (size_t i=0; i<_countof(sErrorMappings) && !message; i++) {
+    if (sErrorMappings[i].error == messageId)
+      message = strerror(sErrorMappings[i].errnoValue);
+  }
+  if (!message) {
+    sLastError = ERROR_INVALID_PARAMETER;
+    return 0;
+  }
+  wstring text = Utf8ToWide(message) + L"\r\n";
+  wchar_t* result = (wchar_t*) malloc((text.length() + 1) * sizeof(wchar_t));
+  if (!result) {
+    sLastError = ERROR_NOT_ENOUGH_MEMORY;
+    return 0;
+  }
+  wcscpy(result, text.c_str());
+  *(wchar_t**) buffer = result;
+  return (DWORD) text.length();
+}
+
+HANDLE LocalFree(HANDLE mem)
+{
+  free(mem);
+  return NULL;
+}
+
+//---------------------------------------------------------------------------
+// kernel objects
+// All objects share one lock and one condition that is notified whenever an
+// object gets signaled. This keeps WaitForMultipleObjects() simple, the engine
+// waits for a few objects only.
+
+namespace {
+
+const DWORD kObjectMagic = 0x4f44494e;
+
+enum TObjectKind { kindFile, kindEvent, kindSemaphore, kindThread };
+
+struct TObject {
+  TObject(TObjectKind objectKind) : magic(kObjectMagic), kind(objectKind), refs(1) {
+  }
+  virtual ~TObject() {
+    magic = 0;
+  }
+  DWORD magic;
+  TObjectKind kind;
+  int refs;           // handle and running thread
+};
+
+struct TFile : public TObject {
+  TFile(int descriptor, bool blockDevice) : TObject(kindFile), fd(descriptor), isBlockDevice(blockDevice) {
+  }
+  int fd;
+  bool isBlockDevice;
+};
+
+struct TEvent : public TObject {
+  TEvent(bool manual, bool initial) : TObject(kindEvent), manualReset(manual), signaled(initial) {
+  }
+  bool manualReset;
+  bool signaled;
+};
+
+struct TSemaphore : public TObject {
+  TSemaphore(LONG initial, LONG maximum) : TObject(kindSemaphore), count(initial), maxCount(maximum) {
+  }
+  LONG count;
+  LONG maxCount;
+};
+
+struct TThread : public TObject {
+  TThread() : TObject(kindThread), started(false), closed(false), finished(false), exitCode(STILL_ACTIVE), id(0),
+    startAddress(NULL), arg(NULL) {
+  }
+  bool started;
+  bool closed;
+  bool finished;
+  DWORD exitCode;
+  DWORD id;
+  unsigned (*startAddress)(void*);
+  void* arg;
+};
+
+mutex sObjectLock;
+condition_variable sObjectSignaled;
+thread_local TThread* sCurrentThread = NULL;
+thread_local DWORD sCurrentThreadId = 0;
+DWORD sNextThreadId = 1;
+
+// the object of a handle or NULL, lock must be held
+TObject* GetObject(HANDLE h, TObjectKind kind)
+{
+  TObject* obj = (TObject*) h;
+  if (h == NULL || h == INVALID_HANDLE_VALUE || obj->magic != kObjectMagic || obj->kind != kind)
+    return NULL;
+  return obj;
+}
+
+TObject* GetAnyObject(HANDLE h)
+{
+  TObject* obj = (TObject*) h;
+  if (h == NULL || h == INVALID_HANDLE_VALUE || obj->magic != kObjectMagic)
+    return NULL;
+  return obj;
+}
+
+// lock must be held
+void ReleaseObject(TObject* obj)
+{
+  if (--obj->refs == 0)
+    delete obj;
+}
+
+// lock must be held
+bool IsSignaled(TObject* obj)
+{
+  switch (obj->kind) {
+    case kindEvent:
+      return static_cast<TEvent*>(obj)->signaled;
+    case kindSemaphore:
+      return static_cast<TSemaphore*>(obj)->count > 0;
+    case kindThread:
+      return static_cast<TThread*>(obj)->finished;
+    default:
+      return true;
+  }
+}
+
+// a wait for obj was satisfied, lock must be held
+void Acquire(TObject* obj)
+{
+  if (obj->kind == kindEvent && !static_cast<TEvent*>(obj)->manualReset)
+    static_cast<TEvent*>(obj)->signaled = false;
+  else if (obj->kind == kindSemaphore)
+    --static_cast<TSemaphore*>(obj)->count;
+}
+
+// mark the calling thread as finished, lock must not be held
+void FinishThread(TThread* thread, DWORD exitCode)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  thread->finished = true;
+  thread->exitCode = exitCode;
+  sCurrentThread = NULL;
+  ReleaseObject(thread);
+  sObjectSignaled.notify_all();
+}
+
+void* ThreadMain(void* param)
+{
+  TThread* thread = (TThread*) param;
+  {
+    unique_lock<mutex> lock(sObjectLock);
+    while (!thread->started && !thread->closed)
+      sObjectSignaled.wait(lock);
+    // a suspended thread can not be resumed after its handle is closed, it ends
+    // without running instead of waiting until the process exits
+    if (!thread->started) {
+      ReleaseObject(thread);
+      return NULL;
+    }
+    sCurrentThread = thread;
+    sCurrentThreadId = thread->id;
+  }
+  unsigned exitCode = thread->startAddress(thread->arg);
+  FinishThread(thread, exitCode);
+  return NULL;
+}
+
+// the calling thread stops without unwinding its stack like with TerminateThread()
+// on Windows, destructors of the objects on its stack do not run
+void StopCurrentThread(DWORD exitCode)
+{
+  FinishThread(sCurrentThread, exitCode);
+  for (;;)
+    pause();
+}
+
+}
+
+BOOL CloseHandle(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TObject* obj = GetAnyObject(h);
+  if (!obj) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  if (obj->kind == kindFile && close(static_cast<TFile*>(obj)->fd) != 0) {
+    SetErrorFromErrno(errno);
+    ReleaseObject(obj);
+    return FALSE;
+  }
+  if (obj->kind == kindThread) {
+    static_cast<TThread*>(obj)->closed = true;
+    sObjectSignaled.notify_all();
+  }
+  ReleaseObject(obj);
+  return TRUE;
+}
+
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds)
+{
+  unique_lock<mutex> lock(sObjectLock);
+  vector<TObject*> objects(count);
+  for (DWORD i=0; i<count; i++) {
+    objects[i] = GetAnyObject(handles[i]);
+    if (!objects[i]) {
+      sLastError = ERROR_INVALID_HANDLE;
+      return WAIT_FAILED;
+    }
+  }
+  chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(milliseconds);
+  for (;;) {
+    if (waitAll) {
+      bool all = true;
+      for (DWORD i=0; i<count && all; i++)
+        all = IsSignaled(objects[i]);
+      if (all) {
+        for (DWORD i=0; i<count; i++)
+          Acquire(objects[i]);
+        return WAIT_OBJECT_0;
+      }
+    } else {
+      for (DWORD i=0; i<count; i++) {
+        if (IsSignaled(objects[i])) {
+          Acquire(objects[i]);
+          return WAIT_OBJECT_0 + i;
+        }
+      }
+    }
+    if (milliseconds == INFINITE)
+      sObjectSignaled.wait(lock);
+    else if (sObjectSignaled.wait_until(lock, deadline) == cv_status::timeout)
+      return WAIT_TIMEOUT;
+  }
+}
+
+DWORD WaitForSingleObject(HANDLE h, DWORD milliseconds)
+{
+  return WaitForMultipleObjects(1, &h, TRUE, milliseconds);
+}
+
+HANDLE CreateEvent(LPSECURITY_ATTRIBUTES /* security */, BOOL manualReset, BOOL initialState, LPCWSTR name)
+{
+  if (name) {
+    sLastError = ERROR_NOT_SUPPORTED;
+    return NULL;
+  }
+  return new TEvent(manualReset != FALSE, initialState != FALSE);
+}
+
+BOOL SetEvent(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TEvent* event = static_cast<TEvent*>(GetObject(h, kindEvent));
+  if (!event) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  event->signaled = true;
+  sObjectSignaled.notify_all();
+  return TRUE;
+}
+
+BOOL ResetEvent(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TEvent* event = static_cast<TEvent*>(GetObject(h, kindEvent));
+  if (!event) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  event->signaled = false;
+  return TRUE;
+}
+
+HANDLE CreateSemaphore(LPSECURITY_ATTRIBUTES /* security */, LONG initialCount, LONG maximumCount, LPCWSTR name)
+{
+  if (name) {
+    sLastError = ERROR_NOT_SUPPORTED;
+    return NULL;
+  }
+  if (maximumCount <= 0 || initialCount < 0 || initialCount > maximumCount) {
+    sLastError = ERROR_INVALID_PARAMETER;
+    return NULL;
+  }
+  return new TSemaphore(initialCount, maximumCount);
+}
+
+BOOL ReleaseSemaphore(HANDLE h, LONG releaseCount, LONG* previousCount)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TSemaphore* semaphore = static_cast<TSemaphore*>(GetObject(h, kindSemaphore));
+  if (!semaphore) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  if (releaseCount <= 0 || semaphore->count > semaphore->maxCount - releaseCount) {
+    sLastError = ERROR_INVALID_PARAMETER;  // Windows: ERROR_TOO_MANY_POSTS
+    return FALSE;
+  }
+  if (previousCount)
+    *previousCount = semaphore->count;
+  semaphore->count += releaseCount;
+  sObjectSignaled.notify_all();
+  return TRUE;
+}
+
+//---------------------------------------------------------------------------
+// threads
+
+uintptr_t _beginthreadex(void* /* security */, unsigned stackSize, unsigned (*startAddress)(void*), void* arg,
+                         unsigned initFlag, unsigned* threadId)
+{
+  TThread* thread = new TThread();
+  thread->startAddress = startAddress;
+  thread->arg = arg;
+  thread->started = (initFlag & CREATE_SUSPENDED) == 0;
+  {
+    lock_guard<mutex> lock(sObjectLock);
+    thread->id = sNextThreadId++;
+    thread->refs = 2;  // released by CloseHandle() and by the thread when it ends
+  }
+
+  pthread_attr_t attr;
+  pthread_t tid;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  if (stackSize > 0)
+    pthread_attr_setstacksize(&attr, max((size_t) stackSize, (size_t) PTHREAD_STACK_MIN));
+  int res = pthread_create(&tid, &attr, ThreadMain, thread);
+  pthread_attr_destroy(&attr);
+  if (res != 0) {
+    delete thread;
+    SetErrorFromErrno(res);
+    errno = res;
+    return 0;
+  }
+  if (threadId)
+    *threadId = thread->id;
+  return (uintptr_t) thread;
+}
+
+void _endthreadex(unsigned exitCode)
+{
+  StopCurrentThread(exitCode);
+}
+
+DWORD ResumeThread(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TThread* thread = static_cast<TThread*>(GetObject(h, kindThread));
+  if (!thread) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return (DWORD) -1;
+  }
+  if (thread->started)
+    return 0;
+  thread->started = true;
+  sObjectSignaled.notify_all();
+  return 1;
+}
+
+DWORD SuspendThread(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TThread* thread = static_cast<TThread*>(GetObject(h, kindThread));
+  sLastError = thread ? ERROR_NOT_SUPPORTED : ERROR_INVALID_HANDLE;
+  return (DWORD) -1;
+}
+
+BOOL TerminateThread(HANDLE h, DWORD exitCode)
+{
+  {
+    lock_guard<mutex> lock(sObjectLock);
+    TThread* thread = static_cast<TThread*>(GetObject(h, kindThread));
+    if (!thread) {
+      sLastError = ERROR_INVALID_HANDLE;
+      return FALSE;
+    }
+    if (thread != sCurrentThread) {
+      sLastError = ERROR_NOT_SUPPORTED;
+      return FALSE;
+    }
+  }
+  StopCurrentThread(exitCode);
+  return TRUE;
+}
+
+BOOL GetExitCodeThread(HANDLE h, LPDWORD exitCode)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TThread* thread = static_cast<TThread*>(GetObject(h, kindThread));
+  if (!thread) {
+    sLastError = ERROR_INVALID_HANDLE;
+    return FALSE;
+  }
+  *exitCode = thread->exitCode;
+  return TRUE;
+}
+
+DWORD GetCurrentThreadId()
+{
+  if (sCurrentThreadId == 0) {
+    lock_guard<mutex> lock(sObjectLock);
+    sCurrentThreadId = sNextThreadId++;
+  }
+  return sCurrentThreadId;
+}
+
+int GetThreadPriority(HANDLE /* h */)
+{
+  return THREAD_PRIORITY_NORMAL;
+}
+
+HANDLE GetCurrentThread()
+{
+  return (HANDLE) (intptr_t) -2;
+}
+
+BOOL SetThreadPriority(HANDLE h, int priority)
+{
+  if (priority == THREAD_MODE_BACKGROUND_BEGIN || priority == THREAD_MODE_BACKGROUND_END) {
+    // background mode lowers the I/O priority of the calling thread: idle class of the
+    // I/O scheduler or the class taken from the nice value of the process
+    if (h != GetCurrentThread()) {
+      sLastError = ERROR_INVALID_PARAMETER;
+      return FALSE;
+    }
+#ifdef __linux__
+    const int ioprioWhoProcess = 1, ioprioClassShift = 13, ioprioClassIdle = 3;
+    int ioprio = priority == THREAD_MODE_BACKGROUND_BEGIN ? ioprioClassIdle << ioprioClassShift : 0;
+    // a thread id of 0 is the calling thread
+    if (syscall(SYS_ioprio_set, ioprioWhoProcess, 0, ioprio) != 0) {
+      SetErrorFromErrno(errno);
+      return FALSE;
+    }
+    return TRUE;
+#else
+    sLastError = ERROR_NOT_SUPPORTED;
+    return FALSE;
+#endif
+  }
+  // priorities of threads need privileges on Linux, the scheduler is fair enough
+  lock_guard<mutex> lock(sObjectLock);
+  return GetObject(h, kindThread) != NULL;
+}
+
+BOOL GetThreadTimes(HANDLE /* h */, LPFILETIME /* creationTime */, LPFILETIME /* exitTime */,
+                    LPFILETIME /* kernelTime */, LPFILETIME /* userTime */)
+{
+  sLastError = ERROR_NOT_SUPPORTED;
+  return FALSE;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO info)
+{
+  long processors = sysconf(_SC_NPROCESSORS_ONLN);
+  info->dwNumberOfProcessors = processors > 0 ? (DWORD) processors : 1;
+  info->dwPageSize = (DWORD) sysconf(_SC_PAGESIZE);
+}
+
+//---------------------------------------------------------------------------
+// timers
+
+void Sleep(DWORD milliseconds)
+{
+  struct timespec ts;
+  ts.tv_sec = milliseconds / 1000;
+  ts.tv_nsec = (long) (milliseconds % 1000) * 1000000L;
+  while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+    ;
+}
+
+ULONGLONG GetTickCount64()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ULONGLONG) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+DWORD GetTickCount()
+{
+  return (DWORD) GetTickCount64();
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  counter->QuadPart = (LONGLONG) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency)
+{
+  frequency->QuadPart = 1000000000LL;
+  return TRUE;
+}
+
+//---------------------------------------------------------------------------
+// strings
+
+string WideToUtf8(LPCWSTR s)
+{
+  string result;
+  if (!s)
+    return result;
+  for (; *s; s++) {
+    unsigned c = (unsigned) *s;
+    if (c < 0x80) {
+      result += (char) c;
+    } else if (c < 0x800) {
+      result += (char) (0xc0 | (c >> 6));
+      result += (char) (0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+      result += (char) (0xe0 | (c >> 12));
+      result += (char) (0x80 | ((c >> 6) & 0x3f));
+      result += (char) (0x80 | (c & 0x3f));
+    } else {
+      result += (char) (0xf0 | (c >> 18));
+      result += (char) (0x80 | ((c >> 12) & 0x3f));
+      result += (char) (0x80 | ((c >> 6) & 0x3f));
+      result += (char) (0x80 | (c & 0x3f));
+    }
+  }
+  return result;
+}
+
+wstring Utf8ToWide(LPCSTR s)
+{
+  wstring result;
+  if (!s)
+    return result;
+  const unsigned char* p = (const unsigned char*) s;
+  while (*p) {
+    unsigned c = *p++;
+    int follow = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if (follow > 0)
+      c &= 0x3f >> follow;
+    for (; follow > 0 && (*p & 0xc0) == 0x80; follow--)
+      c = (c << 6) | (*p++ & 0x3f);
+    result += (wchar_t) c;
+  }
+  return result;
+}
+
+string WideToPath(LPCWSTR fileName)
+{
+  string path = WideToUtf8(fileName);
+  replace(path.begin(), path.end(), '\\', '/');
+  return path;
+}
+
+static int FormatNumber(unsigned long long value, bool negative, wchar_t* buffer, size_t size, int radix)
+{
+  wchar_t digits[72];
+  size_t len = 0;
+  if (radix < 2 || radix > 36 || !buffer || size == 0)
+    return EINVAL;
+  do {
+    unsigned d = (unsigned) (value % radix);
+    digits[len++] = (wchar_t) (d < 10 ? L'0' + d : L'a' + d - 10);
+    value /= radix;
+  } while (value > 0);
+  if (negative)
+    digits[len++] = L'-';
+  if (len + 1 > size) {
+    buffer[0] = L'\0';
+    return ERANGE;
+  }
+  for (size_t i=0; i<len; i++)
+    buffer[i] = digits[len - 1 - i];
+  buffer[len] = L'\0';
+  return 0;
+}
+
+int _itow_s(int value, wchar_t* buffer, size_t size, int radix)
+{
+  bool negative = value < 0 && radix == 10;
+  unsigned long long magnitude = negative ? 0ULL - (long long) value : (unsigned) value;
+  return FormatNumber(magnitude, negative, buffer, size, radix);
+}
+
+int _ui64tow_s(unsigned long long value, wchar_t* buffer, size_t size, int radix)
+{
+  return FormatNumber(value, false, buffer, size, radix);
+}
+
+#ifdef _DEBUG
+void AtlTrace(const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+}
+#endif
+
+//---------------------------------------------------------------------------
+// files
+
+static TFile* GetFile(HANDLE h)
+{
+  lock_guard<mutex> lock(sObjectLock);
+  TFile* file = static_cast<TFile*>(GetObject(h, kindFile));
+  if (!file)
+    sLastError = ERROR_INVALID_HANDLE;
+  return file;
+}
+
+int GetFileDescriptor(HANDLE h)
+{
+  TFile* file = GetFile(h);
+  return file ? file->fd : -1;
+}
+
+HANDLE GetStdHandle(DWORD stdHandle)
+{
+  // created once and never released, like on Windows the handles stay valid
+  static TFile* sStdFiles[3] = { new TFile(0, false), new TFile(1, false), new TFile(2, false) };
+  switch (stdHandle) {
+    case STD_INPUT_HANDLE:
+      return sStdFiles[0];
+    case STD_OUTPUT_HANDLE:
+      return sStdFiles[1];
+    case STD_ERROR_HANDLE:
+      return sStdFiles[2];
+    default:
+      sLastError = ERROR_INVALID_PARAMETER;
+      return INVALID_HANDLE_VALUE;
+  }
+}
+
+HANDLE CreateFile(LPCWSTR fileName, DWORD access, DWORD shareMode, LPSECURITY_ATTRIBUTES /* security */,
+                  DWORD creationDisposition, DWORD flags, HANDLE /* templateFile */)
+{
+  int openFlags = O_CLOEXEC;
+  if ((access & GENERIC_READ) && (access & GENERIC_WRITE))
+    openFlags |= O_RDWR;
+  else if (access & GENERIC_WRITE)
+    openFlags |= O_WRONLY;
+  else
+    openFlags |= O_RDONLY;
+  switch (creationDisposition) {
+    case CREATE_NEW:
+      openFlags |= O_CREAT | O_EXCL;
+      break;
+    case CREATE_ALWAYS:
+      openFlags |= O_CREAT | O_TRUNC;
+      break;
+    case OPEN_EXISTING:
+      break;
+    case OPEN_ALWAYS:
+      openFlags |= O_CREAT;
+      break;
+    case TRUNCATE_EXISTING:
+      openFlags |= O_TRUNC;
+      break;
+    default:
+      sLastError = ERROR_INVALID_PARAMETER;
+      return INVALID_HANDLE_VALUE;
+  }
+  if (flags & FILE_FLAG_WRITE_THROUGH)
+    openFlags |= O_DSYNC;
+#ifdef O_DIRECT
+  if (flags & FILE_FLAG_NO_BUFFERING)
+    openFlags |= O_DIRECT;
+#endif
+
+  string path = WideToPath(fileName);
+  struct stat st;
+  if (shareMode == 0 && stat(path.c_str(), &st) == 0 && S_ISBLK(st.st_mode))
+    openFlags |= O_EXCL;
+  int fd = open(path.c_str(), openFlags, 0666);
+  if (fd < 0) {
+    SetErrorFromErrno(errno);
+    return INVALID_HANDLE_VALUE;
+  }
+  if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+    // like Windows, directories can not be opened as files
+    close(fd);
+    sLastError = ERROR_ACCESS_DENIED;
+    return INVALID_HANDLE_VALUE;
+  }
+  if (flags & FILE_FLAG_SEQUENTIAL_SCAN)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  if (flags & FILE_FLAG_DELETE_ON_CLOSE)
+    unlink(path.c_str());
+  return new TFile(fd, S_ISBLK(st.st_mode));
+}
+
+static off_t GetOverlappedOffset(LPOVERLAPPED overlapped)
+{
+  return (off_t) (((ULONGLONG) overlapped->OffsetHigh << 32) | overlapped->Offset);
+}
+
+BOOL ReadFile(HANDLE h, LPVOID buffer, DWORD bytesToRead, LPDWORD bytesRead, LPOVERLAPPED overlapped)
+{
+  TFile* file = GetFile(h);
+  if (bytesRead)
+    *bytesRead = 0;
+  if (!file)
+    return FALSE;
+  // a read only returns less than requested at the end of the file
+  DWORD total = 0;
+  while (total < bytesToRead) {
+    ssize_t n = overlapped ? pread(file->fd, (BYTE*) buffer + total, bytesToRead - total, GetOverlappedOffset(overlapped) + total)
+                           : read(file->fd, (BYTE*) buffer + total, bytesToRead - total);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      SetErrorFromErrno(errno);
+      if (bytesRead)
+        *bytesRead = total;
+      return FALSE;
+    }
+    if (n == 0)
+      break;
+    total += (DWORD) n;
+  }
+  if (bytesRead)
+    *bytesRead = total;
+  return TRUE;
+}
+
+BOOL WriteFile(HANDLE h, LPCVOID buffer, DWORD bytesToWrite, LPDWORD bytesWritten, LPOVERLAPPED overlapped)
+{
+  TFile* file = GetFile(h);
+  if (bytesWritten)
+    *bytesWritten = 0;
+  if (!file)
+    return FALSE;
+  DWORD total = 0;
+  while (total < bytesToWrite) {
+    ssize_t n = overlapped ? pwrite(file->fd, (const BYTE*) buffer + total, bytesToWrite - total,
+                                    GetOverlappedOffset(overlapped) + total)
+                           : write(file->fd, (const BYTE*) buffer + total, bytesToWrite - total);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      SetErrorFromErrno(errno);
+      if (bytesWritten)
+        *bytesWritten = total;
+      return FALSE;
+    }
+    total += (DWORD) n;
+  }
+  if (bytesWritten)
+    *bytesWritten = total;
+  return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE h, LARGE_INTEGER distance, PLARGE_INTEGER newPosition, DWORD moveMethod)
+{
+  TFile* file = GetFile(h);
+  if (!file)
+    return FALSE;
+  int whence = moveMethod == FILE_BEGIN ? SEEK_SET : moveMethod == FILE_CURRENT ? SEEK_CUR : SEEK_END;
+  off_t pos = lseek(file->fd, (off_t) distance.QuadPart, whence);
+  if (pos < 0) {
+    if (errno == EINVAL)
+      sLastError = ERROR_NEGATIVE_SEEK;
+    else
+      SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  if (newPosition)
+    newPosition->QuadPart = pos;
+  return TRUE;
+}
+
+DWORD SetFilePointer(HANDLE h, LONG distance, LONG* distanceHigh, DWORD moveMethod)
+{
+  LARGE_INTEGER move, pos;
+  move.QuadPart = distanceHigh ? ((LONGLONG) *distanceHigh << 32) | (DWORD) distance : distance;
+  if (!SetFilePointerEx(h, move, &pos, moveMethod))
+    return INVALID_SET_FILE_POINTER;
+  if (distanceHigh)
+    *distanceHigh = pos.HighPart;
+  return pos.LowPart;
+}
+
+BOOL GetFileSizeEx(HANDLE h, PLARGE_INTEGER size)
+{
+  TFile* file = GetFile(h);
+  if (!file)
+    return FALSE;
+#ifdef BLKGETSIZE64
+  if (file->isBlockDevice) {
+    uint64_t bytes = 0;
+    if (ioctl(file->fd, BLKGETSIZE64, &bytes) != 0) {
+      SetErrorFromErrno(errno);
+      return FALSE;
+    }
+    size->QuadPart = (LONGLONG) bytes;
+    return TRUE;
+  }
+#endif
+  struct stat st;
+  if (fstat(file->fd, &st) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  size->QuadPart = st.st_size;
+  return TRUE;
+}
+
+DWORD GetFileSize(HANDLE h, LPDWORD sizeHigh)
+{
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(h, &size))
+    return INVALID_FILE_SIZE;
+  if (sizeHigh)
+    *sizeHigh = (DWORD) size.HighPart;
+  return size.LowPart;
+}
+
+BOOL SetEndOfFile(HANDLE h)
+{
+  TFile* file = GetFile(h);
+  if (!file)
+    return FALSE;
+  off_t pos = lseek(file->fd, 0, SEEK_CUR);
+  if (pos < 0 || ftruncate(file->fd, pos) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE h)
+{
+  TFile* file = GetFile(h);
+  if (!file)
+    return FALSE;
+  if (fsync(file->fd) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL DeleteFile(LPCWSTR fileName)
+{
+  if (unlink(WideToPath(fileName).c_str()) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL MoveFile(LPCWSTR existingFileName, LPCWSTR newFileName)
+{
+  // like on Windows an existing target is not replaced
+  string target = WideToPath(newFileName);
+  struct stat st;
+  if (lstat(target.c_str(), &st) == 0) {
+    sLastError = ERROR_ALREADY_EXISTS;
+    return FALSE;
+  }
+  if (rename(WideToPath(existingFileName).c_str(), target.c_str()) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL CreateDirectory(LPCWSTR pathName, LPSECURITY_ATTRIBUTES /* security */)
+{
+  if (mkdir(WideToPath(pathName).c_str(), 0777) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+BOOL RemoveDirectory(LPCWSTR pathName)
+{
+  if (rmdir(WideToPath(pathName).c_str()) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+DWORD GetFileAttributes(LPCWSTR fileName)
+{
+  string path = WideToPath(fileName);
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) {
+    SetErrorFromErrno(errno);
+    return INVALID_FILE_ATTRIBUTES;
+  }
+  DWORD attributes = S_ISDIR(st.st_mode) ? FILE_ATTRIBUTE_DIRECTORY : FILE_ATTRIBUTE_NORMAL;
+  if (access(path.c_str(), W_OK) != 0)
+    attributes |= FILE_ATTRIBUTE_READONLY;
+  return attributes;
+}
+
+DWORD GetFullPathName(LPCWSTR fileName, DWORD bufferLength, LPWSTR buffer, LPWSTR* filePart)
+{
+  // like on Windows the file does not need to exist, "." and ".." are resolved
+  // without following symbolic links
+  string path = WideToPath(fileName);
+  if (path.empty() || path[0] != '/') {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+      SetErrorFromErrno(errno);
+      return 0;
+    }
+    path = string(cwd) + "/" + path;
+  }
+  vector<string> parts;
+  size_t start = 0;
+  while (start <= path.length()) {
+    size_t end = path.find('/', start);
+    if (end == string::npos)
+      end = path.length();
+    string part = path.substr(start, end - start);
+    if (part == "..") {
+      if (!parts.empty())
+        parts.pop_back();
+    } else if (!part.empty() && part != ".") {
+      parts.push_back(part);
+    }
+    start = end + 1;
+  }
+  string fullPath;
+  for (size_t i=0; i<parts.size(); i++)
+    fullPath += "/" + parts[i];
+  if (fullPath.empty())
+    fullPath = "/";
+
+  wstring result = Utf8ToWide(fullPath.c_str());
+  if (result.length() + 1 > bufferLength)
+    return (DWORD) result.length() + 1;
+  wcscpy(buffer, result.c_str());
+  if (filePart) {
+    size_t pos = result.rfind(L'/');
+    *filePart = parts.empty() ? NULL : buffer + pos + 1;
+  }
+  return (DWORD) result.length();
+}
+
+BOOL GetDiskFreeSpaceEx(LPCWSTR directoryName, PULARGE_INTEGER freeBytesAvailable, PULARGE_INTEGER totalNumberOfBytes,
+                        PULARGE_INTEGER totalNumberOfFreeBytes)
+{
+  struct statvfs st;
+  if (statvfs(directoryName ? WideToPath(directoryName).c_str() : ".", &st) != 0) {
+    SetErrorFromErrno(errno);
+    return FALSE;
+  }
+  if (freeBytesAvailable)
+    freeBytesAvailable->QuadPart = (ULONGLONG) st.f_bavail * st.f_frsize;
+  if (totalNumberOfBytes)
+    totalNumberOfBytes->QuadPart = (ULONGLONG) st.f_blocks * st.f_frsize;
+  if (totalNumberOfFreeBytes)
+    totalNumberOfFreeBytes->QuadPart = (ULONGLONG) st.f_bfree * st.f_frsize;
+  return TRUE;
+}
+
+DWORD GetTempPath(DWORD bufferLength, LPWSTR buffer)
+{
+  const char* dir = getenv("TMPDIR");
+  wstring result = Utf8ToWide(dir && *dir ? dir : "/tmp");
+  if (result[result.length()-1] != L'/')
+    result += L'/';
+  if (result.length() + 1 > bufferLength)
+    return (DWORD) result.length() + 1;
+  wcscpy(buffer, result.c_str());
+  return (DWORD) result.length();
+}
+
+UINT GetTempFileName(LPCWSTR pathName, LPCWSTR prefix, UINT unique, LPWSTR tempFileName)
+{
+  if (unique != 0) {
+    sLastError = ERROR_NOT_SUPPORTED;
+    return 0;
+  }
+  string path = WideToPath(pathName);
+  if (!path.empty() && path[path.length()-1] != '/')
+    path += '/';
+  path += WideToUtf8(prefix).substr(0, 3) + "XXXXXX";
+  vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  int fd = mkstemp(&name[0]);
+  if (fd < 0) {
+    SetErrorFromErrno(errno);
+    return 0;
+  }
+  close(fd);
+  wcsncpy(tempFileName, Utf8ToWide(&name[0]).c_str(), MAX_PATH);
+  tempFileName[MAX_PATH-1] = L'\0';
+  return 1;
+}
+
+FILE* _wfopen(LPCWSTR fileName, LPCWSTR mode)
+{
+  return fopen(WideToPath(fileName).c_str(), WideToUtf8(mode).c_str());
+}
+
+//---------------------------------------------------------------------------
+// sockets
+
+int WSAStartup(WORD versionRequested, LPWSADATA data)
+{
+  // a connection closed by the peer is reported by send() and not by a signal
+  signal(SIGPIPE, SIG_IGN);
+  if (data) {
+    data->wVersion = versionRequested;
+    data->wHighVersion = MAKEWORD(2, 2);
+  }
+  return 0;
+}
+
+int WSACleanup()
+{
+  return 0;
+}
+
+int WSAGetLastError()
+{
+  SetErrorFromErrno(errno);
+  return (int) sLastError;
+}
+
+int closesocket(SOCKET s)
+{
+  return close(s);
+}
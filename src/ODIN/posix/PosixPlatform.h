@@ -0,0 +1,548 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __POSIXPLATFORM_H__
+#define __POSIXPLATFORM_H__
+
+//---------------------------------------------------------------------------
+// Platform layer of the engine on POSIX systems
+// The engine is written against a small subset of the Win32 API: kernel objects
+// (threads, events, semaphores) waited for with WaitForSingleObject(), files
+// accessed by HANDLE, timers and GetLastError(). This subset is the interface
+// between the engine and the operating system. On Windows it is provided by the
+// system, here it is implemented with pthreads and file descriptors, so the
+// engine sources compile unchanged. Paths are passed as wide strings like on
+// Windows and converted to UTF-8, backslashes are taken as path separators.
+// Only what the engine uses is implemented, drive and volume functions are not.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <memory>
+#include <string>
+#include <algorithm>
+#include <type_traits>
+
+//---------------------------------------------------------------------------
+// types
+
+#define __int64 long long
+#define __stdcall
+#define __cdecl
+#define WINAPI
+#define CALLBACK
+
+typedef int BOOL;
+typedef uint8_t BYTE;
+typedef uint8_t UCHAR;
+typedef uint16_t WORD;
+typedef uint16_t USHORT;
+typedef uint32_t DWORD;
+typedef uint32_t UINT;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef uint64_t DWORD64;
+typedef uintptr_t ULONG_PTR;
+typedef uintptr_t DWORD_PTR;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t SIZE_T;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef wchar_t TCHAR;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef void* HANDLE;
+typedef void* HMODULE;
+typedef HANDLE* PHANDLE;
+typedef DWORD* LPDWORD;
+typedef LONG* LPLONG;
+typedef BYTE* LPBYTE;
+typedef char* LPSTR;
+typedef const char* LPCSTR;
+typedef wchar_t* LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef wchar_t* LPTSTR;
+typedef const wchar_t* LPCTSTR;
+typedef int32_t HRESULT;
+typedef void* LPSECURITY_ATTRIBUTES;
+
+typedef union {
+  struct {
+    DWORD LowPart;
+    LONG HighPart;
+  };
+  LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef union {
+  struct {
+    DWORD LowPart;
+    DWORD HighPart;
+  };
+  ULONGLONG QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+// only the offset is used, I/O is always synchronous
+typedef struct {
+  ULONG_PTR Internal;
+  ULONG_PTR InternalHigh;
+  DWORD Offset;
+  DWORD OffsetHigh;
+  HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+typedef struct {
+  DWORD dwLowDateTime;
+  DWORD dwHighDateTime;
+} FILETIME, *LPFILETIME;
+
+typedef struct {
+  DWORD Data1;
+  WORD Data2;
+  WORD Data3;
+  BYTE Data4[8];
+} GUID;
+
+inline bool operator==(const GUID& a, const GUID& b) {
+  return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+inline bool operator!=(const GUID& a, const GUID& b) {
+  return !(a == b);
+}
+
+typedef struct {
+  DWORD dwNumberOfProcessors;
+  DWORD dwPageSize;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+#define TRUE 1
+#define FALSE 0
+#define _T(x) L ## x
+#define TEXT(x) L ## x
+#define MAX_PATH 4096
+#define MAXLONG 0x7fffffff
+#define MAXDWORD 0xffffffff
+#define INFINITE 0xffffffff
+#define S_OK ((HRESULT) 0)
+#define E_FAIL ((HRESULT) 0x80004005)
+#define _countof(a) (sizeof(a) / sizeof((a)[0]))
+#define ZeroMemory(p, len) memset((p), 0, (len))
+#define CopyMemory(dst, src, len) memcpy((dst), (src), (len))
+#define MAKELANGID(p, s) ((((WORD) (s)) << 10) | (WORD) (p))
+#define LANG_NEUTRAL 0x00
+#define SUBLANG_DEFAULT 0x01
+#define IDOK 1
+#define IDCANCEL 2
+
+// Windows defines min and max as macros that accept operands of different types
+template<class A, class B> inline typename std::common_type<A, B>::type min(A a, B b) {
+  return b < a ? b : a;
+}
+template<class A, class B> inline typename std::common_type<A, B>::type max(A a, B b) {
+  return a < b ? b : a;
+}
+
+//---------------------------------------------------------------------------
+// error codes returned by GetLastError(), errno values are mapped to them
+
+#define ERROR_SUCCESS 0
+#define NO_ERROR 0
+#define ERROR_INVALID_FUNCTION 1
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_PATH_NOT_FOUND 3
+#define ERROR_TOO_MANY_OPEN_FILES 4
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_INVALID_HANDLE 6
+#define ERROR_NOT_ENOUGH_MEMORY 8
+#define ERROR_OUTOFMEMORY 14
+#define ERROR_WRITE_PROTECT 19
+#define ERROR_NOT_READY 21
+#define ERROR_CRC 23
+#define ERROR_SEEK 25
+#define ERROR_WRITE_FAULT 29
+#define ERROR_READ_FAULT 30
+#define ERROR_SHARING_VIOLATION 32
+#define ERROR_LOCK_VIOLATION 33
+#define ERROR_HANDLE_EOF 38
+#define ERROR_HANDLE_DISK_FULL 39
+#define ERROR_NOT_SUPPORTED 50
+#define ERROR_FILE_EXISTS 80
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_BROKEN_PIPE 109
+#define ERROR_DISK_FULL 112
+#define ERROR_INSUFFICIENT_BUFFER 122
+#define ERROR_NEGATIVE_SEEK 131
+#define ERROR_DIR_NOT_EMPTY 145
+#define ERROR_BUSY 170
+#define ERROR_ALREADY_EXISTS 183
+#define ERROR_FILENAME_EXCED_RANGE 206
+#define ERROR_MORE_DATA 234
+#define ERROR_DIRECTORY 267
+#define ERROR_OPERATION_ABORTED 995
+#define ERROR_IO_DEVICE 1117
+#define ERROR_TIMEOUT 1460
+
+DWORD GetLastError();
+void SetLastError(DWORD error);
+
+#define FORMAT_MESSAGE_ALLOCATE_BUFFER 0x00000100
+#define FORMAT_MESSAGE_IGNORE_INSERTS 0x00000200
+#define FORMAT_MESSAGE_FROM_HMODULE 0x00000800
+#define FORMAT_MESSAGE_FROM_SYSTEM 0x00001000
+
+// only FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM is supported,
+// the message ends with "\r\n" like on Windows, free buffer with LocalFree()
+DWORD FormatMessage(DWORD flags, LPCVOID source, DWORD messageId, DWORD languageId, LPWSTR buffer,
+                    DWORD size, va_list* arguments);
+HANDLE LocalFree(HANDLE mem);
+
+//---------------------------------------------------------------------------
+// kernel objects, all of them are closed with CloseHandle()
+
+#define INVALID_HANDLE_VALUE ((HANDLE) (intptr_t) -1)
+#define WAIT_OBJECT_0 0
+#define WAIT_ABANDONED 0x80
+#define WAIT_ABANDONED_0 0x80
+#define WAIT_TIMEOUT 258
+#define WAIT_FAILED 0xffffffff
+#define MAXIMUM_WAIT_OBJECTS 64
+
+BOOL CloseHandle(HANDLE h);
+DWORD WaitForSingleObject(HANDLE h, DWORD milliseconds);
+DWORD WaitForMultipleObjects(DWORD count, const HANDLE* handles, BOOL waitAll, DWORD milliseconds);
+
+HANDLE CreateEvent(LPSECURITY_ATTRIBUTES security, BOOL manualReset, BOOL initialState, LPCWSTR name);
+BOOL SetEvent(HANDLE h);
+BOOL ResetEvent(HANDLE h);
+
+HANDLE CreateSemaphore(LPSECURITY_ATTRIBUTES security, LONG initialCount, LONG maximumCount, LPCWSTR name);
+BOOL ReleaseSemaphore(HANDLE h, LONG releaseCount, LONG* previousCount);
+
+//---------------------------------------------------------------------------
+// threads
+// A thread created with CREATE_SUSPENDED starts when ResumeThread() is called
+// the first time, SuspendThread() of a running thread is not supported.
+// TerminateThread() only ends the calling thread: like on Windows its stack is
+// not unwound, the thread stops for good and its handle gets signaled.
+
+#define CREATE_SUSPENDED 0x00000004
+#define STILL_ACTIVE 259
+#define THREAD_PRIORITY_LOWEST -2
+#define THREAD_PRIORITY_BELOW_NORMAL -1
+#define THREAD_PRIORITY_NORMAL 0
+#define THREAD_PRIORITY_ABOVE_NORMAL 1
+#define THREAD_PRIORITY_HIGHEST 2
+#define THREAD_PRIORITY_ERROR_RETURN MAXLONG
+#define THREAD_MODE_BACKGROUND_BEGIN 0x00010000
+#define THREAD_MODE_BACKGROUND_END 0x00020000
+
+uintptr_t _beginthreadex(void* security, unsigned stackSize, unsigned (*startAddress)(void*), void* arg,
+                         unsigned initFlag, unsigned* threadId);
+void _endthreadex(unsigned exitCode);
+DWORD ResumeThread(HANDLE h);
+DWORD SuspendThread(HANDLE h);
+BOOL TerminateThread(HANDLE h, DWORD exitCode);
+BOOL GetExitCodeThread(HANDLE h, LPDWORD exitCode);
+DWORD GetCurrentThreadId();
+// pseudo handle of the calling thread, only for SetThreadPriority()
+HANDLE GetCurrentThread();
+int GetThreadPriority(HANDLE h);
+BOOL SetThreadPriority(HANDLE h, int priority);
+BOOL GetThreadTimes(HANDLE h, LPFILETIME creationTime, LPFILETIME exitTime, LPFILETIME kernelTime,
+                    LPFILETIME userTime);
+void GetSystemInfo(LPSYSTEM_INFO info);
+
+inline LONG InterlockedIncrement(volatile LONG* value) {
+  return __atomic_add_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+inline LONG InterlockedDecrement(volatile LONG* value) {
+  return __atomic_sub_fetch(value, 1, __ATOMIC_SEQ_CST);
+}
+inline LONG InterlockedExchange(volatile LONG* target, LONG value) {
+  return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+//---------------------------------------------------------------------------
+// timers
+
+void Sleep(DWORD milliseconds);
+DWORD GetTickCount();
+ULONGLONG GetTickCount64();
+BOOL QueryPerformanceCounter(LARGE_INTEGER* counter);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* frequency);
+
+//---------------------------------------------------------------------------
+// files
+// Regular files and block devices are opened by path. GetFileSizeEx() of a block
+// device returns the size of the device. A block device opened without sharing
+// is opened exclusively, this fails if it is mounted. Other share modes and the
+// attributes are ignored. FILE_FLAG_DELETE_ON_CLOSE removes the name of the file
+// once it is open. FILE_FLAG_NO_BUFFERING opens with O_DIRECT, buffers,
+// offsets and lengths must then be aligned to the logical block size. ReadFile()
+// and WriteFile() with an OVERLAPPED structure read and write at its offset and
+// leave the file pointer unchanged like on Windows for synchronous handles.
+
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define SYNCHRONIZE 0x00100000
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_READONLY 0x00000001
+#define FILE_ATTRIBUTE_DIRECTORY 0x00000010
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_ATTRIBUTE_TEMPORARY 0x00000100
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_NO_BUFFERING 0x20000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000
+#define INVALID_FILE_ATTRIBUTES ((DWORD) -1)
+#define INVALID_FILE_SIZE ((DWORD) 0xffffffff)
+#define INVALID_SET_FILE_POINTER ((DWORD) -1)
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+
+HANDLE CreateFile(LPCWSTR fileName, DWORD access, DWORD shareMode, LPSECURITY_ATTRIBUTES security,
+                  DWORD creationDisposition, DWORD flags, HANDLE templateFile);
+BOOL ReadFile(HANDLE h, LPVOID buffer, DWORD bytesToRead, LPDWORD bytesRead, LPOVERLAPPED overlapped);
+BOOL WriteFile(HANDLE h, LPCVOID buffer, DWORD bytesToWrite, LPDWORD bytesWritten, LPOVERLAPPED overlapped);
+BOOL SetFilePointerEx(HANDLE h, LARGE_INTEGER distance, PLARGE_INTEGER newPosition, DWORD moveMethod);
+DWORD SetFilePointer(HANDLE h, LONG distance, LONG* distanceHigh, DWORD moveMethod);
+BOOL GetFileSizeEx(HANDLE h, PLARGE_INTEGER size);
+DWORD GetFileSize(HANDLE h, LPDWORD sizeHigh);
+BOOL SetEndOfFile(HANDLE h);
+BOOL FlushFileBuffers(HANDLE h);
+BOOL DeleteFile(LPCWSTR fileName);
+BOOL MoveFile(LPCWSTR existingFileName, LPCWSTR newFileName);
+BOOL CreateDirectory(LPCWSTR pathName, LPSECURITY_ATTRIBUTES security);
+BOOL RemoveDirectory(LPCWSTR pathName);
+DWORD GetFileAttributes(LPCWSTR fileName);
+DWORD GetFullPathName(LPCWSTR fileName, DWORD bufferLength, LPWSTR buffer, LPWSTR* filePart);
+BOOL GetDiskFreeSpaceEx(LPCWSTR directoryName, PULARGE_INTEGER freeBytesAvailable, PULARGE_INTEGER totalNumberOfBytes,
+                        PULARGE_INTEGER totalNumberOfFreeBytes);
+// directory of TMPDIR or /tmp with a trailing separator
+DWORD GetTempPath(DWORD bufferLength, LPWSTR buffer);
+// creates an empty file with a unique name in pathName, unique must be 0
+UINT GetTempFileName(LPCWSTR pathName, LPCWSTR prefix, UINT unique, LPWSTR tempFileName);
+FILE* _wfopen(LPCWSTR fileName, LPCWSTR mode);
+
+// file descriptor of a file handle or -1
+int GetFileDescriptor(HANDLE h);
+
+// standard input, output and error, the handles must not be closed
+#define STD_INPUT_HANDLE ((DWORD) -10)
+#define STD_OUTPUT_HANDLE ((DWORD) -11)
+#define STD_ERROR_HANDLE ((DWORD) -12)
+
+HANDLE GetStdHandle(DWORD stdHandle);
+
+// conversion of paths and strings between wide strings and UTF-8
+std::string WideToUtf8(LPCWSTR s);
+std::wstring Utf8ToWide(LPCSTR s);
+std::string WideToPath(LPCWSTR fileName);
+
+//---------------------------------------------------------------------------
+// C runtime functions of Microsoft used by the engine
+
+#define _wcsicmp wcscasecmp
+#define _wcsnicmp wcsncasecmp
+#define _stricmp strcasecmp
+#define _strnicmp strncasecmp
+#define _wtoi(s) ((int) wcstol((s), NULL, 10))
+#define _wtoi64(s) wcstoll((s), NULL, 10)
+#define _wtof(s) wcstod((s), NULL)
+#define _wcstoui64 wcstoull
+#define _strtoui64 strtoull
+#define sprintf_s snprintf
+
+// The bounded string functions take the size of the destination in characters and always
+// terminate it. Copying returns 0, EINVAL or ERANGE if the source was cut off (STRUNCATE
+// if _TRUNCATE was passed as count), formatting the length or -1 if the result was cut off.
+#define STRUNCATE 80
+#define _TRUNCATE ((size_t) -1)
+
+inline int wcsncpy_s(wchar_t* dst, size_t size, const wchar_t* src, size_t count)
+{
+  if (dst == NULL || size == 0)
+    return EINVAL;
+  if (src == NULL) {
+    dst[0] = L'\0';
+    return EINVAL;
+  }
+  size_t len = 0;
+  while (len < count && src[len] != L'\0')
+    ++len;
+  bool truncated = len >= size;
+  if (truncated)
+    len = size - 1;
+  wmemcpy(dst, src, len);
+  dst[len] = L'\0';
+  return truncated ? (count == _TRUNCATE ? STRUNCATE : ERANGE) : 0;
+}
+
+inline int wcscpy_s(wchar_t* dst, size_t size, const wchar_t* src)
+{
+  int result = wcsncpy_s(dst, size, src, _TRUNCATE);
+  return result == STRUNCATE ? ERANGE : result;
+}
+
+inline int wcscat_s(wchar_t* dst, size_t size, const wchar_t* src)
+{
+  if (dst == NULL || size == 0)
+    return EINVAL;
+  size_t len = wcsnlen(dst, size);
+  if (len == size) {
+    dst[size - 1] = L'\0';
+    return EINVAL;
+  }
+  return wcscpy_s(dst + len, size - len, src);
+}
+
+template <size_t size> inline int wcsncpy_s(wchar_t (&dst)[size], const wchar_t* src, size_t count)
+{
+  return wcsncpy_s(dst, size, src, count);
+}
+
+template <size_t size> inline int wcscpy_s(wchar_t (&dst)[size], const wchar_t* src)
+{
+  return wcscpy_s(dst, size, src);
+}
+
+template <size_t size> inline int wcscat_s(wchar_t (&dst)[size], const wchar_t* src)
+{
+  return wcscat_s(dst, size, src);
+}
+
+inline int vswprintf_s(wchar_t* buffer, size_t size, const wchar_t* format, va_list args)
+{
+  if (buffer == NULL || size == 0)
+    return -1;
+  int result = vswprintf(buffer, size, format, args);
+  // the contents are not defined if the result did not fit
+  if (result < 0)
+    buffer[size - 1] = L'\0';
+  return result;
+}
+
+inline int swprintf_s(wchar_t* buffer, size_t size, const wchar_t* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = vswprintf_s(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+inline int _snwprintf(wchar_t* buffer, size_t size, const wchar_t* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = vswprintf_s(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+template <size_t size> inline int swprintf_s(wchar_t (&buffer)[size], const wchar_t* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = vswprintf_s(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+// wsprintf of Windows has no size, only arrays are accepted here
+template <size_t size> inline int wsprintf(wchar_t (&buffer)[size], const wchar_t* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int result = vswprintf_s(buffer, size, format, args);
+  va_end(args);
+  return result;
+}
+
+int _itow_s(int value, wchar_t* buffer, size_t size, int radix);
+int _ui64tow_s(unsigned long long value, wchar_t* buffer, size_t size, int radix);
+
+//---------------------------------------------------------------------------
+// ATL
+
+#ifdef _DEBUG
+  void AtlTrace(const char* format, ...);
+  #define ATLTRACE AtlTrace
+#else
+  #define ATLTRACE(...) ((void) 0)
+#endif
+#define ATLASSERT(expr) assert(expr)
+#define ATLVERIFY(expr) ((void) (expr))
+
+#define CP_ACP 0
+#define CP_UTF8 65001
+
+namespace ATL
+{
+  // conversion of strings like the ATL classes of the same name, the code page
+  // is always UTF-8
+  class CA2W {
+  public:
+    CA2W(LPCSTR s, UINT /* codePage */ = CP_ACP) : fString(Utf8ToWide(s)) {
+    }
+    operator LPCWSTR() const {
+      return fString.c_str();
+    }
+  private:
+    std::wstring fString;
+  };
+
+  class CW2A {
+  public:
+    CW2A(LPCWSTR s, UINT /* codePage */ = CP_ACP) : fString(WideToUtf8(s)) {
+    }
+    operator LPCSTR() const {
+      return fString.c_str();
+    }
+  private:
+    std::string fString;
+  };
+};
+
+using namespace ATL;
+
+#endif
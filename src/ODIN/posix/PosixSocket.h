@@ -0,0 +1,82 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __POSIXSOCKET_H__
+#define __POSIXSOCKET_H__
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <netdb.h>
+#include "PosixPlatform.h"
+
+//---------------------------------------------------------------------------
+// The subset of Winsock 2 used by ODIN on POSIX systems. BSD sockets already
+// have the same calls, only the socket type, closing a socket, the start up
+// and the error codes differ.
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define SD_RECEIVE SHUT_RD
+#define SD_SEND SHUT_WR
+#define SD_BOTH SHUT_RDWR
+
+#define WSAEINTR 10004
+#define WSAEACCES 10013
+#define WSAEINVAL 10022
+#define WSAEMFILE 10024
+#define WSAEMSGSIZE 10040
+#define WSAEADDRINUSE 10048
+#define WSAEADDRNOTAVAIL 10049
+#define WSAENETDOWN 10050
+#define WSAENETUNREACH 10051
+#define WSAECONNABORTED 10053
+#define WSAECONNRESET 10054
+#define WSAENOBUFS 10055
+#define WSAENOTCONN 10057
+#define WSAETIMEDOUT 10060
+#define WSAECONNREFUSED 10061
+#define WSAEHOSTUNREACH 10065
+#define WSAHOST_NOT_FOUND 11001
+
+#define MAKEWORD(low, high) ((WORD) (((BYTE) (low)) | ((WORD) ((BYTE) (high))) << 8))
+
+typedef struct {
+  WORD wVersion;
+  WORD wHighVersion;
+} WSADATA, *LPWSADATA;
+
+// writing to a closed connection fails with WSAECONNRESET instead of raising SIGPIPE
+int WSAStartup(WORD versionRequested, LPWSADATA data);
+int WSACleanup();
+// error of the last failed socket call of the calling thread
+int WSAGetLastError();
+int closesocket(SOCKET s);
+
+#endif
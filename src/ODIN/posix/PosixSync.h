@@ -0,0 +1,172 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __POSIXSYNC_H__
+#define __POSIXSYNC_H__
+
+#include <pthread.h>
+#include "PosixPlatform.h"
+
+//---------------------------------------------------------------------------
+// Synchronization classes of atlsync.h on POSIX systems
+// CCriticalSection is a recursive mutex like a Windows critical section, the
+// other classes wrap the kernel objects of the platform layer so that their
+// handles can be passed to WaitForSingleObject().
+
+namespace ATL
+{
+
+class CCriticalSection
+{
+public:
+  CCriticalSection() {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&fMutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+  }
+
+  explicit CCriticalSection(ULONG /* spinCount */) : CCriticalSection() {
+  }
+
+  ~CCriticalSection() {
+    pthread_mutex_destroy(&fMutex);
+  }
+
+  void Enter() {
+    pthread_mutex_lock(&fMutex);
+  }
+
+  void Leave() {
+    pthread_mutex_unlock(&fMutex);
+  }
+
+  BOOL TryEnter() {
+    return pthread_mutex_trylock(&fMutex) == 0;
+  }
+
+private:
+  CCriticalSection(const CCriticalSection&);
+  CCriticalSection& operator=(const CCriticalSection&);
+
+  pthread_mutex_t fMutex;
+};
+
+class CHandle
+{
+public:
+  CHandle() : m_h(NULL) {
+  }
+
+  explicit CHandle(HANDLE h) : m_h(h) {
+  }
+
+  ~CHandle() {
+    if (m_h != NULL)
+      Close();
+  }
+
+  operator HANDLE() const {
+    return m_h;
+  }
+
+  void Attach(HANDLE h) {
+    m_h = h;
+  }
+
+  HANDLE Detach() {
+    HANDLE h = m_h;
+    m_h = NULL;
+    return h;
+  }
+
+  void Close() {
+    if (m_h != NULL) {
+      ::CloseHandle(m_h);
+      m_h = NULL;
+    }
+  }
+
+public:
+  HANDLE m_h;
+
+private:
+  CHandle(const CHandle&);
+  CHandle& operator=(const CHandle&);
+};
+
+class CSemaphore : public CHandle
+{
+public:
+  CSemaphore() {
+  }
+
+  CSemaphore(LONG initialCount, LONG maxCount) {
+    Create(NULL, initialCount, maxCount, NULL);
+  }
+
+  BOOL Create(LPSECURITY_ATTRIBUTES security, LONG initialCount, LONG maxCount, LPCTSTR name) {
+    ATLASSERT(m_h == NULL);
+    m_h = ::CreateSemaphore(security, initialCount, maxCount, name);
+    return m_h != NULL;
+  }
+
+  BOOL Release(LONG releaseCount = 1, LONG* oldCount = NULL) {
+    ATLASSERT(m_h != NULL);
+    return ::ReleaseSemaphore(m_h, releaseCount, oldCount);
+  }
+};
+
+class CEvent : public CHandle
+{
+public:
+  CEvent() {
+  }
+
+  CEvent(BOOL manualReset, BOOL initialState) {
+    Create(NULL, manualReset, initialState, NULL);
+  }
+
+  BOOL Create(LPSECURITY_ATTRIBUTES security, BOOL manualReset, BOOL initialState, LPCTSTR name) {
+    ATLASSERT(m_h == NULL);
+    m_h = ::CreateEvent(security, manualReset, initialState, name);
+    return m_h != NULL;
+  }
+
+  BOOL Set() {
+    ATLASSERT(m_h != NULL);
+    return ::SetEvent(m_h);
+  }
+
+  BOOL Reset() {
+    ATLASSERT(m_h != NULL);
+    return ::ResetEvent(m_h);
+  }
+};
+
+};
+
+#endif
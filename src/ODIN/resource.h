@@ -57,6 +57,7 @@
 #define IDS_UNMOUNTED_VOLUME            207
 #define IDS_DISKTOPARTITION             208
 #define IDS_CANTUSERMBREXT              209
+#define IDS_VERIFY_BLOCKS_FAILED        211
 #define IDC_LABEL_BYTES_TOTAL           1009
 #define IDC_TAB_GENERAL                 1010
 #define IDC_TABS_SETTINGS               1011
@@ -115,6 +116,14 @@
 #define IDS_ERRCMDLINE_BACKUP_PARAM_ERROR 57355
 #define IDS_ERRCMDLINE_RESTORE_PARAM_ERROR 57356
 #define IDS_ERRCMDLINE_VERIFY_PARAM_ERROR 57357
+#define IDS_ERRCMDLINE_TRANSCODE_PARAM_ERROR 57358
+#define IDS_ERRCMDLINE_WRONG_HASH       57359
+#define IDS_ERRCMDLINE_WRONG_HASH_SCOPE 57360
+#define IDS_ERRCMDLINE_COMPARE_PARAM_ERROR 57361
+#define IDS_ERRCMDLINE_ENGINE_JOB_ERROR 57362
+#define IDS_ERRCMDLINE_STD_STREAM_PARAM_ERROR 57363
+#define IDS_ERRCMDLINE_WRONG_IO_LIMIT   57364
+#define IDS_ERRCMDLINE_WRONG_CHECKPOINT 57365
 #define ID_BT_OPTIONS                   57665
 #define ID_BT_BROWSE                    57666
 #define IDS_PARTITION_FAT12             61403
@@ -142,7 +151,7 @@
 // 
 #ifdef APSTUDIO_INVOKED
 #ifndef APSTUDIO_READONLY_SYMBOLS
-#define _APS_NEXT_RESOURCE_VALUE        211
+#define _APS_NEXT_RESOURCE_VALUE        212
 #define _APS_NEXT_COMMAND_VALUE         32774
 #define _APS_NEXT_CONTROL_VALUE         1060
 #define _APS_NEXT_SYMED_VALUE           101
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 // Change these values to use different versions
 // WTL 10 requires WINVER >= 0x0501 (Windows XP or higher)
 // WTL 10 requires _RICHEDIT_VER >= 0x0300
@@ -42,6 +44,10 @@
 
 #include <memory>  // For std::unique_ptr
 
+// Winsock 2 must be included before windows.h includes the old winsock.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
 #include <atlbase.h>
 #include <atlstr.h>  // ATL::CString
 
@@ -63,3 +69,10 @@ extern CAppModule _Module;
 
 // to track memory allocations:
 #include "DebugMem.h"
+
+#else
+
+// the engine library on POSIX systems, see posix/PosixPlatform.h
+#include "posix/PosixPlatform.h"
+
+#endif
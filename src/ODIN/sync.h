@@ -213,7 +213,10 @@ public:
 	}
 };
 
-#else // _WTL_SUPPORT_SDK_ATL3
+#elif defined(_WIN32)
 #include <atlsync.h>
 
+#else
+#include "posix/PosixSync.h"
+
 #endif  //_WTL_SUPPORT_SDK_ATL3
@@ -83,6 +83,11 @@ int wmain(int argc, wchar_t* argv[])
     return 1;
   }
   WaitForSingleObject(procInfo.hProcess,INFINITE); // wait until ODIN terminates
-  return 0;
+  // pass on the exit code of ODIN to the caller
+  DWORD exitCode = 1;
+  GetExitCodeProcess(procInfo.hProcess, &exitCode);
+  CloseHandle(procInfo.hThread);
+  CloseHandle(procInfo.hProcess);
+  return (int) exitCode;
 }
 
@@ -0,0 +1,364 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+// odinh: console program running backup, restore, verify, transcode, compare
+// and inspect with COdinManager, without Windows user interface, drive list or
+// configuration file.
+//
+//   odinh backup <volume> <image> [-compression=...] [-manifest=KB] [-comment=text]
+//   odinh restore <image> <volume>
+//   odinh verify <image>
+//   odinh transcode <image> <target image> [-compression=...] [-manifest=KB]
+//   odinh compare <image> <volume>
+//   odinh inspect <image>
+//
+// An image named - is read from standard input or written to standard output,
+// messages are then written to standard error.
+// An image named http://host[:port]/path is an object of an HTTP server like an
+// S3 compatible object storage, read with ranged requests and uploaded in parts.
+// All operations take -readlimit=MB/s, -writelimit=MB/s, -readiops=n and -writeiops=n
+// to stay within a budget of I/O and -lowpriority to do their I/O in the background.
+// Backups and restores of local image files record a checkpoint every -checkpoint=MB
+// (default 0 for none) in a journal next to the image, -resume continues an interrupted
+// one at its last checkpoint and records one every 1024 MB if no interval is given.
+// SIGINT and SIGTERM cancel the operation and keep its journal.
+//
+// Exit code is 0 on success, 1 if the operation failed, the image is corrupt
+// or differs from the volume and 2 for wrong arguments.
+
+#include "stdafx.h"
+#include <locale.h>
+#include <signal.h>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OdinManager.h"
+#include "ImageStream.h"
+#include "FileHeader.h"
+#include "Exception.h"
+#include "OSException.h"
+
+using namespace std;
+
+typedef struct {
+  LPCWSTR name;
+  TCompressionFormat value;
+} TCompressionName;
+
+static const TCompressionName sCompressions[] = {
+  { L"none", noCompression },
+  { L"gzip", compressionGZip },
+  { L"bzip", compressionBZIP2 },
+  { L"lz4", compressionLZ4 },
+  { L"lz4hc", compressionLZ4HC },
+  { L"zstd", compressionZSTD },
+  { L"dedup", compressionChunkStore },
+};
+
+static LPCWSTR GetCompressionName(TCompressionFormat format)
+{
+  for (size_t i=0; i<_countof(sCompressions); i++) {
+    if (sCompressions[i].value == format)
+      return sCompressions[i].name;
+  }
+  return L"unknown";
+}
+
+static void Usage()
+{
+  wcerr << L"Usage: odinh backup <volume> <image> [-compression=none|gzip|bzip|lz4|lz4hc|zstd|dedup]" << endl;
+  wcerr << L"                    [-manifest=KB] [-comment=text]" << endl;
+  wcerr << L"       odinh restore <image> <volume>" << endl;
+  wcerr << L"       odinh verify <image>" << endl;
+  wcerr << L"       odinh transcode <image> <target image> [-compression=...] [-manifest=KB]" << endl;
+  wcerr << L"       odinh compare <image> <volume>" << endl;
+  wcerr << L"       odinh inspect <image>" << endl;
+  wcerr << L"Options of all operations: [-readlimit=MB/s] [-writelimit=MB/s] [-readiops=n]" << endl;
+  wcerr << L"                    [-writeiops=n] [-lowpriority]" << endl;
+  wcerr << L"Options of backup and restore: [-checkpoint=MB] [-resume]" << endl;
+  wcerr << L"An image - is read from standard input or written to standard output." << endl;
+  wcerr << L"An image http://host[:port]/path is an object on an HTTP server." << endl;
+}
+
+//---------------------------------------------------------------------------
+// class COperationResult
+// Takes the result of an operation of COdinManager when its threads have
+// finished, the manager releases them afterwards.
+
+class COperationResult : public IWaitCallback {
+public:
+  COperationResult(COdinManager& manager)
+    : fManager(manager)
+  {
+    fWasError = false;
+    fBytesProcessed = 0;
+  }
+
+  virtual void OnThreadTerminated() {
+  }
+  virtual void OnFinished() {
+    fWasError = fManager.WasError();
+    if (fWasError)
+      fErrorMessage = fManager.GetErrorMessage();
+    fBytesProcessed = fManager.GetBytesProcessed();
+  }
+  virtual void OnAbort() {
+    fWasError = true;
+    fErrorMessage = L"Waiting for the operation failed";
+  }
+  virtual void OnPartitionChange(int /* i */, int /* n */) {
+  }
+  virtual void OnPrepareSnapshotBegin() {
+  }
+  virtual void OnPrepareSnapshotReady() {
+  }
+
+  bool WasError() const {
+    return fWasError;
+  }
+  LPCWSTR GetErrorMessage() const {
+    return fErrorMessage.c_str();
+  }
+  unsigned __int64 GetBytesProcessed() const {
+    return fBytesProcessed;
+  }
+
+private:
+  COdinManager& fManager;
+  bool fWasError;
+  wstring fErrorMessage;
+  unsigned __int64 fBytesProcessed;
+};
+
+static void PrintRanges(LPCWSTR what, const vector<TImageRange>& ranges)
+{
+  for (size_t i=0; i<ranges.size(); i++)
+    wcout << what << L": offset " << ranges[i].offset << L", length " << ranges[i].length << endl;
+}
+
+static void Inspect(LPCWSTR fileName)
+{
+  CFileImageStream image;
+  image.Open(fileName, IImageStream::forReading);
+  image.ReadImageFileHeader(false);
+  const CImageFileHeader& header = image.GetImageFileHeader();
+  unsigned __int64 manifestOffset, manifestLength;
+  DWORD manifestBlockSize;
+  header.GetBlockManifestInfo(manifestOffset, manifestLength, manifestBlockSize);
+
+  wcout << L"version: " << header.GetMajorVersion() << L"." << header.GetMinorVersion() << endl;
+  wcout << L"type: " << (header.GetImageType() == CImageFileHeader::imageIncremental ? L"incremental" : L"full") << endl;
+  wcout << L"volume: " << (header.GetVolumeType() == CImageFileHeader::volumeHardDisk ? L"disk" : L"partition") << endl;
+  wcout << L"volume size: " << header.GetVolumeSize() << endl;
+  wcout << L"cluster size: " << header.GetClusterSize() << endl;
+  wcout << L"used clusters only: " << (header.GetVolumeEncoding() != CImageFileHeader::noVolumeBitmap ? L"yes" : L"no") << endl;
+  wcout << L"compression: " << GetCompressionName(header.GetCompressionFormat()) << endl;
+  wcout << L"data size: " << header.GetDataSize() << endl;
+  wcout << L"crc32: " << hex << image.GetCrc32Checksum() << dec << endl;
+  if (header.GetBlockManifestFormat() != CImageFileHeader::noBlockManifest)
+    wcout << L"block manifest: " << manifestBlockSize << endl;
+  wcout << L"comment: " << image.GetComment() << endl;
+}
+
+//---------------------------------------------------------------------------
+// SIGINT and SIGTERM cancel the running operation like the cancel button of ODIN,
+// an interrupted backup or restore keeps its journal. The signals are taken by a
+// thread of their own, without a running operation they end odinh.
+
+static mutex sCancelLock;
+static COdinManager* sRunningManager = NULL;
+
+static void SetRunningManager(COdinManager* manager)
+{
+  lock_guard<mutex> lock(sCancelLock);
+  sRunningManager = manager;
+}
+
+static void CancelOnSignals(sigset_t signals)
+{
+  for (;;) {
+    int signal;
+    if (sigwait(&signals, &signal) != 0)
+      continue;
+    lock_guard<mutex> lock(sCancelLock);
+    if (!sRunningManager)
+      _exit(128 + signal);
+    sRunningManager->CancelOperation();
+  }
+}
+
+// a volume in a file is restored to a new file if it does not exist
+static void CreateTargetFile(LPCWSTR volumeName)
+{
+  if (GetFileAttributes(volumeName) == INVALID_FILE_ATTRIBUTES) {
+    HANDLE h = CreateFile(volumeName, GENERIC_WRITE, 0, NULL, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, NULL);
+    CHECK_OS_EX_HANDLE_PARAM1(h, EWinException::fileOpenError, volumeName);
+    CloseHandle(h);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  vector<wstring> args;
+  setlocale(LC_ALL, "");
+  TCompressionFormat compression = compressionGZip;
+  unsigned manifestKB = 1024;
+  wstring comment;
+  // the configured limits and checkpoint interval are taken for options not given
+  int readLimit = -1, writeLimit = -1, readIops = -1, writeIops = -1;
+  bool lowPriority = false;
+  int checkpointMB = -1;
+  bool resume = false;
+
+  for (int i=1; i<argc; i++) {
+    wstring arg = (LPCWSTR) CA2W(argv[i]);
+    size_t eq = arg.find(L'=');
+    wstring name = arg.substr(0, eq), value = eq == wstring::npos ? L"" : arg.substr(eq + 1);
+    if (arg.empty() || arg[0] != L'-' || arg == L"-") {
+      args.push_back(arg);
+    } else if (name == L"-compression") {
+      size_t k;
+      for (k=0; k<_countof(sCompressions) && value != sCompressions[k].name; k++)
+        ;
+      if (k == _countof(sCompressions)) {
+        wcerr << L"Unknown compression: " << value << endl;
+        return 2;
+      }
+      if (!IsCompressionAvailable(sCompressions[k].value)) {
+        wcerr << L"Compression not available in this build: " << value << endl;
+        return 2;
+      }
+      compression = sCompressions[k].value;
+    } else if (name == L"-manifest") {
+      manifestKB = _wtoi(value.c_str());
+    } else if (name == L"-comment") {
+      comment = value;
+    } else if (name == L"-readlimit") {
+      readLimit = _wtoi(value.c_str());
+    } else if (name == L"-writelimit") {
+      writeLimit = _wtoi(value.c_str());
+    } else if (name == L"-readiops") {
+      readIops = _wtoi(value.c_str());
+    } else if (name == L"-writeiops") {
+      writeIops = _wtoi(value.c_str());
+    } else if (arg == L"-lowpriority") {
+      lowPriority = true;
+    } else if (name == L"-checkpoint") {
+      checkpointMB = _wtoi(value.c_str());
+    } else if (arg == L"-resume") {
+      resume = true;
+    } else {
+      wcerr << L"Unknown option: " << arg << endl;
+      return 2;
+    }
+  }
+
+  const wstring command = args.empty() ? L"" : args[0];
+  size_t operands = command == L"verify" || command == L"inspect" ? 2 : 3;
+  if (args.size() != operands || (command != L"backup" && command != L"restore" && command != L"verify" &&
+      command != L"transcode" && command != L"compare" && command != L"inspect")) {
+    Usage();
+    return 2;
+  }
+
+  // standard output carries the image
+  if ((command == L"backup" || command == L"transcode") && args[2] == L"-")
+    wcout.rdbuf(wcerr.rdbuf());
+
+  // the threads of the operation inherit the blocked signals
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  thread(CancelOnSignals, signals).detach();
+
+  COdinManager manager;
+  COperationResult result(manager);
+  manager.SetCompressionMode(compression);
+  manager.SetBlockManifestSize(manifestKB * 1024);
+  manager.SetComment(comment.c_str());
+  if (readLimit >= 0 || readIops >= 0)
+    manager.SetReadLimit(readLimit >= 0 ? readLimit : manager.GetReadLimit(),
+                         readIops >= 0 ? readIops : manager.GetReadOpsLimit());
+  if (writeLimit >= 0 || writeIops >= 0)
+    manager.SetWriteLimit(writeLimit >= 0 ? writeLimit : manager.GetWriteLimit(),
+                          writeIops >= 0 ? writeIops : manager.GetWriteOpsLimit());
+  if (lowPriority)
+    manager.SetLowIoPriority(true);
+  if (checkpointMB >= 0)
+    manager.SetCheckpointInterval(checkpointMB);
+  manager.SetResume(resume);
+  SetRunningManager(&manager);
+  try {
+    if (command == L"backup") {
+      manager.SaveVolume(args[1].c_str(), args[2].c_str(), NULL, &result);
+    } else if (command == L"restore") {
+      CreateTargetFile(args[2].c_str());
+      manager.RestoreVolume(args[1].c_str(), args[2].c_str(), 0, 0, NULL, &result);
+    } else if (command == L"verify") {
+      manager.VerifyPartition(args[1].c_str(), -1, 0, 0, NULL, &result);
+    } else if (command == L"transcode") {
+      manager.TranscodeImage(args[1].c_str(), 0, 0, args[2].c_str(), NULL);
+    } else if (command == L"compare") {
+      manager.CompareImageToVolume(args[1].c_str(), 0, 0, args[2].c_str(), NULL);
+    } else {
+      SetRunningManager(NULL);
+      Inspect(args[1].c_str());
+      return 0;
+    }
+    manager.WaitToCompleteOperation(&result);
+    SetRunningManager(NULL);
+  } catch (Exception& e) {
+    SetRunningManager(NULL);
+    wcerr << L"Error: " << e.GetMessage() << endl;
+    return 1;
+  }
+
+  if (manager.WasCancelled()) {
+    wcerr << command << L" cancelled" << endl;
+    return 1;
+  }
+  if (result.WasError()) {
+    wcerr << L"Error: " << result.GetErrorMessage() << endl;
+    return 1;
+  }
+  bool ok = true;
+  if (command == L"verify" && manager.WasBlockVerify()) {
+    PrintRanges(L"corrupt", manager.GetCorruptRanges());
+    ok = manager.GetCorruptRanges().empty();
+  } else if (command == L"verify" || command == L"transcode") {
+    ok = manager.WasSourceIntact();
+  } else if (command == L"compare") {
+    PrintRanges(L"differs", manager.GetCompareDifferences());
+    wcout << L"differing bytes: " << manager.GetCompareDifferingBytes() << endl;
+    ok = manager.GetCompareDifferingBytes() == 0;
+  }
+  if (manager.GetResumedBytes() > 0)
+    wcout << command << L" resumed at " << manager.GetResumedBytes() << L" bytes" << endl;
+  wcout << command << (ok ? L" succeeded, " : L" failed, ") << result.GetBytesProcessed() << L" bytes" << endl;
+  return ok ? 0 : 1;
+}
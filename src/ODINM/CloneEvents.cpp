@@ -0,0 +1,105 @@
+/******************************************************************************
+
+    OdinM - Multi-Drive Clone Tool
+    CloneEvents.cpp - Event stream of a running ODINC.exe
+
+******************************************************************************/
+
+#include "stdafx.h"
+#include "CloneEvents.h"
+#include "..\ODIN\EventStream.h"
+
+std::wstring CloneEvent::Value(const wchar_t* key) const
+{
+    auto it = values.find(key);
+    return it == values.end() ? std::wstring() : it->second;
+}
+
+ULONGLONG CloneEvent::Number(const wchar_t* key) const
+{
+    return _wcstoui64(Value(key).c_str(), NULL, 10);
+}
+
+// --- Launch ---
+// Only the write end of the pipe is inheritable. ODINC.exe passes it on to
+// ODIN.exe, the pipe breaks when both have ended.
+bool CCloneEventReader::Launch(std::wstring commandLine, HWND target, DWORD& processId)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, TRUE };
+    HANDLE readEnd = NULL, writeEnd = NULL;
+    if (!CreatePipe(&readEnd, &writeEnd, &sa, 65536))
+        return false;
+    SetHandleInformation(readEnd, HANDLE_FLAG_INHERIT, 0);
+    commandLine += L" -events=" + std::to_wstring((ULONG_PTR)writeEnd);
+
+    STARTUPINFOW si = {}; PROCESS_INFORMATION pi = {}; si.cb = sizeof(si);
+    BOOL ok = CreateProcessW(NULL, &commandLine[0], NULL, NULL, TRUE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi);
+    DWORD err = GetLastError();
+    CloseHandle(writeEnd);
+    if (!ok) {
+        CloseHandle(readEnd);
+        SetLastError(err);
+        return false;
+    }
+    CloseHandle(pi.hThread);
+    processId = pi.dwProcessId;
+
+    Context* ctx = new Context{ readEnd, pi.hProcess, pi.dwProcessId, target };
+    HANDLE thread = CreateThread(NULL, 0, ReaderThread, ctx, 0, NULL);
+    if (!thread) {
+        // without a reader the process would block on a full pipe
+        err = GetLastError();
+        TerminateProcess(pi.hProcess, 1);
+        CloseHandle(readEnd); CloseHandle(pi.hProcess);
+        delete ctx;
+        SetLastError(err);
+        return false;
+    }
+    CloseHandle(thread);
+    return true;
+}
+
+// --- ReaderThread ---
+// Reads event lines until ODINC.exe has ended, then posts its exit code
+DWORD WINAPI CCloneEventReader::ReaderThread(LPVOID param)
+{
+    std::unique_ptr<Context> ctx((Context*)param);
+    std::string pending;
+    char buffer[4096];
+    DWORD read = 0;
+    while (ReadFile(ctx->pipe, buffer, sizeof(buffer), &read, NULL) && read > 0) {
+        pending.append(buffer, read);
+        size_t pos;
+        while ((pos = pending.find('\n')) != std::string::npos) {
+            std::string line = pending.substr(0, pos);
+            pending.erase(0, pos + 1);
+            int len = MultiByteToWideChar(CP_UTF8, 0, line.c_str(), (int)line.length(), NULL, 0);
+            if (len <= 0) continue;
+            std::wstring text(len, L' ');
+            MultiByteToWideChar(CP_UTF8, 0, line.c_str(), (int)line.length(), &text[0], len);
+            CloneEvent* ev = new CloneEvent;
+            if (!CEventStream::Parse(text, ev->name, ev->values)) { delete ev; continue; }
+            Post(*ctx, ev);
+        }
+    }
+    CloseHandle(ctx->pipe);
+
+    WaitForSingleObject(ctx->process, INFINITE);
+    DWORD code = 1;
+    GetExitCodeProcess(ctx->process, &code);
+    CloseHandle(ctx->process);
+    CloneEvent* ev = new CloneEvent;
+    ev->name = L"exit";
+    ev->values[L"code"] = std::to_wstring(code);
+    Post(*ctx, ev);
+    return 0;
+}
+
+// --- Post ---
+void CCloneEventReader::Post(const Context& ctx, CloneEvent* ev)
+{
+    ev->processId = ctx.processId;
+    // the dialog may be gone already
+    if (!::PostMessage(ctx.target, WM_CLONE_EVENT, 0, (LPARAM)ev))
+        delete ev;
+}
@@ -0,0 +1,44 @@
+/******************************************************************************
+
+    OdinM - Multi-Drive Clone Tool
+    CloneEvents.h - Event stream of a running ODINC.exe
+
+******************************************************************************/
+
+#pragma once
+#include "stdafx.h"
+
+// Posted to the dialog for every event of an ODINC.exe, lParam is a CloneEvent*
+// the dialog deletes
+static const UINT WM_CLONE_EVENT = WM_APP + 101;
+
+// One event line of ODINC.exe (odinc -events): started, stage, progress, finished.
+// "exit" with value code is sent when the process has ended.
+struct CloneEvent {
+    DWORD processId = 0;
+    std::wstring name;
+    std::map<std::wstring, std::wstring> values;
+
+    std::wstring Value(const wchar_t* key) const;
+    ULONGLONG Number(const wchar_t* key) const;
+};
+
+// Starts ODINC.exe with its events on an anonymous pipe. A thread of its own reads
+// them and posts them to the window, so the window reacts as soon as ODINC.exe
+// reports something instead of polling the process.
+class CCloneEventReader
+{
+public:
+    // commandLine without -events; false with GetLastError() if not started
+    static bool Launch(std::wstring commandLine, HWND target, DWORD& processId);
+
+private:
+    struct Context {
+        HANDLE pipe;
+        HANDLE process;
+        DWORD processId;
+        HWND target;
+    };
+    static DWORD WINAPI ReaderThread(LPVOID param);
+    static void Post(const Context& ctx, CloneEvent* ev);
+};
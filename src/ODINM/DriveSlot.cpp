@@ -13,7 +13,9 @@ CDriveSlot::CDriveSlot(int slotNumber)
     , m_driveSize(0)
     , m_status(CloneStatus::Empty)
     , m_progress(0)
+    , m_rate(0)
     , m_processId(0)
+    , m_batchTarget(-1)
 {
 }
 
@@ -28,6 +30,7 @@ void CDriveSlot::SetDrive(const std::wstring& letter, const std::wstring& name,
     m_driveSize = size;
     m_status = CloneStatus::Ready;
     m_progress = 0;
+    m_rate = 0;
     m_verifyResult = VerificationResult();
 }
 
@@ -38,7 +41,11 @@ void CDriveSlot::ClearDrive()
     m_driveSize = 0;
     m_status = CloneStatus::Empty;
     m_progress = 0;
+    m_rate = 0;
     m_processId = 0;
+    m_batchTarget = -1;
+    m_resultFile.clear();
+    m_busGroup.clear();
     m_verifyResult = VerificationResult();
 }
 
@@ -67,6 +74,7 @@ std::wstring CDriveSlot::GetStatusString() const
     switch (m_status) {
         case CloneStatus::Empty:      return L"-";
         case CloneStatus::Ready:      return L"Ready";
+        case CloneStatus::Queued:     return L"Queued";
         case CloneStatus::Cloning:    return L"Cloning";
         case CloneStatus::Verifying:  return L"Verifying";
         case CloneStatus::Complete:   return L"Complete";
@@ -90,11 +98,15 @@ std::wstring CDriveSlot::GetDriveSizeString() const
 
 std::wstring CDriveSlot::GetProgressString() const
 {
-    if (m_status == CloneStatus::Empty || m_status == CloneStatus::Ready) {
+    if (m_status == CloneStatus::Empty || m_status == CloneStatus::Ready ||
+        m_status == CloneStatus::Queued) {
         return L"-";
     }
     
-    wchar_t buffer[32];
-    swprintf_s(buffer, L"%d%%", m_progress);
+    wchar_t buffer[48];
+    if (m_status == CloneStatus::Cloning && m_rate > 0)
+        swprintf_s(buffer, L"%d%%  %.1f MB/s", m_progress, m_rate / (1024.0 * 1024.0));
+    else
+        swprintf_s(buffer, L"%d%%", m_progress);
     return buffer;
 }
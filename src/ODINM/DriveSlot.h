@@ -12,6 +12,7 @@
 enum class CloneStatus {
     Empty,          // No drive detected
     Ready,          // Drive detected, ready to clone
+    Queued,         // Waiting until its bus has room for another clone
     Cloning,        // Currently cloning
     Verifying,      // Clone complete, verifying hash
     Complete,       // Clone and verification complete
@@ -44,22 +45,31 @@ public:
     ULONGLONG GetDriveSize() const { return m_driveSize; }
     CloneStatus GetStatus() const { return m_status; }
     int GetProgress() const { return m_progress; }
+    ULONGLONG GetRate() const { return m_rate; }
     const VerificationResult& GetVerificationResult() const { return m_verifyResult; }
     DWORD GetProcessId() const { return m_processId; }
+    int GetBatchTarget() const { return m_batchTarget; }
+    const std::wstring& GetResultFile() const { return m_resultFile; }
+    const std::wstring& GetBusGroup() const { return m_busGroup; }
     
     // Setters
     void SetDrive(const std::wstring& letter, const std::wstring& name, ULONGLONG size);
     void ClearDrive();
     void SetStatus(CloneStatus status);
     void SetProgress(int progress);
+    void SetRate(ULONGLONG bytesPerSecond) { m_rate = bytesPerSecond; }
     void SetVerificationResult(const VerificationResult& result);
     void SetProcessId(DWORD pid);
+    void SetBatchTarget(int target) { m_batchTarget = target; }
+    void SetResultFile(const std::wstring& file) { m_resultFile = file; }
+    void SetBusGroup(const std::wstring& group) { m_busGroup = group; }
     
     // Status queries
     bool IsEmpty() const { return m_status == CloneStatus::Empty; }
     bool IsActive() const { 
         return m_status == CloneStatus::Cloning || m_status == CloneStatus::Verifying;
     }
+    bool IsQueued() const { return m_status == CloneStatus::Queued; }
     bool IsComplete() const { return m_status == CloneStatus::Complete; }
     bool IsFailed() const { return m_status == CloneStatus::Failed; }
     
@@ -75,6 +85,10 @@ private:
     ULONGLONG m_driveSize;           // Size in bytes
     CloneStatus m_status;
     int m_progress;                  // 0-100
+    ULONGLONG m_rate;                // Bytes per second written by ODINC.exe, 0 if unknown
     VerificationResult m_verifyResult;
     DWORD m_processId;               // Process ID of ODINC.exe for this slot
+    int m_batchTarget;               // Position of this drive in -target of the ODINC.exe batch
+    std::wstring m_resultFile;       // Result file (-output) of the ODINC.exe batch with the hashes
+    std::wstring m_busGroup;         // Hub or controller port the drive shares with other drives
 };
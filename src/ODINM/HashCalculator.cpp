@@ -7,6 +7,12 @@
 
 #include "stdafx.h"
 #include "HashCalculator.h"
+#include "..\ODIN\FileHeader.h"
+#include "..\ODIN\StreamHasher.h"
+
+// Same as CImageFileHeader::sMagicFileHeaderGUID of ODIN (not linked into OdinM)
+static const GUID kOdinImageGUID =
+    { 0x1d4d7b73, 0xfa01, 0x40e1, { 0xb0, 0x94, 0x52, 0x67, 0xd8, 0xfa, 0xb, 0xe7 } };
 
 // ---------------------------------------------------------------------------
 // Public: calculate SHA-1
@@ -14,7 +20,8 @@
 bool CHashCalculator::CalculateSHA1(HANDLE hFile, ULONGLONG offset, ULONGLONG size,
     std::wstring& result, std::function<void(int)> progressCallback)
 {
-    return CalculateHash(CALG_SHA1, hFile, offset, size, result, progressCallback);
+    return CalculateHash(CStreamHasher::hashSha1, hFile, offset, size, &result, NULL,
+        progressCallback);
 }
 
 // ---------------------------------------------------------------------------
@@ -23,7 +30,8 @@ bool CHashCalculator::CalculateSHA1(HANDLE hFile, ULONGLONG offset, ULONGLONG si
 bool CHashCalculator::CalculateSHA256(HANDLE hFile, ULONGLONG offset, ULONGLONG size,
     std::wstring& result, std::function<void(int)> progressCallback)
 {
-    return CalculateHash(CALG_SHA_256, hFile, offset, size, result, progressCallback);
+    return CalculateHash(CStreamHasher::hashSha256, hFile, offset, size, NULL, &result,
+        progressCallback);
 }
 
 // ---------------------------------------------------------------------------
@@ -33,77 +41,8 @@ bool CHashCalculator::CalculateBothHashes(HANDLE hFile, ULONGLONG offset, ULONGL
     std::wstring& sha1Result, std::wstring& sha256Result,
     std::function<void(int)> progressCallback)
 {
-    HCRYPTPROV hProv = 0;
-    HCRYPTHASH hSHA1 = 0;
-    HCRYPTHASH hSHA256 = 0;
-
-    if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT))
-        return false;
-
-    bool success = false;
-
-    do {
-        if (!CryptCreateHash(hProv, CALG_SHA1, 0, 0, &hSHA1)) break;
-        if (!CryptCreateHash(hProv, CALG_SHA_256, 0, 0, &hSHA256)) break;
-
-        // Seek to offset
-        LARGE_INTEGER li;
-        li.QuadPart = (LONGLONG)offset;
-        if (!SetFilePointerEx(hFile, li, NULL, FILE_BEGIN)) break;
-
-        const DWORD BUFFER_SIZE = 1024 * 1024; // 1 MB
-        std::vector<BYTE> buffer(BUFFER_SIZE);
-        ULONGLONG remaining = size;
-        ULONGLONG processed = 0;
-
-        success = true;
-        while (remaining > 0 && success) {
-            DWORD toRead = (DWORD)min((ULONGLONG)BUFFER_SIZE, remaining);
-            DWORD bytesRead = 0;
-
-            if (!ReadFile(hFile, buffer.data(), toRead, &bytesRead, NULL) || bytesRead == 0) {
-                success = false;
-                break;
-            }
-
-            CryptHashData(hSHA1,   buffer.data(), bytesRead, 0);
-            CryptHashData(hSHA256, buffer.data(), bytesRead, 0);
-
-            processed  += bytesRead;
-            remaining  -= bytesRead;
-
-            if (progressCallback && size > 0) {
-                int pct = (int)((processed * 100) / size);
-                progressCallback(pct);
-            }
-        }
-
-        if (success) {
-            // Retrieve SHA-1
-            DWORD hashLen = 0, hashLenSize = sizeof(DWORD);
-            CryptGetHashParam(hSHA1, HP_HASHSIZE, (BYTE*)&hashLen, &hashLenSize, 0);
-            std::vector<BYTE> hashVal(hashLen);
-            if (CryptGetHashParam(hSHA1, HP_HASHVAL, hashVal.data(), &hashLen, 0))
-                sha1Result = BytesToHex(hashVal.data(), hashLen);
-            else
-                success = false;
-
-            // Retrieve SHA-256
-            hashLen = 0; hashLenSize = sizeof(DWORD);
-            CryptGetHashParam(hSHA256, HP_HASHSIZE, (BYTE*)&hashLen, &hashLenSize, 0);
-            hashVal.resize(hashLen);
-            if (CryptGetHashParam(hSHA256, HP_HASHVAL, hashVal.data(), &hashLen, 0))
-                sha256Result = BytesToHex(hashVal.data(), hashLen);
-            else
-                success = false;
-        }
-    } while (false);
-
-    if (hSHA1)   CryptDestroyHash(hSHA1);
-    if (hSHA256) CryptDestroyHash(hSHA256);
-    CryptReleaseContext(hProv, 0);
-
-    return success;
+    return CalculateHash(CStreamHasher::hashSha1 | CStreamHasher::hashSha256, hFile,
+        offset, size, &sha1Result, &sha256Result, progressCallback);
 }
 
 // ---------------------------------------------------------------------------
@@ -119,7 +58,7 @@ bool CHashCalculator::CalculateSHA1FromFile(const std::wstring& filePath,
 
     LARGE_INTEGER fileSize = {};
     bool ok = GetFileSizeEx(hFile, &fileSize) &&
-              CalculateHash(CALG_SHA1, hFile, 0, (ULONGLONG)fileSize.QuadPart,
+              CalculateSHA1(hFile, 0, (ULONGLONG)fileSize.QuadPart,
                             result, progressCallback);
     CloseHandle(hFile);
     return ok;
@@ -138,7 +77,7 @@ bool CHashCalculator::CalculateSHA256FromFile(const std::wstring& filePath,
 
     LARGE_INTEGER fileSize = {};
     bool ok = GetFileSizeEx(hFile, &fileSize) &&
-              CalculateHash(CALG_SHA_256, hFile, 0, (ULONGLONG)fileSize.QuadPart,
+              CalculateSHA256(hFile, 0, (ULONGLONG)fileSize.QuadPart,
                             result, progressCallback);
     CloseHandle(hFile);
     return ok;
@@ -147,68 +86,36 @@ bool CHashCalculator::CalculateSHA256FromFile(const std::wstring& filePath,
 // ---------------------------------------------------------------------------
 // Private: core hash calculation
 // ---------------------------------------------------------------------------
-bool CHashCalculator::CalculateHash(ALG_ID algId, HANDLE hFile, ULONGLONG offset,
-    ULONGLONG size, std::wstring& result, std::function<void(int)> progressCallback)
+bool CHashCalculator::CalculateHash(unsigned algorithms, HANDLE hFile, ULONGLONG offset,
+    ULONGLONG size, std::wstring* sha1Result, std::wstring* sha256Result,
+    std::function<void(int)> progressCallback)
 {
-    HCRYPTPROV hProv = 0;
-    HCRYPTHASH hHash = 0;
+    LARGE_INTEGER li;
+    li.QuadPart = (LONGLONG)offset;
+    if (!SetFilePointerEx(hFile, li, NULL, FILE_BEGIN))
+        return false;
 
-    if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT))
+    // 1 MB buffers, three of them: one being read while two are hashed
+    CStreamHasher hasher(algorithms);
+    auto readFile = [hFile](BYTE* buffer, unsigned toRead, unsigned& bytesRead) {
+        DWORD read = 0;
+        if (!ReadFile(hFile, buffer, toRead, &read, NULL))
+            return false;
+        bytesRead = read;
+        return true;
+    };
+    // length 0 would hash up to the end of the file, size 0 is the empty message
+    auto noData = [](BYTE*, unsigned, unsigned& bytesRead) { bytesRead = 0; return true; };
+    bool ok = size == 0 ? hasher.Calculate(noData, 0)
+                        : hasher.Calculate(readFile, size, progressCallback);
+    if (!ok)
         return false;
 
-    bool success = false;
-
-    do {
-        if (!CryptCreateHash(hProv, algId, 0, 0, &hHash)) break;
-
-        LARGE_INTEGER li;
-        li.QuadPart = (LONGLONG)offset;
-        if (!SetFilePointerEx(hFile, li, NULL, FILE_BEGIN)) break;
-
-        const DWORD BUFFER_SIZE = 1024 * 1024; // 1 MB
-        std::vector<BYTE> buffer(BUFFER_SIZE);
-        ULONGLONG remaining = size;
-        ULONGLONG processed = 0;
-
-        success = true;
-        while (remaining > 0 && success) {
-            DWORD toRead = (DWORD)min((ULONGLONG)BUFFER_SIZE, remaining);
-            DWORD bytesRead = 0;
-
-            if (!ReadFile(hFile, buffer.data(), toRead, &bytesRead, NULL) || bytesRead == 0) {
-                success = false;
-                break;
-            }
-
-            if (!CryptHashData(hHash, buffer.data(), bytesRead, 0)) {
-                success = false;
-                break;
-            }
-
-            processed += bytesRead;
-            remaining -= bytesRead;
-
-            if (progressCallback && size > 0) {
-                int pct = (int)((processed * 100) / size);
-                progressCallback(pct);
-            }
-        }
-
-        if (success) {
-            DWORD hashLen = 0, hashLenSize = sizeof(DWORD);
-            CryptGetHashParam(hHash, HP_HASHSIZE, (BYTE*)&hashLen, &hashLenSize, 0);
-            std::vector<BYTE> hashVal(hashLen);
-            if (CryptGetHashParam(hHash, HP_HASHVAL, hashVal.data(), &hashLen, 0))
-                result = BytesToHex(hashVal.data(), hashLen);
-            else
-                success = false;
-        }
-    } while (false);
-
-    if (hHash) CryptDestroyHash(hHash);
-    CryptReleaseContext(hProv, 0);
-
-    return success;
+    if (sha1Result && (algorithms & CStreamHasher::hashSha1))
+        *sha1Result = BytesToHex(hasher.GetSha1Digest(), CSha1::sDigestLength);
+    if (sha256Result && (algorithms & CStreamHasher::hashSha256))
+        *sha256Result = BytesToHex(hasher.GetSha256Digest(), CSha256::sDigestLength);
+    return true;
 }
 
 // ---------------------------------------------------------------------------
@@ -227,3 +134,36 @@ std::wstring CHashCalculator::BytesToHex(const BYTE* data, DWORD length)
 
     return result;
 }
+
+// ---------------------------------------------------------------------------
+// Public: read the hashes stored in the image file header
+// ---------------------------------------------------------------------------
+bool CHashCalculator::ReadImageHashes(const std::wstring& imagePath,
+    std::wstring& sha1Result, std::wstring& sha256Result, bool* usedClustersOnly)
+{
+    sha1Result.clear();
+    sha256Result.clear();
+
+    HANDLE hFile = CreateFileW(imagePath.c_str(), GENERIC_READ, FILE_SHARE_READ,
+        NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    CImageFileHeader::TDiskImageFileHeader header = {};
+    DWORD read = 0;
+    BOOL ok = ReadFile(hFile, &header, sizeof(header), &read, NULL);
+    CloseHandle(hFile);
+
+    // media hashes exist since image format 1.3, older headers are shorter
+    if (!ok || read != sizeof(header) || !IsEqualGUID(header.guid, kOdinImageGUID)
+        || header.versionMajor != 1 || header.versionMinor < 3)
+        return false;
+
+    if (header.mediaHashScheme & CImageFileHeader::mediaHashSHA1)
+        sha1Result = BytesToHex(header.mediaHashSha1, sizeof(header.mediaHashSha1));
+    if (header.mediaHashScheme & CImageFileHeader::mediaHashSHA256)
+        sha256Result = BytesToHex(header.mediaHashSha256, sizeof(header.mediaHashSha256));
+    if (usedClustersOnly)
+        *usedClustersOnly = (header.mediaHashScheme & CImageFileHeader::mediaHashUsedClusters) != 0;
+    return !sha1Result.empty() || !sha256Result.empty();
+}
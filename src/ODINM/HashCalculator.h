@@ -1,7 +1,7 @@
 /******************************************************************************
 
     OdinM - Multi-Drive Clone Tool
-    HashCalculator.h - SHA hash calculation using Windows CryptoAPI
+    HashCalculator.h - SHA hash calculation using ODIN's SHA engine
 
 ******************************************************************************/
 
@@ -30,7 +30,7 @@ public:
         std::function<void(int)> progressCallback = nullptr
     );
 
-    // Calculate both SHA-1 and SHA-256 in a single read pass (efficient)
+    // Calculate both SHA-1 and SHA-256 in a single read pass, each on its own core
     static bool CalculateBothHashes(
         HANDLE hFile,
         ULONGLONG offset,
@@ -54,13 +54,29 @@ public:
         std::function<void(int)> progressCallback = nullptr
     );
 
+    // Read the hashes ODIN stored in the header of an image at backup time
+    // (odinc -backup -hash=..., image format 1.3). No hashing needed.
+    // Returns false if the image holds none; a missing algorithm gives "".
+    // usedClustersOnly tells if they cover only the used clusters
+    // (-hashscope=used) instead of the volume with free clusters as zeros.
+    static bool ReadImageHashes(
+        const std::wstring& imagePath,
+        std::wstring& sha1Result,
+        std::wstring& sha256Result,
+        bool* usedClustersOnly = nullptr
+    );
+
 private:
+    // Read size bytes at offset once and hash them with the CStreamHasher
+    // algorithms given (reading overlaps hashing). Results of algorithms not
+    // requested are left unchanged.
     static bool CalculateHash(
-        ALG_ID algId,
+        unsigned algorithms,
         HANDLE hFile,
         ULONGLONG offset,
         ULONGLONG size,
-        std::wstring& result,
+        std::wstring* sha1Result,
+        std::wstring* sha256Result,
         std::function<void(int)> progressCallback
     );
 
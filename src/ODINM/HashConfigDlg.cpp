@@ -119,11 +119,12 @@ LRESULT CHashConfigDlg::OnLoadFile(WORD /*code*/, WORD /*id*/, HWND /*hwnd*/, BO
 }
 
 // ---------------------------------------------------------------------------
-// Core: open the image file and calculate the requested hashes.
+// Core: take the requested hashes from the image header or calculate them.
 //
-// NOTE: Currently hashes the entire image file.  If partition-specific
-//       hashing is needed, add ODIN file-header parsing here to derive
-//       the correct byte offset/length for each partition.
+// NOTE: Images made with "odinc -backup -hash=..." carry the hashes of the
+//       restored volume in their header, nothing needs to be read.  For
+//       other images the entire image file is hashed, which matches the
+//       whole drive for uncompressed images of all blocks only.
 // ---------------------------------------------------------------------------
 void CHashConfigDlg::CalculateHashesFromImage(bool calcSHA1, bool calcSHA256)
 {
@@ -135,6 +136,20 @@ void CHashConfigDlg::CalculateHashesFromImage(bool calcSHA1, bool calcSHA256)
         return;
     }
 
+    std::wstring sha1Stored, sha256Stored;
+    bool usedOnly = false;
+    if (CHashCalculator::ReadImageHashes(m_config.imagePath, sha1Stored, sha256Stored, &usedOnly)
+        && (!calcSHA1 || !sha1Stored.empty()) && (!calcSHA256 || !sha256Stored.empty()))
+    {
+        SetScope(usedOnly ? HashScope::UsedClusters : HashScope::Volume);
+        if (calcSHA1)
+            SetControlText(IDC_EDIT_SHA1,   sha1Stored);
+        if (calcSHA256)
+            SetControlText(IDC_EDIT_SHA256, sha256Stored);
+        UpdateStatusLabels();
+        return;
+    }
+
     HANDLE hFile = CreateFileW(
         m_config.imagePath.c_str(),
         GENERIC_READ, FILE_SHARE_READ,
@@ -189,6 +204,7 @@ void CHashConfigDlg::CalculateHashesFromImage(bool calcSHA1, bool calcSHA256)
         return;
     }
 
+    SetScope(HashScope::Drive);
     if (calcSHA1   && !sha1Result.empty())
         SetControlText(IDC_EDIT_SHA1,   sha1Result);
     if (calcSHA256 && !sha256Result.empty())
@@ -230,6 +246,14 @@ void CHashConfigDlg::LoadConfigToControls()
     if (selIdx < 0 || selIdx > 9) selIdx = 0;
     SendMessage(hCombo, CB_SETCURSEL, (WPARAM)selIdx, 0);
 
+    // Digest definition, in the order of HashScope
+    HWND hScope = GetDlgItem(IDC_COMBO_HASH_SCOPE);
+    SendMessage(hScope, CB_RESETCONTENT, 0, 0);
+    SendMessage(hScope, CB_ADDSTRING, 0, (LPARAM)L"Whole drive");
+    SendMessage(hScope, CB_ADDSTRING, 0, (LPARAM)L"Volume (free clusters as zeros)");
+    SendMessage(hScope, CB_ADDSTRING, 0, (LPARAM)L"Used clusters only");
+    SetScope(m_config.scope);
+
     // Hash value edit boxes
     SetControlText(IDC_EDIT_SHA1,   m_config.sha1Expected);
     SetControlText(IDC_EDIT_SHA256, m_config.sha256Expected);
@@ -252,6 +276,10 @@ void CHashConfigDlg::SaveControlsToConfig()
     if (idx != CB_ERR)
         m_config.partitionNumber = (int)SendMessage(hCombo, CB_GETITEMDATA, (WPARAM)idx, 0);
 
+    int scopeIdx = (int)SendDlgItemMessage(IDC_COMBO_HASH_SCOPE, CB_GETCURSEL, 0, 0);
+    if (scopeIdx != CB_ERR)
+        m_config.scope = (HashScope)scopeIdx;
+
     // Hash strings
     m_config.sha1Expected   = GetControlText(IDC_EDIT_SHA1);
     m_config.sha256Expected = GetControlText(IDC_EDIT_SHA256);
@@ -318,3 +346,11 @@ void CHashConfigDlg::SetCheckState(int controlId, bool checked)
 {
     CheckDlgButton(controlId, checked ? BST_CHECKED : BST_UNCHECKED);
 }
+
+// ---------------------------------------------------------------------------
+// Helper: select what the hashes cover
+// ---------------------------------------------------------------------------
+void CHashConfigDlg::SetScope(HashScope scope)
+{
+    SendDlgItemMessage(IDC_COMBO_HASH_SCOPE, CB_SETCURSEL, (WPARAM)scope, 0);
+}
@@ -50,5 +50,6 @@ private:
     bool         GetCheckState (int controlId);
     void         SetControlText(int controlId, const std::wstring& text);
     void         SetCheckState (int controlId, bool checked);
+    void         SetScope      (HashScope scope);
     void         UpdateStatusLabels();
 };
@@ -7,16 +7,18 @@
 #include "OdinMDlg.h"
 #include "HashConfigDlg.h"
 #include "HashCalculator.h"
+#include "..\ODIN\PartitionHasher.h"
+#include "..\ODIN\Exception.h"
 #include <dbt.h>
+#include <setupapi.h>
+#include <cfgmgr32.h>
 
 // ListView column indices
 enum { COL_SLOT=0, COL_DRIVE, COL_NAME, COL_SIZE, COL_STATUS, COL_PROGRESS, COL_SHA1, COL_SHA256, COL_COUNT };
-static const UINT_PTR POLL_TIMER_ID          = 1;
 static const UINT_PTR DEVICE_SETTLE_TIMER_ID = 2;
-static const UINT     POLL_INTERVAL          = 2000;
 
 // --- Constructor/Destructor ---
-COdinMDlg::COdinMDlg() : m_autoCloneEnabled(false), m_maxConcurrent(2), m_timer(0)
+COdinMDlg::COdinMDlg() : m_autoCloneEnabled(false), m_maxConcurrent(2), m_scheduler(2)
 {
     for (int i = 0; i < 5; i++)
         m_driveSlots.emplace_back(std::make_unique<CDriveSlot>(i + 1));
@@ -24,11 +26,10 @@ COdinMDlg::COdinMDlg() : m_autoCloneEnabled(false), m_maxConcurrent(2), m_timer(
 COdinMDlg::~COdinMDlg() { }
 
 // --- OnDestroy ---
-// Kill the poll timer here while m_hWnd is still valid.
+// Kill the timer here while m_hWnd is still valid.
 // Never call KillTimer() from the destructor — the window is gone by then.
 LRESULT COdinMDlg::OnDestroy(UINT, WPARAM, LPARAM, BOOL& handled)
 {
-    if (m_timer) { ::KillTimer(m_hWnd, m_timer); m_timer = 0; }
     ::KillTimer(m_hWnd, DEVICE_SETTLE_TIMER_ID); // safe no-op if not active
     if (m_darkBgBrush)   { ::DeleteObject(m_darkBgBrush);   m_darkBgBrush   = nullptr; }
     if (m_darkEditBrush) { ::DeleteObject(m_darkEditBrush); m_darkEditBrush = nullptr; }
@@ -53,7 +54,6 @@ LRESULT COdinMDlg::OnInitDialog(UINT, WPARAM, LPARAM, BOOL& handled)
     RefreshDrives();
     UpdateDriveList();
     UpdateStatus();
-    m_timer = SetTimer(POLL_TIMER_ID, POLL_INTERVAL);
     CenterWindow();
     Log(L"OdinM started. Ready.");
     ApplyDarkMode(m_hWnd);       // create brushes before first paint
@@ -68,7 +68,7 @@ void COdinMDlg::InitializeDriveList()
     m_driveList.SetExtendedListViewStyle(LVS_EX_FULLROWSELECT | LVS_EX_GRIDLINES | LVS_EX_DOUBLEBUFFER);
     struct { const wchar_t* title; int width; } cols[COL_COUNT] = {
         {L"Slot",     40}, {L"Drive",    55}, {L"Name",   110},
-        {L"Size",     65}, {L"Status",   75}, {L"Progress", 60},
+        {L"Size",     65}, {L"Status",   75}, {L"Progress", 120},
         {L"SHA-1",   185}, {L"SHA-256", 185}
     };
     for (int i = 0; i < COL_COUNT; i++) {
@@ -172,64 +172,100 @@ LRESULT COdinMDlg::OnTimer(UINT, WPARAM wParam, LPARAM, BOOL& handled)
         UpdateStatus();
         Log(L"Device change detected.");
         if (m_pendingArrival && m_autoCloneEnabled && IsValidImageFile(m_imagePath)) {
+            std::vector<int> arrived;
             for (int i = 0; i < (int)m_driveSlots.size(); i++) {
                 const std::wstring& letter = m_driveSlots[i]->GetDriveLetter();
                 if (!letter.empty() && letter != prevLetters[i])
-                    StartClone(i);
+                    arrived.push_back(i);
             }
+            if (!arrived.empty()) QueueClones(arrived);
         }
-        handled = TRUE;
-        return 0;
     }
+    handled = TRUE;
+    return 0;
+}
 
-    if (wParam == POLL_TIMER_ID) {
-        bool anyActive = false;
-        for (int i = 0; i < (int)m_driveSlots.size(); i++) {
-            CDriveSlot* slot = m_driveSlots[i].get();
-            if (slot->GetStatus() == CloneStatus::Cloning && slot->GetProcessId()) {
-                anyActive = true;
-                HANDLE hProc = OpenProcess(PROCESS_QUERY_INFORMATION | SYNCHRONIZE,
-                                           FALSE, slot->GetProcessId());
-                if (hProc) {
-                    DWORD exit = STILL_ACTIVE;
-                    GetExitCodeProcess(hProc, &exit);
-                    CloseHandle(hProc);
-                    if (exit != STILL_ACTIVE) {
-                        slot->SetProcessId(0);
-                        if (exit == 0) {
-                            slot->SetProgress(100);
-                            LogDrive(i, L"Clone complete.");
-                            if (m_verifyHashCheck.GetCheck() == BST_CHECKED)
-                                VerifyDrive(i);
-                            else
-                                slot->SetStatus(CloneStatus::Complete);
-                        } else {
-                            slot->SetStatus(CloneStatus::Failed);
-                            LogDrive(i, L"Clone failed (exit " + std::to_wstring(exit) + L").");
-                        }
-                    }
-                } else {
-                    slot->SetProcessId(0);
-                    slot->SetProgress(100);
-                    slot->SetStatus(CloneStatus::Complete);
-                    VerifyDrive(i);
-                }
-            }
-        }
-        if (anyActive) {
-            UpdateDriveList();
-            UpdateStatus();
+// --- OnCloneEvent ---
+// Events of the ODINC.exe of a batch, see CCloneEventReader. A batch is done when
+// ODINC.exe reports the end of the restore, "exit" only matters if it ended without.
+LRESULT COdinMDlg::OnCloneEvent(UINT, WPARAM, LPARAM lParam, BOOL& handled)
+{
+    std::unique_ptr<CloneEvent> ev(reinterpret_cast<CloneEvent*>(lParam));
+    handled = TRUE;
+    std::vector<int> batch;
+    for (int i = 0; i < (int)m_driveSlots.size(); i++) {
+        CDriveSlot* slot = m_driveSlots[i].get();
+        if (slot->GetStatus() == CloneStatus::Cloning && slot->GetProcessId() == ev->processId)
+            batch.push_back(i);
+    }
+    if (batch.empty()) return 0;  // stopped or already finished
+
+    if (ev->name == L"progress") {
+        ULONGLONG total = ev->Number(L"total"), bytes = ev->Number(L"bytes");
+        int percent = total ? (int)(min(bytes, total) * 100 / total) : 0;
+        ULONGLONG now = GetTickCount64();
+        for (int idx : batch) {
+            m_driveSlots[idx]->SetProgress(min(percent, 99));
+            m_driveSlots[idx]->SetRate(ev->Number(L"rate"));
+            m_scheduler.OnRate(idx, ev->Number(L"rate"), now);
         }
+        AdmitQueued();
+        UpdateDriveList();
+    } else if (ev->name == L"stage") {
+        for (int idx : batch) LogDrive(idx, L"ODINC: " + ev->Value(L"name"));
+    } else if (ev->name == L"finished") {
+        std::wstring error = ev->Value(L"error");
+        if (!error.empty())
+            for (int idx : batch) LogDrive(idx, L"ODINC: " + error);
+        FinishClones(batch, (DWORD)_wtoi(ev->Value(L"exit").c_str()));
+    } else if (ev->name == L"exit") {
+        FinishClones(batch, (DWORD)ev->Number(L"code"));
     }
-    handled = TRUE;
     return 0;
 }
 
+// --- FinishClones ---
+// The drives of a batch finish together, the ones without hashes from ODINC.exe
+// are read back in parallel
+void COdinMDlg::FinishClones(const std::vector<int>& slotIndexes, DWORD exit)
+{
+    std::vector<int> toVerify;
+    ULONGLONG now = GetTickCount64();
+    for (int i : slotIndexes) {
+        CDriveSlot* slot = m_driveSlots[i].get();
+        m_scheduler.OnFinished(i, now);
+        // a batch restores all its drives in one process, 0x10000 in the
+        // exit code flags that only the drives with their bit set failed
+        int target = slot->GetBatchTarget();
+        bool ok = exit == 0 || ((exit & 0x10000) && target >= 0 && !(exit & (1u << target)));
+        slot->SetProcessId(0);
+        slot->SetRate(0);
+        if (ok) {
+            slot->SetProgress(100);
+            LogDrive(i, L"Clone complete.");
+            // hashes calculated while restoring, read the drive again only without them
+            if (m_verifyHashCheck.GetCheck() == BST_CHECKED && !VerifyDriveFromResult(i))
+                toVerify.push_back(i);
+            else if (m_verifyHashCheck.GetCheck() != BST_CHECKED)
+                slot->SetStatus(CloneStatus::Complete);
+        } else {
+            slot->SetStatus(CloneStatus::Failed);
+            LogDrive(i, L"Clone failed (exit " + std::to_wstring((int)exit) + L").");
+        }
+        ReleaseResultFile(i);
+    }
+    if (!toVerify.empty())
+        VerifyDrives(toVerify);
+    AdmitQueued();
+    UpdateDriveList();
+    UpdateStatus();
+}
+
 // --- OnOK ---
 LRESULT COdinMDlg::OnOK(WORD, WORD, HWND, BOOL& handled)
 {
     for (auto& s : m_driveSlots)
-        if (s->IsActive()) {
+        if (s->IsActive() || s->IsQueued()) {
             MessageBox(L"Please stop all active operations before closing.", L"Busy", MB_ICONWARNING);
             handled = TRUE; return 0;
         }
@@ -295,12 +331,12 @@ LRESULT COdinMDlg::OnStartAll(WORD, WORD, HWND, BOOL& handled)
         MessageBox(L"Please select a valid ODIN image file first.", L"No Image", MB_ICONWARNING);
         handled = TRUE; return 0;
     }
-    int idx = m_maxConcurrentCombo.GetCurSel();
-    if (idx != CB_ERR) m_maxConcurrent = idx + 1;
-    int started = 0;
-    for (int i = 0; i < (int)m_driveSlots.size() && started < m_maxConcurrent; i++)
-        if (m_driveSlots[i]->GetStatus() == CloneStatus::Ready) { StartClone(i); started++; }
-    if (started == 0)
+    std::vector<int> ready;
+    for (int i = 0; i < (int)m_driveSlots.size(); i++)
+        if (m_driveSlots[i]->GetStatus() == CloneStatus::Ready) ready.push_back(i);
+    if (!ready.empty())
+        QueueClones(ready);
+    else
         MessageBox(L"No drives are ready to clone.", L"Nothing to do", MB_ICONINFORMATION);
     handled = TRUE; return 0;
 }
@@ -309,7 +345,7 @@ LRESULT COdinMDlg::OnStartAll(WORD, WORD, HWND, BOOL& handled)
 LRESULT COdinMDlg::OnStopAll(WORD, WORD, HWND, BOOL& handled)
 {
     for (int i = 0; i < (int)m_driveSlots.size(); i++)
-        if (m_driveSlots[i]->IsActive()) StopClone(i);
+        if (m_driveSlots[i]->IsActive() || m_driveSlots[i]->IsQueued()) StopClone(i);
     handled = TRUE; return 0;
 }
 
@@ -364,6 +400,7 @@ void COdinMDlg::RefreshDrives()
         if (GetDriveTypeW(root) != DRIVE_REMOVABLE) continue;
         std::wstring letter(1, L'A' + i); letter += L":";
         m_driveSlots[slot]->SetDrive(letter, GetDriveName(root), GetDriveSize(letter));
+        m_driveSlots[slot]->SetBusGroup(GetBusGroup(letter));
         slot++;
     }
 }
@@ -383,8 +420,9 @@ void COdinMDlg::DetectNewDrives()
             for (int j = 0; j < (int)m_driveSlots.size(); j++) {
                 if (m_driveSlots[j]->IsEmpty()) {
                     m_driveSlots[j]->SetDrive(letter, GetDriveName(root), GetDriveSize(letter));
+                    m_driveSlots[j]->SetBusGroup(GetBusGroup(letter));
                     LogDrive(j, L"Drive inserted: " + letter);
-                    if (m_autoCloneEnabled && IsValidImageFile(m_imagePath)) StartClone(j);
+                    if (m_autoCloneEnabled && IsValidImageFile(m_imagePath)) QueueClones(std::vector<int>(1, j));
                     break;
                 }
             }
@@ -395,34 +433,133 @@ void COdinMDlg::DetectNewDrives()
 // --- StartClone ---
 void COdinMDlg::StartClone(int idx)
 {
-    CDriveSlot* slot = m_driveSlots[idx].get();
-    if (!slot || slot->IsEmpty() || slot->IsActive()) return;
+    StartClones(std::vector<int>(1, idx));
+}
+
+// --- StartClones ---
+// One ODINC.exe restores the image to all drives of the batch: the image is
+// read and decompressed once and the data is shared by one writer per drive.
+void COdinMDlg::StartClones(const std::vector<int>& slotIndexes)
+{
+    std::vector<int> batch;
+    std::wstring targets;
+    for (int idx : slotIndexes) {
+        CDriveSlot* slot = m_driveSlots[idx].get();
+        if (!slot || slot->IsEmpty() || slot->IsActive()) continue;
+        if (batch.size() == 16) break; // ODINC reports failed drives in 16 bits
+        if (!targets.empty()) targets += L",";
+        targets += slot->GetDriveLetter();
+        batch.push_back(idx);
+    }
+    if (batch.empty()) return;
     wchar_t exe[MAX_PATH]; GetModuleFileNameW(NULL, exe, MAX_PATH); PathRemoveFileSpecW(exe);
     std::wstring cmd = L"\"" + std::wstring(exe) + L"\\ODINC.exe\""
-        + L" --source \"" + m_imagePath + L"\" --target " + slot->GetDriveLetter();
-    STARTUPINFOW si = {}; PROCESS_INFORMATION pi = {}; si.cb = sizeof(si);
-    if (CreateProcessW(NULL, &cmd[0], NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi)) {
-        slot->SetStatus(CloneStatus::Cloning); slot->SetProgress(0); slot->SetProcessId(pi.dwProcessId);
-        CloseHandle(pi.hThread); CloseHandle(pi.hProcess);
-        LogDrive(idx, L"Clone started to " + slot->GetDriveLetter());
+        + L" -restore -force -source=\"" + m_imagePath + L"\" -target=" + targets;
+    // let ODINC hash the data while writing them, so verify does not read the drives again;
+    // hashes of the whole drive cannot be calculated that way
+    std::wstring resultFile;
+    bool sha1 = !m_hashConfig.sha1Expected.empty(), sha256 = !m_hashConfig.sha256Expected.empty();
+    if (m_verifyHashCheck.GetCheck() == BST_CHECKED && (sha1 || sha256) && m_hashConfig.scope != HashScope::Drive) {
+        wchar_t tempDir[MAX_PATH], tempFile[MAX_PATH];
+        if (GetTempPathW(MAX_PATH, tempDir) && GetTempFileNameW(tempDir, L"odm", 0, tempFile)) {
+            resultFile = tempFile;
+            cmd += std::wstring(L" -hash=") + (sha1 && sha256 ? L"both" : (sha1 ? L"sha1" : L"sha256"))
+                + L" -output=\"" + resultFile + L"\"";
+            if (m_hashConfig.scope == HashScope::UsedClusters)
+                cmd += L" -hashscope=used";
+        }
+    }
+    // progress and end of the batch arrive as WM_CLONE_EVENT
+    DWORD processId = 0;
+    if (CCloneEventReader::Launch(cmd, m_hWnd, processId)) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            CDriveSlot* slot = m_driveSlots[batch[i]].get();
+            slot->SetStatus(CloneStatus::Cloning); slot->SetProgress(0); slot->SetRate(0); slot->SetProcessId(processId);
+            slot->SetBatchTarget((int)i);
+            slot->SetResultFile(resultFile);
+            LogDrive(batch[i], L"Clone started to " + slot->GetDriveLetter());
+        }
+        if (batch.size() > 1)
+            Log(L"Restoring " + std::to_wstring(batch.size()) + L" drives in one pass: " + targets);
     } else {
-        slot->SetStatus(CloneStatus::Failed);
-        LogDrive(idx, L"Failed to launch ODINC.exe (err " + std::to_wstring(GetLastError()) + L")");
+        DWORD err = GetLastError();
+        if (!resultFile.empty()) DeleteFileW(resultFile.c_str());
+        for (int idx : batch) {
+            m_driveSlots[idx]->SetStatus(CloneStatus::Failed);
+            LogDrive(idx, L"Failed to launch ODINC.exe (err " + std::to_wstring(err) + L")");
+        }
     }
     UpdateDriveList();
 }
 
+// --- QueueClones ---
+// Drives wait as Queued until the scheduler lets another clone run on their bus
+void COdinMDlg::QueueClones(const std::vector<int>& slotIndexes)
+{
+    int idx = m_maxConcurrentCombo.GetCurSel();
+    if (idx != CB_ERR) m_maxConcurrent = idx + 1;
+    m_scheduler.SetMaxConcurrent(m_maxConcurrent);
+    for (int i : slotIndexes) {
+        CDriveSlot* slot = m_driveSlots[i].get();
+        if (slot->IsEmpty() || slot->IsActive() || slot->IsQueued()) continue;
+        slot->SetStatus(CloneStatus::Queued); slot->SetProgress(0);
+    }
+    AdmitQueued();
+    UpdateDriveList();
+    UpdateStatus();
+}
+
+// --- AdmitQueued ---
+// Start the queued drives whose bus still writes faster with one more clone, in
+// slot order. The admitted drives are restored by one ODINC.exe.
+void COdinMDlg::AdmitQueued()
+{
+    while (true) {
+        ULONGLONG now = GetTickCount64();
+        std::vector<int> admitted;
+        for (int i = 0; i < (int)m_driveSlots.size(); i++) {
+            CDriveSlot* slot = m_driveSlots[i].get();
+            if (!slot->IsQueued() || !m_scheduler.MayStart(slot->GetBusGroup())) continue;
+            m_scheduler.OnStarted(i, slot->GetBusGroup(), now);
+            admitted.push_back(i);
+        }
+        if (admitted.empty()) break;
+        StartClones(admitted);
+        // drives that failed to launch leave room for others
+        bool launched = true;
+        for (int i : admitted)
+            if (!m_driveSlots[i]->IsActive()) { m_scheduler.OnFinished(i, now); launched = false; }
+        if (launched) break;
+    }
+    UpdateStatus();
+}
+
 // --- StopClone ---
 void COdinMDlg::StopClone(int idx)
 {
     CDriveSlot* slot = m_driveSlots[idx].get();
+    if (slot && slot->IsQueued()) {
+        slot->SetStatus(CloneStatus::Stopped);
+        LogDrive(idx, L"Clone stopped.");
+        UpdateDriveList();
+        return;
+    }
     if (!slot || !slot->IsActive()) return;
-    if (slot->GetProcessId()) {
-        HANDLE h = OpenProcess(PROCESS_TERMINATE, FALSE, slot->GetProcessId());
+    DWORD pid = slot->GetProcessId();
+    if (pid) {
+        HANDLE h = OpenProcess(PROCESS_TERMINATE, FALSE, pid);
         if (h) { TerminateProcess(h, 1); CloseHandle(h); }
     }
-    slot->SetStatus(CloneStatus::Stopped); slot->SetProcessId(0);
-    LogDrive(idx, L"Clone stopped."); UpdateDriveList();
+    // all drives of the batch are written by the same process and stop with it
+    for (int i = 0; i < (int)m_driveSlots.size(); i++) {
+        CDriveSlot* s = m_driveSlots[i].get();
+        if (i != idx && (!pid || s->GetProcessId() != pid)) continue;
+        s->SetStatus(CloneStatus::Stopped); s->SetProcessId(0);
+        m_scheduler.OnFinished(i, GetTickCount64());
+        ReleaseResultFile(i);
+        LogDrive(i, L"Clone stopped.");
+    }
+    UpdateDriveList();
 }
 
 // --- UpdateDriveList ---
@@ -448,13 +585,15 @@ void COdinMDlg::UpdateDriveList()
 // --- UpdateStatus ---
 void COdinMDlg::UpdateStatus()
 {
-    int active=0, complete=0, failed=0;
+    int active=0, queued=0, complete=0, failed=0;
     for (auto& s : m_driveSlots) {
         if (s->IsActive())   active++;
+        if (s->IsQueued())   queued++;
         if (s->IsComplete()) complete++;
         if (s->IsFailed())   failed++;
     }
-    wchar_t buf[128]; swprintf_s(buf, L"Active: %d  |  Complete: %d  |  Failed: %d", active, complete, failed);
+    wchar_t buf[160]; swprintf_s(buf, L"Active: %d  |  Queued: %d  |  Complete: %d  |  Failed: %d",
+                                 active, queued, complete, failed);
     m_statusStatic.SetWindowText(buf);
 }
 
@@ -471,9 +610,20 @@ void COdinMDlg::Log(const std::wstring& msg)
 void COdinMDlg::LogDrive(int slot, const std::wstring& msg) { Log(L"Slot " + std::to_wstring(slot+1) + L": " + msg); }
 
 // --- LoadHashConfig ---
+// Images made with "odinc -backup -hash=..." carry the expected hashes in their
+// header, the <image>.hashcfg sidecar is only used for images without them
 bool COdinMDlg::LoadHashConfig(const std::wstring& imagePath)
 {
     if (imagePath.empty()) return false;
+    std::wstring sha1, sha256;
+    bool usedOnly = false;
+    if (CHashCalculator::ReadImageHashes(imagePath, sha1, sha256, &usedOnly)) {
+        m_hashConfig.sha1Expected   = sha1;
+        m_hashConfig.sha256Expected = sha256;
+        m_hashConfig.scope = usedOnly ? HashScope::UsedClusters : HashScope::Volume;
+        Log(L"Expected hashes read from image header.");
+        return true;
+    }
     std::wstring cfg = imagePath + L".hashcfg";
     HANDLE hf = CreateFileW(cfg.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     if (hf == INVALID_HANDLE_VALUE) return false;
@@ -489,6 +639,10 @@ bool COdinMDlg::LoadHashConfig(const std::wstring& imagePath)
     };
     m_hashConfig.sha1Expected   = parse("SHA1");
     m_hashConfig.sha256Expected = parse("SHA256");
+    // sidecars without a scope were made for hashing the whole drive
+    std::wstring scope = parse("Scope");
+    m_hashConfig.scope = scope == L"used" ? HashScope::UsedClusters
+                       : (scope == L"volume" ? HashScope::Volume : HashScope::Drive);
     return true;
 }
 
@@ -507,38 +661,120 @@ bool COdinMDlg::SaveHashConfig(const std::wstring& imagePath)
             s += static_cast<char>(c);
         return s;
     };
+    const char* scope = m_hashConfig.scope == HashScope::UsedClusters ? "used"
+                      : (m_hashConfig.scope == HashScope::Volume ? "volume" : "drive");
     std::string content = "SHA1="   + n(m_hashConfig.sha1Expected)   + "\r\n"
-                        + "SHA256=" + n(m_hashConfig.sha256Expected) + "\r\n";
+                        + "SHA256=" + n(m_hashConfig.sha256Expected) + "\r\n"
+                        + "Scope="  + scope + "\r\n";
     DWORD w; WriteFile(hf, content.c_str(), (DWORD)content.size(), &w, NULL);
     CloseHandle(hf); return true;
 }
 
-// --- VerifyDrive ---
-void COdinMDlg::VerifyDrive(int idx)
+// --- VerifyDrives ---
+// Reads the drives back, each on its own thread. Unless the expected hashes cover
+// the whole drive, only the used clusters in the allocation map of the image are
+// read, so the time depends on the data in the image and not on the drive size.
+void COdinMDlg::VerifyDrives(const std::vector<int>& slotIndexes)
 {
-    CDriveSlot* slot = m_driveSlots[idx].get();
-    if (!slot || slot->IsEmpty()) return;
-    slot->SetStatus(CloneStatus::Verifying);
-    LogDrive(idx, L"Verifying hashes...");
-    // Open the physical drive device
-    std::wstring dev = L"\\\\.\\PhysicalDrive";  // fallback — prefer drive letter
-    std::wstring drv = L"\\\\.\\";
-    drv += slot->GetDriveLetter()[0];  // e.g. \\.\F:
-    drv += L":";
-    HANDLE hDrive = CreateFileW(drv.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
-                                NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
-    if (hDrive == INVALID_HANDLE_VALUE) {
-        slot->SetStatus(CloneStatus::Failed);
-        LogDrive(idx, L"Cannot open drive for verification.");
-        return;
+    CPartitionHasher::TPartition layout = {};
+    if (m_hashConfig.scope != HashScope::Drive) {
+        try {
+            CPartitionHasher::ReadImageLayout(m_imagePath.c_str(), layout);
+        } catch (Exception& e) {
+            Log(L"Cannot read allocation map of image: " + std::wstring(e.GetMessage()));
+            for (int idx : slotIndexes) m_driveSlots[idx]->SetStatus(CloneStatus::Failed);
+            return;
+        }
     }
-    LARGE_INTEGER driveSize = {};
-    if (!GetFileSizeEx(hDrive, &driveSize)) driveSize.QuadPart = (LONGLONG)slot->GetDriveSize();
+    std::vector<int> slots;
+    std::vector<HANDLE> handles;
+    std::vector<CPartitionHasher::TPartition> partitions;
+    for (int idx : slotIndexes) {
+        CDriveSlot* slot = m_driveSlots[idx].get();
+        if (!slot || slot->IsEmpty()) continue;
+        slot->SetStatus(CloneStatus::Verifying);
+        LogDrive(idx, L"Verifying hashes...");
+        std::wstring drv = L"\\\\.\\";
+        drv += slot->GetDriveLetter()[0];  // e.g. \\.\F:
+        drv += L":";
+        HANDLE hDrive = CreateFileW(drv.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                    NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (hDrive == INVALID_HANDLE_VALUE) {
+            slot->SetStatus(CloneStatus::Failed);
+            LogDrive(idx, L"Cannot open drive for verification.");
+            continue;
+        }
+        CPartitionHasher::TPartition partition = layout;
+        if (m_hashConfig.scope == HashScope::Drive) {
+            LARGE_INTEGER driveSize = {};
+            if (!GetFileSizeEx(hDrive, &driveSize)) driveSize.QuadPart = (LONGLONG)slot->GetDriveSize();
+            partition.volumeSize = (ULONGLONG)driveSize.QuadPart;
+        }
+        // positioned reads, the handle is used by the hashing thread of this drive only
+        partition.readAt = [hDrive](unsigned __int64 offset, BYTE* buffer, unsigned size, unsigned& bytesRead) {
+            OVERLAPPED ov = {};
+            ov.Offset = (DWORD)offset;
+            ov.OffsetHigh = (DWORD)(offset >> 32);
+            DWORD read = 0;
+            if (!ReadFile(hDrive, buffer, size, &read, &ov))
+                return false;
+            bytesRead = read;
+            return true;
+        };
+        slots.push_back(idx);
+        handles.push_back(hDrive);
+        partitions.push_back(partition);
+    }
+    if (partitions.empty()) return;
+
+    unsigned algorithms = (m_hashConfig.sha1Expected.empty() ? 0 : CMediaHash::hashSha1)
+                        | (m_hashConfig.sha256Expected.empty() ? 0 : CMediaHash::hashSha256);
+    if (!algorithms) algorithms = CMediaHash::hashSha1 | CMediaHash::hashSha256;
+    CPartitionHasher hasher(algorithms, m_hashConfig.scope == HashScope::UsedClusters
+                                        ? CMediaHash::scopeUsedClusters : CMediaHash::scopeVolume);
+    hasher.Calculate(partitions);
+    for (size_t i = 0; i < slots.size(); i++) {
+        CloseHandle(handles[i]);
+        if (!partitions[i].ok) {
+            m_driveSlots[slots[i]]->SetStatus(CloneStatus::Failed);
+            LogDrive(slots[i], L"Hash calculation failed.");
+            continue;
+        }
+        VerificationResult vr;
+        vr.sha1Value = partitions[i].sha1;
+        vr.sha256Value = partitions[i].sha256;
+        CompareHashes(slots[i], vr);
+    }
+}
+
+// --- VerifyDriveFromResult ---
+// Uses the hashes ODINC calculated while writing the drive, false if there are none
+bool COdinMDlg::VerifyDriveFromResult(int idx)
+{
+    CDriveSlot* slot = m_driveSlots[idx].get();
+    if (slot->GetResultFile().empty() || slot->GetBatchTarget() < 0) return false;
+    wchar_t section[16]; swprintf_s(section, L"Target%d", slot->GetBatchTarget());
+    wchar_t scope[16] = {};
+    GetPrivateProfileStringW(section, L"HashScope", L"volume", scope, _countof(scope), slot->GetResultFile().c_str());
+    if ((m_hashConfig.scope == HashScope::UsedClusters) != (wcscmp(scope, L"used") == 0))
+        return false;
+    wchar_t sha1[64] = {}, sha256[80] = {};
+    GetPrivateProfileStringW(section, L"SHA1", L"", sha1, _countof(sha1), slot->GetResultFile().c_str());
+    GetPrivateProfileStringW(section, L"SHA256", L"", sha256, _countof(sha256), slot->GetResultFile().c_str());
+    if ((!m_hashConfig.sha1Expected.empty() && !sha1[0]) || (!m_hashConfig.sha256Expected.empty() && !sha256[0]))
+        return false;
     VerificationResult vr;
-    bool ok = CHashCalculator::CalculateBothHashes(hDrive, 0, (ULONGLONG)driveSize.QuadPart,
-                                                   vr.sha1Value, vr.sha256Value);
-    CloseHandle(hDrive);
-    if (!ok) { slot->SetStatus(CloneStatus::Failed); LogDrive(idx, L"Hash calculation failed."); return; }
+    vr.sha1Value = sha1;
+    vr.sha256Value = sha256;
+    LogDrive(idx, L"Verifying hashes calculated while writing...");
+    CompareHashes(idx, vr);
+    return true;
+}
+
+// --- CompareHashes ---
+void COdinMDlg::CompareHashes(int idx, VerificationResult& vr)
+{
+    CDriveSlot* slot = m_driveSlots[idx].get();
     vr.sha1Pass   = !m_hashConfig.sha1Expected.empty()   && vr.sha1Value   == m_hashConfig.sha1Expected;
     vr.sha256Pass = !m_hashConfig.sha256Expected.empty() && vr.sha256Value == m_hashConfig.sha256Expected;
     bool sha1ok   = m_hashConfig.sha1Expected.empty()   || vr.sha1Pass;
@@ -549,10 +785,25 @@ void COdinMDlg::VerifyDrive(int idx)
     LogDrive(idx, std::wstring(L"Verification ") + (vr.overallPass ? L"PASSED." : L"FAILED."));
     if (!vr.overallPass && m_stopOnFailCheck.GetCheck() == BST_CHECKED) {
         Log(L"Stop-on-fail: halting remaining operations.");
-        for (int j = 0; j < (int)m_driveSlots.size(); j++) if (m_driveSlots[j]->IsActive()) StopClone(j);
+        for (int j = 0; j < (int)m_driveSlots.size(); j++)
+            if (m_driveSlots[j]->IsActive() || m_driveSlots[j]->IsQueued()) StopClone(j);
     }
 }
 
+// --- ReleaseResultFile ---
+// The result file is shared by all drives of a batch, delete it with the last one
+void COdinMDlg::ReleaseResultFile(int idx)
+{
+    CDriveSlot* slot = m_driveSlots[idx].get();
+    std::wstring file = slot->GetResultFile();
+    slot->SetResultFile(L"");
+    slot->SetBatchTarget(-1);
+    if (file.empty()) return;
+    for (auto& s : m_driveSlots)
+        if (s->GetResultFile() == file) return;
+    DeleteFileW(file.c_str());
+}
+
 // --- GetTimeString ---
 std::wstring COdinMDlg::GetTimeString()
 {
@@ -585,6 +836,64 @@ std::wstring COdinMDlg::GetDriveName(const std::wstring& root)
     return label[0] ? std::wstring(label) : L"Removable";
 }
 
+// --- GetBusGroup ---
+// Drives behind the same hub, card reader or controller port share its bandwidth.
+// The group is the device directly below the USB root hub (or the controller) the
+// disk of the drive is attached to, the drive letter if it cannot be found.
+std::wstring COdinMDlg::GetBusGroup(const std::wstring& letter)
+{
+    // GUID_DEVINTERFACE_DISK
+    static const GUID diskInterface = { 0x53f56307, 0xb6bf, 0x11d0, { 0x94, 0xf2, 0x00, 0xa0, 0xc9, 0x1e, 0xfb, 0x8b } };
+    auto deviceNumber = [](const wchar_t* path, STORAGE_DEVICE_NUMBER& sdn) -> bool {
+        HANDLE h = CreateFileW(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        if (h == INVALID_HANDLE_VALUE) return false;
+        DWORD ret = 0;
+        BOOL ok = DeviceIoControl(h, IOCTL_STORAGE_GET_DEVICE_NUMBER, NULL, 0, &sdn, sizeof(sdn), &ret, NULL);
+        CloseHandle(h);
+        return ok != FALSE;
+    };
+    std::wstring dev = L"\\\\.\\"; dev += letter[0]; dev += L":";
+    STORAGE_DEVICE_NUMBER volume = {};
+    if (!deviceNumber(dev.c_str(), volume)) return letter;
+
+    // find the disk with the number of the volume
+    DEVINST disk = 0;
+    HDEVINFO devs = SetupDiGetClassDevsW(&diskInterface, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+    if (devs == INVALID_HANDLE_VALUE) return letter;
+    SP_DEVICE_INTERFACE_DATA ifData = { sizeof(ifData) };
+    for (DWORD i = 0; !disk && SetupDiEnumDeviceInterfaces(devs, NULL, &diskInterface, i, &ifData); i++) {
+        DWORD size = 0;
+        SetupDiGetDeviceInterfaceDetailW(devs, &ifData, NULL, 0, &size, NULL);
+        if (size == 0) continue;
+        std::vector<BYTE> buf(size);
+        PSP_DEVICE_INTERFACE_DETAIL_DATA_W detail = reinterpret_cast<PSP_DEVICE_INTERFACE_DETAIL_DATA_W>(&buf[0]);
+        detail->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA_W);
+        SP_DEVINFO_DATA devData = { sizeof(devData) };
+        if (!SetupDiGetDeviceInterfaceDetailW(devs, &ifData, detail, size, NULL, &devData)) continue;
+        STORAGE_DEVICE_NUMBER sdn = {};
+        if (deviceNumber(detail->DevicePath, sdn) && sdn.DeviceType == volume.DeviceType && sdn.DeviceNumber == volume.DeviceNumber)
+            disk = devData.DevInst;
+    }
+    SetupDiDestroyDeviceInfoList(devs);
+    if (!disk) return letter;
+
+    // walk up to the device below the root hub or the controller
+    auto instanceId = [](DEVINST inst) -> std::wstring {
+        wchar_t id[MAX_DEVICE_ID_LEN] = {};
+        return CM_Get_Device_IDW(inst, id, MAX_DEVICE_ID_LEN, 0) == CR_SUCCESS ? std::wstring(id) : std::wstring();
+    };
+    DEVINST node = disk, parent = 0;
+    while (CM_Get_Parent(&parent, node, 0) == CR_SUCCESS) {
+        std::wstring id = instanceId(parent);
+        if (id.empty() || _wcsnicmp(id.c_str(), L"USB\\ROOT_HUB", 12) == 0 || _wcsnicmp(id.c_str(), L"PCI\\", 4) == 0
+            || _wcsnicmp(id.c_str(), L"ACPI\\", 5) == 0 || _wcsnicmp(id.c_str(), L"HTREE\\", 6) == 0)
+            break;
+        node = parent;
+    }
+    std::wstring group = instanceId(node);
+    return group.empty() ? letter : group;
+}
+
 // ── Dark mode ────────────────────────────────────────────────────────────────
 // Title bar:  DwmSetWindowAttribute (loaded at runtime via dwmapi.dll)
 // Client area: AllowDarkModeForWindow (uxtheme ordinal 133) + WM_CTLCOLOR* +
@@ -775,7 +1084,7 @@ COLORREF COdinMDlg::StatusColor(CloneStatus s) {
     }
 }
 
-void COdinMDlg::DrawProgressCell(HDC hdc, RECT rc, int progress) {
+void COdinMDlg::DrawProgressCell(HDC hdc, RECT rc, int progress, const std::wstring& text) {
     // Background: system window color (adapts to dark/light mode)
     FillRect(hdc, &rc, ::GetSysColorBrush(COLOR_WINDOW));
     // Blue filled portion
@@ -784,12 +1093,10 @@ void COdinMDlg::DrawProgressCell(HDC hdc, RECT rc, int progress) {
     HBRUSH blueBrush = CreateSolidBrush(RGB(0, 120, 215));
     FillRect(hdc, &fill, blueBrush);
     DeleteObject(blueBrush);
-    // Percentage text centered (white over fill, system text color over bg)
-    wchar_t buf[8];
-    swprintf_s(buf, L"%d%%", progress);
+    // Percentage and rate centered (white over fill, system text color over bg)
     SetBkMode(hdc, TRANSPARENT);
     SetTextColor(hdc, progress > 50 ? RGB(255, 255, 255) : ::GetSysColor(COLOR_WINDOWTEXT));
-    DrawTextW(hdc, buf, -1, &rc, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
+    DrawTextW(hdc, text.c_str(), -1, &rc, DT_CENTER | DT_VCENTER | DT_SINGLELINE);
 }
 
 LRESULT COdinMDlg::OnListCustomDraw(int, LPNMHDR pnmh, BOOL& handled) {
@@ -817,7 +1124,8 @@ LRESULT COdinMDlg::OnListCustomDraw(int, LPNMHDR pnmh, BOOL& handled) {
             return CDRF_NEWFONT;
         }
         if (subItem == COL_PROGRESS && status == CloneStatus::Cloning) {
-            DrawProgressCell(pcd->nmcd.hdc, pcd->nmcd.rc, m_driveSlots[item]->GetProgress());
+            DrawProgressCell(pcd->nmcd.hdc, pcd->nmcd.rc, m_driveSlots[item]->GetProgress(),
+                             m_driveSlots[item]->GetProgressString());
             return CDRF_SKIPDEFAULT;
         }
         if (status == CloneStatus::Empty) {
@@ -9,12 +9,22 @@
 #include "stdafx.h"
 #include "resource.h"
 #include "DriveSlot.h"
+#include "CloneEvents.h"
+#include "..\ODIN\AdmissionScheduler.h"
 #include <vector>
 
+// What the expected hashes cover (digest definition), stored with the hash config
+enum class HashScope {
+    Drive,          // the whole drive as read from it
+    Volume,         // the volume in the image, free clusters as zeros (odinc -hash)
+    UsedClusters    // only the used clusters of the image (odinc -hash -hashscope=used)
+};
+
 // Hash configuration structure
 struct HashConfig {
     int partitionNumber = 1;
     std::wstring partitionType;
+    HashScope scope = HashScope::Drive;
     
     bool sha1Enabled = true;
     bool sha256Enabled = false;
@@ -41,6 +51,7 @@ public:
         MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
         MESSAGE_HANDLER(WM_DEVICECHANGE, OnDeviceChange)
         MESSAGE_HANDLER(WM_TIMER, OnTimer)
+        MESSAGE_HANDLER(WM_CLONE_EVENT, OnCloneEvent)
         COMMAND_ID_HANDLER(IDOK, OnOK)
         COMMAND_ID_HANDLER(IDCANCEL, OnCancel)
         COMMAND_ID_HANDLER(IDC_BUTTON_BROWSE, OnBrowse)
@@ -81,9 +92,9 @@ private:
     HashConfig m_hashConfig;
     bool m_autoCloneEnabled;
     int m_maxConcurrent;
-    UINT_PTR m_timer;
     bool m_pendingArrival = false;
     ULONGLONG m_lastDeviceChange = 0;
+    CAdmissionScheduler m_scheduler;  // how many clones may run on each bus
     
     // Initialization
     LRESULT OnInitDialog(UINT msg, WPARAM wParam, LPARAM lParam, BOOL& handled);
@@ -96,6 +107,7 @@ private:
     LRESULT OnDestroy(UINT msg, WPARAM wParam, LPARAM lParam, BOOL& handled);
     LRESULT OnDeviceChange(UINT msg, WPARAM wParam, LPARAM lParam, BOOL& handled);
     LRESULT OnTimer(UINT msg, WPARAM wParam, LPARAM lParam, BOOL& handled);
+    LRESULT OnCloneEvent(UINT msg, WPARAM wParam, LPARAM lParam, BOOL& handled);
     LRESULT OnOK(WORD code, WORD id, HWND hwnd, BOOL& handled);
     LRESULT OnCancel(WORD code, WORD id, HWND hwnd, BOOL& handled);
     LRESULT OnBrowse(WORD code, WORD id, HWND hwnd, BOOL& handled);
@@ -111,7 +123,11 @@ private:
     void RefreshDrives();
     void DetectNewDrives();
     void StartClone(int slotIndex);
+    void StartClones(const std::vector<int>& slotIndexes);
+    void QueueClones(const std::vector<int>& slotIndexes);
+    void AdmitQueued();
     void StopClone(int slotIndex);
+    void FinishClones(const std::vector<int>& slotIndexes, DWORD exitCode);
     void UpdateDriveList();
     void UpdateStatus();
     
@@ -122,13 +138,17 @@ private:
     // Hash operations
     bool LoadHashConfig(const std::wstring& imagePath);
     bool SaveHashConfig(const std::wstring& imagePath);
-    void VerifyDrive(int slotIndex);
+    void VerifyDrives(const std::vector<int>& slotIndexes);
+    bool VerifyDriveFromResult(int slotIndex);
+    void CompareHashes(int slotIndex, VerificationResult& result);
+    void ReleaseResultFile(int slotIndex);
     
     // Helper methods
     std::wstring GetTimeString();
     bool IsValidImageFile(const std::wstring& path);
     ULONGLONG GetDriveSize(const std::wstring& driveLetter);
     std::wstring GetDriveName(const std::wstring& driveLetter);
+    std::wstring GetBusGroup(const std::wstring& driveLetter);
 
     // Dark mode
     LRESULT OnSettingChange(UINT, WPARAM, LPARAM, BOOL&);
@@ -144,6 +164,6 @@ private:
 
     // ListView custom draw
     LRESULT  OnListCustomDraw(int, LPNMHDR pnmh, BOOL& handled);
-    void     DrawProgressCell(HDC hdc, RECT rc, int progress);
+    void     DrawProgressCell(HDC hdc, RECT rc, int progress, const std::wstring& text);
     static COLORREF StatusColor(CloneStatus s);
 };
@@ -45,6 +45,7 @@
 #define IDC_BUTTON_LOAD_FILE    1111
 #define IDC_STATIC_STATUS_SHA1  1112
 #define IDC_STATIC_STATUS_SHA256 1113
+#define IDC_COMBO_HASH_SCOPE    1114
 
 // Next default values for new objects
 #ifdef APSTUDIO_INVOKED
@@ -51,7 +51,6 @@ extern CAppModule _Module;
 // Windows headers
 #include <windows.h>
 #include <winioctl.h>
-#include <wincrypt.h>
 #include <shlwapi.h>
 
 #if defined _M_IX86
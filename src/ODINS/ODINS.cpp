@@ -0,0 +1,117 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+// odinserver: image server storing the images of clients that back up to
+// odin://host[:port]/path and delivering them for restore and verify.
+//
+//   odinserver [-dir=directory] [-port=n] [-portfile=file] [-castwindow=n]
+//              [-castclients=n] [-castwait=s] [-castdetach=s]
+//
+// Images are stored in directory (default: current directory), the server listens
+// on port n of all interfaces (default 7931, 0 for a free port). The port is
+// written to file when the server accepts clients. The server runs until it is
+// killed, exit code is 1 if it could not start and 2 for wrong arguments.
+// Clients restoring odincast://host[:port]/path at the same time share one
+// decoding of the image: it keeps the last castwindow blocks of 1MB (default 32),
+// starts when castclients clients joined or castwait seconds passed (default:
+// at once) and lets clients that hold back the others for castdetach seconds
+// (default 5) continue on their own.
+
+#include "stdafx.h"
+#include <locale.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include "NetImageServer.h"
+#include "NetProtocol.h"
+#include "Exception.h"
+
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+  setlocale(LC_ALL, "");
+  wstring directory = L".";
+  wstring portFile;
+  int port = kNetDefaultPort;
+  int castWindow = 32, castClients = 0, castWait = 0, castDetach = 5;
+
+  for (int i=1; i<argc; i++) {
+    wstring arg = (LPCWSTR) CA2W(argv[i]);
+    size_t eq = arg.find(L'=');
+    wstring name = arg.substr(0, eq), value = eq == wstring::npos ? L"" : arg.substr(eq + 1);
+    if (name == L"-dir" && !value.empty()) {
+      directory = value;
+    } else if (name == L"-port" && !value.empty()) {
+      port = _wtoi(value.c_str());
+    } else if (name == L"-portfile" && !value.empty()) {
+      portFile = value;
+    } else if (name == L"-castwindow" && !value.empty()) {
+      castWindow = _wtoi(value.c_str());
+    } else if (name == L"-castclients" && !value.empty()) {
+      castClients = _wtoi(value.c_str());
+    } else if (name == L"-castwait" && !value.empty()) {
+      castWait = _wtoi(value.c_str());
+    } else if (name == L"-castdetach" && !value.empty()) {
+      castDetach = _wtoi(value.c_str());
+    } else {
+      wcerr << L"Usage: odinserver [-dir=directory] [-port=n] [-portfile=file] [-castwindow=n]" << endl;
+      wcerr << L"                  [-castclients=n] [-castwait=s] [-castdetach=s]" << endl;
+      return 2;
+    }
+  }
+  if (port < 0 || port > 65535) {
+    wcerr << L"Invalid port: " << port << endl;
+    return 2;
+  }
+  if (castWindow < 2 || castClients < 0 || castWait < 0 || castWait > 3600 || castDetach < 0 || castDetach > 3600) {
+    wcerr << L"Invalid cast option" << endl;
+    return 2;
+  }
+
+  CNetImageServer server(directory.c_str());
+  server.SetCastOptions(castWindow, castClients, castWait * 1000, castDetach * 1000);
+  try {
+    unsigned short listenPort = server.Start((unsigned short) port);
+    wcout << L"odinserver: storing images in " << directory << L", port " << listenPort << endl;
+    if (!portFile.empty()) {
+      // written to a new name and renamed so that the port is never read half written
+      string path = (LPCSTR) CW2A(portFile.c_str());
+      ofstream out((path + ".tmp").c_str());
+      out << listenPort << endl;
+      out.close();
+      DeleteFile(portFile.c_str());
+      if (!out || !MoveFile((portFile + L".tmp").c_str(), portFile.c_str())) {
+        wcerr << L"Error: can not write " << portFile << endl;
+        return 1;
+      }
+    }
+  } catch (Exception& e) {
+    wcerr << L"Error: " << e.GetMessage() << endl;
+    return 1;
+  }
+  server.Wait();
+  wcerr << L"Error: the server stopped accepting clients" << endl;
+  return 1;
+}
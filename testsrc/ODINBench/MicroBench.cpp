@@ -0,0 +1,376 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <algorithm>
+#include "MicroBench.h"
+#include "../../src/ODIN/crc32.h"
+#include "../../src/ODIN/CompressedRunLengthStream.h"
+#include "../../src/ODIN/BufferQueue.h"
+#include "../../src/ODIN/OdinThread.h"
+#include "../../src/ODIN/CompressionThread.h"
+#include "../../src/ODIN/DecompressionThread.h"
+
+using namespace std;
+
+static const unsigned sMaxIterations = 10000;
+static const unsigned sOutputBufferCount = 8;
+static const unsigned sHandoffChunks = 16384;
+static const unsigned sHandoffBufferCount = 8;
+
+// results are accumulated here so that the compiler cannot drop the measured code
+static volatile DWORD sSink;
+
+static double Now()
+{
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / frequency.QuadPart;
+}
+
+//---------------------------------------------------------------------------
+// class CHandoffThread
+// Passes count empty chunks from one queue to the other, the last one with EOF set.
+
+class CHandoffThread : public COdinThread {
+public:
+  CHandoffThread(CImageBuffer* emptyQueue, CImageBuffer* filledQueue, unsigned count)
+    : COdinThread(CREATE_SUSPENDED)
+  {
+    fEmptyQueue = emptyQueue;
+    fFilledQueue = filledQueue;
+    fCount = count;
+  }
+
+protected:
+  virtual DWORD Execute()
+  {
+    for (unsigned i=0; i<fCount; i++) {
+      CBufferChunk* chunk = fEmptyQueue->GetChunk();
+      chunk->SetSize(chunk->GetMaxSize());
+      chunk->SetEOF(i == fCount - 1);
+      fFilledQueue->ReleaseChunk(chunk);
+    }
+    fFinished = true;
+    return 0;
+  }
+
+private:
+  CImageBuffer* fEmptyQueue;
+  CImageBuffer* fFilledQueue;
+  unsigned fCount;
+};
+
+//---------------------------------------------------------------------------
+CMicroBench::CMicroBench(unsigned corpusSize, unsigned blockSize, unsigned minIterations, double minSeconds)
+{
+  fCorpusSize = corpusSize;
+  fBlockSize = blockSize;
+  fMinIterations = minIterations;
+  fMinSeconds = minSeconds;
+}
+
+template <class F>
+TMicroResult CMicroBench::Measure(LPCWSTR name, unsigned __int64 bytes, unsigned __int64 items, F iteration)
+{
+  TMicroResult result;
+  vector<double> times;
+  result.name = name;
+  result.bytes = bytes;
+  result.items = items;
+  result.median = result.p95 = 0.0;
+  result.ok = true;
+
+  double total = 0.0;
+  bool warmUp = true;
+  while (times.size() < sMaxIterations && (times.size() < fMinIterations || total < fMinSeconds)) {
+    double seconds = iteration();
+    if (seconds < 0.0) {
+      result.ok = false;
+      result.error = fError;
+      break;
+    }
+    if (warmUp)
+      warmUp = false;
+    else {
+      times.push_back(seconds);
+      total += seconds;
+    }
+  }
+
+  result.iterations = (unsigned) times.size();
+  if (!times.empty()) {
+    sort(times.begin(), times.end());
+    result.median = times[times.size() / 2];
+    result.p95 = times[(times.size() * 95 + 99) / 100 - 1];
+  }
+  return result;
+}
+
+// fCorpusSize bytes of the given content as the image stream simulator produces it
+const vector<BYTE>& CMicroBench::GetCorpus(CImageStreamSimulator::TContent content)
+{
+  vector<BYTE>& corpus = fCorpus[content];
+  if (corpus.empty()) {
+    CImageStreamSimulator volume(fCorpusSize, true);
+    unsigned bytesRead;
+    volume.SetContent(content);
+    corpus.resize(fCorpusSize);
+    volume.Read(&corpus[0], fCorpusSize, &bytesRead);
+    corpus.resize(bytesRead);
+  }
+  return corpus;
+}
+
+// allocation bitmap of fCorpusSize bytes with runs of set and cleared bits of
+// random length up to twice the mean
+void CMicroBench::MakeBitmap(unsigned meanRunLength, vector<BYTE>& bitmap, unsigned __int64& runs)
+{
+  unsigned __int64 bitCount = (unsigned __int64) fCorpusSize * 8;
+  unsigned __int64 random = 2463534242ULL, pos = 0;
+  bool value = true;
+
+  bitmap.assign(fCorpusSize, 0);
+  runs = 0;
+  while (pos < bitCount) {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    unsigned __int64 end = min(bitCount, pos + 1 + random % (2 * meanRunLength));
+    if (value) {
+      for (; pos < end && pos % 8 != 0; pos++)
+        bitmap[pos / 8] |= 1 << (pos % 8);
+      if (end - pos >= 8) {
+        memset(&bitmap[pos / 8], 0xFF, (size_t) ((end - pos) / 8));
+        pos += (end - pos) / 8 * 8;
+      }
+      for (; pos < end; pos++)
+        bitmap[pos / 8] |= 1 << (pos % 8);
+    }
+    pos = end;
+    value = !value;
+    runs++;
+  }
+}
+
+// pass input through one compression or decompression thread, appends the
+// result to output if not NULL and returns the seconds the thread needed
+double CMicroBench::CodecPass(TCompressionFormat format, bool compress, const vector<BYTE>& input,
+                              vector<BYTE>* output)
+{
+  unsigned inputChunks = max(1U, (unsigned) ((input.size() + fBlockSize - 1) / fBlockSize));
+  CImageBuffer emptyIn(fBlockSize, inputChunks), filledIn;
+  CImageBuffer emptyOut(fBlockSize, sOutputBufferCount), filledOut;
+  CBufferChunk* chunk;
+  bool eof;
+
+  for (unsigned i=0; i<inputChunks; i++) {
+    size_t pos = (size_t) i * fBlockSize;
+    unsigned count = (unsigned) min((size_t) fBlockSize, input.size() - pos);
+    chunk = emptyIn.GetChunk();
+    if (count > 0)
+      memcpy(chunk->GetData(), &input[pos], count);
+    chunk->SetSize(count);
+    chunk->SetEOF(i == inputChunks - 1);
+    filledIn.ReleaseChunk(chunk);
+  }
+
+  unique_ptr<COdinThread> thread;
+  if (compress)
+    thread = make_unique<CCompressionThread>(format, &filledIn, &emptyIn, &emptyOut, &filledOut);
+  else
+    thread = make_unique<CDecompressionThread>(format, &filledIn, &emptyIn, &emptyOut, &filledOut);
+
+  double start = Now();
+  thread->Resume();
+  do {
+    chunk = filledOut.GetChunk();
+    if (output) {
+      BYTE* p = (BYTE*) chunk->GetData();
+      output->insert(output->end(), p, p + chunk->GetSize());
+    }
+    eof = chunk->IsEOF();
+    emptyOut.ReleaseChunk(chunk);
+  } while (!eof);
+  thread->WaitForThread();
+  double seconds = Now() - start;
+
+  if (thread->GetErrorFlag()) {
+    fError = thread->GetErrorMessage();
+    return -1.0;
+  }
+  return seconds;
+}
+
+//---------------------------------------------------------------------------
+void CMicroBench::RunChecksums(vector<TMicroResult>& results)
+{
+  const vector<BYTE>& corpus = GetCorpus(CImageStreamSimulator::contentRandom);
+  BYTE* data = const_cast<BYTE*>(&corpus[0]);
+  unsigned length = (unsigned) corpus.size();
+
+  results.push_back(Measure(L"crc32", length, 1, [&]() {
+    double start = Now();
+    CCRC32 crc;
+    crc.AddDataBlock(data, length);
+    sSink ^= crc.GetResult();
+    return Now() - start;
+  }));
+  results.push_back(Measure(L"crc32c", length, 1, [&]() {
+    double start = Now();
+    sSink ^= CCRC32C::Calculate(data, length);
+    return Now() - start;
+  }));
+}
+
+void CMicroBench::RunBitmaps(vector<TMicroResult>& results)
+{
+  static const struct {
+    LPCWSTR name;
+    unsigned meanRunLength;
+  } sLayouts[] = {
+    { L"fragmented", 8 },
+    { L"contiguous", 4096 },
+  };
+
+  for (size_t l=0; l<sizeof(sLayouts)/sizeof(sLayouts[0]); l++) {
+    vector<BYTE> bitmap;
+    unsigned __int64 runs;
+    unsigned bitCount = fCorpusSize * 8;
+    MakeBitmap(sLayouts[l].meanRunLength, bitmap, runs);
+    wstring suffix = wstring(L"/") + sLayouts[l].name;
+
+    CBitArray bitArray(&bitmap[0], bitCount);
+    results.push_back(Measure((L"bitarray-runs" + suffix).c_str(), bitmap.size(), runs, [&]() {
+      double start = Now();
+      unsigned pos = 0, count = 0;
+      bool value = true;
+      while (pos < bitCount) {
+        unsigned run = bitArray.GetRunLength(pos, value);
+        if (run == 0)
+          break;
+        pos += run;
+        value = !value;
+        count++;
+      }
+      double seconds = Now() - start;
+      if (count != runs) {
+        fError = L"scanned runs do not match bitmap";
+        return -1.0;
+      }
+      sSink ^= count;
+      return seconds;
+    }));
+
+    // the run length stream is written to and read from a temporary file as
+    // with the allocation map of an image
+    WCHAR tempDir[MAX_PATH], tempFile[MAX_PATH];
+    GetTempPath(MAX_PATH, tempDir);
+    GetTempFileName(tempDir, L"odb", 0, tempFile);
+    HANDLE h = CreateFile(tempFile, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                          FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (h == INVALID_HANDLE_VALUE) {
+      fError = L"cannot create temporary file";
+      results.push_back(Measure((L"rle-encode" + suffix).c_str(), bitmap.size(), runs, []() { return -1.0; }));
+      continue;
+    }
+    DWORD streamLength = 0;
+    results.push_back(Measure((L"rle-encode" + suffix).c_str(), bitmap.size(), runs, [&]() {
+      LARGE_INTEGER zero, size;
+      zero.QuadPart = 0;
+      SetFilePointerEx(h, zero, NULL, FILE_BEGIN);
+      SetEndOfFile(h);
+      double start = Now();
+      CompressedRunLengthStreamWriter writer(h);
+      writer.AddBuffer(&bitmap[0], bitCount);
+      writer.Flush();
+      double seconds = Now() - start;
+      GetFileSizeEx(h, &size);
+      streamLength = (DWORD) size.QuadPart;
+      return seconds;
+    }));
+    results.push_back(Measure((L"rle-decode" + suffix).c_str(), bitmap.size(), runs, [&]() {
+      double start = Now();
+      CompressedRunLengthStreamReader reader(h, 0, streamLength);
+      unsigned __int64 bits = 0;
+      while (bits < bitCount && !reader.LastValueRead())
+        bits += reader.GetNextRunLength();
+      double seconds = Now() - start;
+      if (bits != bitCount) {
+        fError = L"decoded run lengths do not match bitmap";
+        return -1.0;
+      }
+      return seconds;
+    }));
+    CloseHandle(h);
+  }
+}
+
+void CMicroBench::RunCodec(TCompressionFormat format, LPCWSTR codecName, CImageStreamSimulator::TContent content,
+                           LPCWSTR contentName, vector<TMicroResult>& results)
+{
+  const vector<BYTE>& corpus = GetCorpus(content);
+  wstring suffix = wstring(L"/") + codecName + L"/" + contentName;
+  unsigned chunks = (unsigned) ((corpus.size() + fBlockSize - 1) / fBlockSize);
+  vector<BYTE> compressed;
+
+  results.push_back(Measure((L"compress" + suffix).c_str(), corpus.size(), chunks, [&]() {
+    compressed.clear();
+    return CodecPass(format, true, corpus, &compressed);
+  }));
+  if (!results.back().ok)
+    return;
+
+  vector<BYTE> decompressed;
+  decompressed.reserve(corpus.size());
+  results.push_back(Measure((L"decompress" + suffix).c_str(), corpus.size(), chunks, [&]() {
+    decompressed.clear();
+    double seconds = CodecPass(format, false, compressed, &decompressed);
+    if (seconds >= 0.0 && decompressed != corpus) {
+      fError = L"decompressed data differ from corpus";
+      return -1.0;
+    }
+    return seconds;
+  }));
+}
+
+void CMicroBench::RunBufferHandoff(vector<TMicroResult>& results)
+{
+  results.push_back(Measure(L"buffer-handoff", (unsigned __int64) sHandoffChunks * fBlockSize, sHandoffChunks, [&]() {
+    CImageBuffer emptyQueue(fBlockSize, sHandoffBufferCount), filledQueue;
+    CHandoffThread producer(&emptyQueue, &filledQueue, sHandoffChunks);
+    CBufferChunk* chunk;
+    bool eof;
+    double start = Now();
+    producer.Resume();
+    do {
+      chunk = filledQueue.GetChunk();
+      eof = chunk->IsEOF();
+      emptyQueue.ReleaseChunk(chunk);
+    } while (!eof);
+    producer.WaitForThread();
+    return Now() - start;
+  }));
+}
@@ -0,0 +1,82 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __MICROBENCH_H__
+#define __MICROBENCH_H__
+
+#include <string>
+#include <vector>
+#include "../../src/ODIN/Compression.h"
+#include "../ODINTest/ImageStreamSimulator.h"
+
+// statistics of one micro benchmark
+typedef struct {
+  std::wstring name;
+  unsigned __int64 bytes;       // bytes processed by one iteration
+  unsigned __int64 items;       // runs, chunks etc. processed by one iteration
+  unsigned iterations;          // measured iterations without warm up
+  double median;                // seconds of one iteration
+  double p95;
+  bool ok;
+  std::wstring error;
+} TMicroResult;
+
+//---------------------------------------------------------------------------
+// class CMicroBench
+// Measures the hot components of the backup and restore pipeline on their own,
+// on data in memory: CRC32, run scanning of CBitArray, encoding and decoding of
+// the compressed run length stream of the allocation map, the codec loops of
+// CCompressionThread and CDecompressionThread and the handoff of chunks between
+// two threads through a CImageBuffer. Every benchmark runs one iteration to warm
+// up and then at least minIterations iterations and minSeconds seconds.
+
+class CMicroBench {
+public:
+  CMicroBench(unsigned corpusSize, unsigned blockSize, unsigned minIterations, double minSeconds);
+
+  void RunChecksums(std::vector<TMicroResult>& results);
+  void RunBitmaps(std::vector<TMicroResult>& results);
+  void RunCodec(TCompressionFormat format, LPCWSTR codecName, CImageStreamSimulator::TContent content,
+                LPCWSTR contentName, std::vector<TMicroResult>& results);
+  void RunBufferHandoff(std::vector<TMicroResult>& results);
+
+private:
+  // iteration returns the measured seconds or a negative value if it failed
+  template <class F> TMicroResult Measure(LPCWSTR name, unsigned __int64 bytes, unsigned __int64 items,
+                                          F iteration);
+  const std::vector<BYTE>& GetCorpus(CImageStreamSimulator::TContent content);
+  void MakeBitmap(unsigned meanRunLength, std::vector<BYTE>& bitmap, unsigned __int64& runs);
+  double CodecPass(TCompressionFormat format, bool compress, const std::vector<BYTE>& input,
+                   std::vector<BYTE>* output);
+
+  unsigned fCorpusSize;
+  unsigned fBlockSize;
+  unsigned fMinIterations;
+  double fMinSeconds;
+  std::vector<BYTE> fCorpus[4];  // data of each content, generated when first used
+  std::wstring fError;           // error of the last failed iteration
+};
+
+#endif
@@ -0,0 +1,357 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+// ODINBench.cpp : end-to-end benchmark of backup, verify and restore
+//
+// Runs the read, compression and write threads of ODIN on synthetic volumes for
+// every combination of content, codec and block size and prints the measured
+// throughput, CPU time and peak working set as JSON:
+//
+//   ODINBench [-size=MB] [-content=zeros,text,random,mixed|all] [-codec=none,gzip,
+//             lz4,lz4hc,zstd,dedup|all] [-blocksize=KB,...] [-buffers=n]
+//             [-fragments=n] [-used=percent] [-device=cf|usbhub|nvme] [-dir=path]
+//             [-output=file]
+//
+// -device lets the volume read and write at the speed of a device of that model
+// (see CEmulatedImageStream) instead of instantly.
+//
+// With -micro the single components are measured on data in memory instead (see
+// CMicroBench), -size is the size of the data then and the first -blocksize the
+// chunk size:
+//
+//   ODINBench -micro [-size=MB] [-content=...] [-codec=...] [-blocksize=KB]
+//             [-iterations=n] [-seconds=s] [-output=file]
+
+#include "stdafx.h"
+#include <locale.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sstream>
+#include "PipelineBench.h"
+#include "MicroBench.h"
+#include "../../src/ODIN/Config.h"
+
+using namespace std;
+
+typedef struct {
+  LPCWSTR name;
+  int value;
+} TNamedValue;
+
+static const TNamedValue sContents[] = {
+  { L"zeros", CImageStreamSimulator::contentZeros },
+  { L"text", CImageStreamSimulator::contentText },
+  { L"random", CImageStreamSimulator::contentRandom },
+  { L"mixed", CImageStreamSimulator::contentMixed },
+};
+
+// bzip2 is missing, images can no longer be written with it
+static const TNamedValue sCodecs[] = {
+  { L"none", noCompression },
+  { L"gzip", compressionGZip },
+  { L"lz4", compressionLZ4 },
+  { L"lz4hc", compressionLZ4HC },
+  { L"zstd", compressionZSTD },
+  { L"dedup", compressionChunkStore },
+};
+
+static vector<wstring> SplitList(const wstring& list)
+{
+  vector<wstring> items;
+  wistringstream stream(list);
+  wstring item;
+  while (getline(stream, item, L','))
+    if (!item.empty())
+      items.push_back(item);
+  return items;
+}
+
+// values of the names in list, all values for "all", false if a name is unknown
+template <size_t n>
+static bool ParseNames(const wstring& list, const TNamedValue (&table)[n], vector<const TNamedValue*>& values)
+{
+  values.clear();
+  if (list == L"all") {
+    for (size_t i=0; i<n; i++)
+      values.push_back(&table[i]);
+    return true;
+  }
+  vector<wstring> names = SplitList(list);
+  for (size_t i=0; i<names.size(); i++) {
+    size_t j;
+    for (j=0; j<n && names[i] != table[j].name; j++)
+      ;
+    if (j == n) {
+      wcerr << L"Unknown value: " << names[i] << endl;
+      return false;
+    }
+    values.push_back(&table[j]);
+  }
+  return !values.empty();
+}
+
+static wstring JsonString(const wstring& s)
+{
+  wostringstream out;
+  out << L'"';
+  for (size_t i=0; i<s.length(); i++) {
+    wchar_t c = s[i];
+    if (c == L'"' || c == L'\\')
+      out << L'\\' << c;
+    else if (c == L'\r' || c == L'\n' || c == L'\t')
+      out << L' ';
+    else if (c < 0x20)
+      ;
+    else
+      out << c;
+  }
+  out << L'"';
+  return out.str();
+}
+
+static void WriteRun(wostringstream& json, bool first, LPCWSTR content, LPCWSTR codec, unsigned blockSize,
+                     unsigned fragments, const TBenchResult& result)
+{
+  double mbPerSecond = result.seconds > 0.0 ? result.bytes / result.seconds / (1024.0 * 1024.0) : 0.0;
+  json << (first ? L"\n" : L",\n") << L"    {";
+  json << L"\"content\": " << JsonString(content);
+  json << L", \"codec\": " << JsonString(codec);
+  json << L", \"blockSize\": " << blockSize;
+  json << L", \"fragments\": " << fragments;
+  json << L", \"operation\": " << JsonString(result.operation);
+  json << L", \"bytes\": " << result.bytes;
+  json << L", \"imageBytes\": " << result.imageBytes;
+  json << L", \"seconds\": " << result.seconds;
+  json << L", \"mbPerSecond\": " << mbPerSecond;
+  json << L", \"cpuSeconds\": " << result.cpuSeconds;
+  json << L", \"peakRssBytes\": " << result.peakRss;
+  json << L", \"ok\": " << (result.ok ? L"true" : L"false");
+  json << L", \"error\": " << JsonString(result.error);
+  json << L"}";
+}
+
+static void WriteMicroRun(wostringstream& json, bool first, const TMicroResult& result)
+{
+  double mbPerSecond = result.median > 0.0 ? result.bytes / result.median / (1024.0 * 1024.0) : 0.0;
+  double itemsPerSecond = result.median > 0.0 ? result.items / result.median : 0.0;
+  json << (first ? L"\n" : L",\n") << L"    {";
+  json << L"\"name\": " << JsonString(result.name);
+  json << L", \"bytes\": " << result.bytes;
+  json << L", \"items\": " << result.items;
+  json << L", \"iterations\": " << result.iterations;
+  json << L", \"medianSeconds\": " << result.median;
+  json << L", \"p95Seconds\": " << result.p95;
+  json << L", \"mbPerSecond\": " << mbPerSecond;
+  json << L", \"itemsPerSecond\": " << itemsPerSecond;
+  json << L", \"ok\": " << (result.ok ? L"true" : L"false");
+  json << L", \"error\": " << JsonString(result.error);
+  json << L"}";
+}
+
+// backup, verify and restore for each block size, content and codec, returns false if one failed
+static bool RunPipeline(wostringstream& json, const wstring& imageFile, unsigned sizeMB, unsigned bufferCount,
+                        unsigned fragments, unsigned usedPercent, const wstring& device,
+                        const vector<wstring>& blockSizes, const vector<const TNamedValue*>& contents,
+                        const vector<const TNamedValue*>& codecs)
+{
+  bool first = true, allOk = true;
+  json << L"{\n  \"benchmark\": \"odinbench\",\n  \"volumeBytes\": " << (unsigned __int64) sizeMB * 1024 * 1024;
+  json << L",\n  \"usedPercent\": " << (fragments ? usedPercent : 100);
+  json << L",\n  \"buffers\": " << bufferCount;
+  json << L",\n  \"device\": " << JsonString(device.empty() ? L"none" : device);
+  json << L",\n  \"runs\": [";
+  TDeviceModel model;
+  if (!device.empty())
+    CEmulatedImageStream::GetModel(device.c_str(), model);
+  for (size_t b=0; b<blockSizes.size(); b++) {
+    unsigned blockSize = _wtoi(blockSizes[b].c_str()) * 1024;
+    if (blockSize == 0)
+      continue;
+    CPipelineBench bench(imageFile.c_str(), blockSize, bufferCount);
+    bench.SetDevice(device.empty() ? NULL : &model);
+    for (size_t c=0; c<contents.size(); c++) {
+      bench.SetVolume((unsigned __int64) sizeMB * 1024 * 1024, (CImageStreamSimulator::TContent) contents[c]->value,
+                      fragments, usedPercent);
+      for (size_t k=0; k<codecs.size(); k++) {
+        wcerr << L"Running " << contents[c]->name << L" " << codecs[k]->name << L" " << blockSize / 1024 << L" KB" << endl;
+        bench.SetCompression((TCompressionFormat) codecs[k]->value);
+        TBenchResult results[3];
+        results[0] = bench.Backup();
+        if (results[0].ok) {
+          results[1] = bench.Verify();
+          results[2] = bench.Restore();
+        }
+        for (int r=0; r<3 && !results[r].operation.empty(); r++) {
+          WriteRun(json, first, contents[c]->name, codecs[k]->name, blockSize, fragments, results[r]);
+          first = false;
+          allOk = allOk && results[r].ok;
+        }
+        bench.Cleanup();
+      }
+    }
+  }
+  json << L"\n  ]\n}\n";
+  return allOk;
+}
+
+// micro benchmarks of the components, codecs without a codec loop (none, dedup) are skipped
+static bool RunMicro(wostringstream& json, unsigned sizeMB, unsigned blockSize, unsigned iterations, double seconds,
+                     const vector<const TNamedValue*>& contents, const vector<const TNamedValue*>& codecs)
+{
+  CMicroBench bench(sizeMB * 1024 * 1024, blockSize, iterations, seconds);
+  vector<TMicroResult> results;
+
+  wcerr << L"Running checksums, bitmaps and buffer handoff" << endl;
+  bench.RunChecksums(results);
+  bench.RunBitmaps(results);
+  bench.RunBufferHandoff(results);
+  for (size_t k=0; k<codecs.size(); k++) {
+    if (codecs[k]->value == noCompression || codecs[k]->value == compressionChunkStore)
+      continue;
+    for (size_t c=0; c<contents.size(); c++) {
+      wcerr << L"Running " << codecs[k]->name << L" " << contents[c]->name << endl;
+      bench.RunCodec((TCompressionFormat) codecs[k]->value, codecs[k]->name,
+                     (CImageStreamSimulator::TContent) contents[c]->value, contents[c]->name, results);
+    }
+  }
+
+  bool allOk = true;
+  json << L"{\n  \"benchmark\": \"odinbench-micro\",\n  \"corpusBytes\": " << sizeMB * 1024 * 1024;
+  json << L",\n  \"blockSize\": " << blockSize;
+  json << L",\n  \"runs\": [";
+  for (size_t i=0; i<results.size(); i++) {
+    WriteMicroRun(json, i == 0, results[i]);
+    allOk = allOk && results[i].ok;
+  }
+  json << L"\n  ]\n}\n";
+  return allOk;
+}
+
+#ifdef _WIN32
+int _tmain(int argc, _TCHAR* argv[])
+#else
+int main(int argc, char* argv[])
+#endif
+{
+  setlocale(LC_CTYPE, "");
+#ifdef _WIN32
+  CfgFileInitialize(L"ODINBench.ini", true);
+#endif
+
+  unsigned sizeMB = 0, bufferCount = 8, fragments = 0, usedPercent = 60, iterations = 10;
+  double seconds = 1.0;
+  bool micro = false;
+  wstring contentList = L"all", codecList = L"all", blockSizeList;
+  wstring dir = L".", outputFile, device;
+  for (int i=1; i<argc; i++) {
+#ifdef _WIN32
+    wstring arg = argv[i];
+#else
+    wstring arg = (LPCWSTR) CA2W(argv[i]);
+#endif
+    size_t eq = arg.find(L'=');
+    wstring name = arg.substr(0, eq), value = eq == wstring::npos ? L"" : arg.substr(eq + 1);
+    if (name == L"-micro")
+      micro = true;
+    else if (name == L"-size")
+      sizeMB = _wtoi(value.c_str());
+    else if (name == L"-content")
+      contentList = value;
+    else if (name == L"-codec")
+      codecList = value;
+    else if (name == L"-blocksize")
+      blockSizeList = value;
+    else if (name == L"-buffers")
+      bufferCount = _wtoi(value.c_str());
+    else if (name == L"-fragments")
+      fragments = _wtoi(value.c_str());
+    else if (name == L"-used")
+      usedPercent = _wtoi(value.c_str());
+    else if (name == L"-iterations")
+      iterations = _wtoi(value.c_str());
+    else if (name == L"-seconds")
+      seconds = _wtof(value.c_str());
+    else if (name == L"-device")
+      device = value;
+    else if (name == L"-dir")
+      dir = value;
+    else if (name == L"-output")
+      outputFile = value;
+    else {
+      wcerr << L"Unknown option: " << arg << endl;
+      return 2;
+    }
+  }
+  if (sizeMB == 0)
+    sizeMB = micro ? 16 : 256;
+  if (blockSizeList.empty())
+    blockSizeList = micro ? L"1024" : L"256,1024,4096";
+
+  TDeviceModel model;
+  if (!device.empty() && !CEmulatedImageStream::GetModel(device.c_str(), model)) {
+    wcerr << L"Unknown device: " << device << endl;
+    return 2;
+  }
+
+  vector<const TNamedValue*> contents, codecs;
+  vector<wstring> blockSizes = SplitList(blockSizeList);
+  if (!ParseNames(contentList, sContents, contents) || !ParseNames(codecList, sCodecs, codecs) ||
+      blockSizes.empty() || bufferCount == 0 || iterations == 0 || (micro && sizeMB >= 512))
+    return 2;
+
+  // codecs missing in this build are left out of "all" and rejected by name
+  for (size_t k=0; k<codecs.size(); ) {
+    if (IsCompressionAvailable((TCompressionFormat) codecs[k]->value))
+      k++;
+    else if (codecList == L"all")
+      codecs.erase(codecs.begin() + k);
+    else {
+      wcerr << L"Compression not available in this build: " << codecs[k]->name << endl;
+      return 2;
+    }
+  }
+
+  wostringstream json;
+  bool allOk;
+  if (micro) {
+    unsigned blockSize = _wtoi(blockSizes[0].c_str()) * 1024;
+    if (blockSize == 0)
+      return 2;
+    allOk = RunMicro(json, sizeMB, blockSize, iterations, seconds, contents, codecs);
+  } else
+    allOk = RunPipeline(json, dir + L"\\odinbench.img", sizeMB, bufferCount, fragments, usedPercent, device,
+                        blockSizes, contents, codecs);
+
+  string utf8 = (LPCSTR) CW2A(json.str().c_str(), CP_UTF8);
+  FILE* out = outputFile.empty() ? stdout : _wfopen(outputFile.c_str(), L"wb");
+  if (out == NULL) {
+    wcerr << L"Cannot write " << outputFile << endl;
+    return 2;
+  }
+  fputs(utf8.c_str(), out);
+  if (out != stdout)
+    fclose(out);
+  return allOk ? 0 : 1;
+}
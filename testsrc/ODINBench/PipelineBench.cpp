@@ -0,0 +1,437 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <memory>
+#ifdef _WIN32
+#include <psapi.h>
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#endif
+#include "PipelineBench.h"
+#include "../../src/ODIN/ImageStream.h"
+#include "../../src/ODIN/BufferQueue.h"
+#include "../../src/ODIN/ReadThread.h"
+#include "../../src/ODIN/WriteThread.h"
+#include "../../src/ODIN/CompressionThread.h"
+#include "../../src/ODIN/DecompressionThread.h"
+#include "../../src/ODIN/ChunkingThread.h"
+#include "../../src/ODIN/DechunkingThread.h"
+#include "../../src/ODIN/ChunkStore.h"
+#include "../../src/ODIN/Exception.h"
+
+using namespace std;
+
+static const unsigned sClusterSize = 4096;
+static const unsigned sChunkPrefetchThreads = 4; // default of ChunkPrefetchThreads
+
+#ifdef _WIN32
+static double FileTimeToSeconds(const FILETIME& ft)
+{
+  ULARGE_INTEGER value;
+  value.LowPart = ft.dwLowDateTime;
+  value.HighPart = ft.dwHighDateTime;
+  return value.QuadPart / 1.0e7;
+}
+
+static double GetCpuSeconds()
+{
+  FILETIME creationTime, exitTime, kernelTime, userTime;
+  if (!GetProcessTimes(GetCurrentProcess(), &creationTime, &exitTime, &kernelTime, &userTime))
+    return 0.0;
+  return FileTimeToSeconds(kernelTime) + FileTimeToSeconds(userTime);
+}
+
+static unsigned __int64 GetPeakRss()
+{
+  PROCESS_MEMORY_COUNTERS counters = { sizeof(counters) };
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.PeakWorkingSetSize;
+}
+#else
+static double GetCpuSeconds()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0.0;
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1.0e6;
+}
+
+// ru_maxrss is in KB on Linux and in bytes on macOS
+static unsigned __int64 GetPeakRss()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return usage.ru_maxrss;
+#else
+  return (unsigned __int64) usage.ru_maxrss * 1024;
+#endif
+}
+#endif
+
+static unsigned __int64 GetImageFileSize(LPCWSTR fileName)
+{
+  HANDLE h = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (h == INVALID_HANDLE_VALUE)
+    return 0;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(h, &size))
+    size.QuadPart = 0;
+  CloseHandle(h);
+  return size.QuadPart;
+}
+
+//---------------------------------------------------------------------------
+CPipelineBench::CPipelineBench(LPCWSTR imageFile, unsigned blockSize, unsigned bufferCount)
+{
+  fImageFile = imageFile;
+  fBlockSize = blockSize;
+  fBufferCount = bufferCount;
+  fFormat = noCompression;
+  fVolumeSize = 0;
+  fContent = CImageStreamSimulator::contentRandom;
+  fEmulateDevice = false;
+  fVolumeCrc32 = 0;
+  fUsedBytes = 0;
+}
+
+void CPipelineBench::SetVolume(unsigned __int64 size, CImageStreamSimulator::TContent content, unsigned fragments,
+                               unsigned usedPercent)
+{
+  fVolumeSize = size - size % sClusterSize;
+  fContent = content;
+  fRunLengths.clear();
+  if (fragments == 0)
+    return;
+
+  // split used and free clusters in runs of different length
+  unsigned __int64 clusters = fVolumeSize / sClusterSize;
+  unsigned __int64 usedClusters = clusters * min(usedPercent, 100U) / 100;
+  unsigned __int64 freeClusters = clusters - usedClusters;
+  if (fragments > usedClusters)
+    fragments = (unsigned) usedClusters;
+  if (fragments > freeClusters)
+    fragments = (unsigned) freeClusters;
+  if (fragments == 0)
+    return;
+  vector<unsigned> weights(2 * fragments);
+  unsigned __int64 usedWeights = 0, freeWeights = 0;
+  unsigned __int64 random = 88172645463325252ULL;
+  for (unsigned i=0; i<weights.size(); i++) {
+    random ^= random << 13;
+    random ^= random >> 7;
+    random ^= random << 17;
+    weights[i] = 1 + (unsigned) (random % 100);
+    (i % 2 == 0 ? usedWeights : freeWeights) += weights[i];
+  }
+  unsigned __int64 usedLeft = usedClusters, freeLeft = freeClusters;
+  for (unsigned i=0; i<fragments; i++) {
+    unsigned __int64 used = i == fragments - 1 ? usedLeft : max(1ULL, usedClusters * weights[2*i] / usedWeights);
+    unsigned __int64 unused = i == fragments - 1 ? freeLeft : max(1ULL, freeClusters * weights[2*i+1] / freeWeights);
+    used = min(used, usedLeft - (fragments - 1 - i));
+    unused = min(unused, freeLeft - (fragments - 1 - i));
+    fRunLengths.push_back((int) used);
+    fRunLengths.push_back((int) unused);
+    usedLeft -= used;
+    freeLeft -= unused;
+  }
+}
+
+// volume to read or write, the simulator owns the copy of the run lengths
+CImageStreamSimulator* CPipelineBench::NewVolume(IImageStream::TOpenMode mode)
+{
+  CImageStreamSimulator* volume;
+  if (fRunLengths.empty()) {
+    volume = mode == IImageStream::forReading ? new CImageStreamSimulator(fVolumeSize, true)
+                                              : new CImageStreamSimulator(true);
+  } else {
+    int* runLengths = new int[fRunLengths.size()];
+    memcpy(runLengths, &fRunLengths[0], fRunLengths.size() * sizeof(int));
+    volume = new CImageStreamSimulator(runLengths, (int) fRunLengths.size(), mode, true);
+  }
+  volume->SetClusterSize(sClusterSize);
+  volume->SetContent(fContent);
+  return volume;
+}
+
+void CPipelineBench::InitResult(LPCWSTR operation, TBenchResult& result)
+{
+  result.operation = operation;
+  result.bytes = result.imageBytes = 0;
+  result.seconds = result.cpuSeconds = 0.0;
+  result.peakRss = 0;
+  result.ok = false;
+}
+
+// resume all threads, wait until they have terminated and take the times
+void CPipelineBench::Run(const vector<COdinThread*>& threads, TBenchResult& result)
+{
+  vector<HANDLE> handles;
+  LARGE_INTEGER frequency, start, end;
+
+  QueryPerformanceFrequency(&frequency);
+  double cpuStart = GetCpuSeconds();
+  QueryPerformanceCounter(&start);
+  for (size_t i=0; i<threads.size(); i++) {
+    handles.push_back(threads[i]->GetHandle());
+    threads[i]->Resume();
+  }
+  WaitForMultipleObjects((DWORD) handles.size(), &handles[0], TRUE, INFINITE);
+  QueryPerformanceCounter(&end);
+  result.seconds = (double) (end.QuadPart - start.QuadPart) / frequency.QuadPart;
+  result.cpuSeconds = GetCpuSeconds() - cpuStart;
+  result.peakRss = GetPeakRss();
+  result.ok = true;
+  for (size_t i=0; i<threads.size(); i++) {
+    if (threads[i]->GetErrorFlag()) {
+      result.ok = false;
+      if (result.error.empty())
+        result.error = threads[i]->GetErrorMessage();
+    }
+  }
+}
+
+//---------------------------------------------------------------------------
+TBenchResult CPipelineBench::Backup()
+{
+  TBenchResult result;
+  InitResult(L"backup", result);
+  Cleanup();
+  try {
+    unique_ptr<CImageStreamSimulator> volume(NewVolume(IImageStream::forReading));
+    unique_ptr<CEmulatedImageStream> device;
+    IImageStream* source = volume.get();
+    if (fEmulateDevice) {
+      device = make_unique<CEmulatedImageStream>(volume.get(), fDeviceModel);
+      source = device.get();
+    }
+    CFileImageStream image;
+    image.Open(fImageFile.c_str(), IImageStream::forWriting);
+    image.SetCompressionFormat(fFormat);
+    image.SetVolumeFormat(CImageFileHeader::volumePartition);
+    image.WriteImageFileHeaderForSaveAllBlocks(volume->GetSize(), sClusterSize);
+
+    CImageBuffer emptyReaderQueue(fBlockSize, fBufferCount, L"fEmptyReaderQueue");
+    CImageBuffer filledReaderQueue(L"fFilledReaderQueue");
+    unique_ptr<CImageBuffer> emptyCompQueue, filledCompQueue;
+    CImageBuffer* writerInQueue = &filledReaderQueue;
+    CImageBuffer* writerOutQueue = &emptyReaderQueue;
+    if (fFormat != noCompression) {
+      emptyCompQueue = make_unique<CImageBuffer>(fBlockSize, fBufferCount, L"fEmptyCompDecompQueue");
+      filledCompQueue = make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+      writerInQueue = filledCompQueue.get();
+      writerOutQueue = emptyCompQueue.get();
+    }
+
+    CReadThread readThread(source, &emptyReaderQueue, &filledReaderQueue, false);
+    CWriteThread writeThread(&image, writerInQueue, writerOutQueue, false);
+    if (!fRunLengths.empty())
+      readThread.SetAllocationMapReaderInfo(volume->GetRunLengthStreamReader(), sClusterSize);
+    unique_ptr<CChunkStore> chunkStore;
+    unique_ptr<COdinThread> compThread;
+    if (fFormat == compressionChunkStore) {
+      chunkStore = make_unique<CChunkStore>();
+      chunkStore->Open(CChunkStore::GetStoreDirectory(fImageFile.c_str()).c_str(), true);
+      compThread = make_unique<CChunkingThread>(chunkStore.get(), &filledReaderQueue, &emptyReaderQueue,
+                                                emptyCompQueue.get(), writerInQueue);
+    } else if (fFormat != noCompression) {
+      compThread = make_unique<CCompressionThread>(fFormat, &filledReaderQueue, &emptyReaderQueue,
+                                                   emptyCompQueue.get(), writerInQueue);
+    }
+
+    vector<COdinThread*> threads;
+    threads.push_back(&readThread);
+    threads.push_back(&writeThread);
+    if (compThread)
+      threads.push_back(compThread.get());
+    Run(threads, result);
+    image.Close();
+    chunkStore.reset();
+
+    fVolumeCrc32 = volume->GetCRC32();
+    fUsedBytes = readThread.GetBytesProcessed();
+    result.bytes = fUsedBytes;
+    result.imageBytes = GetImageFileSize(fImageFile.c_str());
+  } catch (Exception& e) {
+    result.ok = false;
+    result.error = e.GetMessage();
+  }
+  return result;
+}
+
+TBenchResult CPipelineBench::Verify()
+{
+  TBenchResult result;
+  InitResult(L"verify", result);
+  try {
+    CFileImageStream image;
+    image.Open(fImageFile.c_str(), IImageStream::forReading);
+    image.ReadImageFileHeader(true);
+    TCompressionFormat format = image.GetImageFileHeader().GetCompressionFormat();
+
+    CImageBuffer emptyReaderQueue(fBlockSize, fBufferCount, L"fEmptyReaderQueue");
+    CImageBuffer filledReaderQueue(L"fFilledReaderQueue");
+    unique_ptr<CImageBuffer> emptyDecompQueue, filledDecompQueue;
+    CImageBuffer* writerInQueue = &filledReaderQueue;
+    CImageBuffer* writerOutQueue = &emptyReaderQueue;
+    if (format != noCompression) {
+      emptyDecompQueue = make_unique<CImageBuffer>(fBlockSize, fBufferCount, L"fEmptyCompDecompQueue");
+      filledDecompQueue = make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+      writerInQueue = filledDecompQueue.get();
+      writerOutQueue = emptyDecompQueue.get();
+    }
+
+    CReadThread readThread(&image, &emptyReaderQueue, &filledReaderQueue, true);
+    CWriteThread writeThread(NULL, writerInQueue, writerOutQueue, true);
+    readThread.SetVolumeDataOffset(image.GetImageFileHeader().GetVolumeDataOffset());
+    readThread.SetVolumeDataSize(image.GetImageFileHeader().GetDataSize());
+    unique_ptr<CChunkStore> chunkStore;
+    unique_ptr<COdinThread> decompThread;
+    if (format == compressionChunkStore) {
+      chunkStore = make_unique<CChunkStore>();
+      chunkStore->Open(CChunkStore::GetStoreDirectory(fImageFile.c_str()).c_str(), false);
+      decompThread = make_unique<CDechunkingThread>(chunkStore.get(), sChunkPrefetchThreads, &filledReaderQueue,
+                                                    &emptyReaderQueue, emptyDecompQueue.get(), writerInQueue);
+    } else if (format != noCompression) {
+      decompThread = make_unique<CDecompressionThread>(format, &filledReaderQueue, &emptyReaderQueue,
+                                                       emptyDecompQueue.get(), writerInQueue);
+    }
+
+    vector<COdinThread*> threads;
+    threads.push_back(&readThread);
+    threads.push_back(&writeThread);
+    if (decompThread)
+      threads.push_back(decompThread.get());
+    Run(threads, result);
+
+    result.bytes = writeThread.GetBytesProcessed();
+    result.imageBytes = GetImageFileSize(fImageFile.c_str());
+    if (result.ok && readThread.GetCrc32() != image.GetCrc32Checksum()) {
+      result.ok = false;
+      result.error = L"checksum of image differs";
+    }
+  } catch (Exception& e) {
+    result.ok = false;
+    result.error = e.GetMessage();
+  }
+  return result;
+}
+
+TBenchResult CPipelineBench::Restore()
+{
+  TBenchResult result;
+  InitResult(L"restore", result);
+  try {
+    unique_ptr<CImageStreamSimulator> volume(NewVolume(IImageStream::forWriting));
+    unique_ptr<CEmulatedImageStream> device;
+    IImageStream* target = volume.get();
+    if (fEmulateDevice) {
+      device = make_unique<CEmulatedImageStream>(volume.get(), fDeviceModel);
+      target = device.get();
+    }
+    CFileImageStream image;
+    image.Open(fImageFile.c_str(), IImageStream::forReading);
+    image.ReadImageFileHeader(true);
+    TCompressionFormat format = image.GetImageFileHeader().GetCompressionFormat();
+
+    CImageBuffer emptyReaderQueue(fBlockSize, fBufferCount, L"fEmptyReaderQueue");
+    CImageBuffer filledReaderQueue(L"fFilledReaderQueue");
+    unique_ptr<CImageBuffer> emptyDecompQueue, filledDecompQueue;
+    CImageBuffer* writerInQueue = &filledReaderQueue;
+    CImageBuffer* writerOutQueue = &emptyReaderQueue;
+    if (format != noCompression) {
+      emptyDecompQueue = make_unique<CImageBuffer>(fBlockSize, fBufferCount, L"fEmptyCompDecompQueue");
+      filledDecompQueue = make_unique<CImageBuffer>(L"fFilledCompDecompQueue");
+      writerInQueue = filledDecompQueue.get();
+      writerOutQueue = emptyDecompQueue.get();
+    }
+
+    CReadThread readThread(&image, &emptyReaderQueue, &filledReaderQueue, false);
+    CWriteThread writeThread(target, writerInQueue, writerOutQueue, false);
+    readThread.SetVolumeDataOffset(image.GetImageFileHeader().GetVolumeDataOffset());
+    readThread.SetVolumeDataSize(image.GetImageFileHeader().GetDataSize());
+    writeThread.SetAllocationMapReaderInfo(volume->GetRunLengthStreamReader(), sClusterSize);
+    unique_ptr<CChunkStore> chunkStore;
+    unique_ptr<COdinThread> decompThread;
+    if (format == compressionChunkStore) {
+      chunkStore = make_unique<CChunkStore>();
+      chunkStore->Open(CChunkStore::GetStoreDirectory(fImageFile.c_str()).c_str(), false);
+      decompThread = make_unique<CDechunkingThread>(chunkStore.get(), sChunkPrefetchThreads, &filledReaderQueue,
+                                                    &emptyReaderQueue, emptyDecompQueue.get(), writerInQueue);
+    } else if (format != noCompression) {
+      decompThread = make_unique<CDecompressionThread>(format, &filledReaderQueue, &emptyReaderQueue,
+                                                       emptyDecompQueue.get(), writerInQueue);
+    }
+
+    vector<COdinThread*> threads;
+    threads.push_back(&readThread);
+    threads.push_back(&writeThread);
+    if (decompThread)
+      threads.push_back(decompThread.get());
+    Run(threads, result);
+
+    result.bytes = writeThread.GetBytesProcessed();
+    result.imageBytes = GetImageFileSize(fImageFile.c_str());
+    if (result.ok && (volume->GetCRC32() != fVolumeCrc32 || result.bytes != fUsedBytes)) {
+      result.ok = false;
+      result.error = L"restored data differ from volume";
+    }
+  } catch (Exception& e) {
+    result.ok = false;
+    result.error = e.GetMessage();
+  }
+  return result;
+}
+
+//---------------------------------------------------------------------------
+void CPipelineBench::Cleanup()
+{
+  DeleteFile(fImageFile.c_str());
+  wstring storeDir = CChunkStore::GetStoreDirectory(fImageFile.c_str());
+#ifdef _WIN32
+  WIN32_FIND_DATA findData;
+  HANDLE h = FindFirstFile((storeDir + L"\\*").c_str(), &findData);
+  if (h != INVALID_HANDLE_VALUE) {
+    do {
+      if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+        DeleteFile((storeDir + L"\\" + findData.cFileName).c_str());
+    } while (FindNextFile(h, &findData));
+    FindClose(h);
+  }
+#else
+  DIR* d = opendir(WideToPath(storeDir.c_str()).c_str());
+  if (d != NULL) {
+    for (struct dirent* entry = readdir(d); entry != NULL; entry = readdir(d)) {
+      if (entry->d_type != DT_DIR)
+        DeleteFile((storeDir + L"\\" + (LPCWSTR) CA2W(entry->d_name)).c_str());
+    }
+    closedir(d);
+  }
+#endif
+  RemoveDirectory(storeDir.c_str());
+}
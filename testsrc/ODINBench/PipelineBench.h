@@ -0,0 +1,102 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+#ifndef __PIPELINEBENCH_H__
+#define __PIPELINEBENCH_H__
+
+#include <string>
+#include <vector>
+#include "../../src/ODIN/Compression.h"
+#include "../ODINTest/ImageStreamSimulator.h"
+#include "../../src/ODIN/EmulatedImageStream.h"
+
+class COdinThread;
+
+// measured numbers of one backup, verify or restore
+typedef struct {
+  std::wstring operation;
+  unsigned __int64 bytes;       // bytes of the volume read or written
+  unsigned __int64 imageBytes;  // size of the image file
+  double seconds;               // wall clock time
+  double cpuSeconds;            // user and kernel time of all threads
+  unsigned __int64 peakRss;     // peak working set of the process up to now
+  bool ok;                      // checksums match and no thread failed
+  std::wstring error;
+} TBenchResult;
+
+//---------------------------------------------------------------------------
+// class CPipelineBench
+// Runs backup, verify and restore of a synthetic volume through the threads
+// and queues COdinManager::DoCopy() sets up for a drive: read thread, compression
+// or decompression thread and write thread with ReadWriteBlockSize chunks. The
+// volume is a CImageStreamSimulator, the image a real file in imageFile. With
+// fragments the volume has this number of used extents, the backup stores only
+// them and the restore writes only them. The image file has no allocation map
+// then, restore takes the run lengths from the simulator.
+
+class CPipelineBench {
+public:
+  CPipelineBench(LPCWSTR imageFile, unsigned blockSize, unsigned bufferCount);
+
+  void SetVolume(unsigned __int64 size, CImageStreamSimulator::TContent content, unsigned fragments,
+                 unsigned usedPercent);
+  void SetCompression(TCompressionFormat format) {
+    fFormat = format;
+  }
+
+  // let the volume behave like a device of this model, NULL for an instant volume
+  void SetDevice(const TDeviceModel* model) {
+    fEmulateDevice = model != NULL;
+    if (model)
+      fDeviceModel = *model;
+  }
+
+  // backup must run first, verify and restore use its image file
+  TBenchResult Backup();
+  TBenchResult Verify();
+  TBenchResult Restore();
+
+  // delete image file and chunk store
+  void Cleanup();
+
+private:
+  CImageStreamSimulator* NewVolume(IImageStream::TOpenMode mode);
+  void Run(const std::vector<COdinThread*>& threads, TBenchResult& result);
+  void InitResult(LPCWSTR operation, TBenchResult& result);
+
+  std::wstring fImageFile;
+  unsigned fBlockSize;
+  unsigned fBufferCount;
+  TCompressionFormat fFormat;
+  unsigned __int64 fVolumeSize;
+  CImageStreamSimulator::TContent fContent;
+  bool fEmulateDevice;
+  TDeviceModel fDeviceModel;
+  std::vector<int> fRunLengths;  // used and free clusters in turn, empty if volume is not fragmented
+  DWORD fVolumeCrc32;            // checksum of the data read by the last backup
+  unsigned __int64 fUsedBytes;   // bytes read by the last backup
+};
+
+#endif
@@ -0,0 +1,36 @@
+// stdafx.h : include file for standard system include files,
+// or project specific include files that are used frequently, but
+// are changed infrequently
+//
+
+#pragma once
+
+#include <stdio.h>
+#include <memory>
+
+#ifdef _WIN32
+
+#define WINVER		0x0501
+#define _WIN32_WINNT	0x0501
+#define _CRT_NON_CONFORMING_SWPRINTFS
+#define _CRT_SECURE_NO_DEPRECATE
+
+#include <tchar.h>
+
+// The benchmarks use neither ATL nor WTL, the engine sources compiled into
+// ODINBench.vcxproj with this precompiled header need the ATL base classes and
+// CString on Windows. There is no CAppModule.
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <atlbase.h>
+#include <atlstr.h>
+
+// to track memory allocations:
+#include "../../src/ODIN/DebugMem.h"
+
+#else
+
+// the engine library odincore on POSIX systems, see posix/PosixPlatform.h
+#include "../../src/ODIN/posix/PosixPlatform.h"
+
+#endif
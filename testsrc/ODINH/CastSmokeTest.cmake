@@ -0,0 +1,78 @@
+# Restores an image cast by odinserver to several odinh clients at the same time.
+# Called by ctest with ODINH (path of odinh), ODINSERVER (path of odinserver) and
+# WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/images)
+set(volume ${WORK_DIR}/volume.bin)
+set(portFile ${WORK_DIR}/port.txt)
+
+# 6MB volume of a repeated block of random text, not a multiple of the 1MB blocks
+# that are cast
+string(RANDOM LENGTH 32768 text)
+file(WRITE ${volume} "")
+foreach(i RANGE 191)
+  file(APPEND ${volume} "${text}")
+endforeach()
+file(APPEND ${volume} "${text}")
+
+execute_process(COMMAND ${ODINH} backup ${volume} ${WORK_DIR}/images/volume.img -compression=gzip RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "backup returned ${result}")
+endif()
+
+# the server runs in the background until it is killed at the end, a cast starts
+# when three clients joined or after a second
+execute_process(COMMAND sh -c "'${ODINSERVER}' -dir='${WORK_DIR}/images' -port=0 -portfile='${portFile}' -castclients=3 -castwait=1 > '${WORK_DIR}/server.log' 2>&1 & echo $!"
+  OUTPUT_VARIABLE serverPid OUTPUT_STRIP_TRAILING_WHITESPACE)
+foreach(i RANGE 100)
+  if(EXISTS ${portFile})
+    break()
+  endif()
+  execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.1)
+endforeach()
+if(NOT EXISTS ${portFile})
+  execute_process(COMMAND kill ${serverPid})
+  message(FATAL_ERROR "odinserver did not start")
+endif()
+file(STRINGS ${portFile} port)
+set(image odincast://127.0.0.1:${port}/volume.img)
+
+# three clients restoring at the same time, exit codes are written to files
+set(script "")
+foreach(i RANGE 1 3)
+  string(APPEND script "('${ODINH}' restore '${image}' '${WORK_DIR}/restored${i}.bin' > '${WORK_DIR}/client${i}.log' 2>&1; echo $? > '${WORK_DIR}/result${i}.txt') & ")
+endforeach()
+string(APPEND script "wait")
+execute_process(COMMAND sh -c "${script}" TIMEOUT 120)
+
+function(odinh expectedResult)
+  execute_process(COMMAND ${ODINH} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    execute_process(COMMAND kill ${serverPid})
+    message(FATAL_ERROR "odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+endfunction()
+
+# a client joining later gets a cast of its own, the image can be verified and
+# not be written
+odinh(0 restore ${image} ${WORK_DIR}/restored4.bin)
+odinh(0 verify ${image})
+odinh(1 backup ${volume} ${image} -compression=none)
+
+execute_process(COMMAND kill ${serverPid})
+foreach(i RANGE 1 3)
+  file(STRINGS ${WORK_DIR}/result${i}.txt result)
+  file(READ ${WORK_DIR}/client${i}.log log)
+  message(STATUS "client ${i}: ${result}\n${log}")
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "client ${i} returned ${result}")
+  endif()
+endforeach()
+foreach(i RANGE 1 4)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${WORK_DIR}/restored${i}.bin RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "restored${i}.bin differs")
+  endif()
+endforeach()
@@ -0,0 +1,40 @@
+# Runs backups with the codecs that depend on libraries found at build time. A
+# codec that is not in the build is rejected before anything is written, the
+# others are verified. Called by ctest with ODINH (path of odinh), LZ4 and ZSTD
+# (1 if the codec is in the build) and WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(volume ${WORK_DIR}/volume.bin)
+
+string(RANDOM LENGTH 32768 text)
+file(WRITE ${volume} "")
+foreach(i RANGE 31)
+  file(APPEND ${volume} "${text}")
+endforeach()
+
+function(odinh expectedResult)
+  execute_process(COMMAND ${ODINH} ${ARGN} TIMEOUT 60 RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    message(FATAL_ERROR "odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+endfunction()
+
+function(codec name available)
+  set(image ${WORK_DIR}/${name}.img)
+  if(available)
+    odinh(0 backup ${volume} ${image} -compression=${name})
+    odinh(0 verify ${image})
+    odinh(0 compare ${image} ${volume})
+  else()
+    odinh(2 backup ${volume} ${image} -compression=${name})
+    if(EXISTS ${image} OR EXISTS ${image}.journal)
+      message(FATAL_ERROR "backup with ${name} left an image or a journal")
+    endif()
+  endif()
+endfunction()
+
+codec(lz4 ${LZ4})
+codec(lz4hc ${LZ4})
+codec(zstd ${ZSTD})
@@ -0,0 +1,99 @@
+# Runs backup, verify, inspect, restore and compare of odinh with images stored
+# as objects of odinhttptest, an HTTP server standing in for an S3 compatible
+# object storage. Called by ctest with ODINH (path of odinh), HTTPSERVER (path
+# of odinhttptest) and WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/objects)
+set(volume ${WORK_DIR}/volume.bin)
+
+# 20MB volume of a repeated block of random text: an uncompressed image is
+# uploaded in several parts of 8MB and read in several blocks of 4MB
+string(RANDOM LENGTH 32768 text)
+file(WRITE ${volume} "")
+foreach(i RANGE 639)
+  file(APPEND ${volume} "${text}")
+endforeach()
+file(APPEND ${volume} "${text}")
+
+# a server answering all requests and one answering every second GET and part
+# upload with 503, both run in the background until they are killed at the end
+set(serverPids)
+function(start_server name)
+  set(portFile ${WORK_DIR}/${name}.port)
+  execute_process(COMMAND sh -c "'${HTTPSERVER}' -dir='${WORK_DIR}/objects' -port=0 -portfile='${portFile}' ${ARGN} > '${WORK_DIR}/${name}.log' 2>&1 & echo $!"
+    OUTPUT_VARIABLE pid OUTPUT_STRIP_TRAILING_WHITESPACE)
+  set(serverPids ${serverPids} ${pid} PARENT_SCOPE)
+  foreach(i RANGE 100)
+    if(EXISTS ${portFile})
+      break()
+    endif()
+    execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.1)
+  endforeach()
+  if(NOT EXISTS ${portFile})
+    execute_process(COMMAND kill ${pid})
+    message(FATAL_ERROR "odinhttptest did not start")
+  endif()
+  file(STRINGS ${portFile} port)
+  set(${name} http://127.0.0.1:${port} PARENT_SCOPE)
+endfunction()
+
+function(fail message)
+  execute_process(COMMAND kill ${serverPids})
+  message(FATAL_ERROR "${message}")
+endfunction()
+
+function(odinh expectedResult)
+  execute_process(COMMAND ${ODINH} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    fail("odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+function(check_restored restored)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${restored} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    fail("${restored} differs")
+  endif()
+endfunction()
+
+start_server(server)
+start_server(failingServer -fail=2)
+
+odinh(0 backup ${volume} ${server}/volume.img -compression=none -comment=http)
+odinh(0 verify ${server}/volume.img)
+odinh(0 inspect ${server}/volume.img)
+if(NOT output MATCHES "version: 1.4" OR NOT output MATCHES "comment: http" OR NOT output MATCHES "volume size: 21004288")
+  fail("unexpected header")
+endif()
+odinh(0 restore ${server}/volume.img ${WORK_DIR}/restored.bin)
+check_restored(${WORK_DIR}/restored.bin)
+odinh(0 compare ${server}/volume.img ${volume})
+
+# parts and blocks failing temporarily are sent and requested again
+odinh(0 backup ${volume} ${failingServer}/gzip.img -compression=gzip)
+odinh(0 restore ${failingServer}/gzip.img ${WORK_DIR}/restoredRetry.bin)
+check_restored(${WORK_DIR}/restoredRetry.bin)
+file(READ ${WORK_DIR}/failingServer.log log)
+if(NOT log MATCHES "PUT /gzip.img part [0-9]+: 503" OR NOT log MATCHES "GET /gzip.img bytes=[0-9-]+: 503")
+  fail("no requests failed")
+endif()
+
+# an image file with a block manifest copied to the server is read as well
+odinh(0 backup ${volume} ${WORK_DIR}/file.img -compression=gzip -manifest=1024)
+file(COPY ${WORK_DIR}/file.img DESTINATION ${WORK_DIR}/objects)
+odinh(0 verify ${server}/file.img)
+odinh(0 restore ${server}/file.img ${WORK_DIR}/restoredFile.bin)
+check_restored(${WORK_DIR}/restoredFile.bin)
+
+# missing objects, chunk stores and HTTPS fail, an upload that failed leaves no object
+odinh(1 verify ${server}/missing.img)
+odinh(1 backup ${volume} ${server}/dedup.img -compression=dedup)
+odinh(1 verify https://127.0.0.1/volume.img)
+if(EXISTS ${WORK_DIR}/objects/dedup.img)
+  fail("object of a failed upload stored")
+endif()
+
+execute_process(COMMAND kill ${serverPids})
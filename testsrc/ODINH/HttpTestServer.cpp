@@ -0,0 +1,399 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+// odinhttptest: minimal HTTP object server standing in for an S3 compatible
+// object storage in the tests of HTTP images (see CHttpImageStream).
+//
+//   odinhttptest -dir=directory [-port=n] [-portfile=file] [-fail=n]
+//
+// Objects are the files in directory, the server listens on port n of the
+// loopback interface (0 for a free port) and writes it to file once it accepts
+// clients. It answers the requests of an S3 multipart upload and ranged reads:
+//
+//   HEAD /path                                   size of the object
+//   GET /path, Range: bytes=first-last           part of the object (206)
+//   GET /path                                    whole object
+//   POST /path?uploads                           start an upload, <UploadId> in the answer
+//   PUT /path?partNumber=n&uploadId=id           store part n of an upload, ETag in the answer
+//   POST /path?uploadId=id                       store the parts listed as object
+//   DELETE /path?uploadId=id                     drop the parts of an upload
+//
+// With -fail=n every n-th GET and PUT of a part is answered with 503 so that
+// retries can be tested. Each request is logged with its status to standard
+// output. The server runs until it is killed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+typedef struct {
+  string path;                    // object the upload is stored as
+  map<unsigned, string> parts;    // data of the parts by number
+} TUpload;
+
+static string sDirectory;
+static unsigned sFailEvery = 0;
+static atomic<unsigned> sFailCounter(0);
+static atomic<unsigned> sNextUpload(1);
+static map<string, TUpload> sUploads;
+static mutex sLock;                // protects uploads
+static mutex sLogLock;             // protects the log
+
+//---------------------------------------------------------------------------
+// connection with a buffer for the received data
+
+class CClient {
+public:
+  CClient(int s) : fSocket(s) {
+  }
+  ~CClient() {
+    close(fSocket);
+  }
+
+  // a line without CR LF, false if the connection ended
+  bool ReadLine(string& line) {
+    line.clear();
+    for (;;) {
+      size_t end = fBuffer.find("\r\n");
+      if (end != string::npos) {
+        line = fBuffer.substr(0, end);
+        fBuffer.erase(0, end + 2);
+        return true;
+      }
+      if (fBuffer.length() > 64 * 1024 || !Fill())
+        return false;
+    }
+  }
+
+  bool Read(string& data, size_t length) {
+    while (fBuffer.length() < length) {
+      if (!Fill())
+        return false;
+    }
+    data = fBuffer.substr(0, length);
+    fBuffer.erase(0, length);
+    return true;
+  }
+
+  bool Send(const string& data) {
+    for (size_t sent = 0; sent < data.length(); ) {
+      ssize_t n = send(fSocket, data.data() + sent, data.length() - sent, MSG_NOSIGNAL);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return false;
+      sent += n;
+    }
+    return true;
+  }
+
+private:
+  bool Fill() {
+    char buffer[256 * 1024];
+    ssize_t n;
+    do {
+      n = recv(fSocket, buffer, sizeof(buffer), 0);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+      return false;
+    fBuffer.append(buffer, n);
+    return true;
+  }
+
+  int fSocket;
+  string fBuffer;
+};
+
+//---------------------------------------------------------------------------
+// requests
+
+typedef struct {
+  string method;
+  string path;                  // decoded, without leading /
+  map<string, string> query;
+  map<string, string> headers;  // names in lower case
+  string body;
+} TRequest;
+
+static string Decode(const string& text)
+{
+  string result;
+  for (size_t i=0; i<text.length(); i++) {
+    if (text[i] == '%' && i + 2 < text.length()) {
+      result += (char) strtol(text.substr(i + 1, 2).c_str(), NULL, 16);
+      i += 2;
+    } else {
+      result += text[i];
+    }
+  }
+  return result;
+}
+
+static string ToLower(string text)
+{
+  for (size_t i=0; i<text.length(); i++)
+    text[i] = (char) tolower((unsigned char) text[i]);
+  return text;
+}
+
+static bool ReadRequest(CClient& client, TRequest& request)
+{
+  string line;
+
+  if (!client.ReadLine(line))
+    return false;
+  istringstream requestLine(line);
+  string target;
+  requestLine >> request.method >> target;
+  size_t queryStart = target.find('?');
+  request.path = Decode(target.substr(1, queryStart == string::npos ? string::npos : queryStart - 1));
+  request.query.clear();
+  if (queryStart != string::npos) {
+    istringstream query(target.substr(queryStart + 1));
+    string parameter;
+    while (getline(query, parameter, '&')) {
+      size_t eq = parameter.find('=');
+      request.query[Decode(parameter.substr(0, eq))] = eq == string::npos ? "" : Decode(parameter.substr(eq + 1));
+    }
+  }
+  request.headers.clear();
+  while (client.ReadLine(line) && !line.empty()) {
+    size_t colon = line.find(':');
+    if (colon != string::npos)
+      request.headers[ToLower(line.substr(0, colon))] = line.substr(line.find_first_not_of(' ', colon + 1));
+  }
+  size_t length = request.headers.count("content-length") ? strtoul(request.headers["content-length"].c_str(), NULL, 10) : 0;
+  return client.Read(request.body, length);
+}
+
+static bool Answer(CClient& client, const TRequest& request, int status, const string& reason, const string& body,
+                   const string& headers = "", size_t contentLength = string::npos)
+{
+  {
+    lock_guard<mutex> lock(sLogLock);
+    cout << request.method << " /" << request.path << (request.query.count("partNumber") ? " part " + request.query.at("partNumber") : "")
+         << (request.headers.count("range") ? " " + request.headers.at("range") : "") << ": " << status << endl;
+  }
+  ostringstream answer;
+  answer << "HTTP/1.1 " << status << " " << reason << "\r\nContent-Length: "
+         << (contentLength == string::npos ? body.length() : contentLength) << "\r\n" << headers << "\r\n";
+  return client.Send(answer.str() + (request.method == "HEAD" ? "" : body));
+}
+
+static bool AnswerError(CClient& client, const TRequest& request, int status, const string& reason, const string& code)
+{
+  return Answer(client, request, status, reason, "<Error><Code>" + code + "</Code></Error>");
+}
+
+static bool ReadObject(const string& path, string& data)
+{
+  ifstream in((sDirectory + "/" + path).c_str(), ios::binary);
+  if (!in)
+    return false;
+  ostringstream content;
+  content << in.rdbuf();
+  data = content.str();
+  return true;
+}
+
+static bool HandleRequest(CClient& client, TRequest& request)
+{
+  bool isPart = request.method == "PUT" && request.query.count("partNumber");
+
+  if (request.path.empty() || request.path.find("..") != string::npos)
+    return AnswerError(client, request, 400, "Bad Request", "InvalidURI");
+  if (sFailEvery > 0 && (request.method == "GET" || isPart) && ++sFailCounter % sFailEvery == 0)
+    return AnswerError(client, request, 503, "Service Unavailable", "SlowDown");
+
+  if (request.method == "HEAD" || request.method == "GET") {
+    string data;
+    if (!ReadObject(request.path, data))
+      return AnswerError(client, request, 404, "Not Found", "NoSuchKey");
+    if (request.method == "HEAD")
+      return Answer(client, request, 200, "OK", "", "", data.length());
+    if (!request.headers.count("range"))
+      return Answer(client, request, 200, "OK", data);
+    unsigned long long first = 0, last = 0;
+    if (sscanf(request.headers["range"].c_str(), "bytes=%llu-%llu", &first, &last) != 2 || first > last ||
+        first >= data.length())
+      return AnswerError(client, request, 416, "Range Not Satisfiable", "InvalidRange");
+    last = min(last, (unsigned long long) data.length() - 1);
+    ostringstream range;
+    range << "Content-Range: bytes " << first << "-" << last << "/" << data.length() << "\r\n";
+    return Answer(client, request, 206, "Partial Content", data.substr(first, last - first + 1), range.str());
+  }
+
+  if (request.method == "POST" && request.query.count("uploads")) {
+    string id = "upload" + to_string(sNextUpload++);
+    {
+      lock_guard<mutex> lock(sLock);
+      sUploads[id].path = request.path;
+    }
+    return Answer(client, request, 200, "OK", "<InitiateMultipartUploadResult><UploadId>" + id +
+                  "</UploadId></InitiateMultipartUploadResult>");
+  }
+
+  string id = request.query.count("uploadId") ? request.query["uploadId"] : "";
+  unique_lock<mutex> lock(sLock);
+  map<string, TUpload>::iterator upload = sUploads.find(id);
+  if (upload == sUploads.end() || upload->second.path != request.path) {
+    lock.unlock();
+    return AnswerError(client, request, 404, "Not Found", "NoSuchUpload");
+  }
+  if (isPart) {
+    unsigned number = strtoul(request.query["partNumber"].c_str(), NULL, 10);
+    upload->second.parts[number].swap(request.body);
+    string etag = "\"" + to_string(number) + "-" + to_string(upload->second.parts[number].length()) + "\"";
+    lock.unlock();
+    return Answer(client, request, 200, "OK", "", "ETag: " + etag + "\r\n");
+  }
+  if (request.method == "POST") {
+    // parts are stored in the order of the list, each with the ETag it got
+    string data;
+    size_t pos = 0;
+    unsigned expected = 1;
+    while ((pos = request.body.find("<PartNumber>", pos)) != string::npos) {
+      unsigned number = strtoul(request.body.c_str() + pos + 12, NULL, 10);
+      size_t etagStart = request.body.find("<ETag>", pos) + 6;
+      string etag = request.body.substr(etagStart, request.body.find("</ETag>", etagStart) - etagStart);
+      map<unsigned, string>::iterator part = upload->second.parts.find(number);
+      if (number != expected++ || part == upload->second.parts.end() ||
+          etag != "\"" + to_string(number) + "-" + to_string(part->second.length()) + "\"") {
+        lock.unlock();
+        return AnswerError(client, request, 400, "Bad Request", "InvalidPart");
+      }
+      data += part->second;
+      pos = etagStart;
+    }
+    sUploads.erase(upload);
+    lock.unlock();
+    ofstream out((sDirectory + "/" + request.path).c_str(), ios::binary | ios::trunc);
+    out.write(data.data(), data.length());
+    out.close();
+    if (!out)
+      return AnswerError(client, request, 500, "Internal Server Error", "InternalError");
+    return Answer(client, request, 200, "OK", "<CompleteMultipartUploadResult><Key>" + request.path +
+                  "</Key></CompleteMultipartUploadResult>");
+  }
+  if (request.method == "DELETE") {
+    sUploads.erase(upload);
+    lock.unlock();
+    return Answer(client, request, 204, "No Content", "");
+  }
+  lock.unlock();
+  return AnswerError(client, request, 405, "Method Not Allowed", "MethodNotAllowed");
+}
+
+static void ServeClient(int s)
+{
+  CClient client(s);
+  TRequest request;
+
+  while (ReadRequest(client, request)) {
+    if (!HandleRequest(client, request))
+      break;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int port = 0;
+  string portFile;
+
+  for (int i=1; i<argc; i++) {
+    string arg = argv[i];
+    size_t eq = arg.find('=');
+    string name = arg.substr(0, eq), value = eq == string::npos ? "" : arg.substr(eq + 1);
+    if (name == "-dir" && !value.empty()) {
+      sDirectory = value;
+    } else if (name == "-port" && !value.empty()) {
+      port = atoi(value.c_str());
+    } else if (name == "-portfile" && !value.empty()) {
+      portFile = value;
+    } else if (name == "-fail" && !value.empty()) {
+      sFailEvery = strtoul(value.c_str(), NULL, 10);
+    } else {
+      cerr << "Usage: odinhttptest -dir=directory [-port=n] [-portfile=file] [-fail=n]" << endl;
+      return 2;
+    }
+  }
+  if (sDirectory.empty() || port < 0 || port > 65535) {
+    cerr << "Usage: odinhttptest -dir=directory [-port=n] [-portfile=file] [-fail=n]" << endl;
+    return 2;
+  }
+
+  int listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  int yes = 1;
+  struct sockaddr_in addr;
+  socklen_t addrLength = sizeof(addr);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons((unsigned short) port);
+  setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+  if (bind(listenSocket, (struct sockaddr*) &addr, sizeof(addr)) != 0 || listen(listenSocket, SOMAXCONN) != 0 ||
+      getsockname(listenSocket, (struct sockaddr*) &addr, &addrLength) != 0) {
+    cerr << "Error: can not listen on port " << port << endl;
+    return 1;
+  }
+  if (!portFile.empty()) {
+    // written to a new name and renamed so that the port is never read half written
+    ofstream out((portFile + ".tmp").c_str());
+    out << ntohs(addr.sin_port) << endl;
+    out.close();
+    if (!out || rename((portFile + ".tmp").c_str(), portFile.c_str()) != 0) {
+      cerr << "Error: can not write " << portFile << endl;
+      return 1;
+    }
+  }
+  for (;;) {
+    int s = accept(listenSocket, NULL, NULL);
+    if (s < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      cerr << "Error: accepting clients failed" << endl;
+      return 1;
+    }
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+    thread(ServeClient, s).detach();
+  }
+}
@@ -0,0 +1,71 @@
+# Runs backup, verify, inspect, restore and compare of odinh with an image
+# stored on odinserver. Called by ctest with ODINH (path of odinh), ODINSERVER
+# (path of odinserver) and WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/images)
+set(volume ${WORK_DIR}/volume.bin)
+set(portFile ${WORK_DIR}/port.txt)
+
+# 6MB volume of a repeated block of random text, not a multiple of the 1MB blocks
+# that are sent over the connections
+string(RANDOM LENGTH 32768 text)
+file(WRITE ${volume} "")
+foreach(i RANGE 191)
+  file(APPEND ${volume} "${text}")
+endforeach()
+file(APPEND ${volume} "${text}")
+
+# the server runs in the background until it is killed at the end
+execute_process(COMMAND sh -c "'${ODINSERVER}' -dir='${WORK_DIR}/images' -port=0 -portfile='${portFile}' > '${WORK_DIR}/server.log' 2>&1 & echo $!"
+  OUTPUT_VARIABLE serverPid OUTPUT_STRIP_TRAILING_WHITESPACE)
+foreach(i RANGE 100)
+  if(EXISTS ${portFile})
+    break()
+  endif()
+  execute_process(COMMAND ${CMAKE_COMMAND} -E sleep 0.1)
+endforeach()
+if(NOT EXISTS ${portFile})
+  execute_process(COMMAND kill ${serverPid})
+  message(FATAL_ERROR "odinserver did not start")
+endif()
+file(STRINGS ${portFile} port)
+set(image odin://127.0.0.1:${port}/volume.img)
+
+function(odinh expectedResult)
+  execute_process(COMMAND ${ODINH} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    execute_process(COMMAND kill ${serverPid})
+    message(FATAL_ERROR "odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+odinh(0 backup ${volume} ${image} -compression=gzip -comment=net)
+odinh(0 verify ${image})
+odinh(0 inspect ${image})
+if(NOT output MATCHES "compression: gzip" OR NOT output MATCHES "volume size: 6324224")
+  execute_process(COMMAND kill ${serverPid})
+  message(FATAL_ERROR "unexpected header")
+endif()
+odinh(0 restore ${image} ${WORK_DIR}/restored.bin)
+odinh(0 compare ${image} ${volume})
+
+# uncompressed images are stored block by block
+odinh(0 backup ${volume} odin://127.0.0.1:${port}/raw.img -compression=none)
+odinh(0 restore odin://127.0.0.1:${port}/raw.img ${WORK_DIR}/restoredRaw.bin)
+
+# paths leaving the image directory are refused
+odinh(1 backup ${volume} odin://127.0.0.1:${port}/../outside.img -compression=none)
+
+execute_process(COMMAND kill ${serverPid})
+foreach(restored restored.bin restoredRaw.bin)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${WORK_DIR}/${restored} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${restored} differs")
+  endif()
+endforeach()
+if(EXISTS ${WORK_DIR}/outside.img)
+  message(FATAL_ERROR "image stored outside of the image directory")
+endif()
@@ -0,0 +1,181 @@
+# Runs backup, verify, inspect, restore, compare and transcode of odinh with
+# a volume in a file. Called by ctest with ODINH (path of odinh), COMPRESSION
+# and WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(volume ${WORK_DIR}/volume.bin)
+set(image ${WORK_DIR}/volume.img)
+
+# 4MB volume of a repeated block of random text and a copy with a different last block
+string(RANDOM LENGTH 32768 text)
+string(RANDOM LENGTH 32768 otherText)
+file(WRITE ${volume} "")
+file(WRITE ${WORK_DIR}/changed.bin "")
+foreach(i RANGE 126)
+  file(APPEND ${volume} "${text}")
+  file(APPEND ${WORK_DIR}/changed.bin "${text}")
+endforeach()
+file(APPEND ${volume} "${text}")
+file(APPEND ${WORK_DIR}/changed.bin "${otherText}")
+
+function(odinh expectedResult)
+  execute_process(COMMAND ${ODINH} ${ARGN} RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    message(FATAL_ERROR "odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+odinh(0 backup ${volume} ${image} -compression=${COMPRESSION} -comment=smoke)
+odinh(0 verify ${image})
+odinh(0 inspect ${image})
+if(NOT output MATCHES "compression: ${COMPRESSION}" OR NOT output MATCHES "volume size: 4194304"
+   OR NOT output MATCHES "comment: smoke\n" OR NOT output MATCHES "version: 1.4\n")
+  message(FATAL_ERROR "unexpected header")
+endif()
+
+# the comment is stored as UTF-16LE like on Windows: commentLength at offset 48 of the
+# header, commentOffset at offset 80
+function(read_header_value offset length variable)
+  file(READ ${image} hex OFFSET ${offset} LIMIT ${length} HEX)
+  set(value "")
+  string(LENGTH "${hex}" hexLength)
+  while(hexLength GREATER 0)
+    math(EXPR hexLength "${hexLength} - 2")
+    string(SUBSTRING "${hex}" ${hexLength} 2 byte)
+    string(APPEND value ${byte})
+  endwhile()
+  math(EXPR value "0x${value}")
+  set(${variable} ${value} PARENT_SCOPE)
+endfunction()
+read_header_value(48 4 commentLength)
+read_header_value(80 8 commentOffset)
+file(READ ${image} comment OFFSET ${commentOffset} LIMIT ${commentLength} HEX)
+if(NOT commentLength EQUAL 10 OR NOT comment STREQUAL "73006d006f006b006500")
+  message(FATAL_ERROR "comment stored as ${commentLength} bytes ${comment}, expected UTF-16LE smoke")
+endif()
+
+odinh(0 restore ${image} ${WORK_DIR}/restored.bin)
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${WORK_DIR}/restored.bin RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "restored volume differs")
+endif()
+odinh(0 compare ${image} ${volume})
+
+# a changed volume is reported by compare
+odinh(1 compare ${image} ${WORK_DIR}/changed.bin)
+if(NOT output MATCHES "differs: offset 4161536")
+  message(FATAL_ERROR "difference not found")
+endif()
+odinh(2 compare ${image})
+
+# the transcoded image holds the same volume
+if(COMPRESSION STREQUAL "dedup")
+  set(target gzip)
+else()
+  set(target none)
+endif()
+odinh(0 transcode ${image} ${WORK_DIR}/transcoded.img -compression=${target})
+odinh(0 verify ${WORK_DIR}/transcoded.img)
+odinh(0 compare ${WORK_DIR}/transcoded.img ${volume})
+
+# a round trip through an uncompressed image back to gzip restores the same volume
+odinh(0 transcode ${image} ${WORK_DIR}/uncompressed.img -compression=none)
+odinh(0 transcode ${WORK_DIR}/uncompressed.img ${WORK_DIR}/roundtrip.img -compression=gzip)
+odinh(0 inspect ${WORK_DIR}/roundtrip.img)
+if(NOT output MATCHES "compression: gzip")
+  message(FATAL_ERROR "round trip image is not compressed with gzip")
+endif()
+odinh(0 restore ${WORK_DIR}/roundtrip.img ${WORK_DIR}/roundtrip.bin)
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${WORK_DIR}/roundtrip.bin RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+  message(FATAL_ERROR "volume restored after transcode round trip differs")
+endif()
+
+# reading 4MB with a limit of 1MB/s takes 4 seconds
+if(COMPRESSION STREQUAL "none")
+  string(TIMESTAMP start "%s")
+  odinh(0 backup ${volume} ${WORK_DIR}/limited.img -compression=none -readlimit=1 -writeiops=100 -lowpriority)
+  string(TIMESTAMP end "%s")
+  math(EXPR elapsed "${end} - ${start}")
+  if(elapsed LESS 3)
+    message(FATAL_ERROR "backup with -readlimit=1 took ${elapsed} seconds")
+  endif()
+  odinh(0 compare ${WORK_DIR}/limited.img ${volume})
+endif()
+
+# a backup and a restore interrupted after their first checkpoint continue there with -resume
+function(interrupted)
+  execute_process(COMMAND ${ODINH} ${ARGN} TIMEOUT 2.5 RESULT_VARIABLE result OUTPUT_QUIET ERROR_QUIET)
+  message(STATUS "odinh ${ARGN} interrupted: ${result}")
+  if(result EQUAL 0)
+    message(FATAL_ERROR "odinh ${ARGN} was not interrupted")
+  endif()
+endfunction()
+
+if(COMPRESSION STREQUAL "dedup")
+  odinh(1 backup ${volume} ${WORK_DIR}/resumed.img -compression=dedup -resume)
+else()
+  interrupted(backup ${volume} ${WORK_DIR}/resumed.img -compression=${COMPRESSION} -readlimit=1 -checkpoint=1)
+  if(NOT EXISTS ${WORK_DIR}/resumed.img.journal)
+    message(FATAL_ERROR "no checkpoint journal")
+  endif()
+  odinh(0 backup ${volume} ${WORK_DIR}/resumed.img -compression=${COMPRESSION} -checkpoint=1 -resume)
+  if(NOT output MATCHES "backup resumed at")
+    message(FATAL_ERROR "backup not resumed")
+  endif()
+  if(EXISTS ${WORK_DIR}/resumed.img.journal)
+    message(FATAL_ERROR "checkpoint journal of completed backup not deleted")
+  endif()
+  odinh(0 verify ${WORK_DIR}/resumed.img)
+  odinh(0 compare ${WORK_DIR}/resumed.img ${volume})
+  # compressed data of several streams need version 1.5, older versions reject the image
+  odinh(0 inspect ${WORK_DIR}/resumed.img)
+  if(COMPRESSION STREQUAL "none")
+    set(version "1.4")
+  else()
+    set(version "1.5")
+  endif()
+  if(NOT output MATCHES "version: ${version}\n" OR NOT output MATCHES "compression: ${COMPRESSION}")
+    message(FATAL_ERROR "image with checkpoints is not version ${version}")
+  endif()
+
+  interrupted(restore ${WORK_DIR}/resumed.img ${WORK_DIR}/resumed.bin -writelimit=1 -checkpoint=1)
+  odinh(0 restore ${WORK_DIR}/resumed.img ${WORK_DIR}/resumed.bin -checkpoint=1 -resume)
+  if(NOT output MATCHES "restore resumed at")
+    message(FATAL_ERROR "restore not resumed")
+  endif()
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${WORK_DIR}/resumed.bin RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "resumed restore differs")
+  endif()
+
+  # a backup cancelled by SIGINT keeps its journal, -resume alone takes it up
+  find_program(TIMEOUT_PROGRAM timeout)
+  if(TIMEOUT_PROGRAM)
+    execute_process(COMMAND ${TIMEOUT_PROGRAM} --preserve-status -s INT 2 ${ODINH} backup ${volume}
+      ${WORK_DIR}/cancelled.img -compression=${COMPRESSION} -readlimit=1 -checkpoint=1
+      RESULT_VARIABLE result OUTPUT_VARIABLE output ERROR_VARIABLE error)
+    message(STATUS "odinh backup cancelled: ${result}\n${output}${error}")
+    if(NOT result EQUAL 1 OR NOT error MATCHES "backup cancelled")
+      message(FATAL_ERROR "backup not cancelled")
+    endif()
+    if(NOT EXISTS ${WORK_DIR}/cancelled.img.journal)
+      message(FATAL_ERROR "checkpoint journal of cancelled backup not kept")
+    endif()
+    odinh(0 backup ${volume} ${WORK_DIR}/cancelled.img -compression=${COMPRESSION} -resume)
+    if(NOT output MATCHES "backup resumed at")
+      message(FATAL_ERROR "cancelled backup not resumed")
+    endif()
+    odinh(0 compare ${WORK_DIR}/cancelled.img ${volume})
+  endif()
+endif()
+
+# checkpoints are off by default
+odinh(0 backup ${volume} ${WORK_DIR}/unjournaled.img -compression=${COMPRESSION})
+file(GLOB journals ${WORK_DIR}/unjournaled.img*.journal)
+if(journals)
+  message(FATAL_ERROR "journal written without -checkpoint")
+endif()
@@ -0,0 +1,86 @@
+# Runs backup, verify, inspect, transcode and restore of odinh with images
+# piped through standard input and output. Called by ctest with ODINH (path of
+# odinh) and WORK_DIR.
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+set(volume ${WORK_DIR}/volume.bin)
+set(image ${WORK_DIR}/volume.img)
+
+# 5MB volume of a repeated block of random text, not a multiple of the 1MB blocks
+# that are read from standard input
+string(RANDOM LENGTH 32768 text)
+file(WRITE ${volume} "")
+foreach(i RANGE 159)
+  file(APPEND ${volume} "${text}")
+endforeach()
+file(APPEND ${volume} "${text}")
+
+# odinh with standard input read from inputFile and standard output written
+# to outputFile, an empty name keeps the standard stream
+function(odinh expectedResult inputFile outputFile)
+  set(redirect)
+  if(inputFile)
+    list(APPEND redirect INPUT_FILE ${inputFile})
+  endif()
+  if(outputFile)
+    list(APPEND redirect OUTPUT_FILE ${outputFile})
+  else()
+    list(APPEND redirect OUTPUT_VARIABLE output)
+  endif()
+  execute_process(COMMAND ${ODINH} ${ARGN} RESULT_VARIABLE result ERROR_VARIABLE error ${redirect})
+  message(STATUS "odinh ${ARGN}: ${result}\n${output}${error}")
+  if(NOT result EQUAL expectedResult)
+    message(FATAL_ERROR "odinh ${ARGN} returned ${result}, expected ${expectedResult}")
+  endif()
+  set(output "${output}" PARENT_SCOPE)
+endfunction()
+
+function(check_restored restored)
+  execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${volume} ${restored} RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${restored} differs")
+  endif()
+endfunction()
+
+odinh(0 "" ${image} backup ${volume} - -compression=gzip -comment=piped)
+odinh(0 ${image} "" verify -)
+odinh(0 ${image} "" restore - ${WORK_DIR}/restored.bin)
+check_restored(${WORK_DIR}/restored.bin)
+
+# the stored image is a regular image file with its final header at the end
+odinh(0 "" "" verify ${image})
+odinh(0 "" "" inspect ${image})
+if(NOT output MATCHES "version: 1.4" OR NOT output MATCHES "comment: piped" OR output MATCHES "data size: 0\n")
+  message(FATAL_ERROR "unexpected header")
+endif()
+odinh(0 "" "" restore ${image} ${WORK_DIR}/restoredFile.bin)
+check_restored(${WORK_DIR}/restoredFile.bin)
+
+# an image file written before can be piped as well
+odinh(0 "" "" backup ${volume} ${WORK_DIR}/file.img -compression=none)
+odinh(0 ${WORK_DIR}/file.img "" restore - ${WORK_DIR}/restoredPlain.bin)
+check_restored(${WORK_DIR}/restoredPlain.bin)
+
+# backup | transcode | restore without an image on disk
+execute_process(COMMAND ${ODINH} backup ${volume} - -compression=none
+                COMMAND ${ODINH} transcode - - -compression=gzip
+                COMMAND ${ODINH} restore - ${WORK_DIR}/restoredPiped.bin
+                RESULTS_VARIABLE results ERROR_VARIABLE error)
+message(STATUS "odinh backup | transcode | restore: ${results}\n${error}")
+if(NOT results STREQUAL "0;0;0")
+  message(FATAL_ERROR "odinh backup | transcode | restore returned ${results}")
+endif()
+check_restored(${WORK_DIR}/restoredPiped.bin)
+
+# an image that ends within its trailer fails its checksum (uncompressed, the
+# decompression of a truncated stream is not what is tested here)
+odinh(0 "" ${WORK_DIR}/raw.img backup ${volume} - -compression=none)
+file(READ ${WORK_DIR}/raw.img content HEX)
+string(LENGTH "${content}" hexLength)
+math(EXPR truncatedSize "${hexLength} / 2 - 100")
+execute_process(COMMAND head -c ${truncatedSize} ${WORK_DIR}/raw.img OUTPUT_FILE ${WORK_DIR}/truncated.img)
+odinh(1 ${WORK_DIR}/truncated.img "" verify -)
+
+# chunk stores are local files
+odinh(1 "" ${WORK_DIR}/dedup.img backup ${volume} - -compression=dedup)
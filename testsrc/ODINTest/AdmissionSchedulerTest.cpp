@@ -0,0 +1,187 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <vector>
+#include <cmath>
+#include "AdmissionSchedulerTest.h"
+#include "..\..\src\ODIN\AdmissionScheduler.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( AdmissionSchedulerTest );
+
+static const double sMB = 1024.0 * 1024.0;
+static const double sCardSize = 4096.0 * sMB;
+
+void AdmissionSchedulerTest::setUp()
+{
+}
+
+void AdmissionSchedulerTest::tearDown()
+{
+}
+
+double AdmissionSchedulerTest::RunStation(const vector<TSimBus>& buses, const vector<int>& cards,
+                                          CAdmissionScheduler* scheduler, unsigned maxConcurrent)
+{
+  vector<int> queue;
+  for (size_t i=0; i<cards.size(); i++)
+    queue.push_back((int) i);
+  vector<double> written(cards.size(), 0.0);
+  vector<int> running;
+  unsigned __int64 now = 0;
+  size_t done = 0;
+
+  while (done < cards.size()) {
+    // start queued cards the scheduler admits, in the order they were queued
+    for (size_t i=0; i<queue.size(); ) {
+      int card = queue[i];
+      bool start = scheduler ? scheduler->MayStart(buses[cards[card]].name) : running.size() < maxConcurrent;
+      if (start) {
+        if (scheduler)
+          scheduler->OnStarted(card, buses[cards[card]].name, now);
+        running.push_back(card);
+        queue.erase(queue.begin() + i);
+      } else {
+        ++i;
+      }
+    }
+    CPPUNIT_ASSERT(!running.empty());
+
+    now += 1000;
+    vector<unsigned> count(buses.size(), 0);
+    for (size_t i=0; i<running.size(); i++)
+      ++count[cards[running[i]]];
+    for (size_t i=0; i<running.size(); ) {
+      int card = running[i];
+      const TSimBus& bus = buses[cards[card]];
+      unsigned n = count[cards[card]];
+      double total = min(bus.bandwidth, n * bus.cardRate) * pow(1.0 - bus.loss, (double) (n - 1));
+      double rate = total / n;
+      written[card] += rate;
+      if (written[card] >= sCardSize) {
+        if (scheduler)
+          scheduler->OnFinished(card, now);
+        running.erase(running.begin() + i);
+        ++done;
+      } else {
+        if (scheduler)
+          scheduler->OnRate(card, (unsigned __int64) rate, now);
+        ++i;
+      }
+    }
+  }
+  return cards.size() * 3600000.0 / now;
+}
+
+void AdmissionSchedulerTest::AdmissionTest()
+{
+  CAdmissionScheduler scheduler(3, 1000);
+
+  // one clone for each bus until the rates are known
+  CPPUNIT_ASSERT(scheduler.MayStart(L"hub"));
+  scheduler.OnStarted(0, L"hub", 0);
+  CPPUNIT_ASSERT(!scheduler.MayStart(L"hub"));
+  CPPUNIT_ASSERT(scheduler.MayStart(L"port"));
+  scheduler.OnStarted(1, L"port", 0);
+  CPPUNIT_ASSERT(scheduler.GetRunning() == 2);
+  CPPUNIT_ASSERT(scheduler.GetRunning(L"hub") == 1);
+
+  // rates before the settle time are not taken
+  scheduler.OnRate(0, 20000000, 500);
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"hub") == 1);
+  scheduler.OnRate(0, 20000000, 1000);
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"hub") == 2);
+  CPPUNIT_ASSERT(scheduler.GetMeasuredRate(L"hub", 1) == 20000000);
+  CPPUNIT_ASSERT(scheduler.MayStart(L"hub"));
+  scheduler.OnStarted(2, L"hub", 1000);
+
+  // no more than maxConcurrent clones over all buses
+  scheduler.OnRate(1, 20000000, 1000);
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"port") == 2);
+  CPPUNIT_ASSERT(!scheduler.MayStart(L"port"));
+  scheduler.OnFinished(0, 2000);
+  CPPUNIT_ASSERT(scheduler.MayStart(L"port"));
+  CPPUNIT_ASSERT(scheduler.GetRunning(L"hub") == 1);
+
+  // unknown slots are ignored
+  scheduler.OnRate(7, 1000, 3000);
+  scheduler.OnFinished(7, 3000);
+  CPPUNIT_ASSERT(scheduler.GetRunning() == 2);
+}
+
+void AdmissionSchedulerTest::PlateauTest()
+{
+  // two cards fill the hub, a third one only makes all of them slower
+  vector<TSimBus> buses;
+  TSimBus hub = { L"hub", 40 * sMB, 20 * sMB, 0.03 };
+  buses.push_back(hub);
+  vector<int> cards(10, 0);
+
+  CAdmissionScheduler scheduler(5);
+  RunStation(buses, cards, &scheduler, 5);
+  CPPUNIT_ASSERT(scheduler.IsSaturated(L"hub"));
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"hub") == 2);
+  CPPUNIT_ASSERT(scheduler.GetMeasuredRate(L"hub", 2) > scheduler.GetMeasuredRate(L"hub", 1));
+  CPPUNIT_ASSERT(scheduler.GetMeasuredRate(L"hub", 3) < scheduler.GetMeasuredRate(L"hub", 2));
+}
+
+void AdmissionSchedulerTest::SeparateBusesTest()
+{
+  // a controller port with room for all cards is not held back by the hub
+  vector<TSimBus> buses;
+  TSimBus hub = { L"hub", 40 * sMB, 20 * sMB, 0.03 };
+  TSimBus port = { L"port", 400 * sMB, 20 * sMB, 0.0 };
+  buses.push_back(hub);
+  buses.push_back(port);
+  vector<int> cards;
+  for (int i=0; i<12; i++)
+    cards.push_back(i % 2);
+
+  CAdmissionScheduler scheduler(5);
+  RunStation(buses, cards, &scheduler, 5);
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"hub") == 2);
+  CPPUNIT_ASSERT(scheduler.GetLimit(L"port") >= 3);
+  CPPUNIT_ASSERT(!scheduler.IsSaturated(L"port"));
+}
+
+void AdmissionSchedulerTest::StationThroughputTest()
+{
+  // cards behind a hub are queued first, with a fixed limit they take all slots
+  // and the cards on the other controller wait
+  vector<TSimBus> buses;
+  TSimBus hub = { L"hub", 40 * sMB, 20 * sMB, 0.03 };
+  TSimBus port = { L"port", 400 * sMB, 20 * sMB, 0.0 };
+  buses.push_back(hub);
+  buses.push_back(port);
+  vector<int> cards(6, 0);
+  cards.insert(cards.end(), 6, 1);
+
+  double fixedRate = RunStation(buses, cards, NULL, 5);
+  CAdmissionScheduler scheduler(5);
+  double adaptiveRate = RunStation(buses, cards, &scheduler, 5);
+  CPPUNIT_ASSERT(adaptiveRate > fixedRate * 1.2);
+}
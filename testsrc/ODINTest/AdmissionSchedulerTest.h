@@ -0,0 +1,65 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#pragma once
+
+#include <vector>
+#include "cppunit/extensions/HelperMacros.h"
+
+class CAdmissionScheduler;
+
+class AdmissionSchedulerTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( AdmissionSchedulerTest );
+  CPPUNIT_TEST( AdmissionTest );
+  CPPUNIT_TEST( PlateauTest );
+  CPPUNIT_TEST( SeparateBusesTest );
+  CPPUNIT_TEST( StationThroughputTest );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void AdmissionTest();
+  void PlateauTest();
+  void SeparateBusesTest();
+  void StationThroughputTest();
+
+private:
+  // drives sharing the bandwidth of a bus, each drive writes at most cardRate
+  // bytes/s, each additional drive costs loss of the bandwidth
+  typedef struct {
+    const wchar_t* name;
+    double bandwidth;
+    double cardRate;
+    double loss;
+  } TSimBus;
+
+  // clone cards (index of bus of each card, in the order they are queued) one
+  // second at a time, with scheduler or with a fixed limit if it is NULL,
+  // returns cards per hour
+  double RunStation(const std::vector<TSimBus>& buses, const std::vector<int>& cards,
+                    CAdmissionScheduler* scheduler, unsigned maxConcurrent);
+};
@@ -0,0 +1,213 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include "BlockManifestTest.h"
+#include "..\..\src\ODIN\BlockManifest.h"
+#include "..\..\src\ODIN\BlockVerifyThread.h"
+#include "..\..\src\ODIN\ImageStream.h"
+#include "..\..\src\ODIN\FileFormatException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( BlockManifestTest );
+
+static const wchar_t sManifestImageName[] = L"TestBlockManifest.img";
+
+void BlockManifestTest::setUp()
+{
+}
+
+void BlockManifestTest::tearDown()
+{
+  DeleteFile(sManifestImageName);
+}
+
+void BlockManifestTest::FillBuffer(BYTE* buffer, unsigned length)
+{
+  for (unsigned i=0; i<length; i++)
+    buffer[i] = (BYTE) ((i * 7) ^ (i >> 8));
+}
+
+void BlockManifestTest::Crc32cTest()
+{
+  // standard check value for crc32c
+  const char check[] = "123456789";
+  CPPUNIT_ASSERT_EQUAL((DWORD)0xE3069283, CCRC32C::Calculate((const BYTE*)check, 9));
+
+  // incremental calculation with unaligned pieces must give the same result
+  vector<BYTE> data(10007);
+  FillBuffer(&data[0], (unsigned)data.size());
+  DWORD oneShot = CCRC32C::Calculate(&data[0], (unsigned)data.size());
+  CCRC32C crc;
+  crc.AddDataBlock(&data[0], 3);
+  crc.AddDataBlock(&data[3], 4001);
+  crc.AddDataBlock(&data[4004], (unsigned)data.size() - 4004);
+  CPPUNIT_ASSERT_EQUAL(oneShot, crc.GetResult());
+}
+
+void BlockManifestTest::AddDataTest()
+{
+  const DWORD blockSize = 4096;
+  vector<BYTE> data(10000);
+  FillBuffer(&data[0], (unsigned)data.size());
+
+  // add data in pieces not aligned to block boundaries
+  CBlockManifest manifest(blockSize);
+  manifest.AddData(&data[0], 1000);
+  manifest.AddData(&data[1000], 5000);
+  manifest.AddData(&data[6000], 4000);
+  manifest.Finish();
+
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)3, manifest.GetBlockCount());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)10000, manifest.GetDataSize());
+  CPPUNIT_ASSERT_EQUAL(blockSize, (DWORD)manifest.GetBlockLength(0));
+  CPPUNIT_ASSERT_EQUAL(10000U - 2*blockSize, manifest.GetBlockLength(2));
+  CPPUNIT_ASSERT_EQUAL(0U, manifest.GetBlockLength(3));
+  for (unsigned i=0; i<3; i++) {
+    DWORD expected = CCRC32C::Calculate(&data[i*blockSize], manifest.GetBlockLength(i));
+    CPPUNIT_ASSERT_EQUAL(expected, manifest.GetChecksum(i));
+  }
+
+  // Finish() on a block boundary must not add an empty block
+  CBlockManifest manifest2(blockSize);
+  manifest2.AddData(&data[0], 2*blockSize);
+  manifest2.Finish();
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)2, manifest2.GetBlockCount());
+}
+
+void BlockManifestTest::SerializeTest()
+{
+  vector<BYTE> data(50000), buffer;
+  FillBuffer(&data[0], (unsigned)data.size());
+  CBlockManifest manifest(8192);
+  manifest.AddData(&data[0], (unsigned)data.size());
+  manifest.Finish();
+  manifest.Serialize(buffer);
+  CPPUNIT_ASSERT_EQUAL(manifest.GetSerializedLength(), (unsigned __int64)buffer.size());
+
+  CBlockManifest manifest2(1);
+  manifest2.Deserialize(&buffer[0], buffer.size());
+  CPPUNIT_ASSERT_EQUAL((DWORD)8192, manifest2.GetBlockSize());
+  CPPUNIT_ASSERT_EQUAL(manifest.GetDataSize(), manifest2.GetDataSize());
+  CPPUNIT_ASSERT_EQUAL(manifest.GetBlockCount(), manifest2.GetBlockCount());
+  for (unsigned __int64 i=0; i<manifest.GetBlockCount(); i++)
+    CPPUNIT_ASSERT_EQUAL(manifest.GetChecksum(i), manifest2.GetChecksum(i));
+
+  // damaged manifests must be rejected
+  CPPUNIT_ASSERT_THROW(manifest2.Deserialize(&buffer[0], buffer.size() - 4), EFileFormatException);
+  buffer[0] ^= 0xFF;
+  CPPUNIT_ASSERT_THROW(manifest2.Deserialize(&buffer[0], buffer.size()), EFileFormatException);
+}
+
+void BlockManifestTest::VerifyBlockTest()
+{
+  const DWORD blockSize = 1024;
+  vector<BYTE> data(3000);
+  FillBuffer(&data[0], (unsigned)data.size());
+  CBlockManifest manifest(blockSize);
+  manifest.AddData(&data[0], (unsigned)data.size());
+  manifest.Finish();
+
+  CPPUNIT_ASSERT(manifest.VerifyBlock(0, &data[0], blockSize));
+  CPPUNIT_ASSERT(manifest.VerifyBlock(2, &data[2*blockSize], 3000 - 2*blockSize));
+  // short read of last block
+  CPPUNIT_ASSERT(!manifest.VerifyBlock(2, &data[2*blockSize], 100));
+  // block number out of range
+  CPPUNIT_ASSERT(!manifest.VerifyBlock(3, &data[0], 0));
+  data[blockSize + 17] ^= 0x01;
+  CPPUNIT_ASSERT(!manifest.VerifyBlock(1, &data[blockSize], blockSize));
+}
+
+void BlockManifestTest::ImageFileVerifyTest()
+{
+  const DWORD blockSize = 4096;
+  const unsigned dataSize = 10 * blockSize + 123;
+  vector<BYTE> data(dataSize);
+  unsigned count;
+  FillBuffer(&data[0], dataSize);
+
+  // write an image file with a block manifest the same way the write thread does
+  CBlockManifest manifest(blockSize);
+  {
+    CFileImageStream imageStream;
+    imageStream.Open(sManifestImageName, IImageStream::forWriting);
+    imageStream.SetCompressionFormat(noCompression);
+    imageStream.SetVolumeFormat(CImageFileHeader::volumePartition);
+    imageStream.WriteImageFileHeaderForSaveAllBlocks(dataSize, 4096);
+    imageStream.SetBlockManifest(&manifest);
+    imageStream.Write(&data[0], dataSize, &count);
+    manifest.AddData(&data[0], dataSize);
+    imageStream.SetCompletedInformation(0, dataSize);
+    imageStream.Close();
+  }
+
+  // read manifest back
+  CBlockManifest readManifest(1);
+  unsigned __int64 dataOffset;
+  {
+    CFileImageStream imageStream;
+    imageStream.Open(sManifestImageName, IImageStream::forReading);
+    imageStream.ReadImageFileHeader(false);
+    CPPUNIT_ASSERT(imageStream.GetImageFileHeader().HasBlockManifest());
+    CPPUNIT_ASSERT(imageStream.ReadBlockManifest(readManifest));
+    dataOffset = imageStream.GetImageFileHeader().GetVolumeDataOffset();
+    imageStream.Close();
+  }
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)11, readManifest.GetBlockCount());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)dataSize, readManifest.GetDataSize());
+
+  // damage block 3 and the last block of the data area
+  HANDLE h = CreateFile(sManifestImageName, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CPPUNIT_ASSERT(h != INVALID_HANDLE_VALUE);
+  BYTE garbage[2] = { 0xDE, 0xAD };
+  DWORD written;
+  LARGE_INTEGER pos;
+  pos.QuadPart = dataOffset + 3 * blockSize + 100;
+  SetFilePointerEx(h, pos, NULL, FILE_BEGIN);
+  WriteFile(h, garbage, sizeof(garbage), &written, NULL);
+  pos.QuadPart = dataOffset + 10 * blockSize + 1;
+  SetFilePointerEx(h, pos, NULL, FILE_BEGIN);
+  WriteFile(h, garbage, sizeof(garbage), &written, NULL);
+  CloseHandle(h);
+
+  // check two halves of the image in two threads
+  CBlockVerifyThread thread1(sManifestImageName, 0, 0, NULL, &readManifest, dataOffset, 0, 6);
+  CBlockVerifyThread thread2(sManifestImageName, 0, 0, NULL, &readManifest, dataOffset, 6, 5);
+  thread1.Resume();
+  thread2.Resume();
+  HANDLE handles[2] = { thread1.GetHandle(), thread2.GetHandle() };
+  WaitForMultipleObjects(2, handles, TRUE, INFINITE);
+
+  CPPUNIT_ASSERT(!thread1.GetErrorFlag());
+  CPPUNIT_ASSERT(!thread2.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL((size_t)1, thread1.GetCorruptRanges().size());
+  CPPUNIT_ASSERT_EQUAL(dataOffset + 3 * blockSize, thread1.GetCorruptRanges()[0].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)blockSize, thread1.GetCorruptRanges()[0].length);
+  CPPUNIT_ASSERT_EQUAL((size_t)1, thread2.GetCorruptRanges().size());
+  CPPUNIT_ASSERT_EQUAL(dataOffset + 10 * blockSize, thread2.GetCorruptRanges()[0].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64)123, thread2.GetCorruptRanges()[0].length);
+  CPPUNIT_ASSERT_EQUAL((__int64)(6 * blockSize), thread1.GetBytesProcessed());
+}
@@ -0,0 +1,213 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+
+
+#include "stdafx.h"
+#include <vector>
+#include "CheckpointJournalTest.h"
+#include "..\..\src\ODIN\CheckpointJournal.h"
+#include "..\..\src\ODIN\InternalException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( CheckpointJournalTest );
+
+static const wchar_t sJournalName[] = L"TestCheckpoint.img.journal";
+
+static CCheckpointJournal::TJournalInfo MakeInfo()
+{
+  CCheckpointJournal::TJournalInfo info;
+  memset(&info, 0, sizeof(info));
+  info.operation = CCheckpointJournal::opBackup;
+  info.compressionFormat = compressionGZip;
+  info.manifestBlockSize = 4096;
+  info.volumeNameChecksum = CCheckpointJournal::GetNameChecksum(L"\\Device\\HarddiskVolume3");
+  info.volumeSize = 100 * 1048576;
+  info.dataOffset = 4096;
+  return info;
+}
+
+static CCheckpointJournal::TCheckpoint MakeCheckpoint(unsigned __int64 dataPos)
+{
+  CCheckpointJournal::TCheckpoint checkpoint;
+  memset(&checkpoint, 0, sizeof(checkpoint));
+  checkpoint.dataPos = dataPos;
+  checkpoint.sourcePos = dataPos + 512;
+  checkpoint.targetPos = dataPos / 2;
+  checkpoint.crc32 = (DWORD) dataPos ^ 0x12345678;
+  checkpoint.manifestChecksum = (DWORD) dataPos;
+  return checkpoint;
+}
+
+void CheckpointJournalTest::setUp()
+{
+  DeleteFile(sJournalName);
+}
+
+void CheckpointJournalTest::tearDown()
+{
+  DeleteFile(sJournalName);
+}
+
+void CheckpointJournalTest::CreateAndReopenTest()
+{
+  CCheckpointJournal::TJournalInfo info = MakeInfo();
+  DWORD checksums[5] = { 11, 12, 13, 14, 15 };
+  {
+    CCheckpointJournal journal;
+    // no journal yet, the operation starts from the beginning
+    CPPUNIT_ASSERT(!journal.Open(sJournalName, info));
+    journal.Create(sJournalName, info);
+    CPPUNIT_ASSERT_EQUAL(0U, journal.GetCheckpointCount());
+  }
+  {
+    // a journal without checkpoint is not continued
+    CCheckpointJournal journal;
+    CPPUNIT_ASSERT(!journal.Open(sJournalName, info));
+    CCheckpointJournal::TCheckpoint checkpoint = MakeCheckpoint(1048576);
+    journal.AddCheckpoint(checkpoint, checksums, 2);
+    checkpoint = MakeCheckpoint(2 * 1048576);
+    journal.AddCheckpoint(checkpoint, checksums + 2, 3);
+    checkpoint = MakeCheckpoint(3 * 1048576);
+    journal.AddCheckpoint(checkpoint, NULL, 0);
+    CPPUNIT_ASSERT_EQUAL(3U, journal.GetCheckpointCount());
+  }
+
+  CCheckpointJournal journal;
+  CPPUNIT_ASSERT(journal.Open(sJournalName, info));
+  CPPUNIT_ASSERT_EQUAL(3U, journal.GetCheckpointCount());
+  const CCheckpointJournal::TCheckpoint& last = journal.GetLastCheckpoint();
+  CCheckpointJournal::TCheckpoint expected = MakeCheckpoint(3 * 1048576);
+  CPPUNIT_ASSERT_EQUAL(expected.dataPos, last.dataPos);
+  CPPUNIT_ASSERT_EQUAL(expected.sourcePos, last.sourcePos);
+  CPPUNIT_ASSERT_EQUAL(expected.targetPos, last.targetPos);
+  CPPUNIT_ASSERT_EQUAL(expected.crc32, last.crc32);
+  CPPUNIT_ASSERT_EQUAL(expected.manifestChecksum, last.manifestChecksum);
+  // the checksums of all checkpoints in the order they were added
+  const vector<DWORD>& read = journal.GetChecksums();
+  CPPUNIT_ASSERT_EQUAL((size_t) 5, read.size());
+  for (unsigned i=0; i<5; i++)
+    CPPUNIT_ASSERT_EQUAL(checksums[i], read[i]);
+
+  // a completed operation removes its journal
+  journal.Remove();
+  CCheckpointJournal removed;
+  CPPUNIT_ASSERT(!removed.Open(sJournalName, info));
+}
+
+void CheckpointJournalTest::TornRecordTest()
+{
+  CCheckpointJournal::TJournalInfo info = MakeInfo();
+  DWORD checksums[4] = { 21, 22, 23, 24 };
+  {
+    CCheckpointJournal journal;
+    journal.Create(sJournalName, info);
+    CCheckpointJournal::TCheckpoint checkpoint = MakeCheckpoint(1048576);
+    journal.AddCheckpoint(checkpoint, checksums, 2);
+    checkpoint = MakeCheckpoint(2 * 1048576);
+    journal.AddCheckpoint(checkpoint, checksums + 2, 2);
+  }
+
+  // the interruption tore the last record apart
+  HANDLE h = CreateFile(sJournalName, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CPPUNIT_ASSERT(h != INVALID_HANDLE_VALUE);
+  SetFilePointer(h, -(LONG) sizeof(DWORD), NULL, FILE_END);
+  SetEndOfFile(h);
+  CloseHandle(h);
+
+  {
+    CCheckpointJournal journal;
+    CPPUNIT_ASSERT(journal.Open(sJournalName, info));
+    CPPUNIT_ASSERT_EQUAL(1U, journal.GetCheckpointCount());
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 1048576, journal.GetLastCheckpoint().dataPos);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, journal.GetChecksums().size());
+    // the next checkpoint replaces the torn record
+    CCheckpointJournal::TCheckpoint checkpoint = MakeCheckpoint(4 * 1048576);
+    journal.AddCheckpoint(checkpoint, checksums + 2, 2);
+  }
+
+  // a damaged record is dropped with all records behind it
+  h = CreateFile(sJournalName, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CPPUNIT_ASSERT(h != INVALID_HANDLE_VALUE);
+  DWORD written;
+  BYTE garbage = 0xA5;
+  SetFilePointer(h, -(LONG) sizeof(DWORD), NULL, FILE_END);
+  WriteFile(h, &garbage, 1, &written, NULL);
+  CloseHandle(h);
+
+  CCheckpointJournal journal;
+  CPPUNIT_ASSERT(journal.Open(sJournalName, info));
+  CPPUNIT_ASSERT_EQUAL(1U, journal.GetCheckpointCount());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 1048576, journal.GetLastCheckpoint().dataPos);
+}
+
+void CheckpointJournalTest::MismatchTest()
+{
+  CCheckpointJournal::TJournalInfo info = MakeInfo();
+  {
+    CCheckpointJournal journal;
+    journal.Create(sJournalName, info);
+    CCheckpointJournal::TCheckpoint checkpoint = MakeCheckpoint(1048576);
+    journal.AddCheckpoint(checkpoint, NULL, 0);
+  }
+
+  // the journal of a backup with another compression is not continued
+  CCheckpointJournal::TJournalInfo other = info;
+  other.compressionFormat = compressionZSTD;
+  CCheckpointJournal journal;
+  try {
+    journal.Open(sJournalName, other);
+    CPPUNIT_FAIL("journal of another operation should raise an EInternalException");
+  } catch (EInternalException& e) {
+    CPPUNIT_ASSERT(e.GetErrorCode() == EInternalException::journalMismatch);
+  }
+  journal.Close();
+
+  // nor the one of another volume
+  other = info;
+  other.volumeNameChecksum = CCheckpointJournal::GetNameChecksum(L"\\Device\\HarddiskVolume4");
+  CPPUNIT_ASSERT(other.volumeNameChecksum != info.volumeNameChecksum);
+  try {
+    journal.Open(sJournalName, other);
+    CPPUNIT_FAIL("journal of another volume should raise an EInternalException");
+  } catch (EInternalException& e) {
+    CPPUNIT_ASSERT(e.GetErrorCode() == EInternalException::journalMismatch);
+  }
+  journal.Close();
+
+  // the checkpoint is still there for the right operation
+  CPPUNIT_ASSERT(journal.Open(sJournalName, info));
+  CPPUNIT_ASSERT_EQUAL(1U, journal.GetCheckpointCount());
+}
+
+void CheckpointJournalTest::JournalNameTest()
+{
+  CPPUNIT_ASSERT(CCheckpointJournal::GetBackupJournalName(L"c:\\images\\disk.img") == L"c:\\images\\disk.img.journal");
+  CPPUNIT_ASSERT(CCheckpointJournal::GetRestoreJournalName(L"c:\\images\\disk.img",
+                   L"\\\\?\\GLOBALROOT\\Device\\HarddiskVolume3") == L"c:\\images\\disk.img.HarddiskVolume3.journal");
+  CPPUNIT_ASSERT(CCheckpointJournal::GetRestoreJournalName(L"disk.img", L"F:") == L"disk.img.F.journal");
+  CPPUNIT_ASSERT(CCheckpointJournal::GetRestoreJournalName(L"disk.img", L"/dev/sdb1") == L"disk.img.sdb1.journal");
+}
@@ -0,0 +1,260 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "ChunkStoreTest.h"
+#include "..\..\src\ODIN\ChunkStore.h"
+#include "..\..\src\ODIN\ChunkingThread.h"
+#include "..\..\src\ODIN\DechunkingThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+#include "..\..\src\ODIN\FileFormatException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( ChunkStoreTest );
+
+static const wchar_t sStoreDir[] = L"TestChunkStore";
+
+void ChunkStoreTest::setUp()
+{
+  DeleteStore();
+}
+
+void ChunkStoreTest::tearDown()
+{
+  DeleteStore();
+}
+
+void ChunkStoreTest::DeleteStore()
+{
+  wstring dir(sStoreDir);
+  DeleteFile((dir + L"\\index.dat").c_str());
+  DeleteFile((dir + L"\\pack-00000.dat").c_str());
+  RemoveDirectory(sStoreDir);
+}
+
+// pseudo random data, different seeds give different data
+void ChunkStoreTest::FillBuffer(BYTE* buffer, unsigned length, unsigned seed)
+{
+  unsigned __int64 x = seed * 0x9E3779B97F4A7C15ULL + 1;
+  for (unsigned i=0; i<length; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    buffer[i] = (BYTE) x;
+  }
+}
+
+void ChunkStoreTest::Sha256Test()
+{
+  BYTE digest[CSha256::sDigestLength];
+  const BYTE expected[CSha256::sDigestLength] = {
+    0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+    0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad };
+  CSha256::Calculate((const BYTE*)"abc", 3, digest);
+  CPPUNIT_ASSERT(memcmp(digest, expected, sizeof(digest)) == 0);
+
+  // incremental calculation with unaligned pieces must give the same result
+  vector<BYTE> data(1000);
+  BYTE digest2[CSha256::sDigestLength];
+  FillBuffer(&data[0], 1000, 1);
+  CSha256::Calculate(&data[0], 1000, digest);
+  CSha256 sha;
+  sha.AddDataBlock(&data[0], 3);
+  sha.AddDataBlock(&data[3], 61);
+  sha.AddDataBlock(&data[64], 936);
+  sha.GetResult(digest2);
+  CPPUNIT_ASSERT(memcmp(digest, digest2, sizeof(digest)) == 0);
+}
+
+void ChunkStoreTest::ChunkerTest()
+{
+  const unsigned dataSize = 4 * 1024 * 1024;
+  const unsigned insertPos = 1000000;
+  vector<BYTE> data(dataSize);
+  FillBuffer(&data[0], dataSize, 2);
+  CContentDefinedChunker chunker;
+
+  // all chunks are within the size limits
+  vector<unsigned> boundaries;
+  for (unsigned pos = 0; pos < dataSize; ) {
+    unsigned length = chunker.FindChunkBoundary(&data[pos], dataSize - pos);
+    CPPUNIT_ASSERT(length <= CContentDefinedChunker::sMaxChunkSize);
+    CPPUNIT_ASSERT(length >= CContentDefinedChunker::sMinChunkSize || pos + length == dataSize);
+    pos += length;
+    boundaries.push_back(pos);
+  }
+
+  // inserting some bytes only changes the chunks around the insert position,
+  // later boundaries are shifted by the number of bytes inserted
+  vector<BYTE> modified(data);
+  modified.insert(modified.begin() + insertPos, 100, 0x55);
+  unsigned matches = 0, after = 0;
+  size_t j = 0;
+  for (unsigned pos = 0; pos < modified.size(); ) {
+    pos += chunker.FindChunkBoundary(&modified[pos], (unsigned) modified.size() - pos);
+    if (pos > insertPos + 100 + CContentDefinedChunker::sMaxChunkSize) {
+      ++after;
+      while (j < boundaries.size() && boundaries[j] + 100 < pos)
+        ++j;
+      if (j < boundaries.size() && boundaries[j] + 100 == pos)
+        ++matches;
+    }
+  }
+  CPPUNIT_ASSERT(after > 0);
+  CPPUNIT_ASSERT_EQUAL(after, matches);
+}
+
+void ChunkStoreTest::StoreTest()
+{
+  const unsigned chunkSize = 10000;
+  vector<BYTE> chunk1(chunkSize), chunk2(chunkSize), readData;
+  TChunkHash hash1, hash2;
+  FillBuffer(&chunk1[0], chunkSize, 3);
+  FillBuffer(&chunk2[0], chunkSize, 4);
+  CSha256::Calculate(&chunk1[0], chunkSize, hash1.digest);
+  CSha256::Calculate(&chunk2[0], chunkSize, hash2.digest);
+
+  {
+    CChunkStore store;
+    store.Open(sStoreDir, true);
+    CPPUNIT_ASSERT(store.AddChunk(hash1, &chunk1[0], chunkSize));
+    CPPUNIT_ASSERT(!store.AddChunk(hash1, &chunk1[0], chunkSize));
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 1, store.GetNewChunkCount());
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) chunkSize, store.GetDuplicateBytes());
+    store.Close();
+  }
+
+  // reopen, existing chunks are found and new ones appended
+  {
+    CChunkStore store;
+    store.Open(sStoreDir, true);
+    CPPUNIT_ASSERT(store.HasChunk(hash1));
+    CPPUNIT_ASSERT(!store.HasChunk(hash2));
+    CPPUNIT_ASSERT(!store.AddChunk(hash1, &chunk1[0], chunkSize));
+    CPPUNIT_ASSERT(store.AddChunk(hash2, &chunk2[0], chunkSize));
+    store.Close();
+  }
+
+  {
+    CChunkStore store;
+    store.Open(sStoreDir, false);
+    CPPUNIT_ASSERT_EQUAL((size_t) 2, store.GetChunkCount());
+    CChunkStoreReader reader(store);
+    reader.ReadChunk(hash2, readData);
+    CPPUNIT_ASSERT(readData == chunk2);
+    reader.ReadChunk(hash1, readData);
+    CPPUNIT_ASSERT(readData == chunk1);
+
+    TChunkHash unknown = hash1;
+    unknown.digest[0] ^= 1;
+    CPPUNIT_ASSERT_THROW(reader.ReadChunk(unknown, readData), EFileFormatException);
+    store.Close();
+  }
+
+  // damage the first chunk in the pack file
+  wstring packFileName = wstring(sStoreDir) + L"\\pack-00000.dat";
+  HANDLE h = CreateFile(packFileName.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CPPUNIT_ASSERT(h != INVALID_HANDLE_VALUE);
+  BYTE garbage[2] = { 0xDE, 0xAD };
+  DWORD written;
+  WriteFile(h, garbage, sizeof(garbage), &written, NULL);
+  CloseHandle(h);
+
+  {
+    CChunkStore store;
+    store.Open(sStoreDir, false);
+    CChunkStoreReader reader(store);
+    CPPUNIT_ASSERT_THROW(reader.ReadChunk(hash1, readData), EFileFormatException);
+    reader.ReadChunk(hash2, readData);
+    CPPUNIT_ASSERT(readData == chunk2);
+    store.Close();
+  }
+}
+
+void ChunkStoreTest::ChunkingThreadTest()
+{
+  const unsigned bufferSize = 65536;
+  const unsigned bufferCount = 40;
+  const unsigned dataSize = 2 * 1024 * 1024 + 1234;
+  vector<BYTE> data(dataSize), result, recipe;
+  FillBuffer(&data[0], dataSize, 5);
+  CBufferChunk* chunk;
+
+  // backup: raw data -> chunking thread -> recipe
+  {
+    CImageBuffer emptyIn(bufferSize, bufferCount), filledIn;
+    CImageBuffer emptyOut(bufferSize, bufferCount), filledOut;
+    CChunkStore store;
+    store.Open(sStoreDir, true);
+    for (unsigned pos = 0; pos < dataSize; pos += bufferSize) {
+      chunk = emptyIn.GetChunk();
+      unsigned count = min(bufferSize, dataSize - pos);
+      memcpy(chunk->GetData(), &data[pos], count);
+      chunk->SetSize(count);
+      chunk->SetEOF(pos + count == dataSize);
+      filledIn.ReleaseChunk(chunk);
+    }
+    CChunkingThread thread(&store, &filledIn, &emptyIn, &emptyOut, &filledOut);
+    thread.Resume();
+    do {
+      chunk = filledOut.GetChunk();
+      BYTE* p = (BYTE*)chunk->GetData();
+      recipe.insert(recipe.end(), p, p + chunk->GetSize());
+      emptyOut.ReleaseChunk(chunk);
+    } while (!chunk->IsEOF());
+    thread.WaitForThread();
+    CPPUNIT_ASSERT(!thread.GetErrorFlag());
+    CPPUNIT_ASSERT_EQUAL((size_t) 0, recipe.size() % sizeof(TRecipeEntry));
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) dataSize, store.GetNewBytes());
+    store.Close();
+  }
+
+  // restore: recipe -> dechunking thread -> raw data
+  {
+    CImageBuffer emptyIn(bufferSize, bufferCount), filledIn;
+    CImageBuffer emptyOut(bufferSize, bufferCount), filledOut;
+    CChunkStore store;
+    store.Open(sStoreDir, false);
+    chunk = emptyIn.GetChunk();
+    memcpy(chunk->GetData(), &recipe[0], recipe.size());
+    chunk->SetSize((unsigned) recipe.size());
+    chunk->SetEOF(true);
+    filledIn.ReleaseChunk(chunk);
+    CDechunkingThread thread(&store, 3, &filledIn, &emptyIn, &emptyOut, &filledOut);
+    thread.Resume();
+    do {
+      chunk = filledOut.GetChunk();
+      BYTE* p = (BYTE*)chunk->GetData();
+      result.insert(result.end(), p, p + chunk->GetSize());
+      emptyOut.ReleaseChunk(chunk);
+    } while (!chunk->IsEOF());
+    thread.WaitForThread();
+    CPPUNIT_ASSERT(!thread.GetErrorFlag());
+    CPPUNIT_ASSERT(result == data);
+    store.Close();
+  }
+}
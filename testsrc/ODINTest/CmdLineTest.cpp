@@ -90,15 +90,56 @@ void CCmdLineTest::TestParseOptions()
     fCommandLine = L"ODIN.exe -restore -source=myfile.img -target=0";
     cp.Parse(fCommandLine.c_str());
     CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdRestore);
+    CPPUNIT_ASSERT(cp.fOperation.readBackVerify == false);
+
+    fCommandLine = L"ODIN.exe -restore -readback -source=myfile.img -target=0";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.readBackVerify == true);
 
     fCommandLine = L"ODIN.exe -verify -source=myfile.img";
     cp.Parse(fCommandLine.c_str());
     CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdVerify);
 
+    fCommandLine = L"ODIN.exe -compare -source=myfile.img -target=0";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdCompare);
+    CPPUNIT_ASSERT(cp.fOperation.target.compare(L"0") == 0);
+
+    fCommandLine = L"ODIN.exe -transcode -compression=zstd -split=100 -source=old.img -target=new.img";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdTranscode);
+    CPPUNIT_ASSERT(cp.fOperation.compression == compressionZSTD);
+    CPPUNIT_ASSERT(cp.fOperation.splitSizeMB == 100);
+    CPPUNIT_ASSERT(cp.fOperation.target.compare(L"new.img") == 0);
+
     fCommandLine = L"ODIN.exe -list";
     cp.Parse(fCommandLine.c_str());
     CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdList);
 
+    fCommandLine = L"ODIN.exe -serve -pipe=MyEngine";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.cmd == CCommandLineProcessor::CmdServe);
+    CPPUNIT_ASSERT(cp.fOperation.pipeName.compare(L"MyEngine") == 0);
+
+    fCommandLine = L"ODIN.exe -restore -source=myfile.img -target=0 -events=1234";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.eventsTarget.compare(L"1234") == 0);
+
+    cp.Reset();
+    fCommandLine = L"ODIN.exe -backup -source=0 -target=myfile.img -readlimit=50 -readiops=200 -lowpriority";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.readLimit == 50);
+    CPPUNIT_ASSERT(cp.fOperation.readIops == 200);
+    CPPUNIT_ASSERT(cp.fOperation.writeLimit == 0);
+    CPPUNIT_ASSERT(cp.fOperation.writeIops == 0);
+    CPPUNIT_ASSERT(cp.fOperation.lowIoPriority == true);
+    CPPUNIT_ASSERT(cp.fOperation.resume == false);
+
+    cp.Reset();
+    fCommandLine = L"ODIN.exe -restore -source=myfile.img -target=0 -resume";
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_ASSERT(cp.fOperation.resume == true);
+
   } catch (ECmdLineException &) {
     CPPUNIT_FAIL("backup options should not raise a CmdLineException");
   }
@@ -183,6 +224,15 @@ void CCmdLineTest::TestParameterValidation()
     CPPUNIT_ASSERT(e.GetErrorCode() == ECmdLineException::wrongCompression);
   }
 
+  cp.Reset();
+  fCommandLine = L"ODIN.exe -backup -source=0 -target=myfile.img -readlimit=fast";
+  try {
+    cp.Parse(fCommandLine.c_str());
+    CPPUNIT_FAIL("wrong I/O limit should raise a CmdLineException");
+  } catch (ECmdLineException &e) {
+    CPPUNIT_ASSERT(e.GetErrorCode() == ECmdLineException::wrongIoLimit);
+  }
+
   cp.Reset();
   fCommandLine = L"ODIN.exe -source=0 -target=myfile.img -compression=bzip -makeSnapshot -split=640";
   try {
@@ -365,4 +415,15 @@ void CCmdLineTest::TestSourceTargetValidation()
     CPPUNIT_ASSERT(e.GetErrorCode() == ECmdLineException::verifyParamError);
   }
 
+  // test compare of an image with itself
+  cp.Reset();
+  fCommandLine = L"ODIN.exe -compare -source=myfile.img -target=MyFile.img";
+  try {
+    cp.Parse(fCommandLine.c_str());
+    cp.CheckValidParameters();
+    CPPUNIT_FAIL("compare of an image with itself should raise a CmdLineException");
+  } catch (ECmdLineException &e) {
+    CPPUNIT_ASSERT(e.GetErrorCode() == ECmdLineException::compareParamError);
+  }
+
 }
@@ -0,0 +1,216 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include "CompareTest.h"
+#include "RunLengthStreamSimulator.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\BlockCompare.h"
+#include "..\..\src\ODIN\CompareThread.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( CompareTest );
+
+static const unsigned sClusterSize = 4096;
+
+// a volume of 64 clusters with alternating runs of used and free clusters:
+// used 0-9, 13-19, 25-44, 49-63
+static const int sRunLengths[] = { 10, 3, 7, 5, 20, 4, 15, 0 };
+static const int sRunLengthCount = sizeof(sRunLengths) / sizeof(sRunLengths[0]);
+static const unsigned sVolumeSize = 64 * sClusterSize;
+
+void CompareTest::setUp()
+{
+}
+
+void CompareTest::tearDown()
+{
+}
+
+// device holds a volume, image its used clusters. The free clusters of the device
+// are overwritten afterwards, they must not be compared
+void CompareTest::MakeVolume(vector<BYTE>& image, vector<BYTE>& device)
+{
+  device.resize(sVolumeSize);
+  FillBuffer(&device[0], sVolumeSize, 5);
+  image.clear();
+  unsigned pos = 0;
+  for (int i=0; i<sRunLengthCount; i+=2) {
+    unsigned used = sRunLengths[i] * sClusterSize;
+    unsigned free = sRunLengths[i+1] * sClusterSize;
+    image.insert(image.end(), device.begin() + pos, device.begin() + pos + used);
+    if (free > 0)
+      FillBuffer(&device[pos + used], free, 6 + i);
+    pos += used + free;
+  }
+}
+
+// the run length simulator takes ownership of its values
+static int* NewRunLengths()
+{
+  int* runLengths = new int[sRunLengthCount];
+  for (int i=0; i<sRunLengthCount; i++)
+    runLengths[i] = sRunLengths[i];
+  return runLengths;
+}
+
+// compare image with device as odinc -compare does: one read thread for the image, one
+// reading the used clusters of the device and the compare thread taking the data of both.
+// Without allocation map image and device hold the complete volume
+void CompareTest::Compare(vector<BYTE>& image, vector<BYTE>& device, bool useAllocationMap, unsigned maxRanges,
+                          vector<TImageRange>& differences, unsigned __int64& differingBytes)
+{
+  // the image chunks do not end at cluster boundaries
+  CImageBuffer emptyImageQueue(3 * sClusterSize + 100, 4), filledImageQueue;
+  CImageBuffer emptyDeviceQueue(5 * sClusterSize, 4), filledDeviceQueue;
+  CMemoryImageStream imageStream(image, false);
+  CMemoryImageStream deviceStream(device, false);
+  CRunLengthStreamReaderSimulator deviceRunLengths(NewRunLengths(), sRunLengthCount);
+  CRunLengthStreamReaderSimulator compareRunLengths(NewRunLengths(), sRunLengthCount);
+  CReadThread imageReadThread(&imageStream, &emptyImageQueue, &filledImageQueue, false);
+  CReadThread deviceReadThread(&deviceStream, &emptyDeviceQueue, &filledDeviceQueue, false);
+  CCompareThread compareThread(&filledImageQueue, &emptyImageQueue, &filledDeviceQueue, &emptyDeviceQueue);
+
+  deviceReadThread.SetVolumeStore(true);
+  if (useAllocationMap) {
+    // each thread reads the allocation map on its own
+    deviceReadThread.SetAllocationMapReaderInfo(&deviceRunLengths, sClusterSize);
+    compareThread.SetAllocationMapReaderInfo(&compareRunLengths, sClusterSize);
+  } else {
+    deviceReadThread.SetVolumeDataSize(image.size());
+  }
+  compareThread.SetMaxRanges(maxRanges);
+  imageReadThread.Resume();
+  deviceReadThread.Resume();
+  compareThread.Resume();
+  imageReadThread.WaitForThread();
+  deviceReadThread.WaitForThread();
+  compareThread.WaitForThread();
+  CPPUNIT_ASSERT(!imageReadThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!deviceReadThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!compareThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image.size(), compareThread.GetBytesProcessed());
+  differences = compareThread.GetDifferences();
+  differingBytes = compareThread.GetDifferingBytes();
+}
+
+void CompareTest::BlockCompareTest()
+{
+  const unsigned size = 300;
+  BYTE data1[size], data2[size];
+
+  FillBuffer(data1, size, 1);
+  memcpy(data2, data1, size);
+  CPPUNIT_ASSERT(CBlockCompare::IsSame(data1, data2, size));
+  CPPUNIT_ASSERT_EQUAL(size, CBlockCompare::FindDifference(data1, data2, size));
+  CPPUNIT_ASSERT(CBlockCompare::IsSame(data1, data2, 0));
+  // a difference at every position, in the 64 byte steps and in the rest
+  for (unsigned pos=0; pos<size; pos++) {
+    data2[pos] ^= 0x01;
+    CPPUNIT_ASSERT(!CBlockCompare::IsSame(data1, data2, size));
+    CPPUNIT_ASSERT_EQUAL(pos, CBlockCompare::FindDifference(data1, data2, size));
+    CPPUNIT_ASSERT(CBlockCompare::IsSame(data1, data2, pos));
+    data2[pos] ^= 0x01;
+  }
+}
+
+void CompareTest::IdenticalTest()
+{
+  vector<BYTE> image, device;
+  vector<TImageRange> differences;
+  unsigned __int64 differingBytes;
+
+  MakeVolume(image, device);
+  Compare(image, device, true, 100, differences, differingBytes);
+  CPPUNIT_ASSERT(differences.empty());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 0, differingBytes);
+}
+
+void CompareTest::DifferenceTest()
+{
+  vector<BYTE> image, device;
+  vector<TImageRange> differences;
+  unsigned __int64 differingBytes;
+
+  // used clusters 14 and 15 are adjacent, 19 and 25 only in the image, 11 is free
+  MakeVolume(image, device);
+  device[14 * sClusterSize + 7] ^= 0x01;
+  device[16 * sClusterSize - 1] ^= 0x01;
+  device[20 * sClusterSize - 1] ^= 0x01;
+  device[25 * sClusterSize] ^= 0x01;
+  device[11 * sClusterSize + 100] ^= 0x01;
+  Compare(image, device, true, 100, differences, differingBytes);
+  CPPUNIT_ASSERT_EQUAL((size_t) 3, differences.size());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 14 * sClusterSize, differences[0].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 2 * sClusterSize, differences[0].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 19 * sClusterSize, differences[1].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) sClusterSize, differences[1].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 25 * sClusterSize, differences[2].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) sClusterSize, differences[2].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 4 * sClusterSize, differingBytes);
+}
+
+void CompareTest::MaxRangesTest()
+{
+  vector<BYTE> image, device;
+  vector<TImageRange> differences;
+  unsigned __int64 differingBytes;
+
+  // the third range is merged into the second one, the differing bytes stay exact
+  MakeVolume(image, device);
+  device[14 * sClusterSize] ^= 0x01;
+  device[19 * sClusterSize] ^= 0x01;
+  device[63 * sClusterSize + 5] ^= 0x01;
+  Compare(image, device, true, 2, differences, differingBytes);
+  CPPUNIT_ASSERT_EQUAL((size_t) 2, differences.size());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 14 * sClusterSize, differences[0].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 19 * sClusterSize, differences[1].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 45 * sClusterSize, differences[1].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 3 * sClusterSize, differingBytes);
+}
+
+void CompareTest::NoAllocationMapTest()
+{
+  // image of all blocks, the last unit is not complete and the device is too short
+  const unsigned volumeSize = 10 * CCompareThread::sDefaultCompareUnit + 1000;
+  vector<BYTE> image(volumeSize), device;
+  vector<TImageRange> differences;
+  unsigned __int64 differingBytes;
+
+  FillBuffer(&image[0], volumeSize, 7);
+  device = image;
+  device[5000] ^= 0x01;
+  device.resize(volumeSize - 500);
+  Compare(image, device, false, 100, differences, differingBytes);
+  CPPUNIT_ASSERT_EQUAL((size_t) 2, differences.size());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) CCompareThread::sDefaultCompareUnit, differences[0].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) CCompareThread::sDefaultCompareUnit, differences[0].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 10 * CCompareThread::sDefaultCompareUnit, differences[1].offset);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 1000, differences[1].length);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) CCompareThread::sDefaultCompareUnit + 1000, differingBytes);
+}
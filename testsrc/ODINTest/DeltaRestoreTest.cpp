@@ -0,0 +1,150 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include "DeltaRestoreTest.h"
+#include "RunLengthStreamSimulator.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\DeltaWriter.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\WriteThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+#include "..\..\src\ODIN\IImageStream.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( DeltaRestoreTest );
+
+static const unsigned sCompareSize = 4096;
+
+void DeltaRestoreTest::setUp()
+{
+}
+
+void DeltaRestoreTest::tearDown()
+{
+}
+
+void DeltaRestoreTest::DeltaWriterTest()
+{
+  const unsigned size = 64 * sCompareSize;
+  vector<BYTE> data(size), target(size);
+  unsigned bytesWritten;
+
+  FillBuffer(&data[0], size, 1);
+  target = data;
+  // change units 3, 4 (adjacent) and 40 and one byte in unit 63
+  FillBuffer(&target[3 * sCompareSize], 2 * sCompareSize, 2);
+  FillBuffer(&target[40 * sCompareSize], sCompareSize, 3);
+  target[size - 1] ^= 0xFF;
+
+  CMemoryImageStream stream(target, true);
+  {
+    CDeltaWriter writer(&stream, sCompareSize);
+    // sequential writes of different size, read ahead covers only the first ones
+    writer.Write(&data[0], 16 * sCompareSize, &bytesWritten);
+    CPPUNIT_ASSERT_EQUAL(16 * sCompareSize, bytesWritten);
+    writer.Write(&data[16 * sCompareSize], 16 * sCompareSize, &bytesWritten);
+    writer.Write(&data[32 * sCompareSize], 8 * sCompareSize, &bytesWritten);
+    // write after seek, read ahead is not used
+    writer.Seek(48 * sCompareSize);
+    writer.Write(&data[48 * sCompareSize], 16 * sCompareSize, &bytesWritten);
+    writer.Seek(40 * sCompareSize);
+    writer.Write(&data[40 * sCompareSize], 8 * sCompareSize, &bytesWritten);
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 48 * sCompareSize, writer.GetPosition());
+
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 4 * sCompareSize, writer.GetWrittenBytes());
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 60 * sCompareSize, writer.GetSkippedBytes());
+  }
+  CPPUNIT_ASSERT(data == target);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 4 * sCompareSize, stream.GetBytesWritten());
+}
+
+void DeltaRestoreTest::ShortTargetTest()
+{
+  // target shorter than data: the missing part is written
+  const unsigned size = 8 * sCompareSize;
+  vector<BYTE> data(size), target;
+  unsigned bytesWritten;
+
+  FillBuffer(&data[0], size, 4);
+  target.assign(data.begin(), data.begin() + 5 * sCompareSize + 100);
+  CMemoryImageStream stream(target, false);
+  {
+    CDeltaWriter writer(&stream, sCompareSize);
+    writer.Write(&data[0], size, &bytesWritten);
+    CPPUNIT_ASSERT_EQUAL(size, bytesWritten);
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 5 * sCompareSize, writer.GetSkippedBytes());
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 3 * sCompareSize, writer.GetWrittenBytes());
+  }
+  CPPUNIT_ASSERT(data == target);
+}
+
+void DeltaRestoreTest::RunLengthRestoreTest()
+{
+  // a volume of 64 clusters with alternating runs of used and free clusters
+  // (the run length simulator needs an even number of values)
+  int runLengths[] = { 10, 3, 7, 5, 20, 4, 15, 0 };
+  const int runLengthCount = sizeof(runLengths) / sizeof(runLengths[0]);
+  const unsigned volumeSize = 64 * sCompareSize;
+  vector<BYTE> volume(volumeSize), image, target;
+
+  // image holds the used clusters of volume
+  FillBuffer(&volume[0], volumeSize, 5);
+  unsigned __int64 pos = 0;
+  for (int i=0; i<runLengthCount; i+=2) {
+    image.insert(image.end(), volume.begin() + (size_t) pos, volume.begin() + (size_t) (pos + runLengths[i] * sCompareSize));
+    pos += (runLengths[i] + runLengths[i+1]) * sCompareSize;
+  }
+
+  // target holds an older version: two used clusters (1 and 30) and a free one (12) differ
+  target = volume;
+  FillBuffer(&target[1 * sCompareSize], sCompareSize, 6);
+  FillBuffer(&target[12 * sCompareSize], sCompareSize, 7);
+  FillBuffer(&target[30 * sCompareSize], sCompareSize, 8);
+  vector<BYTE> expected = volume;
+  memcpy(&expected[12 * sCompareSize], &target[12 * sCompareSize], sCompareSize);
+
+  CImageBuffer emptyQueue(3 * sCompareSize, 4), filledQueue;
+  CMemoryImageStream source(image, false);
+  CMemoryImageStream targetStream(target, true);
+  CRunLengthStreamReaderSimulator runLengthReader(runLengths, runLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CWriteThread writeThread(&targetStream, &filledQueue, &emptyQueue, false);
+
+  writeThread.SetAllocationMapReaderInfo(&runLengthReader, sCompareSize);
+  writeThread.SetDeltaRestore(sCompareSize);
+  readThread.Resume();
+  writeThread.Resume();
+  readThread.WaitForThread();
+  writeThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!writeThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL(readThread.GetCrc32(), writeThread.GetCrc32());
+  CPPUNIT_ASSERT_EQUAL((__int64) image.size(), writeThread.GetBytesProcessed());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image.size() - 2 * sCompareSize, writeThread.GetDeltaSkippedBytes());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 2 * sCompareSize, targetStream.GetBytesWritten());
+  CPPUNIT_ASSERT(expected == target);
+}
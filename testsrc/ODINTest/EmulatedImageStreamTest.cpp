@@ -0,0 +1,187 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <vector>
+#include <math.h>
+#include "EmulatedImageStreamTest.h"
+#include "..\..\src\ODIN\EmulatedImageStream.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\OSException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( EmulatedImageStreamTest );
+
+static double Seconds()
+{
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double) counter.QuadPart / frequency.QuadPart;
+}
+
+// write length bytes in blocks of blockSize, returns the seconds it took
+static double WriteBlocks(IImageStream& stream, unsigned length, unsigned blockSize)
+{
+  vector<BYTE> block(blockSize, 0x5A);
+  unsigned written;
+  double start = Seconds();
+  for (unsigned pos = 0; pos < length; pos += blockSize)
+    stream.Write(&block[0], blockSize, &written);
+  return Seconds() - start;
+}
+
+void EmulatedImageStreamTest::setUp()
+{
+}
+
+void EmulatedImageStreamTest::tearDown()
+{
+}
+
+void EmulatedImageStreamTest::BandwidthTest()
+{
+  vector<BYTE> media;
+  CMemoryImageStream memory(media, true);
+  TDeviceModel model = CEmulatedImageStream::GetUnlimitedModel();
+  model.writeBandwidth = 40.0 * 1024 * 1024;
+  CEmulatedImageStream device(&memory, model);
+
+  // 4 MB at 40 MB/s take 100 ms, sleeping too long must not add up
+  double seconds = WriteBlocks(device, 4 * 1024 * 1024, 65536);
+  CPPUNIT_ASSERT_EQUAL((size_t) 4 * 1024 * 1024, media.size());
+  CPPUNIT_ASSERT_EQUAL(64U, device.GetIoCount());
+  CPPUNIT_ASSERT(fabs(device.GetBusyTime() - 0.1) < 0.001);
+  CPPUNIT_ASSERT(seconds >= 0.098);
+  CPPUNIT_ASSERT(seconds < 0.5);
+}
+
+void EmulatedImageStreamTest::StallTest()
+{
+  vector<BYTE> media;
+  CMemoryImageStream memory(media, true);
+  TDeviceModel model = CEmulatedImageStream::GetUnlimitedModel();
+  model.stallInterval = 1024 * 1024;
+  model.stallTime = 0.02;
+  CEmulatedImageStream device(&memory, model);
+
+  // a stall for each erase block boundary that is crossed or reached, reads do not stall
+  double seconds = WriteBlocks(device, 4 * 1024 * 1024, 256 * 1024);
+  CPPUNIT_ASSERT_EQUAL(4U, device.GetStallCount());
+  CPPUNIT_ASSERT(seconds >= 0.078);
+
+  vector<BYTE> buffer(1024 * 1024);
+  unsigned bytesRead;
+  device.Seek(0, FILE_BEGIN);
+  device.Read(&buffer[0], (unsigned) buffer.size(), &bytesRead);
+  CPPUNIT_ASSERT_EQUAL((unsigned) buffer.size(), bytesRead);
+  CPPUNIT_ASSERT_EQUAL(4U, device.GetStallCount());
+}
+
+void EmulatedImageStreamTest::AlignmentTest()
+{
+  vector<BYTE> media;
+  CMemoryImageStream memory(media, true);
+  TDeviceModel model = CEmulatedImageStream::GetUnlimitedModel();
+  model.alignment = 4096;
+  model.alignmentPenalty = 0.001;
+  CEmulatedImageStream device(&memory, model);
+  vector<BYTE> block(8192);
+  unsigned written;
+
+  device.Write(&block[0], 1000, &written);   // length misaligned
+  device.Write(&block[0], 4096, &written);   // offset misaligned
+  device.Seek(8192, FILE_BEGIN);
+  device.Write(&block[0], 8192, &written);   // aligned
+  CPPUNIT_ASSERT_EQUAL(3U, device.GetIoCount());
+  CPPUNIT_ASSERT_EQUAL(2U, device.GetMisalignedCount());
+  CPPUNIT_ASSERT(fabs(device.GetBusyTime() - 0.002) < 0.0001);
+}
+
+void EmulatedImageStreamTest::LatencyTest()
+{
+  vector<BYTE> media(4096);
+  CMemoryImageStream memory(media, true);
+  TDeviceModel model = CEmulatedImageStream::GetUnlimitedModel();
+  model.readLatency.distribution = latencyExponential;
+  model.readLatency.mean = 0.0001;
+  model.seed = 7;
+  CEmulatedImageStream device(&memory, model);
+  BYTE buffer[512];
+  unsigned bytesRead;
+
+  // the mean of many exponential latencies is close to the configured mean
+  for (int i=0; i<1000; i++) {
+    device.Seek(0, FILE_BEGIN);
+    device.Read(buffer, sizeof(buffer), &bytesRead);
+  }
+  double mean = device.GetBusyTime() / device.GetIoCount();
+  CPPUNIT_ASSERT(mean > 0.00009 && mean < 0.00011);
+
+  // the same seed gives the same latencies
+  CEmulatedImageStream device2(&memory, model);
+  for (int i=0; i<1000; i++) {
+    device2.Seek(0, FILE_BEGIN);
+    device2.Read(buffer, sizeof(buffer), &bytesRead);
+  }
+  CPPUNIT_ASSERT_EQUAL(device.GetBusyTime(), device2.GetBusyTime());
+}
+
+void EmulatedImageStreamTest::ErrorTest()
+{
+  vector<BYTE> media(65536, 1);
+  CMemoryImageStream memory(media, true);
+  TDeviceModel model = CEmulatedImageStream::GetUnlimitedModel();
+  model.errorOffset = 10000;
+  CEmulatedImageStream device(&memory, model);
+  BYTE buffer[8192];
+  unsigned count;
+  bool failed = false;
+
+  device.Read(buffer, sizeof(buffer), &count);
+  CPPUNIT_ASSERT_EQUAL((unsigned) sizeof(buffer), count);
+  try {
+    device.Read(buffer, sizeof(buffer), &count);
+  } catch (EWinException& e) {
+    failed = e.GetErrorCode() == ERROR_CRC;
+  }
+  CPPUNIT_ASSERT(failed);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 8192, device.GetPosition());
+
+  // every write fails and nothing reaches the media
+  model = CEmulatedImageStream::GetUnlimitedModel();
+  model.errorRate = 1.0;
+  CEmulatedImageStream failing(&memory, model);
+  failed = false;
+  memset(buffer, 2, sizeof(buffer));
+  try {
+    failing.Write(buffer, sizeof(buffer), &count);
+  } catch (EWinException& e) {
+    failed = e.GetErrorCode() == ERROR_WRITE_FAULT;
+  }
+  CPPUNIT_ASSERT(failed);
+  CPPUNIT_ASSERT_EQUAL((BYTE) 1, media[8192]);
+}
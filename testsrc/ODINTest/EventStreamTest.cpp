@@ -0,0 +1,138 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+#include "stdafx.h"
+#include <vector>
+#include <map>
+#include "EventStreamTest.h"
+#include "..\..\src\ODIN\EventStream.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( EventStreamTest );
+
+void EventStreamTest::setUp()
+{
+}
+
+void EventStreamTest::tearDown()
+{
+}
+
+// all data written to the pipe so far, the write end must be closed
+string EventStreamTest::ReadPipe(HANDLE pipe)
+{
+  string text;
+  char buffer[256];
+  DWORD bytesRead;
+  while (ReadFile(pipe, buffer, sizeof(buffer), &bytesRead, NULL) && bytesRead > 0)
+    text.append(buffer, bytesRead);
+  return text;
+}
+
+void EventStreamTest::QuoteTest()
+{
+  CPPUNIT_ASSERT(CEventStream::Quote(L"abc") == L"abc");
+  CPPUNIT_ASSERT(CEventStream::Quote(L"") == L"\"\"");
+  CPPUNIT_ASSERT(CEventStream::Quote(NULL) == L"\"\"");
+  CPPUNIT_ASSERT(CEventStream::Quote(L"disk full") == L"\"disk full\"");
+  CPPUNIT_ASSERT(CEventStream::Quote(L"a=b") == L"\"a=b\"");
+  CPPUNIT_ASSERT(CEventStream::Quote(L"say \"no\"") == L"\"say \"\"no\"\"\"");
+  CPPUNIT_ASSERT(CEventStream::Quote(L"two\r\nlines") == L"\"two  lines\"");
+}
+
+void EventStreamTest::JobEventsTest()
+{
+  HANDLE readPipe, writePipe;
+  BOOL ok = CreatePipe(&readPipe, &writePipe, NULL, 0);
+  CPPUNIT_ASSERT(ok);
+  {
+    CEventStream stream(writePipe, true);
+    CJobEvents events(&stream, 7);
+    events.OnQueued();
+    events.OnStarted();
+    events.OnStage(L"restore");
+    events.OnProgress(0, 1000);
+    events.OnFinished(1, L"Error: \"F:\" is gone");
+    events.OnFinished(0, L"");
+    CPPUNIT_ASSERT(!stream.IsClosed());
+  }
+  string text = ReadPipe(readPipe);
+  CloseHandle(readPipe);
+  CPPUNIT_ASSERT(text ==
+    "queued job=7\n"
+    "started job=7\n"
+    "stage job=7 name=restore\n"
+    "progress job=7 bytes=0 total=1000 rate=0\n"
+    "finished job=7 exit=1 error=\"Error: \"\"F:\"\" is gone\"\n"
+    "finished job=7 exit=0\n");
+}
+
+void EventStreamTest::ClosedStreamTest()
+{
+  HANDLE readPipe, writePipe;
+  BOOL ok = CreatePipe(&readPipe, &writePipe, NULL, 0);
+  CPPUNIT_ASSERT(ok);
+  CloseHandle(readPipe);
+  CEventStream stream(writePipe, true);
+  CJobEvents events(&stream, 1);
+  events.OnStarted();
+  CPPUNIT_ASSERT(stream.IsClosed());
+  // further events are dropped without an error
+  events.OnFinished(0, NULL);
+  CPPUNIT_ASSERT(stream.IsClosed());
+
+  CEventStream noStream(INVALID_HANDLE_VALUE, false);
+  CPPUNIT_ASSERT(noStream.IsClosed());
+}
+
+void EventStreamTest::ParseTest()
+{
+  wstring event;
+  map<wstring, wstring> values;
+
+  bool ok = CEventStream::Parse(L"progress job=3 bytes=100 total=200 rate=50", event, values);
+  CPPUNIT_ASSERT(ok);
+  CPPUNIT_ASSERT(event == L"progress");
+  CPPUNIT_ASSERT(values.size() == 4);
+  CPPUNIT_ASSERT(values[L"job"] == L"3");
+  CPPUNIT_ASSERT(values[L"rate"] == L"50");
+
+  // a quoted value comes back as it was written
+  wstring message = L"Error: \"F:\" is gone";
+  ok = CEventStream::Parse(L"finished job=0 exit=1 error=" + CEventStream::Quote(message.c_str()), event, values);
+  CPPUNIT_ASSERT(ok);
+  CPPUNIT_ASSERT(event == L"finished");
+  CPPUNIT_ASSERT(values[L"exit"] == L"1");
+  CPPUNIT_ASSERT(values[L"error"] == message);
+
+  ok = CEventStream::Parse(L"status", event, values);
+  CPPUNIT_ASSERT(ok && event == L"status" && values.empty());
+
+  // not events
+  CPPUNIT_ASSERT(!CEventStream::Parse(L"", event, values));
+  CPPUNIT_ASSERT(!CEventStream::Parse(L"job=1", event, values));
+  CPPUNIT_ASSERT(!CEventStream::Parse(L"progress job", event, values));
+  CPPUNIT_ASSERT(!CEventStream::Parse(L"finished error=\"open", event, values));
+}
@@ -0,0 +1,162 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <memory>
+#include <vector>
+#include "FanOutTest.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\WriteThread.h"
+#include "..\..\src\ODIN\FanOutThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( FanOutTest );
+
+static const unsigned sChunkSize = 4096;
+static const unsigned sChunkCount = 64;
+
+void FanOutTest::setUp()
+{
+}
+
+void FanOutTest::tearDown()
+{
+}
+
+void FanOutTest::SharedChunkTest()
+{
+  // the source chunk goes back to its queue when the last sharing chunk is released
+  CImageBuffer sourceQueue(sChunkSize, 1), viewQueue(0, 2);
+  CBufferChunk* source = sourceQueue.GetChunk();
+  CBufferChunk* view1 = viewQueue.GetChunk();
+  CBufferChunk* view2 = viewQueue.GetChunk();
+  FillBuffer((BYTE*)source->GetData(), sChunkSize, 1);
+  source->SetSize(sChunkSize);
+  source->SetShareCount(2);
+  view1->ShareData(source, &sourceQueue);
+  view2->ShareData(source, &sourceQueue);
+  CPPUNIT_ASSERT(view1->GetData() == source->GetData());
+  CPPUNIT_ASSERT_EQUAL(sChunkSize, view2->GetSize());
+
+  view1->Reset();
+  viewQueue.ReleaseChunk(view1);
+  CPPUNIT_ASSERT_EQUAL(0U, sourceQueue.GetChunkCount());
+  view2->Reset();
+  viewQueue.ReleaseChunk(view2);
+  CPPUNIT_ASSERT_EQUAL(1U, sourceQueue.GetChunkCount());
+  CPPUNIT_ASSERT_EQUAL(2U, viewQueue.GetChunkCount());
+}
+
+void FanOutTest::FanOutRestoreTest()
+{
+  const unsigned size = sChunkCount * sChunkSize + 100;
+  const unsigned targetCount = 3;
+  vector<BYTE> image(size);
+  vector<BYTE> targets[targetCount];
+
+  FillBuffer(&image[0], size, 2);
+  CImageBuffer emptyQueue(sChunkSize, 6), filledQueue;
+  CMemoryImageStream source(image, false);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CFanOutThread fanOutThread(&filledQueue, &emptyQueue, 4, 0);
+  vector<unique_ptr<CMemoryImageStream>> targetStreams;
+  vector<unique_ptr<CWriteThread>> writeThreads;
+  for (unsigned i=0; i<targetCount; i++) {
+    unsigned index = fanOutThread.AddTarget();
+    targetStreams.push_back(make_unique<CMemoryImageStream>(targets[i], false));
+    writeThreads.push_back(make_unique<CWriteThread>(targetStreams[i].get(), fanOutThread.GetTargetQueue(index),
+      fanOutThread.GetTargetReturnQueue(index), false));
+    fanOutThread.SetTargetThread(index, writeThreads[i].get());
+  }
+
+  readThread.Resume();
+  fanOutThread.Resume();
+  for (unsigned i=0; i<targetCount; i++)
+    writeThreads[i]->Resume();
+  readThread.WaitForThread();
+  fanOutThread.WaitForThread();
+  for (unsigned i=0; i<targetCount; i++)
+    writeThreads[i]->WaitForThread();
+
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!fanOutThread.GetErrorFlag());
+  for (unsigned i=0; i<targetCount; i++) {
+    CPPUNIT_ASSERT(!writeThreads[i]->GetErrorFlag());
+    CPPUNIT_ASSERT(!fanOutThread.IsTargetDetached(i));
+    CPPUNIT_ASSERT_EQUAL(readThread.GetCrc32(), writeThreads[i]->GetCrc32());
+    CPPUNIT_ASSERT(image == targets[i]);
+  }
+  // all chunks are back in the queues
+  CPPUNIT_ASSERT_EQUAL(6U, emptyQueue.GetChunkCount());
+}
+
+void FanOutTest::SlowTargetTest()
+{
+  // second target blocks in its first write and is detached, the others complete
+  const unsigned size = sChunkCount * sChunkSize;
+  const unsigned targetCount = 3;
+  vector<BYTE> image(size);
+  vector<BYTE> targets[targetCount];
+  HANDLE writeGate = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+  FillBuffer(&image[0], size, 3);
+  CImageBuffer emptyQueue(sChunkSize, 6), filledQueue;
+  CMemoryImageStream source(image, false);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CFanOutThread fanOutThread(&filledQueue, &emptyQueue, 2, 300);
+  vector<unique_ptr<CMemoryImageStream>> targetStreams;
+  vector<unique_ptr<CWriteThread>> writeThreads;
+  for (unsigned i=0; i<targetCount; i++) {
+    unsigned index = fanOutThread.AddTarget();
+    targetStreams.push_back(make_unique<CMemoryImageStream>(targets[i], false, i == 1 ? writeGate : NULL));
+    writeThreads.push_back(make_unique<CWriteThread>(targetStreams[i].get(), fanOutThread.GetTargetQueue(index),
+      fanOutThread.GetTargetReturnQueue(index), false));
+    fanOutThread.SetTargetThread(index, writeThreads[i].get());
+  }
+
+  readThread.Resume();
+  fanOutThread.Resume();
+  for (unsigned i=0; i<targetCount; i++)
+    writeThreads[i]->Resume();
+  readThread.WaitForThread();
+  fanOutThread.WaitForThread();
+  writeThreads[0]->WaitForThread();
+  writeThreads[2]->WaitForThread();
+  SetEvent(writeGate);
+  writeThreads[1]->WaitForThread();
+  CloseHandle(writeGate);
+
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!fanOutThread.GetErrorFlag());
+  CPPUNIT_ASSERT(fanOutThread.IsTargetDetached(1));
+  CPPUNIT_ASSERT(!fanOutThread.GetTargetError(1).empty());
+  CPPUNIT_ASSERT(targets[1].size() < size);
+  CPPUNIT_ASSERT(!fanOutThread.IsTargetDetached(0));
+  CPPUNIT_ASSERT(!fanOutThread.IsTargetDetached(2));
+  CPPUNIT_ASSERT(image == targets[0]);
+  CPPUNIT_ASSERT(image == targets[2]);
+}
@@ -24,6 +24,7 @@
 #include "stdafx.h"
 #include "..\..\src\ODIN\CompressedRunLengthStream.h"
 #include "..\..\src\ODIN\Compression.h"
+#include "..\..\src\ODIN\ImageStream.h"
 #include "FileHeaderTest.h"
 
 // Registers the fixture into the 'registry'
@@ -127,7 +128,7 @@ void FileHeaderTest::ReadHeaderTest()
   CPPUNIT_ASSERT(fImageHeader.IsValidFileHeader());
   CPPUNIT_ASSERT(fImageHeader.IsSupportedVersion());
   CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMajorVersion(), 1U);
-  CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMinorVersion(), 0U);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMinorVersion(), (unsigned)CImageFileHeader::sVerMinor);
 
   // get checksum
   CImageFileHeader::VerifyFormat verifyFormat = fImageHeader.GetVerifyFormat();
@@ -219,6 +220,27 @@ void FileHeaderTest::SupportedCompressionFormatTest()
   CPPUNIT_ASSERT_EQUAL(fImageHeader.IsSupportedCompressionFormat(), false);
 }
 
+void FileHeaderTest::MultiStreamTest()
+{
+  // images without checkpoints keep the version older versions can read
+  fImageHeader.SetCompressionFormat(compressionGZip);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMinorVersion(), (unsigned)CImageFileHeader::sVerMinor);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.IsMultiStream(), false);
+  // several compression streams: version 1.5 and a compression scheme older versions reject
+  fImageHeader.SetMultiStream(true);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMinorVersion(), (unsigned)CImageFileHeader::sVerMinorMultiStream);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.IsMultiStream(), true);
+  CPPUNIT_ASSERT(fImageHeader.GetCompressionFormat() == compressionGZip);
+  CPPUNIT_ASSERT(fImageHeader.fHeader.compressionScheme > (DWORD)compressionChunkStore);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.IsSupportedCompressionFormat(), true);
+  fImageHeader.SetCompressionFormat(compressionZSTD);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.IsMultiStream(), true);
+  CPPUNIT_ASSERT(fImageHeader.GetCompressionFormat() == compressionZSTD);
+  fImageHeader.SetMultiStream(false);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.GetMinorVersion(), (unsigned)CImageFileHeader::sVerMinor);
+  CPPUNIT_ASSERT_EQUAL(fImageHeader.fHeader.compressionScheme, (DWORD)compressionZSTD);
+}
+
 void FileHeaderTest::SupportedVolumeEncodingFormatTest()
 {
   fImageHeader.SetVolumeBitmapInfo(CImageFileHeader::noVolumeBitmap, 0, 0);
@@ -229,6 +251,41 @@ void FileHeaderTest::SupportedVolumeEncodingFormatTest()
   CPPUNIT_ASSERT_EQUAL(fImageHeader.IsSupportedVolumeEncodingFormat(), false);
 }
 
+void FileHeaderTest::CommentEncodingTest()
+{
+  // the comment is stored as UTF-16LE with two bytes per unit, also where wchar_t has 32 bits
+  const wchar_t* text = L"Odin \x00e4";
+  const BYTE stored[] = { 'O', 0, 'd', 0, 'i', 0, 'n', 0, ' ', 0, 0xe4, 0 };
+  unsigned __int64 offset;
+  DWORD length;
+
+  CFileImageStream writer;
+  writer.Open(fileName, IImageStream::forWriting);
+  writer.SetComment(text);
+  writer.WriteImageFileHeaderForSaveAllBlocks(0, clusterSize);
+  writer.Close();
+
+  CFileImageStream reader;
+  reader.Open(fileName, IImageStream::forReading);
+  reader.ReadImageFileHeader(false);
+  reader.GetImageFileHeader().GetCommentOffsetAndLength(offset, length);
+  CPPUNIT_ASSERT_EQUAL((DWORD) sizeof(stored), length);
+  CPPUNIT_ASSERT(wcscmp(reader.GetComment(), text) == 0);
+  reader.Close();
+
+  fHandle = CreateFile(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  CPPUNIT_ASSERT(fHandle != INVALID_HANDLE_VALUE);
+  ReadAndCheckBuffer(offset, length, (BYTE*)stored, sizeof(stored));
+  CloseHandle(fHandle);
+  DeleteFile(fileName);
+
+  // characters outside the BMP are a surrogate pair
+  std::vector<BYTE> bytes;
+  CImageFileHeader::EncodeString(L"\xd83d\xde00", bytes);
+  CPPUNIT_ASSERT_EQUAL((size_t) 4, bytes.size());
+  CPPUNIT_ASSERT(CImageFileHeader::DecodeString(&bytes[0], (DWORD) bytes.size()) == L"\xd83d\xde00");
+}
+
 
 
 // Helper functions
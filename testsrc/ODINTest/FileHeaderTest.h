@@ -36,6 +36,8 @@ class FileHeaderTest : public CppUnit::TestFixture
   CPPUNIT_TEST( SupportedChecksumMethodTest );
   CPPUNIT_TEST( SupportedCompressionFormatTest );
   CPPUNIT_TEST( SupportedVolumeEncodingFormatTest) ;
+  CPPUNIT_TEST( CommentEncodingTest );
+  CPPUNIT_TEST( MultiStreamTest );
 CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -49,6 +51,8 @@ public:
   void SupportedChecksumMethodTest();
   void SupportedCompressionFormatTest();
   void SupportedVolumeEncodingFormatTest();
+  void CommentEncodingTest();
+  void MultiStreamTest();
 
 private:
   unsigned Read(void * buffer, unsigned nLength);
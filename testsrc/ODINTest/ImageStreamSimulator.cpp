@@ -25,6 +25,28 @@
 #include "ImageStreamSimulator.h"
 #include "RunLengthStreamSimulator.h"
 
+static const unsigned sContentBlockSize = 65536;
+static const unsigned sTextSize = 1024 * 1024;
+
+static const char* sWords[] = {
+  "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+  "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an",
+  "had", "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there",
+  "been", "if", "more", "when", "will", "would", "who", "so", "no", "disk", "image", "volume",
+  "backup", "restore", "partition", "cluster", "sector", "file", "system", "data", "drive"
+};
+
+// mix the bits of a value, used to pick the content of a block from its number
+static unsigned __int64 Mix(unsigned __int64 x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
 // fixed size stream for reading only
 CImageStreamSimulator::CImageStreamSimulator(unsigned __int64 size, bool isDrive)
 {
@@ -55,7 +77,74 @@ void CImageStreamSimulator::Init(TOpenMode openMode, bool isDrive)
   fSize = 0;
   fPosition = 0;
   fRunLengthReader = NULL;
-  srand( ::GetTickCount() );
+  fContent = contentRandom;
+  fRandomState = Mix(::GetTickCount() + 1);
+}
+
+void CImageStreamSimulator::SetContent(TContent content)
+{
+  fContent = content;
+  if ((content == contentText || content == contentMixed) && fText.empty()) {
+    // words with a punctuation and a line break from time to time
+    const int wordCount = sizeof(sWords) / sizeof(sWords[0]);
+    unsigned __int64 random = 0x9e3779b97f4a7c15ULL;
+    fText.reserve(sTextSize + 16);
+    for (unsigned n = 0; fText.size() < sTextSize; n++) {
+      random = Mix(random + n);
+      const char* word = sWords[random % wordCount];
+      fText.insert(fText.end(), word, word + strlen(word));
+      fText.push_back((random >> 32) % 12 == 0 ? (BYTE) '\n' : (BYTE) ' ');
+    }
+    fText.resize(sTextSize);
+  }
+}
+
+void CImageStreamSimulator::FillContent(BYTE* buffer, unsigned length, unsigned __int64 pos)
+{
+  while (length > 0) {
+    unsigned __int64 blockNo = pos / sContentBlockSize;
+    unsigned offset = (unsigned) (pos % sContentBlockSize);
+    unsigned count = sContentBlockSize - offset;
+    if (count > length)
+      count = length;
+    TContent content = fContent;
+    if (content == contentMixed) {
+      unsigned kind = (unsigned) (Mix(blockNo) % 10);
+      content = kind < 4 ? contentZeros : (kind < 7 ? contentText : contentRandom);
+    }
+    if (content == contentZeros) {
+      memset(buffer, 0, count);
+    } else if (content == contentText) {
+      // each block starts somewhere else in the text
+      unsigned start = (unsigned) (Mix(blockNo + 1) % (sTextSize - sContentBlockSize));
+      memcpy(buffer, &fText[start + offset], count);
+    } else {
+      FillRandom(buffer, count);
+    }
+    buffer += count;
+    pos += count;
+    length -= count;
+  }
+}
+
+void CImageStreamSimulator::FillRandom(BYTE* buffer, unsigned length)
+{
+  unsigned __int64 x = fRandomState;
+  unsigned i;
+
+  for (i = 0; i + sizeof(x) <= length; i += sizeof(x)) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    memcpy(buffer + i, &x, sizeof(x));
+  }
+  for (; i < length; i++) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    buffer[i] = (BYTE) x;
+  }
+  fRandomState = x;
 }
 
 CImageStreamSimulator::~CImageStreamSimulator()
@@ -91,10 +180,8 @@ void CImageStreamSimulator::Read(void * buffer, unsigned nLength, unsigned *nByt
   else
     *nBytesRead = 0;
 
+  FillContent((BYTE*)buffer, *nBytesRead, fPosition);
   fPosition += *nBytesRead;
-
-  for (unsigned i=0U; i<(*nBytesRead)/sizeof(int); i++)
-   ((int*)buffer)[i] = rand();
   fCrc32.AddDataBlock((BYTE*)buffer, *nBytesRead);
 
 }
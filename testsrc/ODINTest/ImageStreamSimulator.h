@@ -22,14 +22,18 @@
 ******************************************************************************/
  
 #pragma once
-#include "..\..\src\ODIN\IImageStream.h"
-#include "..\..\src\ODIN\crc32.h"
+#include "../../src/ODIN/IImageStream.h"
+#include "../../src/ODIN/crc32.h"
 #include <vector>
 
 class CImageStreamSimulator : public IImageStream
 {
 
 public:
+  // data returned by a stream for reading: random bytes, zeros, words of english text
+  // or a mix of them in blocks of 64KB (40% zeros, 30% text, 30% random)
+  typedef enum { contentRandom, contentZeros, contentText, contentMixed } TContent;
+
   // fixed size stream for reading only
   CImageStreamSimulator(unsigned __int64 size, bool isDrive); 
   
@@ -62,6 +66,12 @@ public:
   unsigned GetClusterSize() const {
     return fClusterSize;
   }
+
+  void SetContent(TContent content);
+
+  TContent GetContent() const {
+    return fContent;
+  }
   
   const std::vector<unsigned __int64>& GetSeekPositions() {
     return fSeekPositions;
@@ -69,6 +79,8 @@ public:
 
 private:
   void Init(TOpenMode openMode, bool isDrive);
+  void FillContent(BYTE* buffer, unsigned length, unsigned __int64 pos);
+  void FillRandom(BYTE* buffer, unsigned length);
 
   unsigned __int64 fSize;
   unsigned __int64 fPosition;
@@ -77,5 +89,8 @@ private:
   unsigned fClusterSize;
   bool fIsDrive;
   CCRC32 fCrc32;
+  TContent fContent;
+  unsigned __int64 fRandomState;  // state of xorshift generator for random content
+  std::vector<BYTE> fText;        // text the text blocks are taken from
   std::vector<unsigned __int64> fSeekPositions;
 };
@@ -0,0 +1,244 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include <memory>
+#include "IncrementalImageTest.h"
+#include "RunLengthStreamSimulator.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\BlockHashTable.h"
+#include "..\..\src\ODIN\RestoreChain.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\WriteThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+#include "..\..\src\ODIN\IImageStream.h"
+#include "..\..\src\ODIN\FileFormatException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( IncrementalImageTest );
+
+// a volume of 64 clusters of 4KB, 4 clusters per block, alternating runs of used and free clusters
+// (the run length simulator needs an even number of values)
+static const unsigned sClusterSize = 4096;
+static const unsigned sBlockSize = 4 * sClusterSize;
+static int sRunLengths[] = { 10, 3, 7, 5, 20, 4, 15, 0 };
+static const int sRunLengthCount = sizeof(sRunLengths) / sizeof(sRunLengths[0]);
+static const unsigned sVolumeSize = 64 * sClusterSize;
+
+void IncrementalImageTest::setUp()
+{
+}
+
+void IncrementalImageTest::tearDown()
+{
+}
+
+// save the used clusters of volume with block hashes like a backup does
+void IncrementalImageTest::Backup(vector<BYTE>& volume, CBlockHashTable& hashes, const CBlockHashTable* baseHashes,
+                                  vector<BYTE>& image)
+{
+  CImageBuffer emptyQueue(8192, 4), filledQueue;
+  CMemoryImageStream source(volume, true);
+  CMemoryImageStream target(image, false);
+  CRunLengthStreamReaderSimulator runLengthReader(sRunLengths, sRunLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CWriteThread writeThread(&target, &filledQueue, &emptyQueue, false);
+
+  image.clear();
+  readThread.SetAllocationMapReaderInfo(&runLengthReader, sClusterSize);
+  readThread.SetBlockHashTable(&hashes, baseHashes);
+  readThread.Resume();
+  writeThread.Resume();
+  readThread.WaitForThread();
+  writeThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!writeThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL(readThread.GetCrc32(), writeThread.GetCrc32());
+}
+
+// restore image index of a chain to volume
+void IncrementalImageTest::Restore(vector<BYTE>& image, const CRestoreChain& chain, unsigned index, vector<BYTE>& volume,
+                                   unsigned __int64& bytesWritten)
+{
+  CImageBuffer emptyQueue(8192, 4), filledQueue;
+  CMemoryImageStream source(image, false);
+  CMemoryImageStream target(volume, true);
+  CRunLengthStreamReaderSimulator runLengthReader(sRunLengths, sRunLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CWriteThread writeThread(&target, &filledQueue, &emptyQueue, false);
+
+  writeThread.SetAllocationMapReaderInfo(&runLengthReader, sClusterSize);
+  writeThread.SetRestoreChain(&chain, index);
+  readThread.Resume();
+  writeThread.Resume();
+  readThread.WaitForThread();
+  writeThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!writeThread.GetErrorFlag());
+  bytesWritten = writeThread.GetBytesProcessed();
+}
+
+void IncrementalImageTest::SerializeTest()
+{
+  BYTE digest[CSha256::sDigestLength], digest2[CSha256::sDigestLength];
+  vector<BYTE> buffer;
+  CBlockHashTable hashes(sBlockSize, sClusterSize, sVolumeSize + 100);
+
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 17, hashes.GetBlockCount());
+  for (unsigned i=0; i<17; i++) {
+    FillBuffer(digest, sizeof(digest), i);
+    hashes.SetBlockHash(i, digest, i % 3 == 0 ? 0 : CBlockHashTable::blockUsed | (i % 2 ? CBlockHashTable::blockStored : 0));
+  }
+  hashes.SetBaseReference(L"c:\\images\\base.dat", digest);
+  hashes.Serialize(buffer);
+  CPPUNIT_ASSERT_EQUAL((size_t) hashes.GetSerializedLength(), buffer.size());
+
+  CBlockHashTable hashes2;
+  hashes2.Deserialize(&buffer[0], buffer.size());
+  CPPUNIT_ASSERT(hashes2.IsCompatible(hashes));
+  CPPUNIT_ASSERT(hashes2.IsIncremental());
+  CPPUNIT_ASSERT(wstring(L"c:\\images\\base.dat") == hashes2.GetBaseFileName());
+  CPPUNIT_ASSERT(memcmp(digest, hashes2.GetBaseDigest(), sizeof(digest)) == 0);
+  CPPUNIT_ASSERT_EQUAL(hashes.GetStoredBlockCount(), hashes2.GetStoredBlockCount());
+  for (unsigned i=0; i<17; i++) {
+    CPPUNIT_ASSERT_EQUAL(hashes.IsUsed(i), hashes2.IsUsed(i));
+    CPPUNIT_ASSERT_EQUAL(hashes.IsStored(i), hashes2.IsStored(i));
+    CPPUNIT_ASSERT(memcmp(hashes.GetBlockDigest(i), hashes2.GetBlockDigest(i), sizeof(digest)) == 0);
+  }
+
+  // table digest identifies the contents
+  hashes.GetTableDigest(digest);
+  hashes2.GetTableDigest(digest2);
+  CPPUNIT_ASSERT(memcmp(digest, digest2, sizeof(digest)) == 0);
+  hashes2.SetBlockHash(5, digest, CBlockHashTable::blockUsed);
+  hashes2.GetTableDigest(digest2);
+  CPPUNIT_ASSERT(memcmp(digest, digest2, sizeof(digest)) != 0);
+
+  // damaged tables are rejected
+  buffer[0] ^= 0xFF;
+  CPPUNIT_ASSERT_THROW(hashes2.Deserialize(&buffer[0], buffer.size()), EFileFormatException);
+  buffer[0] ^= 0xFF;
+  CPPUNIT_ASSERT_THROW(hashes2.Deserialize(&buffer[0], buffer.size() - 1), EFileFormatException);
+}
+
+void IncrementalImageTest::RestoreChainOwnerTest()
+{
+  BYTE digest[CSha256::sDigestLength];
+  const DWORD used = CBlockHashTable::blockUsed;
+  const DWORD stored = CBlockHashTable::blockUsed | CBlockHashTable::blockStored;
+  // block:                     0       1       2       3       4
+  DWORD fullFlags[] =        { stored, stored, stored, 0,      stored };
+  DWORD incr1Flags[] =       { used,   stored, used,   stored, used   };
+  DWORD incr2Flags[] =       { used,   used,   stored, used,   0      };
+  DWORD* flags[] = { fullFlags, incr1Flags, incr2Flags };
+  unsigned expectedOwner[] = { 0, 1, 2, 1, 99 }; // block 4 is unused in newest image
+
+  CRestoreChain chain;
+  memset(digest, 0, sizeof(digest));
+  for (unsigned i=0; i<3; i++) {
+    unique_ptr<CBlockHashTable> hashes = make_unique<CBlockHashTable>(sBlockSize, sClusterSize, 5 * sBlockSize);
+    for (unsigned j=0; j<5; j++)
+      hashes->SetBlockHash(j, digest, flags[i][j]);
+    chain.fFileNames.push_back(L"image");
+    chain.fHashTables.push_back(move(hashes));
+  }
+  chain.BuildOwners();
+
+  CPPUNIT_ASSERT_EQUAL(3U, chain.GetImageCount());
+  for (unsigned j=0; j<5; j++)
+    for (unsigned i=0; i<3; i++)
+      CPPUNIT_ASSERT_EQUAL(expectedOwner[j] == i, chain.IsBlockFromImage(j, i));
+}
+
+void IncrementalImageTest::ChangedBlockTest()
+{
+  vector<BYTE> volume(sVolumeSize), image, image2;
+  CBlockHashTable hashes(sBlockSize, sClusterSize, sVolumeSize);
+  CBlockHashTable hashes2(sBlockSize, sClusterSize, sVolumeSize);
+  FillBuffer(&volume[0], sVolumeSize, 1);
+
+  // full backup stores all used clusters and has all used blocks stored
+  Backup(volume, hashes, NULL, image);
+  unsigned __int64 usedBytes = 0;
+  for (int i=0; i<sRunLengthCount; i+=2)
+    usedBytes += sRunLengths[i] * sClusterSize;
+  CPPUNIT_ASSERT_EQUAL((size_t) usedBytes, image.size());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 16, hashes.GetBlockCount());
+  for (unsigned i=0; i<16; i++)
+    CPPUNIT_ASSERT_EQUAL(hashes.IsUsed(i), hashes.IsStored(i));
+  CPPUNIT_ASSERT(!hashes.IsUsed(5)); // clusters 20..23 are free
+  CPPUNIT_ASSERT(hashes.IsUsed(3));  // cluster 12 is free, 13..15 are used
+
+  // unchanged volume: incremental backup is empty
+  Backup(volume, hashes2, &hashes, image2);
+  CPPUNIT_ASSERT_EQUAL((size_t) 0, image2.size());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 0, hashes2.GetStoredBlockCount());
+
+  // change one byte in block 0 and in block 9 (clusters 36..39, all used)
+  volume[100] ^= 0x55;
+  volume[9 * sBlockSize + 5000] ^= 0x55;
+  // changes in free clusters are not detected (cluster 11 is free)
+  volume[11 * sClusterSize] ^= 0x55;
+  Backup(volume, hashes2, &hashes, image2);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 2, hashes2.GetStoredBlockCount());
+  CPPUNIT_ASSERT(hashes2.IsStored(0));
+  CPPUNIT_ASSERT(hashes2.IsStored(9));
+  CPPUNIT_ASSERT_EQUAL((size_t) 2 * sBlockSize, image2.size());
+  CPPUNIT_ASSERT(memcmp(&image2[0], &volume[0], sBlockSize) == 0);
+  CPPUNIT_ASSERT(memcmp(&image2[sBlockSize], &volume[9 * sBlockSize], sBlockSize) == 0);
+}
+
+void IncrementalImageTest::ChainRestoreTest()
+{
+  vector<BYTE> volume(sVolumeSize), image, image2, target(sVolumeSize, 0);
+  CRestoreChain chain;
+  chain.fHashTables.push_back(make_unique<CBlockHashTable>(sBlockSize, sClusterSize, sVolumeSize));
+  chain.fHashTables.push_back(make_unique<CBlockHashTable>(sBlockSize, sClusterSize, sVolumeSize));
+  chain.fFileNames.push_back(L"full");
+  chain.fFileNames.push_back(L"incremental");
+  FillBuffer(&volume[0], sVolumeSize, 2);
+  // free clusters are not restored, clear them to compare the complete volume
+  unsigned __int64 pos = 0;
+  for (int i=0; i<sRunLengthCount; i++) {
+    if (i % 2)
+      memset(&volume[(size_t)pos], 0, sRunLengths[i] * sClusterSize);
+    pos += sRunLengths[i] * sClusterSize;
+  }
+
+  Backup(volume, *chain.fHashTables[0], NULL, image);
+  volume[3 * sBlockSize + sClusterSize + 7] ^= 0x55; // block 3 (cluster 12..15, 12 is free)
+  volume[15 * sBlockSize + 4095] ^= 0x55;            // last block
+  Backup(volume, *chain.fHashTables[1], chain.fHashTables[0].get(), image2);
+  chain.BuildOwners();
+
+  // restore full image first, then the incremental image, every block is written once
+  unsigned __int64 bytesWritten, bytesWritten2;
+  Restore(image, chain, 0, target, bytesWritten);
+  Restore(image2, chain, 1, target, bytesWritten2);
+  CPPUNIT_ASSERT(target == volume);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image.size(), bytesWritten + bytesWritten2);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image2.size(), bytesWritten2);
+}
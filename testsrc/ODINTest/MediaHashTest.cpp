@@ -0,0 +1,344 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include "MediaHashTest.h"
+#include "RunLengthStreamSimulator.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\MediaHash.h"
+#include "..\..\src\ODIN\CpuFeatures.h"
+#include "..\..\src\ODIN\StreamHasher.h"
+#include "..\..\src\ODIN\PartitionHasher.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\WriteThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+#include "..\..\src\ODIN\FileHeader.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( MediaHashTest );
+
+static const unsigned sClusterSize = 4096;
+
+void MediaHashTest::setUp()
+{
+}
+
+void MediaHashTest::tearDown()
+{
+}
+
+// volume with data in the used clusters given by runLengths and zeros in the free ones,
+// image gets the used clusters
+void MediaHashTest::MakeVolume(int* runLengths, int runLengthCount, vector<BYTE>& volume, vector<BYTE>& image)
+{
+  unsigned __int64 pos = 0;
+  unsigned clusterCount = 0;
+  for (int i=0; i<runLengthCount; i++)
+    clusterCount += runLengths[i];
+  volume.assign(clusterCount * sClusterSize, 0);
+  image.clear();
+  for (int i=0; i<runLengthCount; i+=2) {
+    FillBuffer(&volume[(size_t) pos], runLengths[i] * sClusterSize, i);
+    image.insert(image.end(), volume.begin() + (size_t) pos, volume.begin() + (size_t) (pos + runLengths[i] * sClusterSize));
+    pos += (runLengths[i] + runLengths[i+1]) * sClusterSize;
+  }
+}
+
+void MediaHashTest::Sha1Test()
+{
+  BYTE digest[CSha1::sDigestLength];
+  CSha1::Calculate((const BYTE*)"abc", 3, digest);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(digest, sizeof(digest)) == L"A9993E364706816ABA3E25717850C26C9CD0D89D");
+
+  // data added in pieces not aligned to the block size give the same result
+  vector<BYTE> data(1000);
+  FillBuffer(&data[0], (unsigned) data.size(), 1);
+  BYTE expected[CSha1::sDigestLength];
+  CSha1::Calculate(&data[0], (unsigned) data.size(), expected);
+  CSha1 sha1;
+  sha1.AddDataBlock(&data[0], 1);
+  sha1.AddDataBlock(&data[1], 63);
+  sha1.AddDataBlock(&data[64], 100);
+  sha1.AddDataBlock(&data[164], 836);
+  sha1.GetResult(digest);
+  CPPUNIT_ASSERT(memcmp(expected, digest, sizeof(digest)) == 0);
+}
+
+void MediaHashTest::ShaExtensionsTest()
+{
+  // the SHA instructions of the CPU (if any) and the portable code give the same digests
+  // for lengths around the block size and with several blocks in one call
+  const unsigned lengths[] = { 0, 1, 55, 56, 63, 64, 65, 127, 128, 1000, 4096, 100001 };
+  vector<BYTE> data(100001);
+  FillBuffer(&data[0], (unsigned) data.size(), 3);
+  bool enabled = CCpuFeatures::UseShaExtensions();
+  for (unsigned i=0; i<sizeof(lengths)/sizeof(lengths[0]); i++) {
+    BYTE sha1[2][CSha1::sDigestLength], sha256[2][CSha256::sDigestLength];
+    for (int ext=0; ext<2; ext++) {
+      CCpuFeatures::EnableShaExtensions(ext != 0);
+      CSha1::Calculate(&data[0], lengths[i], sha1[ext]);
+      CSha256::Calculate(&data[0], lengths[i], sha256[ext]);
+    }
+    CPPUNIT_ASSERT(memcmp(sha1[0], sha1[1], CSha1::sDigestLength) == 0);
+    CPPUNIT_ASSERT(memcmp(sha256[0], sha256[1], CSha256::sDigestLength) == 0);
+  }
+  CCpuFeatures::EnableShaExtensions(enabled);
+}
+
+void MediaHashTest::StreamHasherTest()
+{
+  const unsigned dataSize = 100001;
+  vector<BYTE> data(dataSize);
+  FillBuffer(&data[0], dataSize, 4);
+  BYTE sha1[CSha1::sDigestLength], sha256[CSha256::sDigestLength];
+  CSha1::Calculate(&data[0], dataSize, sha1);
+  CSha256::Calculate(&data[0], dataSize, sha256);
+
+  // small buffers not aligned to the block size so that readers and hashers wrap the ring
+  unsigned pos = 0;
+  int lastPercent = -1;
+  CStreamHasher::TReadFunction readMemory = [&](BYTE* buffer, unsigned size, unsigned& bytesRead) {
+    bytesRead = dataSize - pos < size ? dataSize - pos : size;
+    memcpy(buffer, &data[pos], bytesRead);
+    pos += bytesRead;
+    return true;
+  };
+  CStreamHasher both(CStreamHasher::hashSha1 | CStreamHasher::hashSha256, 1000, 3);
+  CPPUNIT_ASSERT(both.Calculate(readMemory, dataSize, [&](int percent) { lastPercent = percent; }));
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) dataSize, both.GetBytesHashed());
+  CPPUNIT_ASSERT(memcmp(sha1, both.GetSha1Digest(), sizeof(sha1)) == 0);
+  CPPUNIT_ASSERT(memcmp(sha256, both.GetSha256Digest(), sizeof(sha256)) == 0);
+  CPPUNIT_ASSERT_EQUAL(100, lastPercent);
+
+  // length 0 reads up to the end of the data
+  pos = 0;
+  CStreamHasher sha256Only(CStreamHasher::hashSha256, 4096, 2);
+  CPPUNIT_ASSERT(sha256Only.Calculate(readMemory, 0));
+  CPPUNIT_ASSERT(memcmp(sha256, sha256Only.GetSha256Digest(), sizeof(sha256)) == 0);
+
+  // data ending before length and read errors fail
+  pos = 0;
+  CPPUNIT_ASSERT(!both.Calculate(readMemory, dataSize + 1));
+  CStreamHasher::TReadFunction readError = [](BYTE*, unsigned, unsigned&) { return false; };
+  CPPUNIT_ASSERT(!both.Calculate(readError, dataSize));
+}
+
+void MediaHashTest::ZeroPaddingTest()
+{
+  const unsigned dataSize = 1000, zeroSize = 70000, mediaSize = 100000;
+  vector<BYTE> media(mediaSize, 0);
+  FillBuffer(&media[0], dataSize, 2);
+
+  CMediaHash hash(CMediaHash::hashSha1 | CMediaHash::hashSha256);
+  hash.AddData(&media[0], dataSize);
+  hash.AddZeros(zeroSize);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) dataSize + zeroSize, hash.GetPosition());
+  hash.Finish(mediaSize);
+
+  BYTE sha1[CSha1::sDigestLength], sha256[CSha256::sDigestLength];
+  CSha1::Calculate(&media[0], mediaSize, sha1);
+  CSha256::Calculate(&media[0], mediaSize, sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha1, sizeof(sha1)) == hash.GetSha1());
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == hash.GetSha256());
+
+  CMediaHash sha256Only(CMediaHash::hashSha256);
+  sha256Only.AddData(&media[0], dataSize);
+  sha256Only.Finish(mediaSize);
+  CPPUNIT_ASSERT(sha256Only.GetSha1().empty());
+  CPPUNIT_ASSERT(sha256Only.GetSha256() == hash.GetSha256());
+}
+
+void MediaHashTest::UsedClustersScopeTest()
+{
+  // free clusters are skipped, the digest covers only the data of the image
+  int runLengths[] = { 4, 2, 3, 5 };
+  vector<BYTE> volume, image;
+  MakeVolume(runLengths, 4, volume, image);
+  CMediaHash hash(CMediaHash::hashSha256, CMediaHash::scopeUsedClusters);
+  hash.AddData(&image[0], 4 * sClusterSize);
+  hash.AddZeros(2 * sClusterSize);
+  hash.AddData(&image[4 * sClusterSize], 3 * sClusterSize);
+  hash.AddZeros(5 * sClusterSize);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) volume.size(), hash.GetPosition());
+  hash.Finish(volume.size() + sClusterSize);
+
+  BYTE sha256[CSha256::sDigestLength];
+  CSha256::Calculate(&image[0], (unsigned) image.size(), sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == hash.GetSha256());
+  CPPUNIT_ASSERT_EQUAL(CMediaHash::scopeUsedClusters, hash.GetScope());
+}
+
+void MediaHashTest::WriteThreadHashTest()
+{
+  // used/free cluster runs, ending with free clusters not covered by the map
+  int runLengths[] = { 10, 3, 7, 5, 20, 4, 15, 0 };
+  const int runLengthCount = sizeof(runLengths) / sizeof(runLengths[0]);
+  const unsigned volumeSize = 70 * sClusterSize;
+  vector<BYTE> volume, image, target;
+  MakeVolume(runLengths, runLengthCount, volume, image);
+
+  CImageBuffer emptyQueue(3 * sClusterSize, 4), filledQueue;
+  CMemoryImageStream source(image, false);
+  CMemoryImageStream targetStream(target, true);
+  CRunLengthStreamReaderSimulator runLengthReader(runLengths, runLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CWriteThread writeThread(&targetStream, &filledQueue, &emptyQueue, false);
+  CMediaHash hash(CMediaHash::hashSha256);
+
+  writeThread.SetAllocationMapReaderInfo(&runLengthReader, sClusterSize);
+  writeThread.SetMediaHash(&hash, volumeSize);
+  readThread.Resume();
+  writeThread.Resume();
+  readThread.WaitForThread();
+  writeThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!writeThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) volumeSize, hash.GetPosition());
+
+  BYTE expected[CSha256::sDigestLength];
+  CSha256::Calculate(&volume[0], volumeSize, expected);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(expected, sizeof(expected)) == hash.GetSha256());
+}
+
+void MediaHashTest::ReadThreadHashTest()
+{
+  // backup of used clusters calculates the same hash as the restore of the image
+  int runLengths[] = { 10, 3, 7, 5, 20, 4, 15, 6 };
+  const int runLengthCount = sizeof(runLengths) / sizeof(runLengths[0]);
+  const unsigned volumeSize = 70 * sClusterSize;
+  vector<BYTE> volume, image;
+  MakeVolume(runLengths, runLengthCount, volume, image);
+  // free clusters on a real volume are not zero
+  FillBuffer(&volume[10 * sClusterSize], 3 * sClusterSize, 9);
+
+  // enough buffers to take all used clusters, no consumer needed
+  CImageBuffer emptyQueue(3 * sClusterSize, 32), filledQueue;
+  CMemoryImageStream source(volume, true);
+  CRunLengthStreamReaderSimulator runLengthReader(runLengths, runLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CMediaHash hash(CMediaHash::hashSha1 | CMediaHash::hashSha256);
+
+  readThread.SetAllocationMapReaderInfo(&runLengthReader, sClusterSize);
+  readThread.SetMediaHash(&hash, volumeSize);
+  readThread.Resume();
+  readThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL((__int64) image.size(), readThread.GetBytesProcessed());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) volumeSize, hash.GetPosition());
+
+  MakeVolume(runLengths, runLengthCount, volume, image);
+  BYTE sha1[CSha1::sDigestLength], sha256[CSha256::sDigestLength];
+  CSha1::Calculate(&volume[0], volumeSize, sha1);
+  CSha256::Calculate(&volume[0], volumeSize, sha256);
+  CPPUNIT_ASSERT(memcmp(sha1, hash.GetSha1Digest(), sizeof(sha1)) == 0);
+  CPPUNIT_ASSERT(memcmp(sha256, hash.GetSha256Digest(), sizeof(sha256)) == 0);
+}
+
+void MediaHashTest::FileHeaderHashTest()
+{
+  BYTE sha1[CSha1::sDigestLength], sha256[CSha256::sDigestLength];
+  CSha1::Calculate((const BYTE*)"abc", 3, sha1);
+  CSha256::Calculate((const BYTE*)"abc", 3, sha256);
+
+  CImageFileHeader header;
+  CPPUNIT_ASSERT(!header.HasMediaHash());
+  header.SetMediaHash(CImageFileHeader::mediaHashSHA256, sha1, sha256);
+  CPPUNIT_ASSERT(header.HasMediaHash());
+  CPPUNIT_ASSERT_EQUAL((DWORD) CImageFileHeader::mediaHashSHA256, header.GetMediaHashScheme());
+  CPPUNIT_ASSERT(memcmp(sha256, header.GetMediaHashSha256(), sizeof(sha256)) == 0);
+  // digest of algorithm not in scheme is not stored
+  BYTE zeros[CSha1::sDigestLength] = { 0 };
+  CPPUNIT_ASSERT(memcmp(zeros, header.GetMediaHashSha1(), sizeof(zeros)) == 0);
+
+  header.SetMediaHash(CImageFileHeader::mediaHashSHA1 | CImageFileHeader::mediaHashSHA256, sha1, sha256);
+  CPPUNIT_ASSERT(memcmp(sha1, header.GetMediaHashSha1(), sizeof(sha1)) == 0);
+}
+
+void MediaHashTest::PartitionHasherTest()
+{
+  int runLengths1[] = { 10, 3, 7, 5, 20, 4 };
+  int runLengths2[] = { 2, 30, 1, 1 };
+  vector<BYTE> volume1, image1, volume2, image2;
+  MakeVolume(runLengths1, 6, volume1, image1);
+  MakeVolume(runLengths2, 4, volume2, image2);
+  // volume 2 is larger than its allocation map
+  const unsigned volumeSize2 = (unsigned) volume2.size() + 8 * sClusterSize;
+  vector<BYTE> expected1 = volume1, expected2 = volume2;
+  expected2.resize(volumeSize2, 0);
+  // free clusters on the media are not zero and must not be read
+  vector<BYTE> media1 = volume1, media2 = expected2;
+  FillBuffer(&media1[10 * sClusterSize], 3 * sClusterSize, 7);
+  FillBuffer(&media2[2 * sClusterSize], 30 * sClusterSize, 8);
+  FillBuffer(&media2[34 * sClusterSize], 8 * sClusterSize, 9);
+
+  auto makePartition = [](vector<BYTE>& media, int* runLengths, int count, unsigned __int64 volumeSize) {
+    CPartitionHasher::TPartition partition;
+    partition.readAt = [&media](unsigned __int64 offset, BYTE* buffer, unsigned size, unsigned& bytesRead) {
+      bytesRead = media.size() - offset < size ? (unsigned) (media.size() - offset) : size;
+      memcpy(buffer, &media[(size_t) offset], bytesRead);
+      return true;
+    };
+    partition.volumeSize = volumeSize;
+    partition.clusterSize = sClusterSize;
+    partition.runLengths.assign(runLengths, runLengths + count);
+    return partition;
+  };
+  vector<CPartitionHasher::TPartition> partitions;
+  partitions.push_back(makePartition(media1, runLengths1, 6, volume1.size()));
+  partitions.push_back(makePartition(media2, runLengths2, 4, volumeSize2));
+
+  // free clusters as zeros up to the volume size: the same as restore and backup calculate
+  CPartitionHasher volumeHasher(CMediaHash::hashSha1 | CMediaHash::hashSha256, CMediaHash::scopeVolume);
+  CPPUNIT_ASSERT(volumeHasher.Calculate(partitions));
+  BYTE sha1[CSha1::sDigestLength], sha256[CSha256::sDigestLength];
+  CSha1::Calculate(&expected1[0], (unsigned) expected1.size(), sha1);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha1, sizeof(sha1)) == partitions[0].sha1);
+  CSha256::Calculate(&expected2[0], (unsigned) expected2.size(), sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == partitions[1].sha256);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image1.size(), partitions[0].bytesRead);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image2.size(), partitions[1].bytesRead);
+
+  // used clusters only
+  CPartitionHasher usedHasher(CMediaHash::hashSha256, CMediaHash::scopeUsedClusters);
+  CPPUNIT_ASSERT(usedHasher.Calculate(partitions));
+  CSha256::Calculate(&image1[0], (unsigned) image1.size(), sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == partitions[0].sha256);
+  CPPUNIT_ASSERT(partitions[0].sha1.empty());
+  CSha256::Calculate(&image2[0], (unsigned) image2.size(), sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == partitions[1].sha256);
+
+  // without allocation map the whole volume is read
+  partitions[0].runLengths.clear();
+  CPPUNIT_ASSERT(usedHasher.Calculate(partitions));
+  CSha256::Calculate(&media1[0], (unsigned) media1.size(), sha256);
+  CPPUNIT_ASSERT(CMediaHash::ToHex(sha256, sizeof(sha256)) == partitions[0].sha256);
+
+  // a read error fails only its partition
+  partitions[1].readAt = [](unsigned __int64, BYTE*, unsigned, unsigned&) { return false; };
+  CPPUNIT_ASSERT(!usedHasher.Calculate(partitions));
+  CPPUNIT_ASSERT(partitions[0].ok);
+  CPPUNIT_ASSERT(!partitions[1].ok);
+}
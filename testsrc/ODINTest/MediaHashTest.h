@@ -0,0 +1,59 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+
+#include <vector>
+#include "cppunit/extensions/HelperMacros.h"
+
+class MediaHashTest : public CppUnit::TestFixture
+{
+  CPPUNIT_TEST_SUITE( MediaHashTest );
+  CPPUNIT_TEST( Sha1Test );
+  CPPUNIT_TEST( ShaExtensionsTest );
+  CPPUNIT_TEST( StreamHasherTest );
+  CPPUNIT_TEST( ZeroPaddingTest );
+  CPPUNIT_TEST( UsedClustersScopeTest );
+  CPPUNIT_TEST( WriteThreadHashTest );
+  CPPUNIT_TEST( ReadThreadHashTest );
+  CPPUNIT_TEST( FileHeaderHashTest );
+  CPPUNIT_TEST( PartitionHasherTest );
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void setUp();
+  void tearDown();
+
+  void Sha1Test();
+  void ShaExtensionsTest();
+  void StreamHasherTest();
+  void ZeroPaddingTest();
+  void UsedClustersScopeTest();
+  void WriteThreadHashTest();
+  void ReadThreadHashTest();
+  void FileHeaderHashTest();
+  void PartitionHasherTest();
+
+private:
+  void MakeVolume(int* runLengths, int runLengthCount, std::vector<BYTE>& volume, std::vector<BYTE>& image);
+};
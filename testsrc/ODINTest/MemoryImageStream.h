@@ -0,0 +1,103 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#pragma once
+#ifndef __MEMORYIMAGESTREAM_H__
+#define __MEMORYIMAGESTREAM_H__
+
+#include <vector>
+#include "..\..\src\ODIN\IImageStream.h"
+
+// pseudo random test data, different seeds give different data
+inline void FillBuffer(BYTE* buffer, unsigned length, unsigned seed)
+{
+  unsigned value = seed * 2654435761U + 1;
+  for (unsigned i=0; i<length; i++) {
+    value = value * 1103515245U + 12345U;
+    buffer[i] = (BYTE)(value >> 16);
+  }
+}
+
+// an image stream on a memory buffer counting the bytes written, writes wait for
+// an event if one is given
+class CMemoryImageStream : public IImageStream
+{
+public:
+  CMemoryImageStream(std::vector<BYTE>& data, bool isDrive, HANDLE writeGate = NULL)
+    : fData(data), fPosition(0), fIsDrive(isDrive), fBytesWritten(0), fWriteGate(writeGate)
+  {
+  }
+
+  virtual LPCWSTR GetName() const { return L"MemoryImageStream"; }
+  virtual void Open(LPCWSTR name, TOpenMode mode) { fPosition = 0; }
+  virtual void Close() {}
+  virtual unsigned __int64 GetPosition() const { return fPosition; }
+
+  virtual void Read(void * buffer, unsigned nLength, unsigned *nBytesRead) {
+    size_t available = fPosition >= fData.size() ? 0 : fData.size() - (size_t)fPosition;
+    *nBytesRead = available < nLength ? (unsigned) available : nLength;
+    if (*nBytesRead > 0)
+      memcpy(buffer, &fData[(size_t)fPosition], *nBytesRead);
+    fPosition += *nBytesRead;
+  }
+
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten) {
+    if (fWriteGate)
+      WaitForSingleObject(fWriteGate, INFINITE);
+    if (fPosition + nLength > fData.size())
+      fData.resize((size_t)fPosition + nLength);
+    if (nLength > 0)
+      memcpy(&fData[(size_t)fPosition], buffer, nLength);
+    fPosition += nLength;
+    fBytesWritten += nLength;
+    *nBytesWritten = nLength;
+  }
+
+  virtual void Seek(__int64 offset, DWORD moveMethod) {
+    if (moveMethod == FILE_BEGIN)
+      fPosition = offset;
+    else if (moveMethod == FILE_CURRENT)
+      fPosition += offset;
+    else
+      fPosition = fData.size() + offset;
+  }
+
+  virtual unsigned __int64 GetSize() const { return fData.size(); }
+  virtual unsigned __int64 GetAllocatedBytes() const { return 0; }
+  virtual bool IsDrive() const { return fIsDrive; }
+  virtual IRunLengthStreamReader* GetRunLengthStreamReader() const { return NULL; }
+  virtual void SetCompletedInformation(DWORD crc32, unsigned __int64 processedBytes) {}
+
+  unsigned __int64 GetBytesWritten() const {
+    return fBytesWritten;
+  }
+
+private:
+  std::vector<BYTE>& fData;
+  unsigned __int64 fPosition;
+  bool fIsDrive;
+  unsigned __int64 fBytesWritten;
+  HANDLE fWriteGate;
+};
+
+#endif
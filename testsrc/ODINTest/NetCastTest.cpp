@@ -0,0 +1,203 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "NetCastTest.h"
+#include "..\..\src\ODIN\NetCastStream.h"
+#include "..\..\src\ODIN\NetImageServer.h"
+#include "..\..\src\ODIN\ImageStream.h"
+#include "..\..\src\ODIN\crc32.h"
+#include "..\..\src\ODIN\InternalException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( NetCastTest );
+
+static const wchar_t sImageDir[] = L"TestCastImages";
+
+static wstring CastName(unsigned short port, LPCWSTR path)
+{
+  return L"odincast://127.0.0.1:" + to_wstring(port) + L"/" + path;
+}
+
+// pseudo random data, the same for the same position
+static BYTE DataAt(unsigned pos)
+{
+  unsigned x = pos * 2654435761U;
+  return (BYTE) (x >> 24);
+}
+
+// an uncompressed image of size bytes of volume data in the image directory
+static void WriteImage(unsigned size, bool damaged)
+{
+  vector<BYTE> data(size);
+  unsigned count;
+  CCRC32 crc32;
+
+  for (unsigned i=0; i<size; i++)
+    data[i] = DataAt(i);
+  crc32.AddDataBlock(&data[0], size);
+  CFileImageStream imageStream;
+  imageStream.Open((wstring(sImageDir) + L"\\test.img").c_str(), IImageStream::forWriting);
+  imageStream.SetCompressionFormat(noCompression);
+  imageStream.SetVolumeFormat(CImageFileHeader::volumePartition);
+  imageStream.WriteImageFileHeaderForSaveAllBlocks(size, 4096);
+  imageStream.Write(&data[0], size, &count);
+  imageStream.SetCompletedInformation(crc32.GetResult() ^ (damaged ? 1 : 0), size);
+  imageStream.Close();
+}
+
+// read the volume data of a cast image, the header is read like a restore does
+static bool ReadCast(CNetCastStream& stream, unsigned size)
+{
+  CImageFileHeader header;
+  unsigned __int64 dataOffset;
+  vector<BYTE> data(256 * 1024);
+  unsigned bytes;
+
+  header.ReadHeaderFromStream(&stream);
+  dataOffset = header.GetVolumeDataOffset();
+  if (header.GetCompressionFormat() != noCompression || header.GetVolumeUsedSize() != size ||
+      stream.GetSize() != dataOffset + size)
+    return false;
+  stream.Seek(dataOffset, FILE_BEGIN);
+  for (unsigned pos=0; pos<size; pos+=bytes) {
+    stream.Read(&data[0], (unsigned) data.size(), &bytes);
+    if (bytes != min((unsigned) data.size(), size - pos))
+      return false;
+    for (unsigned i=0; i<bytes; i++) {
+      if (data[i] != DataAt(pos + i))
+        return false;
+    }
+  }
+  stream.Read(&data[0], (unsigned) data.size(), &bytes);
+  return bytes == 0;
+}
+
+void NetCastTest::setUp()
+{
+  DeleteImages();
+  CreateDirectory(sImageDir, NULL);
+}
+
+void NetCastTest::tearDown()
+{
+  DeleteImages();
+}
+
+void NetCastTest::DeleteImages()
+{
+  wstring dir(sImageDir);
+  DeleteFile((dir + L"\\test.img").c_str());
+  RemoveDirectory(sImageDir);
+}
+
+void NetCastTest::NameTest()
+{
+  CPPUNIT_ASSERT(CNetCastStream::IsCastName(L"odincast://server/images/disk.img"));
+  CPPUNIT_ASSERT(CNetCastStream::IsCastName(L"ODINCAST://[::1]:7000/disk.img"));
+  CPPUNIT_ASSERT(!CNetCastStream::IsCastName(L"odin://server/disk.img"));
+
+  // cast images can not be written, names without a path are refused before connecting
+  CNetCastStream stream;
+  CPPUNIT_ASSERT_THROW(stream.Open(L"odincast://server/disk.img", IImageStream::forWriting), EInternalException);
+  CPPUNIT_ASSERT_THROW(stream.Open(L"odincast://server", IImageStream::forReading), EInternalException);
+}
+
+void NetCastTest::CastTest()
+{
+  const unsigned size = 3 * 1024 * 1024 + 12345;
+  WriteImage(size, false);
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  wstring name = CastName(port, L"test.img");
+  server.SetCastOptions(4, 2, 10000, 10000);
+
+  // both clients join before decoding starts and share one round, read in turns
+  CNetCastStream stream1, stream2;
+  stream1.Open(name.c_str(), IImageStream::forReading);
+  stream2.Open(name.c_str(), IImageStream::forReading);
+  CPPUNIT_ASSERT(ReadCast(stream1, size));
+  CPPUNIT_ASSERT(ReadCast(stream2, size));
+  CPPUNIT_ASSERT_EQUAL(1U, server.GetCastRoundCount());
+
+  // volume data already read can not be read again
+  unsigned bytes;
+  BYTE data[16];
+  stream1.Seek(-100000, FILE_END);
+  CPPUNIT_ASSERT_THROW(stream1.Read(data, sizeof(data), &bytes), EInternalException);
+  stream1.Close();
+  stream2.Close();
+
+  // a client coming later gets a round of its own
+  server.SetCastOptions(4, 1, 0, 10000);
+  CNetCastStream stream3;
+  stream3.Open(name.c_str(), IImageStream::forReading);
+  CPPUNIT_ASSERT(ReadCast(stream3, size));
+  CPPUNIT_ASSERT_EQUAL(2U, server.GetCastRoundCount());
+  stream3.Close();
+  server.Stop();
+}
+
+void NetCastTest::DetachTest()
+{
+  // larger than the window and the buffers of the connection of the slow client
+  const unsigned size = 32 * 1024 * 1024;
+  WriteImage(size, false);
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  wstring name = CastName(port, L"test.img");
+  server.SetCastOptions(4, 2, 10000, 500);
+
+  // the second client does not read until the first one is done, it is detached
+  // and continues in a round of its own
+  CNetCastStream stream1, stream2;
+  stream1.Open(name.c_str(), IImageStream::forReading);
+  stream2.Open(name.c_str(), IImageStream::forReading);
+  CPPUNIT_ASSERT(ReadCast(stream1, size));
+  CPPUNIT_ASSERT(ReadCast(stream2, size));
+  CPPUNIT_ASSERT_EQUAL(2U, server.GetCastRoundCount());
+  stream1.Close();
+  stream2.Close();
+  server.Stop();
+}
+
+void NetCastTest::ChecksumTest()
+{
+  const unsigned size = 2 * 1024 * 1024;
+  WriteImage(size, true);
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  wstring name = CastName(port, L"test.img");
+
+  // the last block is not sent when the checksum is wrong
+  CNetCastStream stream;
+  stream.Open(name.c_str(), IImageStream::forReading);
+  CPPUNIT_ASSERT_THROW(ReadCast(stream, size), EInternalException);
+  stream.Close();
+  server.Stop();
+}
@@ -0,0 +1,170 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include <vector>
+#include <string>
+#include "NetImageStreamTest.h"
+#include "..\..\src\ODIN\NetImageStream.h"
+#include "..\..\src\ODIN\NetImageServer.h"
+#include "..\..\src\ODIN\OSException.h"
+#include "..\..\src\ODIN\InternalException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( NetImageStreamTest );
+
+static const wchar_t sImageDir[] = L"TestNetImages";
+
+static wstring ImageName(unsigned short port, LPCWSTR path)
+{
+  return L"odin://127.0.0.1:" + to_wstring(port) + L"/" + path;
+}
+
+// pseudo random data, the same for the same position
+static BYTE DataAt(unsigned pos)
+{
+  unsigned x = pos * 2654435761U;
+  return (BYTE) (x >> 24);
+}
+
+void NetImageStreamTest::setUp()
+{
+  DeleteImages();
+  CreateDirectory(sImageDir, NULL);
+}
+
+void NetImageStreamTest::tearDown()
+{
+  DeleteImages();
+}
+
+void NetImageStreamTest::DeleteImages()
+{
+  wstring dir(sImageDir);
+  DeleteFile((dir + L"\\test.img").c_str());
+  RemoveDirectory(sImageDir);
+}
+
+void NetImageStreamTest::NameTest()
+{
+  CPPUNIT_ASSERT(CNetImageStream::IsNetName(L"odin://server/images/disk.img"));
+  CPPUNIT_ASSERT(CNetImageStream::IsNetName(L"ODIN://[::1]:7000/disk.img"));
+  CPPUNIT_ASSERT(!CNetImageStream::IsNetName(L"C:\\images\\disk.img"));
+  CPPUNIT_ASSERT(!CNetImageStream::IsNetName(L"odin:/server/disk.img"));
+
+  // names without a path or with a wrong port are refused before connecting
+  CNetImageStream stream;
+  CPPUNIT_ASSERT_THROW(stream.Open(L"odin://server", IImageStream::forReading), EInternalException);
+  CPPUNIT_ASSERT_THROW(stream.Open(L"odin://server:99999/disk.img", IImageStream::forReading), EInternalException);
+}
+
+void NetImageStreamTest::WriteReadTest()
+{
+  const unsigned size = 1000000;
+  const unsigned blockSize = 65536;
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  wstring name = ImageName(port, L"test.img");
+  vector<BYTE> buffer(size);
+  unsigned bytes;
+
+  // small blocks and windows so that the blocks are spread over all connections
+  {
+    CNetImageStream stream(3, blockSize, 2);
+    stream.Open(name.c_str(), IImageStream::forWriting);
+    CPPUNIT_ASSERT_EQUAL(3U, stream.GetConnectionCount());
+    for (unsigned i=0; i<size; i++)
+      buffer[i] = DataAt(i);
+    // a header written first and rewritten at the end like the image file header
+    vector<BYTE> header(512, 0);
+    stream.Write(&header[0], 512, &bytes);
+    for (unsigned pos=512, len=1; pos<size; pos+=len, len=len*3+7) {
+      len = min(len, size - pos);
+      stream.Write(&buffer[pos], len, &bytes);
+      CPPUNIT_ASSERT_EQUAL(len, bytes);
+    }
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, stream.GetPosition());
+    stream.Seek(0, FILE_BEGIN);
+    stream.Write(&buffer[0], 512, &bytes);
+    stream.Seek(0, FILE_END);
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, stream.GetPosition());
+    stream.Close();
+  }
+
+  // sequential reads and reads after seeks in both directions
+  {
+    CNetImageStream stream(3, blockSize, 2);
+    stream.Open(name.c_str(), IImageStream::forReading);
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, stream.GetSize());
+    vector<BYTE> readBuffer(size);
+    for (unsigned pos=0, len=5; pos<size; pos+=len, len=len*2+3) {
+      len = min(len, size - pos);
+      stream.Read(&readBuffer[pos], len, &bytes);
+      CPPUNIT_ASSERT_EQUAL(len, bytes);
+    }
+    CPPUNIT_ASSERT(readBuffer == buffer);
+
+    const unsigned offsets[] = { 700000, 3, 65530, 999990, 131072 };
+    BYTE data[100];
+    for (unsigned i=0; i<sizeof(offsets)/sizeof(offsets[0]); i++) {
+      stream.Seek(offsets[i], FILE_BEGIN);
+      stream.Read(data, sizeof(data), &bytes);
+      CPPUNIT_ASSERT_EQUAL(min((unsigned) sizeof(data), size - offsets[i]), bytes);
+      CPPUNIT_ASSERT(memcmp(data, &buffer[offsets[i]], bytes) == 0);
+    }
+    // reading at the end returns nothing
+    stream.Seek(0, FILE_END);
+    stream.Read(data, sizeof(data), &bytes);
+    CPPUNIT_ASSERT_EQUAL(0U, bytes);
+    stream.Close();
+  }
+  server.Stop();
+}
+
+void NetImageStreamTest::PathTest()
+{
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  CNetImageStream stream;
+
+  // paths leaving the directory of the server and missing images are reported by the server
+  CPPUNIT_ASSERT_THROW(stream.Open(ImageName(port, L"../test.img").c_str(), IImageStream::forWriting),
+                       EInternalException);
+  CPPUNIT_ASSERT_THROW(stream.Open(ImageName(port, L"missing.img").c_str(), IImageStream::forReading),
+                       EInternalException);
+  server.Stop();
+}
+
+void NetImageStreamTest::ConnectTest()
+{
+  CNetImageServer server(sImageDir);
+  unsigned short port = server.Start(0);
+  server.Stop();
+
+  // nobody listens on the port any more
+  CNetImageStream stream;
+  CPPUNIT_ASSERT_THROW(stream.Open(ImageName(port, L"test.img").c_str(), IImageStream::forReading), EWinException);
+}
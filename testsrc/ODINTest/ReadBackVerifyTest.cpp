@@ -0,0 +1,180 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+ 
+#include "stdafx.h"
+#include <vector>
+#include "ReadBackVerifyTest.h"
+#include "RunLengthStreamSimulator.h"
+#include "MemoryImageStream.h"
+#include "..\..\src\ODIN\ReadBackVerifier.h"
+#include "..\..\src\ODIN\ReadThread.h"
+#include "..\..\src\ODIN\WriteThread.h"
+#include "..\..\src\ODIN\BufferQueue.h"
+#include "..\..\src\ODIN\InternalException.h"
+
+using namespace std;
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( ReadBackVerifyTest );
+
+static const unsigned sBlockSize = 4096;
+
+// a memory image stream that changes one byte on the way to the media
+class CCorruptingImageStream : public CMemoryImageStream
+{
+public:
+  CCorruptingImageStream(std::vector<BYTE>& data, unsigned __int64 corruptOffset)
+    : CMemoryImageStream(data, true), fMedia(data), fCorruptOffset(corruptOffset)
+  {
+  }
+
+  virtual void Write(void *buffer, unsigned nLength, unsigned *nBytesWritten) {
+    unsigned __int64 pos = GetPosition();
+    CMemoryImageStream::Write(buffer, nLength, nBytesWritten);
+    if (fCorruptOffset >= pos && fCorruptOffset < pos + nLength)
+      fMedia[(size_t) fCorruptOffset] ^= 0x10;
+  }
+
+private:
+  std::vector<BYTE>& fMedia;
+  unsigned __int64 fCorruptOffset;
+};
+
+void ReadBackVerifyTest::setUp()
+{
+}
+
+void ReadBackVerifyTest::tearDown()
+{
+}
+
+void ReadBackVerifyTest::ReadBackTest()
+{
+  const unsigned size = 64 * sBlockSize;
+  vector<BYTE> data(size), target(size);
+  unsigned bytesWritten;
+
+  FillBuffer(&data[0], size, 1);
+  CMemoryImageStream stream(target, true);
+  {
+    CReadBackVerifier verifier(&stream, 8 * sBlockSize, 16, 32 * sBlockSize);
+    verifier.Write(&data[0], 16 * sBlockSize, &bytesWritten);
+    CPPUNIT_ASSERT_EQUAL(16 * sBlockSize, bytesWritten);
+    verifier.Write(&data[16 * sBlockSize], 8 * sBlockSize, &bytesWritten);
+    // skip a range and write it later
+    verifier.Seek(40 * sBlockSize);
+    verifier.Write(&data[40 * sBlockSize], 24 * sBlockSize, &bytesWritten);
+    verifier.Seek(24 * sBlockSize);
+    verifier.Write(&data[24 * sBlockSize], 16 * sBlockSize, &bytesWritten);
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) 40 * sBlockSize, verifier.GetPosition());
+    verifier.Finish();
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, verifier.GetVerifiedBytes());
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) -1, verifier.GetMismatchOffset());
+  }
+  CPPUNIT_ASSERT(data == target);
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, stream.GetBytesWritten());
+}
+
+void ReadBackVerifyTest::SmallRetentionTest()
+{
+  // writes larger than the ring buffer and a distance the ring buffer can not hold:
+  // the writer waits for the read back instead of blocking it
+  const unsigned size = 256 * sBlockSize;
+  vector<BYTE> data(size), target;
+  unsigned bytesWritten;
+
+  FillBuffer(&data[0], size, 2);
+  CMemoryImageStream stream(target, false);
+  {
+    CReadBackVerifier verifier(&stream, size, 2, 3 * sBlockSize + 100);
+    for (unsigned pos=0; pos<size; pos+=16 * sBlockSize) {
+      verifier.Write(&data[pos], 16 * sBlockSize, &bytesWritten);
+      CPPUNIT_ASSERT_EQUAL(16 * sBlockSize, bytesWritten);
+    }
+    verifier.Finish();
+    CPPUNIT_ASSERT_EQUAL((unsigned __int64) size, verifier.GetVerifiedBytes());
+  }
+  CPPUNIT_ASSERT(data == target);
+}
+
+void ReadBackVerifyTest::MismatchTest()
+{
+  const unsigned size = 32 * sBlockSize;
+  const unsigned __int64 corruptOffset = 21 * sBlockSize + 1234;
+  vector<BYTE> data(size), target(size);
+  unsigned bytesWritten;
+
+  FillBuffer(&data[0], size, 3);
+  CCorruptingImageStream stream(target, corruptOffset);
+  CReadBackVerifier verifier(&stream, 0, 4, 8 * sBlockSize);
+  try {
+    for (unsigned pos=0; pos<size; pos+=4 * sBlockSize)
+      verifier.Write(&data[pos], 4 * sBlockSize, &bytesWritten);
+    verifier.Finish();
+    CPPUNIT_FAIL("EInternalException was expected");
+  } catch (EInternalException& e) {
+    CPPUNIT_ASSERT_EQUAL((int) EInternalException::readBackMismatch, e.GetErrorCode());
+    CPPUNIT_ASSERT(wstring(e.GetMessage()).find(L"offset 87250") != wstring::npos);
+  }
+  CPPUNIT_ASSERT_EQUAL(corruptOffset, verifier.GetMismatchOffset());
+  CPPUNIT_ASSERT(verifier.GetVerifiedBytes() <= 20 * sBlockSize);
+}
+
+void ReadBackVerifyTest::RunLengthRestoreTest()
+{
+  // a volume of 64 clusters with alternating runs of used and free clusters
+  // (the run length simulator needs an even number of values)
+  int runLengths[] = { 10, 3, 7, 5, 20, 4, 15, 0 };
+  const int runLengthCount = sizeof(runLengths) / sizeof(runLengths[0]);
+  const unsigned volumeSize = 64 * sBlockSize;
+  vector<BYTE> volume(volumeSize), image, target(volumeSize);
+
+  // image holds the used clusters of volume
+  FillBuffer(&volume[0], volumeSize, 4);
+  unsigned __int64 pos = 0;
+  vector<BYTE> expected(volumeSize);
+  for (int i=0; i<runLengthCount; i+=2) {
+    image.insert(image.end(), volume.begin() + (size_t) pos, volume.begin() + (size_t) (pos + runLengths[i] * sBlockSize));
+    memcpy(&expected[(size_t) pos], &volume[(size_t) pos], runLengths[i] * sBlockSize);
+    pos += (runLengths[i] + runLengths[i+1]) * sBlockSize;
+  }
+
+  CImageBuffer emptyQueue(3 * sBlockSize, 4), filledQueue;
+  CMemoryImageStream source(image, false);
+  CMemoryImageStream targetStream(target, true);
+  CRunLengthStreamReaderSimulator runLengthReader(runLengths, runLengthCount);
+  CReadThread readThread(&source, &emptyQueue, &filledQueue, false);
+  CWriteThread writeThread(&targetStream, &filledQueue, &emptyQueue, false);
+
+  writeThread.SetAllocationMapReaderInfo(&runLengthReader, sBlockSize);
+  writeThread.SetReadBackVerify(8 * sBlockSize, 4, 10 * sBlockSize, NULL);
+  readThread.Resume();
+  writeThread.Resume();
+  readThread.WaitForThread();
+  writeThread.WaitForThread();
+  CPPUNIT_ASSERT(!readThread.GetErrorFlag());
+  CPPUNIT_ASSERT(!writeThread.GetErrorFlag());
+  CPPUNIT_ASSERT_EQUAL(readThread.GetCrc32(), writeThread.GetCrc32());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) image.size(), writeThread.GetReadBackVerifiedBytes());
+  CPPUNIT_ASSERT(expected == target);
+}
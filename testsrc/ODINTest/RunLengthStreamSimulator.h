@@ -25,7 +25,7 @@
 #ifndef __RUNLENGTHSTREAMREADER_H__
 #define __RUNLENGTHSTREAMREADER_H__
 
-#include "..\..\src\ODIN\IRunLengthStreamReader.h"
+#include "../../src/ODIN/IRunLengthStreamReader.h"
 
 // This class is a simple simulator of a runlength stream reader
 // It is constructed with a list of run length valuse and just
@@ -0,0 +1,123 @@
+/******************************************************************************
+
+    ODIN - Open Disk Imager in a Nutshell
+
+    Copyright (C) 2008
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, version 3 of the License.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>
+
+    For more information and the latest version of the source code see
+    <http://sourceforge.net/projects/odin-win>
+
+******************************************************************************/
+
+
+#include "stdafx.h"
+#include "ThrottleTest.h"
+#include "..\..\src\ODIN\Throttle.h"
+
+// Registers the fixture into the 'registry'
+CPPUNIT_TEST_SUITE_REGISTRATION( ThrottleTest );
+
+static const unsigned __int64 sMB = 1048576;
+static const unsigned __int64 sSecond = 1000000; // microseconds
+static const unsigned __int64 sStart = 1000 * sSecond;
+
+void ThrottleTest::setUp()
+{
+}
+
+void ThrottleTest::tearDown()
+{
+}
+
+void ThrottleTest::UnlimitedTest()
+{
+  CThrottle throttle;
+  CPPUNIT_ASSERT(!throttle.IsLimited());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 0, throttle.Take(100 * sMB, 1000, sStart));
+  throttle.SetLimits(sMB, 0);
+  CPPUNIT_ASSERT(throttle.IsLimited());
+  throttle.SetLimits(0, 0);
+  CPPUNIT_ASSERT(!throttle.IsLimited());
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 0, throttle.Take(100 * sMB, 1000, sStart));
+}
+
+void ThrottleTest::ByteRateTest()
+{
+  CThrottle throttle;
+  throttle.SetLimits(sMB, 0);
+  // the bucket starts empty, the first I/O is paid off afterwards
+  CPPUNIT_ASSERT_EQUAL(sSecond, throttle.Take(sMB, 1, sStart));
+  // the caller has waited one second, the next half MB takes half a second
+  CPPUNIT_ASSERT_EQUAL(sSecond / 2, throttle.Take(sMB / 2, 1, sStart + sSecond));
+  // a caller not waiting runs into debt: another MB right away needs 1.5 seconds
+  CPPUNIT_ASSERT_EQUAL(sSecond * 3 / 2, throttle.Take(sMB, 1, sStart + sSecond));
+  // the rate is kept over all I/Os: after 10MB in 10s the bucket is even
+  CThrottle other;
+  other.SetLimits(sMB, 0);
+  unsigned __int64 now = sStart;
+  for (int i=0; i<10; i++)
+    now += other.Take(sMB, 1, now);
+  CPPUNIT_ASSERT_EQUAL(sStart + 10 * sSecond, now);
+}
+
+void ThrottleTest::BurstTest()
+{
+  CThrottle throttle;
+  throttle.SetLimits(4 * sMB, 0);
+  CPPUNIT_ASSERT_EQUAL(sSecond / 4, throttle.Take(sMB, 1, sStart));
+  // after a long pause at most the tokens of the burst time are available
+  CPPUNIT_ASSERT_EQUAL((unsigned __int64) 0, throttle.Take(sMB, 1, sStart + 60 * sSecond));
+  CPPUNIT_ASSERT_EQUAL(sSecond / 4, throttle.Take(sMB, 1, sStart + 60 * sSecond));
+}
+
+void ThrottleTest::OpsRateTest()
+{
+  CThrottle throttle;
+  throttle.SetLimits(0, 10);
+  CPPUNIT_ASSERT_EQUAL(sSecond / 10, throttle.Take(100 * sMB, 1, sStart));
+  CPPUNIT_ASSERT_EQUAL(sSecond / 10, throttle.Take(512, 1, sStart + sSecond / 10));
+  // with both limits the one that is further behind decides
+  throttle.SetLimits(sMB, 10);
+  CPPUNIT_ASSERT_EQUAL(sSecond / 10, throttle.Take(4096, 1, sStart));
+  throttle.SetLimits(sMB, 10);
+  CPPUNIT_ASSERT_EQUAL(2 * sSecond, throttle.Take(2 * sMB, 1, sStart));
+  CPPUNIT_ASSERT_EQUAL(sMB, throttle.GetBytesPerSecond());
+  CPPUNIT_ASSERT_EQUAL(10u, throttle.GetOpsPerSecond());
+}
+
+void ThrottleTest::ChangeLimitsTest()
+{
+  CThrottle throttle;
+  throttle.SetLimits(sMB, 0);
+  CPPUNIT_ASSERT_EQUAL(10 * sSecond, throttle.Take(10 * sMB, 1, sStart));
+  // new limits forgive the debt of the former ones
+  throttle.SetLimits(2 * sMB, 0);
+  CPPUNIT_ASSERT_EQUAL(sSecond / 2, throttle.Take(sMB, 1, sStart));
+}
+
+void ThrottleTest::ConsumeTest()
+{
+  CThrottle throttle;
+  DWORD start = GetTickCount();
+  throttle.Consume((unsigned) (100 * sMB));
+  CPPUNIT_ASSERT(GetTickCount() - start < 100);
+
+  // 1MB at 4MB/s
+  throttle.SetLimits(4 * sMB, 0);
+  start = GetTickCount();
+  throttle.Consume((unsigned) sMB);
+  DWORD elapsed = GetTickCount() - start;
+  CPPUNIT_ASSERT(elapsed >= 200 && elapsed < 1000);
+}
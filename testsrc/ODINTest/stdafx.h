@@ -5,6 +5,8 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 #include <stdio.h>
 #include <tchar.h>
 #include <memory>
@@ -33,3 +35,12 @@ extern CAppModule _Module;
 // to track memory allocations:
 #include "..\..\src\ODIN\DebugMem.h"
 
+#else
+
+// only the volume simulators are built on POSIX systems, for the benchmarks
+#include <stdio.h>
+#include <memory>
+#include "../../src/ODIN/posix/PosixPlatform.h"
+
+#endif
+